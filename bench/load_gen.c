@@ -0,0 +1,578 @@
+/**
+ * @file bench/load_gen.c
+ * @brief 服务端负载生成器
+ *
+ * 以多个线程建立 N 个连接，登录 N 个合成用户（服务端以 --synthetic-users 预先添加，
+ * 用户名为 bench0、bench1……），然后按设定的速率和比例发送私聊、广播和 STATUS，
+ * 统计吞吐量和端到端延迟。
+ *
+ * 私聊和广播的内容里带着发送时刻（单调时钟微秒），所有连接都在本进程内，
+ * 收到时用同一时钟相减即为端到端延迟，广播的每个接收者各记一次。
+ * STATUS 的延迟是请求发出到收到第一行响应的时间，每个连接同时只有一个未完成的 STATUS。
+ * 延迟记在 utils/metrics 的按线程直方图中，结束时合并。
+ *
+ * 用法：load_gen [-h host] [-p port] [-c 连接数] [-t 线程数] [-d 秒数]
+ *                [-r 每连接每秒消息数] [-m 私聊:广播:STATUS] [-s 内容字节数] [-u 用户名前缀]
+ * host 为 unix:<路径> 时经服务端的本机 Unix 套接字连接，用于比较与 TCP 回环的差别。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/network/network.h"
+#include "../src/protocol/protocol.h"
+#include "../src/storage/storage.h"
+
+#define LOAD_MAX_CONNECTIONS 1000 /* tcp_connect 用 select 等待连接完成，描述符不能超过 FD_SETSIZE */
+#define LOAD_MAX_THREADS 64
+#define LOAD_LOGIN_TIMEOUT_US (10 * 1000000ull) /* 等待全部登录完成的最长时间 */
+#define LOAD_DRAIN_US (1000000ull)				/* 停止发送后继续接收的时间 */
+#define LOAD_POLL_MS 5							/* 每次等待事件的最长时间 */
+#define LOAD_PAYLOAD_TAG "lg "					/* 负载消息内容的前缀，后跟发送时刻 */
+
+/** 负载消息的种类，同时是发送计数器、送达计数器和延迟直方图的编号 */
+typedef enum
+{
+	LOAD_MSG = 0,
+	LOAD_BROADCAST,
+	LOAD_STATUS,
+	LOAD_KINDS
+} LoadKind;
+
+#define LOAD_DELIVERED(kind) (LOAD_KINDS + (kind)) /* 送达计数器编号 */
+#define LOAD_ERRORS (LOAD_KINDS * 2)			   /* ERROR 响应计数器编号 */
+#define LOAD_FAILURES (LOAD_KINDS * 2 + 1)		   /* 发送失败或连接断开计数器编号 */
+#define LOAD_LOGIN_LATENCY LOAD_KINDS			   /* 登录耗时直方图编号 */
+
+static const char *const kind_names[LOAD_KINDS] = {"MSG", "BROADCAST", "STATUS"};
+
+/**
+ * @brief 负载生成器的参数
+ */
+typedef struct
+{
+	const char *host;		 /**< 服务端地址 */
+	int port;				 /**< 服务端端口 */
+	int connections;		 /**< 连接数（也是用户数） */
+	int threads;			 /**< 线程数 */
+	int duration;			 /**< 发送持续的秒数 */
+	double rate;			 /**< 每个连接每秒发送的消息数 */
+	int mix[LOAD_KINDS];	 /**< 私聊、广播、STATUS 的比例 */
+	int payload;			 /**< 消息内容字节数 */
+	const char *prefix;		 /**< 用户名前缀 */
+} LoadOptions;
+
+/**
+ * @brief 一个负载连接
+ */
+typedef struct
+{
+	socket_t fd;			   /**< 套接字，断开后为 SOCKET_INVALID */
+	int index;				   /**< 连接序号，用户名为前缀加序号 */
+	char username[MAX_USERNAME_LEN];
+	FrameBuffer recv_buffer;   /**< 接收分帧缓冲区 */
+	int logged_in;			   /**< 是否已登录 */
+	uint64_t login_sent_us;	   /**< 登录请求发出的时刻 */
+	uint64_t next_send_us;	   /**< 下一次发送的时刻 */
+	uint64_t status_sent_us;   /**< 未完成的 STATUS 发出的时刻，0 表示没有 */
+	unsigned int seed;		   /**< 本连接的随机数状态 */
+} LoadConn;
+
+/**
+ * @brief 一个负载线程及其负责的连接
+ */
+typedef struct
+{
+	platform_thread_t thread;
+	LoadConn *conns;
+	int count;
+	Poller *poller;
+} LoadThread;
+
+static LoadOptions options = {
+	.host = "127.0.0.1",
+	.port = DEFAULT_PORT,
+	.connections = 100,
+	.threads = 4,
+	.duration = 10,
+	.rate = 10.0,
+	.mix = {90, 5, 5},
+	.payload = 32,
+	.prefix = SYNTHETIC_USER_PREFIX};
+
+static atomic_int logins_done = 0;		   /* 登录成功或失败的连接数 */
+static atomic_int logins_ok = 0;		   /* 登录成功的连接数 */
+static atomic_uint_fast64_t start_us = 0;  /* 开始发送的时刻，0 表示尚未开始 */
+static atomic_uint_fast64_t stop_us = 0;   /* 停止发送的时刻 */
+static atomic_int finished = 0;			   /* 接收阶段结束 */
+
+/**
+ * @brief 线性同余随机数，每个连接一份状态，线程之间互不影响
+ */
+static unsigned int next_random(unsigned int *seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return (*seed >> 16) & 0x7FFF;
+}
+
+/**
+ * @brief 按比例选择下一条消息的种类
+ */
+static LoadKind pick_kind(LoadConn *conn)
+{
+	int total = options.mix[LOAD_MSG] + options.mix[LOAD_BROADCAST] + options.mix[LOAD_STATUS];
+	int roll = (int)(next_random(&conn->seed) % (unsigned int)total);
+
+	for (int kind = 0; kind < LOAD_KINDS; kind++)
+	{
+		if (roll < options.mix[kind])
+			return (LoadKind)kind;
+		roll -= options.mix[kind];
+	}
+	return LOAD_MSG;
+}
+
+/**
+ * @brief 发送一条由 build_* 构建的消息后释放它，发送失败时关闭连接
+ */
+static int send_built(LoadThread *self, LoadConn *conn, char *frame)
+{
+	if (!frame)
+		return -1;
+
+	int result = tcp_send(conn->fd, frame, strlen(frame));
+	build_free(frame);
+	if (result != 0)
+	{
+		metrics_add(LOAD_FAILURES, 1);
+		poller_remove(self->poller, conn->fd);
+		platform_socket_close(conn->fd);
+		conn->fd = SOCKET_INVALID;
+	}
+	return result;
+}
+
+/**
+ * @brief 生成带发送时刻的消息内容
+ */
+static void make_payload(char *content, size_t cap, uint64_t now)
+{
+	int n = snprintf(content, cap, LOAD_PAYLOAD_TAG "%llu ", (unsigned long long)now);
+	size_t len = n > 0 ? (size_t)n : 0;
+	size_t want = (size_t)options.payload < cap - 1 ? (size_t)options.payload : cap - 1;
+
+	while (len < want)
+		content[len++] = 'x';
+	content[len] = '\0';
+}
+
+/**
+ * @brief 发送下一条负载消息
+ */
+static void send_next(LoadThread *self, LoadConn *conn, uint64_t now)
+{
+	char content[MAX_CONTENT_LEN];
+	char receiver[MAX_USERNAME_LEN];
+	LoadKind kind = pick_kind(conn);
+	char *frame = NULL;
+
+	/* 上一个 STATUS 还没有响应时改发私聊，延迟统计保持一问一答 */
+	if (kind == LOAD_STATUS && conn->status_sent_us != 0)
+		kind = LOAD_MSG;
+
+	switch (kind)
+	{
+	case LOAD_MSG:
+	{
+		int target = conn->index;
+		if (options.connections > 1)
+			target = (conn->index + 1 + (int)(next_random(&conn->seed) % (unsigned int)(options.connections - 1))) % options.connections;
+		snprintf(receiver, sizeof(receiver), "%s%d", options.prefix, target);
+		make_payload(content, sizeof(content), now);
+		frame = build_text_msg(conn->username, receiver, content);
+		break;
+	}
+	case LOAD_BROADCAST:
+		make_payload(content, sizeof(content), now);
+		frame = build_broadcast_msg(conn->username, content);
+		break;
+	case LOAD_STATUS:
+		conn->status_sent_us = now;
+		frame = build_status_request(conn->username);
+		break;
+	default:
+		return;
+	}
+
+	if (send_built(self, conn, frame) == 0)
+		metrics_add(kind, 1);
+}
+
+/**
+ * @brief 处理收到的一帧
+ */
+static void handle_frame(LoadConn *conn, char *frame, size_t frame_len, uint64_t now)
+{
+	Message msg;
+
+	if (parse_message_into(frame, frame_len, &msg) != 0)
+	{
+		metrics_add(LOAD_ERRORS, 1);
+		return;
+	}
+
+	if (strcmp(msg.type, MSG_TYPE_MSG) == 0 || strcmp(msg.type, MSG_TYPE_BROADCAST) == 0)
+	{
+		if (strncmp(msg.content, LOAD_PAYLOAD_TAG, strlen(LOAD_PAYLOAD_TAG)) != 0)
+			return;
+		uint64_t sent = strtoull(msg.content + strlen(LOAD_PAYLOAD_TAG), NULL, 10);
+		LoadKind kind = msg.type[0] == 'M' ? LOAD_MSG : LOAD_BROADCAST;
+		metrics_add(LOAD_DELIVERED(kind), 1);
+		metrics_record(kind, now > sent ? now - sent : 0);
+	}
+	else if (strcmp(msg.type, MSG_TYPE_OK) == 0)
+	{
+		if (!conn->logged_in && strstr(msg.content, "Login successful"))
+		{
+			conn->logged_in = 1;
+			metrics_record(LOAD_LOGIN_LATENCY, now - conn->login_sent_us);
+			atomic_fetch_add(&logins_ok, 1);
+			atomic_fetch_add(&logins_done, 1);
+		}
+		else if (conn->status_sent_us != 0 && strstr(msg.content, "Server Status:"))
+		{
+			metrics_add(LOAD_DELIVERED(LOAD_STATUS), 1);
+			metrics_record(LOAD_STATUS, now - conn->status_sent_us);
+			conn->status_sent_us = 0;
+		}
+	}
+	else if (strcmp(msg.type, MSG_TYPE_ERROR) == 0)
+	{
+		metrics_add(LOAD_ERRORS, 1);
+		if (!conn->logged_in)
+		{
+			LOG_WARN("Login failed for %s: %s", conn->username, msg.content);
+			conn->logged_in = -1;
+			atomic_fetch_add(&logins_done, 1);
+		}
+	}
+}
+
+/**
+ * @brief 读取连接上的数据并处理其中的完整帧
+ */
+static void receive_frames(LoadThread *self, LoadConn *conn)
+{
+	size_t space = 0;
+	char *dest = frame_buffer_reserve(&conn->recv_buffer, BUFFER_SIZE, &space);
+	if (!dest)
+		return;
+
+	int received = tcp_receive(conn->fd, dest, space);
+	if (received < 0)
+	{
+		if (conn->logged_in == 0)
+		{
+			conn->logged_in = -1;
+			atomic_fetch_add(&logins_done, 1);
+		}
+		metrics_add(LOAD_FAILURES, 1);
+		poller_remove(self->poller, conn->fd);
+		platform_socket_close(conn->fd);
+		conn->fd = SOCKET_INVALID;
+		return;
+	}
+	if (received == 0)
+		return;
+	frame_buffer_commit(&conn->recv_buffer, (size_t)received);
+
+	uint64_t now = platform_monotonic_us();
+	char *frame;
+	size_t frame_len;
+	while (frame_buffer_next(&conn->recv_buffer, &frame, &frame_len) > 0)
+		handle_frame(conn, frame, frame_len, now);
+	frame_buffer_compact(&conn->recv_buffer);
+}
+
+/**
+ * @brief 找到套接字对应的连接（连接数组按线程划分，线性查找足够）
+ */
+static LoadConn *find_conn(LoadThread *self, socket_t fd)
+{
+	for (int i = 0; i < self->count; i++)
+	{
+		if (self->conns[i].fd == fd)
+			return &self->conns[i];
+	}
+	return NULL;
+}
+
+/**
+ * @brief 负载线程：连接并登录自己负责的用户，开始后按时刻表发送，始终接收
+ */
+static platform_thread_return_t PLATFORM_THREAD_CALL load_thread_main(void *arg)
+{
+	LoadThread *self = (LoadThread *)arg;
+	PollerEvent events[POLLER_DEFAULT_BATCH];
+	uint64_t interval_us = (uint64_t)(1000000.0 / options.rate);
+
+	for (int i = 0; i < self->count; i++)
+	{
+		LoadConn *conn = &self->conns[i];
+		conn->fd = tcp_connect(options.host, options.port);
+		uint64_t now = platform_monotonic_us();
+		if (SOCKET_IS_INVALID(conn->fd) || poller_add(self->poller, conn->fd, POLLER_EVENT_READ) != 0)
+		{
+			conn->logged_in = -1;
+			atomic_fetch_add(&logins_done, 1);
+			continue;
+		}
+		conn->login_sent_us = now;
+		char password[MAX_PASSWORD_LEN + 8];
+		snprintf(password, sizeof(password), "%s123", conn->username);
+		if (send_built(self, conn, build_login_msg(conn->username, password)) != 0)
+		{
+			conn->logged_in = -1;
+			atomic_fetch_add(&logins_done, 1);
+		}
+	}
+
+	while (!atomic_load(&finished))
+	{
+		uint64_t started = atomic_load(&start_us);
+		uint64_t stopping = atomic_load(&stop_us);
+		uint64_t now = platform_monotonic_us();
+
+		if (started != 0 && now < stopping)
+		{
+			for (int i = 0; i < self->count; i++)
+			{
+				LoadConn *conn = &self->conns[i];
+				if (SOCKET_IS_INVALID(conn->fd) || conn->logged_in != 1)
+					continue;
+				if (conn->next_send_us == 0)
+					conn->next_send_us = started + next_random(&conn->seed) % (interval_us + 1);
+				/* 落后超过一秒时不再补发，避免一次性涌出积压的消息 */
+				if (now > conn->next_send_us + 1000000)
+					conn->next_send_us = now;
+				while (conn->next_send_us <= now && SOCKET_IS_VALID(conn->fd))
+				{
+					send_next(self, conn, now);
+					conn->next_send_us += interval_us;
+				}
+			}
+		}
+
+		int ready = poller_wait(self->poller, events, POLLER_DEFAULT_BATCH, LOAD_POLL_MS);
+		for (int i = 0; i < ready; i++)
+		{
+			LoadConn *conn = find_conn(self, events[i].fd);
+			if (conn)
+				receive_frames(self, conn);
+		}
+	}
+
+	for (int i = 0; i < self->count; i++)
+	{
+		if (SOCKET_IS_VALID(self->conns[i].fd))
+			platform_socket_close(self->conns[i].fd);
+		frame_buffer_free(&self->conns[i].recv_buffer);
+	}
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/**
+ * @brief 解析 -m 的比例参数，格式为 私聊:广播:STATUS
+ */
+static int parse_mix(const char *text)
+{
+	int mix[LOAD_KINDS];
+	if (sscanf(text, "%d:%d:%d", &mix[LOAD_MSG], &mix[LOAD_BROADCAST], &mix[LOAD_STATUS]) != 3)
+		return -1;
+	if (mix[0] < 0 || mix[1] < 0 || mix[2] < 0 || mix[0] + mix[1] + mix[2] <= 0)
+		return -1;
+	memcpy(options.mix, mix, sizeof(mix));
+	return 0;
+}
+
+/**
+ * @brief 解析命令行参数
+ */
+static int parse_options(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char *flag = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (flag[0] != '-' || flag[1] == '\0' || flag[2] != '\0' || !value)
+			return -1;
+		i++;
+
+		switch (flag[1])
+		{
+		case 'h':
+			options.host = value;
+			break;
+		case 'p':
+			options.port = atoi(value);
+			break;
+		case 'c':
+			options.connections = atoi(value);
+			break;
+		case 't':
+			options.threads = atoi(value);
+			break;
+		case 'd':
+			options.duration = atoi(value);
+			break;
+		case 'r':
+			options.rate = atof(value);
+			break;
+		case 'm':
+			if (parse_mix(value) != 0)
+				return -1;
+			break;
+		case 's':
+			options.payload = atoi(value);
+			break;
+		case 'u':
+			options.prefix = value;
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	if (!is_valid_port(options.port) || options.connections < 1 || options.duration < 1 || options.rate <= 0)
+		return -1;
+	if (options.connections > LOAD_MAX_CONNECTIONS)
+		options.connections = LOAD_MAX_CONNECTIONS;
+	if (options.threads < 1)
+		options.threads = 1;
+	if (options.threads > LOAD_MAX_THREADS)
+		options.threads = LOAD_MAX_THREADS;
+	if (options.threads > options.connections)
+		options.threads = options.connections;
+	if (options.payload < 0 || options.payload > MAX_CONTENT_LEN - 1)
+		options.payload = MAX_CONTENT_LEN - 1;
+	return 0;
+}
+
+/**
+ * @brief 打印一种消息的发送数、送达数、速率和延迟分位数
+ */
+static void print_kind(const char *name, int sent_id, int delivered_id, int histogram_id, double seconds)
+{
+	MetricsSummary s;
+	metrics_histogram(histogram_id, &s);
+	printf("%-10s %10llu %12llu %12.1f %9llu %9llu %9llu %9llu\n", name,
+		   sent_id >= 0 ? (unsigned long long)metrics_counter(sent_id) : 0ull,
+		   delivered_id >= 0 ? (unsigned long long)metrics_counter(delivered_id) : (unsigned long long)s.count,
+		   (double)s.count / seconds,
+		   (unsigned long long)s.p50, (unsigned long long)s.p99,
+		   (unsigned long long)s.p999, (unsigned long long)s.max);
+}
+
+int main(int argc, char *argv[])
+{
+	if (parse_options(argc, argv) != 0)
+	{
+		fprintf(stderr, "Usage: %s [-h host] [-p port] [-c connections] [-t threads] [-d seconds]\n"
+						"       [-r msgs/s per connection] [-m msg:broadcast:status] [-s payload bytes] [-u user prefix]\n"
+						"The server must have the synthetic users, e.g. ./bin/server 8080 --synthetic-users=<connections>\n",
+				argv[0]);
+		return 1;
+	}
+
+	set_log_file("load_gen.log");
+	set_log_level(LOG_WARNING);
+
+	LoadConn *conns = (LoadConn *)calloc((size_t)options.connections, sizeof(LoadConn));
+	LoadThread *threads = (LoadThread *)calloc((size_t)options.threads, sizeof(LoadThread));
+	if (!conns || !threads)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	/* 连接按线程连续划分 */
+	int per_thread = (options.connections + options.threads - 1) / options.threads;
+	for (int i = 0; i < options.connections; i++)
+	{
+		conns[i].fd = SOCKET_INVALID;
+		conns[i].index = i;
+		conns[i].seed = 2166136261u ^ (unsigned int)i;
+		snprintf(conns[i].username, sizeof(conns[i].username), "%s%d", options.prefix, i);
+		frame_buffer_init(&conns[i].recv_buffer, 0);
+	}
+	for (int t = 0; t < options.threads; t++)
+	{
+		int first = t * per_thread;
+		threads[t].conns = conns + first;
+		threads[t].count = first < options.connections ? (first + per_thread <= options.connections ? per_thread : options.connections - first) : 0;
+		threads[t].poller = poller_create(threads[t].count);
+		if (!threads[t].poller)
+		{
+			fprintf(stderr, "Failed to create poller\n");
+			return 1;
+		}
+	}
+
+	printf("=== Load test: %d connections, %d threads, %d s, %.1f msg/s per connection, mix %d:%d:%d (msg:broadcast:status), %d-byte payload ===\n",
+		   options.connections, options.threads, options.duration, options.rate,
+		   options.mix[LOAD_MSG], options.mix[LOAD_BROADCAST], options.mix[LOAD_STATUS], options.payload);
+
+	for (int t = 0; t < options.threads; t++)
+		platform_thread_create(&threads[t].thread, load_thread_main, &threads[t]);
+
+	/* 等待全部连接登录完成，之后同时开始发送，离线队列不会混入统计 */
+	uint64_t login_begin = platform_monotonic_us();
+	while (atomic_load(&logins_done) < options.connections &&
+		   platform_monotonic_us() - login_begin < LOAD_LOGIN_TIMEOUT_US)
+		platform_sleep_ms(10);
+
+	int logged_in = atomic_load(&logins_ok);
+	MetricsSummary login;
+	metrics_histogram(LOAD_LOGIN_LATENCY, &login);
+	printf("Logged in: %d/%d in %.2f s (login p50 %llu us, p99 %llu us)\n", logged_in, options.connections,
+		   (double)(platform_monotonic_us() - login_begin) / 1e6,
+		   (unsigned long long)login.p50, (unsigned long long)login.p99);
+
+	if (logged_in > 0)
+	{
+		uint64_t begin = platform_monotonic_us();
+		atomic_store(&stop_us, begin + (uint64_t)options.duration * 1000000);
+		atomic_store(&start_us, begin);
+		uint64_t end = atomic_load(&stop_us) + LOAD_DRAIN_US;
+		while (platform_monotonic_us() < end)
+			platform_sleep_ms(100);
+	}
+	atomic_store(&finished, 1);
+	for (int t = 0; t < options.threads; t++)
+		platform_thread_join(threads[t].thread);
+
+	double seconds = (double)options.duration;
+	printf("%-10s %10s %12s %12s %9s %9s %9s %9s\n", "kind", "sent", "delivered", "delivered/s", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+	for (int kind = 0; kind < LOAD_KINDS; kind++)
+		print_kind(kind_names[kind], kind, LOAD_DELIVERED(kind), kind, seconds);
+
+	uint64_t sent_total = 0;
+	uint64_t delivered_total = 0;
+	for (int kind = 0; kind < LOAD_KINDS; kind++)
+	{
+		sent_total += metrics_counter(kind);
+		delivered_total += metrics_counter(LOAD_DELIVERED(kind));
+	}
+	printf("Total: %.1f sent/s, %.1f delivered/s, %llu error responses, %llu connection failures\n",
+		   (double)sent_total / seconds, (double)delivered_total / seconds,
+		   (unsigned long long)metrics_counter(LOAD_ERRORS), (unsigned long long)metrics_counter(LOAD_FAILURES));
+
+	for (int t = 0; t < options.threads; t++)
+		poller_destroy(threads[t].poller);
+	free(threads);
+	free(conns);
+	return logged_in == options.connections ? 0 : 1;
+}
@@ -0,0 +1,592 @@
+/**
+ * @file bench/replay.c
+ * @brief 流量记录回放工具
+ *
+ * 读入服务端以 --trace 记录的流量文件（格式见 docs/trace_format.md），
+ * 按记录中的连接和时间间隔重新连接服务端并发送同样的帧，统计吞吐量和延迟。
+ * -x 为回放速度：1 为原速，N 为 N 倍速（间隔缩短为 1/N），0 为不等待、尽快发送。
+ *
+ * 延迟为连接上第一帧没有得到回应的请求发出到该连接下一次收到数据的时间，
+ * 与服务端处理请求并写回响应的耗时一致；推送给该连接的消息也可能被当作回应，
+ * 同一记录在前后两次回放中的偏差相同，适合做回归比较。
+ * 调度滞后为帧实际发出时刻晚于计划时刻的时间，滞后很大时说明本工具或服务端跟不上回放速度。
+ *
+ * -o 把结果以 key=value 的形式写入文件，-b 读入之前保存的结果并打印每项的变化，
+ * 同一记录在两个版本的服务端上各回放一次即可比较。
+ *
+ * 用法：replay -f 记录文件 [-h host] [-p port] [-x 速度] [-o 保存结果] [-b 基线结果] [-m replay|dump]
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/network/network.h"
+#include "../src/protocol/protocol.h"
+
+#define REPLAY_MAX_CONNECTIONS 1000 /* tcp_connect 用 select 等待连接完成，描述符不能超过 FD_SETSIZE */
+#define REPLAY_DRAIN_US (1000000ull) /* 最后一帧发出后，连续这么久没有收到数据即结束 */
+#define REPLAY_POLL_MS 5			 /* 每次等待事件的最长时间 */
+#define REPLAY_BATCH 256			 /* 尽快发送时每发出这么多条记录检查一次接收 */
+
+/** 直方图编号 */
+enum
+{
+	REPLAY_LATENCY = 0, /* 请求到回应的延迟 */
+	REPLAY_LAG			/* 调度滞后 */
+};
+
+/** 计数器编号 */
+enum
+{
+	REPLAY_FRAMES = 0, /* 发出的帧数 */
+	REPLAY_BYTES,	   /* 发出的字节数 */
+	REPLAY_RESPONSES,  /* 收到的帧数 */
+	REPLAY_FAILURES,   /* 连接失败或发送失败的次数 */
+	REPLAY_DISCONNECTS, /* 记录中关闭之前被服务端断开的次数（如登出、登录失败） */
+	REPLAY_SKIPPED	   /* 连接不可用而跳过的帧数 */
+};
+
+/**
+ * @brief 回放工具的参数
+ */
+typedef struct
+{
+	const char *trace;	  /**< 记录文件 */
+	const char *host;	  /**< 服务端地址 */
+	int port;			  /**< 服务端端口 */
+	double speed;		  /**< 回放速度，0 表示尽快发送 */
+	const char *save;	  /**< 结果保存到的文件 */
+	const char *baseline; /**< 作为比较基线的结果文件 */
+	int dump;			  /**< 只打印记录，不连接服务端 */
+} ReplayOptions;
+
+/**
+ * @brief 载入内存的一条记录，帧记录已还原成线上字节
+ */
+typedef struct
+{
+	int type;		  /**< TraceRecordType */
+	uint32_t conn;	  /**< 连接号 */
+	uint64_t time_us; /**< 距捕获开始的微秒数 */
+	char *wire;		  /**< 线上字节，非帧记录为NULL */
+	size_t len;		  /**< 线上字节数 */
+} ReplayRecord;
+
+/**
+ * @brief 一个回放连接
+ */
+typedef struct
+{
+	socket_t fd;			 /**< 套接字，未连接或已断开为 SOCKET_INVALID */
+	FrameBuffer recv_buffer; /**< 接收分帧缓冲区 */
+	uint64_t probe_us;		 /**< 第一帧没有得到回应的请求发出的时刻，0 表示没有 */
+	int closing;			 /**< 已执行关闭记录，只关闭了发送方向，等服务端写完响应后断开 */
+} ReplayConn;
+
+/**
+ * @brief 一次回放的结果，按名称写入和读出
+ */
+typedef struct
+{
+	const char *name;
+	double value;
+	int higher_is_better; /**< 1-越大越好，0-越小越好 */
+} ReplayResult;
+
+static ReplayOptions options = {
+	.host = "127.0.0.1",
+	.port = DEFAULT_PORT,
+	.speed = 1.0};
+
+static ReplayConn *conns = NULL;	 /* 按连接号索引，0 号不用 */
+static ReplayConn **active = NULL;	 /* 当前打开的连接，按套接字查找时线性扫描 */
+static int active_count = 0;
+static uint64_t last_receive_us = 0; /* 最近一次收到数据的时刻 */
+
+/**
+ * @brief 载入整个记录文件，帧记录还原成线上字节，回放时只剩发送
+ *
+ * @return int 成功返回0，失败返回-1
+ */
+static int load_trace(const char *path, ReplayRecord **out, size_t *out_count, uint32_t *max_conn,
+					  uint64_t *start_us)
+{
+	TraceReader reader;
+	TraceRecord record;
+	ReplayRecord *records = NULL;
+	size_t count = 0;
+	size_t cap = 0;
+	char *wire = (char *)malloc(TRACE_MAX_FRAME + TRACE_WIRE_OVERHEAD);
+	int status;
+
+	if (!wire || trace_reader_open(&reader, path) != 0)
+	{
+		free(wire);
+		return -1;
+	}
+	*start_us = reader.start_us;
+	*max_conn = 0;
+
+	while ((status = trace_reader_next(&reader, &record)) > 0)
+	{
+		if (count == cap)
+		{
+			size_t grown_cap = cap ? cap * 2 : 1024;
+			ReplayRecord *grown = (ReplayRecord *)realloc(records, grown_cap * sizeof(ReplayRecord));
+			if (!grown)
+			{
+				status = -1;
+				break;
+			}
+			records = grown;
+			cap = grown_cap;
+		}
+
+		ReplayRecord *r = &records[count];
+		memset(r, 0, sizeof(*r));
+		r->type = record.type;
+		r->conn = record.conn;
+		r->time_us = record.time_us;
+		if (record.data)
+		{
+			r->len = trace_record_wire(&record, wire, TRACE_MAX_FRAME + TRACE_WIRE_OVERHEAD);
+			r->wire = r->len > 0 ? (char *)malloc(r->len) : NULL;
+			if (!r->wire)
+			{
+				status = -1;
+				break;
+			}
+			memcpy(r->wire, wire, r->len);
+		}
+		if (record.conn > *max_conn)
+			*max_conn = record.conn;
+		count++;
+	}
+
+	trace_reader_close(&reader);
+	free(wire);
+	*out = records;
+	*out_count = count;
+	if (status < 0)
+		fprintf(stderr, "Trace %s is truncated or corrupt after %zu records\n", path, count);
+	return 0;
+}
+
+/**
+ * @brief 打印记录内容，文本帧原样显示，v2 帧显示长度
+ */
+static void dump_trace(const ReplayRecord *records, size_t count)
+{
+	static const char *const names[] = {"?", "OPEN", "TEXT", "V2", "CLOSE"};
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const ReplayRecord *r = &records[i];
+		printf("%12.6f conn=%-6u %-5s", (double)r->time_us / 1e6, r->conn, names[r->type]);
+		if (r->type == TRACE_TEXT)
+			printf(" %.*s", (int)(r->len - 1), r->wire);
+		else if (r->type == TRACE_V2)
+			printf(" %zu bytes", r->len);
+		printf("\n");
+	}
+}
+
+/**
+ * @brief 关闭连接并从打开的连接中移除
+ */
+static void close_conn(Poller *poller, ReplayConn *conn)
+{
+	if (SOCKET_IS_INVALID(conn->fd))
+		return;
+	poller_remove(poller, conn->fd);
+	platform_socket_close(conn->fd);
+	conn->fd = SOCKET_INVALID;
+	conn->probe_us = 0;
+	conn->closing = 0;
+	frame_buffer_free(&conn->recv_buffer);
+
+	for (int i = 0; i < active_count; i++)
+	{
+		if (active[i] == conn)
+		{
+			active[i] = active[--active_count];
+			break;
+		}
+	}
+}
+
+/**
+ * @brief 只关闭发送方向，已发出请求的响应照常读完，服务端随后断开连接
+ */
+static void half_close(ReplayConn *conn)
+{
+	if (SOCKET_IS_VALID(conn->fd) && !conn->closing)
+	{
+		conn->closing = 1;
+		platform_socket_shutdown_send(conn->fd);
+	}
+}
+
+/**
+ * @brief 执行一条记录：打开连接、发送帧或关闭连接
+ */
+static void apply_record(Poller *poller, const ReplayRecord *r, uint64_t now)
+{
+	ReplayConn *conn = &conns[r->conn];
+
+	switch (r->type)
+	{
+	case TRACE_OPEN:
+		if (SOCKET_IS_VALID(conn->fd) || active_count >= REPLAY_MAX_CONNECTIONS)
+		{
+			metrics_add(REPLAY_FAILURES, 1);
+			return;
+		}
+		conn->fd = tcp_connect(options.host, options.port);
+		if (SOCKET_IS_INVALID(conn->fd) || poller_add(poller, conn->fd, POLLER_EVENT_READ) != 0)
+		{
+			if (SOCKET_IS_VALID(conn->fd))
+				platform_socket_close(conn->fd);
+			conn->fd = SOCKET_INVALID;
+			metrics_add(REPLAY_FAILURES, 1);
+			return;
+		}
+		frame_buffer_init(&conn->recv_buffer, 0);
+		active[active_count++] = conn;
+		break;
+	case TRACE_TEXT:
+	case TRACE_V2:
+		if (SOCKET_IS_INVALID(conn->fd) || conn->closing)
+		{
+			metrics_add(REPLAY_SKIPPED, 1);
+			return;
+		}
+		if (tcp_send(conn->fd, r->wire, r->len) != 0)
+		{
+			metrics_add(REPLAY_FAILURES, 1);
+			close_conn(poller, conn);
+			return;
+		}
+		if (conn->probe_us == 0)
+			conn->probe_us = now;
+		metrics_add(REPLAY_FRAMES, 1);
+		metrics_add(REPLAY_BYTES, r->len);
+		break;
+	case TRACE_CLOSE:
+		half_close(conn);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief 读取连接上的数据，记录请求延迟并统计收到的帧
+ */
+static void receive_frames(Poller *poller, ReplayConn *conn)
+{
+	size_t space = 0;
+	char *dest = frame_buffer_reserve(&conn->recv_buffer, BUFFER_SIZE, &space);
+	if (!dest)
+		return;
+
+	int received = tcp_receive(conn->fd, dest, space);
+	if (received < 0)
+	{
+		if (!conn->closing)
+			metrics_add(REPLAY_DISCONNECTS, 1);
+		close_conn(poller, conn);
+		return;
+	}
+	if (received == 0)
+		return;
+	frame_buffer_commit(&conn->recv_buffer, (size_t)received);
+
+	uint64_t now = platform_monotonic_us();
+	last_receive_us = now;
+	if (conn->probe_us != 0)
+	{
+		metrics_record(REPLAY_LATENCY, now - conn->probe_us);
+		conn->probe_us = 0;
+	}
+
+	char *frame;
+	size_t frame_len;
+	int binary;
+	while (protocol_next_frame(&conn->recv_buffer, &frame, &frame_len, &binary) > 0)
+		metrics_add(REPLAY_RESPONSES, 1);
+	frame_buffer_compact(&conn->recv_buffer);
+}
+
+/**
+ * @brief 等待并处理接收事件
+ */
+static void poll_once(Poller *poller, int timeout_ms)
+{
+	PollerEvent events[POLLER_DEFAULT_BATCH];
+	int ready = poller_wait(poller, events, POLLER_DEFAULT_BATCH, timeout_ms);
+
+	for (int i = 0; i < ready; i++)
+	{
+		for (int j = 0; j < active_count; j++)
+		{
+			if (active[j]->fd == events[i].fd)
+			{
+				receive_frames(poller, active[j]);
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * @brief 按记录的时间间隔回放全部记录，之后继续接收一段时间
+ *
+ * @return uint64_t 从第一条记录到最后一条记录发出的微秒数
+ */
+static uint64_t run_replay(Poller *poller, const ReplayRecord *records, size_t count)
+{
+	uint64_t begin = platform_monotonic_us();
+	size_t next = 0;
+
+	while (next < count)
+	{
+		uint64_t now = platform_monotonic_us();
+		int batch = 0;
+		int timeout_ms = 0;
+
+		while (next < count && batch < REPLAY_BATCH)
+		{
+			const ReplayRecord *r = &records[next];
+			uint64_t due = options.speed > 0 ? begin + (uint64_t)((double)r->time_us / options.speed) : now;
+			if (due > now)
+			{
+				uint64_t wait_ms = (due - now) / 1000;
+				timeout_ms = wait_ms < REPLAY_POLL_MS ? (int)wait_ms : REPLAY_POLL_MS;
+				break;
+			}
+			/* 尽快发送时服务端还没处理完就关闭会丢掉积压的请求，忽略关闭记录，连接在接收结束后关闭 */
+			if (options.speed > 0 || r->type != TRACE_CLOSE)
+			{
+				if (r->type != TRACE_OPEN && r->type != TRACE_CLOSE)
+					metrics_record(REPLAY_LAG, now - due);
+				apply_record(poller, r, now);
+			}
+			next++;
+			batch++;
+		}
+		poll_once(poller, timeout_ms);
+	}
+
+	uint64_t elapsed = platform_monotonic_us() - begin;
+	last_receive_us = platform_monotonic_us();
+	while (active_count > 0 && platform_monotonic_us() - last_receive_us < REPLAY_DRAIN_US)
+		poll_once(poller, REPLAY_POLL_MS);
+	return elapsed;
+}
+
+/**
+ * @brief 读出保存的结果中名为 name 的值
+ *
+ * @return int 找到返回1，否则返回0
+ */
+static int baseline_value(const char *path, const char *name, double *value)
+{
+	char line[256];
+	size_t name_len = strlen(name);
+	int found = 0;
+	FILE *fp = fopen(path, "r");
+
+	if (!fp)
+		return 0;
+	while (!found && fgets(line, sizeof(line), fp))
+	{
+		if (strncmp(line, name, name_len) == 0 && line[name_len] == '=')
+		{
+			*value = atof(line + name_len + 1);
+			found = 1;
+		}
+	}
+	fclose(fp);
+	return found;
+}
+
+/**
+ * @brief 打印结果，有基线时附上每项的变化；需要时写入结果文件
+ */
+static void report(const ReplayResult *results, int count)
+{
+	FILE *save = options.save ? fopen(options.save, "w") : NULL;
+
+	if (options.save && !save)
+		fprintf(stderr, "Cannot write results to %s\n", options.save);
+
+	printf("%-16s %14s", "metric", "value");
+	if (options.baseline)
+		printf(" %14s %9s", "baseline", "delta");
+	printf("\n");
+
+	for (int i = 0; i < count; i++)
+	{
+		const ReplayResult *r = &results[i];
+		double base = 0;
+
+		printf("%-16s %14.3f", r->name, r->value);
+		if (options.baseline && baseline_value(options.baseline, r->name, &base))
+		{
+			printf(" %14.3f", base);
+			if (base != 0)
+			{
+				double delta = (r->value - base) * 100.0 / base;
+				int worse = r->higher_is_better ? delta < 0 : delta > 0;
+				printf(" %+8.1f%%%s", delta, worse && (delta > 5.0 || delta < -5.0) ? " !" : "");
+			}
+		}
+		printf("\n");
+		if (save)
+			fprintf(save, "%s=%.3f\n", r->name, r->value);
+	}
+	if (save)
+		fclose(save);
+}
+
+/**
+ * @brief 解析命令行参数
+ */
+static int parse_options(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char *flag = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (flag[0] != '-' || flag[1] == '\0' || flag[2] != '\0' || !value)
+			return -1;
+		i++;
+
+		switch (flag[1])
+		{
+		case 'f':
+			options.trace = value;
+			break;
+		case 'h':
+			options.host = value;
+			break;
+		case 'p':
+			options.port = atoi(value);
+			break;
+		case 'x':
+			options.speed = atof(value);
+			break;
+		case 'o':
+			options.save = value;
+			break;
+		case 'b':
+			options.baseline = value;
+			break;
+		case 'm':
+			if (strcmp(value, "dump") == 0)
+				options.dump = 1;
+			else if (strcmp(value, "replay") != 0)
+				return -1;
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	if (!options.trace || !is_valid_port(options.port) || options.speed < 0)
+		return -1;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	ReplayRecord *records = NULL;
+	size_t count = 0;
+	uint32_t max_conn = 0;
+	uint64_t start_us = 0;
+
+	if (parse_options(argc, argv) != 0)
+	{
+		fprintf(stderr, "Usage: %s -f trace [-h host] [-p port] [-x speed (1 = real time, 0 = as fast as possible)]\n"
+						"       [-o save results] [-b baseline results] [-m replay|dump]\n"
+						"Record a trace with the --trace option, e.g. ./bin/server 8080 --trace=traffic.trace\n",
+				argv[0]);
+		return 1;
+	}
+
+	set_log_file("replay.log");
+	set_log_level(LOG_WARNING);
+
+	if (load_trace(options.trace, &records, &count, &max_conn, &start_us) != 0)
+	{
+		fprintf(stderr, "Cannot read trace %s\n", options.trace);
+		return 1;
+	}
+	if (options.dump)
+	{
+		printf("# captured at %llu (Unix s), %zu records, %u connections\n",
+			   (unsigned long long)(start_us / 1000000), count, max_conn);
+		dump_trace(records, count);
+		for (size_t i = 0; i < count; i++)
+			free(records[i].wire);
+		free(records);
+		return 0;
+	}
+
+	conns = (ReplayConn *)calloc((size_t)max_conn + 1, sizeof(ReplayConn));
+	active = (ReplayConn **)calloc(REPLAY_MAX_CONNECTIONS, sizeof(ReplayConn *));
+	Poller *poller = poller_create(REPLAY_MAX_CONNECTIONS);
+	if (!conns || !active || !poller)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	for (uint32_t i = 0; i <= max_conn; i++)
+		conns[i].fd = SOCKET_INVALID;
+
+	uint64_t span = count > 0 ? records[count - 1].time_us : 0;
+	if (options.speed > 0)
+		printf("=== Replay: %zu records, %u connections, %.2f s captured, speed x%.2f ===\n", count, max_conn,
+			   (double)span / 1e6, options.speed);
+	else
+		printf("=== Replay: %zu records, %u connections, %.2f s captured, as fast as possible ===\n", count, max_conn,
+			   (double)span / 1e6);
+
+	uint64_t elapsed = run_replay(poller, records, count);
+	double seconds = elapsed > 0 ? (double)elapsed / 1e6 : 1e-6;
+
+	MetricsSummary latency;
+	MetricsSummary lag;
+	metrics_histogram(REPLAY_LATENCY, &latency);
+	metrics_histogram(REPLAY_LAG, &lag);
+
+	ReplayResult results[] = {
+		{"seconds", seconds, 0},
+		{"frames_per_s", (double)metrics_counter(REPLAY_FRAMES) / seconds, 1},
+		{"bytes_per_s", (double)metrics_counter(REPLAY_BYTES) / seconds, 1},
+		{"responses", (double)metrics_counter(REPLAY_RESPONSES), 1},
+		{"latency_p50_us", (double)latency.p50, 0},
+		{"latency_p90_us", (double)latency.p90, 0},
+		{"latency_p99_us", (double)latency.p99, 0},
+		{"latency_p999_us", (double)latency.p999, 0},
+		{"latency_max_us", (double)latency.max, 0},
+		{"lag_p99_us", (double)lag.p99, 0},
+		{"failures", (double)metrics_counter(REPLAY_FAILURES), 0},
+		{"disconnects", (double)metrics_counter(REPLAY_DISCONNECTS), 0},
+		{"skipped_frames", (double)metrics_counter(REPLAY_SKIPPED), 0}};
+	report(results, (int)(sizeof(results) / sizeof(results[0])));
+
+	for (int i = active_count - 1; i >= 0; i--)
+		close_conn(poller, active[i]);
+	poller_destroy(poller);
+	for (size_t i = 0; i < count; i++)
+		free(records[i].wire);
+	free(records);
+	free(active);
+	free(conns);
+	return metrics_counter(REPLAY_FAILURES) == 0 ? 0 : 1;
+}
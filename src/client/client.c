@@ -9,6 +9,20 @@
 #include "../network/network.h"
 #include <stdarg.h>
 
+/** 没有唤醒管道的平台（Windows）上等待数据的最长时间，到时检查是否需要停止 */
+#define CLIENT_RECV_WAIT_MS 500
+
+/** 发送缓冲区满时等待服务器接收数据的最长时间 */
+#define CLIENT_SEND_TIMEOUT_MS 5000
+/** 增量同步每页请求的消息数 */
+#define CLIENT_SYNC_PAGE 100
+/** 收到编号消息后最迟多久发出累计确认，期间有其他请求时随它一起发出 */
+#define CLIENT_ACK_DELAY_MS 200
+/** 未确认的消息达到该条数时不等定时器，读完这一批数据就确认 */
+#define CLIENT_ACK_BATCH 64
+
+static void client_flush_ack(AppClient *client);
+
 /**
  * @brief 从响应内容中提取面向用户显示的文本
  *
@@ -89,10 +103,334 @@ static void client_emitf(AppClient *client, const char *format, ...)
 	client_emit_line(client, line);
 }
 
+/**
+ * @brief 展示一个在线状态变化帧
+ *
+ * 内容如 "+alice,+bob,-carol"，展示为“上线: alice, bob  下线: carol”。
+ */
+static void client_show_presence(AppClient *client, const char *delta)
+{
+	char joined[2][MAX_CONTENT_LEN];
+	size_t used[2] = {0, 0};
+	const char *p = delta;
+
+	while (*p)
+	{
+		size_t len = strcspn(p, ",");
+		if (len > 1 && (p[0] == '+' || p[0] == '-'))
+		{
+			int side = p[0] == '+' ? 0 : 1;
+			size_t need = len - 1 + (used[side] > 0 ? 2 : 0);
+			if (used[side] + need < sizeof(joined[side]))
+			{
+				if (used[side] > 0)
+				{
+					memcpy(joined[side] + used[side], ", ", 2);
+					used[side] += 2;
+				}
+				memcpy(joined[side] + used[side], p + 1, len - 1);
+				used[side] += len - 1;
+			}
+		}
+		p += len;
+		if (*p)
+			p++;
+	}
+	joined[0][used[0]] = '\0';
+	joined[1][used[1]] = '\0';
+
+	if (used[0] > 0 && used[1] > 0)
+		client_emitf(client, "上线: %s  下线: %s", joined[0], joined[1]);
+	else if (used[0] > 0)
+		client_emitf(client, "上线: %s", joined[0]);
+	else if (used[1] > 0)
+		client_emitf(client, "下线: %s", joined[1]);
+}
+
+/**
+ * @brief 登录成功时按服务器接受的选项设置累计确认，调用方持有 state_lock
+ *
+ * 纪元变化说明服务器换了进程，之前的序号不再有效，清空已收记录。
+ * 无论纪元是否变化都把已确认序号清零，重发的未确认消息会被再次确认。
+ */
+static void client_accept_ack_locked(AppClient *client, const char *accepted)
+{
+	const char *value = protocol_find_option(accepted, PROTOCOL_OPTION_ACK);
+	client->ack_enabled = value != NULL;
+	if (!value)
+		return;
+
+	uint32_t epoch = (uint32_t)strtoul(value, NULL, 10);
+	if (epoch != client->ack_epoch)
+	{
+		client->ack_epoch = epoch;
+		client->ack_received = 0;
+		memset(client->ack_seen, 0, sizeof(client->ack_seen));
+	}
+	client->ack_sent = 0;
+	client->ack_due_ms = 0;
+}
+
+/**
+ * @brief 记下收到的投递序号，调用方持有 state_lock
+ *
+ * 服务器按序号顺序投递，但重新登录时重发的消息可能与新消息交错到达，
+ * 因此在最近 CLIENT_ACK_WINDOW 个序号的窗口中逐个记录；比窗口更早的序号视为已收到。
+ *
+ * @return int 第一次收到返回1，重复返回0
+ */
+static int client_note_delivery_locked(AppClient *client, uint32_t id)
+{
+	const size_t words = CLIENT_ACK_WINDOW / 64;
+
+	if (client->ack_due_ms == 0)
+		client->ack_due_ms = platform_monotonic_ms() + CLIENT_ACK_DELAY_MS;
+
+	if (id > client->ack_received)
+	{
+		uint32_t shift = id - client->ack_received;
+		if (shift >= CLIENT_ACK_WINDOW)
+			memset(client->ack_seen, 0, sizeof(client->ack_seen));
+		else
+		{
+			size_t word_shift = shift / 64;
+			unsigned bit_shift = shift % 64;
+			for (size_t i = words; i-- > 0;)
+			{
+				uint64_t v = 0;
+				if (i >= word_shift)
+				{
+					v = client->ack_seen[i - word_shift] << bit_shift;
+					if (bit_shift && i > word_shift)
+						v |= client->ack_seen[i - word_shift - 1] >> (64 - bit_shift);
+				}
+				client->ack_seen[i] = v;
+			}
+		}
+		client->ack_received = id;
+		client->ack_seen[0] |= 1;
+		return 1;
+	}
+
+	uint32_t age = client->ack_received - id;
+	if (age >= CLIENT_ACK_WINDOW)
+		return 0;
+	uint64_t mask = (uint64_t)1 << (age % 64);
+	if (client->ack_seen[age / 64] & mask)
+		return 0;
+	client->ack_seen[age / 64] |= mask;
+	return 1;
+}
+
+/**
+ * @brief 处理一条服务器消息
+ *
+ * @param client 客户端结构体指针
+ * @param msg 已解析的消息
+ */
+static void client_handle_message(AppClient *client, const Message *msg)
+{
+#ifdef CLIENT_DEBUG_RECV
+	printf("[PARSED] type=%s | content=%s\n", msg->type, msg->content);
+	fflush(stdout);
+#endif
+
+	// 处理消息
+	if (strcmp(msg->type, MSG_TYPE_OK) == 0)
+	{
+		/* OK 响应既要展示给用户，也可能驱动本地认证状态切换 */
+		client_emitf(client, "成功: %s", response_message_text(msg->content));
+
+		/* 如果是响应，内容通常为 "code|message"，按 code 解析判断成功 */
+		{
+			const char *sep = strchr(msg->content, '|');
+			const char *cursor_field = strstr(msg->content, "cursor=");
+			int resumed = 0;
+			int code = -1;
+			if (sep)
+			{
+				char codebuf[16] = {0};
+				size_t n = sep - msg->content;
+				if (n >= sizeof(codebuf))
+					n = sizeof(codebuf) - 1;
+				memcpy(codebuf, msg->content, n);
+				code = atoi(codebuf);
+			}
+			/* code == 0 (RESPONSE_SUCCESS) 视为登录/操作成功 */
+			if (code == 0)
+			{
+				platform_mutex_lock(&client->state_lock);
+				resumed = client->login_pending && client->sync_target[0];
+				/* 登录响应的 receiver 列出服务器接受的选项 */
+				if (client->login_pending)
+					client_accept_ack_locked(client, msg->receiver);
+				client->login_pending = false;
+				client->state = CLIENT_AUTHENTICATED;
+				/* 服务器接受了 v2 请求，之后发出的帧改用二进制协议 */
+				if (protocol_find_option(msg->receiver, PROTOCOL_OPTION_V2))
+					client->protocol_version = PROTOCOL_V2;
+				platform_mutex_unlock(&client->state_lock);
+				LOG_INFO("Client authenticated locally: %s", client->username);
+#ifdef CLIENT_DEBUG_RECV
+				printf("[STATE] client state set to AUTHENTICATED (code=%d)\n", code);
+				fflush(stdout);
+#endif
+			}
+
+			/* 增量同步的结果带有下一页的游标：记下游标，还有更多时继续请求；重新登录后从游标继续 */
+			if (code == 0 && (cursor_field || resumed))
+			{
+				char target[sizeof(client->sync_target)];
+				int more = resumed;
+				unsigned int cursor = 0;
+				platform_mutex_lock(&client->state_lock);
+				if (cursor_field)
+				{
+					cursor = (unsigned int)strtoul(cursor_field + 7, NULL, 10);
+					if (cursor > client->sync_cursor)
+						client->sync_cursor = cursor;
+					more = strstr(cursor_field, "more=1") != NULL;
+					client->sync_inflight = false;
+				}
+				safe_strcpy(target, client->sync_target, sizeof(target));
+				platform_mutex_unlock(&client->state_lock);
+				/* 这一页的消息连同游标一起写入本地缓存 */
+				if (cursor_field && target[0])
+					message_cache_commit(&client->cache, target, cursor);
+				if (more && target[0])
+					client_sync_history(client, target);
+			}
+		}
+	}
+	else if (strcmp(msg->type, MSG_TYPE_ERROR) == 0)
+	{
+		platform_mutex_lock(&client->state_lock);
+		client->login_pending = false;
+		client->sync_inflight = false;
+		platform_mutex_unlock(&client->state_lock);
+		message_cache_discard(&client->cache);
+		client_emitf(client, "错误: %s", response_message_text(msg->content));
+	}
+	else if (strcmp(msg->type, MSG_TYPE_MSG) == 0)
+	{
+		/* 编号的私聊消息记下序号等待确认，重新登录后重发的重复消息不再显示 */
+		char timestamp[sizeof(msg->timestamp)];
+		safe_strcpy(timestamp, msg->timestamp, sizeof(timestamp));
+		platform_mutex_lock(&client->state_lock);
+		uint32_t id = client->ack_enabled ? protocol_take_delivery_id(timestamp) : 0;
+		int fresh = id == 0 || client_note_delivery_locked(client, id);
+		platform_mutex_unlock(&client->state_lock);
+		if (fresh)
+			client_emitf(client, "%s: %s", msg->sender, msg->content);
+		else
+			LOG_DEBUG("Duplicate delivery %lu from %s dropped", (unsigned long)id, msg->sender);
+	}
+	else if (strcmp(msg->type, MSG_TYPE_BROADCAST) == 0)
+	{
+		client_emitf(client, "广播 %s: %s", msg->sender, msg->content);
+	}
+	else if (strcmp(msg->type, MSG_TYPE_GROUP) == 0)
+	{
+		client_emitf(client, "群组 %s %s: %s", msg->receiver, msg->sender, msg->content);
+	}
+	else if (strcmp(msg->type, MSG_TYPE_HISTORY) == 0)
+	{
+		/* 同步请求的结果先放进缓存的当前页，收到带游标的 OK 后整页写入 */
+		char target[sizeof(client->sync_target)] = {0};
+		platform_mutex_lock(&client->state_lock);
+		if (client->sync_inflight)
+			safe_strcpy(target, client->sync_target, sizeof(target));
+		platform_mutex_unlock(&client->state_lock);
+		if (target[0])
+			message_cache_add(&client->cache, target, msg);
+		client_emitf(client, "历史 [%s] %s -> %s: %s", msg->timestamp, msg->sender, msg->receiver, msg->content);
+	}
+	else if (strcmp(msg->type, MSG_TYPE_STATUS) == 0)
+	{
+		client_emit_line(client, msg->content);
+	}
+	else if (strcmp(msg->type, MSG_TYPE_PRESENCE) == 0)
+	{
+		client_show_presence(client, msg->content);
+	}
+	else if (strcmp(msg->type, MSG_TYPE_RESUME) == 0)
+	{
+		/* 服务器签发的恢复令牌，断线重连时由 client_resume 出示 */
+		platform_mutex_lock(&client->state_lock);
+		safe_strcpy(client->resume_user, msg->receiver, sizeof(client->resume_user));
+		safe_strcpy(client->resume_token, msg->content, sizeof(client->resume_token));
+		platform_mutex_unlock(&client->state_lock);
+		LOG_DEBUG("Resume token received for %s", msg->receiver);
+	}
+}
+
+/**
+ * @brief 等待套接字可读或被唤醒
+ *
+ * 有唤醒管道时一直阻塞到服务器发来数据或 client_stop/client_disconnect 发出唤醒，
+ * 消息送达的延迟只取决于网络；没有唤醒管道时最多等待 CLIENT_RECV_WAIT_MS。
+ * 有待发的累计确认时最多等到确认的定时时刻。
+ *
+ * @param client 客户端结构体指针
+ * @param sockfd 接收线程启动时的套接字
+ * @return int 套接字可读返回1，被唤醒或超时返回0，出错返回-1
+ */
+static int client_wait_readable(AppClient *client, socket_t sockfd)
+{
+	fd_set readfds;
+	struct timeval tv;
+	socket_t wakeup_fd = client->wakeup.read_fd;
+	socket_t max_fd = sockfd;
+
+	FD_ZERO(&readfds);
+	FD_SET(sockfd, &readfds);
+	if (SOCKET_IS_VALID(wakeup_fd))
+	{
+		FD_SET(wakeup_fd, &readfds);
+		if (wakeup_fd > max_fd)
+			max_fd = wakeup_fd;
+	}
+
+	long wait_ms = SOCKET_IS_VALID(wakeup_fd) ? -1 : CLIENT_RECV_WAIT_MS;
+	platform_mutex_lock(&client->state_lock);
+	uint64_t due = client->ack_due_ms;
+	platform_mutex_unlock(&client->state_lock);
+	if (due != 0)
+	{
+		uint64_t now = platform_monotonic_ms();
+		long until = due > now ? (long)(due - now) : 0;
+		if (wait_ms < 0 || until < wait_ms)
+			wait_ms = until;
+	}
+	tv.tv_sec = wait_ms / 1000;
+	tv.tv_usec = (wait_ms % 1000) * 1000;
+
+	int ready = select(platform_select_nfds(max_fd), &readfds, NULL, NULL, wait_ms < 0 ? NULL : &tv);
+	if (ready < 0)
+		return platform_socket_interrupted() ? 0 : -1;
+
+	if (SOCKET_IS_VALID(wakeup_fd) && FD_ISSET(wakeup_fd, &readfds))
+		platform_wakeup_drain(&client->wakeup);
+	return FD_ISSET(sockfd, &readfds) ? 1 : 0;
+}
+
+/**
+ * @brief 唤醒接收线程，使其尽快检查 running 标志
+ *
+ * @param client 客户端结构体指针
+ */
+static void client_wake_receiver(AppClient *client)
+{
+	if (SOCKET_IS_VALID(client->wakeup.write_fd))
+		platform_wakeup_signal(&client->wakeup);
+}
+
 /**
  * @brief 接收消息线程函数
  *
- * 持续接收来自服务器的消息并处理。
+ * 阻塞等待套接字可读，之后接收来自服务器的消息并处理；空闲时不占用 CPU。
+ * 数据读入分帧缓冲区，一次读取中的多帧逐帧处理，半帧留到下一次读取；
+ * 文本帧和 v2 帧按首字节区分。
  *
  * @param arg 客户端结构体指针
  * @return void* 线程返回值
@@ -100,12 +438,32 @@ static void client_emitf(AppClient *client, const char *format, ...)
 static platform_thread_return_t PLATFORM_THREAD_CALL recv_thread_func(void *arg)
 {
 	AppClient *client = (AppClient *)arg;
-	char buffer[1024];
+	/* 套接字在线程的生命周期内不变，client_disconnect 等线程退出后才关闭它 */
+	socket_t sockfd = client->sockfd;
 	int bytes_received;
 
 	while (client->running)
 	{
-		bytes_received = tcp_receive(client->sockfd, buffer, sizeof(buffer) - 1);
+		int readable = client_wait_readable(client, sockfd);
+		if (readable == 0)
+		{
+			client_flush_ack(client);
+			continue;
+		}
+
+		/* 等待出错时按断线处理，与读取失败走同一路径 */
+		bytes_received = -1;
+		if (readable > 0)
+		{
+			size_t space = 0;
+			char *dest = frame_buffer_reserve(&client->recv_buffer, BUFFER_SIZE, &space);
+			if (!dest)
+			{
+				LOG_ERROR("Out of memory for receive buffer");
+				break;
+			}
+			bytes_received = tcp_receive(sockfd, dest, space);
+		}
 		if (bytes_received < 0)
 		{
 			if (client->running)
@@ -118,96 +476,187 @@ static platform_thread_return_t PLATFORM_THREAD_CALL recv_thread_func(void *arg)
 			break;
 		}
 
-		/* 没有数据可读，短暂休眠后继续轮询，避免忙等待或误判断线 */
+		/* 可读通知可能是虚假的，没有数据时回到等待 */
 		if (bytes_received == 0)
 		{
-			platform_sleep_ms(100);
 			continue;
 		}
 
-		buffer[bytes_received] = '\0';
-
-#ifdef CLIENT_DEBUG_RECV
-		printf("[RECV RAW] %s\n", buffer);
-		fflush(stdout);
-#endif
-		LOG_DEBUG("Raw message received (%d bytes): %s", bytes_received, buffer);
+		frame_buffer_commit(&client->recv_buffer, (size_t)bytes_received);
+		LOG_DEBUG("Raw data received (%d bytes)", bytes_received);
 
-		// 解析消息
-		Message *msg = parse_message(buffer);
-		if (!msg)
+		char *frame;
+		size_t frame_len;
+		int binary = 0;
+		int status;
+		while ((status = protocol_next_frame(&client->recv_buffer, &frame, &frame_len, &binary)) > 0)
 		{
-			LOG_ERROR("Failed to parse message: %s", buffer);
-			continue;
-		}
-
 #ifdef CLIENT_DEBUG_RECV
-		printf("[PARSED] type=%s | content=%s\n", msg->type, msg->content);
-		fflush(stdout);
-#endif
-
-		// 处理消息
-		if (strcmp(msg->type, MSG_TYPE_OK) == 0)
-		{
-			/* OK 响应既要展示给用户，也可能驱动本地认证状态切换 */
-			client_emitf(client, "成功: %s", response_message_text(msg->content));
-
-			/* 如果是响应，内容通常为 "code|message"，按 code 解析判断成功 */
+			if (!binary)
 			{
-				char *sep = strchr(msg->content, '|');
-				int code = -1;
-				if (sep)
-				{
-					char codebuf[16] = {0};
-					size_t n = sep - msg->content;
-					if (n >= sizeof(codebuf))
-						n = sizeof(codebuf) - 1;
-					memcpy(codebuf, msg->content, n);
-					code = atoi(codebuf);
-				}
-				/* code == 0 (RESPONSE_SUCCESS) 视为登录/操作成功 */
-				if (code == 0)
-				{
-					platform_mutex_lock(&client->state_lock);
-					client->state = CLIENT_AUTHENTICATED;
-					platform_mutex_unlock(&client->state_lock);
-					LOG_INFO("Client authenticated locally: %s", client->username);
-#ifdef CLIENT_DEBUG_RECV
-					printf("[STATE] client state set to AUTHENTICATED (code=%d)\n", code);
-					fflush(stdout);
+				printf("[RECV RAW] %s\n", frame);
+				fflush(stdout);
+			}
 #endif
-				}
+			// 解析消息
+			Message msg;
+			int parsed = binary ? protocol_v2_decode(frame, frame_len, &msg)
+								: parse_message_into(frame, frame_len, &msg);
+			if (parsed != 0)
+			{
+				LOG_ERROR("Failed to parse %s frame (%zu bytes)", binary ? "v2" : "text", frame_len);
+				continue;
 			}
+			client_handle_message(client, &msg);
 		}
-		else if (strcmp(msg->type, MSG_TYPE_ERROR) == 0)
+		if (status < 0)
 		{
-			client_emitf(client, "错误: %s", response_message_text(msg->content));
+			/* 无法继续分帧，丢弃缓冲区中剩余的数据 */
+			LOG_ERROR("Malformed or oversized frame from server, discarding %zu bytes",
+					  frame_buffer_pending(&client->recv_buffer));
+			frame_buffer_consume(&client->recv_buffer, frame_buffer_pending(&client->recv_buffer));
 		}
-		else if (strcmp(msg->type, MSG_TYPE_MSG) == 0)
-		{
-			client_emitf(client, "%s: %s", msg->sender, msg->content);
-		}
-		else if (strcmp(msg->type, MSG_TYPE_BROADCAST) == 0)
-		{
-			client_emitf(client, "广播 %s: %s", msg->sender, msg->content);
-		}
-		else if (strcmp(msg->type, MSG_TYPE_GROUP) == 0)
-		{
-			client_emitf(client, "群组 %s %s: %s", msg->receiver, msg->sender, msg->content);
-		}
-		else if (strcmp(msg->type, MSG_TYPE_HISTORY) == 0)
+		frame_buffer_compact(&client->recv_buffer);
+		client_flush_ack(client);
+	}
+
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/**
+ * @brief 按协议版本把一个文本帧追加到发送队列，调用方持有 send_lock
+ */
+static int client_push_frame(AppClient *client, const char *frame, int version)
+{
+	if (version != PROTOCOL_V2)
+		return send_queue_push(&client->send_queue, frame, strlen(frame));
+
+	size_t len = 0;
+	char *binary = protocol_v2_from_text(frame, strlen(frame), &len);
+	int result = (binary && len > 0) ? send_queue_push(&client->send_queue, binary, len) : -1;
+	free(binary);
+	return result;
+}
+
+/**
+ * @brief 有未确认的编号消息时把累计确认追加到发送队列，调用方持有 send_lock
+ *
+ * @param client 客户端结构体指针
+ * @param version 协商的协议版本
+ */
+static void client_queue_ack_locked(AppClient *client, int version)
+{
+	platform_mutex_lock(&client->state_lock);
+	uint32_t upto = client->ack_enabled && client->ack_received > client->ack_sent ? client->ack_received : 0;
+	platform_mutex_unlock(&client->state_lock);
+	if (upto == 0)
+		return;
+
+	char *ack = build_ack_request(client->username, upto);
+	if (ack && client_push_frame(client, ack, version) == 0)
+	{
+		platform_mutex_lock(&client->state_lock);
+		if (client->ack_sent < upto)
+			client->ack_sent = upto;
+		client->ack_due_ms = 0;
+		platform_mutex_unlock(&client->state_lock);
+	}
+	free(ack);
+}
+
+/**
+ * @brief 按协商的协议版本把一个文本帧追加到发送队列，调用方持有 send_lock
+ *
+ * 请求由构建器生成文本帧，协商出 v2 后转换成二进制帧再入队。
+ * 有待发的累计确认时先排入确认，与这一帧一起写出，不单独占用一次发送。
+ *
+ * @param client 客户端结构体指针
+ * @param frame 以换行结尾的文本帧
+ * @return int 成功返回0，积压超过上限或内存不足返回-1
+ */
+static int client_queue_frame(AppClient *client, const char *frame)
+{
+	platform_mutex_lock(&client->state_lock);
+	int version = client->protocol_version;
+	platform_mutex_unlock(&client->state_lock);
+
+	client_queue_ack_locked(client, version);
+	return client_push_frame(client, frame, version);
+}
+
+/**
+ * @brief 把发送队列写入套接字，调用方持有 send_lock
+ *
+ * 队列中的帧以分散写合并成尽量少的系统调用；发送缓冲区满时等待套接字可写，
+ * 不忙等。在 CLIENT_SEND_TIMEOUT_MS 内没有任何进展时放弃，未发出的帧留在队列中，
+ * 下一次发送时按原顺序继续。
+ *
+ * @param client 客户端结构体指针
+ * @return int 队列清空返回0，超时或出错返回-1
+ */
+static int client_flush_locked(AppClient *client)
+{
+	socket_t sockfd = client->sockfd;
+
+	if (SOCKET_IS_INVALID(sockfd))
+		return -1;
+
+	for (;;)
+	{
+		int status = send_queue_flush(&client->send_queue, sockfd);
+		if (status > 0)
+			return 0;
+		if (status < 0)
 		{
-			client_emitf(client, "历史记录:\n%s", msg->content);
+			LOG_ERROR("Failed to send data: %s", platform_socket_error_message());
+			return -1;
 		}
-		else if (strcmp(msg->type, MSG_TYPE_STATUS) == 0)
+		if (tcp_wait_writable(sockfd, CLIENT_SEND_TIMEOUT_MS) <= 0)
 		{
-			client_emit_line(client, msg->content);
+			LOG_ERROR("Server not accepting data, %zu bytes still queued", send_queue_bytes(&client->send_queue));
+			return -1;
 		}
-
-		free_message(msg);
 	}
+}
 
-	return PLATFORM_THREAD_RETURN_VALUE;
+/**
+ * @brief 按协商的协议版本发送一个文本帧
+ *
+ * @param client 客户端结构体指针
+ * @param frame 以换行结尾的文本帧
+ * @return int 成功返回0，失败返回-1
+ */
+static int client_transmit(AppClient *client, const char *frame)
+{
+	platform_mutex_lock(&client->send_lock);
+	int result = client_queue_frame(client, frame) == 0 ? client_flush_locked(client) : -1;
+	platform_mutex_unlock(&client->send_lock);
+	return result;
+}
+
+/**
+ * @brief 发出到期的累计确认
+ *
+ * 定时时刻已到，或未确认的消息达到 CLIENT_ACK_BATCH 条时单独发出一个 ACK 帧；
+ * 否则留给定时器或下一个请求捎带。由接收线程在每次等待和读取之后调用。
+ *
+ * @param client 客户端结构体指针
+ */
+static void client_flush_ack(AppClient *client)
+{
+	platform_mutex_lock(&client->state_lock);
+	int due = client->ack_enabled && client->ack_received > client->ack_sent &&
+			  (client->ack_received - client->ack_sent >= CLIENT_ACK_BATCH ||
+			   platform_monotonic_ms() >= client->ack_due_ms);
+	int version = client->protocol_version;
+	platform_mutex_unlock(&client->state_lock);
+	if (!due)
+		return;
+
+	platform_mutex_lock(&client->send_lock);
+	client_queue_ack_locked(client, version);
+	client_flush_locked(client);
+	platform_mutex_unlock(&client->send_lock);
 }
 
 /**
@@ -216,7 +665,7 @@ static platform_thread_return_t PLATFORM_THREAD_CALL recv_thread_func(void *arg)
  * 清空结构体、保存服务器地址，并初始化状态锁。调用成功后客户端处于未连接状态。
  *
  * @param client 客户端结构体指针
- * @param server_ip 服务器 IP 地址
+ * @param server_ip 服务器 IP 地址，unix:<路径> 表示经同机的 Unix 套接字连接
  * @param server_port 服务器端口
  * @return int 成功返回 0，失败返回 -1
  */
@@ -235,6 +684,17 @@ int client_init(AppClient *client, const char *server_ip, int server_port)
 	client->state = CLIENT_DISCONNECTED;
 	client->sockfd = SOCKET_INVALID;
 	client->running = false;
+	client->protocol_offer = PROTOCOL_V1;
+	client->protocol_version = PROTOCOL_V1;
+	safe_strcpy(client->cache_dir, MESSAGE_CACHE_DEFAULT_DIR, sizeof(client->cache_dir));
+	frame_buffer_init(&client->recv_buffer, 0);
+	send_queue_init(&client->send_queue, 0);
+
+	/* 唤醒管道打不开时（如 Windows）接收线程改为定时检查停止标志 */
+	if (platform_wakeup_open(&client->wakeup) != 0)
+	{
+		LOG_DEBUG("Receive wakeup channel unavailable, stopping falls back to %d ms waits", CLIENT_RECV_WAIT_MS);
+	}
 
 	// 初始化互斥锁
 	if (platform_mutex_init(&client->state_lock) != 0)
@@ -242,6 +702,19 @@ int client_init(AppClient *client, const char *server_ip, int server_port)
 		LOG_ERROR("Failed to initialize state mutex");
 		return -1;
 	}
+	if (platform_mutex_init(&client->send_lock) != 0)
+	{
+		LOG_ERROR("Failed to initialize send mutex");
+		platform_mutex_destroy(&client->state_lock);
+		return -1;
+	}
+	if (message_cache_init(&client->cache) != 0)
+	{
+		LOG_ERROR("Failed to initialize message cache");
+		platform_mutex_destroy(&client->send_lock);
+		platform_mutex_destroy(&client->state_lock);
+		return -1;
+	}
 
 	return 0;
 }
@@ -288,8 +761,15 @@ int client_connect(AppClient *client)
 
 	platform_mutex_lock(&client->state_lock);
 	client->state = CLIENT_CONNECTED;
+	/* 新连接从文本协议开始，上一个连接残留的半帧和未发出的帧不能带过来 */
+	client->protocol_version = PROTOCOL_V1;
+	frame_buffer_free(&client->recv_buffer);
 	platform_mutex_unlock(&client->state_lock);
 
+	platform_mutex_lock(&client->send_lock);
+	send_queue_free(&client->send_queue);
+	platform_mutex_unlock(&client->send_lock);
+
 	LOG_INFO("Connected to server %s:%d", client->server_ip, client->server_port);
 	return 0;
 }
@@ -322,30 +802,89 @@ int client_disconnect(AppClient *client)
 
 	// 停止接收线程
 	client->running = false;
-
-	// 先关闭套接字，唤醒可能阻塞在接收中的线程
-	if (SOCKET_IS_VALID(client->sockfd))
-	{
-		tcp_close(client->sockfd);
-		client->sockfd = SOCKET_INVALID;
-	}
+	socket_t sockfd = client->sockfd;
+	client->sockfd = SOCKET_INVALID;
 
 	client->state = CLIENT_DISCONNECTED;
 	memset(client->username, 0, sizeof(client->username));
 
 	platform_mutex_unlock(&client->state_lock);
 
-	// 锁外等待接收线程结束，避免线程退出时访问状态锁产生互相等待
+	// 锁外唤醒并等待接收线程结束，避免线程退出时访问状态锁产生互相等待
+	client_wake_receiver(client);
 	if (platform_thread_is_valid(client->recv_thread))
 	{
 		platform_thread_join(client->recv_thread);
 		client->recv_thread = PLATFORM_THREAD_NULL;
 	}
 
+	// 接收线程退出后再关闭套接字，它等待的描述符不会被关闭或复用；
+	// 持有发送锁关闭，正在发送的线程不会写到已关闭的描述符
+	platform_mutex_lock(&client->send_lock);
+	if (SOCKET_IS_VALID(sockfd))
+	{
+		tcp_close(sockfd);
+	}
+	send_queue_free(&client->send_queue);
+	platform_mutex_unlock(&client->send_lock);
+
 	LOG_INFO("Disconnected from server");
 	return 0;
 }
 
+/**
+ * @brief 设置登录时请求的协议版本
+ *
+ * 只影响之后的登录；协商结果以服务器的登录响应为准。
+ *
+ * @param client 客户端结构体指针
+ * @param version PROTOCOL_V1 或 PROTOCOL_V2
+ * @return int 成功返回 0，版本不支持返回 -1
+ */
+int client_set_protocol(AppClient *client, int version)
+{
+	if (!client || (version != PROTOCOL_V1 && version != PROTOCOL_V2))
+		return -1;
+
+	platform_mutex_lock(&client->state_lock);
+	client->protocol_offer = version;
+	platform_mutex_unlock(&client->state_lock);
+	return 0;
+}
+
+/**
+ * @brief 登录和恢复请求的 receiver：总是请求累计确认和恢复令牌，请求 v2 时同时协商
+ */
+static const char *client_login_options(const AppClient *client)
+{
+	return client->protocol_offer == PROTOCOL_V2
+			   ? PROTOCOL_V2_OFFER ";" PROTOCOL_OPTION_ACK ";" PROTOCOL_OPTION_RESUME
+			   : "server;" PROTOCOL_OPTION_ACK ";" PROTOCOL_OPTION_RESUME;
+}
+
+/**
+ * @brief 等待接收线程确认登录或恢复，最多等待 5 秒（每 100ms 检查一次）
+ *
+ * @return int 已认证返回0，服务器拒绝或超时返回-1
+ */
+static int client_wait_authenticated(AppClient *client)
+{
+	for (int i = 0; i < 50; i++)
+	{
+		platform_mutex_lock(&client->state_lock);
+		ClientState st = client->state;
+		bool pending = client->login_pending;
+		platform_mutex_unlock(&client->state_lock);
+		if (st == CLIENT_AUTHENTICATED)
+			return 0;
+		/* 收到 ERROR 时接收线程清除了等待标记，不必等到超时 */
+		if (!pending)
+			return -1;
+		platform_sleep_ms(100);
+	}
+	return -1;
+}
+
 /**
  * @brief 登录服务器
  *
@@ -374,18 +913,43 @@ int client_login(AppClient *client, const char *username, const char *password)
 		return -1;
 	}
 
+	/* 换了用户时丢弃上一个用户的同步游标；同一用户重新登录后由接收线程从游标继续 */
+	if (strcmp(client->sync_user, username) != 0)
+	{
+		safe_strcpy(client->sync_user, username, sizeof(client->sync_user));
+		client->sync_target[0] = '\0';
+		client->sync_cursor = 0;
+		/* 投递序号按用户分配，换了用户时清空已收记录 */
+		client->ack_epoch = 0;
+		client->ack_received = 0;
+		memset(client->ack_seen, 0, sizeof(client->ack_seen));
+	}
+	/* 上一个令牌不再使用，登录成功后服务器签发新令牌 */
+	client->resume_token[0] = '\0';
+	client->login_pending = true;
+	client->sync_inflight = false;
+	char cache_dir[sizeof(client->cache_dir)];
+	safe_strcpy(cache_dir, client->cache_dir, sizeof(cache_dir));
+
 	platform_mutex_unlock(&client->state_lock);
 
-	// 构建登录消息
-	char *login_msg = build_login_msg(username, password);
+	/* 打开该用户的本地缓存，同一用户重复登录时沿用已打开的文件；打不开时只是不缓存 */
+	message_cache_discard(&client->cache);
+	if (!cache_dir[0])
+		message_cache_close(&client->cache);
+	else if (message_cache_open(&client->cache, cache_dir, username) != 0)
+		LOG_WARN("Message cache unavailable for %s, history will not be cached", username);
+
+	/* 构建登录消息，receiver 中携带登录选项 */
+	char *login_msg = build_login_to(username, password, client_login_options(client));
 	if (!login_msg)
 	{
 		LOG_ERROR("Failed to build login message");
 		return -1;
 	}
 
-	// 发送登录消息
-	if (tcp_send(client->sockfd, login_msg, strlen(login_msg)) < 0)
+	// 发送登录消息，已协商过的连接上按协商结果编码
+	if (client_transmit(client, login_msg) < 0)
 	{
 		LOG_ERROR("Failed to send login message");
 		free(login_msg);
@@ -397,21 +961,73 @@ int client_login(AppClient *client, const char *username, const char *password)
 	// 保存用户名，后续发送消息和构建请求时作为 sender 使用
 	safe_strcpy(client->username, username, sizeof(client->username));
 
-	/* 等待认证响应：避免用户在收到服务器确认前立刻发送消息导致竞态。
-	   最多等待 5 秒（每 100ms 检查一次）。 */
-	for (int i = 0; i < 50; i++)
+	/* 等待认证响应：避免用户在收到服务器确认前立刻发送消息导致竞态 */
+	if (client_wait_authenticated(client) == 0)
 	{
+		return 0;
+	}
+
+	LOG_WARN("Login timed out or not authenticated within wait period");
+	return -1;
+}
+
+/**
+ * @brief 凭恢复令牌恢复上一次登录的会话
+ *
+ * 只在已连接、未认证时发送。已收到的最大投递序号随请求发出，服务器据此确认断线前收到的消息，
+ * 只重发之后的；重发中与已收记录重复的照常被丢弃。令牌发出后即清除，成功时由接收线程存下新令牌。
+ *
+ * @param client 客户端结构体指针
+ * @return int 恢复成功返回 0，没有令牌返回 1，被拒绝或超时返回 -1
+ */
+int client_resume(AppClient *client)
+{
+	char username[sizeof(client->resume_user)];
+	char token[sizeof(client->resume_token)];
+
+	if (!client)
+	{
+		LOG_ERROR("Invalid client");
+		return -1;
+	}
+
+	platform_mutex_lock(&client->state_lock);
+	if (client->state != CLIENT_CONNECTED || client->resume_token[0] == '\0')
+	{
+		platform_mutex_unlock(&client->state_lock);
+		return 1;
+	}
+	safe_strcpy(username, client->resume_user, sizeof(username));
+	safe_strcpy(token, client->resume_token, sizeof(token));
+	client->resume_token[0] = '\0';
+	uint32_t last_seen = client->ack_epoch != 0 ? client->ack_received : 0;
+	client->login_pending = true;
+	client->sync_inflight = false;
+	platform_mutex_unlock(&client->state_lock);
+
+	char *resume_msg = build_resume_request(username, client_login_options(client), token, last_seen);
+	if (!resume_msg || client_transmit(client, resume_msg) < 0)
+	{
+		LOG_ERROR("Failed to send resume request");
+		free(resume_msg);
 		platform_mutex_lock(&client->state_lock);
-		ClientState st = client->state;
+		client->login_pending = false;
 		platform_mutex_unlock(&client->state_lock);
-		if (st == CLIENT_AUTHENTICATED)
-		{
-			return 0;
-		}
-		platform_sleep_ms(100);
+		return -1;
 	}
+	free(resume_msg);
 
-	LOG_WARN("Login timed out or not authenticated within wait period");
+	/* 恢复的是同一个用户，同步游标、已收记录和本地缓存都沿用 */
+	safe_strcpy(client->username, username, sizeof(client->username));
+
+	if (client_wait_authenticated(client) == 0)
+	{
+		LOG_INFO("Session resumed for %s", username);
+		return 0;
+	}
+
+	LOG_WARN("Session resume for %s rejected or timed out", username);
+	memset(client->username, 0, sizeof(client->username));
 	return -1;
 }
 
@@ -452,7 +1068,7 @@ int client_logout(AppClient *client)
 	}
 
 	// 发送登出消息
-	if (tcp_send(client->sockfd, logout_msg, strlen(logout_msg)) < 0)
+	if (client_transmit(client, logout_msg) < 0)
 	{
 		LOG_ERROR("Failed to send logout message");
 		free(logout_msg);
@@ -462,9 +1078,10 @@ int client_logout(AppClient *client)
 	free(logout_msg);
 
 	platform_mutex_lock(&client->state_lock);
-	/* 登出后保持 TCP 连接，可继续使用同一连接重新登录 */
+	/* 登出后保持 TCP 连接，可继续使用同一连接重新登录；服务器已作废恢复令牌 */
 	client->state = CLIENT_CONNECTED;
 	memset(client->username, 0, sizeof(client->username));
+	client->resume_token[0] = '\0';
 	platform_mutex_unlock(&client->state_lock);
 
 	return 0;
@@ -509,7 +1126,7 @@ int client_send_message(AppClient *client, const char *receiver, const char *con
 	}
 
 	// 发送消息
-	if (tcp_send(client->sockfd, msg, strlen(msg)) < 0)
+	if (client_transmit(client, msg) < 0)
 	{
 		LOG_ERROR("Failed to send message");
 		free(msg);
@@ -557,7 +1174,7 @@ int client_send_broadcast(AppClient *client, const char *content)
 	}
 
 	// 发送消息
-	if (tcp_send(client->sockfd, msg, strlen(msg)) < 0)
+	if (client_transmit(client, msg) < 0)
 	{
 		LOG_ERROR("Failed to send broadcast message");
 		free(msg);
@@ -568,6 +1185,103 @@ int client_send_broadcast(AppClient *client, const char *content)
 	return 0;
 }
 
+/**
+ * @brief 设置关注在线状态的用户
+ *
+ * 服务器默认发送所有人的上线/下线通知，设置后只发送关注用户的变化，
+ * 并先补发一次其中当前在线的用户。
+ *
+ * @param client 客户端结构体指针
+ * @param targets "*"、"-" 或用户名列表
+ * @return int 成功返回 0，失败返回 -1
+ */
+int client_set_presence(AppClient *client, const char *targets)
+{
+	if (!client || !targets)
+	{
+		LOG_ERROR("Invalid parameters");
+		return -1;
+	}
+
+	platform_mutex_lock(&client->state_lock);
+
+	if (client->state != CLIENT_AUTHENTICATED)
+	{
+		LOG_ERROR("Client not authenticated");
+		platform_mutex_unlock(&client->state_lock);
+		return -1;
+	}
+
+	platform_mutex_unlock(&client->state_lock);
+
+	char *msg = build_presence_request(client->username, targets);
+	if (!msg)
+	{
+		LOG_ERROR("Failed to build presence request");
+		return -1;
+	}
+
+	if (client_transmit(client, msg) < 0)
+	{
+		LOG_ERROR("Failed to send presence request");
+		free(msg);
+		return -1;
+	}
+
+	free(msg);
+	return 0;
+}
+
+/**
+ * @brief 批量发送私聊或广播消息
+ *
+ * 所有消息先构建并追加到发送队列，最后一次写出，多条消息合并成尽量少的系统调用。
+ * 某条消息构建失败或积压超过上限时跳过该条，其余消息照常发送。
+ *
+ * @param client 客户端结构体指针
+ * @param messages 消息数组，receiver 为 NULL 的条目作为广播发送
+ * @param count 消息条数
+ * @return int 全部发出返回 0，任一条失败返回 -1
+ */
+int client_send_many(AppClient *client, const ClientOutgoingMessage *messages, size_t count)
+{
+	if (!client || (!messages && count > 0))
+	{
+		LOG_ERROR("Invalid parameters");
+		return -1;
+	}
+
+	platform_mutex_lock(&client->state_lock);
+	if (client->state != CLIENT_AUTHENTICATED)
+	{
+		LOG_ERROR("Client not authenticated");
+		platform_mutex_unlock(&client->state_lock);
+		return -1;
+	}
+	platform_mutex_unlock(&client->state_lock);
+
+	int result = 0;
+	platform_mutex_lock(&client->send_lock);
+	for (size_t i = 0; i < count; i++)
+	{
+		const ClientOutgoingMessage *out = &messages[i];
+		char *msg = NULL;
+		if (out->content)
+			msg = out->receiver ? build_text_msg(client->username, out->receiver, out->content)
+								: build_broadcast_msg(client->username, out->content);
+		if (!msg || client_queue_frame(client, msg) != 0)
+		{
+			LOG_ERROR("Failed to queue message %zu of %zu", i + 1, count);
+			result = -1;
+		}
+		build_free(msg);
+	}
+	if (client_flush_locked(client) != 0)
+		result = -1;
+	platform_mutex_unlock(&client->send_lock);
+	return result;
+}
+
 /**
  * @brief 发送群组消息
  *
@@ -606,7 +1320,7 @@ int client_send_group_message(AppClient *client, const char *group_name, const c
 	}
 
 	// 发送消息
-	if (tcp_send(client->sockfd, msg, strlen(msg)) < 0)
+	if (client_transmit(client, msg) < 0)
 	{
 		LOG_ERROR("Failed to send group message");
 		free(msg);
@@ -657,7 +1371,7 @@ int client_request_history(AppClient *client, const char *target,
 	}
 
 	// 发送请求
-	if (tcp_send(client->sockfd, msg, strlen(msg)) < 0)
+	if (client_transmit(client, msg) < 0)
 	{
 		LOG_ERROR("Failed to send history request");
 		free(msg);
@@ -668,6 +1382,171 @@ int client_request_history(AppClient *client, const char *target,
 	return 0;
 }
 
+/**
+ * @brief 增量同步历史消息
+ *
+ * 请求该会话游标之后的一页消息；结果的 OK 中带有新的游标，由接收线程记下，
+ * 还有更多时接收线程接着请求下一页，因此每次只传输一页没有收到过的消息。
+ *
+ * @param client 客户端结构体指针
+ * @param target 目标用户，"all" 表示广播
+ * @return int 成功返回 0，失败返回 -1
+ */
+int client_sync_history(AppClient *client, const char *target)
+{
+	if (!client || !target || !*target)
+	{
+		LOG_ERROR("Invalid parameters");
+		return -1;
+	}
+
+	/* 换到另一个会话时从本地缓存记录的游标开始；缓存锁不在 state_lock 内获取 */
+	unsigned int cached = message_cache_cursor(&client->cache, target);
+
+	platform_mutex_lock(&client->state_lock);
+	if (client->state != CLIENT_AUTHENTICATED)
+	{
+		LOG_ERROR("Client not authenticated");
+		platform_mutex_unlock(&client->state_lock);
+		return -1;
+	}
+	if (strcmp(client->sync_target, target) != 0)
+	{
+		safe_strcpy(client->sync_target, target, sizeof(client->sync_target));
+		client->sync_cursor = cached;
+	}
+	unsigned int since = client->sync_cursor;
+	client->sync_inflight = true;
+	platform_mutex_unlock(&client->state_lock);
+
+	char *msg = build_history_sync_request(client->username, target, since, CLIENT_SYNC_PAGE);
+	if (!msg)
+	{
+		LOG_ERROR("Failed to build history sync request");
+		return -1;
+	}
+
+	if (client_transmit(client, msg) < 0)
+	{
+		LOG_ERROR("Failed to send history sync request");
+		free(msg);
+		return -1;
+	}
+
+	free(msg);
+	return 0;
+}
+
+/**
+ * @brief 全文检索会话历史
+ *
+ * 结果以 HISTORY 帧返回，最后的 OK 为 "Search: N of M matches"。
+ * 同步请求尚未收到游标时不发出检索，避免检索结果被当作同步页写入本地缓存。
+ *
+ * @param client 客户端结构体指针
+ * @param target 目标用户，"all" 表示广播
+ * @param query 查询文本
+ * @return int 成功返回 0，失败返回 -1
+ */
+int client_search_history(AppClient *client, const char *target, const char *query)
+{
+	if (!client || !target || !*target || !query || !*query)
+	{
+		LOG_ERROR("Invalid parameters");
+		return -1;
+	}
+
+	platform_mutex_lock(&client->state_lock);
+	if (client->state != CLIENT_AUTHENTICATED)
+	{
+		LOG_ERROR("Client not authenticated");
+		platform_mutex_unlock(&client->state_lock);
+		return -1;
+	}
+	if (client->sync_inflight)
+	{
+		LOG_WARN("History sync in progress, search refused");
+		platform_mutex_unlock(&client->state_lock);
+		return -1;
+	}
+	platform_mutex_unlock(&client->state_lock);
+
+	char *msg = build_history_search_request(client->username, target, query, 0);
+	if (!msg)
+	{
+		LOG_ERROR("Failed to build history search request");
+		return -1;
+	}
+
+	if (client_transmit(client, msg) < 0)
+	{
+		LOG_ERROR("Failed to send history search request");
+		free(msg);
+		return -1;
+	}
+
+	free(msg);
+	return 0;
+}
+
+/**
+ * @brief 把一条缓存的历史消息按服务器下发时的格式输出
+ */
+static int emit_cached_history(const Message *msg, void *ctx)
+{
+	client_emitf((AppClient *)ctx, "历史 [%s] %s -> %s: %s", msg->timestamp, msg->sender, msg->receiver, msg->content);
+	return 0;
+}
+
+/**
+ * @brief 查看会话历史
+ *
+ * 本地缓存中最近的 MESSAGE_CACHE_VIEW_LIMIT 条立即显示，不经过网络；
+ * 随后从缓存的游标发起增量同步，只有缓存之后的新消息从服务器传来，收到后同样写入缓存。
+ *
+ * @param client 客户端结构体指针
+ * @param target 目标用户，"all" 表示广播
+ * @return int 成功返回 0，失败返回 -1
+ */
+int client_history(AppClient *client, const char *target)
+{
+	if (!client || !target || !*target)
+	{
+		LOG_ERROR("Invalid parameters");
+		return -1;
+	}
+
+	if (!message_cache_is_open(&client->cache))
+	{
+		return client_request_history(client, target, NULL, NULL);
+	}
+
+	int shown = message_cache_recent(&client->cache, target, MESSAGE_CACHE_VIEW_LIMIT, emit_cached_history, client);
+	if (shown > 0)
+	{
+		client_emitf(client, "本地缓存 %d 条，正在同步新消息", shown);
+	}
+	return client_sync_history(client, target);
+}
+
+/**
+ * @brief 设置本地历史缓存目录
+ *
+ * @param client 客户端结构体指针
+ * @param dir 缓存目录，NULL 或空串表示不使用本地缓存
+ */
+void client_set_cache_dir(AppClient *client, const char *dir)
+{
+	if (!client)
+	{
+		return;
+	}
+
+	platform_mutex_lock(&client->state_lock);
+	safe_strcpy(client->cache_dir, dir ? dir : "", sizeof(client->cache_dir));
+	platform_mutex_unlock(&client->state_lock);
+}
+
 /**
  * @brief 请求在线状态信息
  *
@@ -704,7 +1583,7 @@ int client_request_status(AppClient *client)
 	}
 
 	// 发送请求
-	if (tcp_send(client->sockfd, msg, strlen(msg)) < 0)
+	if (client_transmit(client, msg) < 0)
 	{
 		LOG_ERROR("Failed to send status request");
 		free(msg);
@@ -807,6 +1686,7 @@ int client_stop(AppClient *client)
 	/* 停止后台接收循环，但不主动断开 TCP 连接 */
 	client->running = false;
 	platform_mutex_unlock(&client->state_lock);
+	client_wake_receiver(client);
 
 	// 等待接收线程结束，防止 client 结构体被清理时线程仍在访问
 	if (platform_thread_is_valid(client->recv_thread))
@@ -840,6 +1720,11 @@ void client_cleanup(AppClient *client)
 
 	// 销毁互斥锁
 	platform_mutex_destroy(&client->state_lock);
+	platform_mutex_destroy(&client->send_lock);
+	frame_buffer_free(&client->recv_buffer);
+	send_queue_free(&client->send_queue);
+	platform_wakeup_close(&client->wakeup);
+	message_cache_destroy(&client->cache);
 
 	memset(client, 0, sizeof(AppClient));
 }
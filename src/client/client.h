@@ -15,6 +15,7 @@
 #include "../platform/platform.h"
 #include "../protocol/protocol.h"
 #include "../utils/utils.h"
+#include "message_cache.h"
 
 /** 
  * @brief 客户端状态枚举 
@@ -29,27 +30,62 @@ typedef enum {
 
 typedef void (*ClientMessageCallback)(void *userdata, const char *line);
 
+/** 记录最近收到的投递序号的窗口大小，不小于服务器为每个用户保留的未确认消息数 */
+#define CLIENT_ACK_WINDOW 256
+
+/** 恢复令牌的最大长度（含结尾的 0），服务器签发的是 32 个十六进制字符 */
+#define CLIENT_RESUME_TOKEN_LEN 65
+
+/**
+ * @brief client_send_many 的一条待发送消息
+ */
+typedef struct {
+    const char *receiver;       /**< 接收者用户名，NULL 表示广播 */
+    const char *content;        /**< 消息内容 */
+} ClientOutgoingMessage;
+
 /**
  * @brief 客户端结构体
  */
 typedef struct {
     socket_t sockfd;            /**< 套接字文件描述符 */
-    char server_ip[32];         /**< 服务器IP地址 */
+    char server_ip[128];        /**< 服务器IP地址，或 unix:<路径> 表示同机服务端的 Unix 套接字 */
     int server_port;            /**< 服务器端口 */
     ClientState state;          /**< 客户端状态 */
     char username[32];          /**< 用户名 */
     bool running;               /**< 运行状态标志 */
     platform_thread_t recv_thread; /**< 接收线程 */
     platform_mutex_t state_lock;   /**< 状态锁 */
+    platform_mutex_t send_lock;    /**< 发送锁，保护发送队列和写套接字 */
+    SendQueue send_queue;          /**< 待发送帧，多帧合并写出，缓冲区满时等待可写 */
     ClientMessageCallback message_callback; /**< 接收消息回调 */
     void *message_callback_userdata;        /**< 接收消息回调上下文 */
+    FrameBuffer recv_buffer;    /**< 接收分帧缓冲区，只由接收线程访问 */
+    platform_wakeup_t wakeup;   /**< 停止时唤醒阻塞在等待中的接收线程 */
+    int protocol_offer;         /**< 登录时向服务器请求的协议版本 */
+    int protocol_version;       /**< 与服务器协商后的协议版本 */
+    bool login_pending;         /**< 已发出登录请求，等待服务器确认 */
+    char sync_user[32];         /**< 同步游标所属的用户 */
+    char sync_target[32];       /**< 增量同步的会话，同一用户重新登录后自动从游标继续 */
+    unsigned int sync_cursor;   /**< 该会话已收到的最大历史序号 */
+    bool sync_inflight;         /**< 已发出同步请求，收到的 HISTORY 属于待写入缓存的一页 */
+    char cache_dir[MAX_FILENAME_LEN]; /**< 本地历史缓存目录，空串表示不缓存 */
+    MessageCache cache;         /**< 当前用户的本地历史缓存，登录时打开 */
+    bool ack_enabled;           /**< 服务器接受了累计送达确认 */
+    uint32_t ack_epoch;         /**< 服务器的投递序号纪元，变化时清空已收记录 */
+    uint32_t ack_received;      /**< 已收到的最大投递序号 */
+    uint32_t ack_sent;          /**< 已发出确认的最大投递序号 */
+    uint64_t ack_due_ms;        /**< 定时确认的时刻（单调时钟），0 表示没有待发的确认 */
+    uint64_t ack_seen[CLIENT_ACK_WINDOW / 64]; /**< 已收序号的窗口，第 i 位对应 ack_received - i */
+    char resume_user[32];       /**< 恢复令牌所属的用户 */
+    char resume_token[CLIENT_RESUME_TOKEN_LEN]; /**< 服务器签发的恢复令牌，空串表示没有；只能使用一次 */
 } AppClient;
 
 /**
  * @brief 初始化客户端
  * 
  * @param client 客户端结构体指针
- * @param server_ip 服务器IP地址
+ * @param server_ip 服务器IP地址，unix:<路径> 表示经同机的 Unix 套接字连接
  * @param server_port 服务器端口
  * @return int 成功返回0，失败返回-1
  */
@@ -71,6 +107,18 @@ int client_connect(AppClient *client);
  */
 int client_disconnect(AppClient *client);
 
+/**
+ * @brief 设置登录时请求的协议版本
+ *
+ * 请求 PROTOCOL_V2 时登录消息携带 PROTOCOL_V2_OFFER，服务器接受后改用二进制帧；
+ * 不支持 v2 的服务器忽略请求，继续使用文本协议。
+ *
+ * @param client 客户端结构体指针
+ * @param version PROTOCOL_V1 或 PROTOCOL_V2
+ * @return int 成功返回0，失败返回-1
+ */
+int client_set_protocol(AppClient *client, int version);
+
 /**
  * @brief 用户登录
  * 
@@ -81,6 +129,18 @@ int client_disconnect(AppClient *client);
  */
 int client_login(AppClient *client, const char *username, const char *password);
 
+/**
+ * @brief 凭恢复令牌恢复上一次登录的会话
+ *
+ * 连接断开后重新 client_connect 时调用：出示上次登录（或恢复）时服务器签发的令牌和
+ * 已收到的最大投递序号，服务器不验证口令，只补发断线期间错过的消息。
+ * 令牌只能使用一次，成功时服务器签发新令牌；失败时需要用 client_login 重新登录。
+ *
+ * @param client 客户端结构体指针
+ * @return int 恢复成功返回0，没有令牌返回1（未发送请求），被拒绝或超时返回-1
+ */
+int client_resume(AppClient *client);
+
 /**
  * @brief 用户登出
  * 
@@ -108,6 +168,27 @@ int client_send_message(AppClient *client, const char *receiver, const char *con
  */
 int client_send_broadcast(AppClient *client, const char *content);
 
+/**
+ * @brief 设置关注在线状态的用户
+ *
+ * @param client 客户端结构体指针
+ * @param targets "*" 关注所有人，"-" 关闭通知，否则为以逗号或空格分隔的用户名
+ * @return int 成功返回0，失败返回-1
+ */
+int client_set_presence(AppClient *client, const char *targets);
+
+/**
+ * @brief 批量发送私聊或广播消息
+ *
+ * 全部消息入队后一次写出，缓冲区满时等待套接字可写而不是忙等。
+ *
+ * @param client 客户端结构体指针
+ * @param messages 消息数组，receiver 为 NULL 的条目作为广播发送
+ * @param count 消息条数
+ * @return int 全部发出返回0，任一条失败返回-1
+ */
+int client_send_many(AppClient *client, const ClientOutgoingMessage *messages, size_t count);
+
 /**
  * @brief 发送群组消息
  * 
@@ -130,6 +211,54 @@ int client_send_group_message(AppClient *client, const char *group_name, const c
 int client_request_history(AppClient *client, const char *target, 
                         const char *start_time, const char *end_time);
 
+/**
+ * @brief 增量同步历史消息
+ *
+ * 从该会话上次同步到的序号继续，按页请求没有收到过的消息，
+ * 服务器表示还有更多时自动请求下一页；断线重新登录后自动继续。
+ * 换到另一个会话时游标从0开始。
+ *
+ * @param client 客户端结构体指针
+ * @param target 目标用户，"all" 表示广播
+ * @return int 成功返回0，失败返回-1
+ */
+int client_sync_history(AppClient *client, const char *target);
+
+/**
+ * @brief 全文检索会话历史
+ *
+ * 服务器返回会话中包含全部查询词的最近消息，每条以 "#序号 摘要" 作为内容。
+ * 增量同步进行中时拒绝检索，检索结果不会混进本地缓存的同步页。
+ *
+ * @param client 客户端结构体指针
+ * @param target 目标用户，"all" 表示广播
+ * @param query 查询文本
+ * @return int 成功返回0，失败返回-1
+ */
+int client_search_history(AppClient *client, const char *target, const char *query);
+
+/**
+ * @brief 查看会话历史
+ *
+ * 先从本地缓存显示最近的消息，再从缓存记录的游标增量同步之后的新消息，
+ * 已缓存的消息不会重复下载。缓存未打开时退回到向服务器请求全部历史。
+ *
+ * @param client 客户端结构体指针
+ * @param target 目标用户，"all" 表示广播
+ * @return int 成功返回0，失败返回-1
+ */
+int client_history(AppClient *client, const char *target);
+
+/**
+ * @brief 设置本地历史缓存目录
+ *
+ * 在登录前调用，下次登录时按用户打开缓存文件。
+ *
+ * @param client 客户端结构体指针
+ * @param dir 缓存目录，NULL 或空串表示不使用本地缓存
+ */
+void client_set_cache_dir(AppClient *client, const char *dir);
+
 /**
  * @brief 请求状态信息
  * 
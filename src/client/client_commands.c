@@ -80,7 +80,7 @@ static void notify_state_changed(AppClient *client, ClientCommandContext *ctx)
 static void command_show_help(ClientCommandContext *ctx)
 {
 	command_write(ctx, "可用命令:");
-	command_write(ctx, "  connect [ip] [port]    - 连接服务器，默认 127.0.0.1:8080，别名 c");
+	command_write(ctx, "  connect [ip] [port]    - 连接服务器，默认 127.0.0.1:8080，别名 c；ip 为 unix:<路径> 时连接同机的 Unix 套接字");
 	command_write(ctx, "  disconnect             - 断开连接，别名 d");
 	command_write(ctx, "  login <user> <pass>    - 登录，别名 l");
 	command_write(ctx, "  logout                 - 登出");
@@ -88,8 +88,13 @@ static void command_show_help(ClientCommandContext *ctx)
 	command_write(ctx, "  send <user> <msg>      - 发送私聊消息，别名 s");
 	command_write(ctx, "  broadcast <msg>        - 发送广播消息，别名 b");
 	command_write(ctx, "  group <group> <msg>    - 发送群组消息，别名 g");
-	command_write(ctx, "  history <target>       - 查询历史记录，别名 h");
+	command_write(ctx, "  join <group>           - 加入群组，群组不存在时创建");
+	command_write(ctx, "  leave <group>          - 退出群组");
+	command_write(ctx, "  history <target>       - 查看历史记录（先显示本地缓存，再同步新消息），别名 h");
+	command_write(ctx, "  sync <target>          - 增量同步没有收到过的历史消息，重新登录后自动继续");
+	command_write(ctx, "  search <target> <words> - 全文检索与 target 的历史消息（中文按字和词组匹配）");
 	command_write(ctx, "  status                 - 查询服务器状态，别名 st");
+	command_write(ctx, "  presence [*|off|users] - 设置关注上线/下线的用户，默认所有人，别名 p");
 	command_write(ctx, "  help                   - 显示帮助，别名 ?");
 	command_write(ctx, "  quit                   - 退出客户端，别名 q");
 }
@@ -127,13 +132,13 @@ static int send_to_active_receiver(AppClient *client, ClientCommandContext *ctx,
 
 static int command_connect(AppClient *client, ClientCommandContext *ctx, const char *cmd)
 {
-	char ip[32] = "127.0.0.1";
+	char ip[128] = "127.0.0.1";
 	int port = 8080;
 	const char *args = command_args(cmd);
 
-	if (*args != '\0' && sscanf(args, "%31s %d", ip, &port) < 1)
+	if (*args != '\0' && sscanf(args, "%127s %d", ip, &port) < 1)
 	{
-		command_write(ctx, "用法: connect [ip] [port]");
+		command_write(ctx, "用法: connect [ip|unix:<路径>] [port]");
 		return 0;
 	}
 
@@ -144,7 +149,11 @@ static int command_connect(AppClient *client, ClientCommandContext *ctx, const c
 	{
 		if (client_start(client) == 0)
 		{
-			command_write(ctx, "连接成功");
+			/* 上次登录的会话还在保留期内时凭令牌恢复，不必重新输入口令 */
+			int resumed = client_resume(client);
+			command_write(ctx, resumed == 0 ? "连接成功，会话已恢复"
+							   : resumed > 0 ? "连接成功"
+											 : "连接成功，会话已过期，请重新登录");
 		}
 		else
 		{
@@ -281,6 +290,31 @@ static int command_broadcast(AppClient *client, ClientCommandContext *ctx, const
 	return 0;
 }
 
+static int command_presence(AppClient *client, ClientCommandContext *ctx, const char *cmd)
+{
+	const char *targets = command_args(cmd);
+
+	if (strlen(targets) == 0)
+	{
+		targets = "*";
+	}
+	else if (strcmp(targets, "off") == 0)
+	{
+		targets = "-";
+	}
+
+	if (client_set_presence(client, targets) == 0)
+	{
+		command_write(ctx, "在线状态关注设置已发送");
+	}
+	else
+	{
+		command_write(ctx, "设置在线状态关注失败");
+	}
+
+	return 0;
+}
+
 static int command_group(AppClient *client, ClientCommandContext *ctx, const char *cmd)
 {
 	char group_name[32];
@@ -313,6 +347,78 @@ static int command_group(AppClient *client, ClientCommandContext *ctx, const cha
 	return 0;
 }
 
+static int command_group_control(AppClient *client, ClientCommandContext *ctx, const char *cmd, const char *control)
+{
+	char group_name[32];
+
+	if (sscanf(cmd, "%*s %31s", group_name) != 1)
+	{
+		command_writef(ctx, "用法: %s <groupname>", strcmp(control, GROUP_CONTROL_JOIN) == 0 ? "join" : "leave");
+		return 0;
+	}
+
+	if (client_send_group_message(client, group_name, control) != 0)
+	{
+		command_write(ctx, "发送群组请求失败");
+	}
+
+	return 0;
+}
+
+static int command_sync(AppClient *client, ClientCommandContext *ctx, const char *cmd)
+{
+	char target[32];
+
+	if (sscanf(cmd, "%*s %31s", target) != 1)
+	{
+		command_write(ctx, "用法: sync <target>");
+		return 0;
+	}
+
+	if (client_sync_history(client, target) == 0)
+	{
+		command_write(ctx, "同步请求已发送");
+	}
+	else
+	{
+		command_write(ctx, "同步历史记录失败");
+	}
+
+	return 0;
+}
+
+static int command_search(AppClient *client, ClientCommandContext *ctx, const char *cmd)
+{
+	char target[32];
+	const char *query = command_args(cmd);
+
+	while (*query && !isspace((unsigned char)*query))
+	{
+		query++;
+	}
+	while (*query && isspace((unsigned char)*query))
+	{
+		query++;
+	}
+
+	if (sscanf(cmd, "%*s %31s", target) != 1 || strlen(query) == 0)
+	{
+		command_write(ctx, "用法: search <target> <words>");
+		return 0;
+	}
+
+	if (client_search_history(client, target, query) == 0)
+	{
+		command_write(ctx, "检索请求已发送");
+	}
+	else
+	{
+		command_write(ctx, "检索历史记录失败");
+	}
+
+	return 0;
+}
+
 static int command_history(AppClient *client, ClientCommandContext *ctx, const char *cmd)
 {
 	char target[32];
@@ -323,7 +429,7 @@ static int command_history(AppClient *client, ClientCommandContext *ctx, const c
 		return 0;
 	}
 
-	if (client_request_history(client, target, NULL, NULL) == 0)
+	if (client_history(client, target) == 0)
 	{
 		command_write(ctx, "历史记录请求已发送");
 	}
@@ -461,14 +567,34 @@ int client_command_execute(AppClient *client, ClientCommandContext *ctx, const c
 	{
 		return command_group(client, ctx, cmd);
 	}
+	if (command_matches(cmd, "join"))
+	{
+		return command_group_control(client, ctx, cmd, GROUP_CONTROL_JOIN);
+	}
+	if (command_matches(cmd, "leave"))
+	{
+		return command_group_control(client, ctx, cmd, GROUP_CONTROL_LEAVE);
+	}
 	if (command_matches(cmd, "history") || command_matches(cmd, "h"))
 	{
 		return command_history(client, ctx, cmd);
 	}
+	if (command_matches(cmd, "search"))
+	{
+		return command_search(client, ctx, cmd);
+	}
+	if (command_matches(cmd, "sync"))
+	{
+		return command_sync(client, ctx, cmd);
+	}
 	if (command_matches(cmd, "status") || command_matches(cmd, "st"))
 	{
 		return command_status(client, ctx);
 	}
+	if (command_matches(cmd, "presence") || command_matches(cmd, "p"))
+	{
+		return command_presence(client, ctx, cmd);
+	}
 	if (send_to_active_receiver(client, ctx, cmd))
 	{
 		return 0;
@@ -46,8 +46,6 @@ static void signal_handler(int sig)
  */
 int main(int argc, char *argv[])
 {
-	(void)argc;
-	(void)argv;
 	// 设置信号处理
 	signal(SIGINT, signal_handler);
 
@@ -62,6 +60,16 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	// --v2：登录时请求二进制协议 v2，服务器不支持时继续使用文本协议
+	// --cache-dir=<dir>：本地历史缓存目录，留空表示不缓存
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--v2") == 0)
+			client_set_protocol(&g_client, PROTOCOL_V2);
+		else if (strncmp(argv[i], "--cache-dir=", 12) == 0)
+			client_set_cache_dir(&g_client, argv[i] + 12);
+	}
+
 	// 显示欢迎信息
 	ui_show_welcome();
 
@@ -0,0 +1,605 @@
+/**
+ * @file message_cache.c
+ * @brief 客户端本地历史消息缓存
+ *
+ * 缓存文件只追加，每条记录是增量同步的一页：服务器给出的游标和这一页的全部消息。
+ * 一页作为一个整体校验，崩溃时写了一半的页在下次打开时被截掉，
+ * 消息和游标总是一起生效，不会出现缓存了消息却没有推进游标（下次重复下载）的情况。
+ *
+ * 打开时只读映射整个文件，扫描一遍建立按会话的消息位置列表和游标；
+ * 查看最近的消息直接从映射中解码，不读入全部内容。
+ *
+ * 页格式（小端）：
+ *   u32 length | u32 checksum | u32 cursor | u16 count | u8 peer_len | u8 reserved | peer | 消息条目
+ * 消息条目：
+ *   u8 sender_len | u8 receiver_len | u8 timestamp_len | u8 reserved | u16 content_len | 数据
+ * checksum 为 cursor 起全部字节的 FNV-1a。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "message_cache.h"
+
+/** 页头长度 */
+#define PAGE_HEADER 16
+/** 消息条目头长度 */
+#define ENTRY_HEADER 6
+/** 单条消息条目的最大长度 */
+#define ENTRY_MAX (ENTRY_HEADER + 2 * MAX_USERNAME_LEN + 32 + MAX_CONTENT_LEN)
+/** 一页最多的消息数 */
+#define PAGE_MAX_ENTRIES 65535
+
+static void put_u16(unsigned char *p, unsigned int v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+	put_u16(p, v & 0xFFFF);
+	put_u16(p + 2, v >> 16);
+}
+
+static unsigned int get_u16(const unsigned char *p)
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+	return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static uint32_t page_checksum(const unsigned char *data, size_t len)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= data[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static int conversation_matches(const void *value, const void *key)
+{
+	return strcmp(((const MessageCacheConversation *)value)->peer, (const char *)key) == 0;
+}
+
+/**
+ * @brief 规范化会话对方：空串和 NULL 表示广播
+ */
+static const char *normalize_peer(const char *peer)
+{
+	return peer && *peer ? peer : "all";
+}
+
+static MessageCacheConversation *find_conversation(MessageCache *cache, const char *peer)
+{
+	return (MessageCacheConversation *)hash_index_find(&cache->index, hash_index_hash_string(peer, MAX_USERNAME_LEN),
+													   peer, conversation_matches);
+}
+
+static MessageCacheConversation *get_conversation(MessageCache *cache, const char *peer)
+{
+	MessageCacheConversation *conv = find_conversation(cache, peer);
+	if (conv)
+		return conv;
+
+	conv = (MessageCacheConversation *)calloc(1, sizeof(MessageCacheConversation));
+	if (!conv)
+		return NULL;
+	safe_strcpy(conv->peer, peer, sizeof(conv->peer));
+	if (hash_index_insert(&cache->index, hash_index_hash_string(conv->peer, MAX_USERNAME_LEN), conv) != 0)
+	{
+		free(conv);
+		return NULL;
+	}
+	return conv;
+}
+
+/**
+ * @brief 校验一页并把其中的消息位置和游标加入索引
+ *
+ * @param data 页起始地址
+ * @param avail 从页起始到有效内容末尾的字节数
+ * @param offset 页在文件中的偏移
+ * @return size_t 页长度，页不完整或校验失败时返回0
+ */
+static size_t index_page(MessageCache *cache, const unsigned char *data, size_t avail, size_t offset)
+{
+	if (avail < PAGE_HEADER)
+		return 0;
+	size_t len = get_u32(data);
+	if (len < PAGE_HEADER || len > avail || page_checksum(data + 8, len - 8) != get_u32(data + 4))
+		return 0;
+
+	size_t peer_len = data[14];
+	unsigned int count = get_u16(data + 12);
+	char peer[MAX_USERNAME_LEN];
+	if (peer_len == 0 || peer_len >= sizeof(peer) || PAGE_HEADER + peer_len > len)
+		return 0;
+	memcpy(peer, data + PAGE_HEADER, peer_len);
+	peer[peer_len] = '\0';
+
+	MessageCacheConversation *conv = get_conversation(cache, peer);
+	if (!conv)
+		return 0;
+	if (conv->count + count > conv->cap)
+	{
+		size_t cap = conv->cap ? conv->cap : 64;
+		while (cap < conv->count + count)
+			cap *= 2;
+		size_t *grown = (size_t *)realloc(conv->offsets, cap * sizeof(size_t));
+		if (!grown)
+			return 0;
+		conv->offsets = grown;
+		conv->cap = cap;
+	}
+
+	size_t pos = PAGE_HEADER + peer_len;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (pos + ENTRY_HEADER > len)
+			return 0;
+		size_t entry_len = ENTRY_HEADER + data[pos] + data[pos + 1] + data[pos + 2] + get_u16(data + pos + 4);
+		if (pos + entry_len > len)
+			return 0;
+		conv->offsets[conv->count + i] = offset + pos;
+		pos += entry_len;
+	}
+	conv->count += count;
+	if (get_u32(data + 8) > conv->cursor)
+		conv->cursor = get_u32(data + 8);
+	return len;
+}
+
+/**
+ * @brief 让映射覆盖文件中的全部有效内容（在锁内调用）
+ */
+static int ensure_mapped(MessageCache *cache)
+{
+	if (cache->map.base && cache->map.len >= cache->bytes)
+		return 0;
+	platform_munmap_file(&cache->map);
+	memset(&cache->map, 0, sizeof(cache->map));
+	return platform_mmap_file(cache->path, cache->bytes, &cache->map);
+}
+
+/**
+ * @brief 把文件截到有效长度：有效前缀写到临时文件后替换原文件
+ */
+static int truncate_torn(const char *path, const unsigned char *data, size_t valid)
+{
+	char tmp[MAX_FILENAME_LEN + 8];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	FILE *fp = fopen(tmp, "wb");
+	if (!fp)
+		return -1;
+	int ok = (valid == 0 || fwrite(data, 1, valid, fp) == valid) && platform_file_sync(fp) == 0;
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+	{
+		remove(tmp);
+		return -1;
+	}
+	return platform_file_replace(tmp, path);
+}
+
+static void free_conversations(MessageCache *cache)
+{
+	for (size_t i = 0; i < cache->index.cap; i++)
+	{
+		MessageCacheConversation *conv = (MessageCacheConversation *)cache->index.slots[i].value;
+		if (conv)
+		{
+			free(conv->offsets);
+			free(conv);
+		}
+	}
+	hash_index_free(&cache->index);
+}
+
+/**
+ * @brief 初始化缓存结构（不打开文件）
+ *
+ * @return int 成功返回0，失败返回-1
+ */
+int message_cache_init(MessageCache *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+	return platform_mutex_init(&cache->lock);
+}
+
+/**
+ * @brief 关闭缓存并销毁锁
+ */
+void message_cache_destroy(MessageCache *cache)
+{
+	message_cache_close(cache);
+	platform_mutex_destroy(&cache->lock);
+}
+
+/**
+ * @brief 打开一个用户的缓存文件
+ *
+ * 已打开同一文件时直接返回；否则关闭当前文件，映射新文件并扫描重建索引，
+ * 校验失败的尾部（崩溃时写了一半的页）被截掉。
+ *
+ * @param cache 缓存
+ * @param dir 缓存目录，不存在时创建
+ * @param user 用户名，决定文件名
+ * @return int 成功返回0，失败返回-1
+ */
+int message_cache_open(MessageCache *cache, const char *dir, const char *user)
+{
+	char path[MAX_FILENAME_LEN];
+
+	if (!dir || !*dir || !user || !*user)
+		return -1;
+	int n = snprintf(path, sizeof(path), "%s/%s.cache", dir, user);
+	if (n < 0 || (size_t)n >= sizeof(path))
+		return -1;
+
+	platform_mutex_lock(&cache->lock);
+	if (cache->open && strcmp(cache->path, path) == 0)
+	{
+		platform_mutex_unlock(&cache->lock);
+		return 0;
+	}
+	platform_mutex_unlock(&cache->lock);
+	message_cache_close(cache);
+
+	if (platform_mkdir(dir) != 0)
+	{
+		LOG_WARN("Failed to create message cache directory %s", dir);
+		return -1;
+	}
+
+	platform_mutex_lock(&cache->lock);
+	safe_strcpy(cache->path, path, sizeof(cache->path));
+	hash_index_init(&cache->index, 0);
+
+	size_t size = 0;
+	FILE *probe = fopen(path, "rb");
+	if (probe)
+	{
+		if (fseek(probe, 0, SEEK_END) == 0)
+		{
+			long end = ftell(probe);
+			size = end > 0 ? (size_t)end : 0;
+		}
+		fclose(probe);
+	}
+
+	size_t valid = 0;
+	if (size > 0)
+	{
+		if (platform_mmap_file(path, size, &cache->map) != 0)
+		{
+			hash_index_free(&cache->index);
+			platform_mutex_unlock(&cache->lock);
+			LOG_WARN("Failed to map message cache %s", path);
+			return -1;
+		}
+
+		size_t len;
+		while ((len = index_page(cache, cache->map.base + valid, size - valid, valid)) > 0)
+			valid += len;
+		if (valid < size)
+		{
+			LOG_WARN("Message cache %s has a torn tail, keeping %zu of %zu bytes", path, valid, size);
+			int truncated = truncate_torn(path, cache->map.base, valid);
+			platform_munmap_file(&cache->map);
+			memset(&cache->map, 0, sizeof(cache->map));
+			if (truncated != 0)
+			{
+				free_conversations(cache);
+				platform_mutex_unlock(&cache->lock);
+				return -1;
+			}
+		}
+	}
+
+	cache->fp = fopen(path, "ab");
+	if (!cache->fp)
+	{
+		platform_munmap_file(&cache->map);
+		memset(&cache->map, 0, sizeof(cache->map));
+		free_conversations(cache);
+		platform_mutex_unlock(&cache->lock);
+		LOG_WARN("Failed to open message cache %s", path);
+		return -1;
+	}
+	cache->bytes = valid;
+	cache->open = 1;
+	LOG_INFO("Message cache opened: %s, %zu conversations, %zu bytes", path, cache->index.count, valid);
+	platform_mutex_unlock(&cache->lock);
+	return 0;
+}
+
+/**
+ * @brief 关闭缓存文件，丢弃尚未提交的页并释放索引
+ */
+void message_cache_close(MessageCache *cache)
+{
+	platform_mutex_lock(&cache->lock);
+	if (cache->open)
+	{
+		fclose(cache->fp);
+		cache->fp = NULL;
+		platform_munmap_file(&cache->map);
+		memset(&cache->map, 0, sizeof(cache->map));
+		free_conversations(cache);
+		cache->open = 0;
+		cache->bytes = 0;
+	}
+	free(cache->page);
+	cache->page = NULL;
+	cache->page_len = 0;
+	cache->page_cap = 0;
+	cache->page_count = 0;
+	platform_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief 判断缓存是否已打开
+ */
+int message_cache_is_open(MessageCache *cache)
+{
+	platform_mutex_lock(&cache->lock);
+	int open = cache->open;
+	platform_mutex_unlock(&cache->lock);
+	return open;
+}
+
+/**
+ * @brief 把一条同步收到的消息加入正在接收的页
+ *
+ * 换了会话时丢弃之前未提交的页。
+ *
+ * @param cache 缓存
+ * @param peer 消息所属的会话
+ * @param msg 收到的历史消息
+ * @return int 成功返回0，未打开或内存不足返回-1
+ */
+int message_cache_add(MessageCache *cache, const char *peer, const Message *msg)
+{
+	peer = normalize_peer(peer);
+	platform_mutex_lock(&cache->lock);
+	if (!cache->open || cache->page_count >= PAGE_MAX_ENTRIES)
+	{
+		platform_mutex_unlock(&cache->lock);
+		return -1;
+	}
+	if (cache->page_count > 0 && strcmp(cache->page_peer, peer) != 0)
+	{
+		cache->page_len = 0;
+		cache->page_count = 0;
+	}
+	safe_strcpy(cache->page_peer, peer, sizeof(cache->page_peer));
+
+	if (cache->page_len + ENTRY_MAX > cache->page_cap)
+	{
+		size_t cap = cache->page_cap ? cache->page_cap * 2 : 16 * ENTRY_MAX;
+		unsigned char *grown = (unsigned char *)realloc(cache->page, cap);
+		if (!grown)
+		{
+			platform_mutex_unlock(&cache->lock);
+			return -1;
+		}
+		cache->page = grown;
+		cache->page_cap = cap;
+	}
+
+	size_t sender_len = strnlen(msg->sender, MAX_USERNAME_LEN - 1);
+	size_t receiver_len = strnlen(msg->receiver, MAX_USERNAME_LEN - 1);
+	size_t timestamp_len = strnlen(msg->timestamp, 31);
+	size_t content_len = strnlen(msg->content, MAX_CONTENT_LEN - 1);
+	unsigned char *p = cache->page + cache->page_len;
+	p[0] = (unsigned char)sender_len;
+	p[1] = (unsigned char)receiver_len;
+	p[2] = (unsigned char)timestamp_len;
+	p[3] = 0;
+	put_u16(p + 4, (unsigned int)content_len);
+	p += ENTRY_HEADER;
+	memcpy(p, msg->sender, sender_len);
+	p += sender_len;
+	memcpy(p, msg->receiver, receiver_len);
+	p += receiver_len;
+	memcpy(p, msg->timestamp, timestamp_len);
+	p += timestamp_len;
+	memcpy(p, msg->content, content_len);
+	cache->page_len += ENTRY_HEADER + sender_len + receiver_len + timestamp_len + content_len;
+	cache->page_count++;
+	platform_mutex_unlock(&cache->lock);
+	return 0;
+}
+
+/**
+ * @brief 收到游标后把正在接收的页写入缓存文件
+ *
+ * 页和游标作为一条记录追加并刷新到文件，再加入索引。
+ * 游标没有前进且页为空时什么都不写。
+ *
+ * @param cache 缓存
+ * @param peer 页所属的会话，与正在接收的页不符时只记录游标
+ * @param cursor 服务器给出的游标
+ * @return int 成功返回0，未打开或写入失败返回-1
+ */
+int message_cache_commit(MessageCache *cache, const char *peer, uint32_t cursor)
+{
+	unsigned char header[PAGE_HEADER + MAX_USERNAME_LEN];
+
+	peer = normalize_peer(peer);
+	platform_mutex_lock(&cache->lock);
+	if (!cache->open)
+	{
+		cache->page_len = 0;
+		cache->page_count = 0;
+		platform_mutex_unlock(&cache->lock);
+		return -1;
+	}
+	if (cache->page_count > 0 && strcmp(cache->page_peer, peer) != 0)
+	{
+		cache->page_len = 0;
+		cache->page_count = 0;
+	}
+
+	MessageCacheConversation *conv = find_conversation(cache, peer);
+	if (cache->page_count == 0 && (!conv ? cursor == 0 : cursor <= conv->cursor))
+	{
+		platform_mutex_unlock(&cache->lock);
+		return 0;
+	}
+
+	size_t peer_len = strnlen(peer, MAX_USERNAME_LEN - 1);
+	size_t len = PAGE_HEADER + peer_len + cache->page_len;
+	put_u32(header, (uint32_t)len);
+	put_u32(header + 8, cursor);
+	put_u16(header + 12, (unsigned int)cache->page_count);
+	header[14] = (unsigned char)peer_len;
+	header[15] = 0;
+	memcpy(header + PAGE_HEADER, peer, peer_len);
+
+	/* 校验和覆盖页头的游标之后和全部条目，分两段累积 */
+	uint32_t h = page_checksum(header + 8, PAGE_HEADER - 8 + peer_len);
+	for (size_t i = 0; i < cache->page_len; i++)
+	{
+		h ^= cache->page[i];
+		h *= 16777619u;
+	}
+	put_u32(header + 4, h);
+
+	int written = fwrite(header, 1, PAGE_HEADER + peer_len, cache->fp) == PAGE_HEADER + peer_len &&
+				  (cache->page_len == 0 || fwrite(cache->page, 1, cache->page_len, cache->fp) == cache->page_len) &&
+				  fflush(cache->fp) == 0;
+	if (!written)
+	{
+		/* 写了一半的页留在文件尾部，下次打开时被截掉；本次不再追加 */
+		LOG_WARN("Failed to write message cache %s", cache->path);
+		cache->page_len = 0;
+		cache->page_count = 0;
+		platform_mutex_unlock(&cache->lock);
+		return -1;
+	}
+
+	/* 索引直接从内存中的页建立：拼成连续的一页后与打开时走同一段代码 */
+	unsigned char *record = (unsigned char *)malloc(len);
+	if (record)
+	{
+		memcpy(record, header, PAGE_HEADER + peer_len);
+		memcpy(record + PAGE_HEADER + peer_len, cache->page, cache->page_len);
+		index_page(cache, record, len, cache->bytes);
+		free(record);
+	}
+	cache->bytes += len;
+	cache->page_len = 0;
+	cache->page_count = 0;
+	platform_mutex_unlock(&cache->lock);
+	return 0;
+}
+
+/**
+ * @brief 丢弃正在接收的页
+ */
+void message_cache_discard(MessageCache *cache)
+{
+	platform_mutex_lock(&cache->lock);
+	cache->page_len = 0;
+	cache->page_count = 0;
+	platform_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief 获取会话已缓存到的服务器序号
+ *
+ * @return uint32_t 游标，未打开或没有缓存时为0
+ */
+uint32_t message_cache_cursor(MessageCache *cache, const char *peer)
+{
+	peer = normalize_peer(peer);
+	platform_mutex_lock(&cache->lock);
+	MessageCacheConversation *conv = cache->open ? find_conversation(cache, peer) : NULL;
+	uint32_t cursor = conv ? conv->cursor : 0;
+	platform_mutex_unlock(&cache->lock);
+	return cursor;
+}
+
+/**
+ * @brief 获取会话已缓存的消息数
+ */
+size_t message_cache_count(MessageCache *cache, const char *peer)
+{
+	peer = normalize_peer(peer);
+	platform_mutex_lock(&cache->lock);
+	MessageCacheConversation *conv = cache->open ? find_conversation(cache, peer) : NULL;
+	size_t count = conv ? conv->count : 0;
+	platform_mutex_unlock(&cache->lock);
+	return count;
+}
+
+/**
+ * @brief 按同步顺序访问会话最近的 limit 条缓存消息
+ *
+ * 消息从文件映射中解码，type 为 HISTORY。回调在缓存锁内执行，不能再调用本模块的函数。
+ *
+ * @param cache 缓存
+ * @param peer 会话对方，"all" 表示广播
+ * @param limit 最多访问的条数
+ * @param visit 逐条回调
+ * @param ctx 回调上下文
+ * @return int 访问的条数，未打开或映射失败返回-1
+ */
+int message_cache_recent(MessageCache *cache, const char *peer, int limit, MessageCacheVisitor visit, void *ctx)
+{
+	Message msg;
+	int visited = 0;
+
+	peer = normalize_peer(peer);
+	platform_mutex_lock(&cache->lock);
+	if (!cache->open)
+	{
+		platform_mutex_unlock(&cache->lock);
+		return -1;
+	}
+	MessageCacheConversation *conv = find_conversation(cache, peer);
+	if (!conv || conv->count == 0 || limit <= 0)
+	{
+		platform_mutex_unlock(&cache->lock);
+		return 0;
+	}
+	if (ensure_mapped(cache) != 0)
+	{
+		platform_mutex_unlock(&cache->lock);
+		return -1;
+	}
+
+	size_t first = conv->count > (size_t)limit ? conv->count - (size_t)limit : 0;
+	for (size_t i = first; i < conv->count; i++)
+	{
+		const unsigned char *p = cache->map.base + conv->offsets[i];
+		size_t sender_len = p[0];
+		size_t receiver_len = p[1];
+		size_t timestamp_len = p[2];
+		size_t content_len = get_u16(p + 4);
+
+		memset(&msg, 0, sizeof(msg));
+		safe_strcpy(msg.type, MSG_TYPE_HISTORY, sizeof(msg.type));
+		p += ENTRY_HEADER;
+		memcpy(msg.sender, p, sender_len);
+		p += sender_len;
+		memcpy(msg.receiver, p, receiver_len);
+		p += receiver_len;
+		memcpy(msg.timestamp, p, timestamp_len);
+		p += timestamp_len;
+		memcpy(msg.content, p, content_len);
+		visited++;
+		if (visit(&msg, ctx) != 0)
+			break;
+	}
+	platform_mutex_unlock(&cache->lock);
+	return visited;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file message_cache.h
+ * @brief 客户端本地历史消息缓存
+ *
+ * 增量同步收到的每一页历史消息连同服务器给出的游标作为一条记录追加到
+ * 按用户划分的缓存文件，启动时映射文件重建按会话的索引。查看历史时先从
+ * 本地缓存显示，再用游标只向服务器请求缓存之后的消息。
+ */
+
+#ifndef MESSAGE_CACHE_H
+#define MESSAGE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../platform/platform.h"
+#include "../protocol/protocol.h"
+#include "../utils/utils.h"
+
+#define MESSAGE_CACHE_DEFAULT_DIR "client_cache" /**< 默认的缓存目录 */
+#define MESSAGE_CACHE_VIEW_LIMIT 50				 /**< 查看历史时从本地显示的最近消息数 */
+
+/**
+ * @brief 一个会话在缓存中的消息
+ *
+ * 位置为消息条目在缓存文件中的偏移，按同步顺序（即服务器序号顺序）追加。
+ */
+typedef struct
+{
+	char peer[MAX_USERNAME_LEN]; /**< 会话对方，"all" 表示广播 */
+	size_t *offsets;			 /**< 消息条目的文件偏移 */
+	size_t count;				 /**< 消息数 */
+	size_t cap;					 /**< 偏移数组容量 */
+	uint32_t cursor;			 /**< 已缓存到的服务器序号 */
+} MessageCacheConversation;
+
+/**
+ * @brief 一个用户的本地缓存
+ *
+ * 接收线程把同步页的消息先放在 page 中，收到带游标的 OK 后整页写入文件；
+ * 读取走文件映射，追加后映射长度不足时重新映射。所有操作在 lock 内进行。
+ */
+typedef struct
+{
+	platform_mutex_t lock;					/**< 保护以下全部字段 */
+	int open;								/**< 已打开 */
+	char path[MAX_FILENAME_LEN];			/**< 缓存文件路径 */
+	FILE *fp;								/**< 追加句柄 */
+	size_t bytes;							/**< 文件中有效内容的长度 */
+	platform_mmap_t map;					/**< 读取用的只读映射 */
+	HashIndex index;						/**< 会话对方 -> MessageCacheConversation */
+	char page_peer[MAX_USERNAME_LEN];		/**< 正在接收的页所属的会话 */
+	unsigned char *page;					/**< 正在接收的页，已编码的消息条目 */
+	size_t page_len;						/**< 页长度 */
+	size_t page_cap;						/**< 页缓冲区容量 */
+	int page_count;							/**< 页中的消息数 */
+} MessageCache;
+
+/**
+ * @brief 逐条访问缓存消息的回调，返回非0时停止
+ */
+typedef int (*MessageCacheVisitor)(const Message *msg, void *ctx);
+
+int message_cache_init(MessageCache *cache);
+void message_cache_destroy(MessageCache *cache);
+int message_cache_open(MessageCache *cache, const char *dir, const char *user);
+void message_cache_close(MessageCache *cache);
+int message_cache_is_open(MessageCache *cache);
+
+/* 同步页：逐条加入，收到游标后整页写入，出错时丢弃 */
+int message_cache_add(MessageCache *cache, const char *peer, const Message *msg);
+int message_cache_commit(MessageCache *cache, const char *peer, uint32_t cursor);
+void message_cache_discard(MessageCache *cache);
+
+/* 查询：游标、消息数和最近的消息 */
+uint32_t message_cache_cursor(MessageCache *cache, const char *peer);
+size_t message_cache_count(MessageCache *cache, const char *peer);
+int message_cache_recent(MessageCache *cache, const char *peer, int limit, MessageCacheVisitor visit, void *ctx);
+
+#endif /* MESSAGE_CACHE_H */
@@ -0,0 +1,1002 @@
+/**
+ * @file cluster.c
+ * @brief 多节点集群：一致性哈希放置用户，节点间链路批量转发帧
+ *
+ * 集群中每个节点运行同一份节点列表，按一致性哈希（每个节点 CLUSTER_VIRTUAL_NODES 个
+ * 虚拟点）为每个用户名确定一个归属节点。用户可以连在任意节点上（前面放普通的 TCP
+ * 负载均衡器即可），连接所在节点在用户上线/下线时通知归属节点，归属节点因此知道
+ * 用户当前在哪个节点，并保存该用户的离线消息。
+ *
+ * 私聊的接收者不在本节点时，帧交给接收者的归属节点：接收者在归属节点上就直接投递，
+ * 在其他节点上就转给那个节点，都不在线时存入归属节点的离线队列，用户在任何节点上线时
+ * 由归属节点转给该节点。广播帧发给其他每个节点，由各节点发给自己的连接。
+ *
+ * 每对节点之间有一条单向链路：发送方的链路线程把待发记录攒在缓冲区里，
+ * 一次写出当前攒下的全部记录，不等待对方确认；对方按记录逐条处理。链路断开时
+ * 记录继续在缓冲区中累积（超过 CLUSTER_LINK_BUFFER 的丢弃并计数），重连后先把
+ * 本节点上归属于对方的在线用户重新登记一遍。链路只保证连接期间按序送达，
+ * 写出途中断开的一批记录会丢失。
+ *
+ * 记录格式为一行头部 "<op> <arg> <len>\n" 加 len 字节的帧：
+ * H 问候（arg 为发送方节点编号）、U/D 用户上线/下线、M 交给归属节点的私聊、
+ * P 归属节点转来的私聊、Q 退回归属节点的离线消息、B 广播（arg 为发送者）。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core.h"
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+/** 每个节点在哈希环上的虚拟点数 */
+#define CLUSTER_VIRTUAL_NODES 64
+
+/** 每条链路待发记录的字节上限 */
+#define CLUSTER_LINK_BUFFER (4 * 1024 * 1024)
+
+/** 连接失败后的重试间隔（毫秒） */
+#define CLUSTER_RETRY_MS 500
+
+/** 监听和读取线程等待数据的超时，到时检查是否需要停止 */
+#define CLUSTER_POLL_MS 500
+
+/** 记录头部的最大长度 */
+#define CLUSTER_HEADER_BYTES 64
+
+/** 同时存在的入站连接数上限 */
+#define CLUSTER_MAX_READERS (CLUSTER_MAX_NODES * 2)
+
+/**
+ * @brief 节点地址
+ */
+typedef struct
+{
+	char host[64]; /**< IPv4 地址 */
+	int port;	   /**< 集群链路端口 */
+} ClusterNode;
+
+/**
+ * @brief 哈希环上的一个虚拟点
+ */
+typedef struct
+{
+	uint64_t point; /**< 在环上的位置 */
+	int node;		/**< 所属节点 */
+} RingPoint;
+
+/**
+ * @brief 到一个其他节点的出站链路
+ */
+typedef struct
+{
+	int node;					/**< 对方节点编号 */
+	platform_mutex_t lock;		/**< 保护待发缓冲区 */
+	platform_cond_t ready;		/**< 有记录待发或需要停止 */
+	char *pending;				/**< 待发记录 */
+	size_t pending_len;			/**< 待发字节数 */
+	size_t pending_records;		/**< 待发记录数 */
+	socket_t fd;				/**< 链路套接字，只由链路线程使用 */
+	atomic_int connected;		/**< 链路已连通 */
+	platform_thread_t thread;	/**< 链路线程 */
+} ClusterLink;
+
+/**
+ * @brief 一个入站连接
+ */
+typedef struct
+{
+	socket_t fd;			  /**< 套接字 */
+	int node;				  /**< 对方节点编号，收到问候前为-1 */
+	atomic_int active;		  /**< 读取线程仍在运行 */
+	platform_thread_t thread; /**< 读取线程 */
+} ClusterReader;
+
+/**
+ * @brief 归属于本节点、连在其他节点上的用户的位置
+ */
+typedef struct ClusterLocation
+{
+	char username[MAX_USERNAME_LEN]; /**< 用户名 */
+	uint32_t nodes;					 /**< 用户有已认证连接的节点位图 */
+	struct ClusterLocation *prev;	 /**< 全部位置的链表，节点断开时遍历清除 */
+	struct ClusterLocation *next;
+} ClusterLocation;
+
+/** 节点列表和哈希环，cluster_configure 之后只读 */
+static ClusterNode nodes[CLUSTER_MAX_NODES];
+static int node_count = 0;
+static int self_node = -1;
+static RingPoint ring[CLUSTER_MAX_NODES * CLUSTER_VIRTUAL_NODES];
+static int ring_len = 0;
+
+/** 链路和读取线程 */
+static ClusterLink links[CLUSTER_MAX_NODES];
+static ClusterReader readers[CLUSTER_MAX_READERS];
+static socket_t listen_fd = SOCKET_INVALID;
+static platform_thread_t listener_thread;
+static atomic_int cluster_running = 0;
+
+/** 位置表，由互斥锁保护 */
+static platform_mutex_t location_lock = PLATFORM_MUTEX_INITIALIZER;
+static HashIndex location_index;
+static ClusterLocation *location_head = NULL;
+
+/**
+ * @brief 64 位 FNV-1a 加末尾混合，各节点对同一输入得到相同的值
+ */
+static uint64_t ring_hash(const char *data, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= (unsigned char)data[i];
+		h *= 0x100000001b3ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static int compare_points(const void *a, const void *b)
+{
+	const RingPoint *pa = (const RingPoint *)a;
+	const RingPoint *pb = (const RingPoint *)b;
+
+	if (pa->point != pb->point)
+		return pa->point < pb->point ? -1 : 1;
+	return pa->node - pb->node;
+}
+
+static int match_location(const void *value, const void *key)
+{
+	return strncmp(((const ClusterLocation *)value)->username, (const char *)key, MAX_USERNAME_LEN) == 0;
+}
+
+static size_t location_hash(const char *username)
+{
+	return hash_index_hash_string(username, MAX_USERNAME_LEN);
+}
+
+/**
+ * @brief 解析节点列表并建立哈希环
+ *
+ * 只解析配置，不启动链路，测试可以单独用它检查用户的放置。
+ *
+ * @param spec 逗号分隔的 "IPv4:端口" 列表，所有节点必须使用相同的列表
+ * @param self 本节点在列表中的下标
+ * @return int 成功返回节点数，格式错误、节点过多或下标越界返回-1
+ */
+int cluster_configure(const char *spec, int self)
+{
+	int count = 0;
+
+	node_count = 0;
+	self_node = -1;
+	ring_len = 0;
+	if (!spec)
+		return -1;
+
+	for (const char *p = spec; *p;)
+	{
+		const char *end = strchr(p, ',');
+		size_t len = end ? (size_t)(end - p) : strlen(p);
+		const char *colon = memchr(p, ':', len);
+
+		if (count >= CLUSTER_MAX_NODES || !colon || colon == p || (size_t)(colon - p) >= sizeof(nodes[0].host))
+			return -1;
+		memcpy(nodes[count].host, p, (size_t)(colon - p));
+		nodes[count].host[colon - p] = '\0';
+		nodes[count].port = atoi(colon + 1);
+		if (nodes[count].port <= 0 || nodes[count].port > 65535)
+			return -1;
+		count++;
+		p = end ? end + 1 : p + len;
+	}
+	if (count == 0 || self < 0 || self >= count)
+		return -1;
+
+	for (int n = 0; n < count; n++)
+	{
+		for (int v = 0; v < CLUSTER_VIRTUAL_NODES; v++)
+		{
+			char label[96];
+			int len = snprintf(label, sizeof(label), "%s:%d#%d", nodes[n].host, nodes[n].port, v);
+			ring[ring_len].point = ring_hash(label, (size_t)len);
+			ring[ring_len].node = n;
+			ring_len++;
+		}
+	}
+	qsort(ring, (size_t)ring_len, sizeof(RingPoint), compare_points);
+
+	node_count = count;
+	self_node = self;
+	return count;
+}
+
+/**
+ * @brief 获取用户的归属节点
+ *
+ * @param username 用户名
+ * @return int 节点编号，未配置集群时返回-1
+ */
+int cluster_home(const char *username)
+{
+	if (ring_len == 0 || !username)
+		return -1;
+
+	uint64_t h = ring_hash(username, strnlen(username, MAX_USERNAME_LEN));
+	int lo = 0, hi = ring_len;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (ring[mid].point < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return ring[lo == ring_len ? 0 : lo].node;
+}
+
+/**
+ * @brief 集群是否在运行
+ */
+int cluster_enabled(void)
+{
+	return atomic_load(&cluster_running);
+}
+
+/**
+ * @brief 获取本节点编号和节点数
+ *
+ * @param count 输出节点数，可以为NULL
+ * @return int 本节点编号，未配置时返回-1
+ */
+int cluster_self(int *count)
+{
+	if (count)
+		*count = node_count;
+	return self_node;
+}
+
+/**
+ * @brief 获取已连通的出站链路数
+ */
+int cluster_links_up(void)
+{
+	int up = 0;
+
+	for (int n = 0; n < node_count; n++)
+	{
+		if (n != self_node && atomic_load(&links[n].connected))
+			up++;
+	}
+	return up;
+}
+
+/**
+ * @brief 把一条记录追加到链路的待发缓冲区
+ *
+ * 调用者持有 link->lock。
+ *
+ * @return int 成功返回0，超过缓冲区上限或内存不足返回-1
+ */
+static int append_record(ClusterLink *link, char op, const char *arg, const char *data, size_t len)
+{
+	char header[CLUSTER_HEADER_BYTES];
+	int header_len = snprintf(header, sizeof(header), "%c %s %zu\n", op, arg, len);
+
+	if (header_len <= 0 || (size_t)header_len >= sizeof(header) ||
+		link->pending_len + (size_t)header_len + len > CLUSTER_LINK_BUFFER)
+		return -1;
+	if (!link->pending)
+	{
+		link->pending = (char *)malloc(CLUSTER_LINK_BUFFER);
+		if (!link->pending)
+			return -1;
+	}
+	memcpy(link->pending + link->pending_len, header, (size_t)header_len);
+	link->pending_len += (size_t)header_len;
+	if (len > 0)
+		memcpy(link->pending + link->pending_len, data, len);
+	link->pending_len += len;
+	link->pending_records++;
+	return 0;
+}
+
+/**
+ * @brief 把一条记录交给到指定节点的链路
+ *
+ * 只追加到待发缓冲区并唤醒链路线程，不等待写出。
+ *
+ * @return int 成功返回0，节点无效或缓冲区已满返回-1
+ */
+static int link_send(int node, char op, const char *arg, const char *data, size_t len)
+{
+	if (!atomic_load(&cluster_running) || node < 0 || node >= node_count || node == self_node)
+		return -1;
+
+	ClusterLink *link = &links[node];
+	platform_mutex_lock(&link->lock);
+	int result = append_record(link, op, arg, data, len);
+	if (result == 0 && link->pending_records == 1)
+		platform_cond_signal(&link->ready);
+	platform_mutex_unlock(&link->lock);
+
+	if (result != 0)
+	{
+		metrics_add(STAT_CLUSTER_DROPPED, 1);
+		LOG_WARN("Cluster link to node %d full, dropped %c record for %s", node, op, arg);
+	}
+	return result;
+}
+
+/* 写出全部数据，出错返回-1 */
+static int send_all(socket_t fd, const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		socket_io_result_t sent = platform_socket_send(fd, data, len);
+		if (sent <= 0)
+		{
+			if (sent < 0 && platform_socket_interrupted())
+				continue;
+			return -1;
+		}
+		data += sent;
+		len -= (size_t)sent;
+	}
+	return 0;
+}
+
+/**
+ * @brief 连接到其他节点的链路端口
+ *
+ * @return socket_t 成功返回阻塞套接字，失败返回 SOCKET_INVALID
+ */
+static socket_t link_connect(int node)
+{
+	struct sockaddr_in addr;
+	socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (SOCKET_IS_INVALID(fd))
+		return SOCKET_INVALID;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(nodes[node].port);
+	if (inet_pton(AF_INET, nodes[node].host, &addr.sin_addr) <= 0 ||
+		connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		platform_socket_close(fd);
+		return SOCKET_INVALID;
+	}
+
+	/* 记录已经成批写出，不需要再等 Nagle 合并 */
+	int opt = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&opt, sizeof(opt));
+	return fd;
+}
+
+/**
+ * @brief 链路连通后先发问候，再登记本节点上归属于对方的在线用户
+ */
+static int link_greet(ClusterLink *link)
+{
+	char self[16];
+	snprintf(self, sizeof(self), "%d", self_node);
+
+	ClusterLink hello = {.pending = NULL};
+	if (append_record(&hello, 'H', self, NULL, 0) != 0)
+		return -1;
+
+	const OnlineRoster *roster = connection_manager_roster_acquire();
+	for (const char *name = roster ? roster->names : ""; *name;)
+	{
+		const char *end = strchr(name, ',');
+		size_t len = end ? (size_t)(end - name) : strlen(name);
+		char username[MAX_USERNAME_LEN];
+
+		if (len < sizeof(username))
+		{
+			memcpy(username, name, len);
+			username[len] = '\0';
+			if (cluster_home(username) == link->node)
+				append_record(&hello, 'U', username, NULL, 0);
+		}
+		name = end ? end + 1 : name + len;
+	}
+	connection_manager_roster_release(roster);
+
+	int result = send_all(link->fd, hello.pending, hello.pending_len);
+	free(hello.pending);
+	return result;
+}
+
+/**
+ * @brief 出站链路线程：连接对方，每次取走全部待发记录一次写出
+ */
+static platform_thread_return_t PLATFORM_THREAD_CALL link_main(void *arg)
+{
+	ClusterLink *link = (ClusterLink *)arg;
+	char *batch = NULL;
+
+	while (atomic_load(&cluster_running))
+	{
+		if (SOCKET_IS_INVALID(link->fd))
+		{
+			link->fd = link_connect(link->node);
+			if (SOCKET_IS_INVALID(link->fd) || link_greet(link) != 0)
+			{
+				if (SOCKET_IS_VALID(link->fd))
+					platform_socket_close(link->fd);
+				link->fd = SOCKET_INVALID;
+				platform_sleep_ms(CLUSTER_RETRY_MS);
+				continue;
+			}
+			atomic_store(&link->connected, 1);
+			LOG_INFO("Cluster link to node %d (%s:%d) up", link->node, nodes[link->node].host, nodes[link->node].port);
+		}
+
+		platform_mutex_lock(&link->lock);
+		while (atomic_load(&cluster_running) && link->pending_records == 0)
+			platform_cond_wait(&link->ready, &link->lock);
+		char *full = link->pending;
+		size_t len = link->pending_len;
+		size_t records = link->pending_records;
+		link->pending = batch;
+		link->pending_len = 0;
+		link->pending_records = 0;
+		platform_mutex_unlock(&link->lock);
+		batch = full;
+
+		if (records == 0)
+			continue;
+		if (send_all(link->fd, batch, len) != 0)
+		{
+			LOG_WARN("Cluster link to node %d lost, %zu records dropped", link->node, records);
+			metrics_add(STAT_CLUSTER_DROPPED, records);
+			platform_socket_close(link->fd);
+			link->fd = SOCKET_INVALID;
+			atomic_store(&link->connected, 0);
+			continue;
+		}
+		metrics_add(STAT_CLUSTER_SENT, records);
+		metrics_add(STAT_CLUSTER_BATCHES, 1);
+	}
+
+	if (SOCKET_IS_VALID(link->fd))
+		platform_socket_close(link->fd);
+	link->fd = SOCKET_INVALID;
+	atomic_store(&link->connected, 0);
+	free(batch);
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/**
+ * @brief 登记用户在某个节点上线，返回登记前的节点位图
+ */
+static uint32_t location_add(const char *username, int node)
+{
+	size_t h = location_hash(username);
+	uint32_t before = 0;
+
+	platform_mutex_lock(&location_lock);
+	ClusterLocation *loc = (ClusterLocation *)hash_index_find(&location_index, h, username, match_location);
+	if (!loc)
+	{
+		loc = (ClusterLocation *)calloc(1, sizeof(ClusterLocation));
+		if (loc && hash_index_insert(&location_index, h, loc) != 0)
+		{
+			free(loc);
+			loc = NULL;
+		}
+		if (loc)
+		{
+			safe_strcpy(loc->username, username, sizeof(loc->username));
+			loc->next = location_head;
+			if (location_head)
+				location_head->prev = loc;
+			location_head = loc;
+		}
+	}
+	if (loc)
+	{
+		before = loc->nodes;
+		loc->nodes |= 1u << node;
+	}
+	platform_mutex_unlock(&location_lock);
+	return before;
+}
+
+/**
+ * @brief 从位置表中摘下一个条目，调用者持有 location_lock
+ */
+static void location_unlink(ClusterLocation *loc)
+{
+	hash_index_remove(&location_index, location_hash(loc->username), loc, NULL);
+	if (loc->prev)
+		loc->prev->next = loc->next;
+	else
+		location_head = loc->next;
+	if (loc->next)
+		loc->next->prev = loc->prev;
+	free(loc);
+}
+
+/**
+ * @brief 登记用户在某个节点下线
+ */
+static void location_remove(const char *username, int node)
+{
+	platform_mutex_lock(&location_lock);
+	ClusterLocation *loc = (ClusterLocation *)hash_index_find(&location_index, location_hash(username), username, match_location);
+	if (loc)
+	{
+		loc->nodes &= ~(1u << node);
+		if (loc->nodes == 0)
+			location_unlink(loc);
+	}
+	platform_mutex_unlock(&location_lock);
+}
+
+/**
+ * @brief 节点的链路断开时清除该节点上的全部用户
+ */
+static void location_forget_node(int node)
+{
+	platform_mutex_lock(&location_lock);
+	for (ClusterLocation *loc = location_head, *next; loc; loc = next)
+	{
+		next = loc->next;
+		loc->nodes &= ~(1u << node);
+		if (loc->nodes == 0)
+			location_unlink(loc);
+	}
+	platform_mutex_unlock(&location_lock);
+}
+
+/**
+ * @brief 查找用户所在的其他节点
+ *
+ * @return int 编号最小的节点，用户不在任何其他节点上时返回-1
+ */
+static int location_find(const char *username)
+{
+	int node = -1;
+
+	platform_mutex_lock(&location_lock);
+	ClusterLocation *loc = (ClusterLocation *)hash_index_find(&location_index, location_hash(username), username, match_location);
+	if (loc)
+	{
+		for (int n = 0; n < node_count; n++)
+		{
+			if (loc->nodes & (1u << n))
+			{
+				node = n;
+				break;
+			}
+		}
+	}
+	platform_mutex_unlock(&location_lock);
+	return node;
+}
+
+/**
+ * @brief 把帧投递给本节点上在线的用户（经用户所在分片的邮箱）
+ *
+ * @return int 成功返回0，用户不在本节点上返回-1
+ */
+static int deliver_local(const char *username, const char *data, size_t len)
+{
+	SharedFrame *frame = shared_frame_create(data, len);
+	int result = connection_manager_post_to_user(username, frame);
+	shared_frame_release(frame);
+	return result;
+}
+
+/**
+ * @brief 归属节点处理一条私聊：本节点在线就投递，在其他节点就转过去，否则存入离线队列
+ */
+static void deliver_home(const char *username, const char *data, size_t len)
+{
+	if (deliver_local(username, data, len) == 0)
+		return;
+
+	int node = location_find(username);
+	if (node >= 0 && link_send(node, 'P', username, data, len) == 0)
+		return;
+	if (offline_queue_push(username, data, len) != 0)
+		LOG_ERROR("Failed to queue forwarded message for %s", username);
+}
+
+/**
+ * @brief 处理一条入站记录
+ *
+ * @param reader 入站连接
+ * @param op 记录类型
+ * @param arg 参数（用户名或节点编号）
+ * @param data 帧数据
+ * @param len 帧长度
+ */
+static void handle_record(ClusterReader *reader, char op, const char *arg, const char *data, size_t len)
+{
+	int src = reader->node;
+
+	metrics_add(STAT_CLUSTER_RECEIVED, 1);
+	if (op == 'H')
+	{
+		int node = atoi(arg);
+		if (node >= 0 && node < node_count && node != self_node)
+		{
+			reader->node = node;
+			LOG_INFO("Cluster link from node %d accepted", node);
+		}
+		return;
+	}
+	if (src < 0)
+	{
+		LOG_WARN("Cluster record %c before hello, ignored", op);
+		return;
+	}
+
+	switch (op)
+	{
+	case 'U':
+	{
+		location_add(arg, src);
+		size_t backlog_len;
+		char *backlog = offline_queue_take(arg, &backlog_len, NULL);
+		if (backlog && link_send(src, 'P', arg, backlog, backlog_len) != 0)
+			offline_queue_push(arg, backlog, backlog_len);
+		free(backlog);
+		break;
+	}
+	case 'D':
+		location_remove(arg, src);
+		break;
+	case 'M':
+		deliver_home(arg, data, len);
+		break;
+	case 'P':
+		if (deliver_local(arg, data, len) != 0 && link_send(src, 'Q', arg, data, len) != 0)
+			LOG_WARN("Forwarded message for %s lost, user left node", arg);
+		break;
+	case 'Q':
+		if (offline_queue_push(arg, data, len) != 0)
+			LOG_ERROR("Failed to queue returned message for %s", arg);
+		break;
+	case 'B':
+	{
+		SharedFrame *frame = shared_frame_create(data, len);
+		connection_manager_post_broadcast(arg, frame);
+		shared_frame_release(frame);
+		break;
+	}
+	default:
+		LOG_WARN("Unknown cluster record %c from node %d", op, src);
+		break;
+	}
+}
+
+/* 等待套接字可读，超时返回0 */
+static int wait_readable(socket_t fd, int timeout_ms)
+{
+	fd_set readfds;
+	struct timeval tv;
+
+	FD_ZERO(&readfds);
+	FD_SET(fd, &readfds);
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	return select(platform_select_nfds(fd), &readfds, NULL, NULL, &tv);
+}
+
+/**
+ * @brief 入站连接的读取线程：按记录头取出完整记录逐条处理
+ */
+static platform_thread_return_t PLATFORM_THREAD_CALL reader_main(void *arg)
+{
+	ClusterReader *reader = (ClusterReader *)arg;
+	size_t cap = 64 * 1024;
+	size_t used = 0;
+	char *buf = (char *)malloc(cap);
+
+	while (buf && atomic_load(&cluster_running))
+	{
+		int ready = wait_readable(reader->fd, CLUSTER_POLL_MS);
+		if (ready == 0)
+			continue;
+		if (ready < 0 && platform_socket_interrupted())
+			continue;
+
+		if (used == cap)
+		{
+			char *grown = cap < CLUSTER_LINK_BUFFER * 2 ? (char *)realloc(buf, cap * 2) : NULL;
+			if (!grown)
+				break;
+			buf = grown;
+			cap *= 2;
+		}
+		socket_io_result_t n = platform_socket_recv(reader->fd, buf + used, cap - used);
+		if (n <= 0)
+		{
+			if (n < 0 && platform_socket_interrupted())
+				continue;
+			break;
+		}
+		used += (size_t)n;
+
+		size_t offset = 0;
+		int bad = 0;
+		while (offset < used)
+		{
+			char *start = buf + offset;
+			char *nl = memchr(start, '\n', used - offset < CLUSTER_HEADER_BYTES ? used - offset : CLUSTER_HEADER_BYTES);
+			if (!nl)
+			{
+				bad = used - offset >= CLUSTER_HEADER_BYTES;
+				break;
+			}
+
+			char header[CLUSTER_HEADER_BYTES];
+			char name[CLUSTER_HEADER_BYTES];
+			char op;
+			size_t len;
+			memcpy(header, start, (size_t)(nl - start));
+			header[nl - start] = '\0';
+			if (sscanf(header, "%c %63s %zu", &op, name, &len) != 3 || len > CLUSTER_LINK_BUFFER)
+			{
+				bad = 1;
+				break;
+			}
+			size_t header_len = (size_t)(nl - start) + 1;
+			if (used - offset < header_len + len)
+				break;
+			handle_record(reader, op, name, start + header_len, len);
+			offset += header_len + len;
+		}
+		if (bad)
+		{
+			LOG_WARN("Malformed cluster record from node %d, closing link", reader->node);
+			break;
+		}
+		memmove(buf, buf + offset, used - offset);
+		used -= offset;
+	}
+
+	if (reader->node >= 0)
+	{
+		LOG_INFO("Cluster link from node %d closed", reader->node);
+		location_forget_node(reader->node);
+	}
+	free(buf);
+	platform_socket_close(reader->fd);
+	atomic_store(&reader->active, 0);
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/**
+ * @brief 监听线程：接受其他节点的链路，每条链路一个读取线程
+ */
+static platform_thread_return_t PLATFORM_THREAD_CALL listener_main(void *arg)
+{
+	(void)arg;
+
+	while (atomic_load(&cluster_running))
+	{
+		if (wait_readable(listen_fd, CLUSTER_POLL_MS) <= 0)
+			continue;
+
+		socket_t fd = accept(listen_fd, NULL, NULL);
+		if (SOCKET_IS_INVALID(fd))
+			continue;
+
+		ClusterReader *slot = NULL;
+		for (int i = 0; i < CLUSTER_MAX_READERS && !slot; i++)
+		{
+			if (atomic_load(&readers[i].active))
+				continue;
+			if (platform_thread_is_valid(readers[i].thread))
+				platform_thread_join(readers[i].thread);
+			memset(&readers[i].thread, 0, sizeof(readers[i].thread));
+			slot = &readers[i];
+		}
+		if (!slot)
+		{
+			LOG_WARN("Too many cluster links, connection refused");
+			platform_socket_close(fd);
+			continue;
+		}
+
+		slot->fd = fd;
+		slot->node = -1;
+		atomic_store(&slot->active, 1);
+		if (platform_thread_create(&slot->thread, reader_main, slot) != 0)
+		{
+			atomic_store(&slot->active, 0);
+			memset(&slot->thread, 0, sizeof(slot->thread));
+			platform_socket_close(fd);
+		}
+	}
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/**
+ * @brief 启动集群：监听本节点的链路端口，为其他每个节点启动一条出站链路
+ *
+ * @param spec 逗号分隔的 "IPv4:端口" 节点列表
+ * @param self 本节点在列表中的下标
+ * @return int 成功返回0，配置无效或监听失败返回-1
+ */
+int cluster_start(const char *spec, int self)
+{
+	if (atomic_load(&cluster_running) || cluster_configure(spec, self) < 0)
+		return -1;
+	if (hash_index_init(&location_index, 1024) != 0)
+		return -1;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (SOCKET_IS_INVALID(listen_fd))
+	{
+		LOG_ERROR("Failed to create cluster socket: %s", platform_socket_error_message());
+		return -1;
+	}
+
+	int opt = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = INADDR_ANY;
+	addr.sin_port = htons(nodes[self_node].port);
+
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, CLUSTER_MAX_READERS) < 0)
+	{
+		LOG_ERROR("Failed to listen for cluster links on port %d: %s", nodes[self_node].port,
+				  platform_socket_error_message());
+		platform_socket_close(listen_fd);
+		listen_fd = SOCKET_INVALID;
+		return -1;
+	}
+
+	atomic_store(&cluster_running, 1);
+	if (platform_thread_create(&listener_thread, listener_main, NULL) != 0)
+	{
+		atomic_store(&cluster_running, 0);
+		platform_socket_close(listen_fd);
+		listen_fd = SOCKET_INVALID;
+		return -1;
+	}
+
+	for (int n = 0; n < node_count; n++)
+	{
+		if (n == self_node)
+			continue;
+		links[n].node = n;
+		links[n].fd = SOCKET_INVALID;
+		platform_mutex_init(&links[n].lock);
+		platform_cond_init(&links[n].ready);
+		if (platform_thread_create(&links[n].thread, link_main, &links[n]) != 0)
+			LOG_ERROR("Failed to start cluster link to node %d", n);
+	}
+
+	LOG_INFO("Cluster node %d of %d listening on port %d", self_node, node_count, nodes[self_node].port);
+	return 0;
+}
+
+/**
+ * @brief 停止集群，等待所有链路和读取线程退出
+ */
+void cluster_stop(void)
+{
+	if (!atomic_load(&cluster_running))
+		return;
+	atomic_store(&cluster_running, 0);
+
+	for (int n = 0; n < node_count; n++)
+	{
+		if (n == self_node)
+			continue;
+		platform_mutex_lock(&links[n].lock);
+		platform_cond_broadcast(&links[n].ready);
+		platform_mutex_unlock(&links[n].lock);
+		if (platform_thread_is_valid(links[n].thread))
+			platform_thread_join(links[n].thread);
+		platform_cond_destroy(&links[n].ready);
+		platform_mutex_destroy(&links[n].lock);
+		free(links[n].pending);
+		memset(&links[n], 0, sizeof(links[n]));
+	}
+
+	platform_thread_join(listener_thread);
+	platform_socket_close(listen_fd);
+	listen_fd = SOCKET_INVALID;
+	for (int i = 0; i < CLUSTER_MAX_READERS; i++)
+	{
+		if (platform_thread_is_valid(readers[i].thread))
+			platform_thread_join(readers[i].thread);
+		memset(&readers[i], 0, sizeof(readers[i]));
+	}
+
+	platform_mutex_lock(&location_lock);
+	while (location_head)
+		location_unlink(location_head);
+	hash_index_free(&location_index);
+	platform_mutex_unlock(&location_lock);
+}
+
+/**
+ * @brief 登记本节点上用户的上线或下线，通知用户的归属节点
+ *
+ * 由全局用户目录在用户的第一个连接认证、最后一个连接断开时调用。
+ *
+ * @param username 用户名
+ * @param online 1 为上线，0 为下线
+ */
+void cluster_note_user(const char *username, int online)
+{
+	if (!atomic_load(&cluster_running))
+		return;
+
+	int home = cluster_home(username);
+	if (home != self_node)
+		link_send(home, online ? 'U' : 'D', username, NULL, 0);
+}
+
+/**
+ * @brief 为不在本节点上的接收者路由一条私聊帧
+ *
+ * 接收者归属于其他节点时交给归属节点；归属于本节点且连在其他节点上时直接转过去。
+ *
+ * @param receiver 接收者
+ * @param data 已序列化的帧
+ * @param len 帧长度
+ * @return int 已转发返回0；接收者归属于本节点且不在任何节点上（或链路缓冲区已满）
+ *             返回1，由调用者存入本节点的离线队列
+ */
+int cluster_route_private(const char *receiver, const char *data, size_t len)
+{
+	if (!atomic_load(&cluster_running))
+		return 1;
+
+	int home = cluster_home(receiver);
+	if (home != self_node)
+		return link_send(home, 'M', receiver, data, len) == 0 ? 0 : 1;
+
+	int node = location_find(receiver);
+	if (node >= 0 && link_send(node, 'P', receiver, data, len) == 0)
+		return 0;
+	return 1;
+}
+
+/**
+ * @brief 把广播帧发给其他每个节点
+ *
+ * @param sender 发送者，各节点不回发给同名用户
+ * @param data 已序列化的帧
+ * @param len 帧长度
+ * @return int 交给链路的节点数
+ */
+int cluster_broadcast(const char *sender, const char *data, size_t len)
+{
+	int forwarded = 0;
+
+	if (!atomic_load(&cluster_running))
+		return 0;
+	for (int n = 0; n < node_count; n++)
+	{
+		if (n != self_node && link_send(n, 'B', sender, data, len) == 0)
+			forwarded++;
+	}
+	return forwarded;
+}
@@ -4,7 +4,26 @@
  *
  * 本文件实现了基于内存的连接管理器，用于跟踪所有客户端连接。
  * 提供了添加、删除、查找客户端的功能，以及更新客户端状态的能力。
- * 使用链表结构存储客户端信息，支持通过文件描述符、用户名或用户ID查找客户端。
+ * 分片内的连接按热/冷拆开保存：扇出和遍历扫描的套接字与状态放在紧凑的热数据数组中，
+ * 移除时用末尾元素填补；地址、端口和连接时间放在槽位表中，按连接ID的低位寻址，
+ * 连接在生命周期内占用固定槽位，槽位复用时代数加一，过期的连接ID查不到新连接。
+ * 另外维护按套接字和按已认证用户名的哈希索引，收包、鉴权和私聊路由中的查找不随在线人数增长。
+ *
+ * 多 reactor 模式下每个 reactor 线程拥有一个独立的连接分片（ConnectionShard），
+ * 本文件的接口都作用于调用线程绑定的分片，分片内部不加锁。跨分片只通过两条路径：
+ * 全局用户目录（用户名 -> 分片）和每个分片的无锁邮箱，
+ * 发给其他分片用户的帧投递到目标分片的邮箱，由其所属线程取出并发送。
+ * 目录的登记和注销在锁内串行，查询（路由、在线判断）不加锁：读者只公布纪元，
+ * 注销的条目和扩容换下的旧表经纪元回收（utils/epoch.c）延迟到读者都离开后释放，
+ * 登录/下线的抖动不会阻塞工作线程和其他 reactor 上的路由。
+ *
+ * 命令交给工作线程执行时，工作线程绑定的是一个命令任务而不是分片：
+ * 按套接字查找只返回任务中该连接的会话快照，认证状态修改和发给该连接的数据
+ * 记录在任务中，其他用户一律经全局目录投递。任务完成后作为邮件回到所属分片，
+ * 由其线程应用修改并发出响应。
+ *
+ * 用户的第一个已认证连接登记到目录、最后一个连接注销时通知在线状态模块（presence.c），
+ * 由其合并后广播。进程交接时摘下和恢复的连接不算上线/下线，不发通知。
  */
 
 #include <stdio.h>
@@ -13,263 +32,2282 @@
 #include <time.h>
 #include "core.h"
 
+/** 最多支持的连接分片数 */
+#define MAX_CONNECTION_SHARDS 64
+
+/** 连接ID的低位为槽位下标，每个分片最多这么多个同时存在的连接 */
+#define CLIENT_SLOT_BITS 20
+#define CLIENT_SLOT_MASK ((1 << CLIENT_SLOT_BITS) - 1)
+
+/** 槽位复用代数的上限，保证连接ID为正数 */
+#define CLIENT_GENERATION_MAX ((1 << (31 - CLIENT_SLOT_BITS)) - 1)
+
+/** 热数据数组和槽位表的初始容量 */
+#define CLIENT_TABLE_INITIAL 64
+
+/**
+ * @brief 热数据数组的元素
+ *
+ * 扇出、定时器重设和遍历按下标顺序扫描这张紧凑数组，只看状态就能跳过未认证的连接，
+ * 不必逐个读取分散在堆上的 Client 对象。
+ */
+typedef struct
+{
+	socket_t sockfd; /**< 客户端套接字 */
+	int status;		 /**< 客户端状态，与 Client.status 同步 */
+	Client *client;	 /**< 连接对象 */
+} ClientHot;
+
+/**
+ * @brief 槽位表的元素，按连接ID的低位寻址
+ */
+typedef struct
+{
+	Client *client;	 /**< 占用槽位的连接，空闲时为NULL */
+	int generation;	 /**< 槽位当前的复用代数，与下标一起组成连接ID */
+	int dense;		 /**< 连接在热数据数组中的下标；空闲时为下一个空闲槽位，-1 表示没有 */
+	ClientInfo info; /**< 连接的冷数据 */
+} ClientSlot;
+
+/**
+ * @brief 连接分片
+ *
+ * 一个 reactor 线程的全部连接状态，只由所属线程访问（邮箱除外）。
+ */
+struct ConnectionShard
+{
+	int id;							 /**< 分片编号，未注册的默认分片为-1 */
+	ClientHot *hot;					 /**< 热数据数组，前 clients_count 个有效 */
+	int clients_count;				 /**< 当前连接的客户端数量 */
+	int hot_capacity;				 /**< 热数据数组容量 */
+	ClientSlot *slots;				 /**< 槽位表，前 slots_used 个用过 */
+	int slots_used;					 /**< 用过的槽位数 */
+	int slot_capacity;				 /**< 槽位表容量 */
+	int free_slot;					 /**< 空闲槽位链表头，-1 表示没有 */
+	HashIndex fd_index;				 /**< 按套接字索引的客户端哈希表 */
+	HashIndex name_index;			 /**< 按已认证用户名索引的客户端哈希表，同名多连接时指向最近认证的连接 */
+	ConnectionWriteHook write_hook;	 /**< 写关注回调，由所属事件循环注册 */
+	int batch_sends;				 /**< 1-不直接发送，全部排队后由事件循环批量提交（io_uring） */
+	ConnectionResumeHook resume_hook; /**< 命令完成后恢复处理连接的回调 */
+	TimerWheel *timers;				 /**< 所属事件循环的时间轮，NULL 表示不回收空闲连接 */
+	uint64_t idle_timeout_ms;		 /**< 空闲超时，0 表示不回收 */
+	ConnectionIdleHook idle_hook;	 /**< 关闭空闲连接的回调 */
+	MpscQueue mailbox;				 /**< 其他分片投递过来的帧 */
+	atomic_int mail_pending;		 /**< 已发出唤醒但尚未处理 */
+	platform_wakeup_t wakeup;		 /**< 唤醒所属事件循环的管道 */
+};
+
+/**
+ * @brief 分片邮件类型
+ */
+typedef enum
+{
+	MAIL_DIRECT = 0, /**< 发给指定用户 */
+	MAIL_BROADCAST,	 /**< 发给分片内所有已认证用户 */
+	MAIL_GROUP,		 /**< 发给分片内在线的群组成员 */
+	MAIL_PRESENCE,	 /**< 在线状态变化，按订阅者的关注设置发给分片内的已认证用户 */
+	MAIL_COMPLETION	 /**< 工作线程执行完的命令任务 */
+} ShardMailKind;
+
+/**
+ * @brief 分片邮件
+ */
+typedef struct ShardMail
+{
+	MpscNode node;					 /**< 邮箱链表节点，必须是第一个成员 */
+	ShardMailKind kind;				 /**< 邮件类型 */
+	char username[MAX_USERNAME_LEN]; /**< 接收者；广播和群组消息时为发送者（不回发） */
+	char group[MAX_GROUPNAME_LEN];	 /**< 群组消息的目标群组 */
+	SharedFrame *frame;				 /**< 要发送的帧，邮件持有一个引用 */
+	CommandJob *job;				 /**< 完成的命令任务，邮件归任务所有 */
+} ShardMail;
+
+/** 目录哈希表的初始桶数（2的幂），条目数超过桶数时加倍 */
+#define DIRECTORY_INITIAL_BUCKETS 64
+
+struct DirectoryLink;
+
+/**
+ * @brief 全局用户目录条目
+ *
+ * 用户名在发布前写好，之后不变；读者只读用户名和分片编号。
+ */
+typedef struct DirectoryEntry
+{
+	char username[MAX_USERNAME_LEN]; /**< 用户名 */
+	atomic_int shard_id;			 /**< 最近一次认证所在的分片 */
+	int connections;				 /**< 该用户已认证的连接数，只在 directory_lock 内访问 */
+	struct DirectoryEntry *prev;	 /**< 按上线顺序的名单链表，只在 directory_lock 内访问 */
+	struct DirectoryEntry *next;
+	struct DirectoryLink *link;		 /**< 在当前哈希表中的链表节点 */
+	EpochNode reclaim;				 /**< 注销后的延迟回收 */
+} DirectoryEntry;
+
+/**
+ * @brief 目录哈希表的链表节点
+ *
+ * 读者沿 next 无锁遍历；写者只在链表头插入，摘除时让前驱跳过本节点，
+ * 被摘下的节点连同条目在读者离开后才释放，正在遍历的读者仍能走完链表。
+ */
+typedef struct DirectoryLink
+{
+	_Atomic(struct DirectoryLink *) next; /**< 同一桶中的下一个节点 */
+	DirectoryEntry *entry;				  /**< 条目 */
+	size_t hash;						  /**< 用户名的哈希值 */
+} DirectoryLink;
+
+/**
+ * @brief 目录哈希表
+ *
+ * 扩容时写者建一张新表并为每个条目新建链表节点，发布后旧表整体延迟回收，
+ * 仍在旧表上查找的读者看到的是扩容前的内容。
+ */
+typedef struct DirectoryTable
+{
+	EpochNode reclaim;				/**< 换下后的延迟回收 */
+	size_t mask;					/**< 桶数减一 */
+	_Atomic(DirectoryLink *) buckets[]; /**< 桶 */
+} DirectoryTable;
+
+/**
+ * @brief 单线程模式和测试使用的默认分片
+ *
+ * 写关注回调等字段零初始化即可用；没有邮箱，不参与跨分片投递。
+ */
+static ConnectionShard default_shard = {.id = -1, .free_slot = -1};
+
+/**
+ * @brief 工作线程看到的空分片，始终为空且不会被修改
+ */
+static ConnectionShard detached_shard = {.id = -1, .free_slot = -1};
+
+/**
+ * @brief 调用线程绑定的分片，NULL 表示使用默认分片
+ */
+static PLATFORM_THREAD_LOCAL ConnectionShard *bound_shard = NULL;
+
+/**
+ * @brief 工作线程正在执行的命令任务，非NULL时不访问任何分片
+ */
+static PLATFORM_THREAD_LOCAL CommandJob *bound_job = NULL;
+
+/**
+ * @brief 非零时目录登记和注销不通知在线状态和集群，用于进程交接时摘下和恢复连接
+ */
+static PLATFORM_THREAD_LOCAL int directory_quiet = 0;
+
+/**
+ * @brief 已注册的分片，在 reactor 线程启动前创建完毕，运行期间只读
+ */
+static ConnectionShard *shards[MAX_CONNECTION_SHARDS];
+static int shard_count = 0;
+
+/**
+ * @brief Client 对象池，所有分片共用，连接在哪个线程关闭就归还到哪个线程的本地链表
+ */
+static ObjectPool client_pool = OBJECT_POOL_INITIALIZER("client", sizeof(Client), 0);
+
+/**
+ * @brief 全局用户目录（用户名 -> 分片），所有分片共享；
+ * 修改由互斥锁串行，查询在纪元读临界区内进行，不加锁
+ */
+static _Atomic(DirectoryTable *) directory = NULL;
+static platform_mutex_t directory_lock = PLATFORM_MUTEX_INITIALIZER;
+
+/**
+ * @brief 在线名单：目录条目按上线顺序串成链表，用户上线或下线时版本号加一，
+ * 序列化的快照在版本变化后第一次被读取时才重建。链表和快照由 directory_lock 保护，
+ * 用户数和版本号只在锁内修改，可以不加锁读取
+ */
+static DirectoryEntry *roster_head = NULL;
+static DirectoryEntry *roster_tail = NULL;
+static atomic_int roster_users = 0;
+static atomic_uint_fast64_t roster_version = 0;
+static OnlineRoster *roster_cache = NULL;
+
+/**
+ * @brief 所有分片的连接总数和已认证连接总数
+ */
+static atomic_int total_connections = 0;
+static atomic_int total_online = 0;
+
+/** 获取调用线程的分片 */
+static ConnectionShard *current_shard(void)
+{
+	if (bound_job)
+		return &detached_shard;
+	return bound_shard ? bound_shard : &default_shard;
+}
+
+/** 调用线程正在执行的任务是否属于该连接 */
+static int job_owns(socket_t fd)
+{
+	return bound_job && bound_job->session.sockfd == fd;
+}
+
+/** 套接字键比较函数 */
+static int match_fd(const void *value, const void *key)
+{
+	return ((const Client *)value)->sockfd == *(const socket_t *)key;
+}
+
+/** 用户名键比较函数 */
+static int match_username(const void *value, const void *key)
+{
+	return strncmp(((const Client *)value)->username, (const char *)key, MAX_USERNAME_LEN) == 0;
+}
+
+static size_t fd_hash(socket_t fd)
+{
+	return hash_index_hash_int((uint64_t)SOCKET_ID(fd));
+}
+
+static size_t username_hash(const char *username)
+{
+	return hash_index_hash_string(username, MAX_USERNAME_LEN);
+}
+
+/** 连接所在的槽位 */
+static ClientSlot *slot_of(ConnectionShard *shard, const Client *c)
+{
+	return &shard->slots[c->client_id & CLIENT_SLOT_MASK];
+}
+
+/**
+ * @brief 为一个新连接占用槽位和热数据数组的末尾，必要时扩容
+ *
+ * 扩容只移动这两张表，Client 对象本身不动，索引中的指针保持有效。
+ *
+ * @param shard 分片
+ * @param c 新连接，设置其连接ID
+ * @return int 成功返回0，内存不足或槽位用尽返回-1
+ */
+static int slot_acquire(ConnectionShard *shard, Client *c)
+{
+	int index;
+
+	if (shard->clients_count == shard->hot_capacity)
+	{
+		int capacity = shard->hot_capacity ? shard->hot_capacity * 2 : CLIENT_TABLE_INITIAL;
+		ClientHot *hot = (ClientHot *)realloc(shard->hot, (size_t)capacity * sizeof(ClientHot));
+		if (!hot)
+			return -1;
+		shard->hot = hot;
+		shard->hot_capacity = capacity;
+	}
+	if (shard->free_slot < 0 && shard->slots_used == shard->slot_capacity)
+	{
+		int capacity = shard->slot_capacity ? shard->slot_capacity * 2 : CLIENT_TABLE_INITIAL;
+		if (capacity > CLIENT_SLOT_MASK + 1)
+			capacity = CLIENT_SLOT_MASK + 1;
+		if (capacity == shard->slot_capacity)
+			return -1;
+		ClientSlot *slots = (ClientSlot *)realloc(shard->slots, (size_t)capacity * sizeof(ClientSlot));
+		if (!slots)
+			return -1;
+		memset(slots + shard->slot_capacity, 0, (size_t)(capacity - shard->slot_capacity) * sizeof(ClientSlot));
+		shard->slots = slots;
+		shard->slot_capacity = capacity;
+	}
+
+	if (shard->free_slot >= 0)
+	{
+		index = shard->free_slot;
+		shard->free_slot = shard->slots[index].dense;
+	}
+	else
+	{
+		index = shard->slots_used++;
+	}
+
+	ClientSlot *slot = &shard->slots[index];
+	slot->generation = slot->generation % CLIENT_GENERATION_MAX + 1;
+	slot->client = c;
+	slot->dense = shard->clients_count;
+	memset(&slot->info, 0, sizeof(slot->info));
+	c->client_id = (slot->generation << CLIENT_SLOT_BITS) | index;
+
+	ClientHot *hot = &shard->hot[shard->clients_count++];
+	hot->sockfd = c->sockfd;
+	hot->status = c->status;
+	hot->client = c;
+	return 0;
+}
+
+/**
+ * @brief 释放连接的槽位，用热数据数组的最后一个元素填补空位
+ *
+ * @param shard 分片
+ * @param c 要移除的连接
+ */
+static void slot_release(ConnectionShard *shard, Client *c)
+{
+	ClientSlot *slot = slot_of(shard, c);
+	int last = --shard->clients_count;
+
+	if (slot->dense != last)
+	{
+		shard->hot[slot->dense] = shard->hot[last];
+		slot_of(shard, shard->hot[slot->dense].client)->dense = slot->dense;
+	}
+	slot->client = NULL;
+	slot->dense = shard->free_slot;
+	shard->free_slot = c->client_id & CLIENT_SLOT_MASK;
+}
+
+/** 把连接状态同步到热数据数组；工作线程上修改的是会话快照，由任务完成时同步 */
+static void sync_status(ConnectionShard *shard, Client *c)
+{
+	if (!bound_job)
+		shard->hot[slot_of(shard, c)->dense].status = c->status;
+}
+
+/** 释放分片的热数据数组和槽位表 */
+static void free_tables(ConnectionShard *shard)
+{
+	free(shard->hot);
+	free(shard->slots);
+	shard->hot = NULL;
+	shard->slots = NULL;
+	shard->clients_count = 0;
+	shard->hot_capacity = 0;
+	shard->slots_used = 0;
+	shard->slot_capacity = 0;
+	shard->free_slot = -1;
+}
+
+/**
+ * @brief 开始读取全局目录
+ *
+ * 通常只进入纪元读临界区；无法分配线程的纪元记录时退回持有 directory_lock。
+ *
+ * @return int 加了锁返回1，传给 directory_read_end
+ */
+static int directory_read_begin(void)
+{
+	if (epoch_enter() == 0)
+		return 0;
+	platform_mutex_lock(&directory_lock);
+	return 1;
+}
+
+static void directory_read_end(int locked)
+{
+	if (locked)
+		platform_mutex_unlock(&directory_lock);
+	else
+		epoch_exit();
+}
+
+/**
+ * @brief 在目录中查找用户，调用者在读临界区内或持有 directory_lock
+ */
+static DirectoryEntry *directory_find(const char *username, size_t h)
+{
+	DirectoryTable *table = atomic_load_explicit(&directory, memory_order_acquire);
+	if (!table)
+		return NULL;
+
+	DirectoryLink *link = atomic_load_explicit(&table->buckets[h & table->mask], memory_order_acquire);
+	for (; link; link = atomic_load_explicit(&link->next, memory_order_acquire))
+	{
+		if (link->hash == h && strncmp(link->entry->username, username, MAX_USERNAME_LEN) == 0)
+			return link->entry;
+	}
+	return NULL;
+}
+
+/** 回收注销的条目和它在当前表中的链表节点 */
+static void reclaim_entry(EpochNode *node)
+{
+	DirectoryEntry *entry = (DirectoryEntry *)((char *)node - offsetof(DirectoryEntry, reclaim));
+	free(entry->link);
+	free(entry);
+}
+
+/** 回收换下的旧表和其中全部链表节点；此后没有写者修改旧表 */
+static void reclaim_table(EpochNode *node)
+{
+	DirectoryTable *table = (DirectoryTable *)((char *)node - offsetof(DirectoryTable, reclaim));
+	for (size_t i = 0; i <= table->mask; i++)
+	{
+		DirectoryLink *link = atomic_load_explicit(&table->buckets[i], memory_order_relaxed);
+		while (link)
+		{
+			DirectoryLink *next = atomic_load_explicit(&link->next, memory_order_relaxed);
+			free(link);
+			link = next;
+		}
+	}
+	free(table);
+}
+
+/** 把链表节点插到新表（尚未发布）或当前表的桶头 */
+static void directory_link(DirectoryTable *table, DirectoryLink *link)
+{
+	_Atomic(DirectoryLink *) *bucket = &table->buckets[link->hash & table->mask];
+	atomic_init(&link->next, atomic_load_explicit(bucket, memory_order_relaxed));
+	atomic_store_explicit(bucket, link, memory_order_release);
+}
+
+/**
+ * @brief 建一张 buckets 个桶的新表，放入当前全部条目后发布，旧表延迟回收。持有 directory_lock
+ */
+static int directory_grow(size_t buckets)
+{
+	DirectoryTable *old = atomic_load_explicit(&directory, memory_order_relaxed);
+	DirectoryTable *table = (DirectoryTable *)calloc(1, sizeof(DirectoryTable) + buckets * sizeof(table->buckets[0]));
+	if (!table)
+		return -1;
+	table->mask = buckets - 1;
+	for (size_t i = 0; i < buckets; i++)
+		atomic_init(&table->buckets[i], NULL);
+
+	/* 先为所有条目建好新节点，全部成功后才改条目的 link，失败时旧表不受影响 */
+	DirectoryLink *fresh = NULL;
+	for (DirectoryEntry *e = roster_head; e; e = e->next)
+	{
+		DirectoryLink *link = (DirectoryLink *)malloc(sizeof(DirectoryLink));
+		if (!link)
+		{
+			while (fresh)
+			{
+				DirectoryLink *next = atomic_load_explicit(&fresh->next, memory_order_relaxed);
+				free(fresh);
+				fresh = next;
+			}
+			free(table);
+			return -1;
+		}
+		link->entry = e;
+		link->hash = e->link->hash;
+		atomic_init(&link->next, fresh);
+		fresh = link;
+	}
+	while (fresh)
+	{
+		DirectoryLink *link = fresh;
+		fresh = atomic_load_explicit(&link->next, memory_order_relaxed);
+		link->entry->link = link;
+		directory_link(table, link);
+	}
+
+	atomic_store_explicit(&directory, table, memory_order_release);
+	if (old)
+		epoch_retire(&old->reclaim, reclaim_table);
+	return 0;
+}
+
+/**
+ * @brief 把新条目加入目录，持有 directory_lock；条目尚未挂入名单链表
+ */
+static int directory_insert(DirectoryEntry *entry, size_t h)
+{
+	DirectoryTable *table = atomic_load_explicit(&directory, memory_order_relaxed);
+	size_t users = (size_t)atomic_load_explicit(&roster_users, memory_order_relaxed);
+
+	if (!table || users + 1 > table->mask + 1)
+	{
+		size_t buckets = table ? (table->mask + 1) * 2 : DIRECTORY_INITIAL_BUCKETS;
+		if (directory_grow(buckets) != 0 && !table)
+			return -1;
+		table = atomic_load_explicit(&directory, memory_order_relaxed);
+	}
+
+	DirectoryLink *link = (DirectoryLink *)malloc(sizeof(DirectoryLink));
+	if (!link)
+		return -1;
+	link->entry = entry;
+	link->hash = h;
+	entry->link = link;
+	directory_link(table, link);
+	return 0;
+}
+
+/**
+ * @brief 把条目从当前表中摘下，持有 directory_lock；之后由调用者登记延迟回收
+ */
+static void directory_unlink(DirectoryEntry *entry)
+{
+	DirectoryTable *table = atomic_load_explicit(&directory, memory_order_relaxed);
+	_Atomic(DirectoryLink *) *prev = &table->buckets[entry->link->hash & table->mask];
+	DirectoryLink *link;
+
+	while ((link = atomic_load_explicit(prev, memory_order_relaxed)) != NULL)
+	{
+		if (link == entry->link)
+		{
+			atomic_store_explicit(prev, atomic_load_explicit(&link->next, memory_order_relaxed), memory_order_release);
+			return;
+		}
+		prev = &link->next;
+	}
+}
+
+/**
+ * @brief 在全局目录中登记一个已认证连接
+ *
+ * @param shard 连接所在分片
+ * @param username 用户名
+ */
+static void directory_acquire(ConnectionShard *shard, const char *username)
+{
+	size_t h = username_hash(username);
+	int first = 0;
+
+	platform_mutex_lock(&directory_lock);
+	DirectoryEntry *entry = directory_find(username, h);
+	if (!entry)
+	{
+		/* 用户名和分片编号在插入（发布）之前写好 */
+		entry = (DirectoryEntry *)calloc(1, sizeof(DirectoryEntry));
+		if (entry)
+		{
+			safe_strcpy(entry->username, username, sizeof(entry->username));
+			atomic_init(&entry->shard_id, shard->id);
+		}
+		if (entry && directory_insert(entry, h) != 0)
+		{
+			free(entry);
+			entry = NULL;
+		}
+		if (entry)
+		{
+			entry->prev = roster_tail;
+			if (roster_tail)
+				roster_tail->next = entry;
+			else
+				roster_head = entry;
+			roster_tail = entry;
+			atomic_fetch_add(&roster_users, 1);
+			atomic_fetch_add(&roster_version, 1);
+			first = 1;
+		}
+	}
+	if (entry)
+	{
+		atomic_store_explicit(&entry->shard_id, shard->id, memory_order_relaxed);
+		entry->connections++;
+	}
+	platform_mutex_unlock(&directory_lock);
+	atomic_fetch_add(&total_online, 1);
+	if (first && !directory_quiet)
+	{
+		session_resume_presence(username, 1);
+		cluster_note_user(username, 1);
+	}
+}
+
+/**
+ * @brief 从全局目录中注销一个已认证连接
+ *
+ * @param username 用户名
+ */
+static void directory_release(const char *username)
+{
+	size_t h = username_hash(username);
+	int last = 0;
+
+	platform_mutex_lock(&directory_lock);
+	DirectoryEntry *entry = directory_find(username, h);
+	if (entry && --entry->connections <= 0)
+	{
+		directory_unlink(entry);
+		if (entry->prev)
+			entry->prev->next = entry->next;
+		else
+			roster_head = entry->next;
+		if (entry->next)
+			entry->next->prev = entry->prev;
+		else
+			roster_tail = entry->prev;
+		atomic_fetch_sub(&roster_users, 1);
+		atomic_fetch_add(&roster_version, 1);
+		epoch_retire(&entry->reclaim, reclaim_entry);
+		last = 1;
+	}
+	platform_mutex_unlock(&directory_lock);
+	atomic_fetch_sub(&total_online, 1);
+	if (last && !directory_quiet)
+	{
+		session_resume_presence(username, 0);
+		cluster_note_user(username, 0);
+	}
+}
+
+/**
+ * @brief 从用户名索引中移除客户端
+ *
+ * 同时从全局目录注销。只有索引指向的正是该客户端时才移除；若还有其他同名的
+ * 已认证连接，让索引改指向其中之一（罕见路径，扫描热数据数组）。
+ *
+ * @param c 客户端指针
+ */
+static void unindex_username(Client *c)
+{
+	ConnectionShard *shard = current_shard();
+	if (c->username[0] == '\0')
+		return;
+
+	directory_release(c->username);
+
+	size_t h = username_hash(c->username);
+	if (hash_index_find(&shard->name_index, h, c->username, match_username) != c)
+		return;
+	hash_index_remove(&shard->name_index, h, c, NULL);
+
+	for (int i = 0; i < shard->clients_count; i++)
+	{
+		Client *cur = shard->hot[i].client;
+		if (cur != c && shard->hot[i].status == CLIENT_STATUS_AUTHENTICATED &&
+			strncmp(cur->username, c->username, sizeof(cur->username)) == 0)
+		{
+			hash_index_insert(&shard->name_index, h, cur);
+			break;
+		}
+	}
+}
+
+/**
+ * @brief 根据文件描述符查找客户端
+ *
+ * 通过套接字哈希索引查找具有指定文件描述符的客户端。
+ *
+ * @param fd 要查找的文件描述符
+ * @return Client* 找到返回客户端指针，未找到返回NULL
+ */
+Client *connection_manager_find_by_fd(socket_t fd)
+{
+	ConnectionShard *shard = current_shard();
+	if (bound_job)
+		return job_owns(fd) ? &bound_job->session : NULL;
+	return (Client *)hash_index_find(&shard->fd_index, fd_hash(fd), &fd, match_fd);
+}
+
+/**
+ * @brief 根据用户名查找客户端
+ *
+ * 通过用户名哈希索引查找已认证的客户端。
+ *
+ * @param username 要查找的用户名
+ * @return Client* 找到返回客户端指针，未找到返回NULL
+ */
+Client *connection_manager_find_by_username(const char *username)
+{
+	ConnectionShard *shard = current_shard();
+	if (!username || username[0] == '\0')
+		return NULL;
+	return (Client *)hash_index_find(&shard->name_index, username_hash(username), username, match_username);
+}
+
+/**
+ * @brief 根据连接ID查找客户端
+ *
+ * 连接ID在连接的生命周期内不变，连接关闭后槽位即使被新连接复用也查不到，
+ * 可以代替指针和可能被复用的套接字保存。工作线程上只能查到任务中的会话快照。
+ *
+ * @param client_id 连接ID
+ * @return Client* 找到返回客户端指针，连接已关闭返回NULL
+ */
+Client *connection_manager_find_by_id(int client_id)
+{
+	ConnectionShard *shard = current_shard();
+	int index = client_id & CLIENT_SLOT_MASK;
+
+	if (bound_job)
+		return bound_job->client_id == client_id ? &bound_job->session : NULL;
+	if (client_id <= 0 || index >= shard->slots_used)
+		return NULL;
+	Client *c = shard->slots[index].client;
+	return (c && c->client_id == client_id) ? c : NULL;
+}
+
+/**
+ * @brief 获取连接的冷数据（地址、端口、连接时间）
+ *
+ * 返回的指针在当前分片下一次接入连接前有效。
+ *
+ * @param c 当前分片上的客户端
+ * @return const ClientInfo* 冷数据，工作线程上的会话快照或其他分片的连接返回NULL
+ */
+const ClientInfo *connection_manager_info(const Client *c)
+{
+	ConnectionShard *shard = current_shard();
+	int index;
+
+	if (!c || bound_job)
+		return NULL;
+	index = c->client_id & CLIENT_SLOT_MASK;
+	if (index >= shard->slots_used || shard->slots[index].client != c)
+		return NULL;
+	return &shard->slots[index].info;
+}
+
+/**
+ * @brief 空闲超时定时器回调，在所属分片线程上执行
+ *
+ * 命令还在工作线程上执行的连接顺延一个周期，其余连接先发出错误响应再关闭。
+ */
+static void idle_expired(TimerNode *timer, void *ctx)
+{
+	ConnectionShard *shard = current_shard();
+	Client *c = (Client *)ctx;
+	(void)timer;
+
+	if (c->in_flight)
+	{
+		timer_wheel_schedule(shard->timers, &c->idle_timer, shard->idle_timeout_ms, 0);
+		return;
+	}
+
+	LOG_INFO("Closing idle connection fd=%lld (%s), no data for %llu s", SOCKET_ID(c->sockfd),
+			 c->username[0] ? c->username : slot_of(shard, c)->info.remote_ip,
+			 (unsigned long long)(shard->idle_timeout_ms / 1000));
+	metrics_add(STAT_IDLE_TIMEOUTS, 1);
+	char *notice = build_error_msg(ERROR_SERVER_ERROR, "Idle timeout");
+	if (notice)
+	{
+		connection_manager_send_text(c->sockfd, notice);
+		build_free(notice);
+	}
+	if (shard->idle_hook)
+		shard->idle_hook(c->sockfd);
+}
+
+/**
+ * @brief 限流暂停到期，在所属分片线程上恢复读取
+ *
+ * 命令还在工作线程上执行时不恢复，命令完成时会恢复。
+ */
+static void throttle_expired(TimerNode *timer, void *ctx)
+{
+	ConnectionShard *shard = current_shard();
+	Client *c = (Client *)ctx;
+	(void)timer;
+
+	if (!c->in_flight && shard->resume_hook)
+		shard->resume_hook(c->sockfd);
+}
+
+/**
+ * @brief 从文件描述符添加客户端
+ *
+ * 根据给定的文件描述符创建新的客户端条目，占用一个槽位并追加到热数据数组末尾。
+ * 如果文件描述符已存在，则不执行任何操作。
+ *
+ * @param sockfd 客户端的套接字文件描述符
+ * @param ip 客户端的IP地址字符串
+ * @param port 客户端的端口号
+ */
+void connection_manager_add_from_fd(socket_t sockfd, const char *ip, int port)
+{
+	ConnectionShard *shard = current_shard();
+	if (connection_manager_find_by_fd(sockfd))
+		return;
+
+	Client *c = (Client *)object_pool_alloc(&client_pool);
+	if (!c)
+		return;
+	c->sockfd = sockfd;
+	c->user_id = -1;
+	c->status = CLIENT_STATUS_CONNECTED;
+	c->protocol_version = PROTOCOL_V1;
+	if (slot_acquire(shard, c) != 0)
+	{
+		LOG_ERROR("No connection slot for fd=%lld", SOCKET_ID(sockfd));
+		object_pool_free(&client_pool, c);
+		return;
+	}
+	if (hash_index_insert(&shard->fd_index, fd_hash(sockfd), c) != 0)
+	{
+		slot_release(shard, c);
+		object_pool_free(&client_pool, c);
+		return;
+	}
+
+	ClientInfo *info = &slot_of(shard, c)->info;
+	info->connect_time = time(NULL);
+	if (ip)
+		safe_strcpy(info->remote_ip, ip, sizeof(info->remote_ip));
+	info->remote_port = port;
+	c->last_active = info->connect_time;
+	frame_buffer_init(&c->recv_buffer, FRAME_BUFFER_DEFAULT_MAX);
+	send_queue_init(&c->send_queue, SEND_QUEUE_DEFAULT_HIGH_WATER);
+	timer_init(&c->idle_timer, idle_expired, c);
+	timer_init(&c->throttle_timer, throttle_expired, c);
+	if (shard->timers && shard->idle_timeout_ms > 0)
+		timer_wheel_schedule(shard->timers, &c->idle_timer, shard->idle_timeout_ms, 0);
+
+	atomic_fetch_add(&total_connections, 1);
+	metrics_add(STAT_CONNECTIONS_ACCEPTED, 1);
+}
+
+/**
+ * @brief 从当前分片摘下客户端并释放其缓冲区
+ *
+ * @param fd 客户端的文件描述符
+ * @return int 摘下返回1，客户端不存在返回0
+ */
+static int drop_client(socket_t fd)
+{
+	ConnectionShard *shard = current_shard();
+	Client *target = (Client *)hash_index_remove(&shard->fd_index, fd_hash(fd), &fd, match_fd);
+	if (!target)
+		return 0;
+
+	unindex_username(target);
+	timer_wheel_cancel(shard->timers, &target->idle_timer);
+	timer_wheel_cancel(shard->timers, &target->throttle_timer);
+	slot_release(shard, target);
+
+	frame_buffer_free(&target->recv_buffer);
+	send_queue_free(&target->send_queue);
+	object_pool_free(&client_pool, target);
+	atomic_fetch_sub(&total_connections, 1);
+	return 1;
+}
+
+/**
+ * @brief 移除客户端
+ *
+ * 根据文件描述符移除对应的客户端，释放其槽位和相关资源。
+ *
+ * @param fd 要移除的客户端的文件描述符
+ */
+void connection_manager_remove(socket_t fd)
+{
+	if (drop_client(fd))
+		metrics_add(STAT_CONNECTIONS_CLOSED, 1);
+}
+
+/**
+ * @brief 为进程交接摘下客户端
+ *
+ * 与 connection_manager_remove 相同，但用户下线不通知在线状态和集群，
+ * 也不计入关闭的连接数；套接字由调用者交给新进程，这里不关闭。
+ *
+ * @param fd 客户端的文件描述符
+ */
+void connection_manager_detach(socket_t fd)
+{
+	directory_quiet = 1;
+	drop_client(fd);
+	directory_quiet = 0;
+}
+
+/**
+ * @brief 恢复从上一个进程交接过来的客户端
+ *
+ * 连接须已由 connection_manager_add_from_fd 登记。恢复认证状态、协商的协议版本和
+ * 连接时间，把尚未成帧的输入放回接收缓冲区、尚未写出的输出放回发送队列并打开写关注。
+ * 用户上线不通知在线状态和集群：对其他用户来说这个用户一直在线。
+ *
+ * @param fd 客户端的文件描述符
+ * @param saved 上一个进程中的连接记录（只读取会话字段）
+ * @param info 上一个进程中的连接冷数据
+ * @param unread 尚未成帧的输入
+ * @param unread_len 输入字节数
+ * @param unsent 尚未写出的输出
+ * @param unsent_len 输出字节数
+ * @return int 成功返回0，连接不存在或内存不足返回-1
+ */
+int connection_manager_restore(socket_t fd, const Client *saved, const ClientInfo *info, const char *unread,
+							   size_t unread_len, const char *unsent, size_t unsent_len)
+{
+	ConnectionShard *shard = current_shard();
+	Client *c = connection_manager_find_by_fd(fd);
+	if (!c || !saved || !info || bound_job)
+		return -1;
+
+	if (saved->status == CLIENT_STATUS_AUTHENTICATED && saved->username[0] != '\0')
+	{
+		directory_quiet = 1;
+		connection_manager_set_auth(fd, saved->user_id, saved->username);
+		directory_quiet = 0;
+	}
+	c->protocol_version = saved->protocol_version;
+	c->last_active = saved->last_active;
+	slot_of(shard, c)->info = *info;
+
+	if (unread_len > 0)
+	{
+		size_t space = 0;
+		char *dest = frame_buffer_reserve(&c->recv_buffer, unread_len, &space);
+		if (!dest || space < unread_len)
+			return -1;
+		memcpy(dest, unread, unread_len);
+		frame_buffer_commit(&c->recv_buffer, unread_len);
+	}
+	if (unsent_len > 0)
+	{
+		if (send_queue_push(&c->send_queue, unsent, unsent_len) != 0)
+			return -1;
+		if (shard->write_hook)
+			shard->write_hook(fd, 1);
+	}
+	return 0;
+}
+
+/**
+ * @brief 获取当前分片连接的客户端数量
+ *
+ * @return int 当前分片连接的客户端总数
+ */
+int connection_manager_count(void)
+{
+	ConnectionShard *shard = current_shard();
+	return shard->clients_count;
+}
+
+/**
+ * @brief 获取所有分片连接的客户端总数
+ *
+ * @return int 客户端总数
+ */
+int connection_manager_total_count(void)
+{
+	return atomic_load(&total_connections);
+}
+
+/**
+ * @brief 获取所有分片已认证的连接总数
+ *
+ * @return int 已认证连接总数
+ */
+int connection_manager_online_count(void)
+{
+	return atomic_load(&total_online);
+}
+
+/**
+ * @brief 获取所有分片在线的不同用户数
+ *
+ * 同一用户的多个已认证连接只算一次。
+ *
+ * @return int 在线用户数
+ */
+int connection_manager_user_count(void)
+{
+	return atomic_load(&roster_users);
+}
+
+/**
+ * @brief 按当前名单链表序列化一份快照，调用者持有 directory_lock
+ */
+static OnlineRoster *roster_build(void)
+{
+	size_t len = 0;
+
+	for (DirectoryEntry *e = roster_head; e; e = e->next)
+		len += strnlen(e->username, MAX_USERNAME_LEN) + 1;
+
+	OnlineRoster *roster = (OnlineRoster *)malloc(sizeof(OnlineRoster) + len + 1);
+	if (!roster)
+		return NULL;
+	atomic_init(&roster->refs, 1);
+	roster->version = atomic_load(&roster_version);
+	roster->count = atomic_load(&roster_users);
+	roster->len = 0;
+	for (DirectoryEntry *e = roster_head; e; e = e->next)
+	{
+		size_t n = strnlen(e->username, MAX_USERNAME_LEN);
+		if (roster->len > 0)
+			roster->names[roster->len++] = ',';
+		memcpy(roster->names + roster->len, e->username, n);
+		roster->len += n;
+	}
+	roster->names[roster->len] = '\0';
+	return roster;
+}
+
+/**
+ * @brief 获取在线名单快照
+ *
+ * 名单自上次读取以来没有变化时直接返回缓存的快照，否则重建一次。
+ * 快照只读，用完后调用 connection_manager_roster_release。
+ *
+ * @return const OnlineRoster* 成功返回快照（多一个引用），内存不足返回NULL
+ */
+const OnlineRoster *connection_manager_roster_acquire(void)
+{
+	OnlineRoster *roster;
+
+	platform_mutex_lock(&directory_lock);
+	if (!roster_cache || roster_cache->version != atomic_load(&roster_version))
+	{
+		OnlineRoster *fresh = roster_build();
+		if (fresh)
+		{
+			if (roster_cache)
+				connection_manager_roster_release(roster_cache);
+			roster_cache = fresh;
+		}
+	}
+	roster = roster_cache;
+	if (roster)
+		atomic_fetch_add(&roster->refs, 1);
+	platform_mutex_unlock(&directory_lock);
+	return roster;
+}
+
+/**
+ * @brief 释放一次名单快照引用
+ *
+ * @param roster 快照，可以为NULL
+ */
+void connection_manager_roster_release(const OnlineRoster *roster)
+{
+	OnlineRoster *r = (OnlineRoster *)roster;
+
+	if (r && atomic_fetch_sub(&r->refs, 1) == 1)
+		free(r);
+}
+
+/**
+ * @brief 获取在线名单的版本号，用户上线或下线时递增
+ *
+ * @return uint64_t 版本号
+ */
+uint64_t connection_manager_roster_version(void)
+{
+	return atomic_load(&roster_version);
+}
+
+/**
+ * @brief 按最大连接数预先分配 Client 对象
+ *
+ * @param max_clients 最大连接数
+ * @return int 成功返回0，内存不足返回-1
+ */
+int connection_manager_reserve(int max_clients)
+{
+	if (max_clients <= 0)
+		return 0;
+	return object_pool_reserve(&client_pool, (size_t)max_clients);
+}
+
+/**
+ * @brief 获取 Client 对象池的使用数和峰值
+ *
+ * @param high_water 输出峰值，可为NULL
+ * @return size_t 使用中的 Client 对象数
+ */
+size_t connection_manager_pool_usage(size_t *high_water)
+{
+	if (high_water)
+		*high_water = object_pool_high_water(&client_pool);
+	return object_pool_in_use(&client_pool);
+}
+
+/**
+ * @brief 更新客户端最后活动时间
+ *
+ * 根据文件描述符找到对应的客户端，并更新其最后活动时间为当前时间，
+ * 同时重设空闲超时定时器（常数时间）。工作线程上只更新会话快照的时间。
+ *
+ * @param fd 客户端的文件描述符
+ */
+void connection_manager_update_active(socket_t fd)
+{
+	ConnectionShard *shard = current_shard();
+	Client *c = connection_manager_find_by_fd(fd);
+	if (c)
+	{
+		c->last_active = time(NULL);
+		if (!job_owns(fd) && shard->timers && shard->idle_timeout_ms > 0)
+			timer_wheel_schedule(shard->timers, &c->idle_timer, shard->idle_timeout_ms, 0);
+	}
+}
+
+/**
+ * @brief 设置当前分片的空闲超时
+ *
+ * 由事件循环在初始化时注册自己的时间轮、在停止时传 NULL 注销。
+ * 已有的连接从现在开始计时。
+ *
+ * @param wheel 所属事件循环的时间轮，NULL 表示不回收空闲连接
+ * @param seconds 超时秒数，不大于0表示不回收
+ * @param hook 关闭空闲连接的回调
+ */
+void connection_manager_set_idle_timeout(TimerWheel *wheel, int seconds, ConnectionIdleHook hook)
+{
+	ConnectionShard *shard = current_shard();
+
+	for (int i = 0; i < shard->clients_count; i++)
+	{
+		timer_wheel_cancel(shard->timers, &shard->hot[i].client->idle_timer);
+		timer_wheel_cancel(shard->timers, &shard->hot[i].client->throttle_timer);
+	}
+
+	shard->timers = wheel;
+	shard->idle_timeout_ms = (wheel && seconds > 0) ? (uint64_t)seconds * 1000 : 0;
+	shard->idle_hook = hook;
+
+	if (shard->idle_timeout_ms == 0)
+		return;
+	for (int i = 0; i < shard->clients_count; i++)
+		timer_wheel_schedule(wheel, &shard->hot[i].client->idle_timer, shard->idle_timeout_ms, 0);
+}
+
+/**
+ * @brief 在一段时间后恢复处理暂停读取的连接
+ *
+ * 调用者先暂停读取；到期时经恢复回调重新开始读取并分发积压的帧。
+ *
+ * @param fd 客户端的文件描述符
+ * @param delay_ms 暂停的毫秒数
+ * @return int 已设置定时器返回0，连接不存在或分片没有时间轮返回-1（调用者不应暂停）
+ */
+int connection_manager_throttle(socket_t fd, uint64_t delay_ms)
+{
+	ConnectionShard *shard = current_shard();
+	Client *c = connection_manager_find_by_fd(fd);
+
+	if (!c || !shard->timers || !shard->resume_hook)
+		return -1;
+	timer_wheel_schedule(shard->timers, &c->throttle_timer, delay_ms, 0);
+	return 0;
+}
+
+/**
+ * @brief 判断连接是否处于限流暂停中
+ *
+ * 命令完成或发送队列清空时据此决定能否恢复读取，暂停只由到期的定时器解除。
+ *
+ * @param fd 客户端的文件描述符
+ * @return int 暂停定时器尚未到期返回1，否则返回0
+ */
+int connection_manager_is_throttled(socket_t fd)
+{
+	Client *c = connection_manager_find_by_fd(fd);
+	return c && timer_pending(&c->throttle_timer);
+}
+
+/**
+ * @brief 设置客户端认证信息
+ *
+ * 为指定文件描述符的客户端设置用户ID和用户名，并将状态更新为已认证。
+ *
+ * @param fd 客户端的文件描述符
+ * @param user_id 用户的ID
+ * @param username 用户名
+ * @return int 成功返回0，失败返回-1
+ */
+int connection_manager_set_auth(socket_t fd, int user_id, const char *username)
+{
+	ConnectionShard *shard = current_shard();
+	Client *c = connection_manager_find_by_fd(fd);
+	if (!c)
+		return -1;
+	if (bound_job)
+	{
+		/* 只修改快照，索引和目录在任务完成后由所属分片更新 */
+		c->user_id = user_id;
+		if (username)
+			safe_strcpy(c->username, username, sizeof(c->username));
+		c->status = CLIENT_STATUS_AUTHENTICATED;
+		bound_job->session_changed = 1;
+		return 0;
+	}
+	unindex_username(c);
+	c->user_id = user_id;
+	if (username)
+	{
+		memset(c->username, 0, sizeof(c->username));
+		strncpy(c->username, username, sizeof(c->username) - 1);
+	}
+	c->status = CLIENT_STATUS_AUTHENTICATED;
+	sync_status(shard, c);
+
+	if (c->username[0] != '\0')
+	{
+		size_t h = username_hash(c->username);
+		Client *existing = (Client *)hash_index_find(&shard->name_index, h, c->username, match_username);
+		if (existing)
+			hash_index_remove(&shard->name_index, h, existing, NULL);
+		hash_index_insert(&shard->name_index, h, c);
+		directory_acquire(shard, c->username);
+	}
+	return 0;
+}
+
+/**
+ * @brief 清除客户端认证信息
+ *
+ * 把客户端恢复为已连接未认证状态，并从用户名索引中移除。
+ *
+ * @param fd 客户端的文件描述符
+ */
+void connection_manager_clear_auth(socket_t fd)
+{
+	ConnectionShard *shard = current_shard();
+	Client *c = connection_manager_find_by_fd(fd);
+	if (!c)
+		return;
+	if (bound_job)
+		bound_job->session_changed = 1;
+	else
+		unindex_username(c);
+	c->user_id = -1;
+	memset(c->username, 0, sizeof(c->username));
+	c->status = CLIENT_STATUS_CONNECTED;
+	sync_status(shard, c);
+}
+
+/**
+ * @brief 设置客户端状态
+ *
+ * 为指定文件描述符的客户端设置新的状态。
+ *
+ * @param fd 客户端的文件描述符
+ * @param status 要设置的新状态
+ */
+void connection_manager_set_status(socket_t fd, int status)
+{
+	ConnectionShard *shard = current_shard();
+	Client *c = connection_manager_find_by_fd(fd);
+	if (!c)
+		return;
+	c->status = status;
+	if (bound_job)
+		bound_job->session_changed = 1;
+	else
+		sync_status(shard, c);
+}
+
+/**
+ * @brief 设置连接的线协议版本
+ *
+ * 登录协商出 v2 后调用，此后发往该连接的文本帧一律转换成 v2 帧，
+ * 协商在连接的整个生命周期内有效。工作线程上调用时记录在任务的会话快照中，
+ * 任务完成时随响应一起生效。
+ *
+ * @param fd 客户端的文件描述符
+ * @param version PROTOCOL_V1 或 PROTOCOL_V2
+ * @return int 成功返回0，连接不存在或版本不支持返回-1
+ */
+int connection_manager_set_protocol(socket_t fd, int version)
+{
+	Client *c = connection_manager_find_by_fd(fd);
+	if (!c || (version != PROTOCOL_V1 && version != PROTOCOL_V2))
+		return -1;
+	c->protocol_version = version;
+	return 0;
+}
+
+/**
+ * @brief 设置写关注回调
+ *
+ * @param hook 回调函数，NULL 表示不通知
+ */
+void connection_manager_set_write_hook(ConnectionWriteHook hook)
+{
+	ConnectionShard *shard = current_shard();
+	shard->write_hook = hook;
+}
+
+/**
+ * @brief 把发给任务所属连接的数据追加到任务的响应缓冲区
+ *
+ * @return int 成功返回0，内存不足返回-1
+ */
+static int job_reply(CommandJob *job, const char *data, size_t len)
+{
+	if (job->replies_len + len > job->replies_cap)
+	{
+		size_t cap = job->replies_cap ? job->replies_cap : 256;
+		while (cap < job->replies_len + len)
+			cap *= 2;
+		char *grown = (char *)realloc(job->replies, cap);
+		if (!grown)
+			return -1;
+		job->replies = grown;
+		job->replies_cap = cap;
+	}
+	memcpy(job->replies + job->replies_len, data, len);
+	job->replies_len += len;
+	return 0;
+}
+
+/**
+ * @brief 向已登记的客户端发送数据
+ *
+ * 发送队列为空时先直接发送，内核未能全部接受的剩余部分进入发送队列，
+ * 并通过写关注回调让事件循环在套接字可写时调用 connection_manager_flush。
+ * 队列非空时新数据直接排队，保证帧顺序。分片启用批量发送时不直接发送，
+ * 队列由空变为非空时同样调用写关注回调，由事件循环在本轮结束时一并提交。frame 非空时以引用方式排队，
+ * 不复制数据。
+ *
+ * @param c 客户端
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param frame 数据所属的共享帧，NULL 表示排队时复制
+ * @return int 已发送或已排队返回0，发送出错或超过积压上限返回-1
+ */
+static int client_send(Client *c, const char *data, size_t len, SharedFrame *frame)
+{
+	ConnectionShard *shard = current_shard();
+	socket_t fd = c->sockfd;
+	size_t sent_len = 0;
+	int was_empty = send_queue_empty(&c->send_queue);
+
+	if (bound_job)
+		return job_reply(bound_job, data, len);
+
+	if (was_empty && !shard->batch_sends)
+	{
+		socket_io_result_t sent = platform_socket_send(fd, data, len);
+		if (sent > 0)
+			metrics_add(STAT_BYTES_OUT, (uint64_t)sent);
+		if (sent >= 0 && (size_t)sent == len)
+			return 0;
+		if (sent < 0)
+		{
+			if (!platform_socket_would_block() && !platform_socket_interrupted())
+			{
+				LOG_ERROR("Failed to send to socket %lld: %s",
+						  SOCKET_ID(fd), platform_socket_error_message());
+				metrics_add(STAT_SEND_FAILURES, 1);
+				return -1;
+			}
+			sent = 0;
+		}
+		sent_len = (size_t)sent;
+	}
+
+	int queued = frame ? send_queue_push_shared(&c->send_queue, frame, sent_len)
+					   : send_queue_push(&c->send_queue, data + sent_len, len - sent_len);
+	if (queued != 0)
+	{
+		metrics_add(STAT_SEND_FAILURES, 1);
+		/* 慢速读取方会持续触发，只在每轮积压的第一次丢弃时告警 */
+		if (c->send_queue.dropped == 1)
+			LOG_WARN("Send queue of fd=%lld over high-water mark (%zu bytes pending), dropping frames",
+					 SOCKET_ID(fd), send_queue_bytes(&c->send_queue));
+		return -1;
+	}
+
+	if (was_empty && shard->write_hook)
+		shard->write_hook(fd, 1);
+
+	LOG_DEBUG("Queued %zu bytes for socket %lld (pending=%zu)",
+			  len - sent_len, SOCKET_ID(fd), send_queue_bytes(&c->send_queue));
+	return 0;
+}
+
+/**
+ * @brief 按连接协商的协议版本发送文本帧
+ *
+ * 服务器内部以文本帧构建响应，v2 连接上先整体转换成 v2 帧再发送。
+ *
+ * @param c 客户端
+ * @param data 一个或多个以换行结尾的文本帧
+ * @param len 数据长度
+ * @return int 已发送或已排队返回0，失败返回-1
+ */
+static int client_send_text(Client *c, const char *data, size_t len)
+{
+	if (c->protocol_version != PROTOCOL_V2)
+		return client_send(c, data, len, NULL);
+
+	size_t binary_len = 0;
+	char *binary = protocol_v2_from_text(data, len, &binary_len);
+	if (!binary)
+		return -1;
+	int result = binary_len > 0 ? client_send(c, binary, binary_len, NULL) : 0;
+	free(binary);
+	return result;
+}
+
+/**
+ * @brief 获取共享帧的 v2 编码，第一个需要它的 v2 接收者负责生成
+ *
+ * @return SharedFrame* 随原帧释放的 v2 帧，转换失败返回NULL
+ */
+static SharedFrame *binary_variant(SharedFrame *frame)
+{
+	SharedFrame *variant = shared_frame_variant(frame);
+	if (variant)
+		return variant;
+
+	size_t binary_len = 0;
+	char *binary = protocol_v2_from_text(frame->data, frame->len, &binary_len);
+	if (binary && binary_len > 0)
+		variant = shared_frame_create(binary, binary_len);
+	free(binary);
+	return variant ? shared_frame_set_variant(frame, variant) : NULL;
+}
+
+/**
+ * @brief 向客户端发送数据
+ *
+ * 见 client_send；未登记的套接字没有发送队列，只能尝试直接发送。
+ * 数据为文本帧，已协商 v2 的连接上会先转换。
+ *
+ * @param fd 客户端的文件描述符
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @return int 已发送或已排队返回0，发送出错或超过积压上限返回-1
+ */
+int connection_manager_send(socket_t fd, const char *data, size_t len)
+{
+	if (SOCKET_IS_INVALID(fd) || !data || len == 0)
+		return -1;
+
+	Client *c = connection_manager_find_by_fd(fd);
+	if (!c)
+	{
+		/* 工作线程只能回复任务所属的连接 */
+		if (bound_job)
+			return -1;
+		socket_io_result_t sent = platform_socket_send(fd, data, len);
+		return (sent >= 0 && (size_t)sent == len) ? 0 : -1;
+	}
+
+	return client_send_text(c, data, len);
+}
+
+/**
+ * @brief 向客户端发送共享帧
+ *
+ * 与 connection_manager_send 相同，但积压时只在队列中保存共享帧的引用，
+ * 用于同一帧发给大量接收者的场景。v2 连接发送共享帧的 v2 编码，
+ * 每帧只转换一次，由所有 v2 接收者共享。
+ *
+ * @param c 客户端
+ * @param frame 共享帧，调用方保留自己的引用
+ * @return int 已发送或已排队返回0，失败返回-1
+ */
+int connection_manager_send_frame(Client *c, SharedFrame *frame)
+{
+	if (!c || !frame || SOCKET_IS_INVALID(c->sockfd))
+		return -1;
+	if (c->protocol_version == PROTOCOL_V2)
+	{
+		SharedFrame *binary = binary_variant(frame);
+		return binary ? client_send(c, binary->data, binary->len, binary) : -1;
+	}
+	return client_send(c, frame->data, frame->len, frame);
+}
+
+/**
+ * @brief 向客户端发送字符串
+ *
+ * @param fd 客户端的文件描述符
+ * @param message 以'\0'结尾的消息
+ * @return int 成功返回0，失败返回-1
+ */
+int connection_manager_send_text(socket_t fd, const char *message)
+{
+	if (!message)
+		return -1;
+	return connection_manager_send(fd, message, strlen(message));
+}
+
+/**
+ * @brief 记录一次写出的结果
+ *
+ * 出错时丢弃积压并关闭可写通知；队列清空后报告期间丢弃的帧数并关闭可写通知。
+ *
+ * @param pending 写出前的积压字节数
+ * @param result 写出结果：队列已清空1，仍有积压0，出错-1
+ * @return int 成功返回0，出错返回-1
+ */
+static int finish_flush(ConnectionShard *shard, Client *c, size_t pending, int result)
+{
+	socket_t fd = c->sockfd;
+
+	if (result < 0)
+	{
+		metrics_add(STAT_SEND_FAILURES, 1);
+		LOG_ERROR("Failed to flush socket %lld: %s", SOCKET_ID(fd), platform_socket_error_message());
+		send_queue_free(&c->send_queue);
+		if (shard->write_hook)
+			shard->write_hook(fd, 0);
+		return -1;
+	}
+
+	metrics_add(STAT_BYTES_OUT, pending - send_queue_bytes(&c->send_queue));
+	if (result == 1)
+	{
+		if (c->send_queue.dropped > 0)
+		{
+			LOG_WARN("Send queue of fd=%lld drained, %zu frames were dropped",
+					 SOCKET_ID(fd), c->send_queue.dropped);
+			c->send_queue.dropped = 0;
+		}
+		if (shard->write_hook)
+			shard->write_hook(fd, 0);
+	}
+	return 0;
+}
+
+/**
+ * @brief 在套接字可写时刷新发送队列
+ *
+ * 队列清空后通过写关注回调关闭可写通知。
+ *
+ * @param fd 客户端的文件描述符
+ * @return int 成功返回0（包括仍有积压），发送出错返回-1
+ */
+int connection_manager_flush(socket_t fd)
+{
+	Client *c = connection_manager_find_by_fd(fd);
+	if (!c)
+		return 0;
+
+	size_t pending = send_queue_bytes(&c->send_queue);
+	return finish_flush(current_shard(), c, pending, send_queue_flush(&c->send_queue, fd));
+}
+
+/**
+ * @brief 取出发送队列队首待发送的数据，供事件循环异步提交
+ *
+ * 队列不被修改，描述指向的数据在 connection_manager_sent 确认之前保持有效。
+ *
+ * @param fd 客户端的文件描述符
+ * @param iov 输出的分散写描述
+ * @param max 最多取出的帧数
+ * @return int 取出的帧数，没有积压或客户端不存在返回0
+ */
+int connection_manager_gather(socket_t fd, platform_iovec_t *iov, int max)
+{
+	Client *c = connection_manager_find_by_fd(fd);
+	return c ? send_queue_gather(&c->send_queue, iov, max) : 0;
+}
+
+/**
+ * @brief 确认异步提交的发送结果，移除已写出的数据
+ *
+ * @param fd 客户端的文件描述符
+ * @param sent 写出的字节数，小于0表示出错（errno 为错误码）
+ * @return int 队列已清空返回1，仍有积压返回0，发送出错返回-1
+ */
+int connection_manager_sent(socket_t fd, socket_io_result_t sent)
+{
+	Client *c = connection_manager_find_by_fd(fd);
+	if (!c)
+		return 1;
+
+	size_t pending = send_queue_bytes(&c->send_queue);
+	int result = sent < 0 ? -1 : send_queue_consume(&c->send_queue, (size_t)sent);
+	if (finish_flush(current_shard(), c, pending, result) < 0)
+		return -1;
+	return result;
+}
+
+/**
+ * @brief 取走客户端的发送队列，原队列变为空
+ *
+ * 连接关闭时仍有异步发送未完成的数据由调用者保留到发送完成。
+ *
+ * @param fd 客户端的文件描述符
+ * @param out 接收队列的空队列
+ */
+void connection_manager_take_unsent(socket_t fd, SendQueue *out)
+{
+	Client *c = connection_manager_find_by_fd(fd);
+	if (c)
+		send_queue_move(out, &c->send_queue);
+}
+
+/**
+ * @brief 设置当前分片是否批量发送
+ *
+ * 启用后发送不再直接写套接字，全部进入发送队列并通过写关注回调通知事件循环，
+ * 由事件循环合并提交。在事件循环运行之前由所属线程调用。
+ *
+ * @param enable 1-批量发送，0-先直接发送
+ */
+void connection_manager_set_batched_send(int enable)
+{
+	current_shard()->batch_sends = enable;
+}
+
+/**
+ * @brief 获取客户端发送队列中尚未写出的字节数
+ *
+ * @param fd 客户端的文件描述符
+ * @return size_t 积压字节数，客户端不存在返回0
+ */
+size_t connection_manager_pending_bytes(socket_t fd)
+{
+	Client *c = connection_manager_find_by_fd(fd);
+	return c ? send_queue_bytes(&c->send_queue) : 0;
+}
+
+/**
+ * @brief 获取所有客户端
+ *
+ * 返回一个包含所有客户端指针的动态分配数组，调用者负责释放该数组。
+ * 使用safe_free释放时请传入数组地址。
+ *
+ * @param out_count 输出参数，用于返回客户端数量
+ * @return Client** 成功返回客户端指针数组，失败返回NULL
+ */
+Client **connection_manager_get_all(int *out_count)
+{
+	ConnectionShard *shard = current_shard();
+	if (out_count)
+		*out_count = 0;
+
+	if (shard->clients_count == 0)
+		return NULL;
+
+	Client **arr = (Client **)calloc(shard->clients_count, sizeof(Client *));
+	if (!arr)
+		return NULL;
+
+	for (int i = 0; i < shard->clients_count; i++)
+		arr[i] = shard->hot[i].client;
+
+	if (out_count)
+		*out_count = shard->clients_count;
+	return arr;
+}
+
 /**
- * @brief 客户端链表头指针
+ * @brief 原地遍历所有客户端
+ *
+ * 按下标顺序扫描热数据数组，不分配快照数组。回调中可以发送数据，
+ * 但不能增删连接。
  *
- * 指向客户端链表的第一个节点，所有客户端信息都通过这个链表访问。
+ * @param visit 回调函数，返回非零时停止遍历
+ * @param ctx 传给回调的上下文
+ * @return int 实际访问的客户端数量
  */
-static Client *clients_head = NULL;
+int connection_manager_foreach(ConnectionVisitor visit, void *ctx)
+{
+	ConnectionShard *shard = current_shard();
+	int visited = 0;
+
+	if (!visit)
+		return 0;
+
+	for (int i = 0; i < shard->clients_count; i++)
+	{
+		visited++;
+		if (visit(shard->hot[i].client, ctx) != 0)
+			break;
+	}
+	return visited;
+}
 
 /**
- * @brief 当前连接的客户端数量
+ * @brief 原地遍历所有已认证的客户端
  *
- * 记录当前系统中连接的客户端总数。
+ * 扇出专用：只凭热数据数组中的状态跳过未认证的连接，不读取它们的 Client 对象。
+ * 限制与 connection_manager_foreach 相同。
+ *
+ * @param visit 回调函数，返回非零时停止遍历
+ * @param ctx 传给回调的上下文
+ * @return int 实际访问的客户端数量
  */
-static int clients_count = 0;
+int connection_manager_foreach_online(ConnectionVisitor visit, void *ctx)
+{
+	ConnectionShard *shard = current_shard();
+	int visited = 0;
+
+	if (!visit)
+		return 0;
+
+	for (int i = 0; i < shard->clients_count; i++)
+	{
+		if (shard->hot[i].status != CLIENT_STATUS_AUTHENTICATED)
+			continue;
+		visited++;
+		if (visit(shard->hot[i].client, ctx) != 0)
+			break;
+	}
+	return visited;
+}
 
 /**
- * @brief 下一个客户端ID
+ * @brief 打印所有客户端信息
  *
- * 用于为新连接的客户端分配唯一ID，每次分配后自动递增。
+ * 遍历热数据数组，打印每个客户端的基本信息，包括文件描述符、
+ * 客户端ID、用户ID、用户名、状态和地址。
  */
-static int next_client_id = 1;
+void connection_manager_print_all(void)
+{
+	ConnectionShard *shard = current_shard();
+	printf("[connection_manager] total=%d\n", shard->clients_count);
+	for (int i = 0; i < shard->clients_count; i++)
+	{
+		Client *cur = shard->hot[i].client;
+		const ClientInfo *info = &slot_of(shard, cur)->info;
+		printf(" fd=%lld id=%d user=%d name=%s status=%d addr=%s:%d\n", SOCKET_ID(cur->sockfd), cur->client_id,
+			   cur->user_id, cur->username, cur->status, info->remote_ip, info->remote_port);
+	}
+}
 
 /**
- * @brief 根据文件描述符查找客户端
- *
- * 遍历客户端链表，查找具有指定文件描述符的客户端。
+ * @brief 清理所有客户端
  *
- * @param fd 要查找的文件描述符
- * @return Client* 找到返回客户端指针，未找到返回NULL
+ * 释放当前分片的所有客户端，以及热数据数组和槽位表。
+ * 通常在服务器关闭时调用。
  */
-Client *connection_manager_find_by_fd(socket_t fd)
+void connection_manager_cleanup(void)
 {
-	Client *cur = clients_head;
-	while (cur)
+	ConnectionShard *shard = current_shard();
+	for (int i = 0; i < shard->clients_count; i++)
 	{
-		if (cur->sockfd == fd)
-			return cur;
-		cur = cur->next;
+		Client *cur = shard->hot[i].client;
+		if (cur->username[0] != '\0')
+			directory_release(cur->username);
+		timer_wheel_cancel(shard->timers, &cur->idle_timer);
+		frame_buffer_free(&cur->recv_buffer);
+		send_queue_free(&cur->send_queue);
+		object_pool_free(&client_pool, cur);
+		atomic_fetch_sub(&total_connections, 1);
 	}
-	return NULL;
+	free_tables(shard);
+	hash_index_free(&shard->fd_index);
+	hash_index_free(&shard->name_index);
 }
 
 /**
- * @brief 根据用户名查找客户端
+ * @brief 创建并注册一个连接分片
  *
- * 遍历客户端链表，查找具有指定用户名的客户端。
+ * 必须在 reactor 线程启动前调用。每个分片带一个邮箱和唤醒管道，
+ * 唤醒管道的读端需要由所属事件循环注册到就绪通知后端。
  *
- * @param username 要查找的用户名
- * @return Client* 找到返回客户端指针，未找到返回NULL
+ * @return ConnectionShard* 成功返回分片，超过上限或唤醒管道创建失败返回NULL
  */
-Client *connection_manager_find_by_username(const char *username)
+ConnectionShard *connection_shard_create(void)
 {
-	if (!username)
+	if (shard_count >= MAX_CONNECTION_SHARDS)
+	{
+		LOG_ERROR("Too many connection shards (max %d)", MAX_CONNECTION_SHARDS);
+		return NULL;
+	}
+
+	ConnectionShard *shard = (ConnectionShard *)calloc(1, sizeof(ConnectionShard));
+	if (!shard)
 		return NULL;
-	Client *cur = clients_head;
-	while (cur)
+
+	if (platform_wakeup_open(&shard->wakeup) != 0)
 	{
-		if (strncmp(cur->username, username, sizeof(cur->username)) == 0)
-			return cur;
-		cur = cur->next;
+		LOG_ERROR("Failed to create wakeup channel for shard %d", shard_count);
+		free(shard);
+		return NULL;
 	}
-	return NULL;
+
+	shard->id = shard_count;
+	shard->free_slot = -1;
+	mpsc_queue_init(&shard->mailbox);
+	atomic_init(&shard->mail_pending, 0);
+	shards[shard_count++] = shard;
+	return shard;
 }
 
 /**
- * @brief 从文件描述符添加客户端
+ * @brief 注销并销毁所有已注册的分片
  *
- * 根据给定的文件描述符创建新的客户端条目，并将其添加到客户端链表中。
- * 如果文件描述符已存在，则不执行任何操作。
+ * 必须在所有 reactor 线程结束后调用；各分片的连接应已由所属线程清理。
+ */
+void connection_shard_destroy_all(void)
+{
+	for (int i = 0; i < shard_count; i++)
+	{
+		ConnectionShard *shard = shards[i];
+		MpscNode *node;
+		while ((node = mpsc_queue_pop(&shard->mailbox)) != NULL)
+		{
+			ShardMail *mail = (ShardMail *)node;
+			if (mail->kind == MAIL_COMPLETION)
+			{
+				connection_manager_free_job(mail->job);
+				continue;
+			}
+			shared_frame_release(mail->frame);
+			free(mail);
+		}
+		platform_wakeup_close(&shard->wakeup);
+		free_tables(shard);
+		free(shard);
+		shards[i] = NULL;
+	}
+	shard_count = 0;
+	/* 各线程都已离开读临界区，释放注销后尚未回收的目录条目 */
+	epoch_synchronize();
+}
+
+/**
+ * @brief 把调用线程绑定到分片
  *
- * @param sockfd 客户端的套接字文件描述符
- * @param ip 客户端的IP地址字符串
- * @param port 客户端的端口号
+ * @param shard 要绑定的分片，NULL 表示恢复为默认分片
  */
-void connection_manager_add_from_fd(socket_t sockfd, const char *ip, int port)
+void connection_manager_bind_shard(ConnectionShard *shard)
 {
-	if (connection_manager_find_by_fd(sockfd))
-		return;
+	bound_shard = shard;
+}
 
-	Client *c = (Client *)calloc(1, sizeof(Client));
-	if (!c)
-		return;
+/**
+ * @brief 获取调用线程所属分片的唤醒句柄
+ *
+ * @return socket_t 唤醒管道读端，默认分片返回 SOCKET_INVALID
+ */
+socket_t connection_manager_wakeup_fd(void)
+{
+	ConnectionShard *shard = current_shard();
+	return shard->id >= 0 ? shard->wakeup.read_fd : SOCKET_INVALID;
+}
 
-	c->sockfd = sockfd;
-	c->client_id = next_client_id++;
-	c->user_id = -1;
-	c->status = CLIENT_STATUS_CONNECTED;
-	c->connect_time = time(NULL);
-	c->last_active = c->connect_time;
-	if (ip)
-		strncpy(c->remote_ip, ip, sizeof(c->remote_ip) - 1);
-	c->remote_port = port;
+/**
+ * @brief 唤醒所有已注册分片的事件循环
+ *
+ * 用于停止服务器时让阻塞在等待中的 reactor 立即检查运行标志。
+ */
+void connection_manager_wake_all(void)
+{
+	for (int i = 0; i < shard_count; i++)
+		platform_wakeup_signal(&shards[i]->wakeup);
+}
 
-	// insert at head
-	c->next = clients_head;
-	clients_head = c;
-	clients_count++;
+/**
+ * @brief 把一封已填好的邮件放入分片邮箱
+ *
+ * 只在邮箱从空闲变为待处理时写唤醒管道，连续投递只唤醒一次。
+ */
+static void enqueue_mail(ConnectionShard *target, ShardMail *mail)
+{
+	mpsc_queue_push(&target->mailbox, &mail->node);
+	if (atomic_exchange(&target->mail_pending, 1) == 0)
+		platform_wakeup_signal(&target->wakeup);
 }
 
 /**
- * @brief 移除客户端
+ * @brief 把一封帧邮件投递到分片邮箱
  *
- * 根据文件描述符从客户端链表中移除对应的客户端，并释放相关资源。
+ * @return int 成功返回0，失败返回-1
+ */
+static int post_mail(ConnectionShard *target, ShardMailKind kind, const char *username, SharedFrame *frame)
+{
+	ShardMail *mail = (ShardMail *)malloc(sizeof(ShardMail));
+	if (!mail)
+		return -1;
+
+	mail->kind = kind;
+	safe_strcpy(mail->username, username, sizeof(mail->username));
+	mail->group[0] = '\0';
+	mail->frame = shared_frame_retain(frame);
+	mail->job = NULL;
+	enqueue_mail(target, mail);
+	return 0;
+}
+
+/**
+ * @brief 查找用户所在的其他分片
  *
- * @param fd 要移除的客户端的文件描述符
+ * @param username 用户名
+ * @return ConnectionShard* 用户在其他已注册分片上时返回该分片，否则返回NULL
  */
-void connection_manager_remove(socket_t fd)
+static ConnectionShard *locate_remote(const char *username)
 {
-	Client *prev = NULL;
-	Client *cur = clients_head;
-	while (cur)
-	{
-		if (cur->sockfd == fd)
-		{
-			if (prev)
-				prev->next = cur->next;
-			else
-				clients_head = cur->next;
+	ConnectionShard *self = current_shard();
+	int shard_id = -1;
 
-			free(cur);
-			clients_count--;
-			return;
-		}
-		prev = cur;
-		cur = cur->next;
-	}
+	if (shard_count == 0 || !username || username[0] == '\0')
+		return NULL;
+
+	int locked = directory_read_begin();
+	DirectoryEntry *entry = directory_find(username, username_hash(username));
+	if (entry)
+		shard_id = atomic_load_explicit(&entry->shard_id, memory_order_relaxed);
+	directory_read_end(locked);
+
+	if (shard_id < 0 || shard_id >= shard_count || shards[shard_id] == self)
+		return NULL;
+	return shards[shard_id];
 }
 
 /**
- * @brief 获取当前连接的客户端数量
+ * @brief 检查用户是否在其他分片上在线
  *
- * @return int 当前连接的客户端总数
+ * @param username 用户名
+ * @return int 在其他分片在线返回1，否则返回0
  */
-int connection_manager_count(void)
+int connection_manager_is_remote_user(const char *username)
 {
-	return clients_count;
+	return locate_remote(username) != NULL;
 }
 
 /**
- * @brief 更新客户端最后活动时间
+ * @brief 把帧投递给其他分片上的用户
  *
- * 根据文件描述符找到对应的客户端，并更新其最后活动时间为当前时间。
+ * @param username 接收者
+ * @param frame 要发送的帧，邮件持有自己的引用
+ * @return int 已投递返回0，用户不在其他分片上或投递失败返回-1
+ */
+int connection_manager_post_to_user(const char *username, SharedFrame *frame)
+{
+	ConnectionShard *target = locate_remote(username);
+	if (!target || !frame)
+		return -1;
+	return post_mail(target, MAIL_DIRECT, username, frame);
+}
+
+/**
+ * @brief 把广播帧投递给除当前分片外的所有分片
  *
- * @param fd 客户端的文件描述符
+ * @param sender 发送者，目标分片不会回发给同名用户
+ * @param frame 要发送的帧
+ * @return int 成功投递的分片数
  */
-void connection_manager_update_active(socket_t fd)
+int connection_manager_post_broadcast(const char *sender, SharedFrame *frame)
 {
-	Client *c = connection_manager_find_by_fd(fd);
-	if (c)
+	ConnectionShard *self = current_shard();
+	int posted = 0;
+
+	if (!frame)
+		return 0;
+
+	for (int i = 0; i < shard_count; i++)
 	{
-		c->last_active = time(NULL);
+		if (shards[i] != self && post_mail(shards[i], MAIL_BROADCAST, sender ? sender : "", frame) == 0)
+			posted++;
 	}
+	return posted;
 }
 
 /**
- * @brief 设置客户端认证信息
+ * @brief 把在线状态变化帧投递给除当前分片外的所有分片
  *
- * 为指定文件描述符的客户端设置用户ID和用户名，并将状态更新为已认证。
+ * @param frame PRESENCE 帧，目标分片按各订阅者的关注设置发送
+ * @return int 成功投递的分片数
+ */
+int connection_manager_post_presence(SharedFrame *frame)
+{
+	ConnectionShard *self = current_shard();
+	int posted = 0;
+
+	if (!frame)
+		return 0;
+
+	for (int i = 0; i < shard_count; i++)
+	{
+		if (shards[i] != self && post_mail(shards[i], MAIL_PRESENCE, "", frame) == 0)
+			posted++;
+	}
+	return posted;
+}
+
+/**
+ * @brief 检查用户在任一分片上是否有已认证的连接
+ *
+ * 只查全局用户目录，不加锁，在工作线程上调用也能得到正确结果。
  *
- * @param fd 客户端的文件描述符
- * @param user_id 用户的ID
  * @param username 用户名
- * @return int 成功返回0，失败返回-1
+ * @return int 在线返回1，否则返回0
  */
-int connection_manager_set_auth(socket_t fd, int user_id, const char *username)
+int connection_manager_is_online(const char *username)
 {
-	Client *c = connection_manager_find_by_fd(fd);
-	if (!c)
-		return -1;
-	c->user_id = user_id;
-	if (username)
-		strncpy(c->username, username, sizeof(c->username) - 1);
-	c->status = CLIENT_STATUS_AUTHENTICATED;
-	return 0;
+	int online;
+
+	if (!username || username[0] == '\0')
+		return 0;
+
+	int locked = directory_read_begin();
+	online = directory_find(username, username_hash(username)) != NULL;
+	directory_read_end(locked);
+	return online;
 }
 
 /**
- * @brief 设置客户端状态
+ * @brief 把群组消息帧投递给除当前分片外的所有分片
  *
- * 为指定文件描述符的客户端设置新的状态。
+ * 每个分片一封邮件，由目标分片遍历成员集合发给本分片上在线的成员，
+ * 不为每个成员单独投递。
  *
- * @param fd 客户端的文件描述符
- * @param status 要设置的新状态
+ * @param group_name 目标群组
+ * @param sender 发送者，不回发
+ * @param frame 要发送的帧
+ * @return int 成功投递的分片数
  */
-void connection_manager_set_status(socket_t fd, int status)
+int connection_manager_post_group(const char *group_name, const char *sender, SharedFrame *frame)
 {
-	Client *c = connection_manager_find_by_fd(fd);
-	if (c)
-		c->status = status;
+	ConnectionShard *self = current_shard();
+	int posted = 0;
+
+	if (!group_name || !frame)
+		return 0;
+
+	for (int i = 0; i < shard_count; i++)
+	{
+		if (shards[i] == self)
+			continue;
+		ShardMail *mail = (ShardMail *)malloc(sizeof(ShardMail));
+		if (!mail)
+			continue;
+		mail->kind = MAIL_GROUP;
+		safe_strcpy(mail->username, sender ? sender : "", sizeof(mail->username));
+		safe_strcpy(mail->group, group_name, sizeof(mail->group));
+		mail->frame = shared_frame_retain(frame);
+		mail->job = NULL;
+		enqueue_mail(shards[i], mail);
+		posted++;
+	}
+	return posted;
 }
 
 /**
- * @brief 获取所有客户端
+ * @brief 群组扇出的遍历上下文
+ */
+typedef struct
+{
+	SharedFrame *frame; /**< 已序列化的群组消息帧 */
+	const char *sender; /**< 发送者，不回发 */
+	int delivered;		/**< 成功入队的成员数 */
+} GroupDelivery;
+
+/**
+ * @brief 成员遍历回调：成员在当前分片上在线时把共享帧排入其发送队列
+ */
+static int deliver_group_member(const char *username, void *ctx)
+{
+	GroupDelivery *gd = (GroupDelivery *)ctx;
+	if (strcmp(username, gd->sender) == 0)
+		return 0;
+
+	Client *c = connection_manager_find_by_username(username);
+	if (c && connection_manager_send_frame(c, gd->frame) == 0)
+		gd->delivered++;
+	return 0;
+}
+
+/**
+ * @brief 把群组消息帧发给当前分片上在线的群组成员
  *
- * 返回一个包含所有客户端指针的动态分配数组，调用者负责释放该数组。
- * 使用safe_free释放时请传入数组地址。
+ * @param group_name 目标群组
+ * @param sender 发送者，不回发
+ * @param frame 要发送的帧，各成员共享
+ * @return int 成功入队的成员数，群组不存在返回-1
+ */
+int connection_manager_send_group(const char *group_name, const char *sender, SharedFrame *frame)
+{
+	GroupDelivery gd;
+	gd.frame = frame;
+	gd.sender = sender ? sender : "";
+	gd.delivered = 0;
+	if (!frame || group_manager_foreach_member(group_name, deliver_group_member, &gd) < 0)
+		return -1;
+	return gd.delivered;
+}
+
+/**
+ * @brief 在所属分片上应用已完成的命令任务并释放任务
  *
- * @param out_count 输出参数，用于返回客户端数量
- * @return Client** 成功返回客户端指针数组，失败返回NULL
+ * 执行期间连接可能已关闭，套接字甚至已被新连接复用，按连接ID查找。
+ * 先同步认证状态再发出响应，最后通过恢复回调继续处理该连接积压的帧；
+ * 限流暂停尚未到期时回调只分发已读入的帧，不恢复读取。
+ * 登录任务在认证生效后再取一次离线队列，补上执行期间到达的离线消息。
  */
-Client **connection_manager_get_all(int *out_count)
+static void finish_job(ConnectionShard *shard, CommandJob *job)
 {
-	if (out_count)
-		*out_count = 0;
+	socket_t fd = job->session.sockfd;
+	Client *c = connection_manager_find_by_id(job->client_id);
 
-	if (clients_count == 0)
-		return NULL;
+	if (!c)
+	{
+		LOG_DEBUG("Connection fd=%lld closed before its command completed", SOCKET_ID(fd));
+		connection_manager_free_job(job);
+		return;
+	}
 
-	Client **arr = (Client **)calloc(clients_count, sizeof(Client *));
-	if (!arr)
-		return NULL;
+	if (job->session_changed)
+	{
+		if (job->session.status == CLIENT_STATUS_AUTHENTICATED)
+			connection_manager_set_auth(fd, job->session.user_id, job->session.username);
+		else
+		{
+			connection_manager_clear_auth(fd);
+			c->status = job->session.status;
+			sync_status(shard, c);
+		}
+	}
 
-	int i = 0;
-	Client *cur = clients_head;
-	while (cur && i < clients_count)
+	/* 响应在工作线程上已按执行时的协议版本编码，之后才应用执行期间协商的版本 */
+	if (job->replies_len > 0 && client_send(c, job->replies, job->replies_len, NULL) < 0)
+		LOG_ERROR("Failed to send command response to fd=%lld", SOCKET_ID(fd));
+	c->protocol_version = job->session.protocol_version;
+
+	/* 工作线程上的登录到这里才对其他线程可见，其间存入离线队列的消息接在响应之后补发 */
+	if (job->session_changed && job->session.status == CLIENT_STATUS_AUTHENTICATED)
 	{
-		arr[i++] = cur;
-		cur = cur->next;
+		size_t late_len;
+		char *late = offline_queue_take(job->session.username, &late_len, NULL);
+		if (late && client_send_text(c, late, late_len) < 0)
+			LOG_ERROR("Failed to send offline messages to fd=%lld", SOCKET_ID(fd));
+		free(late);
 	}
 
-	if (out_count)
-		*out_count = i;
-	return arr;
+	c->in_flight = 0;
+	connection_manager_free_job(job);
+	if (shard->resume_hook)
+		shard->resume_hook(fd);
 }
 
 /**
- * @brief 打印所有客户端信息
+ * @brief 处理当前分片邮箱中的所有邮件
  *
- * 遍历客户端链表，打印每个客户端的基本信息，包括文件描述符、
- * 客户端ID、用户ID、用户名和状态。
+ * 由所属事件循环在唤醒管道可读时调用。先读空唤醒管道，再清除待处理标记，最后取邮件，
+ * 清除标记之后到达的邮件会重新写入唤醒管道，不会丢失；反过来先清标记再读管道，
+ * 会把清除之后写入的唤醒一起读掉而标记仍为 1，之后的投递都不再唤醒。
+ * 生产者交换了队尾但还没链接时取不到它的邮件，而它看到的待处理标记可能仍是 1 而不发唤醒，
+ * 所以这种情况下由本函数重新标记并唤醒自己，下一轮事件循环再取。
+ *
+ * @return int 处理的邮件数
  */
-void connection_manager_print_all(void)
+int connection_manager_drain_mailbox(void)
 {
-	Client *cur = clients_head;
-	printf("[connection_manager] total=%d\n", clients_count);
-	while (cur)
+	ConnectionShard *shard = current_shard();
+	MpscNode *node;
+	int handled = 0;
+
+	if (shard->id < 0)
+		return 0;
+
+	platform_wakeup_drain(&shard->wakeup);
+	atomic_store(&shard->mail_pending, 0);
+
+	while ((node = mpsc_queue_pop(&shard->mailbox)) != NULL)
 	{
-		printf(" fd=%lld id=%d user=%d name=%s status=%d\n",
-			   SOCKET_ID(cur->sockfd), cur->client_id, cur->user_id, cur->username, cur->status);
-		cur = cur->next;
+		ShardMail *mail = (ShardMail *)node;
+		handled++;
+		if (mail->kind == MAIL_COMPLETION)
+		{
+			finish_job(shard, mail->job);
+			continue;
+		}
+
+		if (mail->kind == MAIL_GROUP)
+		{
+			connection_manager_send_group(mail->group, mail->username, mail->frame);
+		}
+		else if (mail->kind == MAIL_PRESENCE)
+		{
+			presence_deliver(mail->frame);
+		}
+		else if (mail->kind == MAIL_BROADCAST)
+		{
+			for (int i = 0; i < shard->clients_count; i++)
+			{
+				Client *cur = shard->hot[i].client;
+				if (shard->hot[i].status == CLIENT_STATUS_AUTHENTICATED &&
+					strncmp(cur->username, mail->username, sizeof(cur->username)) != 0)
+					connection_manager_send_frame(cur, mail->frame);
+			}
+		}
+		else
+		{
+			Client *c = connection_manager_find_by_username(mail->username);
+			if (c)
+				connection_manager_send_frame(c, mail->frame);
+			else
+				LOG_WARN("Cross-shard message for %s arrived after the user left shard %d",
+						 mail->username, shard->id);
+		}
+		shared_frame_release(mail->frame);
+		free(mail);
 	}
+
+	if (!mpsc_queue_empty(&shard->mailbox) && atomic_exchange(&shard->mail_pending, 1) == 0)
+		platform_wakeup_signal(&shard->wakeup);
+	return handled;
 }
 
 /**
- * @brief 清理所有客户端
+ * @brief 设置命令完成后的恢复回调
  *
- * 释放客户端链表中的所有节点，重置客户端计数和链表头指针。
- * 通常在服务器关闭时调用。
+ * @param hook 回调函数，NULL 表示不通知
  */
-void connection_manager_cleanup(void)
+void connection_manager_set_resume_hook(ConnectionResumeHook hook)
+{
+	ConnectionShard *shard = current_shard();
+	shard->resume_hook = hook;
+}
+
+/**
+ * @brief 为连接上的一条命令创建任务
+ *
+ * 只有已注册的分片才有邮箱接收完成通知，默认分片上的命令只能直接执行。
+ *
+ * @param fd 客户端的文件描述符
+ * @param msg 已解析的命令，会被复制
+ * @return CommandJob* 成功返回任务，调用线程没有已注册分片、连接不存在或内存不足返回NULL
+ */
+CommandJob *connection_manager_prepare_job(socket_t fd, const Message *msg)
 {
-	Client *cur = clients_head;
-	while (cur)
+	ConnectionShard *shard = current_shard();
+	Client *c = connection_manager_find_by_fd(fd);
+
+	if (shard->id < 0 || !c || !msg)
+		return NULL;
+
+	CommandJob *job = (CommandJob *)calloc(1, sizeof(CommandJob));
+	if (!job)
+		return NULL;
+	job->completion = (ShardMail *)malloc(sizeof(ShardMail));
+	job->msg = message_pack(msg);
+	if (!job->completion || !job->msg)
 	{
-		Client *next = cur->next;
-		free(cur);
-		cur = next;
+		free(job->completion);
+		free(job->msg);
+		free(job);
+		return NULL;
 	}
-	clients_head = NULL;
-	clients_count = 0;
+
+	job->shard = shard;
+	job->client_id = c->client_id;
+	job->session = *c;
+	memset(&job->session.recv_buffer, 0, sizeof(job->session.recv_buffer));
+	memset(&job->session.send_queue, 0, sizeof(job->session.send_queue));
+	memset(&job->session.idle_timer, 0, sizeof(job->session.idle_timer));
+	return job;
+}
+
+/**
+ * @brief 把调用线程绑定到命令任务
+ *
+ * @param job 要执行的任务，NULL 表示解除绑定
+ */
+void connection_manager_bind_job(CommandJob *job)
+{
+	bound_job = job;
+}
+
+/**
+ * @brief 把执行完的任务送回所属分片
+ *
+ * 使用创建任务时预先分配的邮件，不会失败；之后任务归所属分片所有。
+ *
+ * @param job 命令任务
+ */
+void connection_manager_complete_job(CommandJob *job)
+{
+	if (!job)
+		return;
+
+	ShardMail *mail = job->completion;
+	mail->kind = MAIL_COMPLETION;
+	mail->username[0] = '\0';
+	mail->frame = NULL;
+	mail->job = job;
+	enqueue_mail(job->shard, mail);
+}
+
+/**
+ * @brief 释放命令任务
+ *
+ * @param job 命令任务，可以为NULL
+ */
+void connection_manager_free_job(CommandJob *job)
+{
+	if (!job)
+		return;
+	free(job->completion);
+	free(job->replies);
+	free(job->msg);
+	free(job);
 }
@@ -4,6 +4,7 @@
 
 #include <time.h>
 #include "../models/models.h"
+#include "../models/message.h"
 #include "../utils/utils.h"
 #include "../protocol/protocol.h"
 
@@ -12,23 +13,137 @@
 /* 客户端管理 */
 Client *connection_manager_find_by_fd(socket_t fd);
 Client *connection_manager_find_by_username(const char *username);
+Client *connection_manager_find_by_id(int client_id);
+const ClientInfo *connection_manager_info(const Client *c);
 void connection_manager_add_from_fd(socket_t sockfd, const char *ip, int port);
 void connection_manager_remove(socket_t fd);
 int connection_manager_count(void);
 
+/* 进程交接：摘下和恢复连接时不通知上线/下线 */
+void connection_manager_detach(socket_t fd);
+int connection_manager_restore(socket_t fd, const Client *saved, const ClientInfo *info, const char *unread,
+							   size_t unread_len, const char *unsent, size_t unsent_len);
+
+/* 全部分片的统计 */
+int connection_manager_total_count(void);
+int connection_manager_online_count(void);
+int connection_manager_user_count(void);
+
+/* 在线名单：随用户上线/下线增量维护，快照按版本缓存，变化后首次读取时才重建 */
+typedef struct OnlineRoster
+{
+	atomic_int refs;  /**< 引用计数，缓存本身持有一个 */
+	uint64_t version; /**< 生成快照时的名单版本 */
+	int count;		  /**< 用户数 */
+	size_t len;		  /**< names 的长度 */
+	char names[];	  /**< 按上线顺序以逗号分隔的用户名 */
+} OnlineRoster;
+const OnlineRoster *connection_manager_roster_acquire(void);
+void connection_manager_roster_release(const OnlineRoster *roster);
+uint64_t connection_manager_roster_version(void);
+
+/* Client 对象池：按最大连接数预分配，查询使用数和峰值 */
+int connection_manager_reserve(int max_clients);
+size_t connection_manager_pool_usage(size_t *high_water);
+
+/* 空闲超时：连接挂在所属分片线程的时间轮上，超时未收到数据时调用回调关闭 */
+typedef void (*ConnectionIdleHook)(socket_t fd);
+void connection_manager_set_idle_timeout(TimerWheel *wheel, int seconds, ConnectionIdleHook hook);
+int connection_manager_throttle(socket_t fd, uint64_t delay_ms);
+int connection_manager_is_throttled(socket_t fd);
+
 /* 客户端状态 */
 void connection_manager_update_active(socket_t fd);
 int connection_manager_set_auth(socket_t fd, int user_id, const char *username);
+void connection_manager_clear_auth(socket_t fd);
 void connection_manager_set_status(socket_t fd, int status);
+int connection_manager_set_protocol(socket_t fd, int version);
+
+/* 发送队列：写关注回调、带排队的发送与可写时刷新 */
+typedef void (*ConnectionWriteHook)(socket_t fd, int enable);
+void connection_manager_set_write_hook(ConnectionWriteHook hook);
+int connection_manager_send(socket_t fd, const char *data, size_t len);
+int connection_manager_send_text(socket_t fd, const char *message);
+int connection_manager_send_frame(Client *c, SharedFrame *frame);
+int connection_manager_flush(socket_t fd);
+int connection_manager_gather(socket_t fd, platform_iovec_t *iov, int max);
+int connection_manager_sent(socket_t fd, socket_io_result_t sent);
+void connection_manager_take_unsent(socket_t fd, SendQueue *out);
+void connection_manager_set_batched_send(int enable);
+size_t connection_manager_pending_bytes(socket_t fd);
 
 /* 工具函数 */
 void connection_manager_print_all(void);
 void connection_manager_cleanup(void);
 Client **connection_manager_get_all(int *out_count);
 
+/* 原地遍历：回调返回非零时停止，回调中不能增删连接 */
+typedef int (*ConnectionVisitor)(Client *c, void *ctx);
+int connection_manager_foreach(ConnectionVisitor visit, void *ctx);
+int connection_manager_foreach_online(ConnectionVisitor visit, void *ctx);
+
+/* 连接分片：每个 reactor 线程绑定一个分片，跨分片经用户目录和无锁邮箱投递 */
+typedef struct ConnectionShard ConnectionShard;
+ConnectionShard *connection_shard_create(void);
+void connection_shard_destroy_all(void);
+void connection_manager_bind_shard(ConnectionShard *shard);
+socket_t connection_manager_wakeup_fd(void);
+void connection_manager_wake_all(void);
+int connection_manager_is_remote_user(const char *username);
+int connection_manager_post_to_user(const char *username, SharedFrame *frame);
+int connection_manager_post_broadcast(const char *sender, SharedFrame *frame);
+int connection_manager_post_group(const char *group_name, const char *sender, SharedFrame *frame);
+int connection_manager_post_presence(SharedFrame *frame);
+int connection_manager_is_online(const char *username);
+int connection_manager_send_group(const char *group_name, const char *sender, SharedFrame *frame);
+int connection_manager_drain_mailbox(void);
+
+/* 命令任务：在工作线程上执行一条命令。会话字段取自连接的快照，
+   发回本连接的响应和认证状态变化随完成邮件送回所属分片，由其线程应用 */
+struct ShardMail;
+typedef struct CommandJob
+{
+	MpscNode node;				 /**< 工作队列节点，必须是第一个成员 */
+	ConnectionShard *shard;		 /**< 连接所属分片 */
+	int client_id;				 /**< 连接ID，用于识别期间被关闭并复用的套接字 */
+	Client session;				 /**< 连接会话字段的快照（不含缓冲区） */
+	int session_changed;		 /**< 执行期间认证状态被修改 */
+	char *replies;				 /**< 发回本连接的响应 */
+	size_t replies_len;			 /**< 响应字节数 */
+	size_t replies_cap;			 /**< 响应缓冲区容量 */
+	struct ShardMail *completion; /**< 预先分配的完成邮件 */
+	PackedMessage *msg;			 /**< 已解析的命令，紧凑表示 */
+} CommandJob;
+
+typedef void (*ConnectionResumeHook)(socket_t fd);
+void connection_manager_set_resume_hook(ConnectionResumeHook hook);
+CommandJob *connection_manager_prepare_job(socket_t fd, const Message *msg);
+void connection_manager_bind_job(CommandJob *job);
+void connection_manager_complete_job(CommandJob *job);
+void connection_manager_free_job(CommandJob *job);
+
+/* ================ 命令工作线程池 ================ */
+
+#define MAX_WORKERS 64				/* 最多的工作线程数 */
+#define WORKER_QUEUE_CAPACITY 1024	/* 单个工作线程队列的最大任务数 */
+
+int worker_pool_start(int workers);
+void worker_pool_stop(void);
+int worker_pool_size(void);
+int worker_pool_submit(CommandJob *job);
+
+/* 认证线程池：只执行 LOGIN，口令摘要的慢速派生不占用 reactor 和命令工作线程 */
+#define AUTH_DEFAULT_WORKERS 0 /* 默认的认证线程数：0-登录与其他命令一样处理 */
+
+int auth_pool_start(int workers);
+void auth_pool_stop(void);
+int auth_pool_size(void);
+int auth_pool_submit(CommandJob *job);
+
 /* ================ 会话管理器函数 ================ */
 
 int session_manager_authenticate(socket_t fd, const char *username, const char *password);
+int session_manager_resume(socket_t fd, const char *username, const char *token);
 void session_manager_logout(socket_t fd);
 int session_manager_is_authenticated(socket_t fd);
 int session_manager_get_user_id(socket_t fd);
@@ -38,7 +153,147 @@ const char *session_manager_get_username(socket_t fd);
 int session_manager_is_user_online(const char *username);
 int session_manager_get_online_users(char ***usernames, int *count);
 
+/* ================ 会话恢复 ================ */
+
+#define SESSION_RESUME_DEFAULT_GRACE 60	  /* 默认的断线保留秒数 */
+#define SESSION_RESUME_TOKEN_BYTES 16	  /* 令牌字节数，线上为两倍长度的十六进制 */
+#define SESSION_RESUME_TOKEN_LEN (SESSION_RESUME_TOKEN_BYTES * 2 + 1)
+#define SESSION_RESUME_MAX_TOKENS 4		  /* 每个用户同时有效的令牌数（每个设备一个） */
+#define SESSION_RESUME_MAX_USERS 65536	  /* 令牌表最多保存的用户数 */
+#define SESSION_RESUME_TOKEN_TTL_S 86400  /* 令牌自签发起的最长有效期（秒） */
+#define SESSION_RESUME_CHECK_MS 1000	  /* 事件循环检查保留期是否结束的间隔 */
+
+/* 登录时签发一次性的恢复令牌；最后一个连接断开后保留期内出示令牌即可恢复会话，
+   期间不通知下线，保留期结束仍未恢复时才通知 */
+void session_resume_set_grace(int seconds);
+int session_resume_grace(void);
+int session_resume_issue(const char *username, int user_id, char *out, size_t cap);
+int session_resume_claim(const char *username, const char *token, int *user_id);
+void session_resume_revoke(const char *username);
+void session_resume_presence(const char *username, int online);
+int session_resume_expire(uint64_t now_ms);
+int session_resume_parked(void);
+void session_resume_cleanup(void);
+
+/* ================ 群组管理器函数 ================ */
+
+#define GROUP_MAX_MEMBERS 10000 /* 单个群组的最大成员数 */
+
+/* 成员和所在群组互为倒排索引，加入、退出和成员判断都是 O(1) */
+int group_manager_join(const char *group_name, const char *username);
+int group_manager_leave(const char *group_name, const char *username);
+int group_manager_is_member(const char *group_name, const char *username);
+int group_manager_member_count(const char *group_name);
+int group_manager_user_group_count(const char *username);
+
+/* 在锁内遍历成员：回调返回非零时停止，回调中不能调用群组管理器 */
+typedef int (*GroupMemberVisitor)(const char *username, void *ctx);
+int group_manager_foreach_member(const char *group_name, GroupMemberVisitor visit, void *ctx);
+void group_manager_cleanup(void);
+
+/* ================ 离线消息队列函数 ================ */
+
+#define OFFLINE_QUEUE_MAX_PER_USER 256			 /* 每个用户最多保存的离线消息数 */
+#define OFFLINE_QUEUE_MAX_BYTES (4 * 1024 * 1024) /* 所有离线队列合计的最大字节数 */
+
+/* 按用户保存发给离线用户的已序列化帧，超限时丢弃最旧的（仍可从历史记录查询） */
+int offline_queue_push(const char *username, const char *frame, size_t len);
+char *offline_queue_take(const char *username, size_t *out_len, int *out_spilled);
+
+/* 累计送达确认：登录时接受了 ack 的用户，私聊帧在锁内编号、入队并投递，
+   投递后仍留在队列中，直到 ACK 确认；重新登录时未确认的帧全部重发 */
+typedef size_t (*OfflineFrameWriter)(uint32_t id, void *ctx, char *out, size_t cap);
+typedef int (*OfflineFrameSender)(const char *username, const char *frame, size_t len);
+char *offline_queue_login(const char *username, int tracking, size_t *out_len, int *out_spilled);
+uint32_t offline_queue_epoch(void);
+int offline_queue_push_tracked(const char *username, OfflineFrameWriter write, void *ctx,
+							   OfflineFrameSender send, int *delivered);
+int offline_queue_ack(const char *username, uint32_t upto);
+int offline_queue_pending(const char *username);
+size_t offline_queue_bytes(void);
+void offline_queue_cleanup(void);
+
+/* ================ 在线状态通知 ================ */
+
+#define PRESENCE_DEFAULT_WINDOW_MS 100 /* 默认的合并窗口（毫秒） */
+#define PRESENCE_MAX_WATCH 32		   /* 单个用户最多关注的用户数 */
+
+/* 上线/下线先记入待发表，窗口结束时把净变化合并成 PRESENCE 帧扇出到所有分片；
+   默认接收所有人的状态，PRESENCE 命令可改为只关注指定用户或关闭 */
+void presence_set_window(int ms);
+int presence_window(void);
+void presence_note(const char *username, int online);
+int presence_flush(uint64_t now_ms);
+void presence_deliver(SharedFrame *frame);
+int presence_watch(const char *subscriber, const char *spec);
+int presence_snapshot(const char *subscriber, char *out, size_t cap);
+void presence_cleanup(void);
+
+/* ================ 集群 ================ */
+
+#define CLUSTER_MAX_NODES 16 /* 集群节点数上限 */
+
+/* 用户按一致性哈希归属于一个节点，连接所在节点经节点间链路批量转发私聊和广播帧 */
+int cluster_configure(const char *spec, int self);
+int cluster_start(const char *spec, int self);
+void cluster_stop(void);
+int cluster_enabled(void);
+int cluster_self(int *count);
+int cluster_links_up(void);
+int cluster_home(const char *username);
+void cluster_note_user(const char *username, int online);
+int cluster_route_private(const char *receiver, const char *data, size_t len);
+int cluster_broadcast(const char *sender, const char *data, size_t len);
+
+/* ================ 限流函数 ================ */
+
+#define RATE_LIMIT_DEFAULT_USER_FACTOR 4 /* 同一用户所有连接合计的默认额度倍数 */
+
+void rate_limit_configure(const RateLimitConfig *config);
+int rate_limit_enabled(void);
+int rate_limit_admit(Client *c, CommandType type, uint64_t now_ms);
+uint64_t rate_limit_charge_bytes(Client *c, size_t bytes, uint64_t now_ms);
+void rate_limit_cleanup(void);
+
 /* ================ 消息路由器函数 ================ */
 
 int route_message(Message *msg);
+
+/* ================ 服务器指标函数 ================ */
+
+/* 服务器计数器编号，命令耗时直方图的编号是命令类型 */
+typedef enum
+{
+	STAT_BYTES_IN = 0,		   /* 从客户端读入的字节数 */
+	STAT_BYTES_OUT,			   /* 写入套接字的字节数 */
+	STAT_SEND_FAILURES,		   /* 发送出错或超过积压上限的次数 */
+	STAT_PARSE_ERRORS,		   /* 无法解析或超长的帧数 */
+	STAT_CONNECTIONS_ACCEPTED, /* 接受的连接数 */
+	STAT_CONNECTIONS_CLOSED,   /* 关闭的连接数 */
+	STAT_IDLE_TIMEOUTS,		   /* 因空闲超时关闭的连接数 */
+	STAT_AUTH_QUEUED,		   /* 交给认证线程的登录数 */
+	STAT_AUTH_BUSY,			   /* 认证队列已满而拒绝的登录数 */
+	STAT_PRESENCE_CHANGES,	   /* 发出的在线状态变化数 */
+	STAT_PRESENCE_FRAMES,	   /* 合并后发出的 PRESENCE 帧数 */
+	STAT_CLUSTER_SENT,		   /* 写到其他节点的链路记录数 */
+	STAT_CLUSTER_BATCHES,	   /* 链路写出的批次数 */
+	STAT_CLUSTER_RECEIVED,	   /* 从其他节点收到的链路记录数 */
+	STAT_CLUSTER_DROPPED,	   /* 链路缓冲区已满或断开而丢弃的记录数 */
+	STAT_RATE_REJECTED,		   /* 超过消息或广播额度而拒绝的命令帧数 */
+	STAT_RATE_THROTTLED,	   /* 超过字节额度而暂停读取的次数 */
+	STAT_DELIVERY_TRACKED,	   /* 带投递序号发出的私聊帧数 */
+	STAT_DELIVERY_ACKS,		   /* 收到的 ACK 帧数 */
+	STAT_DELIVERY_TRIMMED,	   /* 因确认从离线队列删除的帧数 */
+	STAT_DELIVERY_RESENT,	   /* 登录时重发的未确认帧数 */
+	STAT_SESSION_RESUMED,	   /* 凭恢复令牌恢复的会话数 */
+	STAT_SESSION_REJECTED,	   /* 令牌无效或已过期而拒绝的恢复数 */
+	STAT_SESSION_PARKED,	   /* 断线后进入保留期的用户数 */
+	STAT_SESSION_EXPIRED	   /* 保留期结束仍未恢复的用户数 */
+} ServerStat;
+
+void server_stats_init(void);
+void server_stats_record_command(CommandType type, uint64_t elapsed_us);
+long server_stats_uptime(void);
+size_t server_stats_format_status(char *buf, size_t cap);
+size_t server_stats_scrape(char *buf, size_t cap);
 #endif /* CORE_H */
@@ -0,0 +1,336 @@
+/**
+ * @file group_manager.c
+ * @brief 群组成员管理实现
+ *
+ * 维护两份互为倒排的哈希索引：群组名 -> 成员集合，用户名 -> 所在群组集合。
+ * 成员集合的值直接指向用户条目，用户的群组集合的值指向群组条目，
+ * 加入、退出和成员判断都是常数次哈希查找，与群组规模无关。
+ * 最后一个成员退出时删除群组，用户退出最后一个群组时删除用户条目。
+ *
+ * 所有索引由一把互斥锁保护；群组消息扇出时在锁内遍历成员集合，
+ * 遍历回调只做本分片的连接查找和发送队列入队，不能再调用本模块。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core.h"
+
+/**
+ * @brief 用户所在群组的倒排条目
+ */
+typedef struct
+{
+	char username[MAX_USERNAME_LEN]; /**< 用户名 */
+	HashIndex groups;				 /**< 所在群组集合，值为 Group* */
+} UserGroups;
+
+static platform_mutex_t group_lock = PLATFORM_MUTEX_INITIALIZER;
+static HashIndex groups_by_name; /* 群组名 -> Group* */
+static HashIndex users_by_name;	 /* 用户名 -> UserGroups* */
+static int next_group_id = 1;
+
+static size_t group_hash(const char *name)
+{
+	return hash_index_hash_string(name, MAX_GROUPNAME_LEN);
+}
+
+static size_t user_hash(const char *username)
+{
+	return hash_index_hash_string(username, MAX_USERNAME_LEN);
+}
+
+static int match_group(const void *value, const void *key)
+{
+	return strcmp(((const Group *)value)->group_name, (const char *)key) == 0;
+}
+
+static int match_user(const void *value, const void *key)
+{
+	return strcmp(((const UserGroups *)value)->username, (const char *)key) == 0;
+}
+
+static Group *find_group(const char *name)
+{
+	return (Group *)hash_index_find(&groups_by_name, group_hash(name), name, match_group);
+}
+
+static UserGroups *find_user(const char *username)
+{
+	return (UserGroups *)hash_index_find(&users_by_name, user_hash(username), username, match_user);
+}
+
+/**
+ * @brief 检查群组名是否可用
+ *
+ * @return int 合法返回1，否则返回0
+ */
+static int valid_group_name(const char *name)
+{
+	return name && name[0] != '\0' && strlen(name) < MAX_GROUPNAME_LEN && strcmp(name, "all") != 0;
+}
+
+/**
+ * @brief 删除已无成员的群组（在锁内调用）
+ */
+static void drop_group(Group *group)
+{
+	hash_index_remove(&groups_by_name, group_hash(group->group_name), group, NULL);
+	hash_index_free(&group->members);
+	free(group);
+}
+
+/**
+ * @brief 删除已不在任何群组中的用户条目（在锁内调用）
+ */
+static void drop_user(UserGroups *user)
+{
+	hash_index_remove(&users_by_name, user_hash(user->username), user, NULL);
+	hash_index_free(&user->groups);
+	free(user);
+}
+
+/**
+ * @brief 加入群组，群组不存在时创建
+ *
+ * @param group_name 群组名
+ * @param username 用户名
+ * @return int 加入成功返回0，已是成员返回1，群组已满返回 ERROR_GROUP_FULL，失败返回-1
+ */
+int group_manager_join(const char *group_name, const char *username)
+{
+	if (!valid_group_name(group_name) || !username || username[0] == '\0')
+		return -1;
+
+	platform_mutex_lock(&group_lock);
+	Group *group = find_group(group_name);
+	UserGroups *user = find_user(username);
+	int result = 0;
+
+	if (group && user && hash_index_find(&group->members, user_hash(username), username, match_user))
+	{
+		platform_mutex_unlock(&group_lock);
+		return 1;
+	}
+	if (group && group->member_count >= GROUP_MAX_MEMBERS)
+	{
+		platform_mutex_unlock(&group_lock);
+		return ERROR_GROUP_FULL;
+	}
+
+	if (!group)
+	{
+		group = (Group *)calloc(1, sizeof(Group));
+		if (!group || hash_index_insert(&groups_by_name, group_hash(group_name), group) != 0)
+		{
+			free(group);
+			platform_mutex_unlock(&group_lock);
+			return -1;
+		}
+		safe_strcpy(group->group_name, group_name, sizeof(group->group_name));
+		safe_strcpy(group->created_by, username, sizeof(group->created_by));
+		group->group_id = next_group_id++;
+		group->create_time = time(NULL);
+		hash_index_init(&group->members, 0);
+	}
+	if (!user)
+	{
+		user = (UserGroups *)calloc(1, sizeof(UserGroups));
+		if (!user || hash_index_insert(&users_by_name, user_hash(username), user) != 0)
+		{
+			free(user);
+			user = NULL;
+			result = -1;
+		}
+		else
+		{
+			safe_strcpy(user->username, username, sizeof(user->username));
+			hash_index_init(&user->groups, 0);
+		}
+	}
+
+	if (user && hash_index_insert(&group->members, user_hash(username), user) == 0)
+	{
+		if (hash_index_insert(&user->groups, group_hash(group_name), group) == 0)
+			group->member_count++;
+		else
+		{
+			hash_index_remove(&group->members, user_hash(username), user, NULL);
+			result = -1;
+		}
+	}
+	else
+	{
+		result = -1;
+	}
+
+	if (result != 0)
+	{
+		if (group->member_count == 0)
+			drop_group(group);
+		if (user && user->groups.count == 0)
+			drop_user(user);
+	}
+	platform_mutex_unlock(&group_lock);
+
+	if (result == 0)
+		LOG_INFO("User %s joined group %s", username, group_name);
+	return result;
+}
+
+/**
+ * @brief 退出群组，最后一个成员退出时删除群组
+ *
+ * @param group_name 群组名
+ * @param username 用户名
+ * @return int 成功返回0，群组不存在或不是成员返回-1
+ */
+int group_manager_leave(const char *group_name, const char *username)
+{
+	if (!group_name || !username)
+		return -1;
+
+	platform_mutex_lock(&group_lock);
+	Group *group = find_group(group_name);
+	UserGroups *user = find_user(username);
+	if (!group || !user || !hash_index_remove(&group->members, user_hash(username), user, NULL))
+	{
+		platform_mutex_unlock(&group_lock);
+		return -1;
+	}
+
+	hash_index_remove(&user->groups, group_hash(group_name), group, NULL);
+	group->member_count--;
+	if (group->member_count == 0)
+		drop_group(group);
+	if (user->groups.count == 0)
+		drop_user(user);
+	platform_mutex_unlock(&group_lock);
+
+	LOG_INFO("User %s left group %s", username, group_name);
+	return 0;
+}
+
+/**
+ * @brief 判断用户是否为群组成员
+ *
+ * @param group_name 群组名
+ * @param username 用户名
+ * @return int 是成员返回1，否则返回0
+ */
+int group_manager_is_member(const char *group_name, const char *username)
+{
+	if (!group_name || !username)
+		return 0;
+
+	platform_mutex_lock(&group_lock);
+	Group *group = find_group(group_name);
+	int member = group && hash_index_find(&group->members, user_hash(username), username, match_user) != NULL;
+	platform_mutex_unlock(&group_lock);
+	return member;
+}
+
+/**
+ * @brief 获取群组成员数
+ *
+ * @param group_name 群组名
+ * @return int 成员数，群组不存在返回0
+ */
+int group_manager_member_count(const char *group_name)
+{
+	if (!group_name)
+		return 0;
+
+	platform_mutex_lock(&group_lock);
+	Group *group = find_group(group_name);
+	int count = group ? group->member_count : 0;
+	platform_mutex_unlock(&group_lock);
+	return count;
+}
+
+/**
+ * @brief 获取用户所在的群组数
+ *
+ * @param username 用户名
+ * @return int 群组数
+ */
+int group_manager_user_group_count(const char *username)
+{
+	if (!username)
+		return 0;
+
+	platform_mutex_lock(&group_lock);
+	UserGroups *user = find_user(username);
+	int count = user ? (int)user->groups.count : 0;
+	platform_mutex_unlock(&group_lock);
+	return count;
+}
+
+/**
+ * @brief 在锁内遍历群组的全部成员
+ *
+ * 回调中不能调用本模块的其他函数。
+ *
+ * @param group_name 群组名
+ * @param visit 逐个成员的回调，返回非零时停止
+ * @param ctx 回调上下文
+ * @return int 遍历的成员数，群组不存在返回-1
+ */
+int group_manager_foreach_member(const char *group_name, GroupMemberVisitor visit, void *ctx)
+{
+	int visited = 0;
+
+	if (!group_name || !visit)
+		return -1;
+
+	platform_mutex_lock(&group_lock);
+	Group *group = find_group(group_name);
+	if (!group)
+	{
+		platform_mutex_unlock(&group_lock);
+		return -1;
+	}
+	for (size_t i = 0; i < group->members.cap; i++)
+	{
+		UserGroups *user = (UserGroups *)group->members.slots[i].value;
+		if (!user)
+			continue;
+		visited++;
+		if (visit(user->username, ctx) != 0)
+			break;
+	}
+	platform_mutex_unlock(&group_lock);
+	return visited;
+}
+
+/**
+ * @brief 释放全部群组和成员索引
+ */
+void group_manager_cleanup(void)
+{
+	platform_mutex_lock(&group_lock);
+	for (size_t i = 0; i < groups_by_name.cap; i++)
+	{
+		Group *group = (Group *)groups_by_name.slots[i].value;
+		if (group)
+		{
+			hash_index_free(&group->members);
+			free(group);
+		}
+	}
+	for (size_t i = 0; i < users_by_name.cap; i++)
+	{
+		UserGroups *user = (UserGroups *)users_by_name.slots[i].value;
+		if (user)
+		{
+			hash_index_free(&user->groups);
+			free(user);
+		}
+	}
+	hash_index_free(&groups_by_name);
+	hash_index_free(&users_by_name);
+	platform_mutex_unlock(&group_lock);
+}
@@ -3,7 +3,8 @@
  * @brief 消息路由模块实现
  *
  * 负责根据消息类型和接收者将消息路由到正确的客户端。
- * 支持私聊、群聊、广播三种消息类型的路由。
+ * 支持私聊、群聊、广播三种消息类型的路由。集群模式下不在本节点的私聊接收者
+ * 交给 cluster.c 转发，广播帧也发给其他节点；群组消息只在本节点内扇出。
  */
 
 #include <stdio.h>
@@ -11,40 +12,106 @@
 #include <string.h>
 #include "core.h"
 #include "../protocol/protocol.h"
+#include "../storage/storage.h"
 #include "../utils/utils.h"
 
 /**
- * @brief 发送消息到指定的socket描述符
+ * @brief 把已序列化的帧发给在线用户
  *
- * @param sockfd 目标socket描述符
- * @param message 要发送的消息字符串
- * @return int 成功返回0，失败返回-1
+ * 用户在当前分片上时直接排入其发送队列，在其他 reactor 分片上时投递到该分片的邮箱。
+ *
+ * @return int 成功返回0，用户不在线或发送失败返回-1
+ */
+static int deliver_to_user(const char *username, const char *data, size_t len)
+{
+	Client *receiver = connection_manager_find_by_username(username);
+	if (receiver)
+		return connection_manager_send(receiver->sockfd, data, len);
+
+	SharedFrame *frame = shared_frame_create(data, len);
+	int result = connection_manager_post_to_user(username, frame);
+	shared_frame_release(frame);
+	return result;
+}
+
+/**
+ * @brief 把发给离线用户的消息存入其离线队列
+ *
+ * 入队后再检查一次在线状态：接收者恰好在检查之后登录、且登录时已取走队列的情况下，
+ * 由这里取走刚入队的帧直接投递，消息不会滞留到下一次登录。
+ *
+ * @return int 成功返回0（msg->is_delivered 表示是否已直接投递），失败返回-1
  */
-static int send_to_socket(socket_t sockfd, const char *message)
+static int queue_offline_message(Message *msg, const char *serialized_msg)
 {
-	if (SOCKET_IS_INVALID(sockfd) || !message)
+	if (offline_queue_push(msg->receiver, serialized_msg, strlen(serialized_msg)) != 0)
 	{
+		LOG_ERROR("Failed to queue offline message for %s", msg->receiver);
 		return -1;
 	}
 
-	size_t len = strlen(message);
-	socket_io_result_t bytes_sent = platform_socket_send(sockfd, message, len);
+	if (session_manager_is_user_online(msg->receiver))
+	{
+		size_t len;
+		char *backlog = offline_queue_take(msg->receiver, &len, NULL);
+		if (backlog && deliver_to_user(msg->receiver, backlog, len) == 0)
+			msg->is_delivered = 1;
+		free(backlog);
+	}
+
+	LOG_INFO("Private message %s: %s -> %s", msg->is_delivered ? "delivered" : "queued offline",
+			 msg->sender, msg->receiver);
+	return 0;
+}
 
-	if (bytes_sent < 0)
+/**
+ * @brief 按投递序号写出私聊帧：时间戳改为 "时间;序号"，放不下时截短原来的时间
+ */
+static size_t write_tracked_frame(uint32_t id, void *ctx, char *out, size_t cap)
+{
+	Message *msg = (Message *)ctx;
+	char original[sizeof(msg->timestamp)];
+	char suffix[16];
+	size_t len = 0;
+
+	int n = snprintf(suffix, sizeof(suffix), "%c%lu", PROTOCOL_DELIVERY_SEPARATOR, (unsigned long)id);
+	size_t keep = strlen(msg->timestamp);
+	if (keep + (size_t)n >= sizeof(msg->timestamp))
+		keep = sizeof(msg->timestamp) - 1 - (size_t)n;
+
+	safe_strcpy(original, msg->timestamp, sizeof(original));
+	memcpy(msg->timestamp + keep, suffix, (size_t)n + 1);
+	char *frame = serialize_message(msg);
+	safe_strcpy(msg->timestamp, original, sizeof(msg->timestamp));
+
+	if (frame && strlen(frame) < cap)
 	{
-		LOG_ERROR("Failed to send message to socket %lld: %s",
-				  SOCKET_ID(sockfd), platform_socket_error_message());
-		return -1;
+		len = strlen(frame);
+		memcpy(out, frame, len);
 	}
+	build_free(frame);
+	return len;
+}
 
-	if ((size_t)bytes_sent != len)
+/**
+ * @brief 把消息交给跟踪确认的接收者的离线队列编号投递
+ *
+ * @return int 已入队返回0（msg->is_delivered 表示是否已投递），接收者不跟踪确认返回1，失败返回-1
+ */
+static int route_tracked_message(Message *msg)
+{
+	int delivered = 0;
+	int result = offline_queue_push_tracked(msg->receiver, write_tracked_frame, msg, deliver_to_user, &delivered);
+	if (result != 0)
 	{
-		LOG_WARN("Partial send to socket %lld: %lld/%zu bytes",
-				 SOCKET_ID(sockfd), (long long)bytes_sent, len);
-		return -1;
+		if (result < 0)
+			LOG_ERROR("Failed to queue tracked message for %s", msg->receiver);
+		return result;
 	}
 
-	LOG_DEBUG("Sent %lld bytes to socket %lld", (long long)bytes_sent, SOCKET_ID(sockfd));
+	msg->is_delivered = delivered;
+	LOG_INFO("Private message %s: %s -> %s (awaiting ack)", delivered ? "delivered" : "queued offline",
+			 msg->sender, msg->receiver);
 	return 0;
 }
 
@@ -52,12 +119,14 @@ static int send_to_socket(socket_t sockfd, const char *message)
  * @brief 路由私聊消息
  *
  * 将私聊消息发送给指定的接收者。
- * 1. 检查接收者是否在线
- * 2. 查找接收者的客户端连接
- * 3. 发送消息给接收者
+ * 1. 接收者不在本节点时，集群模式下交给接收者的归属节点（或其所在的节点）
+ * 2. 接收者登录时接受了 ack 时，编号后存入离线队列并投递，确认后才从队列删除
+ * 3. 接收者离线时存入离线队列，登录时随登录响应一起送达
+ * 4. 查找接收者的客户端连接（接收者在其他 reactor 分片上时投递到该分片的邮箱）
+ * 5. 发送消息给接收者
  *
  * @param msg 要路由的消息
- * @return int 成功返回0，失败返回错误码
+ * @return int 成功返回0（已存入离线队列也算成功，msg->is_delivered 为0），失败返回错误码
  */
 static int route_private_message(Message *msg)
 {
@@ -67,16 +136,16 @@ static int route_private_message(Message *msg)
 		return -1;
 	}
 
-	// 检查接收者是否在线
-	if (!session_manager_is_user_online(msg->receiver))
+	int online = session_manager_is_user_online(msg->receiver);
+	if (!online && !user_store_find_by_username(msg->receiver))
 	{
-		LOG_WARN("User %s is not online, cannot deliver message", msg->receiver);
-		return ERROR_USER_OFFLINE;
+		LOG_WARN("User %s does not exist, cannot deliver message", msg->receiver);
+		return ERROR_USER_NOT_FOUND;
 	}
 
 	// 查找接收者的客户端连接
-	Client *receiver = connection_manager_find_by_username(msg->receiver);
-	if (!receiver)
+	Client *receiver = online ? connection_manager_find_by_username(msg->receiver) : NULL;
+	if (online && !receiver && !connection_manager_is_remote_user(msg->receiver))
 	{
 		LOG_ERROR("Failed to find client for user: %s", msg->receiver);
 		return ERROR_USER_NOT_FOUND;
@@ -90,8 +159,29 @@ static int route_private_message(Message *msg)
 		return -1;
 	}
 
+	msg->is_delivered = 0;
+	if (!online && cluster_route_private(msg->receiver, serialized_msg, strlen(serialized_msg)) == 0)
+	{
+		msg->is_delivered = 1;
+		LOG_INFO("Private message forwarded to cluster: %s -> %s", msg->sender, msg->receiver);
+		build_free(serialized_msg);
+		return 0;
+	}
+	int tracked = route_tracked_message(msg);
+	if (tracked <= 0)
+	{
+		build_free(serialized_msg);
+		return tracked;
+	}
+	if (!online)
+	{
+		int queued = queue_offline_message(msg, serialized_msg);
+		build_free(serialized_msg);
+		return queued;
+	}
+
 	// 发送消息
-	int result = send_to_socket(receiver->sockfd, serialized_msg);
+	int result = deliver_to_user(msg->receiver, serialized_msg, strlen(serialized_msg));
 
 	// 更新消息状态
 	if (result == 0)
@@ -105,14 +195,60 @@ static int route_private_message(Message *msg)
 				  msg->sender, msg->receiver);
 	}
 
-	free(serialized_msg);
+	build_free(serialized_msg);
 	return result;
 }
 
+/**
+ * @brief 广播遍历上下文
+ */
+typedef struct
+{
+	SharedFrame *frame;	  /**< 已序列化的广播帧 */
+	const char *sender;	  /**< 发送者，不回发给自己 */
+	int success_count;	  /**< 成功投递数 */
+	int total_eligible;	  /**< 已认证的客户端数 */
+	int sender_seen;	  /**< 发送者的连接在本分片上 */
+} BroadcastContext;
+
+/**
+ * @brief 广播遍历回调：把共享帧排入一个接收者的发送队列
+ */
+static int deliver_broadcast(Client *client, void *ctx)
+{
+	BroadcastContext *bc = (BroadcastContext *)ctx;
+
+	if (client->status != CLIENT_STATUS_AUTHENTICATED)
+		return 0;
+
+	bc->total_eligible++;
+
+	// 不发送给自己
+	if (strcmp(client->username, bc->sender) == 0)
+	{
+		bc->sender_seen = 1;
+		return 0;
+	}
+
+	if (connection_manager_send_frame(client, bc->frame) == 0)
+	{
+		bc->success_count++;
+		LOG_DEBUG("Broadcast delivered to: %s", client->username);
+	}
+	else
+	{
+		LOG_WARN("Failed to deliver broadcast to: %s", client->username);
+	}
+	return 0;
+}
+
 /**
  * @brief 路由广播消息
  *
  * 将广播消息发送给所有在线且已认证的用户（除了发送者自己）。
+ * 消息只序列化一次，所有接收者共享同一个引用计数帧，
+ * 原地遍历连接表，不分配客户端快照。多 reactor 模式下同一帧
+ * 再投递到其他分片的邮箱，由各分片线程发给自己的客户端。
  *
  * @param msg 要广播的消息
  * @return int 成功返回0，失败返回-1
@@ -125,14 +261,9 @@ static int route_broadcast_message(Message *msg)
 		return -1;
 	}
 
-	// 获取所有客户端
-	int client_count = 0;
-	Client **clients = connection_manager_get_all(&client_count);
-	if (!clients || client_count == 0)
+	if (connection_manager_total_count() == 0 && !cluster_enabled())
 	{
 		LOG_WARN("No clients available for broadcast");
-		if (clients)
-			free(clients);
 		return -1;
 	}
 
@@ -141,69 +272,87 @@ static int route_broadcast_message(Message *msg)
 	if (!serialized_msg)
 	{
 		LOG_ERROR("Failed to serialize broadcast message");
-		free(clients);
 		return -1;
 	}
 
-	int success_count = 0;
-	int total_eligible = 0;
+	BroadcastContext bc;
+	bc.frame = shared_frame_create(serialized_msg, strlen(serialized_msg));
+	bc.sender = msg->sender;
+	bc.success_count = 0;
+	bc.total_eligible = 0;
+	bc.sender_seen = 0;
+	int remote_nodes = cluster_broadcast(msg->sender, serialized_msg, strlen(serialized_msg));
+	build_free(serialized_msg);
+	if (!bc.frame)
+	{
+		LOG_ERROR("Failed to allocate broadcast frame");
+		return -1;
+	}
 
 	// 发送给所有已认证的客户端（除了发送者）
-	for (int i = 0; i < client_count; i++)
-	{
-		Client *client = clients[i];
-		if (!client || client->status != CLIENT_STATUS_AUTHENTICATED)
-		{
-			continue;
-		}
-
-		total_eligible++;
-
-		// 不发送给自己
-		if (strcmp(client->username, msg->sender) == 0)
-		{
-			continue;
-		}
-
-		if (send_to_socket(client->sockfd, serialized_msg) == 0)
-		{
-			success_count++;
-			LOG_DEBUG("Broadcast delivered to: %s", client->username);
-		}
-		else
-		{
-			LOG_WARN("Failed to deliver broadcast to: %s", client->username);
-		}
-	}
+	connection_manager_foreach_online(deliver_broadcast, &bc);
+	int remote_shards = connection_manager_post_broadcast(msg->sender, bc.frame);
 
-	LOG_INFO("Broadcast delivered: %d/%d users, from: %s",
-			 success_count, total_eligible, msg->sender);
+	LOG_INFO("Broadcast delivered: %d/%d users, from: %s, forwarded to %d shards and %d nodes",
+			 bc.success_count, bc.total_eligible, msg->sender, remote_shards, remote_nodes);
 
-	free(serialized_msg);
-	free(clients);
+	shared_frame_release(bc.frame);
 
-	// 如果至少发送给了一个用户，就算成功
-	return (success_count > 0) ? 0 : -1;
+	// 如果至少发送给了一个用户（或其他分片上还有在线用户、已交给其他节点），就算成功；
+	// 在工作线程上执行时本地没有分片，发送者自己也要从在线数中扣除
+	int remote_online = connection_manager_online_count() - bc.total_eligible - (bc.sender_seen ? 0 : 1);
+	return (bc.success_count > 0 || (remote_shards > 0 && remote_online > 0) || remote_nodes > 0) ? 0 : -1;
 }
 
 /**
  * @brief 路由群组消息
  *
- * TODO: 等待群组管理模块实现
+ * 与广播相同，消息只序列化一次，所有成员共享同一个引用计数帧：
+ * 先经群组成员集合发给本分片上在线的成员，再给其他每个分片投递一封邮件，
+ * 由各分片线程遍历成员集合发给自己的客户端。发送者是否为成员由调用方检查。
  *
- * @param msg 群组消息
- * @return int 暂返回-1
+ * @param msg 群组消息，接收者为 "group:<群组名>"
+ * @return int 成功返回0，群组不存在返回 ERROR_USER_NOT_FOUND，失败返回-1
  */
 static int route_group_message(Message *msg)
 {
-	if (!msg || !is_group_msg(msg))
+	if (!msg || !is_group_msg(msg) ||
+		strncmp(msg->receiver, RECEIVER_GROUP_PREFIX, strlen(RECEIVER_GROUP_PREFIX)) != 0)
 	{
 		LOG_ERROR("Invalid group message");
 		return -1;
 	}
 
-	LOG_WARN("Group message routing not implemented yet");
-	return -1;
+	const char *group_name = msg->receiver + strlen(RECEIVER_GROUP_PREFIX);
+	char *serialized_msg = serialize_message(msg);
+	if (!serialized_msg)
+	{
+		LOG_ERROR("Failed to serialize group message");
+		return -1;
+	}
+
+	SharedFrame *frame = shared_frame_create(serialized_msg, strlen(serialized_msg));
+	build_free(serialized_msg);
+	if (!frame)
+	{
+		LOG_ERROR("Failed to allocate group frame");
+		return -1;
+	}
+
+	int delivered = connection_manager_send_group(group_name, msg->sender, frame);
+	if (delivered < 0)
+	{
+		shared_frame_release(frame);
+		LOG_WARN("Group %s does not exist", group_name);
+		return ERROR_USER_NOT_FOUND;
+	}
+	int remote_shards = connection_manager_post_group(group_name, msg->sender, frame);
+	shared_frame_release(frame);
+
+	msg->is_delivered = 1;
+	LOG_INFO("Group message delivered: %s -> %s, %d local members, forwarded to %d shards",
+			 msg->sender, group_name, delivered, remote_shards);
+	return 0;
 }
 
 /**
@@ -225,18 +374,20 @@ int route_message(Message *msg)
 	LOG_DEBUG("Routing message: id=%d, type=%s, sender=%s, receiver=%s",
 			  msg->message_id, msg->type, msg->sender, msg->receiver);
 
-	// 根据消息类型路由
-	if (is_private_msg(msg))
+	// 根据消息类型路由，投递成功的消息交给历史日志（只入队，不写文件）
+	if (is_private_msg(msg) || is_broadcast_msg(msg) || is_group_msg(msg))
 	{
-		return route_private_message(msg);
-	}
-	else if (is_broadcast_msg(msg))
-	{
-		return route_broadcast_message(msg);
-	}
-	else if (is_group_msg(msg))
-	{
-		return route_group_message(msg);
+		int result;
+		if (is_private_msg(msg))
+			result = route_private_message(msg);
+		else if (is_broadcast_msg(msg))
+			result = route_broadcast_message(msg);
+		else
+			result = route_group_message(msg);
+
+		if (result == 0)
+			history_manager_append(msg);
+		return result;
 	}
 	else if (is_login_msg(msg) || is_logout_msg(msg) ||
 			 is_history_request(msg) || is_status_request(msg))
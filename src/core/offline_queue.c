@@ -0,0 +1,520 @@
+/**
+ * @file offline_queue.c
+ * @brief 离线消息队列实现
+ *
+ * 发给离线用户的私聊消息以已序列化的帧保存在该用户的先进先出队列中，
+ * 登录成功时一次取走全部帧，拼成一个缓冲区随登录响应一起写出。
+ *
+ * 内存有两道上限：每个用户最多 OFFLINE_QUEUE_MAX_PER_USER 条，所有用户合计
+ * 最多 OFFLINE_QUEUE_MAX_BYTES 字节。超出时丢弃最旧的帧（全局超限时丢弃全局最旧的），
+ * 这些消息在路由时已经写入历史日志，只记下溢出的条数，登录时提示用户从历史记录中查询。
+ *
+ * 每个帧同时挂在所属用户的队列和按到达顺序的全局链表上，全局链表的头部
+ * 总是某个用户队列的头部，淘汰是常数时间。所有状态由一把互斥锁保护，
+ * 接收者可能在任意 reactor 分片或工作线程上登录。
+ *
+ * 登录时接受了累计送达确认（ack 选项）的用户，队列同时是重发队列：每条私聊帧在锁内
+ * 分配该用户的下一个投递序号、写入队列并立即投递，同一用户的帧按序号顺序发出。
+ * 帧在投递后仍然留在队列中，客户端每收到一批消息发一个 ACK 确认已收到的最大序号，
+ * 序号不超过它的帧一次从队首删除；连接断开后重新登录时，未确认的帧随登录响应全部重发。
+ * 序号从1开始按用户递增，只在本进程内有效，登录响应带上进程的序号纪元，
+ * 客户端看到纪元变化时清空去重记录。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "core.h"
+
+struct OfflineUser;
+
+/**
+ * @brief 一条等待投递的帧
+ */
+typedef struct OfflineEntry
+{
+	struct OfflineEntry *next;		  /**< 同一用户的下一条 */
+	struct OfflineEntry *prev_global; /**< 全局链表中较早的一条 */
+	struct OfflineEntry *next_global; /**< 全局链表中较晚的一条 */
+	struct OfflineUser *owner;		  /**< 所属用户 */
+	uint32_t id;					  /**< 投递序号，0 表示未编号（投递一次即删除） */
+	size_t len;						  /**< 帧长度 */
+	char data[];					  /**< 已序列化的帧 */
+} OfflineEntry;
+
+/**
+ * @brief 一个离线用户的队列
+ */
+typedef struct OfflineUser
+{
+	char username[MAX_USERNAME_LEN]; /**< 接收者 */
+	OfflineEntry *head;				 /**< 最早的一条 */
+	OfflineEntry *tail;				 /**< 最新的一条 */
+	int count;						 /**< 队列中的条数 */
+	int spilled;					 /**< 因超限被丢弃、只能从历史记录查询的条数 */
+	int tracking;					 /**< 登录时接受了 ack，投递后保留到确认为止 */
+	uint32_t last_id;				 /**< 最近分配的投递序号 */
+	uint32_t sent_id;				 /**< 已交给当前连接的最大投递序号，登录时清零 */
+} OfflineUser;
+
+static platform_mutex_t offline_lock = PLATFORM_MUTEX_INITIALIZER;
+static HashIndex offline_users;
+static OfflineEntry *global_oldest = NULL;
+static OfflineEntry *global_newest = NULL;
+static size_t offline_bytes = 0;
+static uint32_t offline_epoch = 0;
+
+static size_t offline_hash(const char *username)
+{
+	return hash_index_hash_string(username, MAX_USERNAME_LEN);
+}
+
+static int match_offline_user(const void *value, const void *key)
+{
+	return strcmp(((const OfflineUser *)value)->username, (const char *)key) == 0;
+}
+
+static OfflineUser *find_offline_user(const char *username)
+{
+	return (OfflineUser *)hash_index_find(&offline_users, offline_hash(username), username, match_offline_user);
+}
+
+/**
+ * @brief 从全局链表中摘下一条（在锁内调用）
+ */
+static void unlink_global(OfflineEntry *entry)
+{
+	if (entry->prev_global)
+		entry->prev_global->next_global = entry->next_global;
+	else
+		global_oldest = entry->next_global;
+	if (entry->next_global)
+		entry->next_global->prev_global = entry->prev_global;
+	else
+		global_newest = entry->prev_global;
+	offline_bytes -= sizeof(OfflineEntry) + entry->len;
+}
+
+/**
+ * @brief 删除用户队列中最早的一条（在锁内调用）
+ */
+static void drop_head(OfflineUser *user)
+{
+	OfflineEntry *entry = user->head;
+	user->head = entry->next;
+	if (!user->head)
+		user->tail = NULL;
+	user->count--;
+	unlink_global(entry);
+	free(entry);
+}
+
+/**
+ * @brief 丢弃用户队列中最早的一条并计入溢出数（在锁内调用）
+ */
+static void spill_oldest(OfflineUser *user)
+{
+	drop_head(user);
+	user->spilled++;
+}
+
+/**
+ * @brief 查找用户的队列，不存在时创建（在锁内调用）
+ */
+static OfflineUser *obtain_offline_user(const char *username)
+{
+	OfflineUser *user = find_offline_user(username);
+	if (user)
+		return user;
+
+	user = (OfflineUser *)calloc(1, sizeof(OfflineUser));
+	if (!user || hash_index_insert(&offline_users, offline_hash(username), user) != 0)
+	{
+		free(user);
+		return NULL;
+	}
+	safe_strcpy(user->username, username, sizeof(user->username));
+	return user;
+}
+
+/**
+ * @brief 按上限淘汰后把一条帧接到用户队列和全局链表的末尾（在锁内调用）
+ */
+static void append_entry(OfflineUser *user, OfflineEntry *entry)
+{
+	if (user->count >= OFFLINE_QUEUE_MAX_PER_USER)
+		spill_oldest(user);
+	while (global_oldest && offline_bytes + sizeof(OfflineEntry) + entry->len > OFFLINE_QUEUE_MAX_BYTES)
+		spill_oldest(global_oldest->owner);
+
+	entry->next = NULL;
+	entry->owner = user;
+	if (user->tail)
+		user->tail->next = entry;
+	else
+		user->head = entry;
+	user->tail = entry;
+	user->count++;
+
+	entry->next_global = NULL;
+	entry->prev_global = global_newest;
+	if (global_newest)
+		global_newest->next_global = entry;
+	else
+		global_oldest = entry;
+	global_newest = entry;
+	offline_bytes += sizeof(OfflineEntry) + entry->len;
+}
+
+/**
+ * @brief 队列已空、溢出数已报告且不再跟踪确认时删除用户记录（在锁内调用）
+ */
+static void release_if_idle(OfflineUser *user)
+{
+	if (user->head || user->spilled > 0 || user->tracking)
+		return;
+	hash_index_remove(&offline_users, offline_hash(user->username), user, NULL);
+	free(user);
+}
+
+/**
+ * @brief 为离线用户保存一帧
+ *
+ * @param username 接收者
+ * @param frame 已序列化的帧
+ * @param len 帧长度
+ * @return int 成功返回0，参数无效、帧超过总上限或内存不足返回-1
+ */
+int offline_queue_push(const char *username, const char *frame, size_t len)
+{
+	if (!username || username[0] == '\0' || !frame || len == 0 ||
+		sizeof(OfflineEntry) + len > OFFLINE_QUEUE_MAX_BYTES)
+		return -1;
+
+	OfflineEntry *entry = (OfflineEntry *)malloc(sizeof(OfflineEntry) + len);
+	if (!entry)
+		return -1;
+	memcpy(entry->data, frame, len);
+	entry->len = len;
+	entry->id = 0;
+
+	platform_mutex_lock(&offline_lock);
+	OfflineUser *user = obtain_offline_user(username);
+	if (!user)
+	{
+		platform_mutex_unlock(&offline_lock);
+		free(entry);
+		return -1;
+	}
+	append_entry(user, entry);
+	platform_mutex_unlock(&offline_lock);
+	return 0;
+}
+
+/**
+ * @brief 取出用户待发的帧（在锁内调用）
+ *
+ * 未编号的帧取走删除；跟踪确认的用户已编号、还没有交给当前连接的帧（序号大于 sent_id）
+ * 只复制不删除，等待 ACK 确认。溢出计数随之清零。
+ *
+ * @return char* 以空字符结尾的缓冲区，没有待发的帧或内存不足时返回NULL
+ */
+static char *collect_locked(OfflineUser *user, size_t *out_len, int *out_spilled, int *out_resent)
+{
+	char *buffer = NULL;
+	size_t total = 0;
+
+	for (OfflineEntry *entry = user->head; entry; entry = entry->next)
+		if (entry->id == 0 || !user->tracking || entry->id > user->sent_id)
+			total += entry->len;
+	if (total > 0)
+		buffer = (char *)malloc(total + 1);
+	if (total > 0 && !buffer)
+		return NULL;
+
+	size_t pos = 0;
+	OfflineEntry **link = &user->head;
+	OfflineEntry *kept = NULL;
+	while (*link)
+	{
+		OfflineEntry *entry = *link;
+		if (user->tracking && entry->id != 0)
+		{
+			if (entry->id > user->sent_id)
+			{
+				memcpy(buffer + pos, entry->data, entry->len);
+				pos += entry->len;
+				(*out_resent)++;
+			}
+			kept = entry;
+			link = &entry->next;
+			continue;
+		}
+		memcpy(buffer + pos, entry->data, entry->len);
+		pos += entry->len;
+		*link = entry->next;
+		user->count--;
+		unlink_global(entry);
+		free(entry);
+	}
+	user->tail = kept;
+	if (user->tracking)
+		user->sent_id = user->last_id;
+	if (out_spilled)
+		*out_spilled = user->spilled;
+	user->spilled = 0;
+
+	if (buffer)
+		buffer[pos] = '\0';
+	*out_len = pos;
+	return buffer;
+}
+
+/**
+ * @brief 取走用户的全部离线帧
+ *
+ * 帧按到达顺序拼接成一个缓冲区，调用方一次写出；取走后用户的队列和溢出计数清零。
+ * 跟踪确认的用户已编号的帧只取出还没有发给当前连接的，并且只复制不删除，等待 ACK 确认。
+ *
+ * @param username 接收者
+ * @param out_len 输出缓冲区长度
+ * @param out_spilled 输出因超限丢弃的条数，可为NULL
+ * @return char* 以空字符结尾的缓冲区，调用方负责释放；没有离线帧时返回NULL
+ */
+char *offline_queue_take(const char *username, size_t *out_len, int *out_spilled)
+{
+	size_t len = 0;
+	int resent = 0;
+	char *buffer = NULL;
+
+	if (out_len)
+		*out_len = 0;
+	if (out_spilled)
+		*out_spilled = 0;
+	if (!username)
+		return NULL;
+
+	platform_mutex_lock(&offline_lock);
+	OfflineUser *user = find_offline_user(username);
+	if (user)
+	{
+		buffer = collect_locked(user, &len, out_spilled, &resent);
+		release_if_idle(user);
+	}
+	platform_mutex_unlock(&offline_lock);
+
+	if (resent > 0)
+		metrics_add(STAT_DELIVERY_RESENT, (uint64_t)resent);
+	if (out_len)
+		*out_len = len;
+	return buffer;
+}
+
+/**
+ * @brief 登录时设置是否跟踪送达确认，并取走要随登录响应发出的帧
+ *
+ * 新连接没有收到过任何帧：跟踪确认的用户所有未确认的帧都重发，之后的帧编号投递、
+ * 保留到确认；不跟踪确认时恢复为投递一次即删除，已编号的帧也一并取走。
+ * 设置和取出在同一次加锁中完成，期间到达的帧不会漏发。
+ *
+ * @param username 登录的用户
+ * @param tracking 客户端是否接受了 ack 选项
+ * @param out_len 输出缓冲区长度
+ * @param out_spilled 输出因超限丢弃的条数，可为NULL
+ * @return char* 以空字符结尾的缓冲区，调用方负责释放；没有离线帧时返回NULL
+ */
+char *offline_queue_login(const char *username, int tracking, size_t *out_len, int *out_spilled)
+{
+	size_t len = 0;
+	int resent = 0;
+	char *buffer = NULL;
+
+	if (out_len)
+		*out_len = 0;
+	if (out_spilled)
+		*out_spilled = 0;
+	if (!username || username[0] == '\0')
+		return NULL;
+
+	platform_mutex_lock(&offline_lock);
+	OfflineUser *user = tracking ? obtain_offline_user(username) : find_offline_user(username);
+	if (user)
+	{
+		user->tracking = tracking ? 1 : 0;
+		user->sent_id = 0;
+		buffer = collect_locked(user, &len, out_spilled, &resent);
+		release_if_idle(user);
+	}
+	platform_mutex_unlock(&offline_lock);
+
+	if (resent > 0)
+		metrics_add(STAT_DELIVERY_RESENT, (uint64_t)resent);
+	if (out_len)
+		*out_len = len;
+	return buffer;
+}
+
+/**
+ * @brief 获取本进程的投递序号纪元
+ *
+ * 投递序号只在本进程内有效，接受 ack 的登录响应带上纪元，客户端看到纪元变化时
+ * （服务器重启或交接给了新进程）清空已收序号的记录。
+ *
+ * @return uint32_t 纪元，取第一次调用时的时间（秒）
+ */
+uint32_t offline_queue_epoch(void)
+{
+	platform_mutex_lock(&offline_lock);
+	if (offline_epoch == 0)
+		offline_epoch = (uint32_t)time(NULL);
+	uint32_t epoch = offline_epoch;
+	platform_mutex_unlock(&offline_lock);
+	return epoch;
+}
+
+/**
+ * @brief 为跟踪确认的用户编号、保存并投递一帧
+ *
+ * 在锁内分配下一个投递序号，由 write 按序号写出帧，入队后调用 send 投递；
+ * 同一用户的帧按序号顺序交给 send。send 失败（用户不在线或登录尚未生效）时帧留在队列中，
+ * 由下一次取出（登录响应或登录生效后的补发）发出。
+ *
+ * @param username 接收者
+ * @param write 按序号写出帧，返回帧长度，0 表示失败；在锁内调用
+ * @param ctx write 的上下文
+ * @param send 投递帧，成功返回0；在锁内调用，不能再调用离线队列
+ * @param delivered 输出是否已交给 send 投递，可为NULL
+ * @return int 成功返回0，用户不跟踪确认返回1（调用方按普通离线消息处理），失败返回-1
+ */
+int offline_queue_push_tracked(const char *username, OfflineFrameWriter write, void *ctx,
+							   OfflineFrameSender send, int *delivered)
+{
+	char frame[MAX_RAW_MESSAGE_LEN];
+
+	if (delivered)
+		*delivered = 0;
+	if (!username || !write)
+		return -1;
+
+	platform_mutex_lock(&offline_lock);
+	OfflineUser *user = find_offline_user(username);
+	if (!user || !user->tracking)
+	{
+		platform_mutex_unlock(&offline_lock);
+		return 1;
+	}
+
+	uint32_t id = user->last_id + 1 == 0 ? 1 : user->last_id + 1;
+	size_t len = write(id, ctx, frame, sizeof(frame));
+	OfflineEntry *entry = len > 0 ? (OfflineEntry *)malloc(sizeof(OfflineEntry) + len) : NULL;
+	if (!entry)
+	{
+		platform_mutex_unlock(&offline_lock);
+		return -1;
+	}
+	memcpy(entry->data, frame, len);
+	entry->len = len;
+	entry->id = id;
+	user->last_id = id;
+	append_entry(user, entry);
+
+	int sent = send && send(username, entry->data, entry->len) == 0;
+	if (sent)
+		user->sent_id = id;
+	platform_mutex_unlock(&offline_lock);
+
+	if (delivered)
+		*delivered = sent;
+	metrics_add(STAT_DELIVERY_TRACKED, 1);
+	return 0;
+}
+
+/**
+ * @brief 处理累计送达确认，从队首删除序号不超过 upto 的帧
+ *
+ * @param username 确认的用户
+ * @param upto 客户端已收到的最大投递序号，超过已分配的序号时按已分配的处理
+ * @return int 删除的帧数
+ */
+int offline_queue_ack(const char *username, uint32_t upto)
+{
+	int trimmed = 0;
+
+	if (!username || upto == 0)
+		return 0;
+
+	platform_mutex_lock(&offline_lock);
+	OfflineUser *user = find_offline_user(username);
+	if (user && user->tracking)
+	{
+		if (upto > user->last_id)
+			upto = user->last_id;
+		while (user->head && user->head->id != 0 && user->head->id <= upto)
+		{
+			drop_head(user);
+			trimmed++;
+		}
+	}
+	platform_mutex_unlock(&offline_lock);
+
+	if (trimmed > 0)
+		metrics_add(STAT_DELIVERY_TRIMMED, (uint64_t)trimmed);
+	return trimmed;
+}
+
+/**
+ * @brief 获取用户等待投递的离线消息数
+ *
+ * 跟踪确认的用户包括已投递、尚未确认的帧。
+ *
+ * @param username 接收者
+ * @return int 条数
+ */
+int offline_queue_pending(const char *username)
+{
+	if (!username)
+		return 0;
+
+	platform_mutex_lock(&offline_lock);
+	OfflineUser *user = find_offline_user(username);
+	int count = user ? user->count : 0;
+	platform_mutex_unlock(&offline_lock);
+	return count;
+}
+
+/**
+ * @brief 获取所有离线队列占用的字节数
+ *
+ * @return size_t 字节数
+ */
+size_t offline_queue_bytes(void)
+{
+	platform_mutex_lock(&offline_lock);
+	size_t bytes = offline_bytes;
+	platform_mutex_unlock(&offline_lock);
+	return bytes;
+}
+
+/**
+ * @brief 释放全部离线队列
+ */
+void offline_queue_cleanup(void)
+{
+	platform_mutex_lock(&offline_lock);
+	while (global_oldest)
+	{
+		OfflineEntry *entry = global_oldest;
+		global_oldest = entry->next_global;
+		free(entry);
+	}
+	global_newest = NULL;
+	for (size_t i = 0; i < offline_users.cap; i++)
+		free(offline_users.slots[i].value);
+	hash_index_free(&offline_users);
+	offline_bytes = 0;
+	platform_mutex_unlock(&offline_lock);
+}
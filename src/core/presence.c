@@ -0,0 +1,532 @@
+/**
+ * @file presence.c
+ * @brief 在线状态通知的合并与扇出
+ *
+ * 用户的第一个连接认证成功时上线，最后一个已认证连接断开时下线（由 connection_manager.c
+ * 的全局用户目录判断）。状态变化不立即广播，而是记入待发表，同一用户在一个窗口内的
+ * 多次变化只保留净结果，窗口内上线又下线的用户不发通知。窗口结束时把所有净变化拼成
+ * 尽量少的 PRESENCE 帧（内容如 "+alice,-bob"），每帧只序列化一次，经共享帧发给本分片的
+ * 已认证用户，并给其他每个分片投递一封邮件。一波重连因此只产生每个窗口几个帧，
+ * 而不是每次登录向所有人广播一次。
+ *
+ * 默认每个已认证用户接收所有人的状态变化；PRESENCE 命令可以改为只关注指定的用户
+ * 或关闭通知。只关注部分用户的连接在扇出时从共享帧中筛出自己关注的条目，
+ * 没有任何此类订阅时扇出不查关注表。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core.h"
+
+/** 一个 PRESENCE 帧内容的最大字节数 */
+#define PRESENCE_DELTA_BYTES (MAX_CONTENT_LEN - 1)
+
+/**
+ * @brief 一个用户在当前窗口内的状态变化
+ */
+typedef struct PresenceDelta
+{
+	struct PresenceDelta *next;		/**< 按首次变化的顺序排列 */
+	char username[MAX_USERNAME_LEN]; /**< 用户名 */
+	int was_online;					/**< 窗口开始时的状态 */
+	int online;						/**< 最新状态 */
+} PresenceDelta;
+
+/**
+ * @brief 一个订阅者的关注设置，没有设置的用户接收所有人的状态
+ */
+typedef struct
+{
+	char username[MAX_USERNAME_LEN];				/**< 订阅者 */
+	int count;										/**< 关注的用户数，0 表示关闭通知 */
+	char names[PRESENCE_MAX_WATCH][MAX_USERNAME_LEN]; /**< 关注的用户 */
+} PresenceWatch;
+
+/** 合并窗口（毫秒），0 表示不发送状态通知 */
+static int window_ms = 0;
+
+/** 待发表、关注表和窗口截止时间，由同一把锁保护 */
+static platform_mutex_t presence_lock = PLATFORM_MUTEX_INITIALIZER;
+static HashIndex pending_index;
+static PresenceDelta *pending_head = NULL;
+static PresenceDelta *pending_tail = NULL;
+static uint64_t window_deadline = 0;
+static HashIndex watch_index;
+
+/** 待发表非空，定时器检查时先看它，无变化时不加锁 */
+static atomic_int pending_count = 0;
+
+/** 有关注设置的订阅者数，为0时扇出不查关注表 */
+static atomic_int watch_count = 0;
+
+static int match_delta(const void *value, const void *key)
+{
+	return strncmp(((const PresenceDelta *)value)->username, (const char *)key, MAX_USERNAME_LEN) == 0;
+}
+
+static int match_watch(const void *value, const void *key)
+{
+	return strncmp(((const PresenceWatch *)value)->username, (const char *)key, MAX_USERNAME_LEN) == 0;
+}
+
+static size_t name_hash(const char *username)
+{
+	return hash_index_hash_string(username, MAX_USERNAME_LEN);
+}
+
+/**
+ * @brief 设置合并窗口，在启动事件循环之前调用
+ *
+ * @param ms 窗口毫秒数，不大于0表示不发送状态通知
+ */
+void presence_set_window(int ms)
+{
+	window_ms = ms > 0 ? ms : 0;
+}
+
+/**
+ * @brief 获取合并窗口
+ *
+ * @return int 窗口毫秒数，0 表示未启用
+ */
+int presence_window(void)
+{
+	return window_ms;
+}
+
+/**
+ * @brief 删除订阅者的关注设置，调用方持有锁
+ */
+static void drop_watch(const char *username)
+{
+	PresenceWatch *watch = (PresenceWatch *)hash_index_remove(&watch_index, name_hash(username), username, match_watch);
+	if (watch)
+	{
+		free(watch);
+		atomic_fetch_sub(&watch_count, 1);
+	}
+}
+
+/**
+ * @brief 记录一次上线或下线
+ *
+ * 由连接管理器在用户目录中出现或删除用户时调用。窗口内第一次变化时开始计时，
+ * 之后同一用户的变化只更新最新状态。下线的用户同时清除其关注设置。
+ *
+ * @param username 用户名
+ * @param online 1-上线，0-下线
+ */
+void presence_note(const char *username, int online)
+{
+	if (window_ms == 0 || !username || username[0] == '\0')
+		return;
+
+	size_t h = name_hash(username);
+	platform_mutex_lock(&presence_lock);
+	if (!online)
+		drop_watch(username);
+
+	PresenceDelta *delta = (PresenceDelta *)hash_index_find(&pending_index, h, username, match_delta);
+	if (delta)
+	{
+		delta->online = online;
+		platform_mutex_unlock(&presence_lock);
+		return;
+	}
+
+	delta = (PresenceDelta *)malloc(sizeof(PresenceDelta));
+	if (delta && hash_index_insert(&pending_index, h, delta) != 0)
+	{
+		free(delta);
+		delta = NULL;
+	}
+	if (!delta)
+	{
+		platform_mutex_unlock(&presence_lock);
+		LOG_WARN("Dropped presence change of %s: out of memory", username);
+		return;
+	}
+
+	safe_strcpy(delta->username, username, sizeof(delta->username));
+	delta->was_online = !online;
+	delta->online = online;
+	delta->next = NULL;
+	if (pending_tail)
+		pending_tail->next = delta;
+	else
+		pending_head = delta;
+	pending_tail = delta;
+	if (atomic_fetch_add(&pending_count, 1) == 0)
+		window_deadline = platform_monotonic_ms() + (uint64_t)window_ms;
+	platform_mutex_unlock(&presence_lock);
+}
+
+/**
+ * @brief 取出 PRESENCE 帧的内容部分
+ *
+ * @param frame 文本帧
+ * @param len 输出内容的字节数（不含换行）
+ * @return const char* 内容起始位置，格式不符返回NULL
+ */
+static const char *frame_content(const SharedFrame *frame, size_t *len)
+{
+	const char *p = frame->data;
+	const char *end = frame->data + frame->len;
+
+	for (int fields = 0; fields < 4; fields++)
+	{
+		p = (const char *)memchr(p, '|', (size_t)(end - p));
+		if (!p)
+			return NULL;
+		p++;
+	}
+	*len = (size_t)(end - p);
+	while (*len > 0 && (p[*len - 1] == '\n' || p[*len - 1] == '\r'))
+		(*len)--;
+	return p;
+}
+
+/**
+ * @brief 检查用户是否在关注列表中
+ */
+static int is_watched(const PresenceWatch *watch, const char *name, size_t len)
+{
+	for (int i = 0; i < watch->count; i++)
+	{
+		if (strlen(watch->names[i]) == len && memcmp(watch->names[i], name, len) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief 按关注列表从共享帧中筛出条目，单独发给一个订阅者
+ */
+static void send_filtered(Client *c, const PresenceWatch *watch, const SharedFrame *frame)
+{
+	char content[PRESENCE_DELTA_BYTES + 1];
+	size_t used = 0;
+	size_t len = 0;
+	const char *p = frame_content(frame, &len);
+
+	if (!p || watch->count == 0)
+		return;
+
+	const char *end = p + len;
+	while (p < end)
+	{
+		const char *sep = (const char *)memchr(p, ',', (size_t)(end - p));
+		size_t item_len = (size_t)((sep ? sep : end) - p);
+		if (item_len > 1 && is_watched(watch, p + 1, item_len - 1) && used + item_len + 1 <= PRESENCE_DELTA_BYTES)
+		{
+			if (used > 0)
+				content[used++] = ',';
+			memcpy(content + used, p, item_len);
+			used += item_len;
+		}
+		p = sep ? sep + 1 : end;
+	}
+	if (used == 0)
+		return;
+	content[used] = '\0';
+
+	char *text = build_presence_msg(content);
+	SharedFrame *filtered = text ? shared_frame_create(text, strlen(text)) : NULL;
+	build_free(text);
+	if (filtered)
+	{
+		connection_manager_send_frame(c, filtered);
+		shared_frame_release(filtered);
+	}
+}
+
+/**
+ * @brief 扇出的遍历上下文
+ */
+typedef struct
+{
+	SharedFrame *frame; /**< 状态变化帧 */
+	int filtered;		/**< 遍历前有关注设置，已持有锁 */
+} PresenceFanout;
+
+/**
+ * @brief 扇出回调：按订阅者的关注设置发送共享帧或筛选后的帧
+ */
+static int deliver_presence(Client *c, void *ctx)
+{
+	PresenceFanout *fanout = (PresenceFanout *)ctx;
+
+	if (c->status != CLIENT_STATUS_AUTHENTICATED)
+		return 0;
+	if (fanout->filtered)
+	{
+		PresenceWatch *watch = (PresenceWatch *)hash_index_find(&watch_index, name_hash(c->username), c->username, match_watch);
+		if (watch)
+		{
+			send_filtered(c, watch, fanout->frame);
+			return 0;
+		}
+	}
+	connection_manager_send_frame(c, fanout->frame);
+	return 0;
+}
+
+/**
+ * @brief 把 PRESENCE 帧发给当前分片上的已认证用户
+ *
+ * 由发出通知的线程和收到 MAIL_PRESENCE 邮件的分片线程调用。
+ * 有关注设置时在锁内遍历，扇出期间关注表不会被修改；没有时不加锁。
+ *
+ * @param frame 状态变化帧，调用方保留自己的引用
+ */
+void presence_deliver(SharedFrame *frame)
+{
+	PresenceFanout fanout;
+
+	if (!frame)
+		return;
+
+	fanout.frame = frame;
+	fanout.filtered = atomic_load(&watch_count) > 0;
+	if (fanout.filtered)
+		platform_mutex_lock(&presence_lock);
+	connection_manager_foreach_online(deliver_presence, &fanout);
+	if (fanout.filtered)
+		platform_mutex_unlock(&presence_lock);
+}
+
+/**
+ * @brief 构建一个 PRESENCE 帧并扇出到所有分片
+ */
+static void broadcast_delta(const char *content)
+{
+	char *text = build_presence_msg(content);
+	SharedFrame *frame = text ? shared_frame_create(text, strlen(text)) : NULL;
+	build_free(text);
+	if (!frame)
+	{
+		LOG_WARN("Failed to build presence frame");
+		return;
+	}
+
+	presence_deliver(frame);
+	connection_manager_post_presence(frame);
+	shared_frame_release(frame);
+	metrics_add(STAT_PRESENCE_FRAMES, 1);
+}
+
+/**
+ * @brief 窗口结束时发出合并后的状态变化
+ *
+ * 由各事件循环的定时器周期调用，第一个发现窗口已结束的线程取走整张待发表，
+ * 按内容长度上限拼成若干帧发出。净结果没有变化的用户不出现在帧中。
+ *
+ * @param now_ms 当前单调时钟毫秒数
+ * @return int 发出的状态变化数，窗口未结束或没有变化返回0
+ */
+int presence_flush(uint64_t now_ms)
+{
+	if (atomic_load(&pending_count) == 0)
+		return 0;
+
+	platform_mutex_lock(&presence_lock);
+	if (!pending_head || now_ms < window_deadline)
+	{
+		platform_mutex_unlock(&presence_lock);
+		return 0;
+	}
+	PresenceDelta *list = pending_head;
+	pending_head = pending_tail = NULL;
+	hash_index_free(&pending_index);
+	atomic_store(&pending_count, 0);
+	platform_mutex_unlock(&presence_lock);
+
+	char content[PRESENCE_DELTA_BYTES + 1];
+	size_t used = 0;
+	int changes = 0;
+	int coalesced = 0;
+	while (list)
+	{
+		PresenceDelta *delta = list;
+		list = list->next;
+		if (delta->online == delta->was_online)
+		{
+			coalesced++;
+			free(delta);
+			continue;
+		}
+
+		size_t item_len = strlen(delta->username) + 1;
+		if (used > 0 && used + 1 + item_len > PRESENCE_DELTA_BYTES)
+		{
+			content[used] = '\0';
+			broadcast_delta(content);
+			used = 0;
+		}
+		if (used > 0)
+			content[used++] = ',';
+		content[used++] = delta->online ? '+' : '-';
+		memcpy(content + used, delta->username, item_len - 1);
+		used += item_len - 1;
+		changes++;
+		free(delta);
+	}
+	if (used > 0)
+	{
+		content[used] = '\0';
+		broadcast_delta(content);
+	}
+
+	metrics_add(STAT_PRESENCE_CHANGES, (uint64_t)changes);
+	LOG_DEBUG("Presence window closed: %d changes, %d coalesced away", changes, coalesced);
+	return changes;
+}
+
+/**
+ * @brief 设置订阅者关注的用户
+ *
+ * spec 为 "*" 时接收所有人的状态（默认），为 "-" 时关闭通知，
+ * 否则为以逗号或空格分隔的用户名列表，最多 PRESENCE_MAX_WATCH 个。
+ *
+ * @param subscriber 订阅者用户名
+ * @param spec 关注设置
+ * @return int 成功返回关注的用户数（"*" 和 "-" 返回0），设置无效返回-1
+ */
+int presence_watch(const char *subscriber, const char *spec)
+{
+	PresenceWatch parsed;
+
+	if (!subscriber || subscriber[0] == '\0' || !spec)
+		return -1;
+
+	while (*spec == ' ')
+		spec++;
+	if (strcmp(spec, "*") == 0)
+	{
+		platform_mutex_lock(&presence_lock);
+		drop_watch(subscriber);
+		platform_mutex_unlock(&presence_lock);
+		return 0;
+	}
+
+	memset(&parsed, 0, sizeof(parsed));
+	safe_strcpy(parsed.username, subscriber, sizeof(parsed.username));
+	if (strcmp(spec, "-") != 0)
+	{
+		const char *p = spec;
+		while (*p)
+		{
+			size_t len = strcspn(p, ", ");
+			if (len > 0)
+			{
+				if (len >= MAX_USERNAME_LEN || parsed.count >= PRESENCE_MAX_WATCH)
+					return -1;
+				memcpy(parsed.names[parsed.count], p, len);
+				parsed.names[parsed.count][len] = '\0';
+				if (!is_valid_username(parsed.names[parsed.count]))
+					return -1;
+				if (!is_watched(&parsed, p, len))
+					parsed.count++;
+			}
+			p += len;
+			if (*p)
+				p++;
+		}
+		if (parsed.count == 0)
+			return -1;
+	}
+
+	size_t h = name_hash(subscriber);
+	platform_mutex_lock(&presence_lock);
+	PresenceWatch *watch = (PresenceWatch *)hash_index_find(&watch_index, h, subscriber, match_watch);
+	if (!watch)
+	{
+		watch = (PresenceWatch *)malloc(sizeof(PresenceWatch));
+		if (watch && hash_index_insert(&watch_index, h, watch) != 0)
+		{
+			free(watch);
+			watch = NULL;
+		}
+		if (!watch)
+		{
+			platform_mutex_unlock(&presence_lock);
+			return -1;
+		}
+		atomic_fetch_add(&watch_count, 1);
+	}
+	*watch = parsed;
+	platform_mutex_unlock(&presence_lock);
+	return parsed.count;
+}
+
+/**
+ * @brief 列出订阅者关注的用户中当前在线的用户，格式与 PRESENCE 帧内容相同
+ *
+ * 订阅者设置关注列表后用它补发一次当前状态。
+ *
+ * @param subscriber 订阅者用户名
+ * @param out 输出缓冲区，如 "+alice,+bob"
+ * @param cap 缓冲区大小
+ * @return int 在线的关注用户数，订阅者没有关注列表返回0
+ */
+int presence_snapshot(const char *subscriber, char *out, size_t cap)
+{
+	PresenceWatch watch;
+	size_t used = 0;
+	int online = 0;
+
+	if (!out || cap == 0)
+		return 0;
+	out[0] = '\0';
+	if (!subscriber)
+		return 0;
+
+	platform_mutex_lock(&presence_lock);
+	PresenceWatch *found = (PresenceWatch *)hash_index_find(&watch_index, name_hash(subscriber), subscriber, match_watch);
+	if (found)
+		watch = *found;
+	platform_mutex_unlock(&presence_lock);
+	if (!found)
+		return 0;
+
+	for (int i = 0; i < watch.count; i++)
+	{
+		size_t len = strlen(watch.names[i]);
+		if (!connection_manager_is_online(watch.names[i]) || used + len + 2 >= cap)
+			continue;
+		if (used > 0)
+			out[used++] = ',';
+		out[used++] = '+';
+		memcpy(out + used, watch.names[i], len + 1);
+		used += len;
+		online++;
+	}
+	return online;
+}
+
+/**
+ * @brief 丢弃未发出的状态变化并清空关注表
+ */
+void presence_cleanup(void)
+{
+	platform_mutex_lock(&presence_lock);
+	while (pending_head)
+	{
+		PresenceDelta *next = pending_head->next;
+		free(pending_head);
+		pending_head = next;
+	}
+	pending_tail = NULL;
+	hash_index_free(&pending_index);
+	atomic_store(&pending_count, 0);
+
+	for (size_t i = 0; i < watch_index.cap; i++)
+		free(watch_index.slots[i].value);
+	hash_index_free(&watch_index);
+	atomic_store(&watch_count, 0);
+	platform_mutex_unlock(&presence_lock);
+}
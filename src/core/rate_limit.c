@@ -0,0 +1,185 @@
+/**
+ * @file rate_limit.c
+ * @brief 按连接和按用户的令牌桶限流
+ *
+ * 每个连接在 Client 中带有消息、广播、字节三个令牌桶，只由所属 reactor 线程访问，不加锁。
+ * 已认证的连接还要扣同一用户的令牌桶，同一用户的多个连接（可能在不同分片上）共用，
+ * 按用户名分条加锁，避免开多个连接绕过限制。
+ *
+ * 命令帧超限时被拒绝；字节在读入后才能计数，超限时透支并暂停读取，
+ * 由 TCP 流控把压力推回发送方。
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "core.h"
+
+#define RATE_LIMIT_BURST_SECONDS 2 /* 桶容量为这么多秒的额度 */
+#define RATE_LIMIT_STRIPES 16	   /* 用户令牌桶表的分条数 */
+
+/**
+ * @brief 一个用户所有连接共用的令牌桶
+ */
+typedef struct
+{
+	char username[MAX_USERNAME_LEN];
+	TokenBucket rate[RATE_LIMIT_KINDS];
+} UserBuckets;
+
+/**
+ * @brief 用户令牌桶表的一条，用户名哈希决定所在的条
+ */
+typedef struct
+{
+	platform_mutex_t lock;
+	HashIndex index;
+} UserStripe;
+
+static RateLimitConfig limits;
+static UserStripe stripes[RATE_LIMIT_STRIPES];
+static int stripes_ready = 0;
+
+static uint32_t burst_of(uint32_t rate)
+{
+	return rate * RATE_LIMIT_BURST_SECONDS;
+}
+
+static int match_user(const void *value, const void *key)
+{
+	return strcmp(((const UserBuckets *)value)->username, (const char *)key) == 0;
+}
+
+/**
+ * @brief 设置限流额度
+ *
+ * 在 reactor 线程启动前调用。
+ *
+ * @param config 限流配置，全为0时不限流
+ */
+void rate_limit_configure(const RateLimitConfig *config)
+{
+	if (!stripes_ready)
+	{
+		for (int i = 0; i < RATE_LIMIT_STRIPES; i++)
+			platform_mutex_init(&stripes[i].lock);
+		stripes_ready = 1;
+	}
+	if (config)
+		limits = *config;
+	else
+		memset(&limits, 0, sizeof(limits));
+}
+
+/**
+ * @brief 判断是否启用了任何限流
+ */
+int rate_limit_enabled(void)
+{
+	for (int i = 0; i < RATE_LIMIT_KINDS; i++)
+	{
+		if (limits.rate[i] > 0)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief 在用户令牌桶上取走或扣除令牌
+ *
+ * @param charge 非0时透支扣除并返回还清的毫秒数，否则取走并返回是否取到
+ */
+static uint64_t user_bucket(const char *username, RateLimitKind kind, uint64_t cost, int charge, uint64_t now_ms)
+{
+	uint32_t rate = limits.rate[kind] * limits.user_factor;
+	size_t hash = hash_index_hash_string(username, MAX_USERNAME_LEN);
+	UserStripe *stripe = &stripes[hash % RATE_LIMIT_STRIPES];
+	uint64_t result = charge ? 0 : 1;
+
+	platform_mutex_lock(&stripe->lock);
+	UserBuckets *user = (UserBuckets *)hash_index_find(&stripe->index, hash, username, match_user);
+	if (!user)
+	{
+		user = (UserBuckets *)calloc(1, sizeof(UserBuckets));
+		if (user)
+		{
+			safe_strcpy(user->username, username, sizeof(user->username));
+			if (hash_index_insert(&stripe->index, hash, user) != 0)
+			{
+				free(user);
+				user = NULL;
+			}
+		}
+	}
+	if (user)
+		result = charge ? token_bucket_charge(&user->rate[kind], rate, burst_of(rate), cost, now_ms)
+						: (uint64_t)token_bucket_take(&user->rate[kind], rate, burst_of(rate), (uint32_t)cost, now_ms);
+	platform_mutex_unlock(&stripe->lock);
+	return result;
+}
+
+/**
+ * @brief 判断一帧命令能否放行并扣除额度
+ *
+ * 广播扣广播额度，其余命令扣消息额度。先扣连接自己的桶（不加锁），
+ * 已认证时再扣用户的桶；用户超限时连接已扣的令牌不退还，该用户此时本就超限。
+ * 送达确认不扣额度：它的数量受收到的消息数约束，拒绝只会让消息在重新登录时重发，字节仍计入字节额度。
+ *
+ * @param c 发来命令的连接
+ * @param type 命令类型
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ * @return 放行返回0，超限返回-1
+ */
+int rate_limit_admit(Client *c, CommandType type, uint64_t now_ms)
+{
+	RateLimitKind kind = type == CMD_BROADCAST ? RATE_BROADCASTS : RATE_MESSAGES;
+	uint32_t rate = limits.rate[kind];
+
+	if (rate == 0 || type == CMD_ACK)
+		return 0;
+	if (!token_bucket_take(&c->rate[kind], rate, burst_of(rate), 1, now_ms))
+		return -1;
+	if (c->username[0] && limits.user_factor > 0 && !user_bucket(c->username, kind, 1, 0, now_ms))
+		return -1;
+	return 0;
+}
+
+/**
+ * @brief 扣除已读入的字节
+ *
+ * @param c 读入数据的连接
+ * @param bytes 读入的字节数
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ * @return 连接或用户还清透支前应暂停读取的毫秒数，0 表示不用暂停
+ */
+uint64_t rate_limit_charge_bytes(Client *c, size_t bytes, uint64_t now_ms)
+{
+	uint32_t rate = limits.rate[RATE_BYTES];
+
+	if (rate == 0)
+		return 0;
+	uint64_t wait = token_bucket_charge(&c->rate[RATE_BYTES], rate, burst_of(rate), bytes, now_ms);
+	if (c->username[0] && limits.user_factor > 0)
+	{
+		uint64_t user_wait = user_bucket(c->username, RATE_BYTES, bytes, 1, now_ms);
+		if (user_wait > wait)
+			wait = user_wait;
+	}
+	return wait;
+}
+
+/**
+ * @brief 释放全部用户令牌桶
+ */
+void rate_limit_cleanup(void)
+{
+	if (!stripes_ready)
+		return;
+	for (int i = 0; i < RATE_LIMIT_STRIPES; i++)
+	{
+		platform_mutex_lock(&stripes[i].lock);
+		for (size_t j = 0; j < stripes[i].index.cap; j++)
+			free(stripes[i].index.slots[j].value);
+		hash_index_free(&stripes[i].index);
+		platform_mutex_unlock(&stripes[i].lock);
+	}
+}
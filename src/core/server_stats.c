@@ -0,0 +1,265 @@
+/**
+ * @file server_stats.c
+ * @brief 服务器运行指标
+ *
+ * 在通用指标登记（utils/metrics.c）上定义服务器的计数器和每种命令的耗时直方图，
+ * 并把它们整理成 STATUS 响应的文本行和 Prometheus 抓取文本。
+ * 直方图编号就是命令类型的取值，记录点只需要一次数组下标访问。
+ *
+ * 计数器和直方图都按线程分块，reactor 和工作线程记录时不加锁；
+ * 读取时合并所有线程，STATUS 和抓取看到的是近似的瞬时值。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "core.h"
+#include "../storage/storage.h"
+
+/** 导出指标名的前缀 */
+#define SERVER_STATS_PREFIX "titi"
+
+/**
+ * @brief 每种命令在 STATUS 中的名称和导出时的标签
+ */
+static const struct
+{
+	const char *name;
+	const char *label;
+} command_series[] = {
+	[CMD_UNKNOWN] = {"UNKNOWN", "command=\"UNKNOWN\""},
+	[CMD_LOGIN] = {"LOGIN", "command=\"LOGIN\""},
+	[CMD_LOGOUT] = {"LOGOUT", "command=\"LOGOUT\""},
+	[CMD_SEND_MSG] = {"MSG", "command=\"MSG\""},
+	[CMD_BROADCAST] = {"BROADCAST", "command=\"BROADCAST\""},
+	[CMD_JOIN_GROUP] = {"JOIN", "command=\"JOIN\""},
+	[CMD_LEAVE_GROUP] = {"LEAVE", "command=\"LEAVE\""},
+	[CMD_GET_HISTORY] = {"HISTORY", "command=\"HISTORY\""},
+	[CMD_GET_STATUS] = {"STATUS", "command=\"STATUS\""},
+	[CMD_RESPONSE_OK] = {"OK", "command=\"OK\""},
+	[CMD_RESPONSE_ERROR] = {"ERROR", "command=\"ERROR\""},
+	[CMD_PRESENCE] = {"PRESENCE", "command=\"PRESENCE\""},
+	[CMD_ACK] = {"ACK", "command=\"ACK\""},
+	[CMD_RESUME] = {"RESUME", "command=\"RESUME\""},
+};
+
+#define COMMAND_SERIES_COUNT ((int)(sizeof(command_series) / sizeof(command_series[0])))
+
+static time_t started_at = 0;
+
+/**
+ * @brief 初始化服务器指标，记录启动时间并定义指标名称
+ *
+ * 在启动任何 reactor 和工作线程之前调用。
+ */
+void server_stats_init(void)
+{
+	started_at = time(NULL);
+
+	metrics_define_counter(STAT_BYTES_IN, "bytes_in");
+	metrics_define_counter(STAT_BYTES_OUT, "bytes_out");
+	metrics_define_counter(STAT_SEND_FAILURES, "send_failures");
+	metrics_define_counter(STAT_PARSE_ERRORS, "parse_errors");
+	metrics_define_counter(STAT_CONNECTIONS_ACCEPTED, "connections_accepted");
+	metrics_define_counter(STAT_CONNECTIONS_CLOSED, "connections_closed");
+	metrics_define_counter(STAT_IDLE_TIMEOUTS, "idle_timeouts");
+	metrics_define_counter(STAT_AUTH_QUEUED, "auth_queued");
+	metrics_define_counter(STAT_AUTH_BUSY, "auth_busy");
+	metrics_define_counter(STAT_PRESENCE_CHANGES, "presence_changes");
+	metrics_define_counter(STAT_PRESENCE_FRAMES, "presence_frames");
+	metrics_define_counter(STAT_CLUSTER_SENT, "cluster_records_sent");
+	metrics_define_counter(STAT_CLUSTER_BATCHES, "cluster_batches");
+	metrics_define_counter(STAT_CLUSTER_RECEIVED, "cluster_records_received");
+	metrics_define_counter(STAT_CLUSTER_DROPPED, "cluster_records_dropped");
+	metrics_define_counter(STAT_RATE_REJECTED, "rate_limited_commands");
+	metrics_define_counter(STAT_RATE_THROTTLED, "rate_limited_reads");
+	metrics_define_counter(STAT_DELIVERY_TRACKED, "delivery_tracked");
+	metrics_define_counter(STAT_DELIVERY_ACKS, "delivery_acks");
+	metrics_define_counter(STAT_DELIVERY_TRIMMED, "delivery_acked");
+	metrics_define_counter(STAT_DELIVERY_RESENT, "delivery_resent");
+	metrics_define_counter(STAT_SESSION_RESUMED, "sessions_resumed");
+	metrics_define_counter(STAT_SESSION_REJECTED, "session_resumes_rejected");
+	metrics_define_counter(STAT_SESSION_PARKED, "sessions_parked");
+	metrics_define_counter(STAT_SESSION_EXPIRED, "sessions_expired");
+
+	for (int i = 0; i < COMMAND_SERIES_COUNT; i++)
+		metrics_define_histogram(i, "command_latency_us", command_series[i].label);
+}
+
+/**
+ * @brief 记录一条命令的处理耗时
+ *
+ * @param type 命令类型
+ * @param elapsed_us 耗时（微秒）
+ */
+void server_stats_record_command(CommandType type, uint64_t elapsed_us)
+{
+	if ((int)type < 0 || (int)type >= COMMAND_SERIES_COUNT)
+		type = CMD_UNKNOWN;
+	metrics_record((int)type, elapsed_us);
+}
+
+/**
+ * @brief 获取服务器已运行的秒数
+ *
+ * @return long 秒数，未初始化时返回0
+ */
+long server_stats_uptime(void)
+{
+	if (started_at == 0)
+		return 0;
+	return (long)(time(NULL) - started_at);
+}
+
+/**
+ * @brief 向缓冲区追加一行，空间不足时丢弃该行
+ */
+static void append_line(char *buf, size_t cap, size_t *used, const char *format, ...)
+{
+	va_list args;
+
+	if (*used >= cap)
+		return;
+
+	va_start(args, format);
+	int n = vsnprintf(buf + *used, cap - *used, format, args);
+	va_end(args);
+
+	if (n < 0 || (size_t)n >= cap - *used)
+	{
+		buf[*used] = '\0';
+		return;
+	}
+	*used += (size_t)n;
+}
+
+/**
+ * @brief 生成 STATUS 响应中的运行指标行
+ *
+ * 每行以换行结尾：运行时间、命令数和平均速率、收发字节数、错误计数、登录的分流情况、在线状态通知的合并情况、
+ * 送达确认的编号、确认和重发计数（有编号投递时）、会话恢复和断线保留计数（启用时）、集群链路的收发计数（集群模式下），以及每种处理过的命令的调用数和 p50/p99/最大耗时。
+ *
+ * @param buf 输出缓冲区
+ * @param cap 缓冲区大小
+ * @return size_t 写入的字节数
+ */
+size_t server_stats_format_status(char *buf, size_t cap)
+{
+	size_t used = 0;
+	uint64_t commands = 0;
+	MetricsSummary summaries[COMMAND_SERIES_COUNT];
+
+	if (!buf || cap == 0)
+		return 0;
+	buf[0] = '\0';
+
+	for (int i = 0; i < COMMAND_SERIES_COUNT; i++)
+	{
+		metrics_histogram(i, &summaries[i]);
+		commands += summaries[i].count;
+	}
+
+	long uptime = server_stats_uptime();
+	append_line(buf, cap, &used, "- Uptime: %ldd %02ld:%02ld:%02ld\n",
+				uptime / 86400, uptime / 3600 % 24, uptime / 60 % 60, uptime % 60);
+	append_line(buf, cap, &used, "- Commands: %llu (%.1f/s average)\n",
+				(unsigned long long)commands, uptime > 0 ? (double)commands / (double)uptime : (double)commands);
+	append_line(buf, cap, &used, "- Traffic: %llu bytes in, %llu bytes out\n",
+				(unsigned long long)metrics_counter(STAT_BYTES_IN),
+				(unsigned long long)metrics_counter(STAT_BYTES_OUT));
+	append_line(buf, cap, &used, "- Connections: %llu accepted, %llu closed, %llu idle timeouts\n",
+				(unsigned long long)metrics_counter(STAT_CONNECTIONS_ACCEPTED),
+				(unsigned long long)metrics_counter(STAT_CONNECTIONS_CLOSED),
+				(unsigned long long)metrics_counter(STAT_IDLE_TIMEOUTS));
+	append_line(buf, cap, &used, "- Errors: %llu send failures, %llu parse errors\n",
+				(unsigned long long)metrics_counter(STAT_SEND_FAILURES),
+				(unsigned long long)metrics_counter(STAT_PARSE_ERRORS));
+	append_line(buf, cap, &used, "- Logins: %llu on auth threads, %llu rejected busy, %zu credential cache hits\n",
+				(unsigned long long)metrics_counter(STAT_AUTH_QUEUED),
+				(unsigned long long)metrics_counter(STAT_AUTH_BUSY),
+				user_store_credential_cache_hits());
+	append_line(buf, cap, &used, "- Presence: %llu changes in %llu frames\n",
+				(unsigned long long)metrics_counter(STAT_PRESENCE_CHANGES),
+				(unsigned long long)metrics_counter(STAT_PRESENCE_FRAMES));
+	if (metrics_counter(STAT_DELIVERY_TRACKED) > 0)
+		append_line(buf, cap, &used, "- Delivery acks: %llu tracked messages, %llu acked in %llu ACK frames, %llu resent\n",
+					(unsigned long long)metrics_counter(STAT_DELIVERY_TRACKED),
+					(unsigned long long)metrics_counter(STAT_DELIVERY_TRIMMED),
+					(unsigned long long)metrics_counter(STAT_DELIVERY_ACKS),
+					(unsigned long long)metrics_counter(STAT_DELIVERY_RESENT));
+	if (session_resume_grace() > 0)
+		append_line(buf, cap, &used, "- Session resume: %llu resumed, %llu rejected, %llu parked, %llu expired, %d in grace\n",
+					(unsigned long long)metrics_counter(STAT_SESSION_RESUMED),
+					(unsigned long long)metrics_counter(STAT_SESSION_REJECTED),
+					(unsigned long long)metrics_counter(STAT_SESSION_PARKED),
+					(unsigned long long)metrics_counter(STAT_SESSION_EXPIRED),
+					session_resume_parked());
+	if (rate_limit_enabled())
+		append_line(buf, cap, &used, "- Rate limits: %llu commands rejected, %llu reads paused\n",
+					(unsigned long long)metrics_counter(STAT_RATE_REJECTED),
+					(unsigned long long)metrics_counter(STAT_RATE_THROTTLED));
+	if (cluster_enabled())
+	{
+		int nodes;
+		int self = cluster_self(&nodes);
+		append_line(buf, cap, &used, "- Cluster: node %d of %d, %d links up, %llu records out in %llu batches, %llu in, %llu dropped\n",
+					self, nodes, cluster_links_up(),
+					(unsigned long long)metrics_counter(STAT_CLUSTER_SENT),
+					(unsigned long long)metrics_counter(STAT_CLUSTER_BATCHES),
+					(unsigned long long)metrics_counter(STAT_CLUSTER_RECEIVED),
+					(unsigned long long)metrics_counter(STAT_CLUSTER_DROPPED));
+	}
+
+	for (int i = 0; i < COMMAND_SERIES_COUNT; i++)
+	{
+		if (summaries[i].count == 0)
+			continue;
+		append_line(buf, cap, &used, "- %s: %llu calls, p50 %lluus, p99 %lluus, max %lluus\n",
+					command_series[i].name,
+					(unsigned long long)summaries[i].count,
+					(unsigned long long)summaries[i].p50,
+					(unsigned long long)summaries[i].p99,
+					(unsigned long long)summaries[i].max);
+	}
+	return used;
+}
+
+/**
+ * @brief 生成 Prometheus 文本格式的抓取结果
+ *
+ * 先输出连接数、在线用户数等瞬时值（gauge），再输出所有计数器和命令耗时。
+ *
+ * @param buf 输出缓冲区
+ * @param cap 缓冲区大小
+ * @return size_t 写入的字节数
+ */
+size_t server_stats_scrape(char *buf, size_t cap)
+{
+	size_t used = 0;
+	size_t client_peak = 0;
+
+	if (!buf || cap == 0)
+		return 0;
+	buf[0] = '\0';
+
+	size_t pooled_clients = connection_manager_pool_usage(&client_peak);
+	append_line(buf, cap, &used, "# TYPE " SERVER_STATS_PREFIX "_uptime_seconds gauge\n" SERVER_STATS_PREFIX "_uptime_seconds %ld\n",
+				server_stats_uptime());
+	append_line(buf, cap, &used, "# TYPE " SERVER_STATS_PREFIX "_connections gauge\n" SERVER_STATS_PREFIX "_connections %d\n",
+				connection_manager_total_count());
+	append_line(buf, cap, &used, "# TYPE " SERVER_STATS_PREFIX "_online_users gauge\n" SERVER_STATS_PREFIX "_online_users %d\n",
+				connection_manager_online_count());
+	append_line(buf, cap, &used, "# TYPE " SERVER_STATS_PREFIX "_registered_users gauge\n" SERVER_STATS_PREFIX "_registered_users %d\n",
+				user_store_count());
+	append_line(buf, cap, &used, "# TYPE " SERVER_STATS_PREFIX "_client_objects gauge\n" SERVER_STATS_PREFIX "_client_objects %zu\n",
+				pooled_clients);
+	append_line(buf, cap, &used, "# TYPE " SERVER_STATS_PREFIX "_offline_queue_bytes gauge\n" SERVER_STATS_PREFIX "_offline_queue_bytes %zu\n",
+				offline_queue_bytes());
+	append_line(buf, cap, &used, "# TYPE " SERVER_STATS_PREFIX "_credential_cache_hits_total counter\n" SERVER_STATS_PREFIX "_credential_cache_hits_total %zu\n",
+				user_store_credential_cache_hits());
+
+	return used + metrics_format(buf + used, cap - used, SERVER_STATS_PREFIX);
+}
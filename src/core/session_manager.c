@@ -11,6 +11,7 @@
  * 1. 用户认证与登出
  * 2. 会话状态管理
  * 3. 在线用户查询
+ * 4. 凭恢复令牌恢复断线的会话
  */
 
 #include <stdio.h>
@@ -86,12 +87,57 @@ int session_manager_authenticate(socket_t fd, const char *username, const char *
 	if (response)
 	{
 		// TODO: 这里需要发送给客户端
-		free(response);
+		build_free(response);
 	}
 
 	return 1;
 }
 
+/**
+ * @brief 凭恢复令牌恢复会话
+ *
+ * 断线重连的客户端出示登录时收到的恢复令牌，令牌有效时直接按令牌记下的用户ID
+ * 设置认证信息，不验证口令也不查用户库。令牌用后作废，成功后由调用方签发新令牌。
+ *
+ * @param fd 客户端的文件描述符
+ * @param username 用户名
+ * @param token 十六进制的恢复令牌
+ * @return int 恢复成功返回1，令牌无效、已过期或连接已认证返回0
+ */
+int session_manager_resume(socket_t fd, const char *username, const char *token)
+{
+	int user_id = -1;
+
+	if (!username || !token)
+		return 0;
+
+	Client *client = connection_manager_find_by_fd(fd);
+	if (!client)
+	{
+		LOG_ERROR("Client not found for fd=%lld", SOCKET_ID(fd));
+		return 0;
+	}
+
+	// 已认证的连接不能再换成其他会话
+	if (client->status == CLIENT_STATUS_AUTHENTICATED)
+	{
+		LOG_WARN("Client already authenticated: fd=%lld, username=%s", SOCKET_ID(fd), client->username);
+		return 0;
+	}
+
+	if (session_resume_claim(username, token, &user_id) != 0)
+	{
+		LOG_WARN("Session resume rejected for user: %s", username);
+		metrics_add(STAT_SESSION_REJECTED, 1);
+		return 0;
+	}
+
+	connection_manager_set_auth(fd, user_id, username);
+	metrics_add(STAT_SESSION_RESUMED, 1);
+	LOG_INFO("Session resumed: %s (fd=%lld)", username, SOCKET_ID(fd));
+	return 1;
+}
+
 /**
  * @brief 用户登出
  *
@@ -121,17 +167,18 @@ void session_manager_logout(socket_t fd)
 
 	LOG_INFO("User logging out: %s (fd=%lld)", client->username, SOCKET_ID(fd));
 
-	// 重置客户端状态
-	client->user_id = -1;
-	memset(client->username, 0, sizeof(client->username));
-	client->status = CLIENT_STATUS_CONNECTED;
+	// 显式登出的用户不再保留会话，最后一个连接断开时立即通知下线
+	session_resume_revoke(client->username);
+
+	// 重置客户端状态（同时移出用户名索引）
+	connection_manager_clear_auth(fd);
 
 	// 发送登出响应
 	char *response = build_success_msg("Logout successful");
 	if (response)
 	{
 		// TODO: 这里需要发送给客户端
-		free(response);
+		build_free(response);
 	}
 }
 
@@ -192,7 +239,7 @@ const char *session_manager_get_username(socket_t fd)
 /**
  * @brief 检查用户名是否在线
  *
- * 检查指定用户名对应的客户端是否在线且已认证。
+ * 检查指定用户名对应的客户端是否在线且已认证，包括其他 reactor 分片上的连接。
  *
  * @param username 要检查的用户名
  * @return int 在线返回1，不在线或用户不存在返回0
@@ -203,18 +250,21 @@ int session_manager_is_user_online(const char *username)
 		return 0;
 
 	Client *client = connection_manager_find_by_username(username);
-	return (client != NULL && client->status == CLIENT_STATUS_AUTHENTICATED);
+	if (client != NULL && client->status == CLIENT_STATUS_AUTHENTICATED)
+		return 1;
+	return connection_manager_is_remote_user(username);
 }
 
 /**
  * @brief 获取所有在线用户
  *
- * 获取所有已认证的在线用户名列表，返回动态分配的用户名数组。
+ * 获取所有分片上已认证的在线用户名列表（同一用户的多个连接只列一次），
+ * 取自连接管理器增量维护的在线名单快照，不遍历连接。
  * 调用者负责释放返回的数组和其中的字符串。
  *
  * @param usernames 输出参数，用于返回用户名数组
  * @param count 输出参数，用于返回在线用户数量
- * @return int 成功返回1，失败返回0
+ * @return int 成功返回1，失败或没有在线用户返回0
  */
 int session_manager_get_online_users(char ***usernames, int *count)
 {
@@ -224,49 +274,36 @@ int session_manager_get_online_users(char ***usernames, int *count)
 	*usernames = NULL;
 	*count = 0;
 
-	int total = 0;
-	Client **all = connection_manager_get_all(&total);
-	if (!all || total == 0)
-	{
-		if (all)
-			free(all);
-		return 0;
-	}
-
-	// 先计算在线的数量
-	int online_count = 0;
-	for (int i = 0; i < total; ++i)
+	const OnlineRoster *roster = connection_manager_roster_acquire();
+	if (!roster || roster->count == 0)
 	{
-		if (all[i] && all[i]->status == CLIENT_STATUS_AUTHENTICATED)
-			online_count++;
-	}
-
-	if (online_count == 0)
-	{
-		free(all);
+		connection_manager_roster_release(roster);
 		return 0;
 	}
 
-	// 分配并填充用户名列表
-	char **list = (char **)safe_malloc(sizeof(char *) * online_count);
+	char **list = (char **)safe_malloc(sizeof(char *) * roster->count);
 	if (!list)
 	{
-		free(all);
+		connection_manager_roster_release(roster);
 		return 0;
 	}
 
 	int idx = 0;
-	for (int i = 0; i < total && idx < online_count; ++i)
+	for (const char *name = roster->names; idx < roster->count; idx++)
 	{
-		if (all[i] && all[i]->status == CLIENT_STATUS_AUTHENTICATED)
+		const char *end = strchr(name, ',');
+		size_t len = end ? (size_t)(end - name) : strlen(name);
+		list[idx] = (char *)safe_malloc(len + 1);
+		if (list[idx])
 		{
-			list[idx++] = platform_strdup(all[i]->username);
+			memcpy(list[idx], name, len);
+			list[idx][len] = '\0';
 		}
+		name = end ? end + 1 : name + len;
 	}
 
-	free(all);
-
 	*usernames = list;
-	*count = online_count;
+	*count = roster->count;
+	connection_manager_roster_release(roster);
 	return 1;
 }
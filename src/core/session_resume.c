@@ -0,0 +1,457 @@
+/**
+ * @file session_resume.c
+ * @brief 会话恢复令牌与断线保留期
+ *
+ * 登录时带 resume 选项的连接在登录响应之后收到一个恢复令牌。连接意外断开后，
+ * 客户端在保留期内用 RESUME 命令出示令牌和已收到的最大投递序号，服务端不再验证口令、
+ * 不查用户库，直接把新连接绑定到令牌记下的用户，只补发断线期间错过的帧。
+ *
+ * 令牌按用户保存，每个用户最多 SESSION_RESUME_MAX_TOKENS 个（每个设备一个），
+ * 满了替换最早签发的；令牌只能使用一次，恢复成功后签发新令牌。令牌是进程密钥
+ * 对用户名、序号和时刻的 HMAC，表中只保存令牌本身，比较用常量时间。
+ *
+ * 用户最后一个连接断开时如果还有有效令牌，下线通知推迟到保留期结束：期间恢复或重新登录
+ * 的用户在其他人看来一直在线，关注设置也不清除。保留期结束仍未回来的用户由各事件循环的
+ * 定时检查补发下线通知并删除令牌。上线、下线和到期都在同一把锁内决定并记入在线状态通知，
+ * 同一用户的通知顺序与目录变化一致。显式登出时令牌立即作废，下线照常通知。
+ *
+ * 集群的上线/下线登记不推迟：保留期内发给该用户的消息照常进入归属节点的离线队列，
+ * 恢复时的上线登记把它们取回来。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "core.h"
+
+/**
+ * @brief 一个恢复令牌
+ */
+typedef struct
+{
+	unsigned char token[SESSION_RESUME_TOKEN_BYTES]; /**< 令牌 */
+	uint64_t issued_ms;								  /**< 签发时刻（单调时钟） */
+} ResumeToken;
+
+/**
+ * @brief 一个用户的令牌和保留状态
+ */
+typedef struct ResumeEntry
+{
+	char username[MAX_USERNAME_LEN];					  /**< 用户名 */
+	int user_id;										  /**< 用户ID，恢复时直接使用 */
+	int count;											  /**< 有效令牌数 */
+	ResumeToken tokens[SESSION_RESUME_MAX_TOKENS];		  /**< 令牌 */
+	int parked;											  /**< 已断线，下线通知推迟到 expires_ms */
+	uint64_t expires_ms;								  /**< 保留期结束时刻 */
+	struct ResumeEntry *prev;							  /**< 保留链表，按到期时刻排列 */
+	struct ResumeEntry *next;
+} ResumeEntry;
+
+/** 断线保留秒数，0 表示不签发令牌；在启动事件循环之前设置 */
+static int grace_seconds = SESSION_RESUME_DEFAULT_GRACE;
+
+/** 令牌表和保留链表由同一把锁保护 */
+static platform_mutex_t resume_lock = PLATFORM_MUTEX_INITIALIZER;
+static HashIndex entry_index;
+static int entry_count = 0;
+static ResumeEntry *parked_head = NULL;
+static ResumeEntry *parked_tail = NULL;
+
+/** 保留中的用户数，定时检查先看它，没有时不加锁 */
+static atomic_int parked_count = 0;
+
+/** 令牌的 HMAC 密钥，第一次签发时生成 */
+static unsigned char resume_secret[SHA256_DIGEST_LEN];
+static int secret_ready = 0;
+static uint64_t token_serial = 0;
+
+static int match_entry(const void *value, const void *key)
+{
+	return strncmp(((const ResumeEntry *)value)->username, (const char *)key, MAX_USERNAME_LEN) == 0;
+}
+
+static size_t name_hash(const char *username)
+{
+	return hash_index_hash_string(username, MAX_USERNAME_LEN);
+}
+
+/**
+ * @brief 生成进程密钥，调用方持有锁
+ *
+ * 有 /dev/urandom 时取系统随机数，再混入时刻、序号和栈地址（与口令盐的生成方式相同），
+ * 没有系统随机源的平台只依靠后者。
+ */
+static void init_secret_locked(void)
+{
+	unsigned char seed[SHA256_DIGEST_LEN] = {0};
+	Sha256Context ctx;
+	uint64_t now_us = platform_monotonic_us();
+	time_t now = time(NULL);
+
+#ifndef _WIN32
+	FILE *fp = fopen("/dev/urandom", "rb");
+	if (fp)
+	{
+		if (fread(seed, 1, sizeof(seed), fp) != sizeof(seed))
+			LOG_WARN("Short read from /dev/urandom, resume tokens use weaker seeding");
+		fclose(fp);
+	}
+#endif
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, "session-resume", 14);
+	sha256_update(&ctx, seed, sizeof(seed));
+	sha256_update(&ctx, &now, sizeof(now));
+	sha256_update(&ctx, &now_us, sizeof(now_us));
+	void *where = &ctx; /* 栈地址在启用 ASLR 时每次启动不同 */
+	sha256_update(&ctx, &where, sizeof(where));
+	sha256_final(&ctx, resume_secret);
+	secret_ready = 1;
+}
+
+/**
+ * @brief 把令牌解码为字节，必须正好是 SESSION_RESUME_TOKEN_BYTES 字节的十六进制
+ */
+static int decode_token(const char *text, unsigned char out[SESSION_RESUME_TOKEN_BYTES])
+{
+	if (!text || strlen(text) != SESSION_RESUME_TOKEN_BYTES * 2)
+		return -1;
+	for (int i = 0; i < SESSION_RESUME_TOKEN_BYTES; i++)
+	{
+		int value = 0;
+		for (int j = 0; j < 2; j++)
+		{
+			char c = text[i * 2 + j];
+			int nibble = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+			if (nibble < 0)
+				return -1;
+			value = value * 16 + nibble;
+		}
+		out[i] = (unsigned char)value;
+	}
+	return 0;
+}
+
+/**
+ * @brief 删除超过最长有效期的令牌，调用方持有锁
+ */
+static void prune_tokens(ResumeEntry *entry, uint64_t now_ms)
+{
+	const uint64_t ttl_ms = (uint64_t)SESSION_RESUME_TOKEN_TTL_S * 1000;
+	for (int i = 0; i < entry->count;)
+	{
+		if (now_ms - entry->tokens[i].issued_ms >= ttl_ms)
+			entry->tokens[i] = entry->tokens[--entry->count];
+		else
+			i++;
+	}
+}
+
+/**
+ * @brief 从保留链表中摘下，调用方持有锁
+ */
+static void unpark(ResumeEntry *entry)
+{
+	if (!entry->parked)
+		return;
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		parked_head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		parked_tail = entry->prev;
+	entry->prev = entry->next = NULL;
+	entry->parked = 0;
+	atomic_fetch_sub(&parked_count, 1);
+}
+
+/**
+ * @brief 删除用户的记录，调用方持有锁
+ */
+static void drop_entry(ResumeEntry *entry)
+{
+	unpark(entry);
+	hash_index_remove(&entry_index, name_hash(entry->username), entry, NULL);
+	entry_count--;
+	free(entry);
+}
+
+/**
+ * @brief 设置断线保留期，在启动事件循环之前调用
+ *
+ * @param seconds 保留秒数，不大于0表示不签发恢复令牌
+ */
+void session_resume_set_grace(int seconds)
+{
+	grace_seconds = seconds > 0 ? seconds : 0;
+}
+
+/**
+ * @brief 获取断线保留期
+ *
+ * @return int 保留秒数，0 表示未启用
+ */
+int session_resume_grace(void)
+{
+	return grace_seconds;
+}
+
+/**
+ * @brief 为已认证的用户签发一个恢复令牌
+ *
+ * 用户已有 SESSION_RESUME_MAX_TOKENS 个令牌时替换最早签发的一个。
+ *
+ * @param username 用户名
+ * @param user_id 用户ID
+ * @param out 输出的令牌（十六进制，以空字符结尾）
+ * @param cap 输出缓冲区大小，至少 SESSION_RESUME_TOKEN_LEN
+ * @return int 成功返回0，未启用、令牌表已满或参数无效返回-1
+ */
+int session_resume_issue(const char *username, int user_id, char *out, size_t cap)
+{
+	unsigned char digest[SHA256_DIGEST_LEN];
+	uint64_t now_ms = platform_monotonic_ms();
+
+	if (grace_seconds == 0 || !username || username[0] == '\0' || !out || cap < SESSION_RESUME_TOKEN_LEN)
+		return -1;
+
+	size_t h = name_hash(username);
+	platform_mutex_lock(&resume_lock);
+	ResumeEntry *entry = (ResumeEntry *)hash_index_find(&entry_index, h, username, match_entry);
+	if (!entry)
+	{
+		if (entry_count >= SESSION_RESUME_MAX_USERS)
+		{
+			platform_mutex_unlock(&resume_lock);
+			LOG_WARN("Resume token table full, %s must log in again after a disconnect", username);
+			return -1;
+		}
+		entry = (ResumeEntry *)calloc(1, sizeof(ResumeEntry));
+		if (entry && hash_index_insert(&entry_index, h, entry) != 0)
+		{
+			free(entry);
+			entry = NULL;
+		}
+		if (!entry)
+		{
+			platform_mutex_unlock(&resume_lock);
+			return -1;
+		}
+		safe_strcpy(entry->username, username, sizeof(entry->username));
+		entry_count++;
+	}
+	entry->user_id = user_id;
+	prune_tokens(entry, now_ms);
+
+	int slot = entry->count;
+	if (slot == SESSION_RESUME_MAX_TOKENS)
+	{
+		slot = 0;
+		for (int i = 1; i < entry->count; i++)
+		{
+			if (entry->tokens[i].issued_ms < entry->tokens[slot].issued_ms)
+				slot = i;
+		}
+	}
+	else
+		entry->count++;
+
+	if (!secret_ready)
+		init_secret_locked();
+	uint64_t serial = ++token_serial;
+	uint64_t now_us = platform_monotonic_us();
+	unsigned char input[MAX_USERNAME_LEN + 2 * sizeof(uint64_t)] = {0};
+	memcpy(input, entry->username, strlen(entry->username));
+	memcpy(input + MAX_USERNAME_LEN, &serial, sizeof(serial));
+	memcpy(input + MAX_USERNAME_LEN + sizeof(serial), &now_us, sizeof(now_us));
+	hmac_sha256(resume_secret, sizeof(resume_secret), input, sizeof(input), digest);
+	memcpy(entry->tokens[slot].token, digest, SESSION_RESUME_TOKEN_BYTES);
+	entry->tokens[slot].issued_ms = now_ms;
+	platform_mutex_unlock(&resume_lock);
+
+	for (int i = 0; i < SESSION_RESUME_TOKEN_BYTES; i++)
+		snprintf(out + i * 2, 3, "%02x", digest[i]);
+	return 0;
+}
+
+/**
+ * @brief 验证并用掉一个恢复令牌
+ *
+ * 令牌属于该用户、未超过最长有效期，且用户仍在线或在保留期内时有效。
+ * 验证通过后令牌作废，不能再次使用；用户的保留状态不变，由新连接认证时解除。
+ *
+ * @param username 出示令牌的用户名
+ * @param token 十六进制令牌
+ * @param user_id 输出令牌对应的用户ID
+ * @return int 有效返回0，无效或已过期返回-1
+ */
+int session_resume_claim(const char *username, const char *token, int *user_id)
+{
+	unsigned char wanted[SESSION_RESUME_TOKEN_BYTES];
+	uint64_t now_ms = platform_monotonic_ms();
+	int result = -1;
+
+	if (grace_seconds == 0 || !username || decode_token(token, wanted) != 0)
+		return -1;
+
+	platform_mutex_lock(&resume_lock);
+	ResumeEntry *entry = (ResumeEntry *)hash_index_find(&entry_index, name_hash(username), username, match_entry);
+	if (entry && !(entry->parked && now_ms >= entry->expires_ms))
+	{
+		prune_tokens(entry, now_ms);
+		for (int i = 0; i < entry->count; i++)
+		{
+			if (digest_equal(entry->tokens[i].token, wanted, SESSION_RESUME_TOKEN_BYTES))
+			{
+				entry->tokens[i] = entry->tokens[--entry->count];
+				if (user_id)
+					*user_id = entry->user_id;
+				result = 0;
+				break;
+			}
+		}
+		if (entry->count == 0 && !entry->parked)
+			drop_entry(entry);
+	}
+	platform_mutex_unlock(&resume_lock);
+	return result;
+}
+
+/**
+ * @brief 作废用户的所有恢复令牌
+ *
+ * 显式登出时调用，之后最后一个连接断开会立即通知下线。用户仍在保留期内时不改变保留状态。
+ *
+ * @param username 用户名
+ */
+void session_resume_revoke(const char *username)
+{
+	if (!username || username[0] == '\0')
+		return;
+
+	platform_mutex_lock(&resume_lock);
+	ResumeEntry *entry = (ResumeEntry *)hash_index_find(&entry_index, name_hash(username), username, match_entry);
+	if (entry)
+	{
+		entry->count = 0;
+		if (!entry->parked)
+			drop_entry(entry);
+	}
+	platform_mutex_unlock(&resume_lock);
+}
+
+/**
+ * @brief 记录用户上线或下线，决定是否推迟下线通知
+ *
+ * 由全局用户目录在用户的第一个连接认证、最后一个连接断开时调用，代替直接调用 presence_note。
+ * 下线时还有有效令牌的用户进入保留期，不通知；保留期内上线的用户解除保留，同样不通知。
+ *
+ * @param username 用户名
+ * @param online 1-上线，0-下线
+ */
+void session_resume_presence(const char *username, int online)
+{
+	if (grace_seconds == 0 || !username || username[0] == '\0')
+	{
+		presence_note(username, online);
+		return;
+	}
+
+	uint64_t now_ms = platform_monotonic_ms();
+	platform_mutex_lock(&resume_lock);
+	ResumeEntry *entry = (ResumeEntry *)hash_index_find(&entry_index, name_hash(username), username, match_entry);
+	if (online)
+	{
+		int quiet = entry && entry->parked;
+		if (quiet)
+		{
+			unpark(entry);
+			if (entry->count == 0)
+				drop_entry(entry);
+		}
+		else
+			presence_note(username, 1);
+		platform_mutex_unlock(&resume_lock);
+		return;
+	}
+
+	if (entry)
+		prune_tokens(entry, now_ms);
+	if (entry && entry->count > 0 && !entry->parked)
+	{
+		entry->parked = 1;
+		entry->expires_ms = now_ms + (uint64_t)grace_seconds * 1000;
+		entry->prev = parked_tail;
+		entry->next = NULL;
+		if (parked_tail)
+			parked_tail->next = entry;
+		else
+			parked_head = entry;
+		parked_tail = entry;
+		atomic_fetch_add(&parked_count, 1);
+		metrics_add(STAT_SESSION_PARKED, 1);
+	}
+	else if (!entry || !entry->parked)
+	{
+		if (entry)
+			drop_entry(entry);
+		presence_note(username, 0);
+	}
+	platform_mutex_unlock(&resume_lock);
+}
+
+/**
+ * @brief 结束已到期的保留期：通知下线并删除令牌
+ *
+ * 由各事件循环的时间轮定期调用，保留链表按到期时刻排列，只检查链表头部。
+ *
+ * @param now_ms 当前单调时钟毫秒数
+ * @return int 到期的用户数
+ */
+int session_resume_expire(uint64_t now_ms)
+{
+	int expired = 0;
+
+	if (atomic_load_explicit(&parked_count, memory_order_relaxed) == 0)
+		return 0;
+
+	platform_mutex_lock(&resume_lock);
+	while (parked_head && parked_head->expires_ms <= now_ms)
+	{
+		ResumeEntry *entry = parked_head;
+		presence_note(entry->username, 0);
+		drop_entry(entry);
+		expired++;
+	}
+	platform_mutex_unlock(&resume_lock);
+	if (expired > 0)
+		metrics_add(STAT_SESSION_EXPIRED, (uint64_t)expired);
+	return expired;
+}
+
+/**
+ * @brief 获取处于保留期的用户数
+ */
+int session_resume_parked(void)
+{
+	return atomic_load(&parked_count);
+}
+
+/**
+ * @brief 释放所有令牌，不发出通知（测试和退出时使用）
+ */
+void session_resume_cleanup(void)
+{
+	platform_mutex_lock(&resume_lock);
+	for (size_t i = 0; i < entry_index.cap; i++)
+		free(entry_index.slots[i].value);
+	hash_index_free(&entry_index);
+	entry_count = 0;
+	parked_head = parked_tail = NULL;
+	atomic_store(&parked_count, 0);
+	platform_mutex_unlock(&resume_lock);
+}
@@ -0,0 +1,300 @@
+/**
+ * @file worker_pool.c
+ * @brief 命令工作线程池实现
+ *
+ * reactor 线程只负责读写和分帧，解析出的命令打包成 CommandJob 交给固定数量的
+ * 工作线程执行，慢速处理（认证、状态构建、历史查询）不再阻塞同一事件循环上的
+ * 其他连接。每个工作线程有一个有界的无锁多生产者队列，所有 reactor 都可以
+ * 直接投递；队列已满时由调用方退回到在事件循环线程上直接执行。
+ *
+ * 同一连接同时最多只有一条命令在执行（见 Client.in_flight），
+ * 完成后才继续分发该连接的下一帧，因此连接内的命令顺序保持不变。
+ * 工作线程在队列为空时睡在条件变量上，生产者只在对方已声明睡眠时才加锁唤醒。
+ *
+ * 登录请求另有一组认证线程：口令摘要的派生是有意做慢的操作，放在独立的
+ * 线程池上，重连风暴中大量排队的登录不会占满命令工作线程，也不会阻塞 reactor。
+ * 两组线程共用同一套队列和完成邮件的实现。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core.h"
+
+/**
+ * @brief 单个工作线程
+ */
+typedef struct
+{
+	struct WorkerPool *pool;  /**< 所属线程池 */
+	MpscQueue queue;		  /**< 待执行的任务 */
+	atomic_int depth;		  /**< 队列中的任务数，用于限制队列长度 */
+	atomic_int sleeping;	  /**< 已声明将要睡眠，生产者需唤醒 */
+	platform_mutex_t lock;	  /**< 与 wake 配合的互斥锁 */
+	platform_cond_t wake;	  /**< 队列非空或停止时唤醒 */
+	platform_thread_t thread; /**< 线程句柄 */
+	int started;			  /**< 线程已启动 */
+} Worker;
+
+/**
+ * @brief 一组工作线程
+ */
+typedef struct WorkerPool
+{
+	const char *name;			 /**< 日志中的名称 */
+	Worker workers[MAX_WORKERS]; /**< 工作线程 */
+	int count;					 /**< 已启动的线程数 */
+	atomic_int running;			 /**< 接受新任务 */
+	atomic_uint next;			 /**< 轮流选择线程的计数 */
+} WorkerPool;
+
+static WorkerPool command_pool = {.name = "Worker"};
+static WorkerPool auth_pool = {.name = "Auth"};
+
+/**
+ * @brief 在工作线程上执行一个任务并送回所属分片
+ */
+static void run_job(CommandJob *job)
+{
+	Message msg;
+
+	message_unpack(job->msg, &msg);
+	connection_manager_bind_job(job);
+	handle_command(job->session.sockfd, &msg);
+	connection_manager_bind_job(NULL);
+	connection_manager_complete_job(job);
+}
+
+/**
+ * @brief 工作线程主循环
+ *
+ * 先声明睡眠再重新检查队列，配合生产者“先入队再检查睡眠标记”，唤醒不会丢失。
+ * 停止时先执行完队列中剩余的任务再退出。
+ */
+static platform_thread_return_t PLATFORM_THREAD_CALL worker_main(void *arg)
+{
+	Worker *w = (Worker *)arg;
+
+	for (;;)
+	{
+		MpscNode *node = mpsc_queue_pop(&w->queue);
+		if (!node)
+		{
+			if (!atomic_load(&w->pool->running))
+				break;
+
+			platform_mutex_lock(&w->lock);
+			atomic_store(&w->sleeping, 1);
+			atomic_thread_fence(memory_order_seq_cst);
+			node = mpsc_queue_pop(&w->queue);
+			if (!node && atomic_load(&w->pool->running))
+				platform_cond_wait(&w->wake, &w->lock);
+			atomic_store(&w->sleeping, 0);
+			platform_mutex_unlock(&w->lock);
+			if (!node)
+				continue;
+		}
+
+		run_job((CommandJob *)node);
+		atomic_fetch_sub(&w->depth, 1);
+	}
+	object_pool_thread_release();
+	epoch_thread_release();
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/**
+ * @brief 启动一组工作线程
+ */
+static int pool_start(WorkerPool *pool, int count)
+{
+	if (count <= 0 || pool->count > 0)
+		return 0;
+	if (count > MAX_WORKERS)
+		count = MAX_WORKERS;
+
+	memset(pool->workers, 0, sizeof(pool->workers));
+	atomic_store(&pool->running, 1);
+	for (int i = 0; i < count; i++)
+	{
+		Worker *w = &pool->workers[i];
+		w->pool = pool;
+		mpsc_queue_init(&w->queue);
+		atomic_init(&w->depth, 0);
+		atomic_init(&w->sleeping, 0);
+		platform_mutex_init(&w->lock);
+		platform_cond_init(&w->wake);
+		if (platform_thread_create(&w->thread, worker_main, w) != 0)
+		{
+			LOG_ERROR("Failed to start %s thread %d", pool->name, i);
+			platform_cond_destroy(&w->wake);
+			platform_mutex_destroy(&w->lock);
+			break;
+		}
+		w->started = 1;
+		pool->count++;
+	}
+
+	if (pool->count == 0)
+		atomic_store(&pool->running, 0);
+	LOG_INFO("%s pool started: %d threads", pool->name, pool->count);
+	return pool->count;
+}
+
+/**
+ * @brief 停止一组工作线程，执行完已入队的任务后返回
+ */
+static void pool_stop(WorkerPool *pool)
+{
+	if (pool->count == 0)
+		return;
+
+	atomic_store(&pool->running, 0);
+	for (int i = 0; i < pool->count; i++)
+	{
+		platform_mutex_lock(&pool->workers[i].lock);
+		platform_cond_broadcast(&pool->workers[i].wake);
+		platform_mutex_unlock(&pool->workers[i].lock);
+	}
+
+	for (int i = 0; i < pool->count; i++)
+	{
+		Worker *w = &pool->workers[i];
+		if (!w->started)
+			continue;
+		platform_thread_join(w->thread);
+		platform_cond_destroy(&w->wake);
+		platform_mutex_destroy(&w->lock);
+		w->started = 0;
+	}
+	LOG_INFO("%s pool stopped", pool->name);
+	pool->count = 0;
+}
+
+/**
+ * @brief 运行中的线程数
+ */
+static int pool_size(WorkerPool *pool)
+{
+	return atomic_load(&pool->running) ? pool->count : 0;
+}
+
+/**
+ * @brief 轮流选择一个线程投递任务，选中的队列已满时返回-1
+ */
+static int pool_submit(WorkerPool *pool, CommandJob *job)
+{
+	if (!job || pool_size(pool) == 0)
+		return -1;
+
+	Worker *w = &pool->workers[atomic_fetch_add(&pool->next, 1) % (unsigned)pool->count];
+	if (atomic_fetch_add(&w->depth, 1) >= WORKER_QUEUE_CAPACITY)
+	{
+		atomic_fetch_sub(&w->depth, 1);
+		return -1;
+	}
+
+	mpsc_queue_push(&w->queue, &job->node);
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load(&w->sleeping))
+	{
+		platform_mutex_lock(&w->lock);
+		platform_cond_signal(&w->wake);
+		platform_mutex_unlock(&w->lock);
+	}
+	return 0;
+}
+
+/**
+ * @brief 启动工作线程池
+ *
+ * @param count 工作线程数，超过 MAX_WORKERS 时截断
+ * @return int 实际启动的线程数，count<=0 或已启动时返回0
+ */
+int worker_pool_start(int count)
+{
+	return pool_start(&command_pool, count);
+}
+
+/**
+ * @brief 停止工作线程池
+ *
+ * 必须在所有 reactor 停止投递之后、销毁连接分片之前调用，
+ * 工作线程会先执行完已入队的任务，把完成邮件送回各自的分片。
+ */
+void worker_pool_stop(void)
+{
+	pool_stop(&command_pool);
+}
+
+/**
+ * @brief 获取工作线程数
+ *
+ * @return int 运行中的工作线程数，0 表示命令在事件循环线程上直接执行
+ */
+int worker_pool_size(void)
+{
+	return pool_size(&command_pool);
+}
+
+/**
+ * @brief 提交一个命令任务
+ *
+ * 轮流选择工作线程；选中的队列已满时不再尝试其他线程，由调用方直接执行，
+ * 让过载时的压力回到 reactor 上。
+ *
+ * @param job 命令任务，成功后归工作线程所有
+ * @return int 成功返回0，线程池未运行或队列已满返回-1
+ */
+int worker_pool_submit(CommandJob *job)
+{
+	return pool_submit(&command_pool, job);
+}
+
+/**
+ * @brief 启动认证线程池
+ *
+ * @param count 认证线程数，超过 MAX_WORKERS 时截断
+ * @return int 实际启动的线程数，count<=0 或已启动时返回0
+ */
+int auth_pool_start(int count)
+{
+	return pool_start(&auth_pool, count);
+}
+
+/**
+ * @brief 停止认证线程池
+ *
+ * 与 worker_pool_stop 相同，须在销毁连接分片之前调用。
+ */
+void auth_pool_stop(void)
+{
+	pool_stop(&auth_pool);
+}
+
+/**
+ * @brief 获取认证线程数
+ *
+ * @return int 运行中的认证线程数，0 表示登录与其他命令一样处理
+ */
+int auth_pool_size(void)
+{
+	return pool_size(&auth_pool);
+}
+
+/**
+ * @brief 提交一个登录任务
+ *
+ * 队列已满时调用方不应退回到事件循环线程上验证口令，而是拒绝这次登录，
+ * 让客户端稍后重试，慢速派生始终不会出现在 reactor 上。
+ *
+ * @param job 登录任务，成功后归认证线程所有
+ * @return int 成功返回0，线程池未运行或队列已满返回-1
+ */
+int auth_pool_submit(CommandJob *job)
+{
+	return pool_submit(&auth_pool, job);
+}
@@ -0,0 +1,263 @@
+/**
+ * @file message.c
+ * @brief 紧凑消息的打包、解包和名字驻留
+ */
+
+#include "message.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ 名字驻留 ================ */
+
+/** 驻留表的一块，名字按编号连续存放 */
+typedef struct
+{
+	char names[NAME_INTERN_CHUNK][MAX_USERNAME_LEN];
+} NameChunk;
+
+static platform_mutex_t intern_lock = PLATFORM_MUTEX_INITIALIZER;
+static HashIndex intern_index;
+static NameChunk *intern_chunks[NAME_INTERN_MAX_CHUNKS];
+/** 已驻留的名字数，编号为下标加1；只在 intern_lock 内增加，以 release 发布，读者不加锁以 acquire 读取 */
+static atomic_size_t intern_count = 0;
+
+static const char *name_at(size_t index)
+{
+	return intern_chunks[index / NAME_INTERN_CHUNK]->names[index % NAME_INTERN_CHUNK];
+}
+
+static int match_name(const void *value, const void *key)
+{
+	return strcmp(name_at((uintptr_t)value - 1), (const char *)key) == 0;
+}
+
+/**
+ * @brief 取名字的驻留编号，首次出现时分配
+ *
+ * 编号从1开始且永不回收，驻留表已满或名字过长时返回 NAME_ID_INLINE，由调用者保存原文。
+ *
+ * @param name 名字
+ * @return 驻留编号，空名字返回 NAME_ID_NONE
+ */
+uint32_t name_intern(const char *name)
+{
+	size_t len = strlen(name);
+	if (len == 0)
+		return NAME_ID_NONE;
+	if (len >= MAX_USERNAME_LEN)
+		return NAME_ID_INLINE;
+
+	size_t hash = hash_index_hash_string(name, MAX_USERNAME_LEN);
+	uint32_t id = NAME_ID_INLINE;
+
+	platform_mutex_lock(&intern_lock);
+	void *found = hash_index_find(&intern_index, hash, name, match_name);
+	size_t count = atomic_load_explicit(&intern_count, memory_order_relaxed);
+	if (found)
+	{
+		id = (uint32_t)(uintptr_t)found;
+	}
+	else if (count < (size_t)NAME_INTERN_CHUNK * NAME_INTERN_MAX_CHUNKS)
+	{
+		size_t chunk = count / NAME_INTERN_CHUNK;
+		if (!intern_chunks[chunk])
+			intern_chunks[chunk] = malloc(sizeof(NameChunk));
+		if (intern_chunks[chunk])
+		{
+			memcpy(intern_chunks[chunk]->names[count % NAME_INTERN_CHUNK], name, len + 1);
+			if (hash_index_insert(&intern_index, hash, (void *)(uintptr_t)(count + 1)) == 0)
+			{
+				/* 名字写完后才发布新的计数，读到计数的线程一定能读到名字 */
+				atomic_store_explicit(&intern_count, count + 1, memory_order_release);
+				id = (uint32_t)(count + 1);
+			}
+		}
+	}
+	platform_mutex_unlock(&intern_lock);
+	return id;
+}
+
+/**
+ * @brief 由驻留编号取名字
+ *
+ * 名字一经驻留不再移动或修改，读取无需加锁；计数以 acquire 读取，与驻留线程的发布配对。
+ *
+ * @param id 驻留编号
+ * @return 名字，NAME_ID_NONE 或未知编号返回空串
+ */
+const char *name_lookup(uint32_t id)
+{
+	if (id == NAME_ID_NONE || id == NAME_ID_INLINE || id > atomic_load_explicit(&intern_count, memory_order_acquire))
+		return "";
+	return name_at(id - 1);
+}
+
+size_t name_intern_count(void)
+{
+	return atomic_load_explicit(&intern_count, memory_order_acquire);
+}
+
+/* ================ 类型编号 ================ */
+
+static const char *const message_types[] = {
+	MSG_TYPE_LOGIN, MSG_TYPE_LOGOUT, MSG_TYPE_MSG, MSG_TYPE_BROADCAST, MSG_TYPE_GROUP,
+	MSG_TYPE_HISTORY, MSG_TYPE_STATUS, MSG_TYPE_PRESENCE, MSG_TYPE_ERROR, MSG_TYPE_OK, MSG_TYPE_ACK,
+	MSG_TYPE_RESUME,
+};
+#define MESSAGE_TYPE_COUNT (sizeof(message_types) / sizeof(message_types[0]))
+
+static uint8_t type_code(const char *type)
+{
+	for (size_t i = 0; i < MESSAGE_TYPE_COUNT; i++)
+	{
+		if (strcmp(type, message_types[i]) == 0)
+			return (uint8_t)i;
+	}
+	return PACKED_TYPE_INLINE;
+}
+
+/* ================ 打包与解包 ================ */
+
+/** 时间戳能否由纪元秒原样还原，空串和非规范格式都按原文保存 */
+static int timestamp_epoch(const char *timestamp, int64_t *epoch)
+{
+	if (timestamp[0] == '\0')
+		return 0;
+	time_t t = parse_timestamp(timestamp);
+	if (t == (time_t)-1)
+		return 0;
+	char check[32];
+	format_timestamp(t, check, sizeof(check));
+	if (strcmp(check, timestamp) != 0)
+		return 0;
+	*epoch = (int64_t)t;
+	return 1;
+}
+
+static char *put_field(char *p, const char *s, size_t len)
+{
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p + len + 1;
+}
+
+/**
+ * @brief 把消息打包为一次分配的紧凑表示
+ *
+ * @param msg 源消息
+ * @return 紧凑消息，用 free() 释放；内存不足返回 NULL
+ */
+PackedMessage *message_pack(const Message *msg)
+{
+	size_t content_len = strnlen(msg->content, sizeof(msg->content));
+	uint8_t type = type_code(msg->type);
+	uint32_t sender = name_intern(msg->sender);
+	uint32_t receiver = name_intern(msg->receiver);
+	int64_t epoch = 0;
+	int raw_time = !timestamp_epoch(msg->timestamp, &epoch);
+
+	size_t type_len = strnlen(msg->type, sizeof(msg->type));
+	size_t sender_len = strnlen(msg->sender, sizeof(msg->sender));
+	size_t receiver_len = strnlen(msg->receiver, sizeof(msg->receiver));
+	size_t time_len = strnlen(msg->timestamp, sizeof(msg->timestamp));
+
+	size_t tail = content_len + 1;
+	if (type == PACKED_TYPE_INLINE)
+		tail += type_len + 1;
+	if (sender == NAME_ID_INLINE)
+		tail += sender_len + 1;
+	if (receiver == NAME_ID_INLINE)
+		tail += receiver_len + 1;
+	if (raw_time)
+		tail += time_len + 1;
+
+	PackedMessage *packed = malloc(sizeof(PackedMessage) + tail);
+	if (!packed)
+		return NULL;
+	packed->timestamp = epoch;
+	packed->message_id = msg->message_id;
+	packed->sender = sender;
+	packed->receiver = receiver;
+	packed->content_len = (uint32_t)content_len;
+	packed->type = type;
+	packed->flags = (msg->is_delivered ? PACKED_FLAG_DELIVERED : 0) | (raw_time ? PACKED_FLAG_RAW_TIME : 0);
+
+	char *p = put_field(packed->tail, msg->content, content_len);
+	if (type == PACKED_TYPE_INLINE)
+		p = put_field(p, msg->type, type_len);
+	if (sender == NAME_ID_INLINE)
+		p = put_field(p, msg->sender, sender_len);
+	if (receiver == NAME_ID_INLINE)
+		p = put_field(p, msg->receiver, receiver_len);
+	if (raw_time)
+		put_field(p, msg->timestamp, time_len);
+	return packed;
+}
+
+/** 依次跳过尾部各字段，返回第 index 个原文字段（内容之后从0计） */
+static const char *inline_field(const PackedMessage *packed, int index)
+{
+	const char *p = packed->tail + packed->content_len + 1;
+	for (int i = 0; i < index; i++)
+		p += strlen(p) + 1;
+	return p;
+}
+
+/**
+ * @brief 把紧凑消息展开为 Message
+ *
+ * 只写入各字段的有效部分及结尾的 0，不清零整个结构体。
+ *
+ * @param packed 紧凑消息
+ * @param msg 输出消息
+ */
+void message_unpack(const PackedMessage *packed, Message *msg)
+{
+	const char *p = packed->tail + packed->content_len + 1;
+
+	memcpy(msg->content, packed->tail, packed->content_len + 1);
+	if (packed->type == PACKED_TYPE_INLINE)
+	{
+		safe_strcpy(msg->type, p, sizeof(msg->type));
+		p += strlen(p) + 1;
+	}
+	else
+	{
+		safe_strcpy(msg->type, message_types[packed->type], sizeof(msg->type));
+	}
+	if (packed->sender == NAME_ID_INLINE)
+	{
+		safe_strcpy(msg->sender, p, sizeof(msg->sender));
+		p += strlen(p) + 1;
+	}
+	else
+	{
+		safe_strcpy(msg->sender, name_lookup(packed->sender), sizeof(msg->sender));
+	}
+	if (packed->receiver == NAME_ID_INLINE)
+	{
+		safe_strcpy(msg->receiver, p, sizeof(msg->receiver));
+		p += strlen(p) + 1;
+	}
+	else
+	{
+		safe_strcpy(msg->receiver, name_lookup(packed->receiver), sizeof(msg->receiver));
+	}
+	if (packed->flags & PACKED_FLAG_RAW_TIME)
+		safe_strcpy(msg->timestamp, p, sizeof(msg->timestamp));
+	else
+		format_timestamp((time_t)packed->timestamp, msg->timestamp, sizeof(msg->timestamp));
+	msg->message_id = packed->message_id;
+	msg->is_delivered = (packed->flags & PACKED_FLAG_DELIVERED) != 0;
+}
+
+/**
+ * @brief 紧凑消息占用的字节数
+ */
+size_t message_packed_size(const PackedMessage *packed)
+{
+	int fields = (packed->type == PACKED_TYPE_INLINE) + (packed->sender == NAME_ID_INLINE) +
+				 (packed->receiver == NAME_ID_INLINE) + ((packed->flags & PACKED_FLAG_RAW_TIME) != 0);
+	const char *end = inline_field(packed, fields);
+	return (size_t)(end - (const char *)packed);
+}
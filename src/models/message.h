@@ -0,0 +1,29 @@
+/**
+ * @file message.h
+ * @brief 紧凑消息表示和名字驻留接口
+ *
+ * Message 是解析和分发一帧时使用的定长结构体，只在栈上短暂存在；
+ * 需要排队或缓存的消息打包成 PackedMessage，名字换成驻留编号，内容按实际长度存放。
+ */
+
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include "models.h"
+
+/* ================ 名字驻留 ================ */
+#define NAME_ID_NONE 0u				/**< 空名字的编号 */
+#define NAME_ID_INLINE 0xFFFFFFFFu	/**< 未驻留（表已满或名字过长），原文放在消息尾部 */
+#define NAME_INTERN_CHUNK 1024		/**< 驻留表每块的名字数 */
+#define NAME_INTERN_MAX_CHUNKS 1024 /**< 驻留表最多的块数，名字只增不减，以此限制总量 */
+
+uint32_t name_intern(const char *name);
+const char *name_lookup(uint32_t id);
+size_t name_intern_count(void);
+
+/* ================ 紧凑消息 ================ */
+PackedMessage *message_pack(const Message *msg);
+void message_unpack(const PackedMessage *packed, Message *msg);
+size_t message_packed_size(const PackedMessage *packed);
+
+#endif /* MESSAGE_H */
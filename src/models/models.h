@@ -11,12 +11,15 @@
 
 #include <time.h>
 #include "../platform/platform.h"
+#include "../utils/utils.h"
 
 /* ================ 字符串长度限制宏定义 ================ */
 #define MAX_USERNAME_LEN 32	 /**< 用户名最大长度 */
 #define MAX_PASSWORD_LEN 32	 /**< 密码最大长度 */
+#define PASSWORD_SALT_LEN 16 /**< 口令摘要的盐的字节数 */
+#define PASSWORD_HASH_LEN 32 /**< 口令摘要的字节数（PBKDF2-HMAC-SHA256 输出） */
 #define MAX_GROUPNAME_LEN 32 /**< 群组名最大长度 */
-#define MAX_CONTENT_LEN 256	 /**< 消息内容最大长度 */
+#define MAX_CONTENT_LEN 1024 /**< 消息内容最大长度（含结尾的 0），排队和缓存的消息按实际长度存放 */
 #define MAX_FILENAME_LEN 64	 /**< 文件名最大长度 */
 #define MAX_IP_LEN 16		 /**< IP地址最大长度 */
 
@@ -28,6 +31,9 @@
 #define MSG_TYPE_GROUP "GROUP"		   /**< 群组消息类型 */
 #define MSG_TYPE_HISTORY "HISTORY"	   /**< 历史记录消息类型 */
 #define MSG_TYPE_STATUS "STATUS"	   /**< 状态查询消息类型 */
+#define MSG_TYPE_PRESENCE "PRESENCE"   /**< 在线状态通知和关注设置消息类型 */
+#define MSG_TYPE_ACK "ACK"			   /**< 累计送达确认消息类型 */
+#define MSG_TYPE_RESUME "RESUME"	   /**< 会话恢复消息类型 */
 #define MSG_TYPE_ERROR "ERROR"		   /**< 错误消息类型 */
 #define MSG_TYPE_OK "OK"			   /**< 确认消息类型 */
 
@@ -36,6 +42,11 @@
 #define RECEIVER_GROUP_PREFIX "group:" /**< 群组消息接收者前缀 */
 #define RECEIVER_ALL_GROUP "group:all" /**< 所有群组的广播标识 */
 
+/* ================ 群组控制命令宏定义 ================ */
+/* 发往 group:<名称> 的 GROUP 消息内容为以下命令时表示加入/退出，其余内容为群组消息 */
+#define GROUP_CONTROL_JOIN "/join"	 /**< 加入群组，群组不存在时创建 */
+#define GROUP_CONTROL_LEAVE "/leave" /**< 退出群组 */
+
 /* ================ 客户端状态宏定义 ================ */
 /* 使用更明确的宏名以避免与客户端本地枚举冲突 */
 #define CLIENT_STATUS_OFFLINE 0	   /**< 客户端离线状态 */
@@ -48,42 +59,106 @@
 #define ERROR_USER_NOT_FOUND 1002 /**< 用户不存在 */
 #define ERROR_USER_OFFLINE 1003	  /**< 用户离线 */
 #define ERROR_GROUP_FULL 1004	  /**< 群组已满 */
+#define ERROR_RATE_LIMITED 1005	  /**< 超过限流额度 */
 #define ERROR_SERVER_ERROR 5000	  /**< 服务器内部错误 */
 
 /* ================ 数据结构定义 ================ */
 
 /**
  * @brief 用户信息结构体
+ *
+ * 查找和认证最先访问的字段（用户名、ID、激活状态）放在前面，
+ * 与密码等较少访问的字段分开，使查找只触及记录的首个缓存行。
+ * 所有字段都是定宽类型且不含指针，结构体本身就是用户库文件的记录格式，
+ * 启动时映射文件后直接使用其中的记录（见 storage/user_db.c）。
  */
 typedef struct User
 {
-	char username[MAX_USERNAME_LEN]; /**< 用户名 */
-	char password[MAX_PASSWORD_LEN]; /**< 密码（Demo中可存储明文） */
-	int user_id;					 /**< 用户ID，系统内唯一标识 */
-	time_t register_time;			 /**< 注册时间戳 */
-	int is_active;					 /**< 账户激活状态：1-激活，0-禁用 */
-	struct User *next;				 /**< 链表指针（用于用户列表） */
+	char username[MAX_USERNAME_LEN];				/**< 用户名 */
+	int32_t user_id;								/**< 用户ID，系统内唯一标识 */
+	int32_t is_active;								/**< 账户激活状态：1-激活，0-禁用 */
+	int64_t register_time;							/**< 注册时间戳 */
+	uint32_t password_iterations;					/**< 派生口令摘要时的 PBKDF2 迭代次数 */
+	unsigned char password_salt[PASSWORD_SALT_LEN]; /**< 每个用户独立的盐 */
+	unsigned char password_hash[PASSWORD_HASH_LEN]; /**< 口令摘要，不保存明文密码 */
 } User;
 
+/**
+ * @brief 客户端连接的冷数据
+ *
+ * 只在日志、STATUS 和进程交接时读取，存放在分片的槽位表中，不与热数据混在一起。
+ */
+typedef struct
+{
+	char remote_ip[MAX_IP_LEN]; /**< 客户端IP地址 */
+	int remote_port;			/**< 客户端端口号 */
+	time_t connect_time;		/**< 连接建立时间 */
+} ClientInfo;
+
+/**
+ * @brief 限流额度的种类
+ */
+typedef enum
+{
+	RATE_MESSAGES = 0, /**< 除广播外的命令帧数 */
+	RATE_BROADCASTS,   /**< 广播帧数 */
+	RATE_BYTES,		   /**< 读入的字节数 */
+	RATE_LIMIT_KINDS
+} RateLimitKind;
+
+/**
+ * @brief 限流配置
+ */
+typedef struct
+{
+	uint32_t rate[RATE_LIMIT_KINDS]; /**< 每个连接每秒的额度，按 RateLimitKind 下标，0 表示不限 */
+	uint32_t user_factor;			 /**< 同一用户所有连接合计的额度为单个连接的倍数，0 表示不按用户限制 */
+} RateLimitConfig;
+
+/**
+ * @brief 监听和客户端套接字选项
+ *
+ * 设置在监听套接字上，接受的连接继承这些选项。
+ */
+typedef struct
+{
+	int listen_backlog;		  /**< 监听队列长度，0 表示使用系统上限 SOMAXCONN */
+	int tcp_nodelay;		  /**< 1-关闭 Nagle 算法，小帧立即发出 */
+	int send_buffer;		  /**< 发送缓冲区字节数（SO_SNDBUF），0 表示系统默认 */
+	int recv_buffer;		  /**< 接收缓冲区字节数（SO_RCVBUF），0 表示系统默认 */
+	int defer_accept_seconds; /**< 连接在这么多秒内发来数据才交给 accept（TCP_DEFER_ACCEPT，仅 Linux），0 表示不延迟 */
+} SocketOptions;
+
 /**
  * @brief 客户端连接信息结构体
+ *
+ * 字段按访问频率排列：扇出和收包每次都读的放在最前面。
+ * 分片内的连接保存在按下标寻址的紧凑数组中，不再串成链表。
  */
 typedef struct Client
 {
 	socket_t sockfd;				 /**< 客户端套接字描述符 */
-	int client_id;					 /**< 客户端连接ID */
+	int status;						 /**< 客户端状态 */
+	int protocol_version;			 /**< 登录时协商的线协议版本：1-文本协议，2-二进制协议 */
+	int in_flight;					 /**< 有命令正在工作线程上执行，期间暂停读取和分帧 */
+	int client_id;					 /**< 稳定连接ID：低位为分片内槽位下标，高位为槽位复用代数 */
 	int user_id;					 /**< 关联的用户ID（认证后设置） */
 	char username[MAX_USERNAME_LEN]; /**< 已认证的用户名 */
-	int status;						 /**< 客户端状态 */
-	char remote_ip[MAX_IP_LEN];		 /**< 客户端IP地址 */
-	int remote_port;				 /**< 客户端端口号 */
-	time_t connect_time;			 /**< 连接建立时间 */
+	SendQueue send_queue;			 /**< 尚未写出的发送队列 */
+	FrameBuffer recv_buffer;		 /**< 跨读取保留的接收分帧缓冲区 */
 	time_t last_active;				 /**< 最后活动时间 */
-	struct Client *next;			 /**< 链表指针 */
+	TimerNode idle_timer;			 /**< 空闲超时定时器，收到数据时重设 */
+	TokenBucket rate[RATE_LIMIT_KINDS]; /**< 本连接按种类分开的限流令牌桶 */
+	int rate_notified;				 /**< 已就本轮超限回复过错误，放行一帧后清除 */
+	TimerNode throttle_timer;		 /**< 字节额度透支时暂停读取，到期恢复 */
+	uint32_t trace_id;				 /**< 流量记录中的连接号，0 表示尚未记录 */
 } Client;
 
 /**
  * @brief 消息结构体
+ *
+ * 解析和分发一帧时使用，字段定长，只在栈上或单条命令期间存在；
+ * 排队和缓存时转换成 PackedMessage（见 message.h）。
  */
 typedef struct Message
 {
@@ -91,21 +166,43 @@ typedef struct Message
 	char sender[MAX_USERNAME_LEN];	 /**< 发送者用户名 */
 	char receiver[MAX_USERNAME_LEN]; /**< 接收者标识 */
 	char timestamp[32];				 /**< 时间戳 "YYYY-MM-DD HH:MM:SS" */
-	char content[MAX_CONTENT_LEN];	 /**< 消息内容 */
 	int message_id;					 /**< 消息唯一ID（用于历史记录） */
 	int is_delivered;				 /**< 送达状态：1-已送达，0-未送达 */
-	struct Message *next;			 /**< 链表指针 */
-	struct Message *prev;			 /**< 双向链表反向指针（可选） */
+	char content[MAX_CONTENT_LEN];	 /**< 消息内容 */
 } Message;
 
+/**
+ * @brief 紧凑消息：定长头部加按实际长度存放的内容，一次分配
+ *
+ * 发送者和接收者为驻留编号，类型为数字编号，时间为纪元秒。尾部先是内容（以 0 结尾），
+ * 之后按类型、发送者、接收者、时间戳的顺序放置无法编号或无法无损还原的字段原文，各以 0 结尾。
+ */
+typedef struct PackedMessage
+{
+	int64_t timestamp;	  /**< 时间戳（纪元秒） */
+	int32_t message_id;	  /**< 消息唯一ID */
+	uint32_t sender;	  /**< 发送者的驻留编号 */
+	uint32_t receiver;	  /**< 接收者的驻留编号 */
+	uint32_t content_len; /**< 内容字节数（不含结尾的 0） */
+	uint8_t type;		  /**< 类型编号，PACKED_TYPE_INLINE 表示原文在尾部 */
+	uint8_t flags;		  /**< PACKED_FLAG_* */
+	char tail[];		  /**< 内容及需要原文保存的字段 */
+} PackedMessage;
+
+#define PACKED_TYPE_INLINE 0xFF		 /**< 类型不在编号表中 */
+#define PACKED_FLAG_DELIVERED 0x01	 /**< 已送达 */
+#define PACKED_FLAG_RAW_TIME 0x02	 /**< 时间戳字符串不能由纪元秒还原，原文在尾部 */
+
 /**
  * @brief 群组结构体
+ *
+ * 成员集合为按用户名索引的哈希表，成员判断与群组规模无关。
  */
 typedef struct
 {
 	char group_name[MAX_GROUPNAME_LEN]; /**< 群组名称 */
 	int group_id;						/**< 群组ID */
-	int member_ids[50];					/**< 成员用户ID数组 */
+	HashIndex members;					/**< 成员集合（按用户名索引） */
 	int member_count;					/**< 当前成员数量 */
 	char created_by[MAX_USERNAME_LEN];	/**< 创建者用户名 */
 	time_t create_time;					/**< 创建时间 */
@@ -118,11 +215,31 @@ typedef struct
 {
 	int server_port;				 /**< 服务器监听端口 */
 	int max_clients;				 /**< 最大客户端连接数 */
-	int max_history;				 /**< 最大历史消息保存数量 */
+	int max_history;				 /**< 最大历史消息保存数量（至少保留最近这么多条，按段删除更旧的消息） */
+	char history_dir[MAX_FILENAME_LEN]; /**< 历史消息段文件目录 */
+	char user_db_path[MAX_FILENAME_LEN]; /**< 用户库文件路径，新增用户追加到同名的 .journal 日志 */
+	size_t history_cache_bytes;		 /**< 最近消息缓存的总字节上限，0 表示关闭 */
+	int history_search;				 /**< 全文检索索引：1-写线程为落盘的消息建立倒排索引，0-不建立 */
 	int timeout_seconds;			 /**< 客户端超时时间（秒） */
 	char log_path[MAX_FILENAME_LEN]; /**< 日志文件路径 */
+	int log_flush_ms;				 /**< 异步日志的刷新间隔（毫秒）：0-同步写日志 */
 	int require_auth;				 /**< 认证要求：1-需要，0-不需要 */
 	int enable_encryption;			 /**< 加密开关：1-启用，0-不启用 */
+	int reactor_count;				 /**< reactor 线程数：1-单线程事件循环，>1-多 reactor 分片模式 */
+	int worker_count;				 /**< 命令工作线程数：0-在事件循环线程上直接处理命令 */
+	int auth_workers;				 /**< 认证线程数，登录的口令验证在这些线程上执行：0-与其他命令一样处理 */
+	int metrics_port;				 /**< 指标抓取端点的端口：0-不启用 */
+	int synthetic_users;			 /**< 启动时添加的压力测试用户数（bench0..），0-不添加 */
+	int presence_window_ms;			 /**< 在线状态通知的合并窗口（毫秒）：0-不发送状态通知 */
+	const char *cluster_nodes;		 /**< 集群节点列表（逗号分隔的 IPv4:链路端口），NULL-单节点运行 */
+	int cluster_node;				 /**< 本节点在集群节点列表中的下标 */
+	const char *handoff_path;		 /**< 进程交接的 Unix 套接字路径，NULL-不交接（重启时断开所有连接） */
+	RateLimitConfig rate_limit;		 /**< 按连接和用户的限流额度，全为0时不限流 */
+	int io_uring;					 /**< 收发引擎：1-Linux 上使用 io_uring（不支持时回退），0-就绪通知后端 */
+	SocketOptions socket_options;	 /**< 监听队列长度、TCP_NODELAY、缓冲区大小和延迟接受 */
+	const char *trace_path;			 /**< 入站帧流量记录文件，NULL-不记录 */
+	const char *local_path;			 /**< 本机客户端的 Unix 套接字路径，NULL-只监听 TCP */
+	int resume_grace_seconds;		 /**< 断线后会话保留秒数，期间可凭恢复令牌重连：0-不签发令牌 */
 } ServerConfig;
 
 /**
@@ -138,6 +255,8 @@ typedef struct
 
 /**
  * @brief 命令类型枚举
+ *
+ * 取值同时是二进制协议 v2 的类型标签，已有取值不能改动。
  */
 typedef enum
 {
@@ -149,7 +268,12 @@ typedef enum
 	CMD_JOIN_GROUP,
 	CMD_LEAVE_GROUP,
 	CMD_GET_HISTORY,
-	CMD_GET_STATUS
+	CMD_GET_STATUS,
+	CMD_RESPONSE_OK,   /**< OK 响应，不是命令，只用作 v2 类型标签 */
+	CMD_RESPONSE_ERROR, /**< ERROR 响应，不是命令，只用作 v2 类型标签 */
+	CMD_PRESENCE,		/**< 在线状态：客户端发出时设置关注的用户，服务器发出时为状态变化 */
+	CMD_ACK,			/**< 累计送达确认：内容为已收到的最大投递序号，服务器不回复 */
+	CMD_RESUME			/**< 会话恢复：客户端发出时出示令牌，服务器发出时签发令牌 */
 } CommandType;
 
 /* 全局服务器配置变量声明 */
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "network.h"
 #include "../protocol/protocol.h"
 #include "../core/core.h"
@@ -11,45 +12,197 @@ void client_handler_init(void)
 	LOG_DEBUG("Client handler initialized");
 }
 
-/* 处理客户端数据 */
-void client_handler_handle(socket_t client_fd)
+/* 超过消息或广播额度的帧直接丢弃；连续超限时只回复第一帧，拒绝本身不放大流量 */
+static void reject_over_limit(Client *client)
 {
-	char buffer[BUFFER_SIZE];
-	socket_io_result_t bytes_read;
-
-	// 读取数据
-	bytes_read = platform_socket_recv(client_fd, buffer, sizeof(buffer) - 1);
-
-	if (bytes_read > 0)
+	metrics_add(STAT_RATE_REJECTED, 1);
+	if (client->rate_notified)
+		return;
+	client->rate_notified = 1;
+	char *response = build_error_msg(ERROR_RATE_LIMITED, "Rate limit exceeded, slow down");
+	if (response)
 	{
-		buffer[bytes_read] = '\0';
-
-		LOG_DEBUG("Received %lld bytes from client %lld: %s",
-				  (long long)bytes_read, SOCKET_ID(client_fd), buffer);
+		client_handler_send(client->sockfd, response);
+		build_free(response);
+	}
+}
 
-		// 更新最后活动时间
-		connection_manager_update_active(client_fd);
+/* 分发一帧完整消息：在接收缓冲区上原地解析到栈上的 Message，每帧只解析一次且不做堆分配。
+   v2 帧按字段长度直接复制，文本帧切分并反转义。分帧解析后先按连接和用户的额度限流。
+   启用工作线程池时命令交给工作线程，连接暂停读取直到命令完成；队列已满时直接执行。
+   启用认证线程池时登录交给认证线程，队列已满时回复繁忙而不在事件循环线程上验证口令 */
+static void dispatch_frame(Client *client, char *frame, size_t frame_len, int binary)
+{
+	socket_t client_fd = client->sockfd;
+	Message msg;
+	int parsed = binary ? protocol_v2_decode(frame, frame_len, &msg)
+						: parse_message_into(frame, frame_len, &msg);
 
-		// 解析消息
-		Message *msg = parse_message(buffer);
-		if (msg)
+	// 解析消息
+	if (parsed == 0)
+	{
+		CommandType type = get_command_type(msg.type);
+		if (rate_limit_admit(client, type, platform_monotonic_ms()) != 0)
 		{
-			// 调用命令处理器处理消息
-			handle_raw_message(client_fd, buffer);
-
-			// 释放消息内存
-			safe_free((void **)&msg);
+			reject_over_limit(client);
+			return;
 		}
-		else
+		client->rate_notified = 0;
+
+		if (auth_pool_size() > 0 && type == CMD_LOGIN)
 		{
-			// 解析失败，返回错误
-			char *response = build_error_msg(ERROR_SERVER_ERROR, "Invalid message format");
+			CommandJob *job = connection_manager_prepare_job(client_fd, &msg);
+			if (job && auth_pool_submit(job) == 0)
+			{
+				metrics_add(STAT_AUTH_QUEUED, 1);
+				client->in_flight = 1;
+				event_loop_set_reading(client_fd, 0);
+				return;
+			}
+			connection_manager_free_job(job);
+
+			metrics_add(STAT_AUTH_BUSY, 1);
+			char *response = build_error_msg(ERROR_SERVER_ERROR, "Server busy, retry login");
 			if (response)
 			{
 				client_handler_send(client_fd, response);
-				free(response);
+				build_free(response);
+			}
+			return;
+		}
+
+		if (worker_pool_size() > 0)
+		{
+			CommandJob *job = connection_manager_prepare_job(client_fd, &msg);
+			if (job && worker_pool_submit(job) == 0)
+			{
+				client->in_flight = 1;
+				event_loop_set_reading(client_fd, 0);
+				return;
 			}
+			connection_manager_free_job(job);
+		}
+
+		// 调用命令处理器处理已解析的消息
+		handle_command(client_fd, &msg);
+	}
+	else
+	{
+		// 解析失败，返回错误
+		metrics_add(STAT_PARSE_ERRORS, 1);
+		char *response = build_error_msg(ERROR_SERVER_ERROR, "Invalid message format");
+		if (response)
+		{
+			client_handler_send(client_fd, response);
+			build_free(response);
+		}
+	}
+}
+
+/* 取出下一帧：协商 v2 之前只接受文本帧，之后两种帧按首字节区分，
+   客户端在收到协商结果前已发出的文本帧仍能正确处理 */
+static int next_frame(Client *client, char **frame, size_t *frame_len, int *binary)
+{
+	if (client->protocol_version == PROTOCOL_V2)
+		return protocol_next_frame(&client->recv_buffer, frame, frame_len, binary);
+	*binary = 0;
+	return frame_buffer_next(&client->recv_buffer, frame, frame_len);
+}
+
+/* 分发缓冲区中的完整帧，半帧留待下次读取；有命令在工作线程上执行时停在下一帧之前 */
+static void dispatch_pending(socket_t client_fd)
+{
+	Client *client = connection_manager_find_by_fd(client_fd);
+	char *frame;
+	size_t frame_len;
+	int binary = 0;
+	int status = 0;
+
+	if (!client)
+		return;
+
+	while (!client->in_flight && (status = next_frame(client, &frame, &frame_len, &binary)) > 0)
+	{
+		LOG_DEBUG("%s frame from fd=%lld (%zu bytes)", binary ? "v2" : "Text", SOCKET_ID(client_fd), frame_len);
+		// 解析会原地修改帧，记录在分发之前
+		trace_capture_frame(&client->trace_id, binary, frame, frame_len);
+		dispatch_frame(client, frame, frame_len, binary);
+
+		// 处理命令期间连接可能已被关闭（如登出），缓冲区随之释放
+		client = connection_manager_find_by_fd(client_fd);
+		if (!client)
+			return;
+	}
+
+	if (status < 0)
+	{
+		LOG_WARN("Frame from fd=%lld exceeds %zu bytes, closing",
+				 SOCKET_ID(client_fd), client->recv_buffer.max_frame);
+		metrics_add(STAT_PARSE_ERRORS, 1);
+		char *response = build_error_msg(ERROR_SERVER_ERROR, "Message too long");
+		if (response)
+		{
+			client_handler_send(client_fd, response);
+			build_free(response);
 		}
+		client_handler_close(client_fd);
+		return;
+	}
+
+	frame_buffer_compact(&client->recv_buffer);
+}
+
+/* 新读入 bytes 字节之后：计数、重设空闲超时、扣字节额度，再分发完整帧 */
+static void process_input(Client *client, socket_t client_fd, size_t bytes)
+{
+	metrics_add(STAT_BYTES_IN, (uint64_t)bytes);
+
+	LOG_DEBUG("Received %zu bytes from client %lld, pending=%zu",
+			  bytes, SOCKET_ID(client_fd), frame_buffer_pending(&client->recv_buffer));
+
+	// 更新最后活动时间并重设空闲超时
+	connection_manager_update_active(client_fd);
+
+	// 字节额度透支时暂停读取，让 TCP 流控把压力推回发送方；已读入的帧照常分发
+	uint64_t pause_ms = rate_limit_charge_bytes(client, bytes, platform_monotonic_ms());
+	if (pause_ms > 0 && connection_manager_throttle(client_fd, pause_ms) == 0)
+	{
+		metrics_add(STAT_RATE_THROTTLED, 1);
+		event_loop_set_reading(client_fd, 0);
+	}
+
+	dispatch_pending(client_fd);
+}
+
+/* 处理客户端数据：读入连接自己的缓冲区，再分发其中的完整帧 */
+void client_handler_handle(socket_t client_fd)
+{
+	Client *client = connection_manager_find_by_fd(client_fd);
+	socket_io_result_t bytes_read;
+	size_t space = 0;
+
+	if (!client)
+	{
+		LOG_WARN("No connection state for fd=%lld, closing", SOCKET_ID(client_fd));
+		client_handler_close(client_fd);
+		return;
+	}
+
+	char *dest = frame_buffer_reserve(&client->recv_buffer, BUFFER_SIZE, &space);
+	if (!dest)
+	{
+		LOG_ERROR("Out of memory for receive buffer of fd=%lld", SOCKET_ID(client_fd));
+		client_handler_close(client_fd);
+		return;
+	}
+
+	// 读取数据
+	bytes_read = platform_socket_recv(client_fd, dest, space);
+
+	if (bytes_read > 0)
+	{
+		frame_buffer_commit(&client->recv_buffer, (size_t)bytes_read);
+		process_input(client, client_fd, (size_t)bytes_read);
 	}
 	else if (bytes_read == 0)
 	{
@@ -69,7 +222,42 @@ void client_handler_handle(socket_t client_fd)
 	}
 }
 
-/* 发送数据到客户端 */
+/* 处理已由异步接收（io_uring）读出的数据：复制进连接的缓冲区后与 client_handler_handle 相同 */
+void client_handler_deliver(socket_t client_fd, const char *data, size_t len)
+{
+	Client *client = connection_manager_find_by_fd(client_fd);
+	size_t space = 0;
+
+	if (!client)
+	{
+		LOG_WARN("No connection state for fd=%lld, closing", SOCKET_ID(client_fd));
+		client_handler_close(client_fd);
+		return;
+	}
+
+	char *dest = frame_buffer_reserve(&client->recv_buffer, len, &space);
+	if (!dest)
+	{
+		LOG_ERROR("Out of memory for receive buffer of fd=%lld", SOCKET_ID(client_fd));
+		client_handler_close(client_fd);
+		return;
+	}
+
+	memcpy(dest, data, len);
+	frame_buffer_commit(&client->recv_buffer, len);
+	process_input(client, client_fd, len);
+}
+
+/* 工作线程上的命令完成或限流暂停到期后继续处理连接：恢复读取并分发暂停期间积压的帧；
+   限流暂停还没到期时只分发已读入的帧，读取留给暂停到期时恢复 */
+void client_handler_resume(socket_t client_fd)
+{
+	if (!connection_manager_is_throttled(client_fd))
+		event_loop_set_reading(client_fd, 1);
+	dispatch_pending(client_fd);
+}
+
+/* 发送数据到客户端：经由连接的发送队列，内核缓冲区满时排队等待可写 */
 void client_handler_send(socket_t client_fd, const char *data)
 {
 	if (!data || strlen(data) == 0)
@@ -77,21 +265,34 @@ void client_handler_send(socket_t client_fd, const char *data)
 		return;
 	}
 
-	socket_io_result_t bytes_sent = platform_socket_send(client_fd, data, strlen(data));
-
-	if (bytes_sent < 0)
+	if (connection_manager_send_text(client_fd, data) < 0)
 	{
-		LOG_ERROR("Failed to send to fd=%lld: %s",
-				  SOCKET_ID(client_fd), platform_socket_error_message());
+		LOG_ERROR("Failed to send to fd=%lld", SOCKET_ID(client_fd));
 	}
-	else
+}
+
+/* 广播目标：共享帧和要排除的连接 */
+typedef struct
+{
+	SharedFrame *frame;
+	socket_t exclude_fd;
+} BroadcastTarget;
+
+/* 广播遍历回调 */
+static int broadcast_to_client(Client *client, void *ctx)
+{
+	BroadcastTarget *target = (BroadcastTarget *)ctx;
+	if (client->sockfd != target->exclude_fd && client->status >= CLIENT_STATUS_CONNECTED)
 	{
-		LOG_DEBUG("Sent %lld bytes to fd=%lld",
-				  (long long)bytes_sent, SOCKET_ID(client_fd));
+		if (connection_manager_send_frame(client, target->frame) < 0)
+		{
+			LOG_ERROR("Failed to send to fd=%lld", SOCKET_ID(client->sockfd));
+		}
 	}
+	return 0;
 }
 
-/* 广播数据到所有客户端 */
+/* 广播数据到当前分片的所有客户端 */
 void client_handler_broadcast(const char *data, socket_t exclude_fd)
 {
 	if (!data || strlen(data) == 0)
@@ -101,25 +302,17 @@ void client_handler_broadcast(const char *data, socket_t exclude_fd)
 
 	LOG_DEBUG("Broadcasting message to all clients");
 
-	// 通过连接管理器获取所有客户端
-	int client_count = 0;
-	Client **clients = connection_manager_get_all(&client_count);
-
-	if (!clients)
+	// 只复制一次，所有接收者共享同一帧，原地遍历连接表
+	BroadcastTarget target;
+	target.frame = shared_frame_create(data, strlen(data));
+	target.exclude_fd = exclude_fd;
+	if (!target.frame)
 	{
 		return;
 	}
 
-	for (int i = 0; i < client_count; i++)
-	{
-		Client *client = clients[i];
-		if (client->sockfd != exclude_fd && client->status >= CLIENT_STATUS_CONNECTED)
-		{
-			client_handler_send(client->sockfd, data);
-		}
-	}
-
-	safe_free((void **)&clients);
+	connection_manager_foreach(broadcast_to_client, &target);
+	shared_frame_release(target.frame);
 }
 
 /* 关闭客户端连接 */
@@ -127,41 +320,46 @@ void client_handler_close(socket_t client_fd)
 {
 	if (SOCKET_IS_VALID(client_fd))
 	{
-		platform_socket_close(client_fd);
-		LOG_DEBUG("Closed connection: fd=%lld", SOCKET_ID(client_fd));
+		if (trace_capture_enabled())
+		{
+			Client *client = connection_manager_find_by_fd(client_fd);
+			if (client)
+				trace_capture_close(client->trace_id);
+		}
 
-		/* 确保事件循环不再使用该fd */
+		/* 先从事件循环注销，再关闭套接字，避免后端对已关闭的fd注销失败 */
 		event_loop_remove_fd(client_fd);
+
+		platform_socket_close(client_fd);
+		LOG_DEBUG("Closed connection: fd=%lld", SOCKET_ID(client_fd));
 	}
 }
 
-/* 获取客户端IP地址 */
-const char *get_client_ip(socket_t client_fd)
+/* 一次 getpeername 取得客户端 IP 和端口，Unix 套接字接入的连接为 LOCAL_PEER_NAME、端口0；
+   失败时 IP 为 "unknown"、端口为-1 并返回-1 */
+int get_client_address(socket_t client_fd, char *ip, size_t ip_size, int *port)
 {
-	static char ip_str[INET_ADDRSTRLEN];
-	struct sockaddr_in addr;
+	struct sockaddr_storage addr;
 	socket_len_t addr_len = sizeof(addr);
 
-	if (getpeername(client_fd, (struct sockaddr *)&addr, &addr_len) == 0)
+	if (getpeername(client_fd, (struct sockaddr *)&addr, &addr_len) < 0)
+		addr.ss_family = AF_UNSPEC;
+#ifdef AF_UNIX
+	if (addr.ss_family == AF_UNIX)
 	{
-		inet_ntop(AF_INET, &addr.sin_addr, ip_str, sizeof(ip_str));
-		return ip_str;
+		safe_strcpy(ip, LOCAL_PEER_NAME, ip_size);
+		*port = 0;
+		return 0;
 	}
-
-	strcpy(ip_str, "unknown");
-	return ip_str;
-}
-
-/* 获取客户端端口 */
-int get_client_port(socket_t client_fd)
-{
-	struct sockaddr_in addr;
-	socket_len_t addr_len = sizeof(addr);
-
-	if (getpeername(client_fd, (struct sockaddr *)&addr, &addr_len) == 0)
+#endif
+	if (addr.ss_family == AF_INET &&
+		inet_ntop(AF_INET, &((struct sockaddr_in *)&addr)->sin_addr, ip, (socket_len_t)ip_size))
 	{
-		return ntohs(addr.sin_port);
+		*port = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+		return 0;
 	}
 
+	safe_strcpy(ip, "unknown", ip_size);
+	*port = -1;
 	return -1;
 }
@@ -4,159 +4,394 @@
 #include <string.h>
 #include "network.h"
 #include "../core/core.h"
-// 客户端连接管理
-static socket_t client_fds[MAX_CLIENTS];
-static int client_count = 0;
-static volatile int loop_running = 0;
-
-/* 初始化事件循环 */
-void event_loop_init(void)
+// 就绪通知后端与连接计数；多 reactor 模式下每个线程各有一份
+static PLATFORM_THREAD_LOCAL Poller *loop_poller = NULL;
+// io_uring 收发引擎，启用且内核支持时代替就绪通知后端
+static PLATFORM_THREAD_LOCAL UringEngine *loop_uring = NULL;
+static PLATFORM_THREAD_LOCAL int client_count = 0;
+static PLATFORM_THREAD_LOCAL int client_limit = MAX_CLIENTS;
+static PLATFORM_THREAD_LOCAL volatile int loop_running = 0;
+// 时间轮：空闲连接回收和定期任务，同样每个线程一份
+static PLATFORM_THREAD_LOCAL TimerWheel *loop_timers = NULL;
+// 空闲超时秒数，在事件循环启动前设置，所有线程共用
+static int idle_timeout_seconds = 0;
+// 是否尝试使用 io_uring，在事件循环启动前设置，所有线程共用
+static int io_uring_requested = 0;
+// 在线状态通知的窗口检查，每个线程的时间轮上一个
+static PLATFORM_THREAD_LOCAL TimerNode presence_timer;
+// 会话恢复保留期的到期检查，每个线程的时间轮上一个
+static PLATFORM_THREAD_LOCAL TimerNode resume_timer;
+
+/* 多 reactor 模式下单个线程的启动参数 */
+typedef struct
+{
+	ConnectionShard *shard; // 线程绑定的连接分片
+	int index;				// reactor 编号，用于分配交接过来的连接
+	int count;				// reactor 总数
+	socket_t listener;		// 线程使用的监听套接字
+	int max_clients;		// 线程允许的最大连接数
+	platform_thread_t thread;
+	int started;
+} Reactor;
+
+/* 发送队列写关注回调：有积压时同时关注可写事件，清空后只关注可读；
+   有命令在工作线程上执行或限流暂停中的连接暂不关注可读 */
+static void set_write_interest(socket_t fd, int enable)
 {
-	for (int i = 0; i < MAX_CLIENTS; i++)
+	// io_uring 下发送由引擎在本轮结束时批量提交，队列清空不需要处理
+	if (loop_uring)
 	{
-		client_fds[i] = SOCKET_INVALID;
+		if (enable)
+			uring_queue_send(loop_uring, fd);
+		return;
 	}
-	client_count = 0;
-	loop_running = 0;
+	if (!loop_poller)
+		return;
 
-	LOG_DEBUG("Event loop initialized");
+	Client *client = connection_manager_find_by_fd(fd);
+	int paused = client && (client->in_flight || timer_pending(&client->throttle_timer));
+	int events = (paused ? 0 : POLLER_EVENT_READ) | (enable ? POLLER_EVENT_WRITE : 0);
+	if (poller_modify(loop_poller, fd, events) < 0)
+	{
+		LOG_WARN("Failed to %s write interest for fd=%lld",
+				 enable ? "enable" : "disable", SOCKET_ID(fd));
+	}
 }
 
-/* 添加客户端到事件循环 */
-static void add_client(socket_t client_fd)
+/* 公共接口：暂停或恢复关注连接的可读事件，保留发送队列积压时的可写关注 */
+void event_loop_set_reading(socket_t client_fd, int enable)
 {
-	if (client_count >= MAX_CLIENTS)
+	if (loop_uring)
 	{
-		LOG_WARN("Maximum clients reached (%d), rejecting connection", MAX_CLIENTS);
-		platform_socket_close(client_fd);
+		uring_set_reading(loop_uring, client_fd, enable);
+		return;
+	}
+	if (!loop_poller)
 		return;
+
+	int events = (enable ? POLLER_EVENT_READ : 0) |
+				 (connection_manager_pending_bytes(client_fd) > 0 ? POLLER_EVENT_WRITE : 0);
+	if (poller_modify(loop_poller, client_fd, events) < 0)
+	{
+		LOG_WARN("Failed to %s read interest for fd=%lld",
+				 enable ? "enable" : "disable", SOCKET_ID(client_fd));
 	}
+}
 
-	// 获取客户端IP和端口
-	const char *client_ip = get_client_ip(client_fd);
-	int client_port = get_client_port(client_fd);
+/* 公共接口：设置空闲连接超时，不大于0表示不回收；在 event_loop_init 之前调用 */
+void event_loop_set_idle_timeout(int seconds)
+{
+	idle_timeout_seconds = seconds > 0 ? seconds : 0;
+}
 
-	// 添加到连接管理器
-	connection_manager_add_from_fd(client_fd, client_ip, client_port);
+/* 公共接口：在 Linux 上改用 io_uring 收发，内核不支持时回退到就绪通知后端；在 event_loop_init 之前调用 */
+void event_loop_use_io_uring(int enable)
+{
+	io_uring_requested = enable;
+}
+
+/* 当前线程使用的收发后端名称 */
+static const char *backend_name(void)
+{
+	return loop_uring ? "io_uring" : poller_backend_name();
+}
+
+/* 公共接口：获取调用线程事件循环的时间轮，用于注册定期任务；未初始化时返回 NULL */
+TimerWheel *event_loop_timers(void)
+{
+	return loop_timers;
+}
+
+/* 每个刻度检查一次在线状态的合并窗口，窗口结束后第一个检查到的线程发出通知 */
+static void presence_tick(TimerNode *timer, void *ctx)
+{
+	(void)timer;
+	(void)ctx;
+	presence_flush(platform_monotonic_ms());
+}
+
+/* 每秒检查一次断线保留期，到期的用户由第一个检查到的线程通知下线 */
+static void resume_tick(TimerNode *timer, void *ctx)
+{
+	(void)timer;
+	(void)ctx;
+	session_resume_expire(platform_monotonic_ms());
+}
+
+/* 初始化事件循环 */
+int event_loop_init(int max_clients)
+{
+	if (loop_poller)
+	{
+		poller_destroy(loop_poller);
+		loop_poller = NULL;
+	}
+	uring_destroy(loop_uring);
+	loop_uring = NULL;
 
-	for (int i = 0; i < MAX_CLIENTS; i++)
+	if (io_uring_requested)
+	{
+		loop_uring = uring_create(URING_DEFAULT_ENTRIES);
+		if (!loop_uring)
+			LOG_WARN("io_uring unavailable, falling back to %s", poller_backend_name());
+	}
+	if (!loop_uring)
 	{
-		if (SOCKET_IS_INVALID(client_fds[i]))
+		loop_poller = poller_create(POLLER_DEFAULT_BATCH);
+		if (!loop_poller)
 		{
-			client_fds[i] = client_fd;
-			client_count++;
+			LOG_ERROR("Failed to create %s poller", poller_backend_name());
+			return -1;
+		}
+	}
 
-			// 设置为非阻塞
-			set_socket_nonblocking(client_fd);
+	free(loop_timers);
+	loop_timers = (TimerWheel *)malloc(sizeof(TimerWheel));
+	if (!loop_timers)
+	{
+		LOG_ERROR("Failed to allocate timer wheel");
+		poller_destroy(loop_poller);
+		loop_poller = NULL;
+		uring_destroy(loop_uring);
+		loop_uring = NULL;
+		return -1;
+	}
+	timer_wheel_init(loop_timers, EVENT_LOOP_TICK_MS, platform_monotonic_ms());
 
-			LOG_INFO("New client connected: fd=%lld, IP=%s:%d, total=%d",
-					 SOCKET_ID(client_fd), client_ip, client_port, client_count);
-			return;
-		}
+	client_limit = max_clients > 0 ? max_clients : MAX_CLIENTS;
+	/* select 后端受 FD_SETSIZE 限制，为监听套接字（和本机 Unix 套接字）预留位置 */
+	int reserved = SOCKET_IS_VALID(tcp_server_get_local()) ? 2 : 1;
+	if (!loop_uring && client_limit > poller_max_fds() - reserved)
+	{
+		LOG_WARN("%s backend limits clients to %d", poller_backend_name(), poller_max_fds() - reserved);
+		client_limit = poller_max_fds() - reserved;
+	}
+	client_count = 0;
+	loop_running = 0;
+	connection_manager_set_write_hook(set_write_interest);
+	connection_manager_set_batched_send(loop_uring != NULL);
+	connection_manager_set_resume_hook(client_handler_resume);
+	connection_manager_set_idle_timeout(loop_timers, idle_timeout_seconds, client_handler_close);
+	if (presence_window() > 0)
+	{
+		timer_init(&presence_timer, presence_tick, NULL);
+		timer_wheel_schedule(loop_timers, &presence_timer, EVENT_LOOP_TICK_MS, EVENT_LOOP_TICK_MS);
 	}
+	if (session_resume_grace() > 0)
+	{
+		timer_init(&resume_timer, resume_tick, NULL);
+		timer_wheel_schedule(loop_timers, &resume_timer, SESSION_RESUME_CHECK_MS, SESSION_RESUME_CHECK_MS);
+	}
+
+	LOG_INFO("Event loop initialized: backend=%s, max_clients=%d, idle_timeout=%ds",
+			 backend_name(), client_limit, idle_timeout_seconds);
+	return 0;
 }
 
-/* 从事件循环移除客户端 */
-static void remove_client(socket_t client_fd)
+/* 添加客户端到事件循环，成功返回0，连接数已满或注册失败时关闭套接字并返回-1。
+   套接字须已是非阻塞的；ip 为 NULL 时（io_uring 多路接受、交接过来的连接）查询一次对端地址 */
+static int add_client(socket_t client_fd, const char *ip, int port)
 {
-	connection_manager_remove(client_fd);
+	char peer_ip[INET_ADDRSTRLEN];
 
-	for (int i = 0; i < MAX_CLIENTS; i++)
+	if (client_count >= client_limit)
 	{
-		if (client_fds[i] == client_fd)
-		{
-			client_fds[i] = SOCKET_INVALID;
-			client_count--;
+		LOG_WARN("Maximum clients reached (%d), rejecting connection", client_limit);
+		platform_socket_close(client_fd);
+		return -1;
+	}
 
-			LOG_INFO("Client removed from event loop: fd=%lld, remaining=%d",
-					 SOCKET_ID(client_fd), client_count);
-			return;
-		}
+	if (loop_uring ? uring_add(loop_uring, client_fd) < 0 : poller_add(loop_poller, client_fd, POLLER_EVENT_READ) < 0)
+	{
+		LOG_WARN("Failed to register fd=%lld, rejecting connection", SOCKET_ID(client_fd));
+		platform_socket_close(client_fd);
+		return -1;
+	}
+
+	if (!ip)
+	{
+		get_client_address(client_fd, peer_ip, sizeof(peer_ip), &port);
+		ip = peer_ip;
+	}
+
+	// 添加到连接管理器
+	connection_manager_add_from_fd(client_fd, ip, port);
+	client_count++;
+
+	LOG_INFO("New client connected: fd=%lld, IP=%s:%d, total=%d",
+			 SOCKET_ID(client_fd), ip, port, client_count);
+	return 0;
+}
+
+/* 公共接口：接管上一个进程交接过来的连接，第 index 个 reactor（共 count 个）取编号
+   index、index+count…… 的连接；在 event_loop_init 之后、事件循环运行之前调用 */
+void event_loop_adopt(int index, int count)
+{
+	int adopted = 0;
+	socket_t fd;
+
+	for (int i = index; SOCKET_IS_VALID(fd = handoff_client_fd(i)); i += count)
+	{
+		// 注册失败时套接字已关闭，仍要调用 handoff_restore 让记录交出套接字的所有权
+		set_socket_nonblocking(fd);
+		int added = add_client(fd, NULL, 0) == 0;
+		if (handoff_restore(i) == 0 && added)
+			adopted++;
 	}
+	if (adopted > 0)
+		LOG_INFO("Adopted %d connections from previous server", adopted);
 }
 
-/* 公共接口：从事件循环中移除指定的客户端fd（供其他模块调用） */
+/* 公共接口：从事件循环中移除指定的客户端fd（供其他模块调用）
+   必须在关闭套接字之前调用，否则部分后端无法注销 */
 void event_loop_remove_fd(socket_t client_fd)
 {
 	if (SOCKET_IS_INVALID(client_fd))
 		return;
 
-	/* 如果文件描述符仍在client_fds数组中，移除之 */
-	for (int i = 0; i < MAX_CLIENTS; i++)
+	if ((loop_uring ? uring_remove(loop_uring, client_fd) : poller_remove(loop_poller, client_fd)) == 0)
 	{
-		if (client_fds[i] == client_fd)
-		{
-			client_fds[i] = SOCKET_INVALID;
-			client_count--;
-			LOG_INFO("Event loop removed fd=%lld, remaining=%d",
-					 SOCKET_ID(client_fd), client_count);
-			break;
-		}
+		client_count--;
+		LOG_INFO("Event loop removed fd=%lld, remaining=%d",
+				 SOCKET_ID(client_fd), client_count);
 	}
 
 	/* 从连接管理器中移除对应客户端 */
 	connection_manager_remove(client_fd);
 }
 
-/* 接受新连接 */
-static socket_t accept_connection(socket_t server_fd)
+/* 接受监听队列中积压的连接，直到队列为空或接受了 ACCEPT_BURST_MAX 个；
+   后端是水平触发的，剩下的连接下一轮仍会报告可读 */
+static void accept_connections(socket_t server_fd)
+{
+	char ip[INET_ADDRSTRLEN];
+	int port;
+
+	for (int i = 0; i < ACCEPT_BURST_MAX; i++)
+	{
+		socket_t client_fd = tcp_server_accept(server_fd, ip, sizeof(ip), &port);
+		if (SOCKET_IS_INVALID(client_fd))
+			break;
+		add_client(client_fd, ip, port);
+	}
+}
+
+/* io_uring 完成事件：新连接、分片唤醒、收到的数据和需要关闭的连接 */
+static void handle_uring_event(const UringEvent *event)
 {
-	struct sockaddr_in client_addr;
-	socket_len_t addr_len = sizeof(client_addr);
+	switch (event->type)
+	{
+	case URING_EVENT_ACCEPT:
+		add_client(event->fd, NULL, 0);
+		break;
+	case URING_EVENT_WAKEUP:
+		connection_manager_drain_mailbox();
+		break;
+	case URING_EVENT_DATA:
+		client_handler_deliver(event->fd, event->data, event->len);
+		break;
+	case URING_EVENT_CLOSED:
+		if (event->error != 0)
+			LOG_ERROR("Read error from fd=%lld: %s", SOCKET_ID(event->fd),
+					  platform_socket_error_message_code(event->error));
+		else
+			LOG_INFO("Client disconnected: fd=%lld", SOCKET_ID(event->fd));
+		client_handler_close(event->fd);
+		break;
+	default:
+		break;
+	}
+}
 
-	socket_t client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addr_len);
+/* io_uring 下的事件循环：每轮提交上一轮积累的收发请求并处理完成事件，只有一次系统调用 */
+static void run_uring(socket_t server_fd)
+{
+	socket_t wakeup_fd = connection_manager_wakeup_fd();
+	socket_t local_fd = tcp_server_get_local();
 
-	if (SOCKET_IS_INVALID(client_fd))
+	if (uring_watch_accept(loop_uring, server_fd) < 0 ||
+		(SOCKET_IS_VALID(local_fd) && uring_watch_accept(loop_uring, local_fd) < 0) ||
+		(SOCKET_IS_VALID(wakeup_fd) && uring_watch_readable(loop_uring, wakeup_fd) < 0))
 	{
-		if (!platform_socket_would_block())
+		LOG_ERROR("Failed to register server socket with io_uring");
+		return;
+	}
+
+	loop_running = 1;
+	LOG_INFO("Event loop started (io_uring)");
+
+	while (loop_running && tcp_server_is_running())
+	{
+		int timeout_ms = timer_wheel_timeout(loop_timers, platform_monotonic_ms(), SELECT_TIMEOUT * 1000);
+		if (uring_wait(loop_uring, timeout_ms, handle_uring_event) < 0)
 		{
-			LOG_ERROR("Failed to accept connection: %s", platform_socket_error_message());
+			LOG_ERROR("io_uring wait error: %s", platform_socket_error_message());
+			break;
 		}
-		return SOCKET_INVALID;
+		timer_wheel_advance(loop_timers, platform_monotonic_ms());
 	}
 
-	return client_fd;
+	// 停止接收后等已提交的发送完成，未发出的输出留在发送队列中（交接时随连接交给继任者）
+	uint64_t deadline = platform_monotonic_ms() + URING_DRAIN_MS;
+	uring_cancel_all(loop_uring);
+	while (uring_pending(loop_uring) > 0 && platform_monotonic_ms() < deadline)
+	{
+		if (uring_wait(loop_uring, EVENT_LOOP_TICK_MS, handle_uring_event) < 0)
+			break;
+	}
+	LOG_INFO("Event loop stopped");
 }
 
 /* 运行事件循环 */
 void event_loop_run(socket_t server_fd)
 {
-	fd_set read_fds;
-	socket_t max_fd;
-	struct timeval timeout;
+	PollerEvent events[POLLER_DEFAULT_BATCH];
 
-	loop_running = 1;
-	LOG_INFO("Event loop started");
+	if (loop_uring)
+	{
+		run_uring(server_fd);
+		return;
+	}
+	if (!loop_poller)
+	{
+		LOG_ERROR("Event loop not initialized");
+		return;
+	}
 
-	while (loop_running && tcp_server_is_running())
+	// 监听套接字只注册一次，之后在每轮等待之间保持注册
+	if (poller_add(loop_poller, server_fd, POLLER_EVENT_READ) < 0)
 	{
-		// 清空文件描述符集合
-		FD_ZERO(&read_fds);
+		LOG_ERROR("Failed to register server socket");
+		return;
+	}
 
-		// 添加服务器套接字
-		FD_SET(server_fd, &read_fds);
-		max_fd = server_fd;
+	// 本机客户端的 Unix 套接字由所有 reactor 共享，未抢到连接的一方 accept 立即返回
+	socket_t local_fd = tcp_server_get_local();
+	if (SOCKET_IS_VALID(local_fd) && poller_add(loop_poller, local_fd, POLLER_EVENT_READ) < 0)
+	{
+		LOG_WARN("Failed to register local socket, local clients must use TCP");
+		local_fd = SOCKET_INVALID;
+	}
 
-		// 添加所有客户端套接字
-		for (int i = 0; i < MAX_CLIENTS; i++)
-		{
-			socket_t fd = client_fds[i];
-			if (SOCKET_IS_VALID(fd))
-			{
-				FD_SET(fd, &read_fds);
-				if (fd > max_fd)
-				{
-					max_fd = fd;
-				}
-			}
-		}
+	// 多 reactor 模式下注册本分片的唤醒管道，用于接收其他分片投递的消息
+	socket_t wakeup_fd = connection_manager_wakeup_fd();
+	if (SOCKET_IS_VALID(wakeup_fd) && poller_add(loop_poller, wakeup_fd, POLLER_EVENT_READ) < 0)
+	{
+		LOG_ERROR("Failed to register shard wakeup channel");
+		poller_remove(loop_poller, server_fd);
+		if (SOCKET_IS_VALID(local_fd))
+			poller_remove(loop_poller, local_fd);
+		return;
+	}
 
-		// 设置超时
-		timeout.tv_sec = SELECT_TIMEOUT;
-		timeout.tv_usec = 0;
+	loop_running = 1;
+	LOG_INFO("Event loop started");
 
-		// 等待事件
-		int activity = select(platform_select_nfds(max_fd), &read_fds, NULL, NULL, &timeout);
+	while (loop_running && tcp_server_is_running())
+	{
+		// 等待事件，只返回真正就绪的套接字；最迟在下一个定时器可能到期时返回
+		int timeout_ms = timer_wheel_timeout(loop_timers, platform_monotonic_ms(), SELECT_TIMEOUT * 1000);
+		int activity = poller_wait(loop_poller, events, POLLER_DEFAULT_BATCH, timeout_ms);
 
 		if (activity < 0)
 		{
@@ -165,54 +400,183 @@ void event_loop_run(socket_t server_fd)
 				continue;
 			}
 
-			LOG_ERROR("select error: %s", platform_socket_error_message());
+			LOG_ERROR("%s wait error: %s", poller_backend_name(), platform_socket_error_message());
 			break;
 		}
 
-		if (activity == 0)
+		for (int i = 0; i < activity; i++)
 		{
-			// 超时，执行定期任务
-			continue;
-		}
+			socket_t fd = events[i].fd;
 
-		// 处理新连接
-		if (FD_ISSET(server_fd, &read_fds))
-		{
-			socket_t new_client = accept_connection(server_fd);
-			if (SOCKET_IS_VALID(new_client))
+			// 其他分片投递的消息
+			if (SOCKET_IS_VALID(wakeup_fd) && fd == wakeup_fd)
 			{
-				add_client(new_client);
+				connection_manager_drain_mailbox();
+				continue;
 			}
-		}
 
-		// 处理客户端数据
-		for (int i = 0; i < MAX_CLIENTS; i++)
-		{
-			socket_t client_fd = client_fds[i];
-			if (SOCKET_IS_VALID(client_fd) && FD_ISSET(client_fd, &read_fds))
+			// 处理新连接（TCP 和本机 Unix 套接字）
+			if (fd == server_fd || (SOCKET_IS_VALID(local_fd) && fd == local_fd))
 			{
-				client_handler_handle(client_fd);
+				accept_connections(fd);
+				continue;
+			}
+
+			// 套接字可写时刷新积压的发送队列
+			if (events[i].events & POLLER_EVENT_WRITE)
+			{
+				if (connection_manager_flush(fd) < 0)
+				{
+					client_handler_close(fd);
+					continue;
+				}
+			}
+
+			// 处理客户端数据
+			if (events[i].events & (POLLER_EVENT_READ | POLLER_EVENT_ERROR))
+			{
+				client_handler_handle(fd);
 			}
 		}
+
+		// 处理完本轮事件后再执行到期的定时器，刚收到数据的连接已经重设了空闲超时，
+		// 定时器关闭的连接也不会再出现在本轮的就绪列表中
+		timer_wheel_advance(loop_timers, platform_monotonic_ms());
 	}
 
+	poller_remove(loop_poller, server_fd);
+	if (SOCKET_IS_VALID(local_fd))
+	{
+		poller_remove(loop_poller, local_fd);
+	}
+	if (SOCKET_IS_VALID(wakeup_fd))
+	{
+		poller_remove(loop_poller, wakeup_fd);
+	}
 	LOG_INFO("Event loop stopped");
 }
 
 /* 停止事件循环 */
 void event_loop_stop(void)
 {
+	int total = 0;
+	Client **clients;
+
 	loop_running = 0;
 
-	// 关闭所有客户端连接
-	for (int i = 0; i < MAX_CLIENTS; i++)
+	// 关闭所有客户端连接；有继任者等待交接时保存连接记录，套接字保持打开交给继任者
+	clients = connection_manager_get_all(&total);
+	for (int i = 0; i < total; i++)
 	{
-		if (SOCKET_IS_VALID(client_fds[i]))
+		socket_t fd = clients[i]->sockfd;
+		poller_remove(loop_poller, fd);
+		int exported = handoff_requested() && handoff_export(clients[i]) == 0;
+		// 先导出再注销：注销会取走仍在发送中的帧
+		uring_remove(loop_uring, fd);
+		if (exported)
 		{
-			socket_t fd = client_fds[i];
-			platform_socket_close(fd);
-			remove_client(fd);
+			connection_manager_detach(fd);
+			continue;
 		}
+		platform_socket_close(fd);
+		connection_manager_remove(fd);
 	}
+	safe_free((void **)&clients);
 	client_count = 0;
+
+	connection_manager_set_write_hook(NULL);
+	connection_manager_set_batched_send(0);
+	connection_manager_set_resume_hook(NULL);
+	connection_manager_set_idle_timeout(NULL, 0, NULL);
+	free(loop_timers);
+	loop_timers = NULL;
+	if (loop_poller)
+	{
+		poller_destroy(loop_poller);
+		loop_poller = NULL;
+	}
+	uring_destroy(loop_uring);
+	loop_uring = NULL;
+}
+
+/* 单个 reactor 线程：绑定分片后运行自己的事件循环 */
+static platform_thread_return_t PLATFORM_THREAD_CALL reactor_main(void *arg)
+{
+	Reactor *reactor = (Reactor *)arg;
+
+	connection_manager_bind_shard(reactor->shard);
+	if (event_loop_init(reactor->max_clients) == 0)
+	{
+		event_loop_adopt(reactor->index, reactor->count);
+		event_loop_run(reactor->listener);
+		event_loop_stop();
+	}
+	connection_manager_bind_shard(NULL);
+	object_pool_thread_release();
+	epoch_thread_release();
+
+	/* 一个 reactor 退出后唤醒其余 reactor，让它们尽快发现服务器已停止 */
+	connection_manager_wake_all();
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/* 多 reactor 模式：启动 reactors 个线程，每个线程拥有独立的就绪通知后端、
+   连接分片和监听套接字（监听套接字不足时共享第一个），阻塞到服务器停止。
+   成功返回0，无法创建分片或线程返回-1 */
+int event_loop_run_reactors(int reactors, int max_clients)
+{
+	Reactor pool[MAX_REACTORS];
+	int started = 0;
+
+	if (reactors < 1)
+		reactors = 1;
+	if (reactors > MAX_REACTORS)
+		reactors = MAX_REACTORS;
+	if (max_clients <= 0)
+		max_clients = MAX_CLIENTS;
+
+	memset(pool, 0, sizeof(pool));
+	for (int i = 0; i < reactors; i++)
+	{
+		pool[i].shard = connection_shard_create();
+		if (!pool[i].shard)
+		{
+			connection_shard_destroy_all();
+			return -1;
+		}
+		pool[i].index = i;
+		pool[i].count = reactors;
+		pool[i].listener = tcp_server_get_listener(i);
+		pool[i].max_clients = (max_clients + reactors - 1) / reactors;
+	}
+
+	LOG_INFO("Starting %d reactors (%d listeners)", reactors, tcp_server_listener_count());
+	for (int i = 0; i < reactors; i++)
+	{
+		if (platform_thread_create(&pool[i].thread, reactor_main, &pool[i]) != 0)
+		{
+			LOG_ERROR("Failed to start reactor %d", i);
+			break;
+		}
+		pool[i].started = 1;
+		started++;
+	}
+
+	/* 主线程只等待停止信号；信号可能投递到任意线程，这里轮询运行标志 */
+	while (started > 0 && tcp_server_is_running())
+	{
+		platform_sleep_ms(100);
+	}
+	connection_manager_wake_all();
+
+	for (int i = 0; i < reactors; i++)
+	{
+		if (pool[i].started)
+			platform_thread_join(pool[i].thread);
+	}
+	/* 工作线程和认证线程可能还在向分片投递完成的命令，先停止线程池再销毁分片 */
+	worker_pool_stop();
+	auth_pool_stop();
+	connection_shard_destroy_all();
+	return started > 0 ? 0 : -1;
 }
@@ -0,0 +1,738 @@
+// network/handoff.c
+/* 进程交接：部署新版本时不断开客户端。运行中的进程在一个 Unix 套接字上等待继任者，
+   继任者启动时连上来请求交接；旧进程停下事件循环（不关闭连接），把监听套接字、
+   每个客户端套接字（SCM_RIGHTS）和紧凑的连接记录发过去，然后退出。
+   继任者直接在继承的监听套接字上继续 accept，排队中的连接不会丢失；
+   客户端按记录恢复认证状态、协议版本、半帧输入和尚未写出的输出，对客户端来说连接从未中断。
+
+   线路格式（两端是同一构建，结构体按本机布局直接传输，版本和记录大小不符时拒绝交接）：
+   继任者先发 HandoffHello 请求；旧进程回一个 HandoffHello（附带监听套接字），
+   之后每批最多 HANDOFF_MAX_FDS 个客户端：一个 HandoffBatch（附带这批套接字）加
+   bytes 字节的记录，每条记录为 HandoffRecord 加未成帧的输入和未写出的输出；
+   继任者收完后回一个 uint32 的客户端数作为确认。
+
+   群组成员、离线队列、关注列表和工作线程上正在执行的命令不在交接范围内 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "network.h"
+#include "../core/core.h"
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define HANDOFF_MAGIC 0x4f485449u // "ITHO"
+#define HANDOFF_VERSION 1
+#define HANDOFF_MAX_FDS 64		  // 一条消息携带的套接字数上限，不小于监听套接字数上限
+#define HANDOFF_POLL_MS 500		  // 等待继任者的超时，到时检查是否需要停止
+#define HANDOFF_TIMEOUT_MS 30000  // 交接过程中等待对方数据的上限
+
+/* 交接请求与应答 */
+typedef struct
+{
+	uint32_t magic;		  // HANDOFF_MAGIC
+	uint32_t version;	  // HANDOFF_VERSION
+	uint32_t record_size; // sizeof(HandoffRecord)，两端构建不一致时拒绝
+	uint32_t listeners;	  // 随应答附带的监听套接字数
+	uint32_t clients;	  // 之后要发送的客户端数
+} HandoffHello;
+
+/* 一批客户端的头部，随消息附带 fds 个套接字 */
+typedef struct
+{
+	uint32_t fds;	// 本批客户端数
+	uint32_t bytes; // 其后记录的总字节数
+} HandoffBatch;
+
+/* 一个客户端的连接记录，其后紧跟 unread_len 字节的输入和 unsent_len 字节的输出 */
+typedef struct
+{
+	int32_t user_id;
+	int32_t status;
+	int32_t protocol_version;
+	int32_t remote_port;
+	int64_t connect_time;
+	int64_t last_active;
+	uint32_t unread_len;
+	uint32_t unsent_len;
+	char username[MAX_USERNAME_LEN];
+	char remote_ip[MAX_IP_LEN];
+} HandoffRecord;
+
+/* 一个待发出（旧进程）或待恢复（继任者）的客户端 */
+typedef struct
+{
+	socket_t fd;		  // 客户端套接字
+	HandoffRecord record; // 连接记录
+	char *data;			  // 输入后接输出
+} HandoffClient;
+
+static socket_t inherited[HANDOFF_MAX_FDS];
+static int inherited_count = 0;
+
+#ifndef _WIN32
+
+static HandoffClient *clients = NULL;
+static int client_count = 0;
+static int client_cap = 0;
+static platform_mutex_t clients_lock = PLATFORM_MUTEX_INITIALIZER;
+
+static socket_t listen_fd = SOCKET_INVALID;
+static socket_t successor_fd = SOCKET_INVALID;
+static platform_thread_t listener_thread;
+static atomic_int listener_running = 0;
+static atomic_int handoff_pending = 0;
+static char listen_path[MAX_FILENAME_LEN];
+
+/* 等待套接字可读，超时返回0 */
+static int wait_readable(socket_t fd, int timeout_ms)
+{
+	fd_set readfds;
+	struct timeval tv;
+
+	FD_ZERO(&readfds);
+	FD_SET(fd, &readfds);
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	return select(platform_select_nfds(fd), &readfds, NULL, NULL, &tv);
+}
+
+/* 写出全部数据，出错返回-1 */
+static int send_all(socket_t fd, const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		socket_io_result_t sent = platform_socket_send(fd, data, len);
+		if (sent <= 0)
+		{
+			if (sent < 0 && platform_socket_interrupted())
+				continue;
+			return -1;
+		}
+		data += sent;
+		len -= (size_t)sent;
+	}
+	return 0;
+}
+
+/* 读满 len 字节，超时或对方关闭返回-1 */
+static int recv_all(socket_t fd, char *data, size_t len)
+{
+	while (len > 0)
+	{
+		if (wait_readable(fd, HANDOFF_TIMEOUT_MS) <= 0)
+			return -1;
+		socket_io_result_t n = platform_socket_recv(fd, data, len);
+		if (n <= 0)
+		{
+			if (n < 0 && platform_socket_interrupted())
+				continue;
+			return -1;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/* 发送一条消息并附带 count 个套接字，成功返回0 */
+static int send_with_fds(socket_t fd, const void *data, size_t len, const socket_t *fds, int count)
+{
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t sent;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&control, 0, sizeof(control));
+	iov.iov_base = (void *)data;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (count > 0)
+	{
+		msg.msg_control = control.buf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)count);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)count);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)count);
+	}
+
+	do
+	{
+		sent = sendmsg(fd, &msg, 0);
+	} while (sent < 0 && errno == EINTR);
+	if (sent <= 0)
+		return -1;
+	return send_all(fd, (const char *)data + sent, len - (size_t)sent);
+}
+
+/* 读满 len 字节并取出随消息附带的套接字，返回套接字数，出错返回-1 */
+static int recv_with_fds(socket_t fd, void *data, size_t len, socket_t *fds, int max_fds)
+{
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t got;
+	int count = 0;
+
+	if (wait_readable(fd, HANDOFF_TIMEOUT_MS) <= 0)
+		return -1;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = data;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	do
+	{
+		got = recvmsg(fd, &msg, 0);
+	} while (got < 0 && errno == EINTR);
+	if (got <= 0)
+		return -1;
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		int n = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		for (int i = 0; i < n; i++)
+		{
+			int received;
+			memcpy(&received, CMSG_DATA(cmsg) + sizeof(int) * (size_t)i, sizeof(int));
+			if (count < max_fds)
+				fds[count++] = received;
+			else
+				platform_socket_close(received);
+		}
+	}
+
+	if ((msg.msg_flags & MSG_CTRUNC) || recv_all(fd, (char *)data + got, len - (size_t)got) != 0)
+	{
+		for (int i = 0; i < count; i++)
+			platform_socket_close(fds[i]);
+		return -1;
+	}
+	return count;
+}
+
+/* 连接记录是否与本构建一致 */
+static int hello_valid(const HandoffHello *hello)
+{
+	return hello->magic == HANDOFF_MAGIC && hello->version == HANDOFF_VERSION &&
+		   hello->record_size == sizeof(HandoffRecord);
+}
+
+/* 追加一个客户端，调用者持有 clients_lock */
+static HandoffClient *append_client(void)
+{
+	if (client_count == client_cap)
+	{
+		int cap = client_cap ? client_cap * 2 : 256;
+		HandoffClient *grown = (HandoffClient *)realloc(clients, sizeof(HandoffClient) * (size_t)cap);
+		if (!grown)
+			return NULL;
+		clients = grown;
+		client_cap = cap;
+	}
+	HandoffClient *hc = &clients[client_count++];
+	memset(hc, 0, sizeof(*hc));
+	hc->fd = SOCKET_INVALID;
+	return hc;
+}
+
+/* 释放全部客户端，关闭本进程中尚未恢复的套接字（已交出的由继任者持有副本） */
+static void free_clients(void)
+{
+	platform_mutex_lock(&clients_lock);
+	for (int i = 0; i < client_count; i++)
+	{
+		if (SOCKET_IS_VALID(clients[i].fd))
+			platform_socket_close(clients[i].fd);
+		free(clients[i].data);
+	}
+	free(clients);
+	clients = NULL;
+	client_count = 0;
+	client_cap = 0;
+	platform_mutex_unlock(&clients_lock);
+}
+
+/* 在 Unix 套接字上连接上一个进程，不存在时返回 SOCKET_INVALID */
+static socket_t connect_predecessor(const char *path)
+{
+	struct sockaddr_un addr;
+	socket_t fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return SOCKET_INVALID;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (SOCKET_IS_INVALID(fd))
+		return SOCKET_INVALID;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, strlen(path));
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		platform_socket_close(fd);
+		return SOCKET_INVALID;
+	}
+	return fd;
+}
+
+/* 解析一批客户端的记录，每个客户端对应 fds 中的一个套接字 */
+static int parse_batch(const char *buf, size_t len, const socket_t *fds, int count)
+{
+	size_t offset = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		HandoffRecord record;
+		if (len - offset < sizeof(record))
+			return -1;
+		memcpy(&record, buf + offset, sizeof(record));
+		offset += sizeof(record);
+
+		size_t data_len = (size_t)record.unread_len + record.unsent_len;
+		if (len - offset < data_len)
+			return -1;
+
+		platform_mutex_lock(&clients_lock);
+		HandoffClient *hc = append_client();
+		if (hc)
+		{
+			hc->record = record;
+			hc->record.username[MAX_USERNAME_LEN - 1] = '\0';
+			hc->record.remote_ip[MAX_IP_LEN - 1] = '\0';
+			hc->data = data_len > 0 ? (char *)malloc(data_len) : NULL;
+			if (hc->data)
+				memcpy(hc->data, buf + offset, data_len);
+			else
+				hc->record.unread_len = hc->record.unsent_len = 0;
+			hc->fd = fds[i];
+		}
+		platform_mutex_unlock(&clients_lock);
+		if (!hc)
+			return -1;
+		offset += data_len;
+	}
+	return offset == len ? 0 : -1;
+}
+
+/* 公共接口：向 path 上等待的上一个进程请求交接。
+   返回继承的监听套接字数；没有上一个进程返回0；交接中途失败返回-1（已收到的连接被关闭） */
+int handoff_receive(const char *path)
+{
+	HandoffHello hello = {HANDOFF_MAGIC, HANDOFF_VERSION, sizeof(HandoffRecord), 0, 0};
+	socket_t fd;
+
+	if (!path || !path[0])
+		return 0;
+	fd = connect_predecessor(path);
+	if (SOCKET_IS_INVALID(fd))
+		return 0;
+
+	LOG_INFO("Requesting handoff from running server at %s", path);
+	if (send_all(fd, (const char *)&hello, sizeof(hello)) != 0)
+	{
+		platform_socket_close(fd);
+		return -1;
+	}
+
+	int listeners = recv_with_fds(fd, &hello, sizeof(hello), inherited, HANDOFF_MAX_FDS);
+	if (listeners < 0 || !hello_valid(&hello) || listeners != (int)hello.listeners || listeners == 0)
+	{
+		LOG_ERROR("Handoff refused or incompatible (got %d listeners)", listeners);
+		for (int i = 0; i < listeners; i++)
+			platform_socket_close(inherited[i]);
+		platform_socket_close(fd);
+		return -1;
+	}
+	inherited_count = listeners;
+
+	uint32_t received = 0;
+	while (received < hello.clients)
+	{
+		HandoffBatch batch;
+		socket_t fds[HANDOFF_MAX_FDS];
+		int count = recv_with_fds(fd, &batch, sizeof(batch), fds, HANDOFF_MAX_FDS);
+		char *buf = NULL;
+
+		if (count >= 0 && (uint32_t)count == batch.fds && batch.bytes > 0)
+			buf = (char *)malloc(batch.bytes);
+		if (!buf || recv_all(fd, buf, batch.bytes) != 0 || parse_batch(buf, batch.bytes, fds, count) != 0)
+		{
+			LOG_ERROR("Handoff interrupted after %u of %u clients", received, hello.clients);
+			for (int i = 0; i < count; i++)
+			{
+				int taken = 0;
+				for (int j = 0; j < client_count && !taken; j++)
+					taken = clients[j].fd == fds[i];
+				if (!taken)
+					platform_socket_close(fds[i]);
+			}
+			free(buf);
+			free_clients();
+			for (int i = 0; i < inherited_count; i++)
+				platform_socket_close(inherited[i]);
+			inherited_count = 0;
+			platform_socket_close(fd);
+			return -1;
+		}
+		free(buf);
+		received += (uint32_t)count;
+	}
+
+	send_all(fd, (const char *)&received, sizeof(received));
+	platform_socket_close(fd);
+	LOG_INFO("Handoff received: %d listeners, %u clients", inherited_count, received);
+	return inherited_count;
+}
+
+/* 公共接口：获取继承的监听套接字 */
+const socket_t *handoff_listeners(int *count)
+{
+	if (count)
+		*count = inherited_count;
+	return inherited;
+}
+
+/* 公共接口：获取第 index 个待恢复客户端的套接字，超出范围返回 SOCKET_INVALID */
+socket_t handoff_client_fd(int index)
+{
+	socket_t fd = SOCKET_INVALID;
+
+	platform_mutex_lock(&clients_lock);
+	if (index >= 0 && index < client_count)
+		fd = clients[index].fd;
+	platform_mutex_unlock(&clients_lock);
+	return fd;
+}
+
+/* 公共接口：在调用线程的分片上恢复第 index 个客户端（套接字已登记到事件循环），
+   然后分发缓冲区中已经完整的帧。成功返回0 */
+int handoff_restore(int index)
+{
+	Client saved;
+	ClientInfo info;
+	HandoffClient hc;
+
+	platform_mutex_lock(&clients_lock);
+	if (index < 0 || index >= client_count)
+	{
+		platform_mutex_unlock(&clients_lock);
+		return -1;
+	}
+	hc = clients[index];
+	clients[index].fd = SOCKET_INVALID;
+	clients[index].data = NULL;
+	platform_mutex_unlock(&clients_lock);
+
+	memset(&saved, 0, sizeof(saved));
+	saved.user_id = hc.record.user_id;
+	saved.status = hc.record.status;
+	saved.protocol_version = hc.record.protocol_version;
+	saved.last_active = (time_t)hc.record.last_active;
+	safe_strcpy(saved.username, hc.record.username, sizeof(saved.username));
+	memset(&info, 0, sizeof(info));
+	info.remote_port = hc.record.remote_port;
+	info.connect_time = (time_t)hc.record.connect_time;
+	safe_strcpy(info.remote_ip, hc.record.remote_ip, sizeof(info.remote_ip));
+
+	int result = connection_manager_restore(hc.fd, &saved, &info, hc.data, hc.record.unread_len,
+											hc.data ? hc.data + hc.record.unread_len : NULL, hc.record.unsent_len);
+	free(hc.data);
+	if (result == 0)
+		client_handler_resume(hc.fd);
+	return result;
+}
+
+/* 等待继任者的线程：收到合法的交接请求后停止服务器，由主线程在事件循环退出后发送 */
+static platform_thread_return_t PLATFORM_THREAD_CALL listener_main(void *arg)
+{
+	(void)arg;
+
+	while (atomic_load(&listener_running))
+	{
+		if (wait_readable(listen_fd, HANDOFF_POLL_MS) <= 0)
+			continue;
+
+		socket_t fd = accept(listen_fd, NULL, NULL);
+		if (SOCKET_IS_INVALID(fd))
+			continue;
+
+		HandoffHello hello;
+		if (recv_all(fd, (char *)&hello, sizeof(hello)) != 0 || !hello_valid(&hello))
+		{
+			LOG_WARN("Ignoring invalid handoff request");
+			platform_socket_close(fd);
+			continue;
+		}
+
+		LOG_INFO("Successor connected, handing off connections");
+		successor_fd = fd;
+		atomic_store(&handoff_pending, 1);
+		tcp_server_request_stop();
+		connection_manager_wake_all();
+		break;
+	}
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/* 公共接口：在 path 上等待继任者，成功返回0 */
+int handoff_listen(const char *path)
+{
+	struct sockaddr_un addr;
+
+	if (!path || !path[0] || strlen(path) >= sizeof(addr.sun_path) || atomic_load(&listener_running))
+		return -1;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (SOCKET_IS_INVALID(listen_fd))
+		return -1;
+
+	/* 上一个进程已经交接完毕（或异常退出），留下的套接字文件不再有人监听 */
+	unlink(path);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, strlen(path));
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 1) < 0)
+	{
+		LOG_ERROR("Failed to listen for handoff on %s: %s", path, platform_socket_error_message());
+		platform_socket_close(listen_fd);
+		listen_fd = SOCKET_INVALID;
+		return -1;
+	}
+	safe_strcpy(listen_path, path, sizeof(listen_path));
+
+	atomic_store(&listener_running, 1);
+	if (platform_thread_create(&listener_thread, listener_main, NULL) != 0)
+	{
+		atomic_store(&listener_running, 0);
+		platform_socket_close(listen_fd);
+		listen_fd = SOCKET_INVALID;
+		unlink(path);
+		return -1;
+	}
+	LOG_INFO("Waiting for successor on %s", path);
+	return 0;
+}
+
+/* 公共接口：是否有继任者在等待交接 */
+int handoff_requested(void)
+{
+	return atomic_load(&handoff_pending);
+}
+
+/* 公共接口：事件循环停止时保存一个要交出的客户端，套接字保持打开。
+   可在多个 reactor 线程上同时调用。成功返回0 */
+int handoff_export(Client *c)
+{
+	const ClientInfo *info = connection_manager_info(c);
+	char *unread = NULL;
+	size_t unread_len = frame_buffer_peek(&c->recv_buffer, &unread);
+	size_t unsent_len = send_queue_bytes(&c->send_queue);
+	char *data = NULL;
+
+	if (unread_len + unsent_len > 0)
+	{
+		data = (char *)malloc(unread_len + unsent_len);
+		if (!data)
+			return -1;
+		memcpy(data, unread, unread_len);
+		send_queue_copy(&c->send_queue, data + unread_len, unsent_len);
+	}
+
+	platform_mutex_lock(&clients_lock);
+	HandoffClient *hc = append_client();
+	if (hc)
+	{
+		hc->fd = c->sockfd;
+		hc->data = data;
+		hc->record.user_id = c->user_id;
+		hc->record.status = c->status;
+		hc->record.protocol_version = c->protocol_version;
+		hc->record.remote_port = info ? info->remote_port : 0;
+		hc->record.connect_time = info ? (int64_t)info->connect_time : (int64_t)c->last_active;
+		hc->record.last_active = (int64_t)c->last_active;
+		hc->record.unread_len = (uint32_t)unread_len;
+		hc->record.unsent_len = (uint32_t)unsent_len;
+		safe_strcpy(hc->record.username, c->username, sizeof(hc->record.username));
+		if (info)
+			safe_strcpy(hc->record.remote_ip, info->remote_ip, sizeof(hc->record.remote_ip));
+	}
+	platform_mutex_unlock(&clients_lock);
+	if (!hc)
+	{
+		free(data);
+		return -1;
+	}
+	return 0;
+}
+
+/* 公共接口：把监听套接字和全部保存的客户端发给继任者，然后关闭本进程的副本
+   （继任者持有的副本使连接保持打开）。在所有事件循环停止后由主线程调用，成功返回0 */
+int handoff_send(void)
+{
+	HandoffHello hello = {HANDOFF_MAGIC, HANDOFF_VERSION, sizeof(HandoffRecord), 0, 0};
+	socket_t listeners[HANDOFF_MAX_FDS];
+	int result = 0;
+
+	if (!atomic_load(&handoff_pending) || SOCKET_IS_INVALID(successor_fd))
+		return -1;
+
+	hello.listeners = (uint32_t)tcp_server_listener_count();
+	if (hello.listeners > HANDOFF_MAX_FDS)
+		hello.listeners = HANDOFF_MAX_FDS;
+	for (uint32_t i = 0; i < hello.listeners; i++)
+		listeners[i] = tcp_server_get_listener((int)i);
+
+	platform_mutex_lock(&clients_lock);
+	hello.clients = (uint32_t)client_count;
+	if (send_with_fds(successor_fd, &hello, sizeof(hello), listeners, (int)hello.listeners) != 0)
+		result = -1;
+
+	for (int start = 0; result == 0 && start < client_count; start += HANDOFF_MAX_FDS)
+	{
+		int count = client_count - start < HANDOFF_MAX_FDS ? client_count - start : HANDOFF_MAX_FDS;
+		HandoffBatch batch = {(uint32_t)count, 0};
+		socket_t fds[HANDOFF_MAX_FDS];
+
+		for (int i = 0; i < count; i++)
+		{
+			const HandoffRecord *record = &clients[start + i].record;
+			batch.bytes += (uint32_t)(sizeof(HandoffRecord) + record->unread_len + record->unsent_len);
+			fds[i] = clients[start + i].fd;
+		}
+
+		char *buf = (char *)malloc(batch.bytes);
+		if (!buf)
+		{
+			result = -1;
+			break;
+		}
+		size_t offset = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const HandoffClient *hc = &clients[start + i];
+			size_t data_len = (size_t)hc->record.unread_len + hc->record.unsent_len;
+			memcpy(buf + offset, &hc->record, sizeof(HandoffRecord));
+			offset += sizeof(HandoffRecord);
+			if (data_len > 0)
+				memcpy(buf + offset, hc->data, data_len);
+			offset += data_len;
+		}
+		if (send_with_fds(successor_fd, &batch, sizeof(batch), fds, count) != 0 ||
+			send_all(successor_fd, buf, batch.bytes) != 0)
+			result = -1;
+		free(buf);
+	}
+	int sent = client_count;
+	platform_mutex_unlock(&clients_lock);
+
+	uint32_t acked = 0;
+	if (result == 0 && recv_all(successor_fd, (char *)&acked, sizeof(acked)) != 0)
+		result = -1;
+	if (result == 0)
+		LOG_INFO("Handoff complete: %u listeners, %d clients, %u acknowledged", hello.listeners, sent, acked);
+	else
+		LOG_ERROR("Handoff to successor failed, %d clients will be disconnected", sent);
+
+	free_clients();
+	platform_socket_close(successor_fd);
+	successor_fd = SOCKET_INVALID;
+	return result;
+}
+
+/* 公共接口：停止等待继任者。已交接时套接字文件归继任者所有，不删除 */
+void handoff_stop(void)
+{
+	if (atomic_load(&listener_running))
+	{
+		atomic_store(&listener_running, 0);
+		platform_thread_join(listener_thread);
+		platform_socket_close(listen_fd);
+		listen_fd = SOCKET_INVALID;
+		if (!atomic_load(&handoff_pending))
+			unlink(listen_path);
+	}
+	if (SOCKET_IS_VALID(successor_fd))
+	{
+		platform_socket_close(successor_fd);
+		successor_fd = SOCKET_INVALID;
+	}
+	free_clients();
+}
+
+#else
+
+/* Windows 没有 SCM_RIGHTS，不支持交接，每次都是全新启动 */
+int handoff_receive(const char *path)
+{
+	(void)path;
+	return 0;
+}
+
+const socket_t *handoff_listeners(int *count)
+{
+	if (count)
+		*count = inherited_count;
+	return inherited;
+}
+
+socket_t handoff_client_fd(int index)
+{
+	(void)index;
+	return SOCKET_INVALID;
+}
+
+int handoff_restore(int index)
+{
+	(void)index;
+	return -1;
+}
+
+int handoff_listen(const char *path)
+{
+	(void)path;
+	LOG_WARN("Connection handoff is not supported on Windows");
+	return -1;
+}
+
+int handoff_requested(void)
+{
+	return 0;
+}
+
+int handoff_export(Client *c)
+{
+	(void)c;
+	return -1;
+}
+
+int handoff_send(void)
+{
+	return -1;
+}
+
+void handoff_stop(void)
+{
+}
+
+#endif
@@ -0,0 +1,168 @@
+// network/metrics_endpoint.c
+/* 指标抓取端点：在单独的端口上用一个后台线程回答 HTTP GET，返回 Prometheus 文本格式的服务器指标。
+   抓取频率很低（通常每几秒一次），逐个连接同步处理，读请求、写结果、关闭，不经过 reactor，
+   聊天连接的事件循环不受影响。指标本身按线程分块记录，生成抓取结果时不会阻塞记录方 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "network.h"
+#include "../core/core.h"
+
+#define METRICS_SCRAPE_BYTES (64 * 1024) // 抓取结果的最大字节数
+#define METRICS_REQUEST_BYTES 1024		 // 只读取请求头的前这么多字节
+#define METRICS_POLL_MS 500				 // 等待连接的超时，到时检查是否需要停止
+
+static socket_t listen_fd = SOCKET_INVALID;
+static platform_thread_t endpoint_thread;
+static atomic_int endpoint_running = 0;
+
+/* 等待套接字可读，超时返回0 */
+static int wait_readable(socket_t fd, int timeout_ms)
+{
+	fd_set readfds;
+	struct timeval tv;
+
+	FD_ZERO(&readfds);
+	FD_SET(fd, &readfds);
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	return select(platform_select_nfds(fd), &readfds, NULL, NULL, &tv);
+}
+
+/* 写出全部数据，出错返回-1 */
+static int send_all(socket_t fd, const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		socket_io_result_t sent = platform_socket_send(fd, data, len);
+		if (sent <= 0)
+		{
+			if (sent < 0 && platform_socket_interrupted())
+				continue;
+			return -1;
+		}
+		data += sent;
+		len -= (size_t)sent;
+	}
+	return 0;
+}
+
+/* 回答一次抓取：读到请求头结束（或超时），不区分路径，任何 GET 都返回全部指标 */
+static void serve_scrape(socket_t fd, char *scrape)
+{
+	char request[METRICS_REQUEST_BYTES];
+	size_t got = 0;
+
+	while (got < sizeof(request) - 1 && wait_readable(fd, 1000) > 0)
+	{
+		socket_io_result_t n = platform_socket_recv(fd, request + got, sizeof(request) - 1 - got);
+		if (n <= 0)
+			break;
+		got += (size_t)n;
+		request[got] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+			break;
+	}
+
+	if (got < 4 || strncmp(request, "GET ", 4) != 0)
+	{
+		static const char bad_request[] = "HTTP/1.0 405 Method Not Allowed\r\nAllow: GET\r\nContent-Length: 0\r\n\r\n";
+		send_all(fd, bad_request, sizeof(bad_request) - 1);
+		return;
+	}
+
+	size_t len = server_stats_scrape(scrape, METRICS_SCRAPE_BYTES);
+	char header[128];
+	int header_len = snprintf(header, sizeof(header),
+							  "HTTP/1.0 200 OK\r\n"
+							  "Content-Type: text/plain; version=0.0.4\r\n"
+							  "Content-Length: %zu\r\n\r\n",
+							  len);
+	if (header_len > 0 && send_all(fd, header, (size_t)header_len) == 0)
+		send_all(fd, scrape, len);
+}
+
+/* 端点线程：每隔 METRICS_POLL_MS 检查一次停止标志 */
+static platform_thread_return_t PLATFORM_THREAD_CALL endpoint_main(void *arg)
+{
+	char *scrape = (char *)arg;
+
+	while (atomic_load(&endpoint_running))
+	{
+		if (wait_readable(listen_fd, METRICS_POLL_MS) <= 0)
+			continue;
+
+		socket_t fd = accept(listen_fd, NULL, NULL);
+		if (SOCKET_IS_INVALID(fd))
+			continue;
+		serve_scrape(fd, scrape);
+		platform_socket_close(fd);
+	}
+
+	free(scrape);
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/* 在 port 上启动指标抓取端点，成功返回0 */
+int metrics_endpoint_start(int port)
+{
+	if (atomic_load(&endpoint_running))
+		return -1;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (SOCKET_IS_INVALID(listen_fd))
+	{
+		LOG_ERROR("Failed to create metrics socket: %s", platform_socket_error_message());
+		return -1;
+	}
+
+	int opt = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = INADDR_ANY;
+	addr.sin_port = htons(port);
+
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0)
+	{
+		LOG_ERROR("Failed to listen for metrics on port %d: %s", port, platform_socket_error_message());
+		platform_socket_close(listen_fd);
+		listen_fd = SOCKET_INVALID;
+		return -1;
+	}
+
+	char *scrape = (char *)malloc(METRICS_SCRAPE_BYTES);
+	if (!scrape)
+	{
+		platform_socket_close(listen_fd);
+		listen_fd = SOCKET_INVALID;
+		return -1;
+	}
+
+	atomic_store(&endpoint_running, 1);
+	if (platform_thread_create(&endpoint_thread, endpoint_main, scrape) != 0)
+	{
+		atomic_store(&endpoint_running, 0);
+		free(scrape);
+		platform_socket_close(listen_fd);
+		listen_fd = SOCKET_INVALID;
+		return -1;
+	}
+
+	LOG_INFO("Metrics endpoint listening on port %d", port);
+	return 0;
+}
+
+/* 停止指标抓取端点，等待线程退出（最多 METRICS_POLL_MS 加上正在处理的抓取） */
+void metrics_endpoint_stop(void)
+{
+	if (!atomic_load(&endpoint_running))
+		return;
+
+	atomic_store(&endpoint_running, 0);
+	platform_thread_join(endpoint_thread);
+	platform_socket_close(listen_fd);
+	listen_fd = SOCKET_INVALID;
+}
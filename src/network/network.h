@@ -10,41 +10,137 @@
 
 /* ================ 网络常量定义 ================ */
 #define DEFAULT_PORT 8080
-#define MAX_CLIENTS 100
+#define MAX_CLIENTS 10000
 #define BUFFER_SIZE 4096
-#define SELECT_TIMEOUT 5 // select超时时间（秒）
+#define SELECT_TIMEOUT 5 // 事件等待超时时间（秒）
+#define EVENT_LOOP_TICK_MS 100 // 事件循环时间轮的刻度（毫秒）
+#define MAX_REACTORS 64	 // 多 reactor 模式的最大线程数
+#define ACCEPT_BURST_MAX 64 // 监听套接字一次可读最多接受的连接数，其余留到下一轮，已有连接不会被饿死
+#define LOCAL_ADDRESS_PREFIX "unix:" // tcp_connect 的地址以此开头时连接本机的 Unix 套接字，后面为路径
+#define LOCAL_PEER_NAME "unix"	 // 经 Unix 套接字接入的连接显示的对端地址
+
+/* ================ 就绪通知后端 ================ */
+#define POLLER_EVENT_READ 0x01	 // 可读
+#define POLLER_EVENT_WRITE 0x02	 // 可写
+#define POLLER_EVENT_ERROR 0x04	 // 错误/挂断
+#define POLLER_DEFAULT_BATCH 256 // 单次等待最多返回的事件数
+
+typedef struct
+{
+	socket_t fd; // 就绪的套接字
+	int events;	 // POLLER_EVENT_* 位组合
+} PollerEvent;
+
+typedef struct Poller Poller;
+
+/* ================ io_uring 收发引擎 ================ */
+#define URING_DEFAULT_ENTRIES 1024 // 提交队列长度
+#define URING_DRAIN_MS 1000		   // 停止时等待已提交的发送完成的最长时间（毫秒）
+
+#define URING_EVENT_ACCEPT 1 // 接受了新连接，fd 为新套接字
+#define URING_EVENT_WAKEUP 2 // 监视的套接字可读
+#define URING_EVENT_DATA 3	 // 收到数据 data/len，只在 handler 返回前有效
+#define URING_EVENT_CLOSED 4 // 对端关闭（error 为0）或收发出错（error 为错误码），应关闭连接
+
+typedef struct
+{
+	int type;		  // URING_EVENT_*
+	socket_t fd;	  // 事件所属的套接字
+	const char *data; // 收到的数据
+	size_t len;		  // 数据长度
+	int error;		  // 错误码
+} UringEvent;
+
+typedef struct UringEngine UringEngine;
+typedef void (*UringHandler)(const UringEvent *event);
 
 /* ================ 函数声明 ================ */
 
 /* TCP服务器函数 */
+void tcp_server_set_options(const SocketOptions *options);
 int tcp_server_init(int port);
+int tcp_server_init_listeners(int port, int listeners);
+int tcp_server_adopt_listeners(const socket_t *fds, int count, int listeners);
+int tcp_server_init_local(const char *path);
 int tcp_server_start(void);
 void tcp_server_stop(void);
 socket_t tcp_server_get_fd(void);
+socket_t tcp_server_get_listener(int index);
+int tcp_server_listener_count(void);
+socket_t tcp_server_get_local(void);
 int tcp_server_is_running(void);
+void tcp_server_request_stop(void);
+socket_t tcp_server_accept(socket_t listener, char *ip, size_t ip_size, int *port);
+
+/* 就绪通知函数（epoll/kqueue/select） */
+Poller *poller_create(int capacity_hint);
+void poller_destroy(Poller *poller);
+int poller_add(Poller *poller, socket_t fd, int events);
+int poller_modify(Poller *poller, socket_t fd, int events);
+int poller_remove(Poller *poller, socket_t fd);
+int poller_wait(Poller *poller, PollerEvent *events, int max_events, int timeout_ms);
+const char *poller_backend_name(void);
+int poller_max_fds(void);
+
+/* io_uring 收发引擎（仅 Linux，不支持时 uring_create 返回 NULL）；
+   可以为 TCP 和本机 Unix 套接字各调用一次 uring_watch_accept */
+UringEngine *uring_create(int entries);
+void uring_destroy(UringEngine *ring);
+int uring_watch_accept(UringEngine *ring, socket_t listener);
+int uring_watch_readable(UringEngine *ring, socket_t fd);
+int uring_add(UringEngine *ring, socket_t fd);
+int uring_remove(UringEngine *ring, socket_t fd);
+void uring_set_reading(UringEngine *ring, socket_t fd, int enable);
+void uring_queue_send(UringEngine *ring, socket_t fd);
+int uring_wait(UringEngine *ring, int timeout_ms, UringHandler handler);
+void uring_cancel_all(UringEngine *ring);
+int uring_pending(const UringEngine *ring);
 
 /* 事件循环函数 */
-void event_loop_init(void);
+int event_loop_init(int max_clients);
 void event_loop_run(socket_t server_fd);
 void event_loop_stop(void);
 void event_loop_remove_fd(socket_t client_fd);
+void event_loop_set_reading(socket_t client_fd, int enable);
+int event_loop_run_reactors(int reactors, int max_clients);
+void event_loop_adopt(int index, int count);
+void event_loop_set_idle_timeout(int seconds);
+void event_loop_use_io_uring(int enable);
+TimerWheel *event_loop_timers(void);
 
 /* 客户端处理函数 */
 void client_handler_init(void);
 void client_handler_handle(socket_t client_fd);
+void client_handler_deliver(socket_t client_fd, const char *data, size_t len);
+void client_handler_resume(socket_t client_fd);
 void client_handler_send(socket_t client_fd, const char *data);
 void client_handler_broadcast(const char *data, socket_t exclude_fd);
 void client_handler_close(socket_t client_fd);
 
-/* TCP客户端函数 */
+/* 进程交接：监听套接字、客户端套接字和连接记录经 Unix 套接字交给新进程（仅 POSIX） */
+int handoff_receive(const char *path);
+const socket_t *handoff_listeners(int *count);
+socket_t handoff_client_fd(int index);
+int handoff_restore(int index);
+int handoff_listen(const char *path);
+int handoff_requested(void);
+int handoff_export(Client *c);
+int handoff_send(void);
+void handoff_stop(void);
+
+/* 指标抓取端点（Prometheus 文本格式） */
+int metrics_endpoint_start(int port);
+void metrics_endpoint_stop(void);
+
+/* TCP客户端函数；地址为 unix:<路径> 时改为连接本机 Unix 套接字（仅 POSIX） */
 socket_t tcp_connect(const char *server_ip, int server_port);
 int tcp_send(socket_t sockfd, const char *data, size_t len);
+int tcp_wait_writable(socket_t sockfd, int timeout_ms);
 int tcp_receive(socket_t sockfd, char *buffer, size_t buffer_size);
 void tcp_close(socket_t sockfd);
 
 /* 网络工具函数 */
 int set_socket_nonblocking(socket_t sockfd);
-const char *get_client_ip(socket_t client_fd);
-int get_client_port(socket_t client_fd);
+int get_client_address(socket_t client_fd, char *ip, size_t ip_size, int *port);
 
 #endif /* NETWORK_H */
@@ -2,7 +2,8 @@
  * @file tcp_client.c
  * @brief TCP客户端实现
  *
- * 实现TCP客户端连接功能，用于连接到服务器。
+ * 实现TCP客户端连接功能，用于连接到服务器。地址为 unix:<路径> 时连接同机服务端的
+ * Unix 套接字，之后的收发与 TCP 连接相同。
  */
 
 #include <stdio.h>
@@ -10,6 +11,12 @@
 #include <string.h>
 #include "network.h"
 #include "../utils/utils.h"
+#ifndef _WIN32
+#include <sys/un.h>
+#endif
+
+/** 发送缓冲区满时等待可写的最长时间 */
+#define TCP_SEND_TIMEOUT_MS 5000
 
 /**
  * @brief 创建TCP套接字
@@ -96,6 +103,57 @@ static int connect_to_server(socket_t sockfd, const char *server_ip, int server_
 	return 0;
 }
 
+/**
+ * @brief 连接同机服务端的 Unix 套接字
+ *
+ * 本机连接立即完成或立即失败（监听队列已满时返回 EAGAIN），先以阻塞方式连接，
+ * 成功后再设为非阻塞。
+ *
+ * @param path 套接字路径
+ * @return socket_t 成功返回非阻塞的套接字，失败返回 SOCKET_INVALID
+ */
+static socket_t connect_local(const char *path)
+{
+#ifndef _WIN32
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		LOG_ERROR("Local socket path too long: %s", path);
+		return SOCKET_INVALID;
+	}
+
+	socket_t sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (SOCKET_IS_INVALID(sockfd))
+	{
+		LOG_ERROR("Failed to create socket: %s", platform_socket_error_message());
+		return SOCKET_INVALID;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, strlen(path));
+	if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		LOG_ERROR("Failed to connect to %s: %s", path, platform_socket_error_message());
+		platform_socket_close(sockfd);
+		return SOCKET_INVALID;
+	}
+	if (platform_socket_set_nonblocking(sockfd) < 0)
+	{
+		LOG_ERROR("Failed to set non-blocking mode: %s", platform_socket_error_message());
+		platform_socket_close(sockfd);
+		return SOCKET_INVALID;
+	}
+
+	LOG_INFO("Connected to local server %s", path);
+	return sockfd;
+#else
+	LOG_ERROR("Local sockets are not supported on this platform: %s", path);
+	return SOCKET_INVALID;
+#endif
+}
+
 socket_t tcp_connect(const char *server_ip, int server_port)
 {
 	socket_t sockfd;
@@ -106,6 +164,20 @@ socket_t tcp_connect(const char *server_ip, int server_port)
 		return SOCKET_INVALID;
 	}
 
+	// unix:<路径>：同机服务端的 Unix 套接字，端口不使用
+	if (strncmp(server_ip, LOCAL_ADDRESS_PREFIX, strlen(LOCAL_ADDRESS_PREFIX)) == 0)
+	{
+		if (platform_socket_init() < 0)
+		{
+			LOG_ERROR("Failed to initialize socket layer");
+			return SOCKET_INVALID;
+		}
+		sockfd = connect_local(server_ip + strlen(LOCAL_ADDRESS_PREFIX));
+		if (SOCKET_IS_INVALID(sockfd))
+			platform_socket_cleanup();
+		return sockfd;
+	}
+
 	if (platform_socket_init() < 0)
 	{
 		LOG_ERROR("Failed to initialize socket layer");
@@ -132,6 +204,31 @@ socket_t tcp_connect(const char *server_ip, int server_port)
 	return sockfd;
 }
 
+/**
+ * @brief 等待套接字可写
+ *
+ * 非阻塞套接字的发送缓冲区满时用于等待，代替反复重试。
+ *
+ * @param sockfd 套接字描述符
+ * @param timeout_ms 最长等待毫秒数
+ * @return int 可写（或等待被信号打断，调用方重试即可）返回1，超时返回0，出错返回-1
+ */
+int tcp_wait_writable(socket_t sockfd, int timeout_ms)
+{
+	fd_set write_fds;
+	struct timeval timeout;
+
+	FD_ZERO(&write_fds);
+	FD_SET(sockfd, &write_fds);
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+	int ready = select(platform_select_nfds(sockfd), NULL, &write_fds, NULL, &timeout);
+	if (ready < 0)
+		return platform_socket_interrupted() ? 1 : -1;
+	return ready > 0 ? 1 : 0;
+}
+
 int tcp_send(socket_t sockfd, const char *data, size_t len)
 {
 	if (SOCKET_IS_INVALID(sockfd) || !data || len == 0)
@@ -150,7 +247,12 @@ int tcp_send(socket_t sockfd, const char *data, size_t len)
 		{
 			if (platform_socket_would_block())
 			{
-				// 非阻塞模式下，稍后重试
+				// 发送缓冲区已满，等待可写后重试，不忙等
+				if (tcp_wait_writable(sockfd, TCP_SEND_TIMEOUT_MS) <= 0)
+				{
+					LOG_ERROR("Socket not writable within %d ms", TCP_SEND_TIMEOUT_MS);
+					return -1;
+				}
 				continue;
 			}
 			else
@@ -6,9 +6,27 @@
 #include <signal.h>
 #endif
 #include "network.h"
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/* 监听套接字：单 reactor 时只有一个；多 reactor 且支持 SO_REUSEPORT 时每个 reactor 一个 */
+#define MAX_LISTENERS 64
 
 static socket_t server_fd = SOCKET_INVALID;
+static socket_t extra_listeners[MAX_LISTENERS - 1];
+static int listener_count = 0;
+/* 本机客户端的 Unix 套接字监听：所有 reactor 共享一个，与 TCP 监听套接字一起注册 */
+static socket_t local_fd = SOCKET_INVALID;
+static char local_path[MAX_FILENAME_LEN];
+#ifndef _WIN32
+static ino_t local_inode = 0; // 本进程创建的套接字文件，退出时只删除自己的（交接后路径已属于继任者）
+#endif
 static volatile int server_running = 0;
+static SocketOptions socket_options = {.tcp_nodelay = 1};
 
 #ifndef _WIN32
 /* 信号处理函数 */
@@ -33,8 +51,98 @@ static void setup_signals(void)
 }
 #endif
 
-/* 初始化TCP服务器 */
-int tcp_server_init(int port)
+/* 设置监听套接字和新连接使用的选项，在初始化或接管监听套接字之前调用 */
+void tcp_server_set_options(const SocketOptions *options)
+{
+	if (options)
+		socket_options = *options;
+}
+
+/* 把套接字选项设置到监听套接字上：接受的连接继承 TCP_NODELAY 和缓冲区大小，每个连接不再单独 setsockopt；
+   接收缓冲区须在 listen 之前设置，窗口缩放因子在握手时确定。设置失败只记录警告 */
+static void apply_listener_options(socket_t fd)
+{
+	int opt;
+
+	if (socket_options.tcp_nodelay)
+	{
+		opt = 1;
+		if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&opt, sizeof(opt)) < 0)
+			LOG_WARN("Failed to set TCP_NODELAY: %s", platform_socket_error_message());
+	}
+	if (socket_options.send_buffer > 0)
+	{
+		opt = socket_options.send_buffer;
+		if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (const char *)&opt, sizeof(opt)) < 0)
+			LOG_WARN("Failed to set SO_SNDBUF: %s", platform_socket_error_message());
+	}
+	if (socket_options.recv_buffer > 0)
+	{
+		opt = socket_options.recv_buffer;
+		if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const char *)&opt, sizeof(opt)) < 0)
+			LOG_WARN("Failed to set SO_RCVBUF: %s", platform_socket_error_message());
+	}
+	if (socket_options.defer_accept_seconds > 0)
+	{
+#ifdef TCP_DEFER_ACCEPT
+		/* 三次握手完成后还要等到首个数据包才进入 accept 队列，只连不发的连接不占用连接槽位 */
+		opt = socket_options.defer_accept_seconds;
+		if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, (const char *)&opt, sizeof(opt)) < 0)
+			LOG_WARN("Failed to set TCP_DEFER_ACCEPT: %s", platform_socket_error_message());
+#else
+		LOG_WARN("TCP_DEFER_ACCEPT is not supported on this platform");
+#endif
+	}
+}
+
+/* 创建并绑定一个监听套接字，reuseport 为真时允许与其他监听套接字共用端口 */
+static socket_t open_listener(int port, int reuseport)
+{
+	socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (SOCKET_IS_INVALID(fd))
+	{
+		LOG_ERROR("Failed to create socket: %s", platform_socket_error_message());
+		return SOCKET_INVALID;
+	}
+
+	// 设置SO_REUSEADDR选项
+	int opt = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt)) < 0)
+	{
+		LOG_ERROR("Failed to set SO_REUSEADDR: %s", platform_socket_error_message());
+		platform_socket_close(fd);
+		return SOCKET_INVALID;
+	}
+
+	if (reuseport && platform_socket_set_reuseport(fd) < 0)
+	{
+		LOG_WARN("SO_REUSEPORT unavailable: %s", platform_socket_error_message());
+		platform_socket_close(fd);
+		return SOCKET_INVALID;
+	}
+
+	apply_listener_options(fd);
+
+	// 绑定地址
+	struct sockaddr_in server_addr;
+	memset(&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = INADDR_ANY;
+	server_addr.sin_port = htons(port);
+
+	if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+	{
+		LOG_ERROR("Failed to bind to port %d: %s", port, platform_socket_error_message());
+		platform_socket_close(fd);
+		return SOCKET_INVALID;
+	}
+
+	return fd;
+}
+
+/* 初始化TCP服务器：listeners>1 时尝试用 SO_REUSEPORT 为每个 reactor 创建独立的监听套接字，
+   不支持时回退为单个监听套接字，由所有 reactor 共享。返回实际创建的监听套接字数，失败返回-1 */
+int tcp_server_init_listeners(int port, int listeners)
 {
 	if (SOCKET_IS_VALID(server_fd))
 	{
@@ -50,44 +158,131 @@ int tcp_server_init(int port)
 		return -1;
 	}
 
-	// 创建套接字
-	server_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listeners > MAX_LISTENERS)
+		listeners = MAX_LISTENERS;
+	int reuseport = listeners > 1;
+
+	server_fd = open_listener(port, reuseport);
+	if (SOCKET_IS_INVALID(server_fd) && reuseport)
+	{
+		reuseport = 0;
+		server_fd = open_listener(port, 0);
+	}
 	if (SOCKET_IS_INVALID(server_fd))
 	{
-		LOG_ERROR("Failed to create socket: %s", platform_socket_error_message());
 		platform_socket_cleanup();
 		return -1;
 	}
+	listener_count = 1;
 
-	// 设置SO_REUSEADDR选项
-	int opt = 1;
-	if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt)) < 0)
+	while (reuseport && listener_count < listeners)
 	{
-		LOG_ERROR("Failed to set SO_REUSEADDR: %s", platform_socket_error_message());
-		platform_socket_close(server_fd);
-		platform_socket_cleanup();
-		server_fd = SOCKET_INVALID;
+		socket_t fd = open_listener(port, 1);
+		if (SOCKET_IS_INVALID(fd))
+			break;
+		extra_listeners[listener_count - 1] = fd;
+		listener_count++;
+	}
+
+	LOG_INFO("TCP server initialized on port %d (%d listener%s)",
+			 port, listener_count, listener_count > 1 ? "s, SO_REUSEPORT" : "");
+	return listener_count;
+}
+
+/* 接管上一个进程交接过来的监听套接字，代替 tcp_server_init_listeners：
+   套接字已经绑定并在监听，队列中尚未 accept 的连接不会丢失。
+   多于 listeners 个时关闭多余的（SO_REUSEPORT 组中没有线程 accept 的套接字会滞留连接），
+   少于时多出的 reactor 共享第一个。返回接管的监听套接字数，失败返回-1 */
+int tcp_server_adopt_listeners(const socket_t *fds, int count, int listeners)
+{
+	if (SOCKET_IS_VALID(server_fd) || !fds || count < 1)
+		return -1;
+
+	setup_signals();
+
+	if (platform_socket_init() < 0)
+	{
+		LOG_ERROR("Failed to initialize socket layer");
 		return -1;
 	}
 
-	// 绑定地址
-	struct sockaddr_in server_addr;
-	memset(&server_addr, 0, sizeof(server_addr));
-	server_addr.sin_family = AF_INET;
-	server_addr.sin_addr.s_addr = INADDR_ANY;
-	server_addr.sin_port = htons(port);
+	if (listeners < 1)
+		listeners = 1;
+	if (listeners > MAX_LISTENERS)
+		listeners = MAX_LISTENERS;
 
-	if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+	server_fd = fds[0];
+	listener_count = 1;
+	apply_listener_options(server_fd);
+	for (int i = 1; i < count; i++)
 	{
-		LOG_ERROR("Failed to bind to port %d: %s", port, platform_socket_error_message());
-		platform_socket_close(server_fd);
-		platform_socket_cleanup();
-		server_fd = SOCKET_INVALID;
+		if (listener_count < listeners)
+		{
+			extra_listeners[listener_count - 1] = fds[i];
+			listener_count++;
+			apply_listener_options(fds[i]);
+		}
+		else
+		{
+			platform_socket_close(fds[i]);
+		}
+	}
+	if (count > listener_count)
+		LOG_WARN("Closed %d inherited listeners beyond %d reactors", count - listener_count, listeners);
+
+	LOG_INFO("TCP server adopted %d inherited listener%s", listener_count, listener_count > 1 ? "s" : "");
+	return listener_count;
+}
+
+/* 在 path 上创建本机客户端的 Unix 套接字监听，在 tcp_server_start 之前调用；
+   同机的机器人和桥接程序经它接入，不经过 TCP/IP 协议栈，接入后与 TCP 连接完全相同。
+   仅支持类 Unix 系统。成功返回0，失败返回-1 */
+int tcp_server_init_local(const char *path)
+{
+#ifndef _WIN32
+	struct sockaddr_un addr;
+	struct stat st;
+
+	if (!path || !path[0] || strlen(path) >= sizeof(addr.sun_path) || strlen(path) >= sizeof(local_path) ||
+		SOCKET_IS_VALID(local_fd))
+		return -1;
+
+	local_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (SOCKET_IS_INVALID(local_fd))
+	{
+		LOG_ERROR("Failed to create local socket: %s", platform_socket_error_message());
 		return -1;
 	}
 
-	LOG_INFO("TCP server initialized on port %d", port);
+	/* 上一个进程异常退出或已交接完毕时留下的套接字文件不再有人监听；路径上是其他文件时不删除 */
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, strlen(path));
+	if (bind(local_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || stat(path, &st) < 0)
+	{
+		LOG_ERROR("Failed to bind local socket %s: %s", path, platform_socket_error_message());
+		platform_socket_close(local_fd);
+		local_fd = SOCKET_INVALID;
+		return -1;
+	}
+	local_inode = st.st_ino;
+	safe_strcpy(local_path, path, sizeof(local_path));
+
+	LOG_INFO("Local socket initialized on %s", path);
 	return 0;
+#else
+	(void)path;
+	LOG_WARN("Local sockets are not supported on this platform");
+	return -1;
+#endif
+}
+
+/* 初始化TCP服务器 */
+int tcp_server_init(int port)
+{
+	return tcp_server_init_listeners(port, 1) < 0 ? -1 : 0;
 }
 
 /* 启动TCP服务器 */
@@ -99,15 +294,31 @@ int tcp_server_start(void)
 		return -1;
 	}
 
-	// 开始监听
-	if (listen(server_fd, 10) < 0)
+	// 开始监听；大量客户端同时重连时监听队列要能容纳一轮事件循环内到达的连接。
+	// 对已在监听的（交接过来的）套接字再次 listen 只更新队列长度
+	int backlog = socket_options.listen_backlog > 0 ? socket_options.listen_backlog : SOMAXCONN;
+	for (int i = 0; i < listener_count; i++)
 	{
-		LOG_ERROR("Failed to listen: %s", platform_socket_error_message());
-		return -1;
+		if (listen(tcp_server_get_listener(i), backlog) < 0)
+		{
+			LOG_ERROR("Failed to listen: %s", platform_socket_error_message());
+			return -1;
+		}
+		/* 共享监听套接字时多个 reactor 会同时被唤醒，未抢到连接的一方 accept 必须立即返回 */
+		set_socket_nonblocking(tcp_server_get_listener(i));
+	}
+	if (SOCKET_IS_VALID(local_fd))
+	{
+		if (listen(local_fd, backlog) < 0)
+		{
+			LOG_ERROR("Failed to listen on %s: %s", local_path, platform_socket_error_message());
+			return -1;
+		}
+		set_socket_nonblocking(local_fd);
 	}
 
 	server_running = 1;
-	LOG_INFO("TCP server started, listening for connections...");
+	LOG_INFO("TCP server started, listening for connections (backlog %d)...", backlog);
 	return 0;
 }
 
@@ -117,10 +328,25 @@ void tcp_server_stop(void)
 	if (SOCKET_IS_VALID(server_fd))
 	{
 		LOG_INFO("Closing server socket...");
+		for (int i = 1; i < listener_count; i++)
+		{
+			platform_socket_close(extra_listeners[i - 1]);
+		}
 		platform_socket_close(server_fd);
 		platform_socket_cleanup();
 		server_fd = SOCKET_INVALID;
+		listener_count = 0;
+	}
+#ifndef _WIN32
+	if (SOCKET_IS_VALID(local_fd))
+	{
+		struct stat st;
+		platform_socket_close(local_fd);
+		local_fd = SOCKET_INVALID;
+		if (stat(local_path, &st) == 0 && st.st_ino == local_inode)
+			unlink(local_path);
 	}
+#endif
 	server_running = 0;
 }
 
@@ -130,12 +356,67 @@ socket_t tcp_server_get_fd(void)
 	return server_fd;
 }
 
+/* 获取第 index 个监听套接字，超出范围时返回共享的主监听套接字 */
+socket_t tcp_server_get_listener(int index)
+{
+	if (index <= 0 || index >= listener_count)
+		return server_fd;
+	return extra_listeners[index - 1];
+}
+
+/* 获取监听套接字数量 */
+int tcp_server_listener_count(void)
+{
+	return listener_count;
+}
+
+/* 获取本机客户端的 Unix 套接字监听，未启用时返回无效套接字 */
+socket_t tcp_server_get_local(void)
+{
+	return local_fd;
+}
+
+/* 请求停止：与收到 SIGTERM 相同，各事件循环在下一轮等待后退出 */
+void tcp_server_request_stop(void)
+{
+	server_running = 0;
+}
+
 /* 获取服务器运行状态 */
 int tcp_server_is_running(void)
 {
 	return server_running;
 }
 
+/* 从监听套接字接受一个连接：新套接字已是非阻塞的，对端地址取自 accept 本身，不再 getpeername；
+   Unix 套接字接入的连接对端地址为 LOCAL_PEER_NAME、端口为0。
+   没有待接受的连接时返回无效套接字，其他错误记录日志后同样返回无效套接字 */
+socket_t tcp_server_accept(socket_t listener, char *ip, size_t ip_size, int *port)
+{
+	struct sockaddr_in addr;
+
+	socket_t fd = platform_socket_accept(listener, &addr);
+	if (SOCKET_IS_INVALID(fd))
+	{
+		if (!platform_socket_would_block() && !platform_socket_interrupted())
+			LOG_ERROR("Failed to accept connection: %s", platform_socket_error_message());
+		return SOCKET_INVALID;
+	}
+
+#ifdef AF_UNIX
+	if (addr.sin_family == AF_UNIX)
+	{
+		safe_strcpy(ip, LOCAL_PEER_NAME, ip_size);
+		*port = 0;
+		return fd;
+	}
+#endif
+	if (!inet_ntop(AF_INET, &addr.sin_addr, ip, (socket_len_t)ip_size))
+		safe_strcpy(ip, "unknown", ip_size);
+	*port = ntohs(addr.sin_port);
+	return fd;
+}
+
 /* 设置套接字为非阻塞模式 */
 int set_socket_nonblocking(socket_t sockfd)
 {
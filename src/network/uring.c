@@ -0,0 +1,924 @@
+/**
+ * @file uring.c
+ * @brief Linux io_uring 收发引擎
+ *
+ * 就绪通知后端每收一帧要一次 recv，每个接收者要一次 send。本引擎改为把请求
+ * 提交到 io_uring，由内核完成收发后再通知事件循环：
+ * 1. 监听套接字（以及本机客户端的 Unix 套接字）各提交一次多发 accept，之后每个新连接一个完成事件
+ * 2. 每个连接提交一次多发 recv，数据直接写入注册给内核的缓冲区环，
+ *    取出后复制进连接自己的帧缓冲区，缓冲区立即还给内核
+ * 3. 发送全部先进入连接的发送队列，事件循环每轮结束时为有积压的连接各提交一个
+ *    sendmsg（一次最多 URING_SEND_IOV 帧），与本轮的其他请求一起在一次系统调用中提交
+ *
+ * 稳定运行时每轮事件循环只有一次 io_uring_enter，与连接数和消息数无关。
+ * 内核不支持（头文件过旧、系统禁用或缺少所需特性）时 uring_create 返回 NULL，
+ * 由调用者回退到 epoll/kqueue/select。不使用 liburing，直接通过系统调用操作环。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "network.h"
+#include "../core/core.h"
+
+#if defined(__linux__) && defined(__has_include) && !defined(ITIT_NO_IO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+/* 多发 recv（6.0）的头文件同时带有缓冲区环（5.19）的定义，后者是枚举值无法直接检查 */
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define URING_SUPPORTED 1
+#endif
+#endif
+#endif
+
+#ifdef URING_SUPPORTED
+
+#include <poll.h>
+#include <sys/syscall.h>
+
+#define URING_CQ_ENTRIES 8192			/**< 完成队列长度，大量连接同时收到数据时不至于溢出 */
+#define URING_BUFFER_COUNT 512			/**< 接收缓冲区环的缓冲区数，必须是2的幂 */
+#define URING_BUFFER_SIZE BUFFER_SIZE	/**< 每个接收缓冲区的大小 */
+#define URING_BUFFER_GROUP 0			/**< 接收缓冲区环的组号 */
+#define URING_SEND_IOV 16				/**< 一次 sendmsg 最多携带的帧数 */
+#define URING_SEND_BATCH 256			/**< 一次提交最多准备的 sendmsg 数，超过时先提交一次 */
+#define URING_REAP_MAX 1024				/**< 一次等待最多处理的完成事件数，之后回到事件循环执行定时器 */
+#define URING_MAX_LISTENERS 2			/**< 可接受连接的监听套接字数：TCP 和本机 Unix 套接字 */
+
+/* 请求类型，保存在 user_data 的低3位，高位为连接记录的地址（accept 请求为监听套接字的下标） */
+enum
+{
+	OP_RECV = 1,
+	OP_SEND = 2,
+	OP_ACCEPT = 3,
+	OP_WATCH = 4,
+	OP_CANCEL = 5
+};
+#define OP_MASK 7u
+#define OP_SHIFT 3
+
+/**
+ * @brief 一个连接在引擎中的状态
+ *
+ * 连接关闭后记录保留到内核交回它的所有请求为止，迟到的完成事件不会落到
+ * 复用同一描述符的新连接上。
+ */
+typedef struct UringConn
+{
+	socket_t fd;
+	int reading;				/**< 希望接收数据（未因命令执行或限流暂停） */
+	int recv_armed;				/**< 有接收请求在内核中 */
+	int cancel_sent;			/**< 已为接收请求提交取消 */
+	int sending;				/**< 有发送请求在内核中 */
+	int dirty;					/**< 在待更新列表中 */
+	int closed;					/**< 连接已关闭，等待请求全部交回 */
+	struct UringConn *next_dirty;
+	SendQueue orphan;			/**< 关闭时仍在发送的帧，发送请求交回后释放 */
+} UringConn;
+
+struct UringEngine
+{
+	int fd;
+	/* 提交队列 */
+	void *sq_ring;
+	size_t ring_size;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_array;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned sq_local_tail;		/**< 已准备但尚未发布给内核的位置 */
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	/* 完成队列 */
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+	/* 接收缓冲区环 */
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_size;
+	char *buffers;
+	unsigned short buf_tail;
+	/* 发送用的分散写描述，提交后内核不再访问（IORING_FEAT_SUBMIT_STABLE） */
+	struct msghdr msgs[URING_SEND_BATCH];
+	platform_iovec_t iovs[URING_SEND_BATCH][URING_SEND_IOV];
+	int msgs_used;
+	/* 连接与监视的套接字 */
+	UringConn **conns;			/**< 按描述符索引 */
+	int conn_capacity;
+	UringConn *dirty;			/**< 待更新的连接 */
+	socket_t listeners[URING_MAX_LISTENERS];
+	int accept_armed[URING_MAX_LISTENERS];
+	socket_t watched;
+	int watch_armed;
+	int inflight;				/**< 内核中尚未交回的请求数（取消请求除外） */
+	int multishot_recv;			/**< 内核支持多发 recv，不支持时每次完成后重新提交 */
+	int multishot_accept;
+	int stopping;				/**< 已取消全部接收，不再提交新请求 */
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief 发布已准备的请求并进入内核
+ *
+ * @param wait 非0时等待至少一个完成事件，最多 timeout_ms 毫秒（小于0不限）
+ * @return 成功（包括超时和被信号打断）返回0，环出错返回-1
+ */
+static int ring_enter(UringEngine *ring, int wait, int timeout_ms)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned flags = 0;
+
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+	unsigned to_submit = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (to_submit == 0 && !wait)
+		return 0;
+
+	memset(&arg, 0, sizeof(arg));
+	if (wait)
+	{
+		flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+		if (timeout_ms >= 0)
+		{
+			ts.tv_sec = timeout_ms / 1000;
+			ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+		}
+	}
+
+	int ret = sys_enter(ring->fd, to_submit, wait ? 1 : 0, flags, wait ? &arg : NULL, wait ? sizeof(arg) : 0);
+	if (ret < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		return -1;
+
+	/* 请求全部被内核取走后分散写描述可以复用 */
+	if (__atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->sq_local_tail)
+		ring->msgs_used = 0;
+	return 0;
+}
+
+/**
+ * @brief 取一个空闲的提交项，提交队列满时先提交一次
+ *
+ * @return 清零的提交项，仍然没有空位返回 NULL
+ */
+static struct io_uring_sqe *get_sqe(UringEngine *ring)
+{
+	if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+	{
+		ring_enter(ring, 0, 0);
+		if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+			return NULL;
+	}
+
+	unsigned index = ring->sq_local_tail & ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[index] = index;
+	ring->sq_local_tail++;
+	return sqe;
+}
+
+static uint64_t op_data(UringConn *c, unsigned op)
+{
+	return (uint64_t)(uintptr_t)c | op;
+}
+
+/** 把缓冲区还给内核 */
+static void recycle_buffer(UringEngine *ring, unsigned short bid)
+{
+	struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_BUFFER_COUNT - 1)];
+	buf->addr = (uint64_t)(uintptr_t)(ring->buffers + (size_t)bid * URING_BUFFER_SIZE);
+	buf->len = URING_BUFFER_SIZE;
+	buf->bid = bid;
+	ring->buf_tail++;
+	__atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void mark_dirty(UringEngine *ring, UringConn *c)
+{
+	if (c->dirty)
+		return;
+	c->dirty = 1;
+	c->next_dirty = ring->dirty;
+	ring->dirty = c;
+}
+
+/** 连接已关闭且请求全部交回时释放记录 */
+static void release_conn(UringConn *c)
+{
+	if (c->closed && !c->recv_armed && !c->sending && !c->dirty)
+	{
+		send_queue_free(&c->orphan);
+		free(c);
+	}
+}
+
+static UringConn *find_conn(UringEngine *ring, socket_t fd)
+{
+	return fd >= 0 && fd < ring->conn_capacity ? ring->conns[fd] : NULL;
+}
+
+static int submit_cancel(UringEngine *ring, uint64_t target)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = target;
+	sqe->user_data = OP_CANCEL;
+	return 0;
+}
+
+static uint64_t accept_data(int index)
+{
+	return ((uint64_t)index << OP_SHIFT) | OP_ACCEPT;
+}
+
+static int submit_accept(UringEngine *ring, int index)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = ring->listeners[index];
+	sqe->ioprio = ring->multishot_accept ? IORING_ACCEPT_MULTISHOT : 0;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe->user_data = accept_data(index);
+	ring->accept_armed[index] = 1;
+	ring->inflight++;
+	return 0;
+}
+
+static int submit_watch(UringEngine *ring)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = ring->watched;
+	sqe->poll32_events = POLLIN;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = OP_WATCH;
+	ring->watch_armed = 1;
+	ring->inflight++;
+	return 0;
+}
+
+static int submit_recv(UringEngine *ring, UringConn *c)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = c->fd;
+	sqe->ioprio = ring->multishot_recv ? IORING_RECV_MULTISHOT : 0;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	sqe->user_data = op_data(c, OP_RECV);
+	c->recv_armed = 1;
+	c->cancel_sent = 0;
+	ring->inflight++;
+	return 0;
+}
+
+/**
+ * @brief 为连接的发送队列提交一个 sendmsg
+ *
+ * @return 已提交或没有积压返回0，本轮的分散写描述或提交队列已满返回-1
+ */
+static int submit_send(UringEngine *ring, UringConn *c)
+{
+	if (connection_manager_pending_bytes(c->fd) == 0)
+		return 0;
+	if (ring->msgs_used >= URING_SEND_BATCH)
+	{
+		ring_enter(ring, 0, 0);
+		if (ring->msgs_used >= URING_SEND_BATCH)
+			return -1;
+	}
+
+	/* 先取提交项：队列满时取提交项会先提交一次，可能让分散写描述从头复用 */
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	if (!sqe)
+		return -1;
+	platform_iovec_t *iov = ring->iovs[ring->msgs_used];
+	struct msghdr *msg = &ring->msgs[ring->msgs_used++];
+	memset(msg, 0, sizeof(*msg));
+	msg->msg_iov = iov;
+	msg->msg_iovlen = (size_t)connection_manager_gather(c->fd, iov, URING_SEND_IOV);
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = c->fd;
+	sqe->addr = (uint64_t)(uintptr_t)msg;
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = op_data(c, OP_SEND);
+	c->sending = 1;
+	ring->inflight++;
+	return 0;
+}
+
+/**
+ * @brief 为待更新的连接准备请求：恢复或暂停接收，提交积压的发送
+ *
+ * 提交队列暂时满的连接留在列表中，下一轮再试。
+ */
+static void update_dirty(UringEngine *ring)
+{
+	UringConn *list = ring->dirty;
+	ring->dirty = NULL;
+
+	while (list)
+	{
+		UringConn *c = list;
+		list = c->next_dirty;
+		c->dirty = 0;
+
+		if (c->closed)
+		{
+			release_conn(c);
+			continue;
+		}
+
+		int retry = 0;
+		if (c->reading && !c->recv_armed && !ring->stopping)
+			retry |= submit_recv(ring, c) < 0;
+		else if (!c->reading && c->recv_armed && !c->cancel_sent)
+		{
+			if (submit_cancel(ring, op_data(c, OP_RECV)) == 0)
+				c->cancel_sent = 1;
+			else
+				retry = 1;
+		}
+		if (!c->sending && !ring->stopping)
+			retry |= submit_send(ring, c) < 0;
+		if (retry)
+			mark_dirty(ring, c);
+	}
+
+	for (int i = 0; i < URING_MAX_LISTENERS; i++)
+	{
+		if (!ring->stopping && SOCKET_IS_VALID(ring->listeners[i]) && !ring->accept_armed[i])
+			submit_accept(ring, i);
+	}
+	if (!ring->stopping && SOCKET_IS_VALID(ring->watched) && !ring->watch_armed)
+		submit_watch(ring);
+}
+
+static void emit(UringHandler handler, int type, socket_t fd, const char *data, size_t len, int error)
+{
+	UringEvent event;
+	event.type = type;
+	event.fd = fd;
+	event.data = data;
+	event.len = len;
+	event.error = error;
+	handler(&event);
+}
+
+static void complete_recv(UringEngine *ring, UringConn *c, const struct io_uring_cqe *cqe, UringHandler handler)
+{
+	int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+	/* 请求结束的记账放在 handler 之后，handler 中注销连接时记录不会被提前释放 */
+	if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+	{
+		unsigned short bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+		if (!c->closed)
+			emit(handler, URING_EVENT_DATA, c->fd, ring->buffers + (size_t)bid * URING_BUFFER_SIZE,
+				 (size_t)cqe->res, 0);
+		recycle_buffer(ring, bid);
+	}
+	else if (cqe->res == 0)
+	{
+		if (!c->closed)
+			emit(handler, URING_EVENT_CLOSED, c->fd, NULL, 0, 0);
+	}
+	else if (cqe->res == -EINVAL && ring->multishot_recv)
+	{
+		LOG_WARN("Kernel does not support multishot recv, re-arming after each completion");
+		ring->multishot_recv = 0;
+	}
+	else if (cqe->res < 0 && cqe->res != -ECANCELED && cqe->res != -ENOBUFS)
+	{
+		if (!c->closed)
+			emit(handler, URING_EVENT_CLOSED, c->fd, NULL, 0, -cqe->res);
+	}
+
+	/* 多发请求结束（缓冲区用尽、暂停或单发）后按需重新提交 */
+	if (!more)
+	{
+		c->recv_armed = 0;
+		ring->inflight--;
+		if (c->closed)
+			release_conn(c);
+		else
+			mark_dirty(ring, c);
+	}
+}
+
+static void complete_send(UringEngine *ring, UringConn *c, const struct io_uring_cqe *cqe, UringHandler handler)
+{
+	c->sending = 0;
+	ring->inflight--;
+
+	if (c->closed)
+	{
+		release_conn(c);
+		return;
+	}
+
+	if (cqe->res < 0)
+		errno = -cqe->res;
+	int result = connection_manager_sent(c->fd, cqe->res);
+	if (result < 0)
+		emit(handler, URING_EVENT_CLOSED, c->fd, NULL, 0, 0);
+	else if (result == 0)
+		mark_dirty(ring, c);
+}
+
+static void complete_accept(UringEngine *ring, int index, const struct io_uring_cqe *cqe, UringHandler handler)
+{
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+	{
+		ring->accept_armed[index] = 0;
+		ring->inflight--;
+	}
+
+	if (cqe->res >= 0)
+	{
+		emit(handler, URING_EVENT_ACCEPT, cqe->res, NULL, 0, 0);
+	}
+	else if (cqe->res == -EINVAL && ring->multishot_accept)
+	{
+		LOG_WARN("Kernel does not support multishot accept, re-arming after each connection");
+		ring->multishot_accept = 0;
+	}
+	else if (cqe->res != -ECANCELED)
+	{
+		LOG_ERROR("Failed to accept connection: %s", platform_socket_error_message_code(-cqe->res));
+	}
+}
+
+static void complete_watch(UringEngine *ring, const struct io_uring_cqe *cqe, UringHandler handler)
+{
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+	{
+		ring->watch_armed = 0;
+		ring->inflight--;
+	}
+	if (cqe->res > 0)
+		emit(handler, URING_EVENT_WAKEUP, ring->watched, NULL, 0, 0);
+}
+
+/**
+ * @brief 创建引擎
+ *
+ * 要求内核支持单次映射、完成事件不丢失、提交即稳定、带超时的等待和缓冲区环
+ * （Linux 5.19 起）；多发 recv 需要 6.0，更旧的内核在第一次完成时自动改为单发。
+ *
+ * @param entries 提交队列长度
+ * @return 引擎，不支持或资源不足返回 NULL
+ */
+UringEngine *uring_create(int entries)
+{
+	struct io_uring_params params;
+	UringEngine *ring = (UringEngine *)safe_calloc(1, sizeof(UringEngine));
+	if (!ring)
+		return NULL;
+
+	ring->fd = -1;
+	for (int i = 0; i < URING_MAX_LISTENERS; i++)
+		ring->listeners[i] = SOCKET_INVALID;
+	ring->watched = SOCKET_INVALID;
+	ring->multishot_recv = 1;
+	ring->multishot_accept = 1;
+
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+	params.cq_entries = URING_CQ_ENTRIES;
+	ring->fd = sys_setup(entries > 0 ? (unsigned)entries : URING_DEFAULT_ENTRIES, &params);
+	if (ring->fd < 0)
+	{
+		LOG_WARN("io_uring_setup failed: %s", platform_socket_error_message());
+		goto fail;
+	}
+
+	unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_EXT_ARG;
+	if ((params.features & required) != required)
+	{
+		LOG_WARN("io_uring lacks required features (have 0x%x)", params.features);
+		goto fail;
+	}
+
+	size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+	ring->sq_ring = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						 ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED)
+	{
+		ring->sq_ring = NULL;
+		goto fail;
+	}
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+											 MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+	{
+		ring->sqes = NULL;
+		goto fail;
+	}
+
+	char *base = (char *)ring->sq_ring;
+	ring->sq_head = (unsigned *)(base + params.sq_off.head);
+	ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+	ring->sq_array = (unsigned *)(base + params.sq_off.array);
+	ring->sq_mask = *(unsigned *)(base + params.sq_off.ring_mask);
+	ring->sq_entries = params.sq_entries;
+	ring->sq_local_tail = *ring->sq_tail;
+	ring->cq_head = (unsigned *)(base + params.cq_off.head);
+	ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+	ring->cq_mask = *(unsigned *)(base + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+
+	/* 接收缓冲区环：缓冲区描述放在页对齐的匿名映射中注册给内核 */
+	ring->buf_ring_size = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+	ring->buf_ring = (struct io_uring_buf_ring *)mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE,
+													  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring->buf_ring == MAP_FAILED)
+	{
+		ring->buf_ring = NULL;
+		goto fail;
+	}
+	ring->buffers = (char *)malloc((size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+	if (!ring->buffers)
+		goto fail;
+
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+	reg.ring_entries = URING_BUFFER_COUNT;
+	reg.bgid = URING_BUFFER_GROUP;
+	if (sys_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	{
+		LOG_WARN("io_uring buffer ring registration failed: %s", platform_socket_error_message());
+		goto fail;
+	}
+	for (int i = 0; i < URING_BUFFER_COUNT; i++)
+		recycle_buffer(ring, (unsigned short)i);
+
+	return ring;
+
+fail:
+	uring_destroy(ring);
+	return NULL;
+}
+
+/**
+ * @brief 销毁引擎，关闭环后内核取消尚未交回的请求
+ */
+void uring_destroy(UringEngine *ring)
+{
+	if (!ring)
+		return;
+
+	if (ring->fd >= 0)
+	{
+		if (ring->buf_ring && ring->buffers)
+		{
+			struct io_uring_buf_reg reg;
+			memset(&reg, 0, sizeof(reg));
+			reg.bgid = URING_BUFFER_GROUP;
+			sys_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+		}
+		close(ring->fd);
+	}
+	for (int i = 0; i < ring->conn_capacity; i++)
+	{
+		if (ring->conns[i])
+		{
+			send_queue_free(&ring->conns[i]->orphan);
+			free(ring->conns[i]);
+		}
+	}
+	/* 已关闭但请求未交回的连接只在待更新列表中还能找到 */
+	while (ring->dirty)
+	{
+		UringConn *c = ring->dirty;
+		ring->dirty = c->next_dirty;
+		if (c->closed)
+		{
+			send_queue_free(&c->orphan);
+			free(c);
+		}
+	}
+	safe_free((void **)&ring->conns);
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->ring_size);
+	if (ring->buf_ring)
+		munmap(ring->buf_ring, ring->buf_ring_size);
+	free(ring->buffers);
+	free(ring);
+}
+
+/**
+ * @brief 在监听套接字上接受连接，每个新连接产生一个 URING_EVENT_ACCEPT
+ *
+ * 最多可监视 URING_MAX_LISTENERS 个监听套接字（TCP 和本机 Unix 套接字）。
+ */
+int uring_watch_accept(UringEngine *ring, socket_t listener)
+{
+	if (!ring || SOCKET_IS_INVALID(listener))
+		return -1;
+	for (int i = 0; i < URING_MAX_LISTENERS; i++)
+	{
+		if (ring->listeners[i] == listener)
+			return 0;
+		if (SOCKET_IS_INVALID(ring->listeners[i]))
+		{
+			ring->listeners[i] = listener;
+			return submit_accept(ring, i);
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief 监视套接字可读，每次可读产生一个 URING_EVENT_WAKEUP（用于分片唤醒管道）
+ */
+int uring_watch_readable(UringEngine *ring, socket_t fd)
+{
+	if (!ring || SOCKET_IS_INVALID(fd))
+		return -1;
+	ring->watched = fd;
+	return submit_watch(ring);
+}
+
+/**
+ * @brief 登记连接并开始接收，请求在下一次 uring_wait 时提交
+ */
+int uring_add(UringEngine *ring, socket_t fd)
+{
+	if (!ring || SOCKET_IS_INVALID(fd))
+		return -1;
+
+	if (fd >= ring->conn_capacity)
+	{
+		int capacity = ring->conn_capacity > 0 ? ring->conn_capacity : 1024;
+		while (capacity <= fd)
+			capacity *= 2;
+		UringConn **grown = (UringConn **)realloc(ring->conns, (size_t)capacity * sizeof(UringConn *));
+		if (!grown)
+			return -1;
+		memset(grown + ring->conn_capacity, 0, (size_t)(capacity - ring->conn_capacity) * sizeof(UringConn *));
+		ring->conns = grown;
+		ring->conn_capacity = capacity;
+	}
+	if (ring->conns[fd])
+		return -1;
+
+	UringConn *c = (UringConn *)calloc(1, sizeof(UringConn));
+	if (!c)
+		return -1;
+	c->fd = fd;
+	c->reading = 1;
+	ring->conns[fd] = c;
+	mark_dirty(ring, c);
+	return 0;
+}
+
+/**
+ * @brief 注销连接，在关闭套接字之前调用
+ *
+ * 取消连接的接收和发送请求；仍在发送的帧从连接的发送队列中取出，
+ * 保留到内核交回发送请求为止。
+ *
+ * @return 成功返回0，连接未登记返回-1
+ */
+int uring_remove(UringEngine *ring, socket_t fd)
+{
+	UringConn *c = ring ? find_conn(ring, fd) : NULL;
+	if (!c)
+		return -1;
+
+	ring->conns[fd] = NULL;
+	c->closed = 1;
+	c->reading = 0;
+	if (c->recv_armed && !c->cancel_sent)
+		submit_cancel(ring, op_data(c, OP_RECV));
+	if (c->sending)
+	{
+		connection_manager_take_unsent(fd, &c->orphan);
+		submit_cancel(ring, op_data(c, OP_SEND));
+	}
+	release_conn(c);
+	return 0;
+}
+
+/**
+ * @brief 暂停或恢复接收，暂停时已在途的数据仍会送达
+ */
+void uring_set_reading(UringEngine *ring, socket_t fd, int enable)
+{
+	UringConn *c = ring ? find_conn(ring, fd) : NULL;
+	if (!c || c->reading == enable)
+		return;
+	c->reading = enable;
+	mark_dirty(ring, c);
+}
+
+/**
+ * @brief 连接的发送队列有了新数据，在本轮结束时提交
+ */
+void uring_queue_send(UringEngine *ring, socket_t fd)
+{
+	UringConn *c = ring ? find_conn(ring, fd) : NULL;
+	if (c && !c->sending)
+		mark_dirty(ring, c);
+}
+
+/**
+ * @brief 提交本轮准备的请求并处理完成事件
+ *
+ * 完成队列为空时最多等待 timeout_ms 毫秒。每个完成事件同步交给 handler，
+ * handler 中可以登记、注销连接或发送数据，产生的请求在下一次调用时提交。
+ *
+ * @return 处理的完成事件数，环出错返回-1
+ */
+int uring_wait(UringEngine *ring, int timeout_ms, UringHandler handler)
+{
+	if (!ring || !handler)
+		return -1;
+
+	update_dirty(ring);
+
+	unsigned head = *ring->cq_head;
+	int wait = head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	if (ring_enter(ring, wait, timeout_ms) < 0)
+		return -1;
+
+	int handled = 0;
+	unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	while (head != tail && handled < URING_REAP_MAX)
+	{
+		struct io_uring_cqe cqe = ring->cqes[head & ring->cq_mask];
+		head++;
+		/* 先交还完成项，handler 中提交请求时完成队列不会被占满 */
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+		handled++;
+
+		UringConn *c = (UringConn *)(uintptr_t)(cqe.user_data & ~(uint64_t)OP_MASK);
+		switch (cqe.user_data & OP_MASK)
+		{
+		case OP_RECV:
+			complete_recv(ring, c, &cqe, handler);
+			break;
+		case OP_SEND:
+			complete_send(ring, c, &cqe, handler);
+			break;
+		case OP_ACCEPT:
+			complete_accept(ring, (int)(cqe.user_data >> OP_SHIFT), &cqe, handler);
+			break;
+		case OP_WATCH:
+			complete_watch(ring, &cqe, handler);
+			break;
+		default:
+			break;
+		}
+	}
+	return handled;
+}
+
+/**
+ * @brief 停止接受连接和接收数据，已提交的发送继续完成
+ *
+ * 之后反复调用 uring_wait 直到 uring_pending 为0，积压的输出留在发送队列中。
+ */
+void uring_cancel_all(UringEngine *ring)
+{
+	if (!ring || ring->stopping)
+		return;
+
+	ring->stopping = 1;
+	for (int i = 0; i < URING_MAX_LISTENERS; i++)
+	{
+		if (ring->accept_armed[i])
+			submit_cancel(ring, accept_data(i));
+	}
+	if (ring->watch_armed)
+		submit_cancel(ring, OP_WATCH);
+	for (int i = 0; i < ring->conn_capacity; i++)
+	{
+		UringConn *c = ring->conns[i];
+		if (c && c->recv_armed && !c->cancel_sent)
+		{
+			c->reading = 0;
+			if (submit_cancel(ring, op_data(c, OP_RECV)) == 0)
+				c->cancel_sent = 1;
+		}
+	}
+}
+
+/**
+ * @brief 内核中尚未交回的请求数
+ */
+int uring_pending(const UringEngine *ring)
+{
+	return ring ? ring->inflight : 0;
+}
+
+#else /* !URING_SUPPORTED */
+
+/* ================ 不支持 io_uring 的平台 ================ */
+
+UringEngine *uring_create(int entries)
+{
+	(void)entries;
+	return NULL;
+}
+
+void uring_destroy(UringEngine *ring)
+{
+	(void)ring;
+}
+
+int uring_watch_accept(UringEngine *ring, socket_t listener)
+{
+	(void)ring;
+	(void)listener;
+	return -1;
+}
+
+int uring_watch_readable(UringEngine *ring, socket_t fd)
+{
+	(void)ring;
+	(void)fd;
+	return -1;
+}
+
+int uring_add(UringEngine *ring, socket_t fd)
+{
+	(void)ring;
+	(void)fd;
+	return -1;
+}
+
+int uring_remove(UringEngine *ring, socket_t fd)
+{
+	(void)ring;
+	(void)fd;
+	return -1;
+}
+
+void uring_set_reading(UringEngine *ring, socket_t fd, int enable)
+{
+	(void)ring;
+	(void)fd;
+	(void)enable;
+}
+
+void uring_queue_send(UringEngine *ring, socket_t fd)
+{
+	(void)ring;
+	(void)fd;
+}
+
+int uring_wait(UringEngine *ring, int timeout_ms, UringHandler handler)
+{
+	(void)ring;
+	(void)timeout_ms;
+	(void)handler;
+	return -1;
+}
+
+void uring_cancel_all(UringEngine *ring)
+{
+	(void)ring;
+}
+
+int uring_pending(const UringEngine *ring)
+{
+	(void)ring;
+	return 0;
+}
+
+#endif /* URING_SUPPORTED */
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 
 #ifdef _WIN32
 #ifndef WIN32_LEAN_AND_MEAN
@@ -19,6 +20,8 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <windows.h>
+#include <direct.h>
+#include <io.h>
 
 typedef SOCKET socket_t;
 typedef int socket_len_t;
@@ -45,6 +48,11 @@ static inline int platform_socket_close(socket_t sockfd)
 	return closesocket(sockfd);
 }
 
+static inline int platform_socket_shutdown_send(socket_t sockfd)
+{
+	return shutdown(sockfd, SD_SEND);
+}
+
 static inline int platform_socket_set_nonblocking(socket_t sockfd)
 {
 	u_long mode = 1;
@@ -116,6 +124,76 @@ static inline socket_io_result_t platform_socket_recv(socket_t sockfd, char *buf
 	return recv(sockfd, buffer, (int)len, 0);
 }
 
+/* 分散写缓冲区描述，Windows 下直接使用 WSABUF */
+typedef WSABUF platform_iovec_t;
+
+#define PLATFORM_IOV_MAX 64
+
+static inline void platform_iovec_set(platform_iovec_t *iov, const char *base, size_t len)
+{
+	iov->buf = (CHAR *)base;
+	iov->len = len > ULONG_MAX ? ULONG_MAX : (ULONG)len;
+}
+
+static inline socket_io_result_t platform_socket_sendv(socket_t sockfd, platform_iovec_t *iov, int count)
+{
+	DWORD sent = 0;
+	if (WSASend(sockfd, iov, (DWORD)count, &sent, 0, NULL, NULL) != 0)
+	{
+		return -1;
+	}
+	return (socket_io_result_t)sent;
+}
+
+/* 接受一个连接并设为非阻塞，对端地址写入 peer */
+static inline socket_t platform_socket_accept(socket_t listener, struct sockaddr_in *peer)
+{
+	int len = (int)sizeof(*peer);
+	socket_t fd = accept(listener, (struct sockaddr *)peer, &len);
+	if (fd != INVALID_SOCKET && platform_socket_set_nonblocking(fd) < 0)
+	{
+		closesocket(fd);
+		return INVALID_SOCKET;
+	}
+	return fd;
+}
+
+/* Windows 没有可负载均衡的 SO_REUSEPORT */
+static inline int platform_socket_set_reuseport(socket_t sockfd)
+{
+	(void)sockfd;
+	return -1;
+}
+
+/* 跨线程唤醒句柄：select 只能等待套接字，Windows 下暂不支持 */
+typedef struct
+{
+	socket_t read_fd;
+	socket_t write_fd;
+} platform_wakeup_t;
+
+static inline int platform_wakeup_open(platform_wakeup_t *wakeup)
+{
+	wakeup->read_fd = SOCKET_INVALID;
+	wakeup->write_fd = SOCKET_INVALID;
+	return -1;
+}
+
+static inline void platform_wakeup_signal(platform_wakeup_t *wakeup)
+{
+	(void)wakeup;
+}
+
+static inline void platform_wakeup_drain(platform_wakeup_t *wakeup)
+{
+	(void)wakeup;
+}
+
+static inline void platform_wakeup_close(platform_wakeup_t *wakeup)
+{
+	(void)wakeup;
+}
+
 static inline int platform_select_nfds(socket_t max_fd)
 {
 	(void)max_fd;
@@ -127,6 +205,22 @@ static inline void platform_sleep_ms(unsigned int milliseconds)
 	Sleep(milliseconds);
 }
 
+/* 单调时钟（毫秒），不受系统时间调整影响 */
+static inline uint64_t platform_monotonic_ms(void)
+{
+	return (uint64_t)GetTickCount64();
+}
+
+/* 单调时钟（微秒），用于测量耗时 */
+static inline uint64_t platform_monotonic_us(void)
+{
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000 +
+		   (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000 / (uint64_t)freq.QuadPart;
+}
+
 static inline char *platform_strdup(const char *src)
 {
 	size_t len;
@@ -151,6 +245,69 @@ static inline struct tm *platform_localtime(const time_t *timep, struct tm *resu
 	return localtime_s(result, timep) == 0 ? result : NULL;
 }
 
+/* 创建目录，已存在时视为成功 */
+static inline int platform_mkdir(const char *path)
+{
+	return (_mkdir(path) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+/* 把 stdio 缓冲和操作系统缓存写到磁盘 */
+static inline int platform_file_sync(FILE *fp)
+{
+	if (fflush(fp) != 0)
+		return -1;
+	return _commit(_fileno(fp));
+}
+
+/* 用 from 原子替换 to（目标已存在时覆盖） */
+static inline int platform_file_replace(const char *from, const char *to)
+{
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : -1;
+}
+
+/* 只读文件映射 */
+typedef struct
+{
+	const unsigned char *base; /**< 映射起始地址 */
+	size_t len;				   /**< 映射长度 */
+	HANDLE file;			   /**< 文件句柄 */
+	HANDLE mapping;			   /**< 映射对象句柄 */
+} platform_mmap_t;
+
+/* 以只读方式映射文件的前 len 字节，len 不能超过文件长度 */
+static inline int platform_mmap_file(const char *path, size_t len, platform_mmap_t *map)
+{
+	memset(map, 0, sizeof(*map));
+	if (len == 0)
+		return -1;
+	map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+							NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (map->file == INVALID_HANDLE_VALUE)
+		return -1;
+	map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (map->mapping)
+		map->base = (const unsigned char *)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, len);
+	if (!map->base)
+	{
+		if (map->mapping)
+			CloseHandle(map->mapping);
+		CloseHandle(map->file);
+		return -1;
+	}
+	map->len = len;
+	return 0;
+}
+
+static inline void platform_munmap_file(platform_mmap_t *map)
+{
+	if (!map->base)
+		return;
+	UnmapViewOfFile((LPCVOID)map->base);
+	CloseHandle(map->mapping);
+	CloseHandle(map->file);
+	map->base = NULL;
+}
+
 typedef HANDLE platform_thread_t;
 typedef DWORD platform_thread_return_t;
 typedef DWORD(WINAPI *platform_thread_func_t)(LPVOID);
@@ -182,6 +339,34 @@ static inline void platform_mutex_destroy(platform_mutex_t *mutex)
 	(void)mutex;
 }
 
+typedef CONDITION_VARIABLE platform_cond_t;
+
+static inline int platform_cond_init(platform_cond_t *cond)
+{
+	InitializeConditionVariable(cond);
+	return 0;
+}
+
+static inline void platform_cond_wait(platform_cond_t *cond, platform_mutex_t *mutex)
+{
+	SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+static inline void platform_cond_signal(platform_cond_t *cond)
+{
+	WakeConditionVariable(cond);
+}
+
+static inline void platform_cond_broadcast(platform_cond_t *cond)
+{
+	WakeAllConditionVariable(cond);
+}
+
+static inline void platform_cond_destroy(platform_cond_t *cond)
+{
+	(void)cond;
+}
+
 static inline int platform_thread_create(platform_thread_t *thread, platform_thread_func_t func, void *arg)
 {
 	*thread = CreateThread(NULL, 0, func, arg, 0, NULL);
@@ -206,17 +391,32 @@ static inline void platform_thread_join(platform_thread_t thread)
 
 #include <arpa/inet.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <netinet/in.h>
 #include <pthread.h>
 #include <signal.h>
 #include <string.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+/* 就绪通知后端选择：Linux 使用 epoll，BSD/macOS 使用 kqueue，
+   其余平台（或定义 ITIT_POLLER_SELECT 强制回退时）使用 select */
+#if defined(__linux__) && !defined(ITIT_POLLER_SELECT)
+#include <sys/epoll.h>
+#define PLATFORM_POLLER_EPOLL 1
+#elif (defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+	   defined(__OpenBSD__) || defined(__DragonFly__)) &&                    \
+	!defined(ITIT_POLLER_SELECT)
+#include <sys/event.h>
+#define PLATFORM_POLLER_KQUEUE 1
+#endif
+
 typedef int socket_t;
 typedef socklen_t socket_len_t;
 typedef ssize_t socket_io_result_t;
@@ -240,6 +440,11 @@ static inline int platform_socket_close(socket_t sockfd)
 	return close(sockfd);
 }
 
+static inline int platform_socket_shutdown_send(socket_t sockfd)
+{
+	return shutdown(sockfd, SHUT_WR);
+}
+
 static inline int platform_socket_set_nonblocking(socket_t sockfd)
 {
 	int flags = fcntl(sockfd, F_GETFL, 0);
@@ -290,6 +495,114 @@ static inline socket_io_result_t platform_socket_recv(socket_t sockfd, char *buf
 	return recv(sockfd, buffer, len, 0);
 }
 
+/* 分散写缓冲区描述，POSIX 下直接使用 struct iovec */
+typedef struct iovec platform_iovec_t;
+
+#define PLATFORM_IOV_MAX 64
+
+static inline void platform_iovec_set(platform_iovec_t *iov, const char *base, size_t len)
+{
+	iov->iov_base = (void *)base;
+	iov->iov_len = len;
+}
+
+static inline socket_io_result_t platform_socket_sendv(socket_t sockfd, platform_iovec_t *iov, int count)
+{
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+#ifdef MSG_NOSIGNAL
+	return sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+#else
+	return sendmsg(sockfd, &msg, 0);
+#endif
+}
+
+/* 接受一个连接并设为非阻塞，对端地址写入 peer；Linux 下用 accept4 一次完成，不再单独 fcntl */
+static inline socket_t platform_socket_accept(socket_t listener, struct sockaddr_in *peer)
+{
+	socklen_t len = sizeof(*peer);
+#if defined(__linux__) && defined(_GNU_SOURCE)
+	return accept4(listener, (struct sockaddr *)peer, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+	socket_t fd = accept(listener, (struct sockaddr *)peer, &len);
+	if (fd >= 0 && platform_socket_set_nonblocking(fd) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+#endif
+}
+
+/* 允许多个套接字绑定同一端口，Linux 下由内核在监听套接字间分配新连接 */
+static inline int platform_socket_set_reuseport(socket_t sockfd)
+{
+#ifdef SO_REUSEPORT
+	int opt = 1;
+	return setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+#else
+	(void)sockfd;
+	return -1;
+#endif
+}
+
+/* 跨线程唤醒句柄：非阻塞管道，读端注册到就绪通知后端 */
+typedef struct
+{
+	socket_t read_fd;
+	socket_t write_fd;
+} platform_wakeup_t;
+
+static inline int platform_wakeup_open(platform_wakeup_t *wakeup)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		wakeup->read_fd = SOCKET_INVALID;
+		wakeup->write_fd = SOCKET_INVALID;
+		return -1;
+	}
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+	wakeup->read_fd = fds[0];
+	wakeup->write_fd = fds[1];
+	return 0;
+}
+
+static inline void platform_wakeup_signal(platform_wakeup_t *wakeup)
+{
+	char byte = 1;
+	/* 管道已满说明对方尚未处理上一次唤醒，丢弃即可 */
+	if (write(wakeup->write_fd, &byte, 1) < 0)
+	{
+		return;
+	}
+}
+
+static inline void platform_wakeup_drain(platform_wakeup_t *wakeup)
+{
+	char buf[64];
+	while (read(wakeup->read_fd, buf, sizeof(buf)) > 0)
+	{
+	}
+}
+
+static inline void platform_wakeup_close(platform_wakeup_t *wakeup)
+{
+	if (SOCKET_IS_VALID(wakeup->read_fd))
+	{
+		close(wakeup->read_fd);
+	}
+	if (SOCKET_IS_VALID(wakeup->write_fd))
+	{
+		close(wakeup->write_fd);
+	}
+	wakeup->read_fd = SOCKET_INVALID;
+	wakeup->write_fd = SOCKET_INVALID;
+}
+
 static inline int platform_select_nfds(socket_t max_fd)
 {
 	return max_fd + 1;
@@ -300,6 +613,22 @@ static inline void platform_sleep_ms(unsigned int milliseconds)
 	usleep(milliseconds * 1000);
 }
 
+/* 单调时钟（毫秒），不受系统时间调整影响 */
+static inline uint64_t platform_monotonic_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* 单调时钟（微秒），用于测量耗时 */
+static inline uint64_t platform_monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
 static inline char *platform_strdup(const char *src)
 {
 	size_t len;
@@ -324,6 +653,60 @@ static inline struct tm *platform_localtime(const time_t *timep, struct tm *resu
 	return localtime_r(timep, result);
 }
 
+/* 创建目录，已存在时视为成功 */
+static inline int platform_mkdir(const char *path)
+{
+	return (mkdir(path, 0755) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+/* 把 stdio 缓冲和操作系统缓存写到磁盘 */
+static inline int platform_file_sync(FILE *fp)
+{
+	if (fflush(fp) != 0)
+		return -1;
+	return fsync(fileno(fp));
+}
+
+/* 用 from 原子替换 to（目标已存在时覆盖） */
+static inline int platform_file_replace(const char *from, const char *to)
+{
+	return rename(from, to);
+}
+
+/* 只读文件映射 */
+typedef struct
+{
+	const unsigned char *base; /**< 映射起始地址 */
+	size_t len;				   /**< 映射长度 */
+} platform_mmap_t;
+
+/* 以只读方式映射文件的前 len 字节，len 不能超过文件长度 */
+static inline int platform_mmap_file(const char *path, size_t len, platform_mmap_t *map)
+{
+	map->base = NULL;
+	map->len = 0;
+	if (len == 0)
+		return -1;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	void *base = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -1;
+	map->base = (const unsigned char *)base;
+	map->len = len;
+	return 0;
+}
+
+static inline void platform_munmap_file(platform_mmap_t *map)
+{
+	if (!map->base)
+		return;
+	munmap((void *)map->base, map->len);
+	map->base = NULL;
+}
+
 typedef pthread_t platform_thread_t;
 typedef void *platform_thread_return_t;
 typedef void *(*platform_thread_func_t)(void *);
@@ -354,6 +737,33 @@ static inline void platform_mutex_destroy(platform_mutex_t *mutex)
 	pthread_mutex_destroy(mutex);
 }
 
+typedef pthread_cond_t platform_cond_t;
+
+static inline int platform_cond_init(platform_cond_t *cond)
+{
+	return pthread_cond_init(cond, NULL);
+}
+
+static inline void platform_cond_wait(platform_cond_t *cond, platform_mutex_t *mutex)
+{
+	pthread_cond_wait(cond, mutex);
+}
+
+static inline void platform_cond_signal(platform_cond_t *cond)
+{
+	pthread_cond_signal(cond);
+}
+
+static inline void platform_cond_broadcast(platform_cond_t *cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
+static inline void platform_cond_destroy(platform_cond_t *cond)
+{
+	pthread_cond_destroy(cond);
+}
+
 static inline int platform_thread_create(platform_thread_t *thread, platform_thread_func_t func, void *arg)
 {
 	return pthread_create(thread, NULL, func, arg);
@@ -371,6 +781,18 @@ static inline void platform_thread_join(platform_thread_t thread)
 
 #endif
 
+/* 线程局部存储 */
+#if defined(_MSC_VER)
+#define PLATFORM_THREAD_LOCAL __declspec(thread)
+#else
+#define PLATFORM_THREAD_LOCAL __thread
+#endif
+
+/* 未选中可扩展后端时回退到 select（Windows 默认走这里） */
+#if !defined(PLATFORM_POLLER_EPOLL) && !defined(PLATFORM_POLLER_KQUEUE)
+#define PLATFORM_POLLER_SELECT 1
+#endif
+
 static inline char *platform_strtok_r(char *str, const char *delim, char **saveptr)
 {
 	char *token = str ? str : *saveptr;
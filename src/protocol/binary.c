@@ -0,0 +1,322 @@
+/**
+ * @file binary.c
+ * @brief 二进制协议 v2 编解码实现
+ *
+ * v2 帧以长度前缀分帧：魔数字节、varint 编码的正文长度，正文依次为
+ * 一字节类型标签（即 CommandType 的取值）和 sender、receiver、timestamp、content
+ * 四个字段，每个字段为 varint 长度加原始字节。字段内容不做转义，
+ * 解析时只需按长度做带边界检查的 memcpy，不再扫描分隔符和换行。
+ *
+ * 魔数不是可打印字符，不会出现在文本帧的开头，因此同一连接的接收缓冲区中
+ * 两种帧可以按首字节区分。服务器内部仍以文本帧为规范表示（历史日志、离线队列、
+ * 跨分片邮件），发往 v2 连接时由本文件一次转换成二进制帧。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "protocol.h"
+
+/** varint 最多字节数，足以表示 PROTOCOL_V2_MAX_BODY */
+#define VARINT_MAX_BYTES 3
+
+/**
+ * @brief 写入 varint（每字节低7位为数据，最高位表示后面还有字节）
+ *
+ * @return size_t 写入的字节数，空间不足返回0
+ */
+static size_t put_varint(char *out, size_t cap, size_t value)
+{
+	size_t n = 0;
+	do
+	{
+		if (n >= cap || n >= VARINT_MAX_BYTES)
+			return 0;
+		unsigned char byte = (unsigned char)(value & 0x7F);
+		value >>= 7;
+		if (value)
+			byte |= 0x80;
+		out[n++] = (char)byte;
+	} while (value);
+	return n;
+}
+
+/**
+ * @brief 读取 varint
+ *
+ * @return size_t 读取的字节数，数据不完整返回0，编码超长返回 (size_t)-1
+ */
+static size_t get_varint(const char *data, size_t avail, size_t *value)
+{
+	size_t result = 0;
+	for (size_t n = 0; n < VARINT_MAX_BYTES; n++)
+	{
+		if (n >= avail)
+			return 0;
+		unsigned char byte = (unsigned char)data[n];
+		result |= (size_t)(byte & 0x7F) << (7 * n);
+		if (!(byte & 0x80))
+		{
+			*value = result;
+			return n + 1;
+		}
+	}
+	return (size_t)-1;
+}
+
+/**
+ * @brief 获取消息类型对应的 v2 类型标签
+ *
+ * 标签直接取 CommandType 的值，响应消息使用 CMD_RESPONSE_OK / CMD_RESPONSE_ERROR。
+ *
+ * @param type 消息类型字符串
+ * @return int 类型标签，未知类型返回-1
+ */
+int protocol_v2_tag(const char *type)
+{
+	if (!type)
+		return -1;
+	if (strcmp(type, MSG_TYPE_OK) == 0)
+		return CMD_RESPONSE_OK;
+	if (strcmp(type, MSG_TYPE_ERROR) == 0)
+		return CMD_RESPONSE_ERROR;
+
+	CommandType cmd = get_command_type(type);
+	return cmd == CMD_UNKNOWN ? -1 : (int)cmd;
+}
+
+/**
+ * @brief 把消息编码为一个 v2 帧
+ *
+ * @param msg 消息
+ * @param out 输出缓冲区
+ * @param cap 输出缓冲区大小，PROTOCOL_V2_MAX_FRAME 总是足够
+ * @return size_t 帧长度，类型未知或空间不足返回0
+ */
+size_t protocol_v2_encode(const Message *msg, char *out, size_t cap)
+{
+	if (!msg || !out)
+		return 0;
+
+	int tag = protocol_v2_tag(msg->type);
+	if (tag < 0)
+	{
+		LOG_ERROR("Cannot encode message type %s as v2", msg->type);
+		return 0;
+	}
+
+	const char *fields[4] = {msg->sender, msg->receiver, msg->timestamp, msg->content};
+	size_t sizes[4] = {sizeof(msg->sender), sizeof(msg->receiver), sizeof(msg->timestamp), sizeof(msg->content)};
+	char body[PROTOCOL_V2_MAX_BODY];
+	size_t body_len = 0;
+
+	body[body_len++] = (char)tag;
+	for (int i = 0; i < 4; i++)
+	{
+		size_t len = strnlen(fields[i], sizes[i]);
+		size_t n = put_varint(body + body_len, sizeof(body) - body_len, len);
+		if (n == 0 || body_len + n + len > sizeof(body))
+			return 0;
+		body_len += n;
+		memcpy(body + body_len, fields[i], len);
+		body_len += len;
+	}
+
+	if (cap < 1)
+		return 0;
+	out[0] = (char)PROTOCOL_V2_MAGIC;
+	size_t header = put_varint(out + 1, cap - 1, body_len);
+	if (header == 0 || 1 + header + body_len > cap)
+		return 0;
+	memcpy(out + 1 + header, body, body_len);
+	return 1 + header + body_len;
+}
+
+/**
+ * @brief 检查缓冲区开头是否为完整的 v2 帧
+ *
+ * @param data 缓冲区，data[0] 应为 PROTOCOL_V2_MAGIC
+ * @param avail 可用字节数
+ * @param header_len 输出帧头长度（魔数和长度字段）
+ * @param body_len 输出正文长度
+ * @return int 帧完整返回1，需要更多数据返回0，不是 v2 帧或正文超过上限返回-1
+ */
+int protocol_v2_frame(const char *data, size_t avail, size_t *header_len, size_t *body_len)
+{
+	size_t len = 0;
+
+	if (!data || avail == 0)
+		return 0;
+	if ((unsigned char)data[0] != PROTOCOL_V2_MAGIC)
+		return -1;
+
+	size_t n = get_varint(data + 1, avail - 1, &len);
+	if (n == (size_t)-1 || len == 0 || len > PROTOCOL_V2_MAX_BODY)
+		return -1;
+	if (n == 0 || avail < 1 + n + len)
+		return 0;
+
+	*header_len = 1 + n;
+	*body_len = len;
+	return 1;
+}
+
+/**
+ * @brief 把 v2 帧的正文解析到调用方提供的 Message
+ *
+ * 每个字段先检查长度不越过正文、不超过目标字段，再整段复制，无堆分配。
+ *
+ * @param body 帧正文（类型标签开始）
+ * @param len 正文长度
+ * @param msg 输出的消息结构体
+ * @return int 成功返回0，失败返回-1
+ */
+int protocol_v2_decode(const char *body, size_t len, Message *msg)
+{
+	if (!body || !msg || len < 1)
+		return -1;
+
+	/* 各字符串字段下面都会整体写入，不再清零整个结构体（内容字段较大） */
+	msg->is_delivered = 0;
+
+	CommandType tag = (CommandType)(unsigned char)body[0];
+	const char *type = get_command_str(tag);
+	if (tag == CMD_UNKNOWN || !is_valid_msg_type(type))
+	{
+		LOG_ERROR("Invalid v2 type tag: %u", (unsigned)(unsigned char)body[0]);
+		return -1;
+	}
+	safe_strcpy(msg->type, type, sizeof(msg->type));
+
+	char *targets[4] = {msg->sender, msg->receiver, msg->timestamp, msg->content};
+	size_t sizes[4] = {sizeof(msg->sender), sizeof(msg->receiver), sizeof(msg->timestamp), sizeof(msg->content)};
+	size_t pos = 1;
+	for (int i = 0; i < 4; i++)
+	{
+		size_t field_len = 0;
+		size_t n = get_varint(body + pos, len - pos, &field_len);
+		if (n == 0 || n == (size_t)-1 || field_len > len - pos - n || field_len >= sizes[i])
+		{
+			LOG_ERROR("Malformed v2 field %d", i);
+			return -1;
+		}
+		pos += n;
+		memcpy(targets[i], body + pos, field_len);
+		targets[i][field_len] = '\0';
+		pos += field_len;
+	}
+
+	msg->message_id = protocol_next_message_id();
+	if (msg->timestamp[0] == '\0')
+		get_current_time(msg->timestamp, sizeof(msg->timestamp));
+	return 0;
+}
+
+/**
+ * @brief 从分帧缓冲区取出下一帧，文本帧和 v2 帧按首字节区分
+ *
+ * 文本帧的结果与 frame_buffer_next 相同；v2 帧返回正文，长度前缀不在其中。
+ * 帧之间多余的空行被跳过。
+ *
+ * @param fb 分帧缓冲区
+ * @param frame 输出帧起始地址
+ * @param frame_len 输出帧长度
+ * @param binary 输出是否为 v2 帧
+ * @return int 取到一帧返回1，需要更多数据返回0，帧不合法或超过上限返回-1
+ */
+int protocol_next_frame(FrameBuffer *fb, char **frame, size_t *frame_len, int *binary)
+{
+	char *data;
+	size_t avail;
+
+	if (!fb || !frame || !frame_len || !binary)
+		return 0;
+
+	while ((avail = frame_buffer_peek(fb, &data)) > 0 && (data[0] == '\n' || data[0] == '\r'))
+		frame_buffer_consume(fb, 1);
+	if (avail == 0)
+		return 0;
+
+	if ((unsigned char)data[0] != PROTOCOL_V2_MAGIC)
+	{
+		*binary = 0;
+		return frame_buffer_next(fb, frame, frame_len);
+	}
+
+	size_t header_len, body_len;
+	int status = protocol_v2_frame(data, avail, &header_len, &body_len);
+	if (status <= 0)
+		return status;
+
+	*binary = 1;
+	*frame = data + header_len;
+	*frame_len = body_len;
+	frame_buffer_consume(fb, header_len + body_len);
+	return 1;
+}
+
+/**
+ * @brief 把一个或多个以换行结尾的文本帧转换成 v2 帧
+ *
+ * 用于服务器内部的文本帧发往已协商 v2 的连接。无法解析的帧被跳过。
+ *
+ * @param text 文本帧
+ * @param len 文本长度
+ * @param out_len 输出长度
+ * @return char* 新分配的 v2 帧序列，调用方负责释放；内存不足返回NULL
+ */
+char *protocol_v2_from_text(const char *text, size_t len, size_t *out_len)
+{
+	char line[MAX_RAW_MESSAGE_LEN + 2];
+	size_t cap = len + PROTOCOL_V2_MAX_FRAME;
+	size_t used = 0;
+	size_t pos = 0;
+	Message msg;
+
+	if (out_len)
+		*out_len = 0;
+	if (!text)
+		return NULL;
+
+	char *out = (char *)malloc(cap);
+	if (!out)
+		return NULL;
+
+	while (pos < len)
+	{
+		const char *newline = (const char *)memchr(text + pos, '\n', len - pos);
+		size_t end = newline ? (size_t)(newline - text) : len;
+		size_t n = end - pos;
+
+		if (n > 0 && n <= MAX_RAW_MESSAGE_LEN)
+		{
+			memcpy(line, text + pos, n);
+			line[n] = '\0';
+			if (parse_message_into(line, n, &msg) == 0)
+			{
+				if (cap - used < PROTOCOL_V2_MAX_FRAME)
+				{
+					char *grown = (char *)realloc(out, cap * 2);
+					if (!grown)
+					{
+						free(out);
+						return NULL;
+					}
+					out = grown;
+					cap *= 2;
+				}
+				used += protocol_v2_encode(&msg, out + used, cap - used);
+			}
+			else
+				LOG_WARN("Dropping unparsable frame while converting to v2");
+		}
+		pos = end + 1;
+	}
+
+	if (out_len)
+		*out_len = used;
+	return out;
+}
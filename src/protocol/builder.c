@@ -8,6 +8,11 @@
  *
  * 所有构建的消息都遵循统一的格式：type|sender|receiver|timestamp|content
  *
+ * 时间戳和转义后的内容放在栈上，消息直接写入 build_alloc 返回的缓冲区。
+ * 处理一条命令期间线程绑定了构建区时，结果分配在构建区中，命令结束时
+ * 一次性回收，构建响应不再产生 malloc/free；未绑定时结果在堆上分配。
+ * 两种情况下调用方都用 build_free 释放结果。
+ *
  * 主要功能：
  * 1. 构建各种类型的用户消息
  * 2. 构建服务器响应消息
@@ -21,6 +26,94 @@
 #include "protocol.h"
 #include "../utils/utils.h"
 
+/**
+ * @brief 当前线程绑定的构建区，NULL 表示在堆上分配
+ */
+static PLATFORM_THREAD_LOCAL Arena *bound_arena = NULL;
+
+/**
+ * @brief 携带用户内容的消息的缓冲区大小，容纳完全转义的 MAX_CONTENT_LEN 字节内容
+ */
+#define BUILD_FRAME_MAX MAX_RAW_MESSAGE_LEN
+
+/**
+ * @brief 为当前线程绑定构建区
+ *
+ * 已经绑定了构建区时保持原绑定（嵌套调用由最外层负责回收）。
+ *
+ * @param arena 构建区
+ * @return int 本次完成绑定返回1，已有绑定返回0
+ */
+int build_arena_begin(Arena *arena)
+{
+	if (bound_arena || !arena)
+		return 0;
+	bound_arena = arena;
+	return 1;
+}
+
+/**
+ * @brief 结束构建区绑定并回收其中的全部结果
+ *
+ * @param bound build_arena_begin 的返回值，为0时不做任何事
+ */
+void build_arena_end(int bound)
+{
+	if (!bound || !bound_arena)
+		return;
+	arena_reset(bound_arena);
+	bound_arena = NULL;
+}
+
+/**
+ * @brief 为构建结果分配缓冲区
+ *
+ * 绑定了构建区时从构建区分配，否则在堆上分配。
+ *
+ * @param size 字节数
+ * @return char* 成功返回缓冲区，失败返回NULL
+ */
+char *build_alloc(size_t size)
+{
+	char *buffer = bound_arena ? (char *)arena_alloc(bound_arena, size) : (char *)malloc(size);
+	if (!buffer)
+		LOG_ERROR("Failed to allocate %zu bytes for message", size);
+	return buffer;
+}
+
+/**
+ * @brief 构建完成后把构建区中多预留的空间还回去
+ *
+ * @param msg build_alloc 返回并已写入的消息
+ * @return char* 返回 msg 本身
+ */
+static char *build_finish(char *msg)
+{
+	if (bound_arena)
+		arena_trim(bound_arena, msg, strlen(msg) + 1);
+	return msg;
+}
+
+/**
+ * @brief 释放构建结果
+ *
+ * 构建区中的结果在命令结束时统一回收，这里只撤销最近一次分配，
+ * 使“构建-复制-释放”的循环重复使用同一块空间；堆上的结果直接释放。
+ *
+ * @param msg 构建结果，可为NULL
+ */
+void build_free(char *msg)
+{
+	if (!msg)
+		return;
+	if (bound_arena && arena_owns(bound_arena, msg))
+	{
+		arena_trim(bound_arena, msg, 0);
+		return;
+	}
+	free(msg);
+}
+
 /**
  * @brief 构建登录消息
  *
@@ -33,7 +126,23 @@
  */
 char *build_login_msg(const char *username, const char *password)
 {
-	if (!username || !password)
+	return build_login_to(username, password, "server");
+}
+
+/**
+ * @brief 构建指定接收者字段的登录消息
+ *
+ * 与 build_login_msg 相同，receiver 可以带登录选项，如 PROTOCOL_V2_OFFER 请求改用二进制协议 v2，
+ * "server;ack" 请求累计送达确认。
+ *
+ * @param username 用户名
+ * @param password 密码
+ * @param receiver 接收者字段
+ * @return char* 成功返回登录消息字符串，失败返回NULL
+ */
+char *build_login_to(const char *username, const char *password, const char *receiver)
+{
+	if (!username || !password || !receiver)
 	{
 		LOG_ERROR("Invalid parameters for login message");
 		return NULL;
@@ -45,21 +154,17 @@ char *build_login_msg(const char *username, const char *password)
 		return NULL;
 	}
 
-	// 获取当前时间戳
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
-		return NULL;
-	}
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
 	// 构建消息内容
-	char content[256];
-	snprintf(content, sizeof(content), "%s|%s|%s|%s|%s\n",
-			 MSG_TYPE_LOGIN, username, "server", timestamp, password);
+	char *msg = build_alloc(256);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 256, "%s|%s|%s|%s|%s\n",
+			 MSG_TYPE_LOGIN, username, receiver, timestamp, password);
 
-	char *result = platform_strdup(content);
-	safe_free((void **)&timestamp);
+	char *result = build_finish(msg);
 
 	LOG_DEBUG("Built login message for user: %s", username);
 	return result;
@@ -88,19 +193,16 @@ char *build_logout_msg(const char *username)
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
-		return NULL;
-	}
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
-	char content[256];
-	snprintf(content, sizeof(content), "%s|%s|%s|%s|\n",
+	char *msg = build_alloc(256);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 256, "%s|%s|%s|%s|\n",
 			 MSG_TYPE_LOGOUT, username, "server", timestamp);
 
-	char *result = platform_strdup(content);
-	safe_free((void **)&timestamp);
+	char *result = build_finish(msg);
 
 	LOG_DEBUG("Built logout message for user: %s", username);
 	return result;
@@ -140,29 +242,21 @@ char *build_text_msg(const char *sender, const char *receiver,
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
-		return NULL;
-	}
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
 	// 转义内容中的特殊字符
-	char *escaped_content = escape_field(content);
-	if (!escaped_content)
-	{
-		LOG_ERROR("Failed to escape content");
-		safe_free((void **)&timestamp);
-		return NULL;
-	}
+	char escaped_content[MAX_CONTENT_LEN * 2];
+	escape_field_into(content, escaped_content, sizeof(escaped_content));
 
-	char msg[512];
-	snprintf(msg, sizeof(msg), "%s|%s|%s|%s|%s\n",
-			 MSG_TYPE_MSG, sender, receiver, timestamp, escaped_content);
+	char *msg = build_alloc(BUILD_FRAME_MAX);
+	if (!msg)
+		return NULL;
+	if (snprintf(msg, BUILD_FRAME_MAX, "%s|%s|%s|%s|%s\n",
+			 MSG_TYPE_MSG, sender, receiver, timestamp, escaped_content) >= BUILD_FRAME_MAX)
+		LOG_WARN("Message truncated to %d bytes", BUILD_FRAME_MAX);
 
-	char *result = platform_strdup(msg);
-	safe_free((void **)&timestamp);
-	safe_free((void **)&escaped_content);
+	char *result = build_finish(msg);
 
 	LOG_DEBUG("Built text message: %s -> %s", sender, receiver);
 	return result;
@@ -200,29 +294,21 @@ char *build_broadcast_msg(const char *sender, const char *content)
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
-		return NULL;
-	}
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
-	char *escaped_content = escape_field(content);
-	if (!escaped_content)
-	{
-		LOG_ERROR("Failed to escape content");
-		safe_free((void **)&timestamp);
-		return NULL;
-	}
+	char escaped_content[MAX_CONTENT_LEN * 2];
+	escape_field_into(content, escaped_content, sizeof(escaped_content));
 
-	char msg[512];
-	snprintf(msg, sizeof(msg), "%s|%s|%s|%s|%s\n",
+	char *msg = build_alloc(BUILD_FRAME_MAX);
+	if (!msg)
+		return NULL;
+	if (snprintf(msg, BUILD_FRAME_MAX, "%s|%s|%s|%s|%s\n",
 			 MSG_TYPE_BROADCAST, sender, RECEIVER_BROADCAST,
-			 timestamp, escaped_content);
+			 timestamp, escaped_content) >= BUILD_FRAME_MAX)
+		LOG_WARN("Message truncated to %d bytes", BUILD_FRAME_MAX);
 
-	char *result = platform_strdup(msg);
-	safe_free((void **)&timestamp);
-	safe_free((void **)&escaped_content);
+	char *result = build_finish(msg);
 
 	LOG_DEBUG("Built broadcast message from: %s", sender);
 	return result;
@@ -268,33 +354,25 @@ char *build_group_msg(const char *sender, const char *group_name,
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
-		return NULL;
-	}
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
 	// 构建接收者标识：group:群组名
 	char receiver[64];
 	snprintf(receiver, sizeof(receiver), "%s%s",
 			 RECEIVER_GROUP_PREFIX, group_name);
 
-	char *escaped_content = escape_field(content);
-	if (!escaped_content)
-	{
-		LOG_ERROR("Failed to escape content");
-		safe_free((void **)&timestamp);
-		return NULL;
-	}
+	char escaped_content[MAX_CONTENT_LEN * 2];
+	escape_field_into(content, escaped_content, sizeof(escaped_content));
 
-	char msg[512];
-	snprintf(msg, sizeof(msg), "%s|%s|%s|%s|%s\n",
-			 MSG_TYPE_GROUP, sender, receiver, timestamp, escaped_content);
+	char *msg = build_alloc(BUILD_FRAME_MAX);
+	if (!msg)
+		return NULL;
+	if (snprintf(msg, BUILD_FRAME_MAX, "%s|%s|%s|%s|%s\n",
+			 MSG_TYPE_GROUP, sender, receiver, timestamp, escaped_content) >= BUILD_FRAME_MAX)
+		LOG_WARN("Message truncated to %d bytes", BUILD_FRAME_MAX);
 
-	char *result = platform_strdup(msg);
-	safe_free((void **)&timestamp);
-	safe_free((void **)&escaped_content);
+	char *result = build_finish(msg);
 
 	LOG_DEBUG("Built group message: %s -> group:%s", sender, group_name);
 	return result;
@@ -329,12 +407,8 @@ char *build_history_request(const char *username, const char *target,
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
-		return NULL;
-	}
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
 	// 构建内容：target|start_time|end_time
 	char content[512];
@@ -343,17 +417,114 @@ char *build_history_request(const char *username, const char *target,
 			 start_time ? start_time : "",
 			 end_time ? end_time : "");
 
-	char msg[1024];
-	snprintf(msg, sizeof(msg), "%s|%s|%s|%s|%s\n",
+	char *msg = build_alloc(1024);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 1024, "%s|%s|%s|%s|%s\n",
 			 MSG_TYPE_HISTORY, username, "server", timestamp, content);
 
-	char *result = platform_strdup(msg);
-	safe_free((void **)&timestamp);
+	char *result = build_finish(msg);
 
 	LOG_DEBUG("Built history request: %s -> %s", username, target);
 	return result;
 }
 
+/**
+ * @brief 构建增量同步的历史记录请求消息
+ *
+ * 格式为 HISTORY|username|server|timestamp|target|||limit|since，时间范围留空，
+ * 服务器返回序号大于 since 的最早 limit 条消息，并在 OK 中给出下一页的游标。
+ *
+ * @param username 请求用户名
+ * @param target 查询目标（用户名，"all" 表示广播）
+ * @param since 游标，0 表示从头开始
+ * @param limit 每页条数，<=0 表示由服务器决定
+ * @return char* 成功返回历史记录请求消息字符串，失败返回NULL
+ */
+char *build_history_sync_request(const char *username, const char *target,
+								 unsigned int since, int limit)
+{
+	if (!username || !target)
+	{
+		LOG_ERROR("Invalid parameters for history sync request");
+		return NULL;
+	}
+
+	if (!is_valid_username(username))
+	{
+		LOG_ERROR("Invalid username: %s", username);
+		return NULL;
+	}
+
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
+
+	char *msg = build_alloc(1024);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 1024, "%s|%s|%s|%s|%s|||%d|%u\n",
+			 MSG_TYPE_HISTORY, username, "server", timestamp, target, limit > 0 ? limit : 0, since);
+
+	char *result = build_finish(msg);
+
+	LOG_DEBUG("Built history sync request: %s -> %s since %u", username, target, since);
+	return result;
+}
+
+/**
+ * @brief 构建全文检索的历史记录请求消息
+ *
+ * 格式为 HISTORY|username|server|timestamp|target|||limit||query，整个内容经过转义，
+ * 查询中的 '|' 和换行不会破坏分帧。服务器返回会话中包含 query 全部词元的最近 limit 条，
+ * 每条的内容为 "#序号 摘要"。
+ *
+ * @param username 请求用户名
+ * @param target 检索的会话（用户名，"all" 表示广播）
+ * @param query 查询文本
+ * @param limit 最多返回的条数，<=0 表示由服务器决定
+ * @return char* 成功返回历史记录请求消息字符串，失败返回NULL
+ */
+char *build_history_search_request(const char *username, const char *target,
+								   const char *query, int limit)
+{
+	if (!username || !target || !query || !*query)
+	{
+		LOG_ERROR("Invalid parameters for history search request");
+		return NULL;
+	}
+
+	if (!is_valid_username(username))
+	{
+		LOG_ERROR("Invalid username: %s", username);
+		return NULL;
+	}
+
+	char content[MAX_CONTENT_LEN];
+	if (snprintf(content, sizeof(content), "%s|||%d||%s", target, limit > 0 ? limit : 0, query) >= (int)sizeof(content))
+	{
+		LOG_ERROR("History search query too long");
+		return NULL;
+	}
+
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
+
+	char escaped_content[MAX_CONTENT_LEN * 2];
+	escape_field_into(content, escaped_content, sizeof(escaped_content));
+
+	char *msg = build_alloc(BUILD_FRAME_MAX);
+	if (!msg)
+		return NULL;
+	if (snprintf(msg, BUILD_FRAME_MAX, "%s|%s|%s|%s|%s\n",
+				 MSG_TYPE_HISTORY, username, "server", timestamp, escaped_content) >= BUILD_FRAME_MAX)
+		LOG_WARN("History search request truncated to %d bytes", BUILD_FRAME_MAX);
+
+	char *result = build_finish(msg);
+
+	LOG_DEBUG("Built history search request: %s -> %s", username, target);
+	return result;
+}
+
 /**
  * @brief 构建状态查询请求消息
  *
@@ -379,24 +550,161 @@ char *build_status_request(const char *username)
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
+
+	char *msg = build_alloc(256);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 256, "%s|%s|%s|%s|\n",
+			 MSG_TYPE_STATUS, username, "server", timestamp);
+
+	char *result = build_finish(msg);
+
+	LOG_DEBUG("Built status request for: %s", username);
+	return result;
+}
+
+/**
+ * @brief 构建在线状态关注请求
+ *
+ * 构建设置关注用户的请求消息，格式为：
+ * PRESENCE|username|server|timestamp|targets
+ *
+ * targets 为 "*"（所有人）、"-"（关闭通知）或以逗号分隔的用户名列表。
+ *
+ * @param username 请求用户名
+ * @param targets 关注设置
+ * @return char* 成功返回请求消息字符串，失败返回NULL
+ */
+char *build_presence_request(const char *username, const char *targets)
+{
+	if (!username || !targets || !is_valid_username(username))
 	{
-		LOG_ERROR("Failed to get timestamp");
+		LOG_ERROR("Invalid parameters for presence request");
 		return NULL;
 	}
 
-	char msg[256];
-	snprintf(msg, sizeof(msg), "%s|%s|%s|%s|\n",
-			 MSG_TYPE_STATUS, username, "server", timestamp);
+	if (strlen(targets) > MAX_CONTENT_LEN - 1 || strpbrk(targets, "|\r\n\\"))
+	{
+		LOG_ERROR("Invalid presence targets: %s", targets);
+		return NULL;
+	}
 
-	char *result = platform_strdup(msg);
-	safe_free((void **)&timestamp);
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
-	LOG_DEBUG("Built status request for: %s", username);
+	char *msg = build_alloc(BUILD_FRAME_MAX);
+	if (!msg)
+		return NULL;
+	snprintf(msg, BUILD_FRAME_MAX, "%s|%s|%s|%s|%s\n",
+			 MSG_TYPE_PRESENCE, username, "server", timestamp, targets);
+
+	char *result = build_finish(msg);
+
+	LOG_DEBUG("Built presence request for: %s", username);
 	return result;
 }
 
+/**
+ * @brief 构建累计送达确认
+ *
+ * 构建确认已收到编号不超过 upto 的私聊消息的请求，格式为：
+ * ACK|username|server|timestamp|upto
+ *
+ * 服务器不回复确认，只据此从离线队列中成批删除已送达的消息。
+ *
+ * @param username 接收消息的用户名
+ * @param upto 已收到的最大投递序号
+ * @return char* 成功返回请求消息字符串，失败返回NULL
+ */
+char *build_ack_request(const char *username, uint32_t upto)
+{
+	if (!username || !is_valid_username(username) || upto == 0)
+	{
+		LOG_ERROR("Invalid parameters for ack request");
+		return NULL;
+	}
+
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
+
+	char *msg = build_alloc(256);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 256, "%s|%s|%s|%s|%lu\n",
+			 MSG_TYPE_ACK, username, "server", timestamp, (unsigned long)upto);
+
+	return build_finish(msg);
+}
+
+/**
+ * @brief 构建会话恢复请求
+ *
+ * 断线重连时代替 LOGIN 发送，格式为：
+ * RESUME|username|receiver|timestamp|token;last_seen
+ *
+ * receiver 与 LOGIN 一样带登录选项；last_seen 为 0 时省略，服务器按没有收到过编号的帧处理。
+ *
+ * @param username 用户名
+ * @param receiver 接收者字段（"server" 加登录选项）
+ * @param token 登录时收到的恢复令牌
+ * @param last_seen 已收到的最大投递序号
+ * @return char* 成功返回请求消息字符串，失败返回NULL
+ */
+char *build_resume_request(const char *username, const char *receiver, const char *token, uint32_t last_seen)
+{
+	if (!username || !receiver || !token || !is_valid_username(username) || token[0] == '\0' ||
+		strchr(token, '|') || strchr(token, '\n'))
+	{
+		LOG_ERROR("Invalid parameters for resume request");
+		return NULL;
+	}
+
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
+
+	char *msg = build_alloc(256);
+	if (!msg)
+		return NULL;
+	if (last_seen > 0)
+		snprintf(msg, 256, "%s|%s|%s|%s|%s%c%lu\n", MSG_TYPE_RESUME, username, receiver, timestamp, token,
+				 PROTOCOL_DELIVERY_SEPARATOR, (unsigned long)last_seen);
+	else
+		snprintf(msg, 256, "%s|%s|%s|%s|%s\n", MSG_TYPE_RESUME, username, receiver, timestamp, token);
+
+	return build_finish(msg);
+}
+
+/**
+ * @brief 构建签发恢复令牌的消息
+ *
+ * 服务器在登录或恢复成功后发送，格式为：
+ * RESUME|server|username|timestamp|token
+ *
+ * @param username 令牌所属的用户名
+ * @param token 十六进制令牌
+ * @return char* 成功返回消息字符串，失败返回NULL
+ */
+char *build_resume_token(const char *username, const char *token)
+{
+	if (!username || !token || token[0] == '\0')
+	{
+		LOG_ERROR("Invalid parameters for resume token");
+		return NULL;
+	}
+
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
+
+	char *msg = build_alloc(256);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 256, "%s|server|%s|%s|%s\n", MSG_TYPE_RESUME, username, timestamp, token);
+
+	return build_finish(msg);
+}
+
 /**
  * @brief 构建响应消息
  *
@@ -412,7 +720,24 @@ char *build_status_request(const char *username)
  */
 char *build_response_msg(int code, const char *type, const char *message)
 {
-	if (!type || !message)
+	return build_response_to(code, type, "client", message);
+}
+
+/**
+ * @brief 构建指定接收者字段的响应消息
+ *
+ * 与 build_response_msg 相同，receiver 字段由调用方指定，
+ * 登录成功响应用它回复接受的登录选项（如 PROTOCOL_V2_ACCEPT）。
+ *
+ * @param code 响应码
+ * @param type 响应类型（OK或ERROR）
+ * @param receiver 接收者字段
+ * @param message 响应消息内容
+ * @return char* 成功返回响应消息字符串，失败返回NULL
+ */
+char *build_response_to(int code, const char *type, const char *receiver, const char *message)
+{
+	if (!type || !receiver || !message)
 	{
 		LOG_ERROR("Invalid parameters for response message");
 		return NULL;
@@ -426,23 +751,20 @@ char *build_response_msg(int code, const char *type, const char *message)
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
-		return NULL;
-	}
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
 	// 构建内容：code|message
 	char content[256];
 	snprintf(content, sizeof(content), "%d|%s", code, message);
 
-	char msg[512];
-	snprintf(msg, sizeof(msg), "%s|server|client|%s|%s\n",
-			 type, timestamp, content);
+	char *msg = build_alloc(512);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 512, "%s|server|%s|%s|%s\n",
+			 type, receiver, timestamp, content);
 
-	char *result = platform_strdup(msg);
-	safe_free((void **)&timestamp);
+	char *result = build_finish(msg);
 
 	LOG_DEBUG("Built response: type=%s, code=%d", type, code);
 	return result;
@@ -544,22 +866,19 @@ char *build_user_online_msg(const char *username)
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
-		return NULL;
-	}
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
 	char content[128];
 	snprintf(content, sizeof(content), "%s is now online", username);
 
-	char msg[512];
-	snprintf(msg, sizeof(msg), "%s|server|%s|%s|%s\n",
+	char *msg = build_alloc(512);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 512, "%s|server|%s|%s|%s\n",
 			 MSG_TYPE_BROADCAST, RECEIVER_BROADCAST, timestamp, content);
 
-	char *result = platform_strdup(msg);
-	safe_free((void **)&timestamp);
+	char *result = build_finish(msg);
 
 	LOG_DEBUG("Built online notification for: %s", username);
 	return result;
@@ -582,22 +901,19 @@ char *build_user_offline_msg(const char *username)
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
-		return NULL;
-	}
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
 	char content[128];
 	snprintf(content, sizeof(content), "%s is now offline", username);
 
-	char msg[512];
-	snprintf(msg, sizeof(msg), "%s|server|%s|%s|%s\n",
+	char *msg = build_alloc(512);
+	if (!msg)
+		return NULL;
+	snprintf(msg, 512, "%s|server|%s|%s|%s\n",
 			 MSG_TYPE_BROADCAST, RECEIVER_BROADCAST, timestamp, content);
 
-	char *result = platform_strdup(msg);
-	safe_free((void **)&timestamp);
+	char *result = build_finish(msg);
 
 	LOG_DEBUG("Built offline notification for: %s", username);
 	return result;
@@ -628,30 +944,53 @@ char *build_system_notification(const char *content)
 		return NULL;
 	}
 
-	char *timestamp = get_current_timestamp();
-	if (!timestamp)
-	{
-		LOG_ERROR("Failed to get timestamp");
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
+
+	char escaped_content[MAX_CONTENT_LEN * 2];
+	escape_field_into(content, escaped_content, sizeof(escaped_content));
+
+	char *msg = build_alloc(BUILD_FRAME_MAX);
+	if (!msg)
 		return NULL;
-	}
+	if (snprintf(msg, BUILD_FRAME_MAX, "%s|server|%s|%s|%s\n",
+			 MSG_TYPE_BROADCAST, RECEIVER_BROADCAST,
+			 timestamp, escaped_content) >= BUILD_FRAME_MAX)
+		LOG_WARN("Message truncated to %d bytes", BUILD_FRAME_MAX);
 
-	char *escaped_content = escape_field(content);
-	if (!escaped_content)
+	char *result = build_finish(msg);
+
+	LOG_DEBUG("Built system notification");
+	return result;
+}
+
+/**
+ * @brief 构建在线状态变化通知
+ *
+ * 一个窗口内的状态变化合并为一帧，格式为：
+ * PRESENCE|server|*|timestamp|+alice,-bob
+ *
+ * 每个条目以 '+'（上线）或 '-'（下线）开头，条目之间以逗号分隔。
+ *
+ * @param delta 状态变化列表，不超过 MAX_CONTENT_LEN - 1 字节
+ * @return char* 成功返回通知消息字符串，失败返回NULL
+ */
+char *build_presence_msg(const char *delta)
+{
+	if (!delta || delta[0] == '\0' || strlen(delta) > MAX_CONTENT_LEN - 1)
 	{
-		LOG_ERROR("Failed to escape content");
-		safe_free((void **)&timestamp);
+		LOG_ERROR("Invalid presence delta");
 		return NULL;
 	}
 
-	char msg[512];
-	snprintf(msg, sizeof(msg), "%s|server|%s|%s|%s\n",
-			 MSG_TYPE_BROADCAST, RECEIVER_BROADCAST,
-			 timestamp, escaped_content);
+	char timestamp[32];
+	get_current_time(timestamp, sizeof(timestamp));
 
-	char *result = platform_strdup(msg);
-	safe_free((void **)&timestamp);
-	safe_free((void **)&escaped_content);
+	char *msg = build_alloc(BUILD_FRAME_MAX);
+	if (!msg)
+		return NULL;
+	snprintf(msg, BUILD_FRAME_MAX, "%s|server|%s|%s|%s\n",
+			 MSG_TYPE_PRESENCE, RECEIVER_BROADCAST, timestamp, delta);
 
-	LOG_DEBUG("Built system notification");
-	return result;
+	return build_finish(msg);
 }
@@ -6,10 +6,11 @@
  * 每个命令都有对应的处理函数，处理完成后会发送响应给客户端。
  *
  * 主要功能：
- * 1. 用户认证管理（登录/登出）
+ * 1. 用户认证管理（登录/登出/会话恢复）
  * 2. 消息发送处理（私聊/广播/群组）
  * 3. 历史记录查询
  * 4. 状态查询
+ * 5. 在线状态关注设置
  */
 
 #include <stdio.h>
@@ -20,37 +21,135 @@
 #include "../storage/storage.h"
 #include "../utils/utils.h"
 
+/** STATUS 响应文本的最大字节数 */
+#define STATUS_REPLY_BYTES 2048
+
 /**
- * @brief 发送消息到指定socket
- *
- * @param sockfd 目标socket
- * @param message 要发送的消息
- * @return int 成功返回0，失败返回-1
+ * @brief 每个线程的命令构建区及其底层内存，处理一条命令期间绑定
+ */
+static PLATFORM_THREAD_LOCAL char command_arena_buffer[COMMAND_ARENA_BYTES];
+static PLATFORM_THREAD_LOCAL Arena command_arena;
+
+/**
+ * @brief 统计缓冲区中的帧数（以换行结尾）
  */
-static int send_to_socket(socket_t sockfd, const char *message)
+static int count_frames(const char *data, size_t len)
 {
-	if (SOCKET_IS_INVALID(sockfd) || !message)
-		return -1;
+	int frames = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (data[i] == '\n')
+			frames++;
+	}
+	return frames;
+}
 
-	size_t len = strlen(message);
-	socket_io_result_t bytes_sent = platform_socket_send(sockfd, message, len);
+/**
+ * @brief 发出登录或会话恢复成功的响应
+ *
+ * 按 receiver 中的登录选项设置确认跟踪并取走离线消息，需要时完成 v2 协商、签发新的恢复令牌，
+ * 成功响应、令牌和离线消息拼成一个缓冲区一次写出，重连的用户在一个往返内补齐消息。
+ *
+ * 带 v2 选项（如 PROTOCOL_V2_OFFER）时成功响应仍是文本帧，receiver 回复 PROTOCOL_V2_ACCEPT，
+ * 其后的令牌、离线消息和之后的所有帧都是 v2 帧。带 ack 选项时该用户的私聊帧改为编号投递、
+ * 累计确认，响应的 receiver 带上 "ack=纪元"，上次连接中已投递但未确认的帧随离线消息一起重发。
+ * 带 resume 选项时响应之后紧跟一个 RESUME 帧，内容为下次断线后恢复会话用的令牌。
+ *
+ * @param client_fd 客户端文件描述符
+ * @param msg 登录或恢复消息，receiver 为登录选项
+ * @param username 已认证的用户名
+ * @param verb 响应文本的开头，如 "Login successful"
+ */
+static void send_session_reply(socket_t client_fd, const Message *msg, const char *username, const char *verb)
+{
+	int options = strncmp(msg->receiver, "server;", 7) == 0;
+
+	/* 按是否接受 ack 设置确认跟踪，再取走离线消息，与成功响应一起发送 */
+	int ack = options && protocol_find_option(msg->receiver, PROTOCOL_OPTION_ACK) != NULL;
+	size_t backlog_len = 0;
+	int spilled = 0;
+	char *backlog = offline_queue_login(username, ack, &backlog_len, &spilled);
+	char status[128];
+	int pending = backlog ? count_frames(backlog, backlog_len) : 0;
+	if (pending > 0 || spilled > 0)
+		snprintf(status, sizeof(status), "%s, %d offline messages%s", verb, pending,
+				 spilled > 0 ? " (older ones are in history)" : "");
+	else
+		safe_strcpy(status, verb, sizeof(status));
+
+	/* 新令牌排在离线消息之前，与它们一起按协商后的协议编码 */
+	char token[SESSION_RESUME_TOKEN_LEN];
+	char *token_frame = NULL;
+	if (options && protocol_find_option(msg->receiver, PROTOCOL_OPTION_RESUME) &&
+		session_resume_issue(username, session_manager_get_user_id(client_fd), token, sizeof(token)) == 0)
+		token_frame = build_resume_token(username, token);
+	if (token_frame)
+	{
+		size_t token_len = strlen(token_frame);
+		char *joined = (char *)malloc(token_len + backlog_len + 1);
+		if (joined)
+		{
+			memcpy(joined, token_frame, token_len);
+			if (backlog_len > 0)
+				memcpy(joined + token_len, backlog, backlog_len);
+			joined[token_len + backlog_len] = '\0';
+			free(backlog);
+			backlog = joined;
+			backlog_len += token_len;
+		}
+		build_free(token_frame);
+	}
 
-	if (bytes_sent < 0)
+	/* 已是 v2 的连接重新登录时不再协商，响应照常转换 */
+	Client *client = connection_manager_find_by_fd(client_fd);
+	int upgrade = client && client->protocol_version != PROTOCOL_V2 && options &&
+				  protocol_find_option(msg->receiver, PROTOCOL_OPTION_V2) != NULL;
+	if (upgrade && backlog)
 	{
-		LOG_ERROR("Failed to send to socket %lld: %s",
-				  SOCKET_ID(sockfd), platform_socket_error_message());
-		return -1;
+		char *binary = protocol_v2_from_text(backlog, backlog_len, &backlog_len);
+		free(backlog);
+		backlog = binary;
+		if (!binary)
+			backlog_len = 0;
 	}
 
-	LOG_DEBUG("Sent %lld bytes to socket %lld", (long long)bytes_sent, SOCKET_ID(sockfd));
-	return 0;
+	char accepted[MAX_USERNAME_LEN];
+	snprintf(accepted, sizeof(accepted), "client%s", upgrade ? ";" PROTOCOL_OPTION_V2 : "");
+	if (ack)
+		snprintf(accepted + strlen(accepted), sizeof(accepted) - strlen(accepted), ";%s=%lu",
+				 PROTOCOL_OPTION_ACK, (unsigned long)offline_queue_epoch());
+	char *success_msg = upgrade || ack ? build_response_to(RESPONSE_SUCCESS, MSG_TYPE_OK, accepted, status)
+									   : build_success_msg(status);
+	if (success_msg)
+	{
+		size_t reply_len = strlen(success_msg);
+		char *burst = backlog_len > 0 ? build_alloc(reply_len + backlog_len) : success_msg;
+		if (burst && burst != success_msg)
+		{
+			memcpy(burst, success_msg, reply_len);
+			memcpy(burst + reply_len, backlog, backlog_len);
+		}
+		if (burst)
+			connection_manager_send(client_fd, burst, reply_len + backlog_len);
+		if (burst != success_msg)
+			build_free(burst);
+		build_free(success_msg);
+	}
+	if (upgrade)
+	{
+		connection_manager_set_protocol(client_fd, PROTOCOL_V2);
+		LOG_INFO("User %s switched to protocol %s", username, PROTOCOL_VERSION_V2);
+	}
+	if (spilled > 0)
+		LOG_INFO("User %s had %d offline messages spilled to history", username, spilled);
+	free(backlog);
 }
 
 /**
  * @brief 处理登录命令
  *
- * 解析消息内容获取用户名和密码，进行认证。
- * 认证成功后设置客户端认证状态。
+ * 解析消息内容获取用户名和密码，进行认证。认证成功后设置客户端认证状态，
+ * 按登录选项发出成功响应和离线期间收到的消息（见 send_session_reply）。
  *
  * @param client_fd 客户端文件描述符
  * @param msg 登录消息
@@ -74,8 +173,8 @@ static int handle_login(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_AUTH_FAILED, "Missing username or password");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_AUTH_FAILED;
 	}
@@ -89,15 +188,7 @@ static int handle_login(socket_t client_fd, Message *msg)
 	{
 		// 认证成功
 		LOG_INFO("User logged in successfully: %s (fd=%lld)", username, SOCKET_ID(client_fd));
-
-		// 发送成功响应
-		char *success_msg = build_success_msg("Login successful");
-		if (success_msg)
-		{
-			send_to_socket(client_fd, success_msg);
-			free(success_msg);
-		}
-
+		send_session_reply(client_fd, msg, username, "Login successful");
 		return 0;
 	}
 	else
@@ -107,11 +198,53 @@ static int handle_login(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_AUTH_FAILED, "Invalid username or password");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
+		}
+		return ERROR_AUTH_FAILED;
+	}
+}
+
+/**
+ * @brief 处理会话恢复命令
+ *
+ * 内容为登录时收到的恢复令牌，可以在分号后带已收到的最大投递序号。令牌有效时不验证口令，
+ * 直接把连接绑定到令牌所属的用户：跟踪确认的用户先按序号确认断线前已收到的帧，
+ * 再和登录一样发出成功响应、新令牌和断线期间错过的帧。令牌无效或保留期已过时回复认证失败，
+ * 客户端改用 LOGIN 重新登录。
+ *
+ * @param client_fd 客户端文件描述符
+ * @param msg 恢复消息
+ * @return int 成功返回0，失败返回错误码
+ */
+static int handle_resume(socket_t client_fd, Message *msg)
+{
+	if (!msg || !is_resume_msg(msg))
+	{
+		LOG_ERROR("Invalid resume message");
+		return -1;
+	}
+
+	const char *username = msg->sender;
+	char token[SESSION_RESUME_TOKEN_LEN + 16];
+	safe_strcpy(token, msg->content, sizeof(token));
+	uint32_t last_seen = protocol_take_delivery_id(token);
+
+	if (!session_manager_resume(client_fd, username, token))
+	{
+		char *error_msg = build_error_msg(ERROR_AUTH_FAILED, "Session expired, log in again");
+		if (error_msg)
+		{
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_AUTH_FAILED;
 	}
+
+	int acked = last_seen > 0 ? offline_queue_ack(username, last_seen) : 0;
+	LOG_INFO("User resumed session: %s (fd=%lld, %d frames acked on resume)", username, SOCKET_ID(client_fd), acked);
+	send_session_reply(client_fd, msg, username, "Session resumed");
+	return 0;
 }
 
 /**
@@ -141,8 +274,8 @@ static int handle_logout(socket_t client_fd, Message *msg)
 	char *success_msg = build_success_msg("Logout successful");
 	if (success_msg)
 	{
-		send_to_socket(client_fd, success_msg);
-		free(success_msg);
+		connection_manager_send_text(client_fd, success_msg);
+		build_free(success_msg);
 	}
 
 	LOG_INFO("User logged out: %s (fd=%lld)", username, SOCKET_ID(client_fd));
@@ -173,8 +306,8 @@ static int handle_send_message(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_AUTH_FAILED, "Please login first");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_AUTH_FAILED;
 	}
@@ -193,8 +326,8 @@ static int handle_send_message(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_AUTH_FAILED, "Sender mismatch");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_AUTH_FAILED;
 	}
@@ -205,12 +338,13 @@ static int handle_send_message(socket_t client_fd, Message *msg)
 
 	if (route_result == 0)
 	{
-		// 发送成功响应给发送者
-		char *success_msg = build_success_msg("Message sent successfully");
+		// 发送成功响应给发送者，接收者离线时说明消息已排队
+		char *success_msg = build_success_msg(msg->is_delivered ? "Message sent successfully"
+																: "User is offline, message queued");
 		if (success_msg)
 		{
-			send_to_socket(client_fd, success_msg);
-			free(success_msg);
+			connection_manager_send_text(client_fd, success_msg);
+			build_free(success_msg);
 		}
 		return 0;
 	}
@@ -226,8 +360,8 @@ static int handle_send_message(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(route_result, error_str);
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return route_result;
 	}
@@ -257,8 +391,8 @@ static int handle_broadcast(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_AUTH_FAILED, "Please login first");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_AUTH_FAILED;
 	}
@@ -277,8 +411,8 @@ static int handle_broadcast(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_AUTH_FAILED, "Sender mismatch");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_AUTH_FAILED;
 	}
@@ -293,8 +427,8 @@ static int handle_broadcast(socket_t client_fd, Message *msg)
 		char *success_msg = build_success_msg("Broadcast sent successfully");
 		if (success_msg)
 		{
-			send_to_socket(client_fd, success_msg);
-			free(success_msg);
+			connection_manager_send_text(client_fd, success_msg);
+			build_free(success_msg);
 		}
 		return 0;
 	}
@@ -303,21 +437,119 @@ static int handle_broadcast(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_SERVER_ERROR, "Failed to broadcast message");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_SERVER_ERROR;
 	}
 }
 
+/**
+ * @brief 历史查询结果的分页发送状态
+ */
+typedef struct
+{
+	socket_t client_fd; /**< 查询者 */
+	char *page;			/**< 当前页已拼接的帧 */
+	size_t len;			/**< 当前页长度 */
+	size_t cap;			/**< 当前页缓冲区容量 */
+	int entries;		/**< 当前页的消息数 */
+	const char *query;	/**< 全文检索的查询文本，用于截取摘要 */
+} HistoryPager;
+
+/**
+ * @brief 把当前页作为一次写入交给发送队列
+ */
+static void flush_history_page(HistoryPager *pager)
+{
+	if (pager->len > 0)
+	{
+		connection_manager_send_text(pager->client_fd, pager->page);
+		pager->len = 0;
+		pager->entries = 0;
+	}
+}
+
+/**
+ * @brief 历史查询回调：把一条历史消息序列化为 HISTORY 帧追加到当前页，满页时发送
+ */
+static int send_history_entry(const Message *entry, void *ctx)
+{
+	HistoryPager *pager = (HistoryPager *)ctx;
+	Message reply = *entry;
+
+	// 帧类型为 HISTORY，发送者、接收者和时间戳保留原消息的值
+	safe_strcpy(reply.type, MSG_TYPE_HISTORY, sizeof(reply.type));
+	char *frame = serialize_message(&reply);
+	if (!frame)
+		return 0;
+
+	size_t frame_len = strlen(frame);
+	if (pager->len + frame_len + 1 > pager->cap)
+	{
+		size_t cap = pager->cap ? pager->cap : 4096;
+		while (pager->len + frame_len + 1 > cap)
+			cap *= 2;
+		char *grown = (char *)realloc(pager->page, cap);
+		if (!grown)
+		{
+			build_free(frame);
+			return 1;
+		}
+		pager->page = grown;
+		pager->cap = cap;
+	}
+	memcpy(pager->page + pager->len, frame, frame_len + 1);
+	pager->len += frame_len;
+	build_free(frame);
+
+	if (++pager->entries >= HISTORY_PAGE_SIZE)
+		flush_history_page(pager);
+	return 0;
+}
+
+/**
+ * @brief 检索回调：内容换成 "#序号 摘要" 后按历史消息发送
+ */
+static int send_search_entry(const Message *entry, void *ctx)
+{
+	HistoryPager *pager = (HistoryPager *)ctx;
+	Message hit = *entry;
+	char snippet[HISTORY_SNIPPET_LEN + 8];
+
+	history_search_snippet(entry->content, pager->query, snippet, sizeof(snippet));
+	snprintf(hit.content, sizeof(hit.content), "#%d %s", entry->message_id, snippet);
+	return send_history_entry(&hit, ctx);
+}
+
+/**
+ * @brief 把查询参数中的时间解析为 time_t，空或无法解析时返回0（不限）
+ */
+static time_t parse_history_bound(const char *value)
+{
+	time_t t = value ? parse_timestamp(value) : -1;
+	return t > 0 ? t : 0;
+}
+
 /**
  * @brief 处理历史记录查询命令
  *
- * TODO: 等待history_manager实现
+ * 内容为 target|start_time|end_time[|limit[|since[|query]]]：target 为用户名时查询双方的私聊，
+ * 为空或 "all" 时查询广播；时间留空表示不限，limit 缺省为 HISTORY_QUERY_DEFAULT_LIMIT。
+ * 匹配的最近消息按时间顺序以 HISTORY 帧返回，每 HISTORY_PAGE_SIZE 条拼成一页
+ * 一次写入发送队列，最后以 OK 结束。
+ *
+ * since 非空时为增量同步：忽略时间范围，返回序号大于 since 的最早 limit 条消息，
+ * OK 内容为 "History: N messages, cursor=C, more=M"，客户端以 C 作为下一次的 since，
+ * M 为1时继续请求下一页。
+ *
+ * query 非空时为全文检索：忽略时间范围和游标，返回会话中包含 query 全部词元的最近 limit 条，
+ * 每条 HISTORY 帧的内容为 "#序号 摘要"，OK 内容为 "Search: N of M matches"。
+ * query 是最后一个字段，其中可以含有 '|'。
  *
  * @param client_fd 客户端文件描述符
  * @param msg 历史查询消息
- * @return int 暂返回-1
+ * @return int 成功返回0，失败返回错误码
  */
 static int handle_history_request(socket_t client_fd, Message *msg)
 {
@@ -334,47 +566,87 @@ static int handle_history_request(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_AUTH_FAILED, "Please login first");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_AUTH_FAILED;
 	}
 
 	// 解析查询参数
-	// 内容格式：target|start_time|end_time
-	char *content_copy = platform_strdup(msg->content);
-	if (!content_copy)
+	// 内容格式：target|start_time|end_time[|limit[|since[|query]]]，保留空字段（工作线程上执行，不能用 strtok）
+	char content_copy[MAX_CONTENT_LEN];
+	char *fields[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
+	safe_strcpy(content_copy, msg->content, sizeof(content_copy));
+	fields[0] = content_copy;
+	for (int i = 1; i < 6 && fields[i - 1]; i++)
 	{
-		LOG_ERROR("Failed to duplicate content");
-		return -1;
+		char *sep = strchr(fields[i - 1], '|');
+		if (sep)
+		{
+			*sep = '\0';
+			fields[i] = sep + 1;
+		}
 	}
 
-	char *target = strtok(content_copy, "|");
-	char *start_time = strtok(NULL, "|");
-	char *end_time = strtok(NULL, "|");
-
-	LOG_DEBUG("History request: user=%s, target=%s, start=%s, end=%s",
-			  msg->sender, target ? target : "all",
-			  start_time ? start_time : "none",
-			  end_time ? end_time : "none");
-
-	free(content_copy);
+	const char *target = fields[0];
+	time_t start = parse_history_bound(fields[1]);
+	time_t end = parse_history_bound(fields[2]);
+	int limit = fields[3] ? atoi(fields[3]) : 0;
+	int incremental = fields[4] && *fields[4];
+	uint32_t since = incremental ? (uint32_t)strtoul(fields[4], NULL, 10) : 0;
+	const char *query = fields[5] && *fields[5] ? fields[5] : NULL;
+
+	LOG_DEBUG("History request: user=%s, target=%s, start=%lld, end=%lld",
+			  msg->sender, *target ? target : "all", (long long)start, (long long)end);
+
+	// 用户名取自已认证的连接，只能查询自己参与的会话
+	Client *client = connection_manager_find_by_fd(client_fd);
+	const char *user = client ? client->username : msg->sender;
+	HistoryPager pager = {client_fd, NULL, 0, 0, 0, query};
+	uint32_t cursor = since;
+	int more = 0;
+	int total = 0;
+	int count;
+	if (query)
+		count = history_manager_search(user, target, query, limit, send_search_entry, &pager, &total);
+	else if (incremental)
+		count = history_manager_query_after(user, target, since, limit, send_history_entry, &pager, &cursor, &more);
+	else
+		count = history_manager_query(user, target, start, end, limit, send_history_entry, &pager);
+	flush_history_page(&pager);
+	free(pager.page);
+	if (count < 0)
+	{
+		char *response = build_error_msg(ERROR_SERVER_ERROR, query ? "Search unavailable" : "History unavailable");
+		if (response)
+		{
+			connection_manager_send_text(client_fd, response);
+			build_free(response);
+		}
+		return ERROR_SERVER_ERROR;
+	}
 
-	// TODO: 实现历史记录查询功能
-	char *response = build_error_msg(ERROR_SERVER_ERROR, "History feature not implemented yet");
+	char summary[96];
+	if (query)
+		snprintf(summary, sizeof(summary), "Search: %d of %d matches", count, total);
+	else if (incremental)
+		snprintf(summary, sizeof(summary), "History: %d messages, cursor=%u, more=%d", count, (unsigned int)cursor, more);
+	else
+		snprintf(summary, sizeof(summary), "History: %d messages", count);
+	char *response = build_success_msg(summary);
 	if (response)
 	{
-		send_to_socket(client_fd, response);
-		free(response);
+		connection_manager_send_text(client_fd, response);
+		build_free(response);
 	}
-
-	return -1;
+	return 0;
 }
 
 /**
  * @brief 处理状态查询命令
  *
- * 返回当前服务器状态和用户状态信息。
+ * 返回当前服务器状态、运行指标（运行时间、流量、错误计数和每种命令的耗时分位数）
+ * 和用户状态信息，每行一个 OK 帧。
  *
  * @param client_fd 客户端文件描述符
  * @param msg 状态查询消息
@@ -391,63 +663,89 @@ static int handle_status_request(socket_t client_fd, Message *msg)
 	const char *username = msg->sender;
 	LOG_DEBUG("Processing status request from: %s", username);
 
-	// 构建状态信息
-	char status_info[512];
-	int online_count = 0;
-
-	// 获取在线用户列表
-	char **online_users = NULL;
-	int user_count = 0;
-	if (session_manager_get_online_users(&online_users, &user_count))
-	{
-		online_count = user_count;
-	}
-
-	// 构建状态消息
-	snprintf(status_info, sizeof(status_info),
-			 "Server Status:\n"
-			 "- Uptime: TODO\n"
-			 "- Connected clients: %d\n"
-			 "- Online users: %d\n"
-			 "- Total users: %d\n"
-			 "- Your status: %s",
-			 connection_manager_count(),
-			 online_count,
-			 user_store_count(),
+	// 构建状态信息（连接数和在线数为所有 reactor 分片的合计），每行以换行结尾
+	char status_info[STATUS_REPLY_BYTES];
+	int online_count = connection_manager_online_count();
+	size_t client_peak = 0;
+	size_t pooled_clients = connection_manager_pool_usage(&client_peak);
+
+	int used = snprintf(status_info, sizeof(status_info),
+						"Server Status:\n"
+						"- Connected clients: %d\n"
+						"- Online users: %d\n"
+						"- Total users: %d\n"
+						"- Client objects: %zu in use, %zu peak\n",
+						connection_manager_total_count(),
+						online_count,
+						user_store_count(),
+						pooled_clients, client_peak);
+	if (used < 0 || (size_t)used >= sizeof(status_info))
+		return -1;
+	used += (int)server_stats_format_status(status_info + used, sizeof(status_info) - (size_t)used);
+	snprintf(status_info + used, sizeof(status_info) - (size_t)used, "- Your status: %s\n",
 			 session_manager_is_authenticated(client_fd) ? "Online" : "Offline");
 
-	// 清理在线用户列表
-	if (online_users)
+	// 帧以换行分隔，每行单独构建一个 OK 帧，拼成一个缓冲区一次发送
+	char *reply = build_alloc(STATUS_REPLY_BYTES * 2);
+	size_t reply_len = 0;
+	if (!reply)
+		return -1;
+	for (char *line = status_info, *next; *line; line = next)
 	{
-		for (int i = 0; i < user_count; i++)
+		next = strchr(line, '\n');
+		if (!next)
+			next = line + strlen(line);
+		else
+			*next++ = '\0';
+
+		char *frame = build_success_msg(line);
+		if (!frame)
+			continue;
+		size_t frame_len = strlen(frame);
+		if (reply_len + frame_len <= STATUS_REPLY_BYTES * 2)
 		{
-			free(online_users[i]);
+			memcpy(reply + reply_len, frame, frame_len);
+			reply_len += frame_len;
 		}
-		free(online_users);
+		build_free(frame);
 	}
 
 	// 发送状态响应
-	char *response = build_success_msg(status_info);
+	if (reply_len > 0)
+		connection_manager_send(client_fd, reply, reply_len);
+	build_free(reply);
+
+	return 0;
+}
+
+/**
+ * @brief 向客户端发送一条 OK 或 ERROR 响应
+ */
+static void send_group_reply(socket_t client_fd, int code, const char *text)
+{
+	char *response = code == 0 ? build_success_msg(text) : build_error_msg(code, text);
 	if (response)
 	{
-		send_to_socket(client_fd, response);
-		free(response);
+		connection_manager_send_text(client_fd, response);
+		build_free(response);
 	}
-
-	return 0;
 }
 
 /**
  * @brief 处理群组消息命令
  *
- * TODO: 等待群组管理模块实现
+ * 接收者为 "group:<群组名>"。内容为 GROUP_CONTROL_JOIN / GROUP_CONTROL_LEAVE 时
+ * 加入或退出群组（加入不存在的群组时创建），其余内容作为群组消息发给在线成员，
+ * 发送者必须是该群组的成员。
  *
  * @param client_fd 客户端文件描述符
  * @param msg 群组消息
- * @return int 暂返回-1
+ * @return int 成功返回0，失败返回错误码
  */
 static int handle_group_message(socket_t client_fd, Message *msg)
 {
+	char text[128];
+
 	if (!msg || !is_group_msg(msg))
 	{
 		LOG_ERROR("Invalid group message");
@@ -461,42 +759,198 @@ static int handle_group_message(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_AUTH_FAILED, "Please login first");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_AUTH_FAILED;
 	}
 
+	const char *sender = session_manager_get_username(client_fd);
+	if (!sender || strcmp(sender, msg->sender) != 0)
+	{
+		LOG_WARN("Group message sender mismatch on fd=%lld", SOCKET_ID(client_fd));
+		send_group_reply(client_fd, ERROR_AUTH_FAILED, "Sender mismatch");
+		return ERROR_AUTH_FAILED;
+	}
+
+	size_t prefix_len = strlen(RECEIVER_GROUP_PREFIX);
+	const char *group_name = msg->receiver + prefix_len;
+	if (strncmp(msg->receiver, RECEIVER_GROUP_PREFIX, prefix_len) != 0 || *group_name == '\0' ||
+		strcmp(msg->receiver, RECEIVER_ALL_GROUP) == 0)
+	{
+		send_group_reply(client_fd, ERROR_SERVER_ERROR, "Invalid group name");
+		return -1;
+	}
+
 	LOG_DEBUG("Processing group message: %s -> %s", msg->sender, msg->receiver);
 
-	// TODO: 实现群组消息处理
-	char *response = build_error_msg(ERROR_SERVER_ERROR, "Group feature not implemented yet");
-	if (response)
+	if (strcmp(msg->content, GROUP_CONTROL_JOIN) == 0)
 	{
-		send_to_socket(client_fd, response);
-		free(response);
+		int result = group_manager_join(group_name, msg->sender);
+		if (result == ERROR_GROUP_FULL)
+		{
+			send_group_reply(client_fd, ERROR_GROUP_FULL, "Group is full");
+			return ERROR_GROUP_FULL;
+		}
+		if (result < 0)
+		{
+			send_group_reply(client_fd, ERROR_SERVER_ERROR, "Failed to join group");
+			return -1;
+		}
+		snprintf(text, sizeof(text), "%s group %s (%d members)", result == 1 ? "Already in" : "Joined",
+				 group_name, group_manager_member_count(group_name));
+		send_group_reply(client_fd, 0, text);
+		return 0;
 	}
 
-	return -1;
+	if (strcmp(msg->content, GROUP_CONTROL_LEAVE) == 0)
+	{
+		if (group_manager_leave(group_name, msg->sender) != 0)
+		{
+			send_group_reply(client_fd, ERROR_USER_NOT_FOUND, "Not a member of this group");
+			return ERROR_USER_NOT_FOUND;
+		}
+		snprintf(text, sizeof(text), "Left group %s", group_name);
+		send_group_reply(client_fd, 0, text);
+		return 0;
+	}
+
+	if (!group_manager_is_member(group_name, msg->sender))
+	{
+		send_group_reply(client_fd, ERROR_USER_NOT_FOUND, "Not a member of this group");
+		return ERROR_USER_NOT_FOUND;
+	}
+
+	int route_result = route_message(msg);
+	if (route_result != 0)
+	{
+		send_group_reply(client_fd, route_result, "Failed to send group message");
+		return route_result;
+	}
+	send_group_reply(client_fd, 0, "Group message sent");
+	return 0;
 }
 
 /**
- * @brief 主命令处理函数
+ * @brief 回复一条关注设置的结果
+ */
+static void send_presence_reply(socket_t client_fd, int code, const char *text)
+{
+	char *response = code == 0 ? build_success_msg(text) : build_error_msg(code, text);
+	if (response)
+	{
+		connection_manager_send_text(client_fd, response);
+		build_free(response);
+	}
+}
+
+/**
+ * @brief 处理在线状态关注设置
  *
- * 根据消息类型分发到对应的命令处理函数。
+ * 内容为 "*"（接收所有人的状态，默认）、"-"（关闭通知）或以逗号分隔的用户名列表。
+ * 设置为列表时在 OK 之后补发一个 PRESENCE 帧，列出其中当前在线的用户；
+ * 之后的状态变化在合并窗口结束时随 PRESENCE 帧送达。
  *
  * @param client_fd 客户端文件描述符
- * @param msg 要处理的消息
+ * @param msg 关注设置消息
  * @return int 成功返回0，失败返回错误码
  */
-int handle_command(socket_t client_fd, Message *msg)
+static int handle_presence(socket_t client_fd, Message *msg)
 {
-	if (!msg)
+	if (!msg || !is_presence_msg(msg))
 	{
-		LOG_ERROR("NULL message for command handling");
+		LOG_ERROR("Invalid presence request");
+		return -1;
+	}
+
+	Client *client = connection_manager_find_by_fd(client_fd);
+	if (!client || client->status != CLIENT_STATUS_AUTHENTICATED)
+	{
+		LOG_WARN("Unauthorized presence request from fd=%lld", SOCKET_ID(client_fd));
+		send_presence_reply(client_fd, ERROR_AUTH_FAILED, "Please login first");
+		return ERROR_AUTH_FAILED;
+	}
+
+	if (presence_window() == 0)
+	{
+		send_presence_reply(client_fd, ERROR_SERVER_ERROR, "Presence notifications disabled");
+		return ERROR_SERVER_ERROR;
+	}
+
+	// 关注设置以已认证的用户名为键，下线时清除
+	int watched = presence_watch(client->username, msg->content);
+	if (watched < 0)
+	{
+		send_presence_reply(client_fd, ERROR_SERVER_ERROR, "Invalid presence targets");
+		return ERROR_SERVER_ERROR;
+	}
+
+	char summary[64];
+	if (watched > 0)
+		snprintf(summary, sizeof(summary), "Presence: watching %d users", watched);
+	else
+		safe_strcpy(summary, strcmp(msg->content, "-") == 0 ? "Presence: off" : "Presence: watching everyone",
+					sizeof(summary));
+	send_presence_reply(client_fd, 0, summary);
+
+	char online[MAX_CONTENT_LEN];
+	if (watched > 0 && presence_snapshot(client->username, online, sizeof(online)) > 0)
+	{
+		char *frame = build_presence_msg(online);
+		if (frame)
+		{
+			connection_manager_send_text(client_fd, frame);
+			build_free(frame);
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief 处理累计送达确认
+ *
+ * 内容为客户端已收到的最大投递序号，从该用户的离线队列中删除序号不超过它的帧。
+ * 确认不回复，格式错误或未登录时也只记录日志，避免每个确认再多一帧。
+ *
+ * @param client_fd 客户端文件描述符
+ * @param msg ACK 消息
+ * @return int 成功返回0，失败返回-1
+ */
+static int handle_ack(socket_t client_fd, Message *msg)
+{
+	if (!msg || !is_ack_msg(msg))
+		return -1;
+
+	const char *username = session_manager_get_username(client_fd);
+	if (!session_manager_is_authenticated(client_fd) || !username || strcmp(username, msg->sender) != 0)
+	{
+		LOG_WARN("Ignoring ack from unauthenticated or mismatched sender: fd=%lld", SOCKET_ID(client_fd));
 		return -1;
 	}
 
+	char *end;
+	unsigned long upto = strtoul(msg->content, &end, 10);
+	if (end == msg->content || *end != '\0' || upto == 0 || upto > UINT32_MAX)
+	{
+		LOG_WARN("Invalid ack from %s: %s", username, msg->content);
+		return -1;
+	}
+
+	metrics_add(STAT_DELIVERY_ACKS, 1);
+	int trimmed = offline_queue_ack(username, (uint32_t)upto);
+	LOG_DEBUG("Ack from %s up to %lu trimmed %d messages", username, upto, trimmed);
+	return 0;
+}
+
+/**
+ * @brief 根据消息类型分发到对应的命令处理函数
+ *
+ * @param client_fd 客户端文件描述符
+ * @param msg 要处理的消息
+ * @return int 成功返回0，失败返回错误码
+ */
+static int dispatch_command(socket_t client_fd, Message *msg)
+{
 	LOG_DEBUG("Handling command: fd=%lld, type=%s", SOCKET_ID(client_fd), msg->type);
 
 	// 获取命令类型
@@ -508,6 +962,9 @@ int handle_command(socket_t client_fd, Message *msg)
 	case CMD_LOGIN:
 		return handle_login(client_fd, msg);
 
+	case CMD_RESUME:
+		return handle_resume(client_fd, msg);
+
 	case CMD_LOGOUT:
 		return handle_logout(client_fd, msg);
 
@@ -527,7 +984,15 @@ int handle_command(socket_t client_fd, Message *msg)
 	case CMD_GET_STATUS:
 		return handle_status_request(client_fd, msg);
 
+	case CMD_PRESENCE:
+		return handle_presence(client_fd, msg);
+
+	case CMD_ACK:
+		return handle_ack(client_fd, msg);
+
 	case CMD_UNKNOWN:
+	case CMD_RESPONSE_OK:
+	case CMD_RESPONSE_ERROR:
 		// 检查是否是响应消息（ERROR/OK）
 		if (strcmp(msg->type, MSG_TYPE_ERROR) == 0 ||
 			strcmp(msg->type, MSG_TYPE_OK) == 0)
@@ -540,8 +1005,8 @@ int handle_command(socket_t client_fd, Message *msg)
 		char *error_msg = build_error_msg(ERROR_SERVER_ERROR, "Unknown command type");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return ERROR_SERVER_ERROR;
 	}
@@ -550,11 +1015,40 @@ int handle_command(socket_t client_fd, Message *msg)
 	return -1;
 }
 
+/**
+ * @brief 主命令处理函数
+ *
+ * 处理期间为当前线程绑定命令构建区，响应和转发帧都在其中构建，
+ * 发送时已复制进发送队列，命令结束后一次回收。处理耗时计入该命令的直方图。
+ *
+ * @param client_fd 客户端文件描述符
+ * @param msg 要处理的消息
+ * @return int 成功返回0，失败返回错误码
+ */
+int handle_command(socket_t client_fd, Message *msg)
+{
+	if (!msg)
+	{
+		LOG_ERROR("NULL message for command handling");
+		return -1;
+	}
+
+	if (!command_arena.base)
+		arena_init(&command_arena, command_arena_buffer, sizeof(command_arena_buffer));
+	uint64_t started_us = platform_monotonic_us();
+	int bound = build_arena_begin(&command_arena);
+	int result = dispatch_command(client_fd, msg);
+	build_arena_end(bound);
+	server_stats_record_command(get_command_type(msg->type), platform_monotonic_us() - started_us);
+	return result;
+}
+
 /**
  * @brief 处理原始消息字符串
  *
  * 将原始消息字符串解析为Message结构，然后调用命令处理器。
- * 这是一个便捷函数，用于简化消息处理流程。
+ * 这是一个便捷函数，用于简化消息处理流程。已持有解析结果的调用方
+ * （如服务端收包路径）应直接调用 handle_command，避免重复解析。
  *
  * @param client_fd 客户端文件描述符
  * @param raw_message 原始消息字符串
@@ -576,8 +1070,8 @@ int handle_raw_message(socket_t client_fd, const char *raw_message)
 		char *error_msg = build_error_msg(ERROR_SERVER_ERROR, "Failed to parse message");
 		if (error_msg)
 		{
-			send_to_socket(client_fd, error_msg);
-			free(error_msg);
+			connection_manager_send_text(client_fd, error_msg);
+			build_free(error_msg);
 		}
 		return -1;
 	}
@@ -586,7 +1080,7 @@ int handle_raw_message(socket_t client_fd, const char *raw_message)
 	int result = handle_command(client_fd, msg);
 
 	// 清理消息
-	safe_free((void **)&msg);
+	free_message(msg);
 
 	return result;
 }
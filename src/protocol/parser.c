@@ -24,204 +24,213 @@
 static atomic_int message_id_counter = ATOMIC_VAR_INIT(100);
 
 /**
- * @brief 解析原始消息字符串为Message结构体
+ * @brief parse_message 返回的堆上 Message 的对象池，由 free_message 归还
+ */
+static ObjectPool message_pool = OBJECT_POOL_INITIALIZER("message", sizeof(Message), 0);
+
+static int check_scanned_message(size_t len, const ProtocolScan *scan);
+static size_t escaped_length(const char *field);
+
+/**
+ * @brief 分配下一个消息ID
  *
- * 该函数将原始字符串格式的消息解析为Message结构体，包括字段提取、
- * 转义字符处理、消息验证等功能。
+ * 文本协议和二进制协议 v2 的解析共用同一个计数器。
  *
- * @param raw_msg 原始消息字符串，格式为：type|sender|receiver|timestamp|content
- * @return Message* 成功返回解析后的消息结构体指针，失败返回NULL
+ * @return int 消息ID
  */
-Message *parse_message(const char *raw_msg)
+int protocol_next_message_id(void)
 {
-	if (!raw_msg || strlen(raw_msg) == 0)
-	{
-		// LOG_ERROR("Empty message received");
-		LOG_ERROR("空的信息");
-		return NULL;
-	}
+	return atomic_fetch_add(&message_id_counter, 1);
+}
 
-	LOG_DEBUG("Parsing message format: %s", raw_msg);
+/**
+ * @brief 在登录选项字段中查找一个选项
+ *
+ * 字段形如 "server;v2;ack" 或 "client;v2;ack=1760000000"，第一个分号之前是对端标识，
+ * 之后每段是一个选项，可以带 "=值"。
+ *
+ * @param field LOGIN 或登录响应的 receiver 字段
+ * @param option 选项名
+ * @return const char* 找到时指向选项的值（到下一个分号或字段结尾为止，没有值时为空），未找到返回NULL
+ */
+const char *protocol_find_option(const char *field, const char *option)
+{
+	if (!field || !option)
+		return NULL;
 
-	if (!validate_message(raw_msg))
+	size_t option_len = strlen(option);
+	const char *p = strchr(field, ';');
+	while (p)
 	{
-		LOG_ERROR("Invalid message format: %s", raw_msg);
-		return NULL;
+		p++;
+		const char *end = strchr(p, ';');
+		size_t len = end ? (size_t)(end - p) : strlen(p);
+		if (len >= option_len && strncmp(p, option, option_len) == 0)
+		{
+			if (len == option_len)
+				return p + len;
+			if (p[option_len] == '=')
+				return p + option_len + 1;
+		}
+		p = end;
 	}
+	return NULL;
+}
 
-	Message *msg = (Message *)safe_malloc(sizeof(Message));
-	if (!msg)
+/**
+ * @brief 取出私聊帧时间戳中的投递序号
+ *
+ * 接受了 ack 选项的用户收到的私聊帧时间戳为 "时间;序号"，取出序号后把时间戳还原为原来的时间。
+ *
+ * @param timestamp 可写的时间戳字段
+ * @return uint32_t 投递序号，没有序号返回0（时间戳不变）
+ */
+uint32_t protocol_take_delivery_id(char *timestamp)
+{
+	if (!timestamp)
+		return 0;
+
+	char *sep = strrchr(timestamp, PROTOCOL_DELIVERY_SEPARATOR);
+	if (!sep || sep[1] < '1' || sep[1] > '9')
+		return 0;
+
+	char *end;
+	unsigned long id = strtoul(sep + 1, &end, 10);
+	if (*end != '\0' || id > UINT32_MAX)
+		return 0;
+	*sep = '\0';
+	return (uint32_t)id;
+}
+
+/**
+ * @brief 在调用方提供的缓冲区和Message上原地解析消息
+ *
+ * 直接在 raw_msg 上切分字段并原地反转义，结果写入调用方提供的 msg，
+ * 整个过程不进行堆分配。raw_msg 会被修改，调用后不应再作为原始消息使用。
+ *
+ * @param raw_msg 可写的原始消息，格式为：type|sender|receiver|timestamp|content，
+ *                raw_msg[len] 必须为 '\0'
+ * @param len 消息长度（不含终止符）
+ * @param msg 输出的消息结构体
+ * @return int 成功返回0，失败返回-1
+ */
+int parse_message_into(char *raw_msg, size_t len, Message *msg)
+{
+	if (!raw_msg || !msg || len == 0)
 	{
-		LOG_ERROR("Memory allocation failed for Message");
-		return NULL;
+		LOG_ERROR("空的信息");
+		return -1;
 	}
 
-	memset(msg, 0, sizeof(Message));
-	msg->next = NULL;
-	msg->prev = NULL;
-	msg->message_id = 0;
-	msg->is_delivered = 0;
+	LOG_DEBUG("Parsing message format: %s", raw_msg);
 
-	char *msg_copy = platform_strdup(raw_msg);
-	if (!msg_copy)
+	/* 一次前向扫描同时完成校验和字段定位 */
+	ProtocolScan scan;
+	memset(&scan, 0, sizeof(scan));
+	if (len >= 5 && len <= MAX_RAW_MESSAGE_LEN)
+		protocol_scan(raw_msg, len, &scan);
+	if (!check_scanned_message(len, &scan))
 	{
-		LOG_ERROR("Failed to duplicate message string");
-		safe_free((void **)&msg);
-		return NULL;
+		LOG_ERROR("Invalid message format: %s", raw_msg);
+		return -1;
 	}
 
-	size_t len = strlen(msg_copy);
-	if (len > 0 && msg_copy[len - 1] == '\n')
+	/* 各字符串字段下面都会整体写入，不再清零整个结构体（内容字段较大） */
+	msg->is_delivered = 0;
+
+	if (raw_msg[len - 1] == '\n')
 	{
-		msg_copy[len - 1] = '\0';
+		raw_msg[--len] = '\0';
 	}
 
-	/* 按未被转义的分隔符手动切分字段，strtok 无法识别转义序列
-	   为避免当 content 中包含额外的分隔符导致 fields 数组越界，
-	   只在前 FIELD_COUNT-1 个未转义分隔符处分割，其后的分隔符都
+	/* 只在前 FIELD_COUNT-1 个未转义分隔符处分割，其后的分隔符都
 	   视为 content 字段的一部分。 */
-	char *fields[FIELD_COUNT] = {NULL};
-	int field_index = 0;
-	char *start = msg_copy;
-	size_t mlen = strlen(msg_copy);
-	for (size_t i = 0; i < mlen; i++)
+	char *fields[FIELD_COUNT];
+	char *start = raw_msg;
+	for (int i = 0; i < FIELD_COUNT - 1; i++)
 	{
-		if (msg_copy[i] == FIELD_DELIMITER[0])
-		{
-			/* 计算当前位置前连续的转义字符数量，若为偶数则分隔符有效 */
-			int backslashes = 0;
-			int idx = (int)i - 1;
-			for (int k = idx; k >= 0 && msg_copy[k] == ESCAPE_CHAR; k--)
-			{
-				backslashes++;
-			}
-			if (backslashes % 2 == 0)
-			{
-				/* 仅在尚未达到字段上限时分割，最后一个字段包含剩余所有内容 */
-				if (field_index < FIELD_COUNT - 1)
-				{
-					msg_copy[i] = '\0';
-					fields[field_index++] = start;
-					start = &msg_copy[i + 1];
-				}
-				/* 否则把这个分隔符视为内容的一部分，继续扫描 */
-			}
-		}
+		raw_msg[scan.delimiters[i]] = '\0';
+		fields[i] = start;
+		start = &raw_msg[scan.delimiters[i] + 1];
 	}
 	/* 最后一个字段指向剩余字符串（即 content） */
-	fields[field_index++] = start;
+	fields[FIELD_CONTENT] = start;
 
-	if (field_index < FIELD_COUNT)
+	char *targets[FIELD_COUNT] = {msg->type, msg->sender, msg->receiver, msg->timestamp, msg->content};
+	size_t sizes[FIELD_COUNT] = {sizeof(msg->type), sizeof(msg->sender), sizeof(msg->receiver),
+								 sizeof(msg->timestamp), sizeof(msg->content)};
+	for (int i = 0; i < FIELD_COUNT; i++)
 	{
-		LOG_ERROR("Invalid field count: %d (expected at least %d)", field_index, FIELD_COUNT);
-		safe_free((void **)&msg_copy);
-		safe_free((void **)&msg);
-		return NULL;
+		/* 整条消息没有转义序列时无需逐字段反转义 */
+		if (scan.escape_count > 0)
+			unescape_field_inplace(fields[i]);
+		safe_strcpy(targets[i], fields[i], sizes[i]);
 	}
 
-	/* 如果字段超过 FIELD_COUNT，则将多余的字段合并到最后的 content 字段中 */
-	if (field_index > FIELD_COUNT)
+	if (msg->type[0] == '\0')
 	{
-		/* 合并 fields[FIELD_CONTENT] .. fields[field_index-1] */
-		size_t total_len = 0;
-		for (int j = FIELD_CONTENT; j < field_index; j++)
-		{
-			total_len += strlen(fields[j]) + 1; /* 包括分隔符 */
-		}
-		char *merged = (char *)safe_malloc(total_len + 1);
-		if (!merged)
-		{
-			LOG_ERROR("Failed to allocate merged content");
-			safe_free((void **)&msg_copy);
-			safe_free((void **)&msg);
-			return NULL;
-		}
-		merged[0] = '\0';
-		for (int j = FIELD_CONTENT; j < field_index; j++)
-		{
-			if (j > FIELD_CONTENT)
-				strcat(merged, FIELD_DELIMITER);
-			strcat(merged, fields[j]);
-		}
-		/* 将合并后的字符串放回 fields[FIELD_CONTENT]，并置后续为 NULL */
-		fields[FIELD_CONTENT] = merged;
-		for (int j = FIELD_CONTENT + 1; j < field_index; j++)
-			fields[j] = NULL;
-		field_index = FIELD_COUNT;
+		LOG_ERROR("Message type is empty");
+		return -1;
 	}
-
-	for (int i = 0; i < FIELD_COUNT; i++)
+	if (!is_valid_msg_type(msg->type))
 	{
-		if (!fields[i])
-		{
-			LOG_ERROR("Field %d is NULL", i);
-			safe_free((void **)&msg_copy);
-			safe_free((void **)&msg);
-			return NULL;
-		}
-		char *unescaped = unescape_field(fields[i]);
-		if (!unescaped)
-		{
-			LOG_ERROR("Failed to unescaped field %d", i);
-			safe_free((void **)&msg_copy);
-			safe_free((void **)&msg);
-			return NULL;
-		}
-		switch (i)
-		{
-		case FIELD_TYPE:
-			safe_strcpy(msg->type, unescaped, sizeof(msg->type));
-			break;
-		case FIELD_SENDER:
-			safe_strcpy(msg->sender, unescaped, sizeof(msg->sender));
-			break;
-		case FIELD_RECEIVER:
-			safe_strcpy(msg->receiver, unescaped, sizeof(msg->receiver));
-			break;
-		case FIELD_TIMESTAMP:
-			safe_strcpy(msg->timestamp, unescaped, sizeof(msg->timestamp));
-			break;
-		case FIELD_CONTENT:
-			safe_strcpy(msg->content, unescaped, sizeof(msg->content));
-			break;
-		}
-		free(unescaped);
+		LOG_ERROR("Invalid message type: %s", msg->type);
+		return -1;
 	}
-	/* 如果我们为合并分配了内存，释放 msg_copy 后需要释放 merged（已替换到 fields[FIELD_CONTENT]） */
-	if (field_index == FIELD_COUNT && fields[FIELD_CONTENT] && fields[FIELD_CONTENT] != start)
+
+	msg->message_id = protocol_next_message_id();
+
+	if (msg->timestamp[0] == '\0')
 	{
-		/* merged was allocated via safe_malloc and assigned to fields[FIELD_CONTENT]; it will be freed by safe_free above? */
+		get_current_time(msg->timestamp, sizeof(msg->timestamp));
 	}
-	safe_free((void **)&msg_copy);
 
-	if (strlen(msg->type) == 0)
+	LOG_DEBUG("Successfully parsed message: id=%d, type=%s, sender=%s, receiver=%s", msg->message_id, msg->type, msg->sender, msg->receiver);
+	return 0;
+}
+
+/**
+ * @brief 解析原始消息字符串为Message结构体
+ *
+ * 兼容接口：把原始消息复制到栈上的临时缓冲区，再调用 parse_message_into
+ * 填充新分配的 Message。调用者负责使用 free_message 释放结果。
+ *
+ * @param raw_msg 原始消息字符串，格式为：type|sender|receiver|timestamp|content
+ * @return Message* 成功返回解析后的消息结构体指针，失败返回NULL
+ */
+Message *parse_message(const char *raw_msg)
+{
+	char buffer[MAX_RAW_MESSAGE_LEN + 2];
+
+	if (!raw_msg || raw_msg[0] == '\0')
 	{
-		LOG_ERROR("Message type is empty");
-		safe_free((void **)&msg);
+		LOG_ERROR("空的信息");
 		return NULL;
 	}
-	if (!is_valid_msg_type(msg->type))
+
+	size_t len = strlen(raw_msg);
+	if (len >= sizeof(buffer))
 	{
-		LOG_ERROR("Invalid message type: %s", msg->type);
-		safe_free((void **)&msg);
+		LOG_ERROR("Invalid message format: message too long (%zu bytes)", len);
 		return NULL;
 	}
+	memcpy(buffer, raw_msg, len + 1);
 
-	msg->message_id = atomic_fetch_add(&message_id_counter, 1);
-
-	if (strlen(msg->timestamp) == 0)
+	Message *msg = (Message *)object_pool_alloc(&message_pool);
+	if (!msg)
 	{
-		char *timestamp = get_current_timestamp();
-		if (timestamp)
-		{
-			safe_strcpy(msg->timestamp, timestamp, sizeof(msg->timestamp));
-			safe_free((void **)&timestamp);
-		}
+		LOG_ERROR("Memory allocation failed for Message");
+		return NULL;
 	}
 
-	LOG_DEBUG("Successfully parsed message: id=%d, type=%s, sender=%s, receiver=%s", msg->message_id, msg->type, msg->sender, msg->receiver);
+	if (parse_message_into(buffer, len, msg) != 0)
+	{
+		object_pool_free(&message_pool, msg);
+		return NULL;
+	}
 	return msg;
 }
+
 /**
  * @brief 将Message结构体序列化为字符串
  *
@@ -246,56 +255,26 @@ char *serialize_message(const Message *msg)
 		return NULL;
 	}
 
-	// 转义所有字段
-	char *escaped_type = escape_field(msg->type);
-	char *escaped_sender = escape_field(msg->sender);
-	char *escaped_receiver = escape_field(msg->receiver);
-	char *escaped_timestamp = escape_field(msg->timestamp);
-	char *escaped_content = escape_field(msg->content);
-
-	if (!escaped_type || !escaped_sender || !escaped_receiver ||
-		!escaped_timestamp || !escaped_content)
-	{
-		LOG_ERROR("Failed to escape message fields");
-		free(escaped_type);
-		free(escaped_sender);
-		free(escaped_receiver);
-		free(escaped_timestamp);
-		free(escaped_content);
-		return NULL;
-	}
-
-	// 计算缓冲区大小
-	size_t buffer_size = strlen(escaped_type) + strlen(escaped_sender) +
-						 strlen(escaped_receiver) + strlen(escaped_timestamp) +
-						 strlen(escaped_content) + 10; // 分隔符和结尾
+	// 先计算转义后的总长度，再把各字段直接转义写入输出缓冲区
+	const char *fields[5] = {msg->type, msg->sender, msg->receiver, msg->timestamp, msg->content};
+	size_t buffer_size = 2; // 换行和结尾
+	for (int i = 0; i < 5; i++)
+		buffer_size += escaped_length(fields[i]) + 1;
 
-	char *buffer = (char *)safe_malloc(buffer_size);
+	char *buffer = build_alloc(buffer_size);
 	if (!buffer)
 	{
 		LOG_ERROR("Memory allocation failed for serialization buffer");
-		free(escaped_type);
-		free(escaped_sender);
-		free(escaped_receiver);
-		free(escaped_timestamp);
-		free(escaped_content);
 		return NULL;
 	}
 
-	// 格式化消息
-	snprintf(buffer, buffer_size, "%s|%s|%s|%s|%s\n",
-			 escaped_type,
-			 escaped_sender,
-			 escaped_receiver,
-			 escaped_timestamp,
-			 escaped_content);
-
-	// 清理
-	free(escaped_type);
-	free(escaped_sender);
-	free(escaped_receiver);
-	free(escaped_timestamp);
-	free(escaped_content);
+	size_t pos = 0;
+	for (int i = 0; i < 5; i++)
+	{
+		pos += escape_field_into(fields[i], buffer + pos, buffer_size - pos);
+		buffer[pos++] = i < 4 ? FIELD_DELIMITER[0] : '\n';
+	}
+	buffer[pos] = '\0';
 
 	LOG_DEBUG("Serialized message: %s", buffer);
 
@@ -303,83 +282,76 @@ char *serialize_message(const Message *msg)
 }
 
 /**
- * @brief 验证消息格式
- *
- * 该函数验证原始消息字符串是否符合协议格式要求，包括：
- * 1. 消息不为空
- * 2. 消息长度在合理范围内
- * 3. 分隔符数量正确（4个）
- * 4. 消息不以未转义的反斜杠结尾
+ * @brief 根据扫描结果检查消息格式
  *
- * @param raw_msg 要验证的原始消息字符串
+ * @param len 消息长度
+ * @param scan protocol_scan 的扫描结果
  * @return int 验证通过返回1(真)，失败返回0(假)
  */
-int validate_message(const char *raw_msg)
+static int check_scanned_message(size_t len, const ProtocolScan *scan)
 {
-	if (!raw_msg)
-	{
-		LOG_DEBUG("NULL message received");
-		return 0;
-	}
-
-	size_t len = strlen(raw_msg);
 	if (len < 5)
 	{
 		LOG_DEBUG("Message too short: %zu", len);
 		return 0;
 	}
 
-	if (len > 1024)
+	if (len > MAX_RAW_MESSAGE_LEN)
 	{ // 合理的大小限制
 		LOG_DEBUG("Message too long: %zu", len);
 		return 0;
 	}
 
-	// 统计分隔符数量（忽略被转义的分隔符）
-	int delimiter_count = 0;
-	for (size_t i = 0; i < len; i++)
-	{
-		if (raw_msg[i] == FIELD_DELIMITER[0])
-		{
-			// 计算当前位置前连续的转义字符('\')数量，如果为偶数则该分隔符有效
-			int backslashes = 0;
-			int idx = (int)i - 1;
-			for (int k = idx; k >= 0 && raw_msg[k] == ESCAPE_CHAR; k--)
-			{
-				backslashes++;
-			}
-			if (backslashes % 2 == 0)
-			{
-				delimiter_count++;
-			}
-		}
-	}
-
 	// 至少应有 4 个分隔符；允许更多（例如响应消息的 content 里可能包含额外的分隔符）
-	if (delimiter_count < FIELD_COUNT - 1)
+	if (scan->delimiter_count < FIELD_COUNT - 1)
 	{
 		LOG_DEBUG("Invalid delimiter count: %d (expected at least %d)",
-				  delimiter_count, FIELD_COUNT - 1);
+				  scan->delimiter_count, FIELD_COUNT - 1);
 		return 0;
 	}
 
 	/* 检查是否存在尾部孤立的转义字符（以单个反斜杠结尾且未被转义） */
-	if (len > 0 && raw_msg[len - 1] == ESCAPE_CHAR)
+	if (scan->trailing_escape)
 	{
-		/* 统计结尾处连续反斜杠的数量 */
-		int backslashes = 0;
-		for (int i = (int)len - 1; i >= 0 && raw_msg[i] == ESCAPE_CHAR; i--)
-			backslashes++;
-		if (backslashes % 2 == 1)
-		{
-			LOG_DEBUG("Message ends with an unescaped backslash");
-			return 0;
-		}
+		LOG_DEBUG("Message ends with an unescaped backslash");
+		return 0;
 	}
 
 	return 1;
 }
 
+/**
+ * @brief 验证消息格式
+ *
+ * 该函数验证原始消息字符串是否符合协议格式要求，包括：
+ * 1. 消息不为空
+ * 2. 消息长度在合理范围内
+ * 3. 分隔符数量正确（4个）
+ * 4. 消息不以未转义的反斜杠结尾
+ *
+ * 未转义分隔符的统计由 protocol_scan 单次前向扫描完成。
+ *
+ * @param raw_msg 要验证的原始消息字符串
+ * @return int 验证通过返回1(真)，失败返回0(假)
+ */
+int validate_message(const char *raw_msg)
+{
+	ProtocolScan scan;
+
+	if (!raw_msg)
+	{
+		LOG_DEBUG("NULL message received");
+		return 0;
+	}
+
+	/* 长度不合法时无需扫描，直接由检查函数报告 */
+	size_t len = strlen(raw_msg);
+	memset(&scan, 0, sizeof(scan));
+	if (len >= 5 && len <= MAX_RAW_MESSAGE_LEN)
+		protocol_scan(raw_msg, len, &scan);
+	return check_scanned_message(len, &scan);
+}
+
 /**
  * @brief 识别命令类型
  *
@@ -422,6 +394,18 @@ CommandType get_command_type(const char *type_str)
 	{
 		return CMD_GET_STATUS;
 	}
+	else if (strcmp(type_str, MSG_TYPE_PRESENCE) == 0)
+	{
+		return CMD_PRESENCE;
+	}
+	else if (strcmp(type_str, MSG_TYPE_ACK) == 0)
+	{
+		return CMD_ACK;
+	}
+	else if (strcmp(type_str, MSG_TYPE_RESUME) == 0)
+	{
+		return CMD_RESUME;
+	}
 	else if (strcmp(type_str, MSG_TYPE_ERROR) == 0 ||
 			 strcmp(type_str, MSG_TYPE_OK) == 0)
 	{
@@ -459,6 +443,16 @@ const char *get_command_str(CommandType type)
 		return MSG_TYPE_HISTORY;
 	case CMD_GET_STATUS:
 		return MSG_TYPE_STATUS;
+	case CMD_RESPONSE_OK:
+		return MSG_TYPE_OK;
+	case CMD_RESPONSE_ERROR:
+		return MSG_TYPE_ERROR;
+	case CMD_PRESENCE:
+		return MSG_TYPE_PRESENCE;
+	case CMD_ACK:
+		return MSG_TYPE_ACK;
+	case CMD_RESUME:
+		return MSG_TYPE_RESUME;
 	default:
 		return "UNKNOWN";
 	}
@@ -468,7 +462,7 @@ const char *get_command_str(CommandType type)
  * @brief 验证消息类型
  *
  * 检查给定的消息类型字符串是否为有效的消息类型。
- * 有效类型包括：LOGIN、LOGOUT、MSG、BROADCAST、GROUP、HISTORY、STATUS、ERROR、OK。
+ * 有效类型包括：LOGIN、LOGOUT、MSG、BROADCAST、GROUP、HISTORY、STATUS、PRESENCE、ACK、RESUME、ERROR、OK。
  *
  * @param type 要验证的消息类型字符串
  * @return int 有效返回1(真)，无效返回0(假)
@@ -485,6 +479,9 @@ int is_valid_msg_type(const char *type)
 			strcmp(type, MSG_TYPE_GROUP) == 0 ||
 			strcmp(type, MSG_TYPE_HISTORY) == 0 ||
 			strcmp(type, MSG_TYPE_STATUS) == 0 ||
+			strcmp(type, MSG_TYPE_PRESENCE) == 0 ||
+			strcmp(type, MSG_TYPE_ACK) == 0 ||
+			strcmp(type, MSG_TYPE_RESUME) == 0 ||
 			strcmp(type, MSG_TYPE_ERROR) == 0 ||
 			strcmp(type, MSG_TYPE_OK) == 0);
 }
@@ -542,124 +539,177 @@ char *escape_field(const char *field)
 		return platform_strdup("");
 	}
 
+	size_t size = escaped_length(field) + 1;
+	char *escaped = (char *)safe_malloc(size);
+	if (!escaped)
+	{
+		LOG_ERROR("Memory allocation failed for escaped field");
+		return NULL;
+	}
+
+	escape_field_into(field, escaped, size);
+	return escaped;
+}
+
+/**
+ * @brief 计算字段转义后的长度（不含结尾）
+ *
+ * @param field 字段字符串，NULL 视为空串
+ * @return size_t 转义后的长度
+ */
+static size_t escaped_length(const char *field)
+{
+	if (!field)
+		return 0;
+
 	size_t len = strlen(field);
-	size_t escape_count = 0;
+	size_t escaped = len;
 
-	// 统计需要转义的字符
-	for (size_t i = 0; i < len; i++)
+	// 统计需要转义的字符，扫描器直接跳过普通字节
+	for (size_t i = protocol_find_special(field, 0, len); i < len;
+		 i = protocol_find_special(field, i + 1, len))
 	{
-		if (field[i] == FIELD_DELIMITER[0] ||
-			field[i] == ESCAPE_CHAR ||
-			field[i] == '\n')
-		{
-			escape_count++;
-		}
+		escaped++;
 	}
+	return escaped;
+}
 
-	// 分配内存
-	char *escaped = (char *)safe_malloc(len + escape_count + 1);
-	if (!escaped)
+/**
+ * @brief 把字段转义后写入调用方提供的缓冲区
+ *
+ * 空间不足时在完整的字符或转义序列处截断，输出总是以空字符结尾。
+ *
+ * @param field 要转义的字段字符串，NULL 视为空串
+ * @param out 输出缓冲区
+ * @param cap 输出缓冲区大小
+ * @return size_t 写入的长度（不含结尾）
+ */
+size_t escape_field_into(const char *field, char *out, size_t cap)
+{
+	if (!out || cap == 0)
+		return 0;
+	if (!field)
 	{
-		LOG_ERROR("Memory allocation failed for escaped field");
-		return NULL;
+		out[0] = '\0';
+		return 0;
 	}
 
+	// 普通字节成段复制，只对特殊字符逐个输出转义序列
+	size_t len = strlen(field);
+	size_t i = 0;
 	size_t j = 0;
-	for (size_t i = 0; i < len; i++)
-	{
-		if (field[i] == FIELD_DELIMITER[0])
-		{
-			escaped[j++] = ESCAPE_CHAR;
-			escaped[j++] = DELIMITER_ESCAPE;
-		}
-		else if (field[i] == ESCAPE_CHAR)
-		{
-			escaped[j++] = ESCAPE_CHAR;
-			escaped[j++] = ESCAPE_CHAR;
-		}
-		else if (field[i] == '\n')
-		{
-			escaped[j++] = ESCAPE_CHAR;
-			escaped[j++] = NEWLINE_ESCAPE;
-		}
+	while (i < len)
+	{
+		size_t next = protocol_find_special(field, i, len);
+		size_t run = next - i;
+		if (run > cap - 1 - j)
+			run = cap - 1 - j;
+		memcpy(out + j, field + i, run);
+		j += run;
+		if (next >= len || i + run < next || j + 2 > cap - 1)
+			break;
+
+		out[j++] = ESCAPE_CHAR;
+		if (field[next] == FIELD_DELIMITER[0])
+			out[j++] = DELIMITER_ESCAPE;
+		else if (field[next] == ESCAPE_CHAR)
+			out[j++] = ESCAPE_CHAR;
 		else
-		{
-			escaped[j++] = field[i];
-		}
+			out[j++] = NEWLINE_ESCAPE;
+		i = next + 1;
 	}
-	escaped[j] = '\0';
-
-	return escaped;
+	out[j] = '\0';
+	return j;
 }
 
 /**
- * @brief 反转义字段
+ * @brief 原地反转义字段
  *
- * 将转义后的字段还原为原始内容，处理转义序列：
+ * 反转义后的内容不会比原内容更长，因此可以直接覆盖原字符串：
  * 1. '\d' -> '|'
  * 2. '\\\\' -> '\\'
  * 3. '\\n' -> '\n'
  *
- * @param field 要反转义的字段字符串
- * @return char* 成功返回反转义后的字符串，失败返回NULL
+ * @param field 要反转义的可写字段字符串
+ * @return size_t 反转义后的长度
  */
-char *unescape_field(const char *field)
+size_t unescape_field_inplace(char *field)
 {
 	if (!field)
-	{
-		return platform_strdup("");
-	}
+		return 0;
 
 	size_t len = strlen(field);
-	char *unescaped = (char *)safe_malloc(len + 1);
-	if (!unescaped)
-	{
-		LOG_ERROR("Memory allocation failed for unescaped field");
-		return NULL;
-	}
+	char *escape = (char *)memchr(field, ESCAPE_CHAR, len);
+	if (!escape)
+		return len;
 
-	size_t j = 0;
-	for (size_t i = 0; i < len; i++)
+	/* 第一个转义字符之前的内容保持不动，之后成段前移 */
+	size_t i = (size_t)(escape - field);
+	size_t j = i;
+	while (i < len)
 	{
 		if (field[i] == ESCAPE_CHAR && i + 1 < len)
 		{
 			switch (field[i + 1])
 			{
 			case DELIMITER_ESCAPE:
-				unescaped[j++] = FIELD_DELIMITER[0];
-				i++;
+				field[j++] = FIELD_DELIMITER[0];
+				i += 2;
 				break;
 			case ESCAPE_CHAR:
-				unescaped[j++] = ESCAPE_CHAR;
-				i++;
+				field[j++] = ESCAPE_CHAR;
+				i += 2;
 				break;
 			case NEWLINE_ESCAPE:
-				unescaped[j++] = '\n';
-				i++;
+				field[j++] = '\n';
+				i += 2;
 				break;
 			default:
 				// 无效的转义序列，保留原样
-				unescaped[j++] = field[i];
+				field[j++] = field[i++];
 				break;
 			}
+			continue;
 		}
-		else
-		{
-			unescaped[j++] = field[i];
-		}
+
+		/* 复制到下一个转义字符为止的普通字节 */
+		char *next = (char *)memchr(field + i + 1, ESCAPE_CHAR, len - i - 1);
+		size_t end = next ? (size_t)(next - field) : len;
+		memmove(field + j, field + i, end - i);
+		j += end - i;
+		i = end;
+	}
+	field[j] = '\0';
+
+	return j;
+}
+
+/**
+ * @brief 反转义字段
+ *
+ * 复制字段后调用 unescape_field_inplace 处理转义序列：
+ * 1. '\d' -> '|'
+ * 2. '\\\\' -> '\\'
+ * 3. '\\n' -> '\n'
+ *
+ * @param field 要反转义的字段字符串
+ * @return char* 成功返回反转义后的字符串，失败返回NULL
+ */
+char *unescape_field(const char *field)
+{
+	if (!field)
+	{
+		return platform_strdup("");
 	}
-	unescaped[j] = '\0';
 
-	// 如果长度变短了，重新分配内存
-	if (j < len)
+	char *unescaped = platform_strdup(field);
+	if (!unescaped)
 	{
-		char *temp = realloc(unescaped, j + 1);
-		if (temp)
-		{
-			unescaped = temp;
-		}
+		LOG_ERROR("Memory allocation failed for unescaped field");
+		return NULL;
 	}
 
+	unescape_field_inplace(unescaped);
 	return unescaped;
 }
 
@@ -667,7 +717,7 @@ char *unescape_field(const char *field)
  * @brief 获取当前时间戳字符串
  *
  * 获取当前时间的格式化字符串，格式为"YYYY-MM-DD HH:MM:SS"。
- * 使用线程安全的localtime_r函数确保多线程环境下正常工作。
+ * 由 get_current_time 从线程的按秒缓存中复制。
  *
  * @return char* 成功返回时间戳字符串，失败返回NULL
  */
@@ -679,14 +729,12 @@ char *get_current_timestamp(void)
 		return NULL;
 	}
 
-	time_t now = time(NULL);
-	struct tm tm_info;
-	if (platform_localtime(&now, &tm_info) == NULL)
+	get_current_time(timestamp, 32);
+	if (timestamp[0] == '\0')
 	{
 		safe_free((void **)&timestamp);
 		return NULL;
 	}
-	strftime(timestamp, 32, "%Y-%m-%d %H:%M:%S", &tm_info);
 
 	return timestamp;
 }
@@ -819,12 +867,58 @@ int is_status_request(const Message *msg)
 	return msg && strcmp(msg->type, MSG_TYPE_STATUS) == 0;
 }
 
+/**
+ * @brief 检查是否为在线状态消息
+ *
+ * @param msg 要检查的消息指针
+ * @return int 是 PRESENCE 消息返回1(真)，否则返回0(假)
+ */
+int is_presence_msg(const Message *msg)
+{
+	return msg && strcmp(msg->type, MSG_TYPE_PRESENCE) == 0;
+}
+
+/**
+ * @brief 检查是否为送达确认消息
+ *
+ * @param msg 要检查的消息指针
+ * @return int 是 ACK 消息返回1(真)，否则返回0(假)
+ */
+int is_ack_msg(const Message *msg)
+{
+	return msg && strcmp(msg->type, MSG_TYPE_ACK) == 0;
+}
+
+/**
+ * @brief 检查是否为会话恢复消息
+ *
+ * @param msg 要检查的消息指针
+ * @return int 是 RESUME 消息返回1(真)，否则返回0(假)
+ */
+int is_resume_msg(const Message *msg)
+{
+	return msg && strcmp(msg->type, MSG_TYPE_RESUME) == 0;
+}
+
 /*
- * @brief 释放 Message 结构体
+ * @brief 释放 Message 结构体，归还消息对象池
  */
 void free_message(Message *msg)
 {
 	if (!msg)
 		return;
-	safe_free((void **)&msg);
+	object_pool_free(&message_pool, msg);
+}
+
+/**
+ * @brief 获取消息对象池的使用数和峰值
+ *
+ * @param high_water 输出峰值，可为NULL
+ * @return size_t 使用中的 Message 对象数
+ */
+size_t protocol_message_pool_usage(size_t *high_water)
+{
+	if (high_water)
+		*high_water = object_pool_high_water(&message_pool);
+	return object_pool_in_use(&message_pool);
 }
@@ -11,6 +11,36 @@
 #define NEWLINE_ESCAPE 'n'
 
 #define PROTOCOL_VERSION "1.0"
+#define PROTOCOL_VERSION_V2 "2.0"
+
+#define PROTOCOL_V1 1 // 文本协议：type|sender|receiver|timestamp|content\n
+#define PROTOCOL_V2 2 // 二进制协议：长度前缀分帧，字段带 varint 长度，不转义
+
+/* v2 帧：魔数 | 正文长度(varint) | 类型标签(CommandType) | 4 个 varint 长度 + 原始字节的字段。
+   魔数不是可打印字符，不会是文本帧的首字节，两种帧可以按首字节区分。 */
+#define PROTOCOL_V2_MAGIC 0xB2
+#define PROTOCOL_V2_MAX_BODY MAX_RAW_MESSAGE_LEN
+#define PROTOCOL_V2_MAX_FRAME (PROTOCOL_V2_MAX_BODY + 4)
+
+/* 版本协商：LOGIN 的 receiver 为 PROTOCOL_V2_OFFER 表示客户端支持 v2，
+   旧服务器忽略 LOGIN 的 receiver；登录成功响应（仍是文本帧）的 receiver 为
+   PROTOCOL_V2_ACCEPT 表示服务器接受，此后双方都改用 v2 帧 */
+#define PROTOCOL_V2_OFFER "server;v2"
+#define PROTOCOL_V2_ACCEPT "client;v2"
+
+/* 登录选项：LOGIN 的 receiver 一般形式为 "server;选项;选项..."，登录成功响应的 receiver
+   为 "client;" 加服务器接受的选项，v2 协商是只带一个选项的特例。选项可带值（"名称=值"） */
+#define PROTOCOL_OPTION_V2 "v2"
+#define PROTOCOL_OPTION_ACK "ack" // 累计送达确认，接受时带服务器的序号纪元 "ack=<epoch>"
+#define PROTOCOL_OPTION_RESUME "resume" // 请求恢复令牌，登录成功后服务器另发一个 RESUME 帧
+
+/* 累计送达确认：接受了 ack 的用户收到的私聊帧时间戳为 "时间;投递序号"，
+   客户端收到后发 ACK 帧确认已收到的最大序号，服务器据此成批删除离线队列中的消息 */
+#define PROTOCOL_DELIVERY_SEPARATOR ';'
+
+/* 会话恢复：登录选项带 resume 时，登录响应之后服务器发 "RESUME|server|用户|时间|令牌"；
+   断线重连时客户端发 "RESUME|用户|server;选项|时间|令牌;已收到的最大投递序号" 代替 LOGIN，
+   选项与 LOGIN 相同，成功响应与登录响应相同并附上新令牌 */
 
 #define FIELD_TYPE 0	  // 消息类型
 #define FIELD_SENDER 1	  // 发送者
@@ -19,15 +49,93 @@
 #define FIELD_CONTENT 4	  // 内容
 #define FIELD_COUNT 5	  // 字段总数
 
+#define MAX_RAW_MESSAGE_LEN 4096 // 单条文本协议消息的最大长度，容纳完全转义的 MAX_CONTENT_LEN 字节内容
+
+/* 单次前向扫描的结果：解析、校验共用，避免对同一帧重复扫描 */
+typedef struct
+{
+	size_t delimiters[FIELD_COUNT - 1]; // 前 FIELD_COUNT-1 个未转义分隔符的位置
+	int delimiter_count;				// 未转义分隔符总数
+	size_t escape_count;				// 转义序列数量
+	int trailing_escape;				// 是否以孤立的转义字符结尾
+} ProtocolScan;
+
+/* 协议扫描器（scanner.c） */
+size_t protocol_find_special(const char *data, size_t from, size_t len);
+void protocol_scan(const char *data, size_t len, ProtocolScan *scan);
+
 Message *parse_message(const char *raw_msg);
+/* 在可写缓冲区上原地解析到调用方提供的 Message，无堆分配 */
+int parse_message_into(char *raw_msg, size_t len, Message *msg);
 char *serialize_message(const Message *msg);
+int protocol_next_message_id(void);
+const char *protocol_find_option(const char *field, const char *option);
+uint32_t protocol_take_delivery_id(char *timestamp);
+
+/* 二进制协议 v2（binary.c） */
+int protocol_v2_tag(const char *type);
+size_t protocol_v2_encode(const Message *msg, char *out, size_t cap);
+int protocol_v2_frame(const char *data, size_t avail, size_t *header_len, size_t *body_len);
+int protocol_v2_decode(const char *body, size_t len, Message *msg);
+int protocol_next_frame(FrameBuffer *fb, char **frame, size_t *frame_len, int *binary);
+char *protocol_v2_from_text(const char *text, size_t len, size_t *out_len);
+
+/* 入站流量记录（trace.c），格式见 docs/trace_format.md */
+#define TRACE_MAGIC "ITTRACE1"					 /* 文件头魔数，后跟 8 字节小端的捕获开始时刻（Unix 微秒） */
+#define TRACE_HEADER_LEN 16
+#define TRACE_MAX_FRAME PROTOCOL_V2_MAX_FRAME	 /* 单帧内容的上限，超过视为文件损坏 */
+#define TRACE_WIRE_OVERHEAD 11					 /* 还原线上字节时最多增加的字节数（魔数和长度前缀） */
+
+typedef enum
+{
+	TRACE_OPEN = 1, /* 连接的第一帧之前 */
+	TRACE_TEXT,		/* 文本帧，不含行尾换行 */
+	TRACE_V2,		/* v2 帧正文，不含魔数和长度前缀 */
+	TRACE_CLOSE		/* 服务端关闭连接 */
+} TraceRecordType;
+
+typedef struct
+{
+	int type;		  /* TraceRecordType */
+	uint32_t conn;	  /* 连接号，从1开始 */
+	uint64_t time_us; /* 距捕获开始的微秒数 */
+	const char *data; /* 帧内容，非帧记录为NULL */
+	size_t len;		  /* 帧长度 */
+} TraceRecord;
+
+typedef struct
+{
+	FILE *fp;
+	uint64_t start_us; /* 捕获开始时刻（Unix 微秒） */
+	uint64_t time_us;  /* 已读记录累计的相对时刻 */
+	char *data;		   /* 帧内容缓冲区 */
+	size_t cap;
+} TraceReader;
+
+int trace_capture_start(const char *path);
+void trace_capture_stop(void);
+int trace_capture_enabled(void);
+void trace_capture_frame(uint32_t *conn, int binary, const char *frame, size_t len);
+void trace_capture_close(uint32_t conn);
+int trace_reader_open(TraceReader *reader, const char *path);
+int trace_reader_next(TraceReader *reader, TraceRecord *record);
+void trace_reader_close(TraceReader *reader);
+size_t trace_record_wire(const TraceRecord *record, char *out, size_t cap);
 
 /* 命令类型识别 */
 CommandType get_command_type(const char *type_str);
 const char *get_command_str(CommandType type);
 
-/* 消息构建相关 - 直接返回格式化字符串 */
+/* 构建区：处理一条命令期间绑定，build_* 和 serialize_message 的结果在其中分配，命令结束时一次回收 */
+#define COMMAND_ARENA_BYTES (16 * 1024)
+int build_arena_begin(Arena *arena);
+void build_arena_end(int bound);
+char *build_alloc(size_t size);
+void build_free(char *msg);
+
+/* 消息构建相关 - 直接返回格式化字符串，用 build_free 释放 */
 char *build_login_msg(const char *username, const char *password);
+char *build_login_to(const char *username, const char *password, const char *receiver);
 char *build_logout_msg(const char *username);
 char *build_text_msg(const char *sender, const char *receiver,
 					 const char *content);
@@ -36,16 +144,26 @@ char *build_group_msg(const char *sender, const char *group_name,
 					  const char *content);
 char *build_history_request(const char *username, const char *target,
 							const char *start_time, const char *end_time);
+char *build_history_sync_request(const char *username, const char *target,
+								 unsigned int since, int limit);
+char *build_history_search_request(const char *username, const char *target,
+								   const char *query, int limit);
 char *build_status_request(const char *username);
+char *build_presence_request(const char *username, const char *targets);
+char *build_ack_request(const char *username, uint32_t upto);
+char *build_resume_request(const char *username, const char *receiver, const char *token, uint32_t last_seen);
+char *build_resume_token(const char *username, const char *token);
 
 /* 额外的构建器函数原型 */
 char *build_response_from_struct(const Response *resp);
 char *build_user_online_msg(const char *username);
 char *build_user_offline_msg(const char *username);
 char *build_system_notification(const char *content);
+char *build_presence_msg(const char *delta);
 
 /* 响应消息构建 - 根据你的Response结构体 */
 char *build_response_msg(int code, const char *type, const char *message);
+char *build_response_to(int code, const char *type, const char *receiver, const char *message);
 char *build_success_msg(const char *message);
 char *build_error_msg(int error_code, const char *message);
 
@@ -56,12 +174,15 @@ int is_valid_username(const char *username);
 
 /* 辅助函数 */
 char *escape_field(const char *field);
+size_t escape_field_into(const char *field, char *out, size_t cap);
 char *unescape_field(const char *field);
+size_t unescape_field_inplace(char *field);
 char *get_current_timestamp(void);
 int parse_group_id(const char *receiver);
 
 /* 释放消息结构体内存 */
 void free_message(Message *msg);
+size_t protocol_message_pool_usage(size_t *high_water);
 
 /* 消息类型检查 */
 int is_login_msg(const Message *msg);
@@ -71,6 +192,9 @@ int is_broadcast_msg(const Message *msg);
 int is_group_msg(const Message *msg);
 int is_history_request(const Message *msg);
 int is_status_request(const Message *msg);
+int is_presence_msg(const Message *msg);
+int is_ack_msg(const Message *msg);
+int is_resume_msg(const Message *msg);
 
 int handle_command(socket_t client_fd, Message *msg);
 int handle_raw_message(socket_t client_fd, const char *raw_message);
@@ -0,0 +1,170 @@
+/**
+ * @file scanner.c
+ * @brief 协议特殊字符扫描器实现
+ *
+ * 文本协议中只有分隔符('|')、转义字符('\\')和换行符需要特殊处理，
+ * 其余字节原样通过。本文件提供一个前向扫描原语，每次跳到下一个特殊字符；
+ * 在支持的平台上一次比较 16/32 字节（SSE2、AVX2、NEON），否则逐字节回退。
+ *
+ * 解析、校验和转义都基于这个原语在一次线性扫描中完成：遇到转义字符时
+ * 直接跳过其后一个字节，因此无需再回头统计连续反斜杠的数量，
+ * 充满转义字符的内容也不会退化为平方复杂度。
+ */
+
+#include <string.h>
+#include "protocol.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCANNER_USE_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCANNER_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCANNER_USE_NEON 1
+#endif
+
+/**
+ * @brief 计算掩码最低位1的下标
+ *
+ * @param mask 非零位掩码
+ * @return unsigned 最低位1的下标
+ */
+static inline unsigned lowest_bit(unsigned mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_ctz(mask);
+#else
+	unsigned index = 0;
+	while (!(mask & 1u))
+	{
+		mask >>= 1;
+		index++;
+	}
+	return index;
+#endif
+}
+
+/**
+ * @brief 判断字节是否为协议特殊字符
+ *
+ * @param c 待判断字节
+ * @return int 是返回1，否则返回0
+ */
+static inline int is_special(char c)
+{
+	return c == FIELD_DELIMITER[0] || c == ESCAPE_CHAR || c == '\n';
+}
+
+/**
+ * @brief 查找下一个协议特殊字符
+ *
+ * 从 from 开始向后查找第一个分隔符、转义字符或换行符。
+ *
+ * @param data 待扫描数据
+ * @param from 起始偏移
+ * @param len 数据长度
+ * @return size_t 特殊字符的偏移，不存在时返回 len
+ */
+size_t protocol_find_special(const char *data, size_t from, size_t len)
+{
+	size_t i = from;
+
+	if (!data)
+		return len;
+
+#if defined(SCANNER_USE_AVX2)
+	const __m256i delim32 = _mm256_set1_epi8(FIELD_DELIMITER[0]);
+	const __m256i escape32 = _mm256_set1_epi8(ESCAPE_CHAR);
+	const __m256i newline32 = _mm256_set1_epi8('\n');
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+		__m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, delim32),
+													   _mm256_cmpeq_epi8(block, escape32)),
+									   _mm256_cmpeq_epi8(block, newline32));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(hits);
+		if (mask)
+			return i + lowest_bit(mask);
+	}
+#elif defined(SCANNER_USE_SSE2)
+	const __m128i delim16 = _mm_set1_epi8(FIELD_DELIMITER[0]);
+	const __m128i escape16 = _mm_set1_epi8(ESCAPE_CHAR);
+	const __m128i newline16 = _mm_set1_epi8('\n');
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+		__m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, delim16),
+												 _mm_cmpeq_epi8(block, escape16)),
+									_mm_cmpeq_epi8(block, newline16));
+		unsigned mask = (unsigned)_mm_movemask_epi8(hits);
+		if (mask)
+			return i + lowest_bit(mask);
+	}
+#elif defined(SCANNER_USE_NEON)
+	const uint8x16_t delim16 = vdupq_n_u8((uint8_t)FIELD_DELIMITER[0]);
+	const uint8x16_t escape16 = vdupq_n_u8((uint8_t)ESCAPE_CHAR);
+	const uint8x16_t newline16 = vdupq_n_u8((uint8_t)'\n');
+	for (; i + 16 <= len; i += 16)
+	{
+		uint8x16_t block = vld1q_u8((const uint8_t *)(data + i));
+		uint8x16_t hits = vorrq_u8(vorrq_u8(vceqq_u8(block, delim16), vceqq_u8(block, escape16)),
+								   vceqq_u8(block, newline16));
+		/* 每个字节压缩为4位，得到64位掩码 */
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+		if (mask)
+			return i + (size_t)(__builtin_ctzll(mask) >> 2);
+	}
+#endif
+
+	for (; i < len; i++)
+	{
+		if (is_special(data[i]))
+			return i;
+	}
+	return len;
+}
+
+/**
+ * @brief 单次前向扫描整条消息
+ *
+ * 记录前 FIELD_COUNT-1 个未转义分隔符的位置，统计未转义分隔符总数和
+ * 转义序列数，并检查末尾是否有孤立的转义字符。
+ *
+ * @param data 待扫描数据
+ * @param len 数据长度
+ * @param scan 输出扫描结果
+ */
+void protocol_scan(const char *data, size_t len, ProtocolScan *scan)
+{
+	size_t i = 0;
+
+	memset(scan, 0, sizeof(ProtocolScan));
+	if (!data)
+		return;
+
+	while ((i = protocol_find_special(data, i, len)) < len)
+	{
+		if (data[i] == ESCAPE_CHAR)
+		{
+			if (i + 1 >= len)
+			{
+				scan->trailing_escape = 1;
+				break;
+			}
+			/* 转义字符与其后一个字节构成整体，被转义的分隔符不参与切分 */
+			scan->escape_count++;
+			i += 2;
+			continue;
+		}
+
+		if (data[i] == FIELD_DELIMITER[0])
+		{
+			if (scan->delimiter_count < FIELD_COUNT - 1)
+				scan->delimiters[scan->delimiter_count] = i;
+			scan->delimiter_count++;
+		}
+		i++;
+	}
+}
@@ -0,0 +1,353 @@
+/**
+ * @file trace.c
+ * @brief 入站流量记录与读取
+ *
+ * 记录模式下服务端把每个连接收到的完整帧按到达顺序写入紧凑的二进制文件，
+ * 回放工具（bench/replay.c）读出后按原来的时间间隔重新发给服务端。
+ * 文件格式见 docs/trace_format.md：16 字节文件头之后是一条接一条的记录，
+ * 每条记录为类型字节、距上一条记录的微秒数、连接号（varint），帧记录再跟
+ * varint 长度和帧内容。文本帧去掉行尾换行，v2 帧去掉魔数和长度前缀，
+ * 回放时重新加上，不同时刻、不同连接的帧都能还原成原来的字节。
+ *
+ * 所有 reactor 线程共用一个文件，写入在锁内进行，记录的时间和顺序一致；
+ * 文件使用 1 MiB 的 stdio 缓冲区，大多数记录只是一次内存复制。未启用时每帧只多一次判断。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "protocol.h"
+
+/** 写文件使用的 stdio 缓冲区大小 */
+#define TRACE_FILE_BUFFER (1 << 20)
+
+/** varint 最多字节数，足以表示 64 位整数 */
+#define TRACE_VARINT_MAX 10
+
+static platform_mutex_t trace_lock = PLATFORM_MUTEX_INITIALIZER;
+static atomic_int trace_active = 0;		 /* 正在记录，未启用时读这一个标志即返回 */
+static FILE *trace_fp = NULL;			 /* 记录文件，由 trace_lock 保护 */
+static char *trace_buffer = NULL;		 /* 记录文件的 stdio 缓冲区 */
+static uint64_t trace_last_us = 0;		 /* 上一条记录的单调时钟时刻 */
+static uint32_t trace_next_conn = 1;	 /* 下一个连接号 */
+static uint64_t trace_records = 0;		 /* 已写入的记录数 */
+
+/**
+ * @brief 把 value 编码为 varint，返回写入的字节数
+ */
+static size_t encode_varint(unsigned char *out, uint64_t value)
+{
+	size_t n = 0;
+	while (value >= 0x80)
+	{
+		out[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (unsigned char)value;
+	return n;
+}
+
+/**
+ * @brief 从文件读取一个 varint
+ *
+ * @return int 成功返回1，文件在第一个字节前结束返回0，格式错误或中途结束返回-1
+ */
+static int read_varint(FILE *fp, uint64_t *value)
+{
+	uint64_t result = 0;
+
+	for (int i = 0; i < TRACE_VARINT_MAX; i++)
+	{
+		int c = fgetc(fp);
+		if (c == EOF)
+			return i == 0 ? 0 : -1;
+		result |= (uint64_t)(c & 0x7F) << (7 * i);
+		if (!(c & 0x80))
+		{
+			*value = result;
+			return 1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief 在锁内写一条记录：类型、距上一条的微秒数、连接号和可选的帧内容
+ */
+static void write_record_locked(int type, uint32_t conn, const char *data, size_t len)
+{
+	unsigned char head[1 + 3 * TRACE_VARINT_MAX];
+	uint64_t now = platform_monotonic_us();
+	uint64_t delta = now > trace_last_us ? now - trace_last_us : 0;
+	size_t n = 0;
+
+	if (now > trace_last_us)
+		trace_last_us = now;
+
+	head[n++] = (unsigned char)type;
+	n += encode_varint(head + n, delta);
+	n += encode_varint(head + n, conn);
+	if (data)
+		n += encode_varint(head + n, len);
+
+	if (fwrite(head, 1, n, trace_fp) != n || (data && len > 0 && fwrite(data, 1, len, trace_fp) != len))
+	{
+		LOG_ERROR("Traffic trace write failed, capture stopped");
+		atomic_store(&trace_active, 0);
+		return;
+	}
+	trace_records++;
+}
+
+/**
+ * @brief 开始记录入站帧
+ *
+ * 在事件循环启动前调用。文件已存在时被覆盖。
+ *
+ * @param path 记录文件路径
+ * @return int 成功返回0，失败返回-1
+ */
+int trace_capture_start(const char *path)
+{
+	unsigned char header[TRACE_HEADER_LEN];
+	uint64_t start = (uint64_t)time(NULL) * 1000000;
+
+	if (!path || path[0] == '\0')
+		return -1;
+
+	platform_mutex_lock(&trace_lock);
+	if (trace_fp)
+	{
+		platform_mutex_unlock(&trace_lock);
+		return -1;
+	}
+	trace_fp = fopen(path, "wb");
+	if (!trace_fp)
+	{
+		platform_mutex_unlock(&trace_lock);
+		return -1;
+	}
+	trace_buffer = (char *)malloc(TRACE_FILE_BUFFER);
+	if (trace_buffer)
+		setvbuf(trace_fp, trace_buffer, _IOFBF, TRACE_FILE_BUFFER);
+
+	memcpy(header, TRACE_MAGIC, 8);
+	for (int i = 0; i < 8; i++)
+		header[8 + i] = (unsigned char)(start >> (8 * i));
+	if (fwrite(header, 1, sizeof(header), trace_fp) != sizeof(header))
+	{
+		fclose(trace_fp);
+		trace_fp = NULL;
+		free(trace_buffer);
+		trace_buffer = NULL;
+		platform_mutex_unlock(&trace_lock);
+		return -1;
+	}
+
+	trace_last_us = platform_monotonic_us();
+	trace_next_conn = 1;
+	trace_records = 0;
+	atomic_store(&trace_active, 1);
+	platform_mutex_unlock(&trace_lock);
+	return 0;
+}
+
+/**
+ * @brief 停止记录，写出缓冲区并关闭文件；未启动时不做任何事
+ */
+void trace_capture_stop(void)
+{
+	platform_mutex_lock(&trace_lock);
+	atomic_store(&trace_active, 0);
+	if (trace_fp)
+	{
+		fclose(trace_fp);
+		trace_fp = NULL;
+		LOG_INFO("Traffic trace closed after %llu records", (unsigned long long)trace_records);
+	}
+	free(trace_buffer);
+	trace_buffer = NULL;
+	platform_mutex_unlock(&trace_lock);
+}
+
+/**
+ * @brief 是否正在记录
+ */
+int trace_capture_enabled(void)
+{
+	return atomic_load_explicit(&trace_active, memory_order_relaxed);
+}
+
+/**
+ * @brief 记录连接收到的一帧
+ *
+ * 连接的第一帧之前先分配连接号并写一条打开记录。
+ *
+ * @param conn 连接的连接号，0 表示尚未分配，分配后写回
+ * @param binary 1-v2 帧正文，0-去掉换行的文本帧
+ * @param frame 帧内容
+ * @param len 帧长度
+ */
+void trace_capture_frame(uint32_t *conn, int binary, const char *frame, size_t len)
+{
+	if (!trace_capture_enabled() || !conn || !frame)
+		return;
+
+	platform_mutex_lock(&trace_lock);
+	if (trace_fp && atomic_load(&trace_active))
+	{
+		if (*conn == 0)
+		{
+			*conn = trace_next_conn++;
+			write_record_locked(TRACE_OPEN, *conn, NULL, 0);
+		}
+		write_record_locked(binary ? TRACE_V2 : TRACE_TEXT, *conn, frame, len);
+	}
+	platform_mutex_unlock(&trace_lock);
+}
+
+/**
+ * @brief 记录连接关闭
+ *
+ * @param conn 连接号，0 表示该连接没有被记录过
+ */
+void trace_capture_close(uint32_t conn)
+{
+	if (!trace_capture_enabled() || conn == 0)
+		return;
+
+	platform_mutex_lock(&trace_lock);
+	if (trace_fp && atomic_load(&trace_active))
+		write_record_locked(TRACE_CLOSE, conn, NULL, 0);
+	platform_mutex_unlock(&trace_lock);
+}
+
+/**
+ * @brief 打开记录文件并校验文件头
+ *
+ * @param reader 读取器
+ * @param path 记录文件路径
+ * @return int 成功返回0，文件无法打开或不是记录文件返回-1
+ */
+int trace_reader_open(TraceReader *reader, const char *path)
+{
+	unsigned char header[TRACE_HEADER_LEN];
+
+	if (!reader || !path)
+		return -1;
+	memset(reader, 0, sizeof(*reader));
+
+	reader->fp = fopen(path, "rb");
+	if (!reader->fp)
+		return -1;
+	if (fread(header, 1, sizeof(header), reader->fp) != sizeof(header) || memcmp(header, TRACE_MAGIC, 8) != 0)
+	{
+		fclose(reader->fp);
+		reader->fp = NULL;
+		return -1;
+	}
+	for (int i = 0; i < 8; i++)
+		reader->start_us |= (uint64_t)header[8 + i] << (8 * i);
+	return 0;
+}
+
+/**
+ * @brief 读取下一条记录
+ *
+ * 帧记录的内容指向读取器内部的缓冲区，下一次调用后失效。
+ *
+ * @param reader 读取器
+ * @param record 输出的记录，time_us 为距捕获开始的微秒数
+ * @return int 读到返回1，文件结束返回0，记录损坏或被截断返回-1
+ */
+int trace_reader_next(TraceReader *reader, TraceRecord *record)
+{
+	uint64_t delta = 0;
+	uint64_t conn = 0;
+	uint64_t len = 0;
+
+	if (!reader || !reader->fp || !record)
+		return -1;
+
+	int type = fgetc(reader->fp);
+	if (type == EOF)
+		return 0;
+	if (type < TRACE_OPEN || type > TRACE_CLOSE || read_varint(reader->fp, &delta) != 1 ||
+		read_varint(reader->fp, &conn) != 1 || conn == 0 || conn > UINT32_MAX)
+		return -1;
+
+	memset(record, 0, sizeof(*record));
+	if (type == TRACE_TEXT || type == TRACE_V2)
+	{
+		if (read_varint(reader->fp, &len) != 1 || len == 0 || len > TRACE_MAX_FRAME)
+			return -1;
+		if (len > reader->cap)
+		{
+			char *grown = (char *)realloc(reader->data, (size_t)len);
+			if (!grown)
+				return -1;
+			reader->data = grown;
+			reader->cap = (size_t)len;
+		}
+		if (fread(reader->data, 1, (size_t)len, reader->fp) != len)
+			return -1;
+		record->data = reader->data;
+		record->len = (size_t)len;
+	}
+
+	reader->time_us += delta;
+	record->type = type;
+	record->conn = (uint32_t)conn;
+	record->time_us = reader->time_us;
+	return 1;
+}
+
+/**
+ * @brief 关闭记录文件并释放缓冲区
+ */
+void trace_reader_close(TraceReader *reader)
+{
+	if (!reader)
+		return;
+	if (reader->fp)
+		fclose(reader->fp);
+	free(reader->data);
+	memset(reader, 0, sizeof(*reader));
+}
+
+/**
+ * @brief 把帧记录还原成线上的字节：文本帧补上换行，v2 帧补上魔数和长度前缀
+ *
+ * @param record 帧记录
+ * @param out 输出缓冲区，至少 TRACE_MAX_FRAME + TRACE_WIRE_OVERHEAD 字节即可容纳任意帧
+ * @param cap 缓冲区大小
+ * @return size_t 线上字节数，不是帧记录或缓冲区不足返回0
+ */
+size_t trace_record_wire(const TraceRecord *record, char *out, size_t cap)
+{
+	if (!record || !out || !record->data)
+		return 0;
+
+	if (record->type == TRACE_TEXT)
+	{
+		if (record->len + 1 > cap)
+			return 0;
+		memcpy(out, record->data, record->len);
+		out[record->len] = '\n';
+		return record->len + 1;
+	}
+	if (record->type == TRACE_V2)
+	{
+		unsigned char header[1 + TRACE_VARINT_MAX];
+		size_t n = 0;
+		header[n++] = PROTOCOL_V2_MAGIC;
+		n += encode_varint(header + n, record->len);
+		if (n + record->len > cap)
+			return 0;
+		memcpy(out, header, n);
+		memcpy(out + n, record->data, record->len);
+		return n + record->len;
+	}
+	return 0;
+}
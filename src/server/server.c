@@ -1,7 +1,10 @@
 // server.c
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include "../network/network.h"
+#include "../core/core.h"
 #include "../utils/utils.h"
 #include "../storage/storage.h"
 
@@ -10,10 +13,228 @@ ServerConfig server_config = {
 	.server_port = DEFAULT_PORT,
 	.max_clients = MAX_CLIENTS,
 	.max_history = 1000,
+	.history_dir = HISTORY_DEFAULT_DIR,
+	.user_db_path = USER_DB_DEFAULT_PATH,
+	.history_cache_bytes = HISTORY_CACHE_BYTES,
+	.history_search = 1,
 	.timeout_seconds = 300,
 	.log_path = "server.log",
+	.log_flush_ms = 100,
 	.require_auth = 1,
-	.enable_encryption = 0};
+	.enable_encryption = 0,
+	.reactor_count = 1,
+	.worker_count = 0,
+	.auth_workers = AUTH_DEFAULT_WORKERS,
+	.metrics_port = 0,
+	.synthetic_users = 0,
+	.presence_window_ms = PRESENCE_DEFAULT_WINDOW_MS,
+	.cluster_nodes = NULL,
+	.cluster_node = 0,
+	.handoff_path = NULL,
+	.resume_grace_seconds = SESSION_RESUME_DEFAULT_GRACE,
+	.io_uring = 0,
+	.socket_options = {.listen_backlog = 0, .tcp_nodelay = 1}};
+
+/* 有继任者等待时写完历史，再交出监听套接字和连接；之后停止等待继任者。
+   在事件循环、集群和指标端点都停止之后调用，继任者可以立即绑定这些端口 */
+static void hand_off_to_successor(void)
+{
+	if (handoff_requested())
+	{
+		history_manager_shutdown();
+		handoff_send();
+	}
+	handoff_stop();
+}
+
+/* 解析限流参数 "消息/秒,广播/秒,字节/秒[,用户倍数]"，省略的项为0（不限），用户倍数默认为 RATE_LIMIT_DEFAULT_USER_FACTOR */
+static void parse_rate_limits(const char *spec, RateLimitConfig *config)
+{
+	long values[RATE_LIMIT_KINDS + 1] = {0};
+	int n = 0;
+	const char *p = spec;
+
+	values[RATE_LIMIT_KINDS] = RATE_LIMIT_DEFAULT_USER_FACTOR;
+	while (n <= RATE_LIMIT_KINDS && *p)
+	{
+		char *end;
+		long v = strtol(p, &end, 10);
+		if (end != p)
+			values[n] = v < 0 ? 0 : v;
+		n++;
+		p = *end == ',' ? end + 1 : end + strlen(end);
+	}
+	for (int i = 0; i < RATE_LIMIT_KINDS; i++)
+		config->rate[i] = (uint32_t)values[i];
+	config->user_factor = (uint32_t)values[RATE_LIMIT_KINDS];
+}
+
+/* 解析套接字选项 "监听队列长度,TCP_NODELAY,发送缓冲区,接收缓冲区,延迟接受秒数"，省略或为空的项保持默认值 */
+static void parse_socket_options(const char *spec, SocketOptions *options)
+{
+	int *fields[] = {&options->listen_backlog, &options->tcp_nodelay, &options->send_buffer,
+					 &options->recv_buffer, &options->defer_accept_seconds};
+	int n = 0;
+	const char *p = spec;
+
+	while (n < (int)(sizeof(fields) / sizeof(fields[0])) && *p)
+	{
+		char *end;
+		long v = strtol(p, &end, 10);
+		if (end != p)
+			*fields[n] = v < 0 ? 0 : (int)v;
+		n++;
+		p = *end == ',' ? end + 1 : end + strlen(end);
+	}
+}
+
+/* 命令行选项：端口可以作为第一个参数直接给出，其余设置都以 --名称=值 给出 */
+static void print_usage(FILE *out, const char *program)
+{
+	fprintf(out, "Usage: %s [port] [--option=value ...]\n\n", program);
+	fprintf(out, "  --port=N                 listening port (default %d)\n", DEFAULT_PORT);
+	fprintf(out, "  --reactors=N             event loop threads (default 1, max %d)\n", MAX_REACTORS);
+	fprintf(out, "  --workers=N              command worker threads (default 0: run commands on the event loop)\n");
+	fprintf(out, "  --auth-workers=N         login threads (default %d: handle logins like other commands)\n",
+			AUTH_DEFAULT_WORKERS);
+	fprintf(out, "  --idle-timeout=S         close connections idle for S seconds (default 300, 0: never)\n");
+	fprintf(out, "  --metrics-port=N         serve Prometheus metrics on this port (default 0: off)\n");
+	fprintf(out, "  --synthetic-users=N      add users %s0..%sN-1 for load tests (default 0)\n", SYNTHETIC_USER_PREFIX,
+			SYNTHETIC_USER_PREFIX);
+	fprintf(out, "  --presence-window=MS     coalesce presence changes for MS milliseconds (default %d, 0: off)\n",
+			PRESENCE_DEFAULT_WINDOW_MS);
+	fprintf(out, "  --cluster=IP:PORT,...    cluster node list, the same on every node\n");
+	fprintf(out, "  --cluster-node=N         index of this node in --cluster (default 0)\n");
+	fprintf(out, "  --handoff=PATH           Unix socket for handing connections to a restarted server\n");
+	fprintf(out, "  --rate-limit=M,B,BYTES[,F]  per-connection msg/s, broadcast/s, bytes/s and per-user factor\n");
+	fprintf(out, "  --io=ENGINE              uring for the io_uring engine, poll for epoll/kqueue/select\n");
+	fprintf(out, "  --sockets=Q,NODELAY,SND,RCV,DEFER  listen backlog, TCP_NODELAY, buffer sizes, defer accept seconds\n");
+	fprintf(out, "  --history-search=0|1     build the full-text history index (default 1)\n");
+	fprintf(out, "  --trace=PATH             record received frames for bin/replay\n");
+	fprintf(out, "  --local=PATH             also accept clients on this Unix socket\n");
+	fprintf(out, "  --resume-grace=S         keep sessions resumable for S seconds after a disconnect (default %d, 0: off)\n",
+			SESSION_RESUME_DEFAULT_GRACE);
+	fprintf(out, "  --help                   show this help\n");
+}
+
+/* 解析整数选项值并截断到 [min, max]，不是整数时返回-1 */
+static int parse_int_value(const char *value, int min, int max, int *out)
+{
+	char *end;
+	long v = strtol(value, &end, 10);
+	if (end == value || *end != '\0')
+		return -1;
+	if (v < min)
+		v = min;
+	if (v > max)
+		v = max;
+	*out = (int)v;
+	return 0;
+}
+
+/* 应用一个 --名称=值 选项，名称未知或值无效时返回-1 */
+static int apply_option(const char *name, const char *value)
+{
+	ServerConfig *c = &server_config;
+
+	if (strcmp(name, "port") == 0)
+		return parse_int_value(value, 1, 65535, &c->server_port);
+	if (strcmp(name, "reactors") == 0)
+		return parse_int_value(value, 1, MAX_REACTORS, &c->reactor_count);
+	if (strcmp(name, "workers") == 0)
+		return parse_int_value(value, 0, MAX_WORKERS, &c->worker_count);
+	if (strcmp(name, "auth-workers") == 0)
+		return parse_int_value(value, 0, MAX_WORKERS, &c->auth_workers);
+	if (strcmp(name, "idle-timeout") == 0)
+		return parse_int_value(value, 0, INT_MAX, &c->timeout_seconds);
+	if (strcmp(name, "metrics-port") == 0)
+		return parse_int_value(value, 0, 65535, &c->metrics_port);
+	if (strcmp(name, "synthetic-users") == 0)
+		return parse_int_value(value, 0, INT_MAX, &c->synthetic_users);
+	if (strcmp(name, "presence-window") == 0)
+		return parse_int_value(value, 0, INT_MAX, &c->presence_window_ms);
+	if (strcmp(name, "cluster-node") == 0)
+		return parse_int_value(value, 0, INT_MAX, &c->cluster_node);
+	if (strcmp(name, "history-search") == 0)
+		return parse_int_value(value, 0, 1, &c->history_search);
+	if (strcmp(name, "resume-grace") == 0)
+		return parse_int_value(value, 0, INT_MAX, &c->resume_grace_seconds);
+
+	/* 以下选项的值为字符串，空值表示不启用 */
+	if (strcmp(name, "cluster") == 0)
+		c->cluster_nodes = value[0] ? value : NULL;
+	else if (strcmp(name, "handoff") == 0)
+		c->handoff_path = value[0] ? value : NULL;
+	else if (strcmp(name, "trace") == 0)
+		c->trace_path = value[0] ? value : NULL;
+	else if (strcmp(name, "local") == 0)
+		c->local_path = value[0] ? value : NULL;
+	else if (strcmp(name, "rate-limit") == 0)
+		parse_rate_limits(value, &c->rate_limit);
+	else if (strcmp(name, "sockets") == 0)
+		parse_socket_options(value, &c->socket_options);
+	else if (strcmp(name, "io") == 0)
+	{
+		if (strcmp(value, "uring") == 0 || strcmp(value, "io_uring") == 0)
+			c->io_uring = 1;
+		else if (strcmp(value, "poll") == 0)
+			c->io_uring = 0;
+		else
+			return -1;
+	}
+	else
+		return -1;
+	return 0;
+}
+
+/**
+ * @brief 解析命令行参数到 server_config
+ *
+ * 第一个参数不以 -- 开头时作为端口，其余参数都必须是 --名称=值。
+ * 字符串选项直接引用 argv 中的值，在进程生命周期内有效。
+ *
+ * @return int 成功返回0，打印了帮助返回1，参数错误时打印原因和用法并返回-1
+ */
+static int parse_arguments(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			print_usage(stdout, argv[0]);
+			return 1;
+		}
+
+		if (strncmp(arg, "--", 2) != 0)
+		{
+			if (i == 1 && parse_int_value(arg, 1, 65535, &server_config.server_port) == 0)
+				continue;
+			fprintf(stderr, "Unexpected argument '%s': settings after the port are given as --name=value\n\n", arg);
+			print_usage(stderr, argv[0]);
+			return -1;
+		}
+
+		char name[32];
+		const char *eq = strchr(arg + 2, '=');
+		size_t name_len = eq ? (size_t)(eq - arg - 2) : 0;
+		if (!eq || name_len == 0 || name_len >= sizeof(name))
+		{
+			fprintf(stderr, "Option '%s' needs a value: --name=value\n\n", arg);
+			print_usage(stderr, argv[0]);
+			return -1;
+		}
+		memcpy(name, arg + 2, name_len);
+		name[name_len] = '\0';
+		if (apply_option(name, eq + 1) != 0)
+		{
+			fprintf(stderr, "Unknown option or invalid value: %s\n\n", arg);
+			print_usage(stderr, argv[0]);
+			return -1;
+		}
+	}
+	return 0;
+}
 
 /* 打印服务器信息 */
 static void print_server_info(void)
@@ -21,18 +242,58 @@ static void print_server_info(void)
 	printf("=== Message Forward Server ===\n");
 	printf("Port: %d\n", server_config.server_port);
 	printf("Max clients: %d\n", server_config.max_clients);
+	printf("Reactors: %d\n", server_config.reactor_count);
+	printf("Workers: %d\n", server_config.worker_count);
+	printf("Auth workers: %d\n", server_config.auth_workers);
+	printf("Idle timeout: %d s\n", server_config.timeout_seconds);
+	if (server_config.metrics_port > 0)
+		printf("Metrics: http://0.0.0.0:%d/metrics\n", server_config.metrics_port);
+	if (server_config.synthetic_users > 0)
+		printf("Synthetic users: %d (%s0..)\n", server_config.synthetic_users, SYNTHETIC_USER_PREFIX);
+	if (server_config.presence_window_ms > 0)
+		printf("Presence window: %d ms\n", server_config.presence_window_ms);
+	if (server_config.cluster_nodes)
+		printf("Cluster: node %d of %s\n", server_config.cluster_node, server_config.cluster_nodes);
+	if (server_config.handoff_path)
+		printf("Handoff socket: %s\n", server_config.handoff_path);
+	if (rate_limit_enabled())
+		printf("Rate limits: %u msg/s, %u broadcast/s, %u bytes/s per connection, x%u per user\n",
+			   server_config.rate_limit.rate[RATE_MESSAGES], server_config.rate_limit.rate[RATE_BROADCASTS],
+			   server_config.rate_limit.rate[RATE_BYTES], server_config.rate_limit.user_factor);
+	if (server_config.io_uring)
+		printf("I/O engine: io_uring (falls back to %s if unsupported)\n", poller_backend_name());
+	const SocketOptions *sockets = &server_config.socket_options;
+	printf("Sockets: backlog %d, TCP_NODELAY %s", sockets->listen_backlog > 0 ? sockets->listen_backlog : SOMAXCONN,
+		   sockets->tcp_nodelay ? "on" : "off");
+	if (sockets->send_buffer > 0 || sockets->recv_buffer > 0)
+		printf(", buffers %d/%d bytes", sockets->send_buffer, sockets->recv_buffer);
+	if (sockets->defer_accept_seconds > 0)
+		printf(", defer accept %d s", sockets->defer_accept_seconds);
+	printf("\n");
+	if (server_config.trace_path)
+		printf("Traffic trace: %s\n", server_config.trace_path);
+	if (server_config.local_path)
+		printf("Local socket: %s\n", server_config.local_path);
+	if (server_config.resume_grace_seconds > 0)
+		printf("Session resume: %d s grace after disconnect\n", server_config.resume_grace_seconds);
 	printf("Log file: %s\n", server_config.log_path);
+	printf("User database: %s\n", server_config.user_db_path);
+	printf("History dir: %s (keep %d messages, cache %zu KB, search %s)\n", server_config.history_dir,
+		   server_config.max_history, server_config.history_cache_bytes / 1024,
+		   server_config.history_search ? "on" : "off");
 	printf("Press Ctrl+C to stop the server\n\n");
 }
 
 /* 主函数 */
 int main(int argc, char *argv[])
 {
-	// 解析命令行参数
-	if (argc > 1)
-	{
-		server_config.server_port = atoi(argv[1]);
-	}
+	// 解析命令行参数：可选的端口之后全部为 --名称=值
+	int parsed = parse_arguments(argc, argv);
+	if (parsed != 0)
+		return parsed > 0 ? 0 : 2;
+
+	// 限流额度在 reactor 线程启动前设定，之后只读
+	rate_limit_configure(&server_config.rate_limit);
 
 	// 打印服务器信息
 	print_server_info();
@@ -41,24 +302,154 @@ int main(int argc, char *argv[])
 	set_log_file(server_config.log_path);
 	set_log_level(LOG_INFO);
 
-	/* 初始化存储（包括默认测试用户或从持久化加载用户） */
+	// 异步日志：工作线程和 reactor 只写环形缓冲区，由后台线程批量写文件；退出时写完剩余日志
+	if (server_config.log_flush_ms > 0 && log_start_async(LOG_ASYNC_DEFAULT_CAPACITY, server_config.log_flush_ms) == 0)
+	{
+		atexit(log_stop_async);
+	}
+
+	/* 先向正在运行的上一个进程请求交接：它停下事件循环、写完历史后交出监听套接字和连接，
+	   之后才打开用户库和历史目录 */
+	int inherited = handoff_receive(server_config.handoff_path);
+	if (inherited < 0)
+	{
+		LOG_WARN("Handoff from previous server failed, starting fresh");
+	}
+
+	/* 映射用户库文件，已保存的用户不逐条载入；库文件无效时用户只保存在内存中 */
+	user_store_open(server_config.user_db_path);
+
+	/* 初始化存储（空库时添加默认测试用户） */
 	storage_init();
 
+	// 压力测试时预先添加合成用户，负载生成器以 bench0、bench1…… 登录
+	if (server_config.synthetic_users > 0)
+	{
+		user_store_init_synthetic(SYNTHETIC_USER_PREFIX, server_config.synthetic_users);
+	}
+
+	// 按最大连接数预先分配 Client 对象，接入连接时不再向系统申请内存
+	if (connection_manager_reserve(server_config.max_clients) != 0)
+	{
+		LOG_WARN("Failed to reserve %d client objects", server_config.max_clients);
+	}
+
+	// 历史消息由后台线程组提交到段文件，退出时写完队列中剩余的记录；最近的消息同时留在内存缓存中
+	history_manager_set_cache(server_config.history_cache_bytes, HISTORY_CACHE_RING);
+	history_manager_set_search(server_config.history_search);
+	if (history_manager_init(server_config.history_dir, HISTORY_SEGMENT_BYTES, server_config.max_history) == 0)
+	{
+		atexit(history_manager_shutdown);
+	}
+	else
+	{
+		LOG_WARN("History store unavailable, messages will not be recorded");
+	}
+
 	LOG_INFO("Server starting...");
 
-	// 初始化TCP服务器
-	if (tcp_server_init(server_config.server_port) < 0)
+	// 命令耗时和流量计数按线程记录，STATUS 和抓取端点读取合计
+	server_stats_init();
+
+	// 初始化TCP服务器（多 reactor 时每个 reactor 一个 SO_REUSEPORT 监听套接字）；
+	// 交接时直接使用上一个进程的监听套接字，期间到达的连接留在监听队列中
+	tcp_server_set_options(&server_config.socket_options);
+	int listener_count = 0;
+	const socket_t *listeners = handoff_listeners(&listener_count);
+	if (inherited > 0 ? tcp_server_adopt_listeners(listeners, listener_count, server_config.reactor_count) < 0
+					  : tcp_server_init_listeners(server_config.server_port, server_config.reactor_count) < 0)
 	{
 		LOG_ERROR("Failed to initialize TCP server");
 		return 1;
 	}
 
-	// 初始化事件循环
-	event_loop_init();
+	// 同机的机器人和桥接程序经 Unix 套接字接入，不走 TCP 回环；各 reactor 与 TCP 监听套接字一起等待
+	if (server_config.local_path && tcp_server_init_local(server_config.local_path) != 0)
+	{
+		LOG_WARN("Local socket unavailable on %s, local clients must use TCP", server_config.local_path);
+	}
 
 	// 初始化客户端处理器
 	client_handler_init();
 
+	// 记录模式下把各连接收到的帧写入流量记录文件，供 bin/replay 回放；退出时写出缓冲区
+	if (server_config.trace_path)
+	{
+		if (trace_capture_start(server_config.trace_path) == 0)
+			atexit(trace_capture_stop);
+		else
+			LOG_WARN("Traffic trace unavailable: %s", server_config.trace_path);
+	}
+
+	// 超过 timeout_seconds 没有收到数据的连接由各事件循环的时间轮关闭
+	event_loop_set_idle_timeout(server_config.timeout_seconds);
+
+	// 各事件循环初始化时尝试创建 io_uring 引擎，内核不支持时仍用就绪通知后端
+	event_loop_use_io_uring(server_config.io_uring);
+
+	// 上线/下线按窗口合并后广播，各事件循环的时间轮检查窗口是否结束
+	presence_set_window(server_config.presence_window_ms);
+
+	// 登录时签发恢复令牌，断线的用户保留期内凭令牌重连；各事件循环的时间轮检查保留期是否结束
+	session_resume_set_grace(server_config.resume_grace_seconds);
+
+	// 指标抓取端点在单独的线程上运行，启动失败不影响聊天服务
+	if (server_config.metrics_port > 0 && metrics_endpoint_start(server_config.metrics_port) != 0)
+	{
+		LOG_WARN("Metrics endpoint unavailable on port %d", server_config.metrics_port);
+	}
+
+	// 集群链路在单独的线程上收发，转来的帧经分片邮箱交给用户所在的 reactor
+	if (server_config.cluster_nodes && cluster_start(server_config.cluster_nodes, server_config.cluster_node) != 0)
+	{
+		LOG_ERROR("Invalid cluster configuration or link port unavailable: %s", server_config.cluster_nodes);
+		return 1;
+	}
+
+	// 在单独的线程上等待继任者，继任者连上来时停止事件循环并交出连接
+	if (server_config.handoff_path && handoff_listen(server_config.handoff_path) != 0)
+	{
+		LOG_WARN("Handoff unavailable on %s, restarts will drop connections", server_config.handoff_path);
+	}
+
+	// 工作线程和认证线程的完成通知、集群转来的帧都经分片邮箱送达，
+	// 启用任一线程池或集群时即使只有一个 reactor 也走分片模式
+	if (server_config.reactor_count > 1 || server_config.worker_count > 0 || server_config.auth_workers > 0 ||
+		cluster_enabled())
+	{
+		// 启动服务器，每个 reactor 线程自行初始化事件循环
+		if (tcp_server_start() < 0)
+		{
+			LOG_ERROR("Failed to start TCP server");
+			return 1;
+		}
+
+		worker_pool_start(server_config.worker_count);
+		auth_pool_start(server_config.auth_workers);
+		if (event_loop_run_reactors(server_config.reactor_count, server_config.max_clients) < 0)
+		{
+			LOG_ERROR("Failed to start reactors");
+		}
+		worker_pool_stop();
+		auth_pool_stop();
+		cluster_stop();
+
+		LOG_INFO("Server shutting down...");
+		metrics_endpoint_stop();
+		hand_off_to_successor();
+		tcp_server_stop();
+		LOG_INFO("Server stopped");
+		return 0;
+	}
+
+	// 初始化事件循环
+	if (event_loop_init(server_config.max_clients) < 0)
+	{
+		LOG_ERROR("Failed to initialize event loop");
+		tcp_server_stop();
+		return 1;
+	}
+
 	// 启动服务器
 	if (tcp_server_start() < 0)
 	{
@@ -66,6 +457,9 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	// 接管上一个进程交接过来的连接
+	event_loop_adopt(0, 1);
+
 	// 运行事件循环
 	socket_t server_fd = tcp_server_get_fd();
 	if (SOCKET_IS_VALID(server_fd))
@@ -75,7 +469,9 @@ int main(int argc, char *argv[])
 
 	// 清理资源
 	LOG_INFO("Server shutting down...");
+	metrics_endpoint_stop();
 	event_loop_stop();
+	hand_off_to_successor();
 	tcp_server_stop();
 
 	LOG_INFO("Server stopped");
@@ -0,0 +1,1996 @@
+/**
+ * @file history_manager.c
+ * @brief 分段追加式历史消息日志
+ *
+ * 路由成功的私聊、广播和群组消息被编码成紧凑的二进制记录，投递到无锁队列后
+ * 立即返回，路由路径上没有任何文件写入。后台写线程一次取走队列中的全部记录，
+ * 顺序写入当前段文件，每批只做一次 fsync（组提交）：写盘期间新到的消息自然
+ * 累积成下一批，负载越高每次 fsync 摊到的消息越多。
+ *
+ * 段文件写满固定容量后滚动到下一个编号；总记录数扣除最旧一段后仍不少于
+ * max_history 时删除最旧的段，因此磁盘上总是至少保留最近 max_history 条消息。
+ * 最旧段的编号记录在 HEAD 文件中，启动时从该编号起依次扫描已有的段，
+ * 校验失败的尾部（崩溃时没有写完的批次）被忽略，之后的记录写入新段。
+ *
+ * 查询不扫描日志，而是走两级内存索引：
+ *   - 每个段一份稀疏时间索引，每 HISTORY_TIME_INDEX_STRIDE 条记录一项（时间 -> 段内偏移）；
+ *   - 每个会话（私聊双方、广播、群组）一份按日志顺序排列的记录位置列表。
+ * 写线程保证日志中的时间单调不减，因此记录位置（段编号, 偏移）的顺序就是时间顺序：
+ * 时间范围先经时间索引换算成位置范围，再在会话列表里二分，"与 alice 的最近 50 条"
+ * 只读取这 50 条记录。记录内容通过只读 mmap 访问，只有被读取的页才会调入内存。
+ * 索引只在 fsync 之后更新，查询看到的都是已提交的记录。
+ *
+ * 索引前面还有一层内存缓存：每个会话一个定长环形缓冲区，保存最近路由的
+ * HISTORY_CACHE_RING 条记录（与段文件相同的编码），入队时同步写入。所有会话按
+ * 最近使用排成 LRU 链表，总字节数超过上限时整个淘汰最久未用的会话。
+ * 缓存能确定给出完整结果时（取够了 limit 条、起始时间落在缓存范围内，或会话的
+ * 全部消息都在缓存中）查询直接从缓存返回，不访问索引和段文件，
+ * 也能看到尚未落盘的消息；否则退回到索引查询。
+ *
+ * 每条记录的 message_id 是持久的递增序号：入队时在 cache_lock 内分配，同一把锁下
+ * 入队和写入缓存，因此日志和缓存中的顺序与序号一致；启动时从已有段里最大的序号继续。
+ * 增量同步按"序号大于游标"分页读取：稀疏索引项同时记录序号，游标先换算成位置下界，
+ * 再在会话列表里二分，只读取游标之后的记录。增量同步只返回已 fsync 的记录，
+ * 崩溃后重新分配的序号不会被客户端当作已读跳过。
+ *
+ * 全文检索的倒排索引（history_search.c）同样由写线程维护：记录加入会话索引后
+ * 再按会话分词加入倒排表，路由路径不做分词；检索先在倒排表中求交得到位置，
+ * 再像普通查询一样从段映射中解码。
+ *
+ * 记录格式（小端）：
+ *   u32 length | u32 checksum | u32 message_id | i64 time | u8 kind |
+ *   u8 sender_len | u8 receiver_len | u8 reserved | u16 content_len | 数据
+ * checksum 为 length 之后全部字节的 FNV-1a。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "storage.h"
+#include "../utils/utils.h"
+
+/** 记录头长度 */
+#define RECORD_HEADER 26
+/** 单条记录的最大长度 */
+#define RECORD_MAX (RECORD_HEADER + 2 * MAX_USERNAME_LEN + MAX_CONTENT_LEN)
+/** 段文件的 stdio 写缓冲大小 */
+#define SEGMENT_WRITE_BUFFER (64 * 1024)
+/** 会话键的最大长度：两个用户名加分隔符 */
+#define CONVERSATION_KEY_LEN (2 * MAX_USERNAME_LEN + 2)
+
+/**
+ * @brief 记录对应的消息种类
+ */
+enum
+{
+	RECORD_PRIVATE = 1,
+	RECORD_BROADCAST = 2,
+	RECORD_GROUP = 3
+};
+
+/**
+ * @brief 等待写盘的一条记录
+ */
+typedef struct
+{
+	MpscNode node;		  /**< 写队列节点 */
+	time_t when;		  /**< 写入时间，写线程保证单调不减 */
+	uint32_t offset;	  /**< 写入后在段内的偏移 */
+	size_t len;			  /**< 编码后的长度 */
+	unsigned char data[]; /**< 编码后的记录 */
+} PendingRecord;
+
+/**
+ * @brief 稀疏时间索引项
+ */
+typedef struct
+{
+	time_t time;	 /**< 该记录的时间 */
+	uint32_t offset; /**< 该记录在段内的偏移 */
+	uint32_t id;	 /**< 该记录的序号 */
+} TimeIndexEntry;
+
+/**
+ * @brief 段文件的只读映射，查询期间持有引用，最后一个引用释放时解除映射
+ */
+typedef struct
+{
+	atomic_int refs;	 /**< 引用计数，段本身持有一个 */
+	platform_mmap_t map; /**< 映射区域 */
+} MappedView;
+
+/**
+ * @brief 一个段文件中已落盘的内容
+ */
+typedef struct
+{
+	unsigned int id;		/**< 段编号，决定文件名 */
+	size_t bytes;			/**< 已提交的字节数，查询只读到这里 */
+	int records;			/**< 已提交的记录数 */
+	time_t first;			/**< 最早记录的时间 */
+	time_t last;			/**< 最新记录的时间 */
+	uint32_t last_id;		/**< 段内最大的序号 */
+	TimeIndexEntry *times;	/**< 稀疏时间索引 */
+	int time_count;			/**< 时间索引项数 */
+	int time_cap;			/**< 时间索引容量 */
+	MappedView *view;		/**< 当前映射，覆盖的长度不足时重新映射 */
+} HistorySegment;
+
+/**
+ * @brief 一个会话的记录位置列表
+ *
+ * 位置为 (段编号 << 32 | 段内偏移)，按日志顺序追加；最旧段被删除时从头部前移，
+ * 有效区间为 [head, count)。
+ */
+typedef struct
+{
+	char key[CONVERSATION_KEY_LEN]; /**< 会话键 */
+	uint64_t *locs;					/**< 记录位置 */
+	size_t head;					/**< 第一个仍有效的位置 */
+	size_t count;					/**< 已追加的位置数 */
+	size_t cap;						/**< 位置数组容量 */
+	uint32_t last_id;				/**< 最新一条已提交记录的序号 */
+} Conversation;
+
+/**
+ * @brief 一个会话最近消息的内存缓存
+ *
+ * records 是容量为 ring 的环形缓冲区，保存编码后的记录，时间单调不减；
+ * whole 表示该会话至今的全部消息都在缓冲区中（创建时磁盘和写队列中都没有该会话，
+ * 且缓冲区从未覆盖过旧记录）。序号大于 floor 的该会话记录都在缓冲区中，
+ * 无法确定时为 UINT32_MAX。
+ */
+typedef struct CachedConversation
+{
+	char key[CONVERSATION_KEY_LEN];	  /**< 会话键 */
+	unsigned char **records;		  /**< 环形缓冲区 */
+	int start;						  /**< 最旧记录的下标 */
+	int count;						  /**< 缓存的记录数 */
+	int whole;						  /**< 缓存包含该会话的全部消息 */
+	uint32_t floor;					  /**< 缓冲区之外该会话最新记录的序号 */
+	size_t bytes;					  /**< 占用的字节数（含自身） */
+	struct CachedConversation *prev;  /**< LRU 链表中较新的一项 */
+	struct CachedConversation *next;  /**< LRU 链表中较旧的一项 */
+} CachedConversation;
+
+static char history_dir[MAX_FILENAME_LEN];
+static size_t segment_capacity = HISTORY_SEGMENT_BYTES;
+static int retain_records = 0;
+static int search_enabled = 1;
+
+/* 段列表和会话索引由写线程修改，查询线程在锁内定位记录 */
+static platform_mutex_t segment_lock = PLATFORM_MUTEX_INITIALIZER;
+static HistorySegment *segments = NULL;
+static int segment_count = 0;
+static int segment_cap = 0;
+static int total_records = 0;
+static HashIndex conversations;
+
+/* 以下只由写线程访问 */
+static FILE *active_file = NULL;
+static size_t active_bytes = 0;
+static time_t last_time = 0;
+static PendingRecord **batch = NULL;
+static size_t batch_count = 0;
+static size_t batch_cap = 0;
+
+static MpscQueue pending_queue;
+static atomic_int pending_count = 0;
+static atomic_int writer_sleeping = 0;
+static atomic_int history_running = 0;
+static atomic_size_t history_dropped = 0;
+static atomic_uint committed_sequence = 0;
+static platform_mutex_t wake_lock;
+static platform_cond_t wake_cond;
+static platform_thread_t writer_thread;
+
+/* 最近消息缓存，由 cache_lock 保护；加锁顺序为 cache_lock 在 segment_lock 之前 */
+static platform_mutex_t cache_lock = PLATFORM_MUTEX_INITIALIZER;
+static HashIndex cache_index;
+static CachedConversation *cache_newest = NULL;
+static CachedConversation *cache_oldest = NULL;
+static size_t cache_bytes = 0;
+static size_t cache_limit = HISTORY_CACHE_BYTES;
+static uint32_t last_sequence = 0;
+static int cache_ring = HISTORY_CACHE_RING;
+static int cache_evicted = 0;
+static atomic_size_t cache_hits = 0;
+
+/* ================ 编码 ================ */
+
+static void put_u16(unsigned char *p, unsigned int v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static unsigned int get_u16(const unsigned char *p)
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+	uint32_t v = 0;
+	for (int i = 3; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+/**
+ * @brief 计算记录校验和（FNV-1a 32位）
+ */
+static uint32_t record_checksum(const unsigned char *data, size_t len)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= data[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ * @brief 按消息类型确定记录种类
+ *
+ * @return int 记录种类，不需要保存的类型返回0
+ */
+static int record_kind(const char *type)
+{
+	if (strcmp(type, MSG_TYPE_MSG) == 0)
+		return RECORD_PRIVATE;
+	if (strcmp(type, MSG_TYPE_BROADCAST) == 0)
+		return RECORD_BROADCAST;
+	if (strcmp(type, MSG_TYPE_GROUP) == 0)
+		return RECORD_GROUP;
+	return 0;
+}
+
+/**
+ * @brief 把消息编码成一条记录
+ *
+ * 序号在入队时填入，校验和由写线程在写盘前计算。
+ *
+ * @param out 输出缓冲区，至少 RECORD_MAX 字节
+ * @return size_t 记录长度，消息类型不需要保存时返回0
+ */
+static size_t encode_record(const Message *msg, time_t when, unsigned char *out)
+{
+	int kind = record_kind(msg->type);
+	size_t sender_len = strnlen(msg->sender, MAX_USERNAME_LEN - 1);
+	size_t receiver_len = strnlen(msg->receiver, MAX_USERNAME_LEN - 1);
+	size_t content_len = strnlen(msg->content, MAX_CONTENT_LEN - 1);
+	size_t len = RECORD_HEADER + sender_len + receiver_len + content_len;
+
+	if (kind == 0)
+		return 0;
+
+	put_u32(out, (uint32_t)len);
+	put_u32(out + 4, 0);
+	put_u32(out + 8, 0);
+	put_u64(out + 12, (uint64_t)(int64_t)when);
+	out[20] = (unsigned char)kind;
+	out[21] = (unsigned char)sender_len;
+	out[22] = (unsigned char)receiver_len;
+	out[23] = 0;
+	put_u16(out + 24, (unsigned int)content_len);
+
+	unsigned char *p = out + RECORD_HEADER;
+	memcpy(p, msg->sender, sender_len);
+	p += sender_len;
+	memcpy(p, msg->receiver, receiver_len);
+	p += receiver_len;
+	memcpy(p, msg->content, content_len);
+	return len;
+}
+
+/**
+ * @brief 把一条记录还原成消息
+ */
+static void decode_record(const unsigned char *rec, Message *msg, time_t *when)
+{
+	size_t sender_len = rec[21];
+	size_t receiver_len = rec[22];
+	size_t content_len = get_u16(rec + 24);
+	const unsigned char *p = rec + RECORD_HEADER;
+
+	switch (rec[20])
+	{
+	case RECORD_BROADCAST:
+		safe_strcpy(msg->type, MSG_TYPE_BROADCAST, sizeof(msg->type));
+		break;
+	case RECORD_GROUP:
+		safe_strcpy(msg->type, MSG_TYPE_GROUP, sizeof(msg->type));
+		break;
+	default:
+		safe_strcpy(msg->type, MSG_TYPE_MSG, sizeof(msg->type));
+		break;
+	}
+	memcpy(msg->sender, p, sender_len);
+	msg->sender[sender_len] = '\0';
+	p += sender_len;
+	memcpy(msg->receiver, p, receiver_len);
+	msg->receiver[receiver_len] = '\0';
+	p += receiver_len;
+	memcpy(msg->content, p, content_len);
+	msg->content[content_len] = '\0';
+	msg->message_id = (int)get_u32(rec + 8);
+	msg->is_delivered = 1;
+
+	*when = (time_t)(int64_t)get_u64(rec + 12);
+	format_timestamp(*when, msg->timestamp, sizeof(msg->timestamp));
+}
+
+/**
+ * @brief 从段文件读取下一条记录并校验
+ *
+ * @param fp 段文件
+ * @param buf 输出缓冲区，至少 RECORD_MAX 字节
+ * @return long 记录长度，文件结束返回0，记录不完整或校验失败返回-1
+ */
+static long read_record(FILE *fp, unsigned char *buf)
+{
+	size_t got = fread(buf, 1, RECORD_HEADER, fp);
+	if (got == 0)
+		return 0;
+	if (got < RECORD_HEADER)
+		return -1;
+
+	size_t len = get_u32(buf);
+	size_t body = (size_t)buf[21] + buf[22] + get_u16(buf + 24);
+	if (len > RECORD_MAX || len != RECORD_HEADER + body || buf[20] < RECORD_PRIVATE || buf[20] > RECORD_GROUP)
+		return -1;
+	if (fread(buf + RECORD_HEADER, 1, body, fp) != body)
+		return -1;
+	if (record_checksum(buf + 8, len - 8) != get_u32(buf + 4))
+		return -1;
+	return (long)len;
+}
+
+/* ================ 索引 ================ */
+
+/**
+ * @brief 生成会话键
+ *
+ * 私聊为按字典序排列的双方用户名，两个方向的消息落在同一会话；
+ * 广播为 "*"，群组为 "#" 加群组名。
+ *
+ * @return size_t 键长度
+ */
+static size_t conversation_key(int kind, const char *sender, size_t sender_len,
+							   const char *receiver, size_t receiver_len, char *out)
+{
+	if (kind == RECORD_BROADCAST)
+	{
+		out[0] = '*';
+		out[1] = '\0';
+		return 1;
+	}
+	if (kind == RECORD_GROUP)
+	{
+		out[0] = '#';
+		memcpy(out + 1, receiver, receiver_len);
+		out[1 + receiver_len] = '\0';
+		return 1 + receiver_len;
+	}
+
+	size_t n = sender_len < receiver_len ? sender_len : receiver_len;
+	int cmp = memcmp(sender, receiver, n);
+	if (cmp > 0 || (cmp == 0 && sender_len > receiver_len))
+	{
+		const char *name = sender;
+		size_t len = sender_len;
+		sender = receiver;
+		sender_len = receiver_len;
+		receiver = name;
+		receiver_len = len;
+	}
+	memcpy(out, sender, sender_len);
+	out[sender_len] = '\t';
+	memcpy(out + sender_len + 1, receiver, receiver_len);
+	out[sender_len + 1 + receiver_len] = '\0';
+	return sender_len + 1 + receiver_len;
+}
+
+static int conversation_matches(const void *value, const void *key)
+{
+	return strcmp(((const Conversation *)value)->key, (const char *)key) == 0;
+}
+
+static Conversation *find_conversation(const char *key)
+{
+	return (Conversation *)hash_index_find(&conversations, hash_index_hash_string(key, CONVERSATION_KEY_LEN),
+										   key, conversation_matches);
+}
+
+/**
+ * @brief 把一条已提交的记录加入段描述、时间索引和会话索引（在锁内调用）
+ */
+static void index_record(HistorySegment *seg, const unsigned char *rec, size_t len, uint32_t offset)
+{
+	time_t when = (time_t)(int64_t)get_u64(rec + 12);
+	uint32_t id = get_u32(rec + 8);
+	char key[CONVERSATION_KEY_LEN];
+
+	if (seg->records == 0)
+		seg->first = when;
+	seg->last = when;
+	if (id > seg->last_id)
+		seg->last_id = id;
+
+	if (seg->records % HISTORY_TIME_INDEX_STRIDE == 0)
+	{
+		if (seg->time_count == seg->time_cap)
+		{
+			int cap = seg->time_cap ? seg->time_cap * 2 : 16;
+			TimeIndexEntry *grown = (TimeIndexEntry *)realloc(seg->times, (size_t)cap * sizeof(TimeIndexEntry));
+			if (grown)
+			{
+				seg->times = grown;
+				seg->time_cap = cap;
+			}
+		}
+		if (seg->time_count < seg->time_cap)
+		{
+			seg->times[seg->time_count].time = when;
+			seg->times[seg->time_count].offset = offset;
+			seg->times[seg->time_count].id = id;
+			seg->time_count++;
+		}
+	}
+	seg->records++;
+	seg->bytes = (size_t)offset + len;
+	total_records++;
+
+	const char *sender = (const char *)rec + RECORD_HEADER;
+	conversation_key(rec[20], sender, rec[21], sender + rec[21], rec[22], key);
+	Conversation *conv = find_conversation(key);
+	if (!conv)
+	{
+		conv = (Conversation *)calloc(1, sizeof(Conversation));
+		if (!conv)
+			return;
+		safe_strcpy(conv->key, key, sizeof(conv->key));
+		if (hash_index_insert(&conversations, hash_index_hash_string(key, CONVERSATION_KEY_LEN), conv) != 0)
+		{
+			free(conv);
+			return;
+		}
+	}
+	if (conv->count == conv->cap)
+	{
+		/* 头部已失效的位置过半时先整理，否则扩容 */
+		if (conv->head > conv->count / 2)
+		{
+			memmove(conv->locs, conv->locs + conv->head, (conv->count - conv->head) * sizeof(uint64_t));
+			conv->count -= conv->head;
+			conv->head = 0;
+		}
+		else
+		{
+			size_t cap = conv->cap ? conv->cap * 2 : 8;
+			uint64_t *grown = (uint64_t *)realloc(conv->locs, cap * sizeof(uint64_t));
+			if (!grown)
+				return;
+			conv->locs = grown;
+			conv->cap = cap;
+		}
+	}
+	conv->locs[conv->count++] = ((uint64_t)seg->id << 32) | offset;
+	conv->last_id = id;
+}
+
+/**
+ * @brief 把一条已提交的记录加入全文检索索引
+ */
+static void search_record(const HistorySegment *seg, const unsigned char *rec, uint32_t offset)
+{
+	char key[CONVERSATION_KEY_LEN];
+	const char *sender = (const char *)rec + RECORD_HEADER;
+
+	if (!search_enabled)
+		return;
+	conversation_key(rec[20], sender, rec[21], sender + rec[21], rec[22], key);
+	history_search_add(key, sender + rec[21] + rec[22], get_u16(rec + 24), ((uint64_t)seg->id << 32) | offset);
+}
+
+/**
+ * @brief 从会话索引中去掉编号小于 head_id 的段上的位置，删除已空的会话（在锁内调用）
+ */
+static void trim_conversations(unsigned int head_id)
+{
+	uint64_t limit = (uint64_t)head_id << 32;
+	size_t empty_count = 0;
+	Conversation **empty = (Conversation **)malloc((conversations.count ? conversations.count : 1) * sizeof(Conversation *));
+
+	for (size_t i = 0; i < conversations.cap; i++)
+	{
+		Conversation *conv = (Conversation *)conversations.slots[i].value;
+		if (!conv)
+			continue;
+		while (conv->head < conv->count && conv->locs[conv->head] < limit)
+			conv->head++;
+		if (conv->head == conv->count && empty)
+			empty[empty_count++] = conv;
+	}
+
+	for (size_t i = 0; i < empty_count; i++)
+	{
+		hash_index_remove(&conversations, hash_index_hash_string(empty[i]->key, CONVERSATION_KEY_LEN),
+						  empty[i], NULL);
+		free(empty[i]->locs);
+		free(empty[i]);
+	}
+	free(empty);
+}
+
+/**
+ * @brief 释放一次映射引用
+ */
+static void release_view(MappedView *view)
+{
+	if (view && atomic_fetch_sub(&view->refs, 1) == 1)
+	{
+		platform_munmap_file(&view->map);
+		free(view);
+	}
+}
+
+/**
+ * @brief 释放段描述持有的索引和映射（在锁内调用）
+ */
+static void free_segment(HistorySegment *seg)
+{
+	free(seg->times);
+	seg->times = NULL;
+	release_view(seg->view);
+	seg->view = NULL;
+}
+
+/* ================ 段文件 ================ */
+
+static void segment_path(unsigned int id, char *path, size_t size)
+{
+	snprintf(path, size, "%s/%08u.seg", history_dir, id);
+}
+
+/**
+ * @brief 读取 HEAD 文件中的最旧段编号
+ */
+static unsigned int read_head(void)
+{
+	char path[MAX_FILENAME_LEN + 16];
+	unsigned int id = 0;
+
+	snprintf(path, sizeof(path), "%s/HEAD", history_dir);
+	FILE *fp = fopen(path, "r");
+	if (fp)
+	{
+		if (fscanf(fp, "%u", &id) != 1)
+			id = 0;
+		fclose(fp);
+	}
+	return id;
+}
+
+/**
+ * @brief 原子地更新 HEAD 文件，必须在删除旧段之前完成
+ */
+static int write_head(unsigned int id)
+{
+	char path[MAX_FILENAME_LEN + 16];
+	char tmp[MAX_FILENAME_LEN + 16];
+
+	snprintf(path, sizeof(path), "%s/HEAD", history_dir);
+	snprintf(tmp, sizeof(tmp), "%s/HEAD.tmp", history_dir);
+	FILE *fp = fopen(tmp, "w");
+	if (!fp)
+		return -1;
+	fprintf(fp, "%u\n", id);
+	if (platform_file_sync(fp) != 0)
+	{
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return platform_file_replace(tmp, path);
+}
+
+/**
+ * @brief 在锁内追加一个段描述
+ */
+static HistorySegment *push_segment(unsigned int id)
+{
+	if (segment_count == segment_cap)
+	{
+		int cap = segment_cap ? segment_cap * 2 : 16;
+		HistorySegment *grown = (HistorySegment *)realloc(segments, (size_t)cap * sizeof(HistorySegment));
+		if (!grown)
+			return NULL;
+		segments = grown;
+		segment_cap = cap;
+	}
+
+	HistorySegment *seg = &segments[segment_count++];
+	memset(seg, 0, sizeof(HistorySegment));
+	seg->id = id;
+	return seg;
+}
+
+/**
+ * @brief 扫描一个已有的段，重建段描述和索引
+ *
+ * @return int 整个文件有效返回0，尾部有损坏返回1，文件不存在返回-1
+ */
+static int scan_segment(HistorySegment *seg)
+{
+	char path[MAX_FILENAME_LEN + 16];
+	unsigned char buf[RECORD_MAX];
+	size_t offset = 0;
+	long len;
+
+	segment_path(seg->id, path, sizeof(path));
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return -1;
+
+	while ((len = read_record(fp, buf)) > 0)
+	{
+		index_record(seg, buf, (size_t)len, (uint32_t)offset);
+		search_record(seg, buf, (uint32_t)offset);
+		offset += (size_t)len;
+	}
+	fclose(fp);
+	return len < 0 ? 1 : 0;
+}
+
+/**
+ * @brief 打开当前段用于追加
+ */
+static int open_active(unsigned int id, size_t bytes)
+{
+	char path[MAX_FILENAME_LEN + 16];
+
+	segment_path(id, path, sizeof(path));
+	active_file = fopen(path, "ab");
+	if (!active_file)
+	{
+		LOG_ERROR("Failed to open history segment %s", path);
+		return -1;
+	}
+	setvbuf(active_file, NULL, _IOFBF, SEGMENT_WRITE_BUFFER);
+	active_bytes = bytes;
+	return 0;
+}
+
+/**
+ * @brief 删除超出保留条数的最旧段
+ *
+ * 只要去掉最旧一段后仍保留至少 retain_records 条就删除它，当前段永远不删除。
+ * 正在被查询读取的段映射由引用计数保持，读取结束后才解除。
+ */
+static void enforce_retention(void)
+{
+	while (retain_records > 0)
+	{
+		platform_mutex_lock(&segment_lock);
+		if (segment_count < 2 || total_records - segments[0].records < retain_records)
+		{
+			platform_mutex_unlock(&segment_lock);
+			return;
+		}
+		HistorySegment oldest = segments[0];
+		memmove(segments, segments + 1, (size_t)(segment_count - 1) * sizeof(HistorySegment));
+		segment_count--;
+		total_records -= oldest.records;
+		unsigned int head = segments[0].id;
+		trim_conversations(head);
+		free_segment(&oldest);
+		platform_mutex_unlock(&segment_lock);
+
+		char path[MAX_FILENAME_LEN + 16];
+		segment_path(oldest.id, path, sizeof(path));
+		if (write_head(head) != 0)
+			LOG_WARN("Failed to update history HEAD to %u", head);
+		remove(path);
+		if (search_enabled)
+			history_search_trim((uint64_t)head << 32);
+		LOG_DEBUG("Rotated out history segment %u (%d records)", oldest.id, oldest.records);
+	}
+}
+
+/**
+ * @brief 把当前批次落盘，再把其中的记录加入索引
+ */
+static void commit_batch(void)
+{
+	if (batch_count == 0)
+		return;
+
+	if (platform_file_sync(active_file) != 0)
+		LOG_ERROR("Failed to sync history segment");
+
+	platform_mutex_lock(&segment_lock);
+	HistorySegment *seg = &segments[segment_count - 1];
+	for (size_t i = 0; i < batch_count; i++)
+		index_record(seg, batch[i]->data, batch[i]->len, batch[i]->offset);
+	platform_mutex_unlock(&segment_lock);
+
+	/* 分词在段锁之外进行，不拖慢同时进行的查询；段描述只由写线程修改，可以直接读编号。
+	 * 序号在入索引之后才公布，已同步到的消息一定能被检索到 */
+	for (size_t i = 0; i < batch_count; i++)
+		search_record(seg, batch[i]->data, batch[i]->offset);
+	atomic_store(&committed_sequence, get_u32(batch[batch_count - 1]->data + 8));
+
+	for (size_t i = 0; i < batch_count; i++)
+		free(batch[i]);
+	batch_count = 0;
+}
+
+/**
+ * @brief 关闭写满的当前段并开始下一个段
+ */
+static int roll_segment(void)
+{
+	fclose(active_file);
+	active_file = NULL;
+
+	platform_mutex_lock(&segment_lock);
+	unsigned int id = segments[segment_count - 1].id + 1;
+	HistorySegment *seg = push_segment(id);
+	platform_mutex_unlock(&segment_lock);
+	if (!seg)
+		return -1;
+
+	enforce_retention();
+	return open_active(id, 0);
+}
+
+/* ================ 写线程 ================ */
+
+/**
+ * @brief 取走队列中的全部记录，写入段文件并组提交
+ *
+ * 写满的段在滚动前先单独提交，每个段每批最多一次 fsync。
+ * 不同线程取时间和入队的先后可能交错，早于上一条的时间被抬到上一条的时间，
+ * 保证日志内时间单调不减；校验和在时间确定后计算。
+ *
+ * @return int 本轮取出的记录数
+ */
+static int commit_pending(void)
+{
+	int taken = 0;
+	MpscNode *node;
+
+	while ((node = mpsc_queue_pop(&pending_queue)) != NULL)
+	{
+		PendingRecord *rec = (PendingRecord *)node;
+		atomic_fetch_sub(&pending_count, 1);
+		taken++;
+
+		if (active_file && active_bytes > 0 && active_bytes + rec->len > segment_capacity)
+		{
+			commit_batch();
+			if (roll_segment() != 0)
+				LOG_ERROR("Failed to roll history segment");
+		}
+
+		if (rec->when < last_time)
+		{
+			rec->when = last_time;
+			put_u64(rec->data + 12, (uint64_t)(int64_t)rec->when);
+		}
+		put_u32(rec->data + 4, record_checksum(rec->data + 8, rec->len - 8));
+
+		if (batch_count == batch_cap)
+		{
+			size_t cap = batch_cap ? batch_cap * 2 : 256;
+			PendingRecord **grown = (PendingRecord **)realloc(batch, cap * sizeof(PendingRecord *));
+			if (grown)
+			{
+				batch = grown;
+				batch_cap = cap;
+			}
+		}
+
+		if (active_file && batch_count < batch_cap && fwrite(rec->data, 1, rec->len, active_file) == rec->len)
+		{
+			rec->offset = (uint32_t)active_bytes;
+			active_bytes += rec->len;
+			last_time = rec->when;
+			batch[batch_count++] = rec;
+		}
+		else
+		{
+			atomic_fetch_add(&history_dropped, 1);
+			free(rec);
+		}
+	}
+
+	commit_batch();
+	return taken;
+}
+
+/**
+ * @brief 后台写线程主循环
+ *
+ * 队列为空时按与工作线程池相同的方式睡在条件变量上：先声明睡眠再检查计数，
+ * 生产者先入队再检查睡眠标记，唤醒不会丢失。停止时写完剩余记录再退出。
+ */
+static platform_thread_return_t PLATFORM_THREAD_CALL writer_main(void *arg)
+{
+	(void)arg;
+
+	for (;;)
+	{
+		if (commit_pending() > 0)
+			continue;
+		if (!atomic_load(&history_running))
+		{
+			commit_pending();
+			break;
+		}
+
+		platform_mutex_lock(&wake_lock);
+		atomic_store(&writer_sleeping, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		if (atomic_load(&pending_count) == 0 && atomic_load(&history_running))
+			platform_cond_wait(&wake_cond, &wake_lock);
+		atomic_store(&writer_sleeping, 0);
+		platform_mutex_unlock(&wake_lock);
+	}
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/* ================ 最近消息缓存 ================ */
+
+static int cached_matches(const void *value, const void *key)
+{
+	return strcmp(((const CachedConversation *)value)->key, (const char *)key) == 0;
+}
+
+static CachedConversation *find_cached(const char *key)
+{
+	return (CachedConversation *)hash_index_find(&cache_index, hash_index_hash_string(key, CONVERSATION_KEY_LEN),
+												 key, cached_matches);
+}
+
+/**
+ * @brief 从 LRU 链表中摘下一个会话（在 cache_lock 内调用）
+ */
+static void cache_unlink(CachedConversation *conv)
+{
+	if (conv->prev)
+		conv->prev->next = conv->next;
+	else
+		cache_newest = conv->next;
+	if (conv->next)
+		conv->next->prev = conv->prev;
+	else
+		cache_oldest = conv->prev;
+	conv->prev = NULL;
+	conv->next = NULL;
+}
+
+/**
+ * @brief 把会话移到 LRU 链表头部（在 cache_lock 内调用）
+ */
+static void cache_touch(CachedConversation *conv)
+{
+	if (cache_newest == conv)
+		return;
+	if (conv->prev || conv->next || cache_oldest == conv)
+		cache_unlink(conv);
+	conv->next = cache_newest;
+	if (cache_newest)
+		cache_newest->prev = conv;
+	cache_newest = conv;
+	if (!cache_oldest)
+		cache_oldest = conv;
+}
+
+/**
+ * @brief 释放一个会话的缓存（在 cache_lock 内调用，调用方负责从索引和链表中移除）
+ */
+static void free_cached(CachedConversation *conv)
+{
+	for (int i = 0; i < conv->count; i++)
+		free(conv->records[(conv->start + i) % cache_ring]);
+	cache_bytes -= conv->bytes;
+	free(conv->records);
+	free(conv);
+}
+
+/**
+ * @brief 整个淘汰一个会话（在 cache_lock 内调用）
+ *
+ * 之后再为任何会话新建缓存时都无法确认它包含全部消息，因此记下发生过淘汰。
+ */
+static void cache_evict(CachedConversation *conv)
+{
+	cache_unlink(conv);
+	hash_index_remove(&cache_index, hash_index_hash_string(conv->key, CONVERSATION_KEY_LEN), conv, NULL);
+	free_cached(conv);
+	cache_evicted = 1;
+}
+
+/**
+ * @brief 把一条已入队的记录加入所属会话的缓存
+ *
+ * 缓冲区满时覆盖最旧的记录；记录时间被抬到不早于该会话上一条，
+ * 保证缓冲区内时间单调。之后按 LRU 淘汰会话直到总字节数回到上限以内（在 cache_lock 内调用）。
+ */
+static void cache_put(const unsigned char *rec, size_t len)
+{
+	char key[CONVERSATION_KEY_LEN];
+	const char *sender = (const char *)rec + RECORD_HEADER;
+
+	if (cache_limit == 0)
+		return;
+	conversation_key(rec[20], sender, rec[21], sender + rec[21], rec[22], key);
+
+	CachedConversation *conv = find_cached(key);
+	if (!conv)
+	{
+		conv = (CachedConversation *)calloc(1, sizeof(CachedConversation));
+		unsigned char **records = (unsigned char **)malloc((size_t)cache_ring * sizeof(unsigned char *));
+		if (!conv || !records ||
+			hash_index_insert(&cache_index, hash_index_hash_string(key, CONVERSATION_KEY_LEN), conv) != 0)
+		{
+			free(conv);
+			free(records);
+			cache_evicted = 1;
+			return;
+		}
+		safe_strcpy(conv->key, key, sizeof(conv->key));
+		conv->records = records;
+		conv->bytes = sizeof(CachedConversation) + (size_t)cache_ring * sizeof(unsigned char *);
+		cache_bytes += conv->bytes;
+		/* 没有淘汰过会话、或之前的记录都已提交时，该会话更早的记录都在索引里 */
+		platform_mutex_lock(&segment_lock);
+		Conversation *stored = find_conversation(key);
+		conv->whole = !cache_evicted && stored == NULL;
+		if (!cache_evicted || atomic_load(&committed_sequence) == last_sequence - 1)
+			conv->floor = stored ? stored->last_id : 0;
+		else
+			conv->floor = UINT32_MAX;
+		platform_mutex_unlock(&segment_lock);
+	}
+
+	unsigned char *copy = (unsigned char *)malloc(len);
+	if (copy)
+	{
+		memcpy(copy, rec, len);
+		if (conv->count > 0)
+		{
+			const unsigned char *newest = conv->records[(conv->start + conv->count - 1) % cache_ring];
+			if ((int64_t)get_u64(copy + 12) < (int64_t)get_u64(newest + 12))
+				put_u64(copy + 12, get_u64(newest + 12));
+		}
+		if (conv->count == cache_ring)
+		{
+			unsigned char *oldest = conv->records[conv->start];
+			conv->floor = get_u32(oldest + 8);
+			conv->bytes -= get_u32(oldest);
+			cache_bytes -= get_u32(oldest);
+			free(oldest);
+			conv->start = (conv->start + 1) % cache_ring;
+			conv->count--;
+			conv->whole = 0;
+		}
+		conv->records[(conv->start + conv->count) % cache_ring] = copy;
+		conv->count++;
+		conv->bytes += len;
+		cache_bytes += len;
+	}
+	else
+	{
+		/* 缓冲区不能有空洞：丢掉已有的记录，从这一条之后重新开始 */
+		for (; conv->count > 0; conv->count--, conv->start = (conv->start + 1) % cache_ring)
+		{
+			unsigned char *oldest = conv->records[conv->start];
+			conv->bytes -= get_u32(oldest);
+			cache_bytes -= get_u32(oldest);
+			free(oldest);
+		}
+		conv->start = 0;
+		conv->whole = 0;
+		conv->floor = get_u32(rec + 8);
+	}
+
+	cache_touch(conv);
+	while (cache_bytes > cache_limit && cache_oldest && cache_oldest != conv)
+		cache_evict(cache_oldest);
+}
+
+/**
+ * @brief 尝试从缓存回答查询
+ *
+ * 从最新的记录往前收集落在 [start, end] 内的记录。收集够 limit 条、
+ * 已经越过 start（更旧的记录都早于 start）或缓存包含会话的全部消息时结果是完整的。
+ * 命中的记录按原样（已是紧凑编码）复制到一块连续内存，解锁后再逐条解码。
+ *
+ * @param out 输出，命中时为按时间顺序首尾相接的记录，用 free() 释放
+ * @return int 完整命中时返回结果条数，否则返回-1
+ */
+static int cache_query(const char *key, time_t start, time_t end, int limit, unsigned char **out)
+{
+	int found = 0;
+	int complete = 0;
+	unsigned char *buf = NULL;
+
+	*out = NULL;
+	platform_mutex_lock(&cache_lock);
+	CachedConversation *conv = find_cached(key);
+	if (conv)
+	{
+		int i = conv->count - 1;
+		int first = conv->count;
+		size_t total = 0;
+		for (; i >= 0 && found < limit; i--)
+		{
+			const unsigned char *rec = conv->records[(conv->start + i) % cache_ring];
+			time_t when = (time_t)(int64_t)get_u64(rec + 12);
+			if (start > 0 && when < start)
+				break;
+			if (end > 0 && when > end)
+				continue;
+			total += get_u32(rec);
+			first = i;
+			found++;
+		}
+		complete = found == limit || i >= 0 || conv->whole;
+		if (complete && found > 0)
+		{
+			buf = (unsigned char *)malloc(total);
+			unsigned char *p = buf;
+			for (int j = first; buf && j < conv->count; j++)
+			{
+				const unsigned char *rec = conv->records[(conv->start + j) % cache_ring];
+				time_t when = (time_t)(int64_t)get_u64(rec + 12);
+				if (end > 0 && when > end)
+					continue;
+				memcpy(p, rec, get_u32(rec));
+				p += get_u32(rec);
+			}
+			complete = buf != NULL;
+		}
+		if (complete)
+			cache_touch(conv);
+	}
+	platform_mutex_unlock(&cache_lock);
+
+	if (!complete)
+		return -1;
+	*out = buf;
+	atomic_fetch_add(&cache_hits, 1);
+	return found;
+}
+
+/**
+ * @brief 尝试从缓存回答增量同步
+ *
+ * 缓冲区内序号递增，floor 不大于 after 时序号大于 after 的记录都在缓冲区中，
+ * 二分找到第一条后顺序收集，只收集不超过 committed 的已落盘记录。
+ *
+ * @param committed 已落盘的最大序号
+ * @param out 输出，命中时为按序号顺序首尾相接的记录，用 free() 释放
+ * @param more 输出，命中时表示 limit 条之后是否还有已落盘的记录
+ * @return int 完整命中时返回结果条数，否则返回-1
+ */
+static int cache_query_after(const char *key, uint32_t after, uint32_t committed, int limit,
+							 unsigned char **out, int *more)
+{
+	int found = 0;
+	int complete = 0;
+	unsigned char *buf = NULL;
+
+	*out = NULL;
+	platform_mutex_lock(&cache_lock);
+	CachedConversation *conv = find_cached(key);
+	if (conv && conv->floor <= after)
+	{
+		int lo = 0, hi = conv->count;
+		while (lo < hi)
+		{
+			int mid = (lo + hi) / 2;
+			if (get_u32(conv->records[(conv->start + mid) % cache_ring] + 8) <= after)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		int end = lo;
+		size_t total = 0;
+		for (; end < conv->count && found < limit; end++)
+		{
+			const unsigned char *rec = conv->records[(conv->start + end) % cache_ring];
+			if (get_u32(rec + 8) > committed)
+				break;
+			total += get_u32(rec);
+			found++;
+		}
+		*more = end < conv->count && get_u32(conv->records[(conv->start + end) % cache_ring] + 8) <= committed;
+		complete = 1;
+		if (found > 0)
+		{
+			buf = (unsigned char *)malloc(total);
+			unsigned char *p = buf;
+			for (int j = lo; buf && j < lo + found; j++)
+			{
+				const unsigned char *rec = conv->records[(conv->start + j) % cache_ring];
+				memcpy(p, rec, get_u32(rec));
+				p += get_u32(rec);
+			}
+			complete = buf != NULL;
+		}
+		if (complete)
+			cache_touch(conv);
+	}
+	platform_mutex_unlock(&cache_lock);
+
+	if (!complete)
+		return -1;
+	*out = buf;
+	atomic_fetch_add(&cache_hits, 1);
+	return found;
+}
+
+/**
+ * @brief 释放全部缓存
+ */
+static void cache_clear(void)
+{
+	platform_mutex_lock(&cache_lock);
+	while (cache_oldest)
+		cache_evict(cache_oldest);
+	hash_index_free(&cache_index);
+	cache_bytes = 0;
+	cache_evicted = 0;
+	platform_mutex_unlock(&cache_lock);
+}
+
+/* ================ 公共接口 ================ */
+
+/**
+ * @brief 初始化历史存储
+ *
+ * 从 HEAD 记录的编号开始扫描已有的段并重建索引，序号从其中最大的继续，继续追加到
+ * 最后一个完好且未写满的段，否则新建下一个段，然后启动后台写线程。
+ *
+ * @param dir 段文件目录，不存在时创建
+ * @param segment_bytes 单个段的容量，0 表示使用 HISTORY_SEGMENT_BYTES
+ * @param max_records 至少保留的最近消息数，<=0 表示不删除旧段
+ * @return int 成功返回0，已启动或失败返回-1
+ */
+int history_manager_init(const char *dir, size_t segment_bytes, int max_records)
+{
+	if (atomic_load(&history_running) || !dir || !*dir)
+		return -1;
+
+	safe_strcpy(history_dir, dir, sizeof(history_dir));
+	segment_capacity = segment_bytes > RECORD_MAX ? segment_bytes : HISTORY_SEGMENT_BYTES;
+	retain_records = max_records;
+	if (platform_mkdir(history_dir) != 0)
+	{
+		LOG_ERROR("Failed to create history directory %s", history_dir);
+		return -1;
+	}
+
+	segment_count = 0;
+	total_records = 0;
+	hash_index_init(&conversations, 0);
+	platform_mutex_lock(&cache_lock);
+	hash_index_init(&cache_index, 0);
+	platform_mutex_unlock(&cache_lock);
+
+	int torn = 0;
+	for (unsigned int id = read_head();; id++)
+	{
+		HistorySegment *seg = push_segment(id);
+		if (!seg)
+			return -1;
+		int scanned = scan_segment(seg);
+		if (scanned < 0)
+		{
+			segment_count--;
+			break;
+		}
+		torn = scanned;
+	}
+
+	/* 最后一段完好且未写满时继续追加，否则从下一个编号开始 */
+	if (segment_count == 0 || torn || segments[segment_count - 1].bytes + RECORD_MAX > segment_capacity)
+	{
+		unsigned int id = segment_count ? segments[segment_count - 1].id + 1 : read_head();
+		if (torn)
+			LOG_WARN("History segment %u has a torn tail, continuing in segment %u", id - 1, id);
+		if (!push_segment(id))
+			return -1;
+	}
+	if (segment_count == 1 && write_head(segments[0].id) != 0)
+		LOG_WARN("Failed to write history HEAD");
+	enforce_retention();
+	last_time = segments[segment_count - 1].records ? segments[segment_count - 1].last
+						  : (segment_count > 1 ? segments[segment_count - 2].last : 0);
+	uint32_t recovered = 0;
+	for (int i = 0; i < segment_count; i++)
+		if (segments[i].last_id > recovered)
+			recovered = segments[i].last_id;
+	platform_mutex_lock(&cache_lock);
+	last_sequence = recovered;
+	platform_mutex_unlock(&cache_lock);
+	atomic_store(&committed_sequence, recovered);
+	if (open_active(segments[segment_count - 1].id, segments[segment_count - 1].bytes) != 0)
+		return -1;
+
+	mpsc_queue_init(&pending_queue);
+	atomic_store(&pending_count, 0);
+	atomic_store(&writer_sleeping, 0);
+	atomic_store(&history_dropped, 0);
+	platform_mutex_init(&wake_lock);
+	platform_cond_init(&wake_cond);
+	atomic_store(&history_running, 1);
+	if (platform_thread_create(&writer_thread, writer_main, NULL) != 0)
+	{
+		LOG_ERROR("Failed to start history writer");
+		atomic_store(&history_running, 0);
+		fclose(active_file);
+		active_file = NULL;
+		return -1;
+	}
+
+	LOG_INFO("History store opened: %s, %d segments, %d records, %zu conversations",
+			 history_dir, segment_count, total_records, conversations.count);
+	return 0;
+}
+
+/**
+ * @brief 停止后台写线程，写完队列中剩余的记录后关闭段文件并释放索引和缓存
+ *
+ * 必须在所有路由线程和查询停止之后调用。
+ */
+void history_manager_shutdown(void)
+{
+	if (!atomic_load(&history_running))
+		return;
+
+	atomic_store(&history_running, 0);
+	platform_mutex_lock(&wake_lock);
+	platform_cond_signal(&wake_cond);
+	platform_mutex_unlock(&wake_lock);
+	platform_thread_join(writer_thread);
+
+	if (active_file)
+	{
+		fclose(active_file);
+		active_file = NULL;
+	}
+	platform_cond_destroy(&wake_cond);
+	platform_mutex_destroy(&wake_lock);
+	safe_free((void **)&batch);
+	batch_cap = 0;
+
+	LOG_INFO("History store closed: %d records", total_records);
+	platform_mutex_lock(&segment_lock);
+	for (int i = 0; i < segment_count; i++)
+		free_segment(&segments[i]);
+	for (size_t i = 0; i < conversations.cap; i++)
+	{
+		Conversation *conv = (Conversation *)conversations.slots[i].value;
+		if (conv)
+		{
+			free(conv->locs);
+			free(conv);
+		}
+	}
+	hash_index_free(&conversations);
+	safe_free((void **)&segments);
+	segment_count = 0;
+	segment_cap = 0;
+	total_records = 0;
+	platform_mutex_unlock(&segment_lock);
+	cache_clear();
+	history_search_clear();
+}
+
+/**
+ * @brief 判断历史存储是否在运行
+ *
+ * @return int 运行中返回1，否则返回0
+ */
+int history_manager_is_running(void)
+{
+	return atomic_load(&history_running);
+}
+
+/**
+ * @brief 追加一条消息到历史日志
+ *
+ * 锁外完成编码，在 cache_lock 内分配序号、入队并写入最近消息缓存，写线程睡眠时
+ * 才加锁唤醒；文件写入和 fsync 全部在后台写线程上批量完成，调用方不会被磁盘阻塞。
+ *
+ * @param msg 已路由的消息，私聊、广播和群组以外的类型被忽略；成功时 message_id 改为分配的序号
+ * @return int 成功入队返回0，未启动、类型不需要保存、队列已满或内存不足返回-1
+ */
+int history_manager_append(Message *msg)
+{
+	unsigned char buf[RECORD_MAX];
+
+	if (!msg || !atomic_load(&history_running))
+		return -1;
+
+	time_t when = time(NULL);
+	size_t len = encode_record(msg, when, buf);
+	if (len == 0)
+		return -1;
+
+	if (atomic_fetch_add(&pending_count, 1) >= HISTORY_MAX_PENDING)
+	{
+		atomic_fetch_sub(&pending_count, 1);
+		atomic_fetch_add(&history_dropped, 1);
+		return -1;
+	}
+
+	PendingRecord *rec = (PendingRecord *)malloc(sizeof(PendingRecord) + len);
+	if (!rec)
+	{
+		atomic_fetch_sub(&pending_count, 1);
+		atomic_fetch_add(&history_dropped, 1);
+		return -1;
+	}
+	rec->when = when;
+	rec->offset = 0;
+	rec->len = len;
+	memcpy(rec->data, buf, len);
+
+	/* 序号、入队和缓存在同一把锁内完成，日志和缓存中的顺序与序号一致；
+	 * 入队后写线程随时可能改写并释放 rec，缓存从栈上的 buf 复制 */
+	platform_mutex_lock(&cache_lock);
+	uint32_t id = ++last_sequence;
+	put_u32(buf + 8, id);
+	put_u32(rec->data + 8, id);
+	mpsc_queue_push(&pending_queue, &rec->node);
+	cache_put(buf, len);
+	platform_mutex_unlock(&cache_lock);
+	msg->message_id = (int)id;
+
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load(&writer_sleeping))
+	{
+		platform_mutex_lock(&wake_lock);
+		platform_cond_signal(&wake_cond);
+		platform_mutex_unlock(&wake_lock);
+	}
+	return 0;
+}
+
+/* ================ 查询 ================ */
+
+/**
+ * @brief 按编号找到段描述（在锁内调用，段编号连续）
+ */
+static HistorySegment *segment_by_id(unsigned int id)
+{
+	if (segment_count == 0 || id < segments[0].id || id - segments[0].id >= (unsigned int)segment_count)
+		return NULL;
+	return &segments[id - segments[0].id];
+}
+
+/**
+ * @brief 把起始时间换算成位置下界（在锁内调用）
+ *
+ * 取第一个最新时间不早于 start 的段，再取该段最后一个早于 start 的时间索引项，
+ * 得到的下界可能包含少量早于 start 的记录，由读取时精确过滤。
+ */
+static uint64_t lower_location(time_t start)
+{
+	if (start <= 0)
+		return 0;
+
+	int lo = 0, hi = segment_count;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (segments[mid].records > 0 && segments[mid].last < start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == segment_count)
+		return UINT64_MAX;
+
+	HistorySegment *seg = &segments[lo];
+	uint32_t offset = 0;
+	int a = 0, b = seg->time_count;
+	while (a < b)
+	{
+		int mid = (a + b) / 2;
+		if (seg->times[mid].time < start)
+			a = mid + 1;
+		else
+			b = mid;
+	}
+	if (a > 0)
+		offset = seg->times[a - 1].offset;
+	return ((uint64_t)seg->id << 32) | offset;
+}
+
+/**
+ * @brief 把结束时间换算成位置上界（不含，在锁内调用）
+ *
+ * 取最后一个最早时间不晚于 end 的段，再取该段第一个晚于 end 的时间索引项；
+ * 上界之前最多还有 HISTORY_TIME_INDEX_STRIDE 条晚于 end 的记录，查询时多取这些条目再过滤。
+ */
+static uint64_t upper_location(time_t end)
+{
+	if (end <= 0)
+		return UINT64_MAX;
+
+	int lo = 0, hi = segment_count;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (segments[mid].records == 0 || segments[mid].first <= end)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return 0;
+
+	HistorySegment *seg = &segments[lo - 1];
+	int a = 0, b = seg->time_count;
+	while (a < b)
+	{
+		int mid = (a + b) / 2;
+		if (seg->times[mid].time <= end)
+			a = mid + 1;
+		else
+			b = mid;
+	}
+	if (a == seg->time_count)
+		return (uint64_t)(seg->id + 1) << 32;
+	return ((uint64_t)seg->id << 32) | seg->times[a].offset;
+}
+
+/**
+ * @brief 把序号游标换算成位置下界（在锁内调用）
+ *
+ * 取第一个最大序号大于 after 的段，再取该段最后一个序号不大于 after 的索引项，
+ * 下界之后最多还有 HISTORY_TIME_INDEX_STRIDE 条序号不大于 after 的记录，由读取时精确过滤。
+ */
+static uint64_t lower_location_after(uint32_t after)
+{
+	int lo = 0, hi = segment_count;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (segments[mid].records > 0 && segments[mid].last_id <= after)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == segment_count)
+		return UINT64_MAX;
+
+	HistorySegment *seg = &segments[lo];
+	uint32_t offset = 0;
+	int a = 0, b = seg->time_count;
+	while (a < b)
+	{
+		int mid = (a + b) / 2;
+		if (seg->times[mid].id <= after)
+			a = mid + 1;
+		else
+			b = mid;
+	}
+	if (a > 0)
+		offset = seg->times[a - 1].offset;
+	return ((uint64_t)seg->id << 32) | offset;
+}
+
+/**
+ * @brief 在会话位置列表中二分查找第一个不小于 loc 的位置
+ */
+static size_t lower_bound(const Conversation *conv, uint64_t loc)
+{
+	size_t lo = conv->head, hi = conv->count;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (conv->locs[mid] < loc)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * @brief 取得覆盖段内已提交内容的映射并增加引用（在锁内调用）
+ *
+ * 当前段还在增长，映射长度不足时重新映射，旧映射在最后一个读者释放后解除。
+ */
+static MappedView *acquire_view(HistorySegment *seg)
+{
+	if (!seg->view || seg->view->map.len < seg->bytes)
+	{
+		char path[MAX_FILENAME_LEN + 16];
+		MappedView *view = (MappedView *)malloc(sizeof(MappedView));
+		segment_path(seg->id, path, sizeof(path));
+		if (!view || platform_mmap_file(path, seg->bytes, &view->map) != 0)
+		{
+			free(view);
+			return NULL;
+		}
+		atomic_init(&view->refs, 1);
+		release_view(seg->view);
+		seg->view = view;
+	}
+	atomic_fetch_add(&seg->view->refs, 1);
+	return seg->view;
+}
+
+/**
+ * @brief 查询者与 peer 的会话键，peer 为 NULL、空串或 "all" 时为广播
+ */
+static void query_key(const char *user, const char *peer, char *key)
+{
+	if (peer && *peer && strcmp(peer, "all") != 0)
+		conversation_key(RECORD_PRIVATE, user, strnlen(user, MAX_USERNAME_LEN - 1),
+						 peer, strnlen(peer, MAX_USERNAME_LEN - 1), key);
+	else
+		conversation_key(RECORD_BROADCAST, NULL, 0, NULL, 0, key);
+}
+
+/**
+ * @brief 查询历史消息
+ *
+ * 先查最近消息缓存，能给出完整结果时直接返回（包括尚未落盘的消息）。
+ * 否则在锁内经会话索引和时间索引定位最近的 limit 条（多取最多
+ * HISTORY_TIME_INDEX_STRIDE 条用于时间上界的精确过滤）并取得所在段的映射，
+ * 解锁后直接从映射中解码，按时间顺序逐条回调，此时尚未提交的消息不可见。
+ *
+ * @param user 查询者
+ * @param peer 私聊对方，NULL、空串或 "all" 表示查询广播
+ * @param start 起始时间（含），<=0 表示不限
+ * @param end 结束时间（含），<=0 表示不限
+ * @param limit 最多返回的条数，<=0 表示 HISTORY_QUERY_DEFAULT_LIMIT，超过 HISTORY_QUERY_MAX_LIMIT 时截断
+ * @param visit 逐条回调
+ * @param ctx 回调上下文
+ * @return int 回调的条数，未启动或失败返回-1
+ */
+int history_manager_query(const char *user, const char *peer, time_t start, time_t end,
+						  int limit, HistoryVisitor visit, void *ctx)
+{
+	char key[CONVERSATION_KEY_LEN];
+
+	if (!user || !visit || !atomic_load(&history_running))
+		return -1;
+	if (limit <= 0)
+		limit = HISTORY_QUERY_DEFAULT_LIMIT;
+	if (limit > HISTORY_QUERY_MAX_LIMIT)
+		limit = HISTORY_QUERY_MAX_LIMIT;
+	query_key(user, peer, key);
+
+	Message msg;
+	time_t when;
+	unsigned char *cached;
+	int hit = cache_query(key, start, end, limit, &cached);
+	if (hit >= 0)
+	{
+		int visited = 0;
+		const unsigned char *rec = cached;
+		for (int i = 0; i < hit; i++)
+		{
+			decode_record(rec, &msg, &when);
+			rec += get_u32(rec);
+			visited++;
+			if (visit(&msg, ctx) != 0)
+				break;
+		}
+		free(cached);
+		return visited;
+	}
+
+	size_t want = (size_t)limit + HISTORY_TIME_INDEX_STRIDE;
+	uint64_t *locs = (uint64_t *)malloc(want * sizeof(uint64_t));
+	MappedView **views = (MappedView **)malloc(want * sizeof(MappedView *));
+	size_t n = 0;
+	if (!locs || !views)
+	{
+		free(locs);
+		free(views);
+		return -1;
+	}
+
+	platform_mutex_lock(&segment_lock);
+	Conversation *conv = find_conversation(key);
+	if (conv)
+	{
+		size_t lo = lower_bound(conv, lower_location(start));
+		size_t hi = lower_bound(conv, upper_location(end));
+		size_t first = (hi > lo && hi - lo > want) ? hi - want : lo;
+		for (size_t i = first; i < hi; i++)
+		{
+			HistorySegment *seg = segment_by_id((unsigned int)(conv->locs[i] >> 32));
+			MappedView *view = seg ? acquire_view(seg) : NULL;
+			if (!view)
+				continue;
+			locs[n] = conv->locs[i];
+			views[n] = view;
+			n++;
+		}
+	}
+	platform_mutex_unlock(&segment_lock);
+
+	/* 先按记录头的时间精确过滤，只解码最后保留的 limit 条，映射在访问完后才释放 */
+	size_t matched = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t offset = (size_t)(uint32_t)locs[i];
+		const unsigned char *rec = views[i]->map.base + offset;
+		if (offset + RECORD_HEADER <= views[i]->map.len && offset + get_u32(rec) <= views[i]->map.len)
+		{
+			when = (time_t)(int64_t)get_u64(rec + 12);
+			if ((start <= 0 || when >= start) && (end <= 0 || when <= end))
+			{
+				locs[matched] = locs[i];
+				views[matched] = views[i];
+				matched++;
+				continue;
+			}
+		}
+		release_view(views[i]);
+	}
+
+	size_t begin = matched > (size_t)limit ? matched - (size_t)limit : 0;
+	int visited = 0;
+	int stopped = 0;
+	for (size_t i = begin; i < matched && !stopped; i++)
+	{
+		decode_record(views[i]->map.base + (size_t)(uint32_t)locs[i], &msg, &when);
+		visited++;
+		stopped = visit(&msg, ctx) != 0;
+	}
+	for (size_t i = 0; i < matched; i++)
+		release_view(views[i]);
+	free(views);
+	free(locs);
+	return visited;
+}
+
+/**
+ * @brief 按序号游标增量读取历史消息
+ *
+ * 返回会话中序号大于 after 的最早 limit 条已落盘消息，按序号顺序逐条回调，
+ * 回调中的 message_id 即该消息的序号。客户端把 next_cursor 作为下一次的 after，
+ * more 为0时已追上；断线重连后从上次的游标继续，只传输没有看到过的消息。
+ * 能从缓存给出完整结果时不访问索引和段文件；否则经稀疏索引把游标换算成位置下界，
+ * 在会话列表里二分后只读取下界之后的 limit 条（多取最多 HISTORY_TIME_INDEX_STRIDE 条用于精确过滤）。
+ *
+ * @param user 查询者
+ * @param peer 私聊对方，NULL、空串或 "all" 表示查询广播
+ * @param after 游标，只返回序号大于它的消息，0 表示从头开始
+ * @param limit 最多返回的条数，<=0 表示 HISTORY_QUERY_DEFAULT_LIMIT，超过 HISTORY_QUERY_MAX_LIMIT 时截断
+ * @param visit 逐条回调
+ * @param ctx 回调上下文
+ * @param next_cursor 输出，最后一条回调的序号，没有回调时为 after，可为 NULL
+ * @param more 输出，之后是否还有已落盘的消息，可为 NULL
+ * @return int 回调的条数，未启动或失败返回-1
+ */
+int history_manager_query_after(const char *user, const char *peer, uint32_t after, int limit,
+								HistoryVisitor visit, void *ctx, uint32_t *next_cursor, int *more)
+{
+	char key[CONVERSATION_KEY_LEN];
+	uint32_t cursor = after;
+	int remaining = 0;
+
+	if (next_cursor)
+		*next_cursor = after;
+	if (more)
+		*more = 0;
+	if (!user || !visit || !atomic_load(&history_running))
+		return -1;
+	if (limit <= 0)
+		limit = HISTORY_QUERY_DEFAULT_LIMIT;
+	if (limit > HISTORY_QUERY_MAX_LIMIT)
+		limit = HISTORY_QUERY_MAX_LIMIT;
+	query_key(user, peer, key);
+
+	Message msg;
+	time_t when;
+	unsigned char *cached;
+	int visited = 0;
+	int hit = cache_query_after(key, after, atomic_load(&committed_sequence), limit, &cached, &remaining);
+	if (hit >= 0)
+	{
+		const unsigned char *rec = cached;
+		for (int i = 0; i < hit; i++)
+		{
+			decode_record(rec, &msg, &when);
+			rec += get_u32(rec);
+			visited++;
+			cursor = (uint32_t)msg.message_id;
+			if (visit(&msg, ctx) != 0)
+			{
+				remaining = remaining || i + 1 < hit;
+				break;
+			}
+		}
+		free(cached);
+		if (next_cursor)
+			*next_cursor = cursor;
+		if (more)
+			*more = remaining;
+		return visited;
+	}
+
+	size_t want = (size_t)limit + HISTORY_TIME_INDEX_STRIDE + 1;
+	uint64_t *locs = (uint64_t *)malloc(want * sizeof(uint64_t));
+	MappedView **views = (MappedView **)malloc(want * sizeof(MappedView *));
+	size_t n = 0;
+	if (!locs || !views)
+	{
+		free(locs);
+		free(views);
+		return -1;
+	}
+
+	platform_mutex_lock(&segment_lock);
+	Conversation *conv = find_conversation(key);
+	if (conv)
+	{
+		size_t lo = lower_bound(conv, lower_location_after(after));
+		size_t hi = conv->count - lo > want ? lo + want : conv->count;
+		for (size_t i = lo; i < hi; i++)
+		{
+			HistorySegment *seg = segment_by_id((unsigned int)(conv->locs[i] >> 32));
+			MappedView *view = seg ? acquire_view(seg) : NULL;
+			if (!view)
+				continue;
+			locs[n] = conv->locs[i];
+			views[n] = view;
+			n++;
+		}
+	}
+	platform_mutex_unlock(&segment_lock);
+
+	/* 多取的条目里序号不大于 after 的最多 HISTORY_TIME_INDEX_STRIDE 条，取满 want 条时一定还有剩余 */
+	size_t matched = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t offset = (size_t)(uint32_t)locs[i];
+		const unsigned char *rec = views[i]->map.base + offset;
+		if (offset + RECORD_HEADER <= views[i]->map.len && offset + get_u32(rec) <= views[i]->map.len &&
+			get_u32(rec + 8) > after)
+		{
+			locs[matched] = locs[i];
+			views[matched] = views[i];
+			matched++;
+			continue;
+		}
+		release_view(views[i]);
+	}
+
+	size_t stop = matched > (size_t)limit ? (size_t)limit : matched;
+	remaining = matched > stop;
+	for (size_t i = 0; i < stop; i++)
+	{
+		decode_record(views[i]->map.base + (size_t)(uint32_t)locs[i], &msg, &when);
+		visited++;
+		cursor = (uint32_t)msg.message_id;
+		if (visit(&msg, ctx) != 0)
+		{
+			remaining = remaining || i + 1 < stop;
+			break;
+		}
+	}
+	for (size_t i = 0; i < matched; i++)
+		release_view(views[i]);
+	free(views);
+	free(locs);
+	if (next_cursor)
+		*next_cursor = cursor;
+	if (more)
+		*more = remaining;
+	return visited;
+}
+
+/**
+ * @brief 全文检索历史消息
+ *
+ * 在查询者与 peer 的会话中查找内容包含 query 全部词元的记录：倒排表求交只在
+ * 检索锁内进行，得到的位置再在段锁内取得映射，解锁后解码，按日志顺序逐条回调。
+ * 只能看到已落盘的消息；位置所在的段已被删除时跳过。
+ *
+ * @param user 查询者
+ * @param peer 私聊对方，NULL、空串或 "all" 表示检索广播
+ * @param query 查询文本，ASCII 词不区分大小写，中文按单字和二元组匹配
+ * @param limit 最多返回的条数（最近的匹配），<=0 表示 HISTORY_QUERY_DEFAULT_LIMIT，超过 HISTORY_QUERY_MAX_LIMIT 时截断
+ * @param visit 逐条回调
+ * @param ctx 回调上下文
+ * @param total 输出，匹配的总数，可为 NULL
+ * @return int 回调的条数，未启动、检索未开启或失败返回-1
+ */
+int history_manager_search(const char *user, const char *peer, const char *query, int limit,
+						   HistoryVisitor visit, void *ctx, int *total)
+{
+	char key[CONVERSATION_KEY_LEN];
+
+	if (total)
+		*total = 0;
+	if (!user || !query || !visit || !search_enabled || !atomic_load(&history_running))
+		return -1;
+	if (limit <= 0)
+		limit = HISTORY_QUERY_DEFAULT_LIMIT;
+	if (limit > HISTORY_QUERY_MAX_LIMIT)
+		limit = HISTORY_QUERY_MAX_LIMIT;
+	query_key(user, peer, key);
+
+	uint64_t *locs = (uint64_t *)malloc((size_t)limit * sizeof(uint64_t));
+	MappedView **views = (MappedView **)malloc((size_t)limit * sizeof(MappedView *));
+	if (!locs || !views)
+	{
+		free(locs);
+		free(views);
+		return -1;
+	}
+	int found = history_search_lookup(key, query, locs, limit, total);
+
+	size_t n = 0;
+	platform_mutex_lock(&segment_lock);
+	for (int i = 0; i < found; i++)
+	{
+		HistorySegment *seg = segment_by_id((unsigned int)(locs[i] >> 32));
+		MappedView *view = seg ? acquire_view(seg) : NULL;
+		if (!view)
+			continue;
+		locs[n] = locs[i];
+		views[n] = view;
+		n++;
+	}
+	platform_mutex_unlock(&segment_lock);
+
+	Message msg;
+	time_t when;
+	int visited = 0;
+	int stopped = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t offset = (size_t)(uint32_t)locs[i];
+		const unsigned char *rec = views[i]->map.base + offset;
+		if (!stopped && offset + RECORD_HEADER <= views[i]->map.len && offset + get_u32(rec) <= views[i]->map.len)
+		{
+			decode_record(rec, &msg, &when);
+			visited++;
+			stopped = visit(&msg, ctx) != 0;
+		}
+		release_view(views[i]);
+	}
+	free(views);
+	free(locs);
+	return visited;
+}
+
+/**
+ * @brief 开启或关闭全文检索索引，必须在 history_manager_init 之前调用
+ *
+ * @param enabled 非0时开启（默认），写线程为每条落盘的记录分词并维护倒排表
+ * @return int 成功返回0，历史存储已启动时返回-1
+ */
+int history_manager_set_search(int enabled)
+{
+	if (atomic_load(&history_running))
+		return -1;
+	search_enabled = enabled != 0;
+	return 0;
+}
+
+/**
+ * @brief 获取全文检索索引占用的字节数
+ *
+ * @return size_t 字节数，检索未开启时为0
+ */
+size_t history_manager_search_bytes(void)
+{
+	return history_search_bytes();
+}
+
+/**
+ * @brief 获取当前已落盘的最大序号
+ *
+ * @return uint32_t 序号，没有记录时为0
+ */
+uint32_t history_manager_committed_sequence(void)
+{
+	return atomic_load(&committed_sequence);
+}
+
+/**
+ * @brief 获取已落盘且仍保留的记录数
+ *
+ * @return int 记录数
+ */
+int history_manager_record_count(void)
+{
+	platform_mutex_lock(&segment_lock);
+	int count = total_records;
+	platform_mutex_unlock(&segment_lock);
+	return count;
+}
+
+/**
+ * @brief 获取丢弃的记录数
+ *
+ * @return size_t 因队列满、内存不足或写盘失败丢弃的记录数
+ */
+size_t history_manager_dropped_count(void)
+{
+	return atomic_load(&history_dropped);
+}
+
+/**
+ * @brief 设置最近消息缓存的大小，必须在 history_manager_init 之前调用
+ *
+ * @param max_bytes 所有会话缓存的总字节上限，0 表示关闭缓存
+ * @param per_conversation 每个会话缓存的最近记录数，<=0 表示使用 HISTORY_CACHE_RING
+ * @return int 成功返回0，历史存储已启动时返回-1
+ */
+int history_manager_set_cache(size_t max_bytes, int per_conversation)
+{
+	if (atomic_load(&history_running))
+		return -1;
+	platform_mutex_lock(&cache_lock);
+	cache_limit = max_bytes;
+	cache_ring = per_conversation > 0 ? per_conversation : HISTORY_CACHE_RING;
+	platform_mutex_unlock(&cache_lock);
+	return 0;
+}
+
+/**
+ * @brief 获取完全由缓存回答的查询次数
+ *
+ * @return size_t 缓存命中次数
+ */
+size_t history_manager_cache_hits(void)
+{
+	return atomic_load(&cache_hits);
+}
+
+/**
+ * @brief 获取缓存当前占用的字节数
+ *
+ * @return size_t 字节数
+ */
+size_t history_manager_cache_bytes(void)
+{
+	platform_mutex_lock(&cache_lock);
+	size_t bytes = cache_bytes;
+	platform_mutex_unlock(&cache_lock);
+	return bytes;
+}
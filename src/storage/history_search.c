@@ -0,0 +1,600 @@
+/**
+ * @file history_search.c
+ * @brief 历史消息的全文检索倒排索引
+ *
+ * 索引由历史存储的写线程在记录落盘并加入会话索引之后增量建立，路由路径上没有任何分词工作；
+ * 启动时随段文件扫描一并重建，不单独落盘。
+ *
+ * 分词同时适用于 ASCII 和 UTF-8 文本：
+ *   - ASCII 字母、数字和下划线组成的词转成小写后作为一个词元；
+ *   - 其他非标点字符（中文等）按码点切分，每个字符和相邻两个字符（二元组）各作为一个词元，
+ *     不依赖词典。查询时连续两个以上的字符只取二元组，单独的一个字符取单字。
+ * 词元以 64 位哈希表示，与会话键的哈希混合后作为倒排表的键，
+ * 因此每个倒排表只包含一个会话中的记录，查询天然限定在查询者参与的会话内。
+ *
+ * 倒排表是按日志顺序递增的记录位置（段编号 << 32 | 段内偏移），差分后以变长整数编码：
+ * 同一段内相邻记录的差通常只占 1~2 字节。最旧的段被删除时截掉各表头部失效的位置。
+ * 多个词元的查询取各倒排表的交集，从最短的表开始逐个求交。
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "storage.h"
+#include "../utils/utils.h"
+
+/** ASCII 词参与哈希的最大长度，更长的词按前缀匹配 */
+#define SEARCH_WORD_MAX 32
+/** 摘要中命中位置之前保留的字节数 */
+#define SEARCH_SNIPPET_LEAD 24
+/** 64 位 FNV-1a 初值 */
+#define FNV64_BASIS 14695981039346656037ull
+
+/**
+ * @brief 一个会话中一个词元的倒排表
+ */
+typedef struct
+{
+	uint64_t key;		 /**< 会话键与词元混合后的哈希 */
+	uint64_t last;		 /**< 最后一个位置，追加时按它差分 */
+	size_t count;		 /**< 位置数 */
+	size_t len;			 /**< 编码后的字节数 */
+	size_t cap;			 /**< 缓冲区容量 */
+	unsigned char *data; /**< 差分后的变长整数序列 */
+} SearchTerm;
+
+/**
+ * @brief 查询分词时收集的词元
+ */
+typedef struct
+{
+	uint64_t tokens[HISTORY_SEARCH_MAX_TERMS]; /**< 去重后的词元 */
+	int count;								   /**< 词元数 */
+} TokenSet;
+
+/**
+ * @brief 建立索引时的上下文
+ */
+typedef struct
+{
+	uint64_t conv; /**< 会话键的哈希 */
+	uint64_t loc;  /**< 记录位置 */
+} IndexContext;
+
+typedef void (*TokenSink)(uint64_t token, void *ctx);
+
+/* 倒排表由写线程修改，查询线程在锁内求交 */
+static platform_mutex_t search_lock = PLATFORM_MUTEX_INITIALIZER;
+static HashIndex terms;
+static size_t search_bytes = 0;
+
+/* ================ 分词 ================ */
+
+static uint64_t fnv64(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+/**
+ * @brief 计算一种词元的哈希，kind 区分词、单字和二元组
+ */
+static uint64_t token_hash(char kind, const void *data, size_t len)
+{
+	return fnv64(fnv64(FNV64_BASIS, &kind, 1), data, len);
+}
+
+/**
+ * @brief 解码一个 UTF-8 码点
+ *
+ * @return size_t 占用的字节数，无效或不完整的序列按1字节的 U+FFFD 处理
+ */
+static size_t utf8_next(const unsigned char *p, const unsigned char *end, uint32_t *cp)
+{
+	if (*p < 0x80)
+	{
+		*cp = *p;
+		return 1;
+	}
+
+	int extra = *p >= 0xF0 ? 3 : *p >= 0xE0 ? 2 : *p >= 0xC0 ? 1 : 0;
+	if (extra == 0 || end - p <= extra)
+	{
+		*cp = 0xFFFD;
+		return 1;
+	}
+	uint32_t v = *p & (0x3F >> extra);
+	for (int i = 1; i <= extra; i++)
+	{
+		if ((p[i] & 0xC0) != 0x80)
+		{
+			*cp = 0xFFFD;
+			return 1;
+		}
+		v = (v << 6) | (p[i] & 0x3F);
+	}
+	*cp = v;
+	return (size_t)extra + 1;
+}
+
+/**
+ * @brief 判断非 ASCII 码点是否为分隔符（通用标点、CJK 标点、全角符号、不间断空格）
+ */
+static int separator_codepoint(uint32_t cp)
+{
+	return cp == 0xFFFD || cp == 0x00A0 || cp == 0xFEFF || (cp >= 0x2000 && cp <= 0x206F) ||
+		   (cp >= 0x3000 && cp <= 0x303F) || (cp >= 0xFF01 && cp <= 0xFF0F) || (cp >= 0xFF1A && cp <= 0xFF20) ||
+		   (cp >= 0xFF3B && cp <= 0xFF40) || (cp >= 0xFF5B && cp <= 0xFF65);
+}
+
+static uint64_t codepoint_token(char kind, uint32_t first, uint32_t second)
+{
+	unsigned char buf[6];
+	buf[0] = (unsigned char)first;
+	buf[1] = (unsigned char)(first >> 8);
+	buf[2] = (unsigned char)(first >> 16);
+	buf[3] = (unsigned char)second;
+	buf[4] = (unsigned char)(second >> 8);
+	buf[5] = (unsigned char)(second >> 16);
+	return token_hash(kind, buf, kind == 'b' ? 6 : 3);
+}
+
+/**
+ * @brief 把文本切分成词元
+ *
+ * 建立索引时每个非 ASCII 字符都产生单字词元，相邻两个再产生二元组；
+ * 查询时（query 非0）连续的字符只产生二元组，单独的一个字符才产生单字，
+ * 二元组已经包含了单字的约束，交集更小，词元数也不会超过上限。
+ */
+static void tokenize(const char *text, size_t len, int query, TokenSink sink, void *ctx)
+{
+	const unsigned char *p = (const unsigned char *)text;
+	const unsigned char *end = p + len;
+	unsigned char word[SEARCH_WORD_MAX];
+	size_t word_len = 0;
+	uint32_t prev = 0;
+	int run = 0;
+
+	for (;;)
+	{
+		uint32_t cp = 0;
+		if (p < end)
+			p += utf8_next(p, end, &cp);
+
+		if (cp != 0 && cp < 0x80 && (isalnum((int)cp) || cp == '_'))
+		{
+			if (word_len < SEARCH_WORD_MAX)
+				word[word_len++] = (unsigned char)tolower((int)cp);
+		}
+		else if (word_len > 0)
+		{
+			sink(token_hash('w', word, word_len), ctx);
+			word_len = 0;
+		}
+
+		if (cp >= 0x80 && !separator_codepoint(cp))
+		{
+			if (!query)
+				sink(codepoint_token('u', cp, 0), ctx);
+			if (run > 0)
+				sink(codepoint_token('b', prev, cp), ctx);
+			prev = cp;
+			run++;
+		}
+		else
+		{
+			if (query && run == 1)
+				sink(codepoint_token('u', prev, 0), ctx);
+			run = 0;
+		}
+
+		if (cp == 0)
+			break;
+	}
+}
+
+static void collect_token(uint64_t token, void *ctx)
+{
+	TokenSet *set = (TokenSet *)ctx;
+	for (int i = 0; i < set->count; i++)
+	{
+		if (set->tokens[i] == token)
+			return;
+	}
+	if (set->count < HISTORY_SEARCH_MAX_TERMS)
+		set->tokens[set->count++] = token;
+}
+
+/* ================ 倒排表 ================ */
+
+static int term_matches(const void *value, const void *key)
+{
+	return ((const SearchTerm *)value)->key == *(const uint64_t *)key;
+}
+
+/**
+ * @brief 把词元与会话混合成倒排表的键
+ */
+static uint64_t term_key(uint64_t conv, uint64_t token)
+{
+	uint64_t h = conv ^ (token * 0x9E3779B97F4A7C15ull);
+	return h ^ (h >> 29);
+}
+
+static SearchTerm *find_term(uint64_t key)
+{
+	return (SearchTerm *)hash_index_find(&terms, hash_index_hash_int(key), &key, term_matches);
+}
+
+static size_t put_varint(unsigned char *p, uint64_t v)
+{
+	size_t n = 0;
+	while (v >= 0x80)
+	{
+		p[n++] = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (unsigned char)v;
+	return n;
+}
+
+static uint64_t get_varint(const unsigned char **p, const unsigned char *end)
+{
+	uint64_t v = 0;
+	int shift = 0;
+	while (*p < end && shift < 64)
+	{
+		unsigned char b = *(*p)++;
+		v |= (uint64_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			break;
+		shift += 7;
+	}
+	return v;
+}
+
+static void free_term(SearchTerm *term)
+{
+	search_bytes -= sizeof(SearchTerm) + term->cap;
+	free(term->data);
+	free(term);
+}
+
+static void index_token(uint64_t token, void *ctx)
+{
+	IndexContext *index = (IndexContext *)ctx;
+	uint64_t key = term_key(index->conv, token);
+	SearchTerm *term = find_term(key);
+
+	if (!term)
+	{
+		term = (SearchTerm *)calloc(1, sizeof(SearchTerm));
+		if (!term)
+			return;
+		term->key = key;
+		if (hash_index_insert(&terms, hash_index_hash_int(key), term) != 0)
+		{
+			free(term);
+			return;
+		}
+		search_bytes += sizeof(SearchTerm);
+	}
+	else if (term->count > 0 && term->last == index->loc)
+	{
+		return; /* 同一条记录中重复出现的词元 */
+	}
+
+	if (term->len + 10 > term->cap)
+	{
+		size_t cap = term->cap ? term->cap * 2 : 16;
+		unsigned char *grown = (unsigned char *)realloc(term->data, cap);
+		if (!grown)
+			return;
+		search_bytes += cap - term->cap;
+		term->data = grown;
+		term->cap = cap;
+	}
+	term->len += put_varint(term->data + term->len, index->loc - (term->count ? term->last : 0));
+	term->last = index->loc;
+	term->count++;
+}
+
+/**
+ * @brief 把一条已提交记录的内容加入倒排索引（写线程调用）
+ *
+ * @param key 记录所属的会话键
+ * @param content 消息内容
+ * @param len 内容长度
+ * @param loc 记录位置，必须大于此前加入的所有位置
+ */
+void history_search_add(const char *key, const char *content, size_t len, uint64_t loc)
+{
+	IndexContext index = {fnv64(FNV64_BASIS, key, strlen(key)), loc};
+
+	platform_mutex_lock(&search_lock);
+	tokenize(content, len, 0, index_token, &index);
+	platform_mutex_unlock(&search_lock);
+}
+
+/**
+ * @brief 截掉所有倒排表中小于 limit 的位置，删除已空的表
+ *
+ * 最旧的段被删除后由写线程调用，只解码每个表头部失效的部分，保留部分整体复制。
+ *
+ * @param limit 第一个仍保留的段的起始位置
+ */
+void history_search_trim(uint64_t limit)
+{
+	platform_mutex_lock(&search_lock);
+	size_t empty_count = 0;
+	SearchTerm **empty = (SearchTerm **)malloc((terms.count ? terms.count : 1) * sizeof(SearchTerm *));
+
+	for (size_t i = 0; i < terms.cap; i++)
+	{
+		SearchTerm *term = (SearchTerm *)terms.slots[i].value;
+		if (!term)
+			continue;
+
+		const unsigned char *p = term->data;
+		const unsigned char *end = term->data + term->len;
+		uint64_t loc = 0;
+		size_t dropped = 0;
+		while (p < end)
+		{
+			loc += get_varint(&p, end);
+			if (loc >= limit)
+				break;
+			dropped++;
+		}
+		if (dropped == 0 && term->count > 0)
+			continue;
+		if (dropped >= term->count)
+		{
+			if (empty)
+				empty[empty_count++] = term;
+			continue;
+		}
+
+		/* 第一个保留的位置改写为绝对值，其后的差分不变 */
+		size_t rest = (size_t)(end - p);
+		unsigned char *data = (unsigned char *)malloc(rest + 10);
+		if (!data)
+			continue;
+		size_t len = put_varint(data, loc);
+		memcpy(data + len, p, rest);
+		search_bytes += rest + 10 - term->cap;
+		free(term->data);
+		term->data = data;
+		term->len = len + rest;
+		term->cap = rest + 10;
+		term->count -= dropped;
+	}
+
+	for (size_t i = 0; i < empty_count; i++)
+	{
+		hash_index_remove(&terms, hash_index_hash_int(empty[i]->key), &empty[i]->key, term_matches);
+		free_term(empty[i]);
+	}
+	free(empty);
+	platform_mutex_unlock(&search_lock);
+}
+
+/**
+ * @brief 在一个会话中查找包含查询全部词元的记录
+ *
+ * 查询最多取前 HISTORY_SEARCH_MAX_TERMS 个不同的词元，超出的部分不参与过滤。
+ *
+ * @param key 会话键
+ * @param query 查询文本
+ * @param locs 输出，按日志顺序排列的最近 max 个匹配位置
+ * @param max locs 的容量
+ * @param total 输出，匹配的总数，可为 NULL
+ * @return int 写入 locs 的位置数，查询没有词元时为0
+ */
+int history_search_lookup(const char *key, const char *query, uint64_t *locs, int max, int *total)
+{
+	TokenSet set = {{0}, 0};
+	SearchTerm *found[HISTORY_SEARCH_MAX_TERMS];
+
+	if (total)
+		*total = 0;
+	if (!key || !query || max <= 0)
+		return 0;
+	tokenize(query, strlen(query), 1, collect_token, &set);
+	if (set.count == 0)
+		return 0;
+
+	uint64_t conv = fnv64(FNV64_BASIS, key, strlen(key));
+	platform_mutex_lock(&search_lock);
+	for (int i = 0; i < set.count; i++)
+	{
+		found[i] = find_term(term_key(conv, set.tokens[i]));
+		if (!found[i] || found[i]->count == 0)
+		{
+			platform_mutex_unlock(&search_lock);
+			return 0;
+		}
+		/* 按长度插入排序，从最短的表开始求交 */
+		for (int j = i; j > 0 && found[j]->count < found[j - 1]->count; j--)
+		{
+			SearchTerm *t = found[j];
+			found[j] = found[j - 1];
+			found[j - 1] = t;
+		}
+	}
+
+	uint64_t *acc = (uint64_t *)malloc(found[0]->count * sizeof(uint64_t));
+	if (!acc)
+	{
+		platform_mutex_unlock(&search_lock);
+		return 0;
+	}
+	const unsigned char *p = found[0]->data;
+	const unsigned char *end = p + found[0]->len;
+	uint64_t loc = 0;
+	size_t n = 0;
+	while (p < end && n < found[0]->count)
+	{
+		loc += get_varint(&p, end);
+		acc[n++] = loc;
+	}
+
+	/* 逐个与更长的表求交，边解码边比较 */
+	for (int i = 1; i < set.count && n > 0; i++)
+	{
+		size_t out = 0, j = 0;
+		int have = 0;
+		p = found[i]->data;
+		end = p + found[i]->len;
+		loc = 0;
+		while (j < n)
+		{
+			if (!have)
+			{
+				if (p >= end)
+					break;
+				loc += get_varint(&p, end);
+				have = 1;
+			}
+			if (loc < acc[j])
+				have = 0;
+			else if (loc > acc[j])
+				j++;
+			else
+			{
+				acc[out++] = acc[j++];
+				have = 0;
+			}
+		}
+		n = out;
+	}
+	platform_mutex_unlock(&search_lock);
+
+	size_t first = n > (size_t)max ? n - (size_t)max : 0;
+	memcpy(locs, acc + first, (n - first) * sizeof(uint64_t));
+	free(acc);
+	if (total)
+		*total = (int)n;
+	return (int)(n - first);
+}
+
+/**
+ * @brief 获取倒排索引占用的字节数
+ */
+size_t history_search_bytes(void)
+{
+	platform_mutex_lock(&search_lock);
+	size_t bytes = search_bytes;
+	platform_mutex_unlock(&search_lock);
+	return bytes;
+}
+
+/**
+ * @brief 释放全部倒排表
+ */
+void history_search_clear(void)
+{
+	platform_mutex_lock(&search_lock);
+	for (size_t i = 0; i < terms.cap; i++)
+	{
+		SearchTerm *term = (SearchTerm *)terms.slots[i].value;
+		if (term)
+			free_term(term);
+	}
+	hash_index_free(&terms);
+	search_bytes = 0;
+	platform_mutex_unlock(&search_lock);
+}
+
+/* ================ 摘要 ================ */
+
+/**
+ * @brief 在 text 中不区分 ASCII 大小写地查找 piece
+ *
+ * @return size_t 第一次出现的偏移，找不到时返回 text_len
+ */
+static size_t find_piece(const char *text, size_t text_len, const char *piece, size_t piece_len)
+{
+	for (size_t i = 0; piece_len <= text_len && i <= text_len - piece_len; i++)
+	{
+		size_t k = 0;
+		while (k < piece_len && tolower((unsigned char)text[i + k]) == tolower((unsigned char)piece[k]))
+			k++;
+		if (k == piece_len)
+			return i;
+	}
+	return text_len;
+}
+
+/**
+ * @brief 截取消息内容中最早命中查询的一段作为摘要
+ *
+ * 查询按空白拆成片段，取内容中最早出现的片段，从它之前 SEARCH_SNIPPET_LEAD 字节起
+ * 截取最多 HISTORY_SNIPPET_LEN 字节，两端对齐到 UTF-8 字符边界，被截断的一端加 "..."。
+ * 没有片段原样出现时（如中间隔着标点）从开头截取。
+ *
+ * @param content 消息内容
+ * @param query 查询文本
+ * @param out 输出缓冲区
+ * @param size 缓冲区大小
+ * @return size_t 摘要长度
+ */
+size_t history_search_snippet(const char *content, const char *query, char *out, size_t size)
+{
+	size_t len = strlen(content);
+	size_t hit = len;
+	const char *q = query ? query : "";
+
+	if (size < 8)
+	{
+		if (size > 0)
+			out[0] = '\0';
+		return 0;
+	}
+
+	while (*q)
+	{
+		while (*q && isspace((unsigned char)*q))
+			q++;
+		const char *piece = q;
+		while (*q && !isspace((unsigned char)*q))
+			q++;
+		size_t at = q > piece ? find_piece(content, len, piece, (size_t)(q - piece)) : len;
+		if (at < hit)
+			hit = at;
+	}
+	if (hit == len)
+		hit = 0;
+
+	size_t start = hit > SEARCH_SNIPPET_LEAD ? hit - SEARCH_SNIPPET_LEAD : 0;
+	while (start > 0 && ((unsigned char)content[start] & 0xC0) == 0x80)
+		start--;
+	size_t room = size - 7 < HISTORY_SNIPPET_LEN ? size - 7 : HISTORY_SNIPPET_LEN;
+	size_t stop = start + room;
+	if (stop >= len)
+		stop = len;
+	else
+		while (stop > start && ((unsigned char)content[stop] & 0xC0) == 0x80)
+			stop--;
+
+	size_t n = 0;
+	if (start > 0)
+	{
+		memcpy(out, "...", 3);
+		n = 3;
+	}
+	memcpy(out + n, content + start, stop - start);
+	n += stop - start;
+	if (stop < len)
+	{
+		memcpy(out + n, "...", 3);
+		n += 3;
+	}
+	out[n] = '\0';
+	return n;
+}
@@ -9,15 +9,17 @@
 /* 初始化存储子模块 */
 void storage_init(void)
 {
-	/* 目前仅初始化默认用户，未来可扩展为加载持久化数据 */
-	user_store_init_defaults();
+	/* 已打开的用户库文件中有用户时直接使用，空库（首次启动或未打开库文件）才添加默认用户 */
+	if (user_store_count() == 0)
+		user_store_init_defaults();
 
 	LOG_INFO("Storage initialized");
 }
 
-/* 清理存储子模块（占位） */
+/* 清理存储子模块 */
 void storage_cleanup(void)
 {
-	/* 目前没有持久化资源需要清理 */
+	/* 释放用户记录及其索引 */
+	user_store_cleanup();
 	LOG_INFO("Storage cleaned up");
 }
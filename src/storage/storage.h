@@ -10,15 +10,123 @@ User *user_store_find_by_username(const char *username);
 User *user_store_find_by_id(int user_id);
 int user_store_add(const char *username, const char *password);
 int user_store_count(void);
+size_t user_store_pool_usage(size_t *high_water);
+void user_store_cleanup(void);
 
-/* 用户验证 */
+/* 用户验证：PBKDF2 派生摘要后比较，验证通过的凭证缓存 CREDENTIAL_CACHE_TTL_MS */
+#define PASSWORD_HASH_ITERATIONS 4096	/**< 新用户口令摘要的默认迭代次数 */
+#define CREDENTIAL_CACHE_SLOTS 1024		/**< 凭证缓存槽位数，按用户ID直接映射 */
+#define CREDENTIAL_CACHE_TTL_MS 60000	/**< 验证通过的凭证在缓存中保留的毫秒数 */
 int user_store_authenticate(const char *username, const char *password);
+void user_store_set_hash_iterations(unsigned int iterations);
+size_t user_store_credential_cache_hits(void);
 
 /* 用户列表 */
 void user_store_print_all(void);
 
-/* 测试辅助：初始化默认用户 */
+/* 持久化：打开用户库文件，之后 user_store_add 新增的用户追加到日志；合并日志后原有 User 指针失效 */
+#define USER_DB_DEFAULT_PATH "users.db"		 /**< 默认的用户库文件 */
+#define USER_JOURNAL_COMPACT_RECORDS 4096	 /**< 启动时日志达到这么多条即合并进库文件 */
+int user_store_open(const char *path);
+int user_store_compact(void);
+size_t user_store_mapped_count(void);
+
+/* 测试辅助：初始化默认用户；合成用户供负载生成器登录，名称为前缀加序号 */
+#define SYNTHETIC_USER_PREFIX "bench"
 void user_store_init_defaults(void);
+int user_store_init_synthetic(const char *prefix, int count);
+
+/* ================ 用户库文件（供 user_store.c 使用） ================ */
+
+/**
+ * @brief 映射的用户库文件视图
+ */
+typedef struct
+{
+	platform_mmap_t map;	 /**< 文件映射 */
+	const User *records;	 /**< 按ID升序的记录 */
+	uint32_t count;			 /**< 记录数 */
+	const uint32_t *buckets; /**< 预建的哈希桶，存记录下标加一 */
+	uint32_t bucket_mask;	 /**< 桶数减一 */
+	int next_user_id;		 /**< 写入时的下一个可分配ID */
+} UserDb;
+
+int user_db_map(const char *path, UserDb *db);
+void user_db_unmap(UserDb *db);
+const User *user_db_find(const UserDb *db, const char *username);
+const User *user_db_find_by_id(const UserDb *db, int user_id);
+int user_db_write(const char *path, const User *mapped, uint32_t mapped_count,
+				  User *const *extra, size_t extra_count, int next_user_id);
+int user_db_commit(const char *path);
+
+FILE *user_journal_open(const char *path);
+int user_journal_append(FILE *fp, const User *user, int sync);
+int user_journal_sync(FILE *fp);
+int user_journal_replay(const char *path, void (*apply)(const User *user, void *ctx), void *ctx, int *torn);
+int user_journal_reset(const char *path);
+
+/* ================ 历史消息存储函数 ================ */
+
+#define HISTORY_DEFAULT_DIR "history"			   /**< 默认的段文件目录 */
+#define HISTORY_SEGMENT_BYTES (1024 * 1024)		   /**< 单个段文件的容量（字节） */
+#define HISTORY_MAX_PENDING 65536				   /**< 等待写盘的最大记录数，超过时丢弃并计数 */
+#define HISTORY_QUERY_DEFAULT_LIMIT 50			   /**< 查询未指定条数时返回的最近消息数 */
+#define HISTORY_QUERY_MAX_LIMIT 200				   /**< 单次查询最多返回的消息数 */
+#define HISTORY_TIME_INDEX_STRIDE 64			   /**< 段内稀疏时间索引的间隔（记录数） */
+#define HISTORY_PAGE_SIZE 20					   /**< 查询结果每页的消息数，每页一次写入发送队列 */
+#define HISTORY_CACHE_BYTES (8 * 1024 * 1024)	   /**< 最近消息缓存的默认总字节上限 */
+#define HISTORY_CACHE_RING 64					   /**< 每个会话缓存的最近记录数 */
+#define HISTORY_SEARCH_MAX_TERMS 16				   /**< 一次检索最多使用的不同词元数 */
+#define HISTORY_SNIPPET_LEN 96					   /**< 检索结果摘要的最大字节数（不含省略号） */
+
+/**
+ * @brief 历史查询的逐条回调
+ *
+ * @param msg 还原出的消息（type 为原消息类型，timestamp 为写入时间）
+ * @param ctx 调用方上下文
+ * @return int 返回非0时停止遍历
+ */
+typedef int (*HistoryVisitor)(const Message *msg, void *ctx);
+
+/* 生命周期：恢复已有段并启动后台写线程 */
+int history_manager_init(const char *dir, size_t segment_bytes, int max_records);
+void history_manager_shutdown(void);
+int history_manager_is_running(void);
+
+/* 追加一条已路由的消息：分配持久序号后只入队，不做文件写入 */
+int history_manager_append(Message *msg);
+
+/* 经会话和时间索引查询与 peer 的私聊（peer 为 NULL/"all" 时查询广播）在 [start, end] 内最近的 limit 条 */
+int history_manager_query(const char *user, const char *peer, time_t start, time_t end,
+						  int limit, HistoryVisitor visit, void *ctx);
+
+/* 增量同步：按序号读取游标 after 之后最早的 limit 条已落盘消息，返回下一页的游标 */
+int history_manager_query_after(const char *user, const char *peer, uint32_t after, int limit,
+								HistoryVisitor visit, void *ctx, uint32_t *next_cursor, int *more);
+uint32_t history_manager_committed_sequence(void);
+
+/* 全文检索：在与 peer 的会话中查找包含 query 全部词元的最近 limit 条已落盘消息 */
+int history_manager_search(const char *user, const char *peer, const char *query, int limit,
+						   HistoryVisitor visit, void *ctx, int *total);
+int history_manager_set_search(int enabled);
+size_t history_manager_search_bytes(void);
+
+/* 统计：已落盘的记录数、因队列满或写盘失败丢弃的记录数 */
+int history_manager_record_count(void);
+size_t history_manager_dropped_count(void);
+
+/* 最近消息缓存：每会话一个环形缓冲区，总字节数超限时按 LRU 淘汰整个会话 */
+int history_manager_set_cache(size_t max_bytes, int per_conversation);
+size_t history_manager_cache_hits(void);
+size_t history_manager_cache_bytes(void);
+
+/* 倒排索引：由历史存储的写线程按会话增量建立，位置为 段编号 << 32 | 段内偏移 */
+void history_search_add(const char *key, const char *content, size_t len, uint64_t loc);
+void history_search_trim(uint64_t limit);
+int history_search_lookup(const char *key, const char *query, uint64_t *locs, int max, int *total);
+size_t history_search_bytes(void);
+void history_search_clear(void);
+size_t history_search_snippet(const char *content, const char *query, char *out, size_t size);
 
 /* 初始化/清理 */
 void storage_init(void);
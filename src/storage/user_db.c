@@ -0,0 +1,428 @@
+/**
+ * @file user_db.c
+ * @brief 用户库文件与追加日志
+ *
+ * 用户库是一个只读映射的文件，布局为：
+ *
+ *     [UserDbHeader 64 字节][User 记录 × record_count][uint32 桶 × bucket_count]
+ *
+ * 记录按用户ID升序排列，记录格式就是内存中的 User 结构体；桶数组是预先建好的
+ * 开放寻址哈希表（线性探测），每个桶存记录下标加一，0 表示空桶。
+ * 启动时只需映射文件并校验文件头，查找直接在映射上探测，不解析也不重新插入任何记录，
+ * 启动耗时与用户数无关；只有被访问到的页才会调入内存。
+ *
+ * 运行期新增的用户追加到旁边的日志文件（<path>.journal），每条是一条 User 记录加
+ * 8 字节校验。启动时重放日志，日志达到 USER_JOURNAL_COMPACT_RECORDS 条或尾部不完整时，
+ * 把库文件和日志合并写成新的库文件（先写临时文件、同步后原子替换），再清空日志。
+ *
+ * 文件头记录字节序标记和记录大小，在字节序或结构体布局不同的平台上打开时拒绝使用，
+ * 不会误读。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "storage.h"
+#include "../utils/utils.h"
+
+#define USER_DB_MAGIC "TITIUSR"	   /**< 文件魔数（含结尾的空字符共 8 字节） */
+#define USER_DB_VERSION 1		   /**< 文件格式版本 */
+#define USER_DB_ENDIAN 0x01020304u /**< 字节序标记 */
+#define USER_DB_CHECK_LEN 8		   /**< 文件头和日志记录的校验字节数 */
+#define USER_DB_MIN_BUCKETS 16	   /**< 桶数组的最小长度 */
+
+/**
+ * @brief 用户库文件头，固定 64 字节
+ */
+typedef struct
+{
+	char magic[8];							  /**< USER_DB_MAGIC */
+	uint32_t version;						  /**< USER_DB_VERSION */
+	uint32_t endian;						  /**< USER_DB_ENDIAN，按本机字节序写入 */
+	uint32_t record_size;					  /**< sizeof(User) */
+	uint32_t record_count;					  /**< 记录数 */
+	uint32_t bucket_count;					  /**< 桶数，2 的幂 */
+	int32_t next_user_id;					  /**< 下一个可分配的用户ID */
+	uint64_t records_offset;				  /**< 记录区的偏移 */
+	uint64_t index_offset;					  /**< 桶数组的偏移 */
+	uint64_t file_size;						  /**< 文件总字节数 */
+	unsigned char checksum[USER_DB_CHECK_LEN]; /**< 文件头（本字段置零）的 SHA-256 前 8 字节 */
+} UserDbHeader;
+
+/**
+ * @brief 日志中的一条记录
+ */
+typedef struct
+{
+	User user;								   /**< 新增的用户 */
+	unsigned char checksum[USER_DB_CHECK_LEN]; /**< user 的 SHA-256 前 8 字节 */
+} UserJournalEntry;
+
+/**
+ * @brief 计算校验字节
+ */
+static void checksum_of(const void *data, size_t len, unsigned char out[USER_DB_CHECK_LEN])
+{
+	unsigned char digest[SHA256_DIGEST_LEN];
+
+	sha256(data, len, digest);
+	memcpy(out, digest, USER_DB_CHECK_LEN);
+}
+
+/**
+ * @brief 计算用户名在桶数组中的起始位置
+ *
+ * 取哈希的低 32 位，32 位和 64 位平台上的结果相同。
+ */
+static uint32_t bucket_hash(const char *username)
+{
+	return (uint32_t)hash_index_hash_string(username, MAX_USERNAME_LEN);
+}
+
+/**
+ * @brief 校验映射的文件头
+ *
+ * 只检查文件头本身和各区域的边界，耗时与记录数无关。
+ *
+ * @return int 有效返回0，否则返回-1
+ */
+static int validate_header(const UserDbHeader *header, size_t file_len)
+{
+	UserDbHeader copy = *header;
+	unsigned char expected[USER_DB_CHECK_LEN];
+
+	memset(copy.checksum, 0, sizeof(copy.checksum));
+	checksum_of(&copy, sizeof(copy), expected);
+	if (memcmp(expected, header->checksum, sizeof(expected)) != 0)
+		return -1;
+
+	if (memcmp(header->magic, USER_DB_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != USER_DB_VERSION || header->endian != USER_DB_ENDIAN ||
+		header->record_size != sizeof(User) || header->file_size != file_len)
+		return -1;
+
+	uint32_t buckets = header->bucket_count;
+	if (buckets < USER_DB_MIN_BUCKETS || (buckets & (buckets - 1)) != 0 || header->record_count >= buckets)
+		return -1;
+
+	uint64_t records_end = header->records_offset + (uint64_t)header->record_count * sizeof(User);
+	if (header->records_offset != sizeof(UserDbHeader) || header->index_offset != records_end ||
+		header->index_offset + (uint64_t)buckets * sizeof(uint32_t) != file_len)
+		return -1;
+	return 0;
+}
+
+/**
+ * @brief 映射用户库文件
+ *
+ * @param path 文件路径
+ * @param db 输出映射后的视图，文件不存在时为空库
+ * @return int 成功返回0，文件不存在返回1，文件无效或映射失败返回-1
+ */
+int user_db_map(const char *path, UserDb *db)
+{
+	memset(db, 0, sizeof(*db));
+
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return 1;
+	if (fseek(fp, 0, SEEK_END) != 0)
+	{
+		fclose(fp);
+		return -1;
+	}
+	long len = ftell(fp);
+	fclose(fp);
+
+	if (len < (long)sizeof(UserDbHeader) || platform_mmap_file(path, (size_t)len, &db->map) != 0)
+		return -1;
+
+	/* 映射起始地址按页对齐，文件头、记录区和桶数组的偏移都满足各自的对齐要求 */
+	const UserDbHeader *header = (const UserDbHeader *)db->map.base;
+	if (validate_header(header, (size_t)len) != 0)
+	{
+		platform_munmap_file(&db->map);
+		memset(db, 0, sizeof(*db));
+		return -1;
+	}
+
+	db->records = (const User *)(db->map.base + header->records_offset);
+	db->count = header->record_count;
+	db->buckets = (const uint32_t *)(db->map.base + header->index_offset);
+	db->bucket_mask = header->bucket_count - 1;
+	db->next_user_id = header->next_user_id;
+	return 0;
+}
+
+/**
+ * @brief 解除用户库文件的映射，之后指向其中记录的指针全部失效
+ */
+void user_db_unmap(UserDb *db)
+{
+	platform_munmap_file(&db->map);
+	memset(db, 0, sizeof(*db));
+}
+
+/**
+ * @brief 在映射的桶数组上按用户名查找
+ *
+ * @return const User* 找到返回映射中的记录，否则返回NULL
+ */
+const User *user_db_find(const UserDb *db, const char *username)
+{
+	if (!db->records || !username)
+		return NULL;
+
+	uint32_t slot = bucket_hash(username) & db->bucket_mask;
+	for (uint32_t probes = 0; probes <= db->bucket_mask; probes++, slot = (slot + 1) & db->bucket_mask)
+	{
+		uint32_t entry = db->buckets[slot];
+		if (entry == 0 || entry > db->count)
+			return NULL;
+
+		const User *user = &db->records[entry - 1];
+		if (strncmp(user->username, username, MAX_USERNAME_LEN) == 0)
+			return user;
+	}
+	return NULL;
+}
+
+/**
+ * @brief 按用户ID查找映射中的记录
+ *
+ * 记录按ID升序排列且ID通常连续，先按偏移直接取，不连续时退回二分查找。
+ *
+ * @return const User* 找到返回映射中的记录，否则返回NULL
+ */
+const User *user_db_find_by_id(const UserDb *db, int user_id)
+{
+	if (db->count == 0 || user_id < db->records[0].user_id || user_id > db->records[db->count - 1].user_id)
+		return NULL;
+
+	uint32_t guess = (uint32_t)(user_id - db->records[0].user_id);
+	if (guess < db->count && db->records[guess].user_id == user_id)
+		return &db->records[guess];
+
+	uint32_t lo = 0, hi = db->count;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (db->records[mid].user_id < user_id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < db->count && db->records[lo].user_id == user_id ? &db->records[lo] : NULL;
+}
+
+/**
+ * @brief 把全部用户写成新的库文件 <path>.tmp
+ *
+ * 写完并同步到磁盘后由 user_db_commit 原子替换 path，中途失败时原文件不受影响。
+ * mapped 可以指向 path 当前的映射。
+ *
+ * @param path 库文件路径
+ * @param mapped 原库文件中的记录，按ID升序，可为NULL
+ * @param mapped_count 原记录数
+ * @param extra 之后新增的用户，按ID升序，可含NULL项（跳过）
+ * @param extra_count extra 的长度
+ * @param next_user_id 下一个可分配的用户ID
+ * @return int 成功返回0，失败返回-1
+ */
+int user_db_write(const char *path, const User *mapped, uint32_t mapped_count,
+				  User *const *extra, size_t extra_count, int next_user_id)
+{
+	char tmp[MAX_FILENAME_LEN + 8];
+	uint32_t count = mapped_count;
+	uint32_t buckets = USER_DB_MIN_BUCKETS;
+
+	for (size_t i = 0; i < extra_count; i++)
+	{
+		if (extra[i])
+			count++;
+	}
+	while (buckets < (uint64_t)count * 2)
+		buckets *= 2;
+
+	/* 先在内存中建好桶数组：记录下标即写入顺序 */
+	uint32_t *table = (uint32_t *)calloc(buckets, sizeof(uint32_t));
+	if (!table)
+		return -1;
+	uint32_t index = 0;
+	for (size_t i = 0; i < (size_t)mapped_count + extra_count; i++)
+	{
+		const User *user = i < mapped_count ? &mapped[i] : extra[i - mapped_count];
+		if (!user)
+			continue;
+		uint32_t slot = bucket_hash(user->username) & (buckets - 1);
+		while (table[slot] != 0)
+			slot = (slot + 1) & (buckets - 1);
+		table[slot] = ++index;
+	}
+
+	UserDbHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, USER_DB_MAGIC, sizeof(header.magic));
+	header.version = USER_DB_VERSION;
+	header.endian = USER_DB_ENDIAN;
+	header.record_size = sizeof(User);
+	header.record_count = count;
+	header.bucket_count = buckets;
+	header.next_user_id = next_user_id;
+	header.records_offset = sizeof(UserDbHeader);
+	header.index_offset = header.records_offset + (uint64_t)count * sizeof(User);
+	header.file_size = header.index_offset + (uint64_t)buckets * sizeof(uint32_t);
+	checksum_of(&header, sizeof(header), header.checksum);
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	FILE *fp = fopen(tmp, "wb");
+	if (!fp)
+	{
+		free(table);
+		return -1;
+	}
+
+	int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	if (ok && mapped_count > 0)
+		ok = fwrite(mapped, sizeof(User), mapped_count, fp) == mapped_count;
+	for (size_t i = 0; ok && i < extra_count; i++)
+	{
+		if (extra[i])
+			ok = fwrite(extra[i], sizeof(User), 1, fp) == 1;
+	}
+	if (ok)
+		ok = fwrite(table, sizeof(uint32_t), buckets, fp) == buckets;
+	free(table);
+
+	if (ok)
+		ok = fflush(fp) == 0 && platform_file_sync(fp) == 0;
+	if (fclose(fp) != 0)
+		ok = 0;
+	if (!ok)
+	{
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief 用 user_db_write 写好的 <path>.tmp 原子替换库文件
+ *
+ * 调用方须先解除对 path 的映射（Windows 上映射中的文件不能被替换）。
+ *
+ * @return int 成功返回0，失败时删除临时文件并返回-1
+ */
+int user_db_commit(const char *path)
+{
+	char tmp[MAX_FILENAME_LEN + 8];
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if (platform_file_replace(tmp, path) != 0)
+	{
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief 以追加方式打开日志文件
+ *
+ * @return FILE* 成功返回文件，失败返回NULL
+ */
+FILE *user_journal_open(const char *path)
+{
+	return fopen(path, "ab");
+}
+
+/**
+ * @brief 向日志追加一条新增用户的记录
+ *
+ * @param fp 日志文件
+ * @param user 新增的用户
+ * @param sync 非0时写入后同步到磁盘，批量追加时可只在最后一条同步
+ * @return int 成功返回0，失败返回-1
+ */
+int user_journal_append(FILE *fp, const User *user, int sync)
+{
+	UserJournalEntry entry;
+
+	if (!fp || !user)
+		return -1;
+
+	memcpy(&entry.user, user, sizeof(User));
+	checksum_of(&entry.user, sizeof(entry.user), entry.checksum);
+	if (fwrite(&entry, sizeof(entry), 1, fp) != 1 || fflush(fp) != 0)
+		return -1;
+	return sync ? platform_file_sync(fp) : 0;
+}
+
+/**
+ * @brief 同步日志文件
+ */
+int user_journal_sync(FILE *fp)
+{
+	return fp ? platform_file_sync(fp) : -1;
+}
+
+/**
+ * @brief 按顺序重放日志中的记录
+ *
+ * 遇到不完整或校验不符的记录时停止，之后的内容视为崩溃时未写完的尾部。
+ *
+ * @param path 日志路径
+ * @param apply 每条有效记录的回调
+ * @param ctx 回调上下文
+ * @param torn 输出是否发现不完整的尾部，可为NULL
+ * @return int 有效记录数，日志不存在时返回0
+ */
+int user_journal_replay(const char *path, void (*apply)(const User *user, void *ctx), void *ctx, int *torn)
+{
+	UserJournalEntry entry;
+	unsigned char expected[USER_DB_CHECK_LEN];
+	int replayed = 0;
+	size_t got;
+
+	if (torn)
+		*torn = 0;
+
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return 0;
+
+	while ((got = fread(&entry, 1, sizeof(entry), fp)) == sizeof(entry))
+	{
+		checksum_of(&entry.user, sizeof(entry.user), expected);
+		if (memcmp(expected, entry.checksum, sizeof(expected)) != 0)
+		{
+			got = 1;
+			break;
+		}
+		entry.user.username[MAX_USERNAME_LEN - 1] = '\0';
+		apply(&entry.user, ctx);
+		replayed++;
+	}
+	if (torn && got > 0)
+		*torn = 1;
+
+	fclose(fp);
+	return replayed;
+}
+
+/**
+ * @brief 清空日志文件
+ *
+ * @return int 成功返回0，失败返回-1
+ */
+int user_journal_reset(const char *path)
+{
+	FILE *fp = fopen(path, "wb");
+	if (!fp)
+		return -1;
+	int rc = platform_file_sync(fp);
+	return fclose(fp) == 0 ? rc : -1;
+}
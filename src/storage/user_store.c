@@ -2,10 +2,19 @@
  * @file user_store.c
  * @brief 用户存储实现
  * 
- * 本文件实现了用户数据的存储和管理功能，使用链表结构存储用户信息。
+ * 本文件实现了用户数据的存储和管理功能。用户记录从定长对象池按块连续分配
+ * （指针在整个生命周期内保持稳定），另外维护用户名哈希索引和按用户ID直接寻址的
+ * 稠密表，查找与认证不随注册用户数增长。
+ *
+ * 打开用户库文件（user_store_open）后，已保存的用户直接使用文件映射中的记录和
+ * 预建的哈希桶，启动时不逐条载入；之后新增的用户照常放在对象池和内存索引中，
+ * 同时追加到日志。查找先查映射，再查内存索引。
  * 提供了用户创建、查找、添加、认证等功能。
  * 
- * 注意：当前实现使用明文密码存储，实际项目中应使用密码哈希。
+ * 密码不保存明文：每个用户有独立的盐，保存 PBKDF2-HMAC-SHA256 派生的摘要，
+ * 一次验证的耗时由迭代次数决定，服务器可以把登录放在专用的认证线程上执行。
+ * 验证通过的凭证在短时间内缓存（键为用户和加盐的口令摘要），
+ * 断线重连风暴中重复登录的用户不必再做一次慢速派生。
  * 
  * 主要功能：
  * 1. 用户创建与管理
@@ -20,19 +29,207 @@
 #include "storage.h"
 #include "../utils/utils.h"
 
+/* 摘要长度在 models.h 中单独定义，必须与 SHA-256 一致 */
+#if PASSWORD_HASH_LEN != SHA256_DIGEST_LEN
+#error "PASSWORD_HASH_LEN must equal SHA256_DIGEST_LEN"
+#endif
+
+/** 每个用户记录块包含的用户数 */
+#define USER_CHUNK_SIZE 256
+
+/** 用户ID起始值，ID连续分配，可直接换算为稠密表下标 */
+#define USER_ID_BASE 1000
+
 /**
- * @brief 全局用户链表头指针
- * 
- * 指向用户链表的第一个节点，所有用户信息都通过这个链表访问。
+ * @brief 用户记录池
+ *
+ * 用户按块连续存放，遍历和批量查找时有更好的缓存局部性；
+ * 块一经分配不再移动，外部持有的 User 指针始终有效。
  */
-static User *user_list_head = NULL;
+static ObjectPool user_pool = OBJECT_POOL_INITIALIZER("user", sizeof(User), USER_CHUNK_SIZE);
 
 /**
  * @brief 用户ID计数器
  * 
  * 用于为新注册的用户分配唯一ID，初始值为1000，每次分配后自动递增。
  */
-static int user_id_counter = 1000;
+static int user_id_counter = USER_ID_BASE;
+
+/**
+ * @brief 按 user_id - USER_ID_BASE 直接寻址的用户表
+ */
+static User **id_table = NULL;
+static size_t id_table_cap = 0;
+
+/** ID表第一项对应的用户ID，库文件中的用户不占用ID表 */
+static int id_table_base = USER_ID_BASE;
+
+/**
+ * @brief 用户名哈希索引
+ */
+static HashIndex username_index;
+
+/** 映射的用户库文件，未打开时为空 */
+static UserDb user_db;
+
+/** 用户库文件路径和新增用户的日志，未打开库文件时 journal 为NULL */
+static char db_path[MAX_FILENAME_LEN];
+static char journal_path[MAX_FILENAME_LEN + 8];
+static FILE *journal = NULL;
+
+/**
+ * @brief 当前用户总数
+ */
+static int users_count = 0;
+
+/** 新用户派生口令摘要时的迭代次数 */
+static unsigned int hash_iterations = PASSWORD_HASH_ITERATIONS;
+
+/**
+ * @brief 已验证凭证的缓存项
+ *
+ * key 为 SHA-256(进程盐 || 用户盐 || 口令)，只算一次哈希，不保存口令本身；
+ * 进程盐每次启动重新生成，缓存内容在进程之外没有意义。
+ */
+typedef struct
+{
+	int user_id;						/**< 所属用户，0 表示空 */
+	uint64_t expires_ms;				/**< 过期时刻（单调时钟毫秒） */
+	unsigned char key[SHA256_DIGEST_LEN]; /**< 加盐的口令摘要 */
+} CredentialCacheEntry;
+
+/** 按 user_id 直接映射的凭证缓存，认证线程并发读写，由 cache_lock 保护 */
+static CredentialCacheEntry credential_cache[CREDENTIAL_CACHE_SLOTS];
+static platform_mutex_t cache_lock = PLATFORM_MUTEX_INITIALIZER;
+static unsigned char cache_salt[SHA256_DIGEST_LEN];
+static int cache_salt_ready = 0;
+static atomic_size_t cache_hits = 0;
+
+/**
+ * @brief 生成一段盐
+ *
+ * 盐只需要各不相同，不需要保密：由用户名、ID、墙上时间、单调时钟和调用计数
+ * 一起做 SHA-256 得到，不依赖平台的随机数接口。
+ */
+static void make_salt(const char *tag, int id, unsigned char *out, size_t len)
+{
+	static atomic_uint salt_counter = 0;
+	unsigned char digest[SHA256_DIGEST_LEN];
+	Sha256Context ctx;
+	uint64_t now_us = platform_monotonic_us();
+	time_t now = time(NULL);
+	unsigned int seq = atomic_fetch_add(&salt_counter, 1);
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, tag, strlen(tag));
+	sha256_update(&ctx, &id, sizeof(id));
+	sha256_update(&ctx, &now, sizeof(now));
+	sha256_update(&ctx, &now_us, sizeof(now_us));
+	sha256_update(&ctx, &seq, sizeof(seq));
+	void *where = &ctx; /* 栈地址在启用 ASLR 时每次启动不同 */
+	sha256_update(&ctx, &where, sizeof(where));
+	sha256_final(&ctx, digest);
+	memcpy(out, digest, len < sizeof(digest) ? len : sizeof(digest));
+}
+
+/**
+ * @brief 计算凭证缓存的键
+ */
+static void credential_key(const User *user, const char *password, unsigned char key[SHA256_DIGEST_LEN])
+{
+	Sha256Context ctx;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, cache_salt, sizeof(cache_salt));
+	sha256_update(&ctx, user->password_salt, sizeof(user->password_salt));
+	sha256_update(&ctx, password, strlen(password));
+	sha256_final(&ctx, key);
+}
+
+/**
+ * @brief 查询凭证缓存
+ *
+ * @return int 缓存中有未过期的同一凭证返回1，否则返回0
+ */
+static int credential_cache_lookup(const User *user, const char *password)
+{
+	unsigned char key[SHA256_DIGEST_LEN];
+	int hit = 0;
+
+	platform_mutex_lock(&cache_lock);
+	if (cache_salt_ready)
+	{
+		CredentialCacheEntry *entry = &credential_cache[(unsigned)user->user_id % CREDENTIAL_CACHE_SLOTS];
+		if (entry->user_id == user->user_id && entry->expires_ms > platform_monotonic_ms())
+		{
+			credential_key(user, password, key);
+			hit = digest_equal(entry->key, key, sizeof(key));
+		}
+	}
+	platform_mutex_unlock(&cache_lock);
+
+	if (hit)
+		atomic_fetch_add(&cache_hits, 1);
+	return hit;
+}
+
+/**
+ * @brief 记录一次验证通过的凭证，覆盖同一槽位上的旧记录
+ */
+static void credential_cache_store(const User *user, const char *password)
+{
+	platform_mutex_lock(&cache_lock);
+	if (!cache_salt_ready)
+	{
+		make_salt("credential-cache", 0, cache_salt, sizeof(cache_salt));
+		cache_salt_ready = 1;
+	}
+	CredentialCacheEntry *entry = &credential_cache[(unsigned)user->user_id % CREDENTIAL_CACHE_SLOTS];
+	entry->user_id = user->user_id;
+	entry->expires_ms = platform_monotonic_ms() + CREDENTIAL_CACHE_TTL_MS;
+	credential_key(user, password, entry->key);
+	platform_mutex_unlock(&cache_lock);
+}
+
+/** 用户名键比较函数 */
+static int match_username(const void *value, const void *key)
+{
+	return strcmp(((const User *)value)->username, (const char *)key) == 0;
+}
+
+/**
+ * @brief 从记录块中取出一个空闲用户记录
+ *
+ * @return User* 成功返回已清零的记录，失败返回NULL
+ */
+static User *alloc_user_slot(void)
+{
+	return (User *)object_pool_alloc(&user_pool);
+}
+
+/**
+ * @brief 确保ID表能容纳指定下标
+ *
+ * @param slot ID表下标
+ * @return int 成功返回0，失败返回-1
+ */
+static int ensure_id_table(size_t slot)
+{
+	if (slot < id_table_cap)
+		return 0;
+
+	size_t new_cap = id_table_cap ? id_table_cap : USER_CHUNK_SIZE;
+	while (new_cap <= slot)
+		new_cap *= 2;
+
+	User **grown = (User **)realloc(id_table, new_cap * sizeof(User *));
+	if (!grown)
+		return -1;
+	memset(grown + id_table_cap, 0, (new_cap - id_table_cap) * sizeof(User *));
+	id_table = grown;
+	id_table_cap = new_cap;
+	return 0;
+}
 
 /**
  * @brief 创建新用户
@@ -46,27 +243,52 @@ static int user_id_counter = 1000;
  */
 static User *create_user(const char *username, const char *password)
 {
-	User *user = (User *)safe_malloc(sizeof(User));
+	if (ensure_id_table((size_t)(user_id_counter - id_table_base)) != 0)
+	{
+		LOG_ERROR("Failed to grow user id table");
+		return NULL;
+	}
+
+	User *user = alloc_user_slot();
 	if (!user)
 	{
 		LOG_ERROR("Failed to allocate memory for user");
 		return NULL;
 	}
 
-	memset(user, 0, sizeof(User));
 	safe_strcpy(user->username, username, sizeof(user->username));
-	safe_strcpy(user->password, password, sizeof(user->password));
 	user->user_id = user_id_counter++;
-	user->register_time = time(NULL);
+	user->password_iterations = hash_iterations;
+	make_salt(username, user->user_id, user->password_salt, sizeof(user->password_salt));
+	pbkdf2_sha256(password, strlen(password), user->password_salt, sizeof(user->password_salt),
+				  user->password_iterations, user->password_hash, sizeof(user->password_hash));
+	user->register_time = (int64_t)time(NULL);
 	user->is_active = 1;
 
 	return user;
 }
 
+/**
+ * @brief 把用户登记到用户名索引和ID表
+ *
+ * @param user 对象池中的用户记录，ID不小于 id_table_base
+ * @return int 成功返回0，失败返回-1
+ */
+static int index_user(User *user)
+{
+	if (user->user_id < id_table_base || ensure_id_table((size_t)(user->user_id - id_table_base)) != 0 ||
+		hash_index_insert(&username_index, hash_index_hash_string(user->username, MAX_USERNAME_LEN), user) != 0)
+		return -1;
+
+	id_table[user->user_id - id_table_base] = user;
+	users_count++;
+	return 0;
+}
+
 /**
  * @brief 根据用户名查找用户
  * 
- * 遍历用户链表，查找具有指定用户名的用户。
+ * 先在用户库文件的预建哈希桶上查找，再查内存中的用户名哈希索引。
  * 
  * @param username 要查找的用户名
  * @return User* 找到返回用户结构体指针，未找到返回NULL
@@ -76,57 +298,45 @@ User *user_store_find_by_username(const char *username)
 	if (!username)
 		return NULL;
 
-	User *current = user_list_head;
-	while (current != NULL)
-	{
-		if (strcmp(current->username, username) == 0)
-		{
-			return current;
-		}
-		current = current->next;
-	}
+	/* 映射是只读的，调用方不会修改返回的记录 */
+	const User *saved = user_db_find(&user_db, username);
+	if (saved)
+		return (User *)saved;
 
-	return NULL;
+	return (User *)hash_index_find(&username_index,
+								   hash_index_hash_string(username, MAX_USERNAME_LEN),
+								   username, match_username);
 }
 
 /**
  * @brief 根据用户ID查找用户
  * 
- * 遍历用户链表，查找具有指定用户ID的用户。
+ * 用户ID连续分配：库文件中的用户按记录偏移直接取，之后新增的用户换算为ID表下标。
  * 
  * @param user_id 要查找的用户ID
  * @return User* 找到返回用户结构体指针，未找到返回NULL
  */
 User *user_store_find_by_id(int user_id)
 {
-	User *current = user_list_head;
-	while (current != NULL)
-	{
-		if (current->user_id == user_id)
-		{
-			return current;
-		}
-		current = current->next;
-	}
+	const User *saved = user_db_find_by_id(&user_db, user_id);
+	if (saved)
+		return (User *)saved;
 
-	return NULL;
+	if (user_id < id_table_base || (size_t)(user_id - id_table_base) >= id_table_cap)
+		return NULL;
+
+	return id_table[user_id - id_table_base];
 }
 
 /**
- * @brief 添加用户
- * 
- * 根据提供的用户名和密码添加新用户到存储中。
- * 添加流程包括：
- * 1. 验证参数有效性
- * 2. 检查用户是否已存在
- * 3. 创建新用户
- * 4. 将用户添加到链表头部
- * 
+ * @brief 添加用户并在打开了库文件时写入日志
+ *
  * @param username 用户名
  * @param password 密码
+ * @param sync 非0时日志写入后立即同步到磁盘
  * @return int 成功返回1，失败返回0
  */
-int user_store_add(const char *username, const char *password)
+static int add_user(const char *username, const char *password, int sync)
 {
 	if (!username || !password)
 	{
@@ -148,14 +358,44 @@ int user_store_add(const char *username, const char *password)
 		return 0;
 	}
 
-	// 添加到链表头部
-	user->next = user_list_head;
-	user_list_head = user;
+	// 登记到索引
+	if (index_user(user) != 0)
+	{
+		LOG_ERROR("Failed to index user: %s", username);
+		memset(user, 0, sizeof(User));
+		return 0;
+	}
+
+	// 追加到日志，写入失败时用户仍可使用，只是重启后丢失
+	if (journal && user_journal_append(journal, user, sync) != 0)
+	{
+		LOG_WARN("Failed to journal user %s to %s", username, journal_path);
+	}
 
 	LOG_INFO("User added: %s (id=%d)", username, user->user_id);
 	return 1;
 }
 
+/**
+ * @brief 添加用户
+ * 
+ * 根据提供的用户名和密码添加新用户到存储中。
+ * 添加流程包括：
+ * 1. 验证参数有效性
+ * 2. 检查用户是否已存在
+ * 3. 创建新用户
+ * 4. 登记到用户名索引和ID表
+ * 5. 打开了用户库文件时追加到日志并同步
+ * 
+ * @param username 用户名
+ * @param password 密码
+ * @return int 成功返回1，失败返回0
+ */
+int user_store_add(const char *username, const char *password)
+{
+	return add_user(username, password, 1);
+}
+
 /**
  * @brief 用户认证
  * 
@@ -163,9 +403,10 @@ int user_store_add(const char *username, const char *password)
  * 认证流程包括：
  * 1. 查找用户
  * 2. 检查用户是否激活
- * 3. 验证密码
+ * 3. 查询凭证缓存，命中则直接通过
+ * 4. 用用户的盐和迭代次数派生摘要并比较，通过后写入缓存
  * 
- * 注意：当前实现使用明文密码比较，实际项目中应使用密码哈希。
+ * 第4步是慢速操作，服务器在认证线程上调用本函数；可被多个线程同时调用。
  * 
  * @param username 用户名
  * @param password 密码
@@ -191,9 +432,18 @@ int user_store_authenticate(const char *username, const char *password)
 		return 0;
 	}
 
-	// 简单密码比较（实际项目应该使用哈希）
-	if (strcmp(user->password, password) == 0)
+	if (credential_cache_lookup(user, password))
 	{
+		LOG_DEBUG("User authenticated from credential cache: %s", username);
+		return 1;
+	}
+
+	unsigned char derived[PASSWORD_HASH_LEN];
+	if (pbkdf2_sha256(password, strlen(password), user->password_salt, sizeof(user->password_salt),
+					  user->password_iterations, derived, sizeof(derived)) == 0 &&
+		digest_equal(derived, user->password_hash, sizeof(derived)))
+	{
+		credential_cache_store(user, password);
 		LOG_INFO("User authenticated: %s", username);
 		return 1;
 	}
@@ -202,6 +452,29 @@ int user_store_authenticate(const char *username, const char *password)
 	return 0;
 }
 
+/**
+ * @brief 设置之后添加的用户派生口令摘要时的迭代次数
+ *
+ * 已有用户保留各自注册时的迭代次数，验证不受影响。
+ * 测试批量注册用户时可调低以缩短耗时。
+ *
+ * @param iterations 迭代次数，0 恢复默认的 PASSWORD_HASH_ITERATIONS
+ */
+void user_store_set_hash_iterations(unsigned int iterations)
+{
+	hash_iterations = iterations > 0 ? iterations : PASSWORD_HASH_ITERATIONS;
+}
+
+/**
+ * @brief 获取凭证缓存的命中次数
+ *
+ * @return size_t 免去慢速派生的认证次数
+ */
+size_t user_store_credential_cache_hits(void)
+{
+	return atomic_load(&cache_hits);
+}
+
 /**
  * @brief 初始化默认用户（用于测试）
  * 
@@ -218,48 +491,258 @@ void user_store_init_defaults(void)
 	LOG_INFO("Initialized default users");
 }
 
+/**
+ * @brief 添加一批合成用户（用于压力测试）
+ *
+ * 用户名为 prefix 加序号（bench0、bench1……），密码与默认用户相同，
+ * 为用户名加 "123"。负载生成器按同样的规则登录。
+ * 已存在的用户（如上次启动时保存到库文件的）直接跳过；日志只在最后同步一次。
+ *
+ * @param prefix 用户名前缀
+ * @param count 用户数
+ * @return int 实际添加的用户数
+ */
+int user_store_init_synthetic(const char *prefix, int count)
+{
+	char username[MAX_PASSWORD_LEN - 3]; /* 留出密码后缀 "123" 的位置 */
+	char password[MAX_PASSWORD_LEN];
+	int added = 0;
+
+	if (!prefix)
+		return 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		snprintf(username, sizeof(username), "%s%d", prefix, i);
+		if (user_store_find_by_username(username))
+			continue;
+		snprintf(password, sizeof(password), "%s123", username);
+		added += add_user(username, password, 0);
+	}
+	if (added > 0 && journal)
+		user_journal_sync(journal);
+
+	LOG_INFO("Initialized %d synthetic users (%s0..%s%d)", added, prefix, prefix, count - 1);
+	return added;
+}
+
+/**
+ * @brief 重放日志时登记一条记录
+ *
+ * 库文件中已有的用户跳过（合并进库文件后、清空日志前崩溃时会出现）。
+ */
+static void replay_user(const User *saved, void *ctx)
+{
+	int *replayed = (int *)ctx;
+
+	if (user_store_find_by_username(saved->username) || user_store_find_by_id(saved->user_id))
+		return;
+
+	User *user = alloc_user_slot();
+	if (!user)
+		return;
+	memcpy(user, saved, sizeof(User));
+	if (index_user(user) != 0)
+	{
+		LOG_WARN("Skipping journaled user %s (id=%d)", saved->username, saved->user_id);
+		memset(user, 0, sizeof(User));
+		return;
+	}
+	if (user->user_id >= user_id_counter)
+		user_id_counter = user->user_id + 1;
+	(*replayed)++;
+}
+
+/**
+ * @brief 打开用户库文件
+ *
+ * 映射库文件并校验文件头，已保存的用户直接在映射上查找，不逐条载入；
+ * 再重放日志中之后新增的用户。日志达到 USER_JOURNAL_COMPACT_RECORDS 条
+ * 或尾部不完整时合并进库文件。之后 user_store_add 新增的用户追加到日志。
+ * 必须在添加任何用户之前调用。
+ *
+ * @param path 库文件路径，日志为 path 加 ".journal"
+ * @return int 成功返回0；库文件无效时返回-1，不覆盖原文件，用户只保存在内存中
+ */
+int user_store_open(const char *path)
+{
+	if (!path || users_count > 0 || journal)
+		return -1;
+
+	safe_strcpy(db_path, path, sizeof(db_path));
+	snprintf(journal_path, sizeof(journal_path), "%s.journal", db_path);
+
+	int mapped = user_db_map(db_path, &user_db);
+	if (mapped < 0)
+	{
+		LOG_ERROR("User database %s is invalid, keeping users in memory only", db_path);
+		db_path[0] = '\0';
+		return -1;
+	}
+	/* 日志中的用户都在库文件写出之后分配ID，不小于库文件记录的下一个ID */
+	id_table_base = mapped == 0 ? user_db.next_user_id : USER_ID_BASE;
+	if (id_table_base > user_id_counter)
+		user_id_counter = id_table_base;
+	users_count = (int)user_db.count;
+
+	int torn = 0;
+	int replayed = 0;
+	int entries = user_journal_replay(journal_path, replay_user, &replayed, &torn);
+	LOG_INFO("User database %s: %u mapped users, %d journaled", db_path, user_db.count, replayed);
+
+	if (torn)
+		LOG_WARN("User journal %s has an incomplete tail, compacting", journal_path);
+	if ((torn || entries >= USER_JOURNAL_COMPACT_RECORDS) && user_store_compact() != 0)
+		LOG_WARN("Failed to compact user database %s", db_path);
+
+	journal = user_journal_open(journal_path);
+	if (!journal)
+	{
+		LOG_WARN("Failed to open user journal %s, new users will not persist", journal_path);
+	}
+	return 0;
+}
+
+/**
+ * @brief 把日志合并进用户库文件
+ *
+ * 写出全部用户和新的哈希桶，替换库文件后重新映射并清空日志，内存中的用户随之释放。
+ * 之前取得的 User 指针全部失效，只能在没有其他线程访问用户存储时调用（启动期间）。
+ *
+ * @return int 成功返回0，未打开库文件或写入失败返回-1
+ */
+int user_store_compact(void)
+{
+	if (db_path[0] == '\0')
+		return -1;
+
+	size_t extra = (size_t)(user_id_counter - id_table_base);
+	if (extra > id_table_cap)
+		extra = id_table_cap;
+	if (user_db_write(db_path, user_db.records, user_db.count, id_table, extra, user_id_counter) != 0)
+		return -1;
+
+	/* 写临时文件期间仍使用旧映射中的记录；替换前解除映射（Windows 上映射中的文件不能被替换） */
+	user_db_unmap(&user_db);
+	if (user_db_commit(db_path) != 0)
+	{
+		user_db_map(db_path, &user_db);
+		return -1;
+	}
+
+	object_pool_destroy(&user_pool);
+	safe_free((void **)&id_table);
+	id_table_cap = 0;
+	hash_index_free(&username_index);
+	id_table_base = user_id_counter;
+	users_count = 0;
+	if (user_db_map(db_path, &user_db) != 0)
+	{
+		LOG_ERROR("Failed to map compacted user database %s", db_path);
+		return -1;
+	}
+	users_count = (int)user_db.count;
+
+	int reopen = journal != NULL;
+	if (journal)
+	{
+		fclose(journal);
+		journal = NULL;
+	}
+	if (user_journal_reset(journal_path) != 0)
+		LOG_WARN("Failed to reset user journal %s", journal_path);
+	if (reopen)
+		journal = user_journal_open(journal_path);
+
+	LOG_INFO("User database %s compacted: %u users", db_path, user_db.count);
+	return 0;
+}
+
+/**
+ * @brief 获取映射的用户库文件中的用户数
+ *
+ * @return size_t 库文件中的用户数，未打开库文件时为0
+ */
+size_t user_store_mapped_count(void)
+{
+	return user_db.count;
+}
+
 /**
  * @brief 获取用户数量
  * 
- * 遍历用户链表，统计当前存储的用户总数。
- * 
  * @return int 用户总数
  */
 int user_store_count(void)
 {
-	int count = 0;
-	User *current = user_list_head;
-
-	while (current != NULL)
-	{
-		count++;
-		current = current->next;
-	}
+	return users_count;
+}
 
-	return count;
+/**
+ * @brief 获取用户记录池的使用数和峰值
+ *
+ * @param high_water 输出峰值，可为NULL
+ * @return size_t 使用中的用户记录数
+ */
+size_t user_store_pool_usage(size_t *high_water)
+{
+	if (high_water)
+		*high_water = object_pool_high_water(&user_pool);
+	return object_pool_in_use(&user_pool);
 }
 
 /**
  * @brief 打印所有用户（调试用）
  * 
- * 遍历用户链表，打印每个用户的详细信息，
+ * 按用户ID顺序打印每个用户的详细信息，
  * 包括ID、用户名、注册时间和激活状态。
  */
 void user_store_print_all(void)
 {
 	printf("=== Registered Users (%d) ===\n", user_store_count());
 
-	User *current = user_list_head;
-	while (current != NULL)
+	for (int id = USER_ID_BASE; id < user_id_counter; id++)
 	{
+		User *current = user_store_find_by_id(id);
+		if (!current)
+			continue;
+
 		char time_buf[32];
-		strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S",
-				 localtime(&current->register_time));
+		format_timestamp((time_t)current->register_time, time_buf, sizeof(time_buf));
+		if (time_buf[0] == '\0')
+			safe_strcpy(time_buf, "unknown", sizeof(time_buf));
 
 		printf("ID: %d, Username: %s, Registered: %s, Active: %s\n",
 			   current->user_id, current->username,
 			   time_buf, current->is_active ? "Yes" : "No");
-		current = current->next;
 	}
 	printf("==============================\n");
 }
+
+/**
+ * @brief 释放所有用户记录和索引，关闭用户库文件和日志
+ *
+ * 之后取得的 User 指针全部失效。ID计数器不回退，保证ID不被复用。
+ */
+void user_store_cleanup(void)
+{
+	object_pool_destroy(&user_pool);
+
+	safe_free((void **)&id_table);
+	id_table_cap = 0;
+	hash_index_free(&username_index);
+	users_count = 0;
+	id_table_base = user_id_counter;
+
+	user_db_unmap(&user_db);
+	if (journal)
+	{
+		fclose(journal);
+		journal = NULL;
+	}
+	db_path[0] = '\0';
+
+	platform_mutex_lock(&cache_lock);
+	memset(credential_cache, 0, sizeof(credential_cache));
+	platform_mutex_unlock(&cache_lock);
+}
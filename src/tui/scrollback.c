@@ -0,0 +1,254 @@
+/**
+ * @file scrollback.c
+ * @brief TUI 消息区的回滚缓冲和视口
+ *
+ * 每行单独分配，环满后释放最旧的一行再放入新行。行的显示宽度在追加时算好，
+ * 绘制时按终端列数换算成行数，只需要从视口底部往上累加到填满为止。
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "scrollback.h"
+
+/**
+ * @brief 判断码点是否为双列宽的东亚字符
+ */
+static int wide_codepoint(uint32_t cp)
+{
+	return (cp >= 0x1100 && cp <= 0x115F) || (cp >= 0x2E80 && cp <= 0xA4CF) || (cp >= 0xAC00 && cp <= 0xD7A3) ||
+		   (cp >= 0xF900 && cp <= 0xFAFF) || (cp >= 0xFE30 && cp <= 0xFE4F) || (cp >= 0xFF00 && cp <= 0xFF60) ||
+		   (cp >= 0xFFE0 && cp <= 0xFFE6) || (cp >= 0x1F300 && cp <= 0x1FAFF) || (cp >= 0x20000 && cp <= 0x3FFFD);
+}
+
+/**
+ * @brief 计算 UTF-8 文本的显示宽度
+ *
+ * 控制字符不占列，东亚宽字符占2列，无效字节按1列计。
+ */
+size_t scrollback_text_width(const char *text, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)text;
+	const unsigned char *end = p + len;
+	size_t width = 0;
+
+	while (p < end)
+	{
+		uint32_t cp = *p;
+		int extra = cp >= 0xF0 ? 3 : cp >= 0xE0 ? 2 : cp >= 0xC0 ? 1 : 0;
+
+		if (extra > 0 && p + extra < end)
+		{
+			cp &= 0x3F >> extra;
+			for (int i = 1; i <= extra; i++)
+				cp = (cp << 6) | (p[i] & 0x3F);
+		}
+		else
+		{
+			extra = 0;
+		}
+		p += 1 + extra;
+		if (cp < 0x20 || cp == 0x7F)
+			continue;
+		width += wide_codepoint(cp) ? 2 : 1;
+	}
+	return width;
+}
+
+/**
+ * @brief 截断到不超过 limit 字节的 UTF-8 字符边界
+ */
+static size_t utf8_clip(const char *text, size_t len, size_t limit)
+{
+	if (len <= limit)
+		return len;
+	while (limit > 0 && ((unsigned char)text[limit] & 0xC0) == 0x80)
+		limit--;
+	return limit;
+}
+
+/**
+ * @brief 初始化回滚缓冲
+ *
+ * @param sb 缓冲指针
+ * @param capacity 最多保留的行数，不大于0时使用 SCROLLBACK_DEFAULT_LINES
+ * @return int 成功返回0，内存不足返回-1
+ */
+int scrollback_init(Scrollback *sb, int capacity)
+{
+	memset(sb, 0, sizeof(*sb));
+	sb->capacity = capacity > 0 ? capacity : SCROLLBACK_DEFAULT_LINES;
+	sb->lines = (ScrollbackLine *)calloc((size_t)sb->capacity, sizeof(ScrollbackLine));
+	if (!sb->lines)
+		return -1;
+	sb->full_damage = 1;
+	return 0;
+}
+
+/**
+ * @brief 释放所有行
+ */
+void scrollback_free(Scrollback *sb)
+{
+	scrollback_clear(sb);
+	free(sb->lines);
+	sb->lines = NULL;
+	sb->capacity = 0;
+}
+
+/**
+ * @brief 丢弃所有行，视口回到底部并整体重绘
+ */
+void scrollback_clear(Scrollback *sb)
+{
+	for (int i = 0; sb->lines && i < sb->capacity; i++)
+	{
+		free(sb->lines[i].text);
+		sb->lines[i].text = NULL;
+	}
+	sb->count = 0;
+	sb->offset = 0;
+	sb->full_damage = 1;
+}
+
+/**
+ * @brief 追加一行，环满时覆盖最旧的行
+ */
+static int push_line(Scrollback *sb, const char *prefix, size_t prefix_len, const char *text, size_t len, int color)
+{
+	size_t sep = prefix_len ? 2 : 0;
+
+	len = utf8_clip(text, len, SCROLLBACK_MAX_LINE - prefix_len - sep);
+	char *copy = (char *)malloc(prefix_len + sep + len + 1);
+	if (!copy)
+		return -1;
+	memcpy(copy, prefix, prefix_len);
+	memcpy(copy + prefix_len, ": ", sep);
+	memcpy(copy + prefix_len + sep, text, len);
+	copy[prefix_len + sep + len] = '\0';
+
+	ScrollbackLine *line = &sb->lines[sb->next % (uint64_t)sb->capacity];
+	free(line->text);
+	line->text = copy;
+	line->prefix = (uint16_t)prefix_len;
+	size_t width = scrollback_text_width(copy, prefix_len + sep + len);
+	line->width = (uint16_t)(width > UINT16_MAX ? UINT16_MAX : width);
+	line->color = (uint8_t)color;
+
+	sb->next++;
+	if (sb->count < sb->capacity)
+		sb->count++;
+	return 0;
+}
+
+/**
+ * @brief 追加一条消息
+ *
+ * 消息中的换行拆成多行，只有第一行带前缀。不访问终端，可在任何线程上调用（由调用者加锁）。
+ * 视口上翻时随新行一起上移，停在原来的内容上。
+ *
+ * @param sb 缓冲指针
+ * @param prefix 前缀（发送者），NULL 或空串表示没有前缀
+ * @param text 正文
+ * @param color 前缀使用的颜色对
+ * @return int 追加的行数
+ */
+int scrollback_append(Scrollback *sb, const char *prefix, const char *text, int color)
+{
+	size_t prefix_len = prefix ? strlen(prefix) : 0;
+	const char *p = text ? text : "";
+	int added = 0;
+
+	if (!sb->lines)
+		return 0;
+	if (prefix_len > SCROLLBACK_MAX_LINE / 2)
+		prefix_len = utf8_clip(prefix, prefix_len, SCROLLBACK_MAX_LINE / 2);
+
+	for (;;)
+	{
+		const char *newline = strchr(p, '\n');
+		size_t len = newline ? (size_t)(newline - p) : strlen(p);
+		if (len > 0 && p[len - 1] == '\r')
+			len--;
+		if (push_line(sb, added ? "" : prefix, added ? 0 : prefix_len, p, len, color) != 0)
+			break;
+		added++;
+		if (!newline)
+			break;
+		p = newline + 1;
+	}
+
+	if (sb->offset > 0)
+	{
+		sb->offset += added;
+		if (sb->offset > sb->count - 1)
+			sb->offset = sb->count - 1;
+		sb->full_damage = 1;
+	}
+	return added;
+}
+
+/**
+ * @brief 按行号取一行，已被覆盖或尚未写入时返回 NULL
+ */
+const ScrollbackLine *scrollback_line(const Scrollback *sb, uint64_t number)
+{
+	if (number < scrollback_first(sb) || number >= sb->next)
+		return NULL;
+	return &sb->lines[number % (uint64_t)sb->capacity];
+}
+
+/**
+ * @brief 返回仍保留的最旧一行的行号
+ */
+uint64_t scrollback_first(const Scrollback *sb)
+{
+	return sb->next - (uint64_t)sb->count;
+}
+
+/**
+ * @brief 移动视口，正数向旧消息方向
+ *
+ * @param sb 缓冲指针
+ * @param lines 移动的行数
+ */
+void scrollback_scroll(Scrollback *sb, int lines)
+{
+	int offset = sb->offset + lines;
+
+	if (offset > sb->count - 1)
+		offset = sb->count - 1;
+	if (offset < 0)
+		offset = 0;
+	if (offset != sb->offset)
+	{
+		sb->offset = offset;
+		sb->full_damage = 1;
+	}
+}
+
+/**
+ * @brief 一行在 cols 列宽的窗口中折行后占用的行数
+ */
+int scrollback_line_rows(const ScrollbackLine *line, int cols)
+{
+	if (cols <= 0 || line->width == 0)
+		return 1;
+	return (line->width + cols - 1) / cols;
+}
+
+/**
+ * @brief 判断上次绘制后是否有变化
+ */
+int scrollback_damaged(const Scrollback *sb)
+{
+	return sb->full_damage || sb->drawn != sb->next;
+}
+
+/**
+ * @brief 绘制完成后清除损坏记录
+ */
+void scrollback_mark_drawn(Scrollback *sb)
+{
+	sb->drawn = sb->next;
+	sb->full_damage = 0;
+}
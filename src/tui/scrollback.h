@@ -0,0 +1,61 @@
+/**
+ * @file scrollback.h
+ * @brief TUI 消息区的回滚缓冲和视口
+ *
+ * 收到的行追加到定长的环形缓冲中，写满后覆盖最旧的行，内存有上限。
+ * 追加只记录损坏范围，不碰终端；由界面线程按帧率统一绘制，
+ * 绘制时只遍历视口内可见的行，与缓冲中的总行数无关。
+ * 与具体的 curses 实现无关，两个后端共用。
+ */
+
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCROLLBACK_DEFAULT_LINES 5000 /**< 默认保留的行数 */
+#define SCROLLBACK_MAX_LINE 4096	  /**< 单行最多保留的字节数，超出部分截断 */
+
+/**
+ * @brief 回滚缓冲中的一行
+ */
+typedef struct
+{
+	char *text;		   /**< 前缀和正文，以空字符结尾 */
+	uint16_t prefix;   /**< 前缀（发送者）的字节数，0 表示没有前缀或为续行 */
+	uint16_t width;	   /**< 显示宽度（列数），宽字符计为2列 */
+	uint8_t color;	   /**< 前缀使用的颜色对 */
+} ScrollbackLine;
+
+/**
+ * @brief 行的环形缓冲和当前视口
+ *
+ * 行号从缓冲建立起单调递增，环中保留最近 capacity 行。
+ * offset 为视口底部距最新一行的行数，0 表示跟随最新消息；
+ * 上翻时有新行到达，offset 随之增加，视口停在原处。
+ */
+typedef struct
+{
+	ScrollbackLine *lines; /**< 行数组，下标为行号对 capacity 取模 */
+	int capacity;		   /**< 最多保留的行数 */
+	int count;			   /**< 当前保留的行数 */
+	uint64_t next;		   /**< 下一行的行号 */
+	int offset;			   /**< 视口底部距最新一行的行数 */
+	uint64_t drawn;		   /**< 上次绘制时的 next，此后追加的行为损坏范围 */
+	int full_damage;	   /**< 非0时视口须整体重绘（清空、滚动、改变尺寸） */
+} Scrollback;
+
+int scrollback_init(Scrollback *sb, int capacity);
+void scrollback_free(Scrollback *sb);
+void scrollback_clear(Scrollback *sb);
+int scrollback_append(Scrollback *sb, const char *prefix, const char *text, int color);
+const ScrollbackLine *scrollback_line(const Scrollback *sb, uint64_t number);
+uint64_t scrollback_first(const Scrollback *sb);
+void scrollback_scroll(Scrollback *sb, int lines);
+int scrollback_line_rows(const ScrollbackLine *line, int cols);
+int scrollback_damaged(const Scrollback *sb);
+void scrollback_mark_drawn(Scrollback *sb);
+size_t scrollback_text_width(const char *text, size_t len);
+
+#endif /* SCROLLBACK_H */
@@ -1,16 +1,25 @@
 #ifndef _WIN32
 
 #include "tui.h"
+#include "scrollback.h"
 #include "../platform/platform.h"
 #include "../utils/utils.h"
 #include <curses.h>
 #include <locale.h>
 #include <string.h>
 
+/* 消息区最多每这么多毫秒重绘一次，期间到达的消息合并到一帧 */
+#define TUI_FRAME_MS 33
+#define TUI_INPUT_MAX 1024
+
+/* 接收线程只把消息放进回滚缓冲并记下损坏，所有 curses 调用都在读输入的线程上按帧进行 */
 static WINDOW *status_win;
 static WINDOW *message_win;
 static WINDOW *input_win;
 static char current_status[256];
+static int status_damaged;
+static Scrollback scrollback;
+static uint64_t last_frame_ms;
 static platform_mutex_t tui_lock = PLATFORM_MUTEX_INITIALIZER;
 
 static void destroy_windows(void)
@@ -34,6 +43,8 @@ static void destroy_windows(void)
 
 static void draw_status_locked(void)
 {
+	char scrolled[64];
+
 	if (!status_win)
 	{
 		return;
@@ -45,8 +56,14 @@ static void draw_status_locked(void)
 		wbkgd(status_win, COLOR_PAIR(2));
 	}
 	mvwprintw(status_win, 0, 0, "%s", current_status[0] ? current_status : "ITit TUI");
+	if (scrollback.offset > 0)
+	{
+		snprintf(scrolled, sizeof(scrolled), " [+%d below, End]", scrollback.offset);
+		wprintw(status_win, "%s", scrolled);
+	}
 	wclrtoeol(status_win);
-	wrefresh(status_win);
+	wnoutrefresh(status_win);
+	status_damaged = 0;
 }
 
 static void create_layout_locked(void)
@@ -71,59 +88,164 @@ static void create_layout_locked(void)
 	message_win = newwin(message_rows, cols, 1, 0);
 	input_win = newwin(1, cols, rows - 1, 0);
 
-	scrollok(message_win, TRUE);
+	/* 只在批量滚动时临时打开，写满最后一格时不会意外滚屏 */
+	scrollok(message_win, FALSE);
 	keypad(input_win, TRUE);
-	draw_status_locked();
-	wrefresh(message_win);
-	wrefresh(input_win);
+	wtimeout(input_win, TUI_FRAME_MS);
+	scrollback.full_damage = 1;
+	status_damaged = 1;
 }
 
-static void write_text_locked(const char *text)
+/* 从第 y 行开始画一行，超出窗口的部分被裁掉 */
+static void draw_line_locked(int y, const ScrollbackLine *line)
 {
-	const char *p = text ? text : "";
-	const char *newline;
-
-	while (*p)
+	if (y < 0)
 	{
-		newline = strchr(p, '\n');
-		if (newline)
+		y = 0;
+	}
+	wmove(message_win, y, 0);
+	if (line->prefix > 0)
+	{
+		if (has_colors() && line->color > 0)
 		{
-			waddnstr(message_win, p, (int)(newline - p));
-			waddch(message_win, '\n');
-			p = newline + 1;
+			wattron(message_win, COLOR_PAIR(line->color));
 		}
-		else
+		waddnstr(message_win, line->text, line->prefix);
+		if (has_colors() && line->color > 0)
 		{
-			waddstr(message_win, p);
-			break;
+			wattroff(message_win, COLOR_PAIR(line->color));
 		}
 	}
-	waddch(message_win, '\n');
-	wrefresh(message_win);
+	waddstr(message_win, line->text + line->prefix);
 }
 
-static void draw_line_locked(const char *prefix, const char *message, int color_pair)
+/* 整体重绘视口：从视口底部的行往上累加到填满窗口，只访问可见的行 */
+static void draw_viewport_locked(int rows, int cols)
 {
-	if (!message_win)
+	uint64_t first = scrollback_first(&scrollback);
+	uint64_t bottom;
+	uint64_t top;
+	int used = 0;
+
+	werase(message_win);
+	if (scrollback.count == 0)
 	{
 		return;
 	}
 
-	if (prefix && prefix[0] != '\0')
+	bottom = scrollback.next - 1 - (uint64_t)scrollback.offset;
+	top = bottom + 1;
+	while (top > first && used < rows)
 	{
-		if (has_colors() && color_pair > 0)
+		int line_rows = scrollback_line_rows(scrollback_line(&scrollback, top - 1), cols);
+		if (used > 0 && used + line_rows > rows)
 		{
-			wattron(message_win, COLOR_PAIR(color_pair));
+			break;
 		}
-		wprintw(message_win, "%s", prefix);
-		if (has_colors() && color_pair > 0)
+		used += line_rows;
+		top--;
+	}
+
+	int y = rows - used;
+	for (uint64_t n = top; n <= bottom; n++)
+	{
+		const ScrollbackLine *line = scrollback_line(&scrollback, n);
+		draw_line_locked(y, line);
+		y += scrollback_line_rows(line, cols);
+	}
+}
+
+/* 跟随最新消息且只有新增的行时，把窗口上滚新行占用的行数，只画新行 */
+static int draw_appended_locked(int rows, int cols)
+{
+	uint64_t from = scrollback.drawn;
+	int height = 0;
+
+	if (scrollback.full_damage || scrollback.offset != 0 || from < scrollback_first(&scrollback))
+	{
+		return -1;
+	}
+	for (uint64_t n = from; n < scrollback.next; n++)
+	{
+		height += scrollback_line_rows(scrollback_line(&scrollback, n), cols);
+		if (height >= rows)
 		{
-			wattroff(message_win, COLOR_PAIR(color_pair));
+			return -1;
 		}
-		wprintw(message_win, ": ");
 	}
 
-	write_text_locked(message);
+	scrollok(message_win, TRUE);
+	wscrl(message_win, height);
+	scrollok(message_win, FALSE);
+
+	int y = rows - height;
+	for (uint64_t n = from; n < scrollback.next; n++)
+	{
+		const ScrollbackLine *line = scrollback_line(&scrollback, n);
+		draw_line_locked(y, line);
+		y += scrollback_line_rows(line, cols);
+	}
+	return 0;
+}
+
+/* 距上一帧满 TUI_FRAME_MS 时把损坏的部分画到虚拟屏幕上，返回是否画了 */
+static int render_frame_locked(void)
+{
+	int rows;
+	int cols;
+	uint64_t now = platform_monotonic_ms();
+
+	if (!message_win || now - last_frame_ms < TUI_FRAME_MS)
+	{
+		return 0;
+	}
+	if (!scrollback_damaged(&scrollback) && !status_damaged)
+	{
+		return 0;
+	}
+
+	getmaxyx(message_win, rows, cols);
+	if (scrollback_damaged(&scrollback))
+	{
+		if (scrollback.full_damage)
+		{
+			status_damaged = 1;
+		}
+		if (draw_appended_locked(rows, cols) != 0)
+		{
+			draw_viewport_locked(rows, cols);
+		}
+		scrollback_mark_drawn(&scrollback);
+		wnoutrefresh(message_win);
+	}
+	if (status_damaged)
+	{
+		draw_status_locked();
+	}
+	last_frame_ms = now;
+	return 1;
+}
+
+/* 画输入栏，内容过长时只显示末尾能放下的部分，光标留在输入栏 */
+static void draw_input(const char *line, size_t len)
+{
+	int cols = getmaxx(input_win);
+	size_t start = 0;
+
+	while (start < len && (int)scrollback_text_width(line + start, len - start) > cols - 3)
+	{
+		start++;
+		while (start < len && ((unsigned char)line[start] & 0xC0) == 0x80)
+		{
+			start++;
+		}
+	}
+
+	werase(input_win);
+	mvwprintw(input_win, 0, 0, "> ");
+	waddnstr(input_win, line + start, (int)(len - start));
+	wclrtoeol(input_win);
+	wnoutrefresh(input_win);
 }
 
 int tui_init(void)
@@ -145,6 +267,12 @@ int tui_init(void)
 	}
 
 	platform_mutex_lock(&tui_lock);
+	if (scrollback_init(&scrollback, SCROLLBACK_DEFAULT_LINES) != 0)
+	{
+		platform_mutex_unlock(&tui_lock);
+		endwin();
+		return -1;
+	}
 	create_layout_locked();
 	platform_mutex_unlock(&tui_lock);
 	return 0;
@@ -154,6 +282,7 @@ void tui_shutdown(void)
 {
 	platform_mutex_lock(&tui_lock);
 	destroy_windows();
+	scrollback_free(&scrollback);
 	platform_mutex_unlock(&tui_lock);
 	endwin();
 }
@@ -161,8 +290,7 @@ void tui_shutdown(void)
 void tui_clear(void)
 {
 	platform_mutex_lock(&tui_lock);
-	werase(message_win);
-	wrefresh(message_win);
+	scrollback_clear(&scrollback);
 	platform_mutex_unlock(&tui_lock);
 }
 
@@ -170,39 +298,43 @@ void tui_set_status(const char *status)
 {
 	platform_mutex_lock(&tui_lock);
 	safe_strcpy(current_status, status ? status : "", sizeof(current_status));
-	draw_status_locked();
+	status_damaged = 1;
 	platform_mutex_unlock(&tui_lock);
 }
 
 void tui_draw_system(const char *message)
 {
 	platform_mutex_lock(&tui_lock);
-	draw_line_locked("system", message, 4);
+	scrollback_append(&scrollback, "system", message, 4);
 	platform_mutex_unlock(&tui_lock);
 }
 
 void tui_draw_error(const char *message)
 {
 	platform_mutex_lock(&tui_lock);
-	draw_line_locked("error", message, 3);
+	scrollback_append(&scrollback, "error", message, 3);
 	platform_mutex_unlock(&tui_lock);
 }
 
 void tui_draw_help(void)
 {
-	tui_draw_system("c [ip] [port] | l <user> <pass> | to <user> | text | b <msg> | st | q");
+	tui_draw_system("c [ip] [port] | l <user> <pass> | to <user> | text | b <msg> | st | q | PgUp/PgDn/End scroll");
 }
 
 void tui_draw_message(const char *sender, const char *message)
 {
 	platform_mutex_lock(&tui_lock);
-	draw_line_locked(sender ? sender : "system", message, 1);
+	scrollback_append(&scrollback, sender ? sender : "system", message, 1);
 	platform_mutex_unlock(&tui_lock);
 }
 
+/* 读一行输入：等待按键的同时按帧绘制消息区，翻页键移动视口 */
 int tui_read_input(char *buffer, int size)
 {
-	int result;
+	char line[TUI_INPUT_MAX];
+	size_t len = 0;
+	int page;
+	int ch;
 
 	if (!buffer || size <= 0)
 	{
@@ -210,23 +342,102 @@ int tui_read_input(char *buffer, int size)
 	}
 
 	platform_mutex_lock(&tui_lock);
-	werase(input_win);
-	mvwprintw(input_win, 0, 0, "> ");
-	wclrtoeol(input_win);
-	wrefresh(input_win);
-	echo();
-	result = wgetnstr(input_win, buffer, size - 1);
-	noecho();
-	werase(input_win);
-	wrefresh(input_win);
+	last_frame_ms = 0;
+	render_frame_locked();
 	platform_mutex_unlock(&tui_lock);
+	draw_input(line, len);
+	doupdate();
 
-	if (result == ERR)
+	for (;;)
 	{
-		return -1;
+		ch = wgetch(input_win);
+		if (ch == '\n' || ch == '\r' || ch == KEY_ENTER)
+		{
+			break;
+		}
+
+		int input_changed = 0;
+		platform_mutex_lock(&tui_lock);
+		page = getmaxy(message_win) > 2 ? getmaxy(message_win) - 1 : 1;
+		switch (ch)
+		{
+		case ERR:
+			break;
+		case KEY_BACKSPACE:
+		case 127:
+		case 8:
+			while (len > 0 && ((unsigned char)line[--len] & 0xC0) == 0x80)
+			{
+			}
+			input_changed = 1;
+			break;
+		case KEY_PPAGE:
+			scrollback_scroll(&scrollback, page);
+			break;
+		case KEY_NPAGE:
+			scrollback_scroll(&scrollback, -page);
+			break;
+		case KEY_UP:
+			scrollback_scroll(&scrollback, 1);
+			break;
+		case KEY_DOWN:
+			scrollback_scroll(&scrollback, -1);
+			break;
+		case KEY_END:
+			scrollback_scroll(&scrollback, -scrollback.offset);
+			break;
+		case KEY_RESIZE:
+#ifdef PDCURSES
+			resize_term(0, 0);
+#endif
+			create_layout_locked();
+			input_changed = 1;
+			break;
+		case 4: /* Ctrl+D：空行时结束输入 */
+			if (len == 0)
+			{
+				platform_mutex_unlock(&tui_lock);
+				return -1;
+			}
+			break;
+		default:
+			if (ch >= 32 && ch < 256 && len + 1 < sizeof(line))
+			{
+				line[len++] = (char)ch;
+				input_changed = 1;
+			}
+			break;
+		}
+
+		/* 键盘触发的视口移动立即画出，不等帧间隔 */
+		if (ch != ERR && scrollback.full_damage)
+		{
+			last_frame_ms = 0;
+		}
+		int rendered = render_frame_locked();
+		platform_mutex_unlock(&tui_lock);
+
+		if (input_changed || rendered)
+		{
+			draw_input(line, len);
+			doupdate();
+		}
+	}
+
+	if (len > (size_t)size - 1)
+	{
+		len = (size_t)size - 1;
 	}
+	memcpy(buffer, line, len);
+	buffer[len] = '\0';
+
+	platform_mutex_lock(&tui_lock);
+	werase(input_win);
+	wnoutrefresh(input_win);
+	platform_mutex_unlock(&tui_lock);
+	doupdate();
 
-	return (int)strlen(buffer);
+	return (int)len;
 }
 
 #endif /* !_WIN32 */
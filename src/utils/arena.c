@@ -0,0 +1,145 @@
+/**
+ * @file utils/arena.c
+ * @brief 线性分配区实现
+ *
+ * 分配只移动一个偏移量，用完后一次 arena_reset 全部回收，适合生命周期
+ * 与一次请求相同的临时对象。最近一次分配可以缩小或撤销，按上限预留后
+ * 再按实际长度收回，或“分配-复制-释放”的循环都不会占用额外空间。
+ * 放不下的分配单独向系统申请并挂在溢出链表上，同样在重置时释放。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** 分配的对齐字节数 */
+#define ARENA_ALIGN 8
+
+/**
+ * @brief 溢出分配，头部之后紧跟数据
+ */
+struct ArenaBlock
+{
+	struct ArenaBlock *next; /**< 下一个溢出分配 */
+	size_t size;			 /**< 数据大小 */
+};
+
+/** 溢出分配的头部大小，保持数据对齐 */
+#define ARENA_BLOCK_HEADER ((sizeof(struct ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/**
+ * @brief 用调用方提供的内存初始化分配区
+ *
+ * @param arena 分配区
+ * @param buffer 底层内存，生命周期不短于分配区
+ * @param cap 底层内存大小
+ */
+void arena_init(Arena *arena, void *buffer, size_t cap)
+{
+	if (!arena)
+		return;
+
+	memset(arena, 0, sizeof(Arena));
+	arena->base = (char *)buffer;
+	arena->cap = buffer ? cap : 0;
+}
+
+/**
+ * @brief 从分配区分配内存
+ *
+ * @param arena 分配区
+ * @param size 字节数
+ * @return void* 成功返回8字节对齐的内存，内存不足返回NULL
+ */
+void *arena_alloc(Arena *arena, size_t size)
+{
+	if (!arena || size == 0)
+		return NULL;
+
+	size_t start = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (start <= arena->cap && size <= arena->cap - start)
+	{
+		arena->last = start;
+		arena->used = start + size;
+		if (arena->used > arena->peak)
+			arena->peak = arena->used;
+		return arena->base + start;
+	}
+
+	struct ArenaBlock *block = (struct ArenaBlock *)malloc(ARENA_BLOCK_HEADER + size);
+	if (!block)
+		return NULL;
+	block->size = size;
+	block->next = arena->overflow;
+	arena->overflow = block;
+	arena->overflow_count++;
+	return (char *)block + ARENA_BLOCK_HEADER;
+}
+
+/**
+ * @brief 缩小最近一次分配，size 为0时撤销该分配
+ *
+ * 不是最近一次从底层内存分配的指针时不做任何事，内存到重置时才回收。
+ *
+ * @param arena 分配区
+ * @param ptr 分配得到的指针
+ * @param size 保留的字节数，不超过原大小
+ */
+void arena_trim(Arena *arena, void *ptr, size_t size)
+{
+	if (!arena || !ptr || !arena->base)
+		return;
+
+	char *p = (char *)ptr;
+	if (p != arena->base + arena->last || arena->last + size > arena->used)
+		return;
+	arena->used = arena->last + size;
+}
+
+/**
+ * @brief 判断指针是否由分配区分配
+ *
+ * @param arena 分配区
+ * @param ptr 指针
+ * @return int 是返回1，否则返回0
+ */
+int arena_owns(const Arena *arena, const void *ptr)
+{
+	if (!arena || !ptr)
+		return 0;
+
+	const char *p = (const char *)ptr;
+	if (arena->base && p >= arena->base && p < arena->base + arena->cap)
+		return 1;
+	for (const struct ArenaBlock *block = arena->overflow; block; block = block->next)
+	{
+		if (p == (const char *)block + ARENA_BLOCK_HEADER)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief 回收分配区的全部分配并释放溢出分配
+ *
+ * @param arena 分配区
+ */
+void arena_reset(Arena *arena)
+{
+	if (!arena)
+		return;
+
+	struct ArenaBlock *block = arena->overflow;
+	while (block)
+	{
+		struct ArenaBlock *next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->overflow = NULL;
+	arena->used = 0;
+	arena->last = 0;
+}
@@ -0,0 +1,306 @@
+/**
+ * @file utils/digest.c
+ * @brief SHA-256、HMAC-SHA256 与 PBKDF2-HMAC-SHA256 实现
+ *
+ * 用户存储用 PBKDF2 从密码和每个用户的盐派生口令摘要，迭代次数决定一次验证的耗时，
+ * 登录验证因此可以放在专用的认证线程上执行（见 core/worker_pool.c）。
+ * 实现按 FIPS 180-4 和 RFC 2104/8018 逐字节处理，不依赖外部加密库，
+ * 不使用平台相关的指令，大小端无关。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include "utils.h"
+#include <string.h>
+
+/** 每个压缩块的字节数 */
+#define SHA256_BLOCK_LEN 64
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/**
+ * @brief 压缩一个 64 字节的块
+ */
+static void sha256_compress(uint32_t state[8], const unsigned char *block)
+{
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h;
+
+	for (int i = 0; i < 16; i++)
+	{
+		w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+			   ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+	}
+	for (int i = 16; i < 64; i++)
+	{
+		uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+	f = state[5];
+	g = state[6];
+	h = state[7];
+	for (int i = 0; i < 64; i++)
+	{
+		uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+/**
+ * @brief 开始一次 SHA-256 计算
+ *
+ * @param ctx 计算上下文
+ */
+void sha256_init(Sha256Context *ctx)
+{
+	static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+										0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+	memcpy(ctx->state, initial, sizeof(initial));
+	ctx->total = 0;
+	ctx->buffered = 0;
+}
+
+/**
+ * @brief 追加输入数据
+ *
+ * @param ctx 计算上下文
+ * @param data 数据
+ * @param len 字节数
+ */
+void sha256_update(Sha256Context *ctx, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+
+	ctx->total += len;
+	if (ctx->buffered > 0)
+	{
+		size_t take = SHA256_BLOCK_LEN - ctx->buffered;
+		if (take > len)
+			take = len;
+		memcpy(ctx->buffer + ctx->buffered, p, take);
+		ctx->buffered += take;
+		p += take;
+		len -= take;
+		if (ctx->buffered < SHA256_BLOCK_LEN)
+			return;
+		sha256_compress(ctx->state, ctx->buffer);
+		ctx->buffered = 0;
+	}
+
+	while (len >= SHA256_BLOCK_LEN)
+	{
+		sha256_compress(ctx->state, p);
+		p += SHA256_BLOCK_LEN;
+		len -= SHA256_BLOCK_LEN;
+	}
+	if (len > 0)
+	{
+		memcpy(ctx->buffer, p, len);
+		ctx->buffered = len;
+	}
+}
+
+/**
+ * @brief 结束计算并输出摘要
+ *
+ * @param ctx 计算上下文，之后需重新 sha256_init 才能再次使用
+ * @param out 输出 SHA256_DIGEST_LEN 字节的摘要
+ */
+void sha256_final(Sha256Context *ctx, unsigned char out[SHA256_DIGEST_LEN])
+{
+	uint64_t bits = ctx->total * 8;
+	unsigned char pad[SHA256_BLOCK_LEN + 8];
+	size_t pad_len = (ctx->buffered < 56 ? 56 : 120) - ctx->buffered;
+
+	memset(pad, 0, sizeof(pad));
+	pad[0] = 0x80;
+	for (int i = 0; i < 8; i++)
+		pad[pad_len + i] = (unsigned char)(bits >> (56 - i * 8));
+	sha256_update(ctx, pad, pad_len + 8);
+
+	for (int i = 0; i < 8; i++)
+	{
+		out[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+		out[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+		out[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+		out[i * 4 + 3] = (unsigned char)ctx->state[i];
+	}
+}
+
+/**
+ * @brief 一次计算整段数据的 SHA-256
+ *
+ * @param data 数据
+ * @param len 字节数
+ * @param out 输出摘要
+ */
+void sha256(const void *data, size_t len, unsigned char out[SHA256_DIGEST_LEN])
+{
+	Sha256Context ctx;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, out);
+}
+
+/**
+ * @brief HMAC 的内外两层初始状态，PBKDF2 的每次迭代都从这里复制
+ */
+typedef struct
+{
+	Sha256Context inner;
+	Sha256Context outer;
+} HmacKey;
+
+static void hmac_prepare(HmacKey *hk, const void *key, size_t key_len)
+{
+	unsigned char block[SHA256_BLOCK_LEN];
+	unsigned char pad[SHA256_BLOCK_LEN];
+
+	memset(block, 0, sizeof(block));
+	if (key_len > SHA256_BLOCK_LEN)
+		sha256(key, key_len, block);
+	else if (key_len > 0)
+		memcpy(block, key, key_len);
+
+	for (int i = 0; i < SHA256_BLOCK_LEN; i++)
+		pad[i] = block[i] ^ 0x36;
+	sha256_init(&hk->inner);
+	sha256_update(&hk->inner, pad, sizeof(pad));
+
+	for (int i = 0; i < SHA256_BLOCK_LEN; i++)
+		pad[i] = block[i] ^ 0x5c;
+	sha256_init(&hk->outer);
+	sha256_update(&hk->outer, pad, sizeof(pad));
+}
+
+static void hmac_finish(const HmacKey *hk, const void *data, size_t len, unsigned char out[SHA256_DIGEST_LEN])
+{
+	Sha256Context ctx = hk->inner;
+	unsigned char inner[SHA256_DIGEST_LEN];
+
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, inner);
+	ctx = hk->outer;
+	sha256_update(&ctx, inner, sizeof(inner));
+	sha256_final(&ctx, out);
+}
+
+/**
+ * @brief 计算 HMAC-SHA256
+ *
+ * @param key 密钥
+ * @param key_len 密钥字节数
+ * @param data 数据
+ * @param len 数据字节数
+ * @param out 输出 SHA256_DIGEST_LEN 字节
+ */
+void hmac_sha256(const void *key, size_t key_len, const void *data, size_t len, unsigned char out[SHA256_DIGEST_LEN])
+{
+	HmacKey hk;
+
+	hmac_prepare(&hk, key, key_len);
+	hmac_finish(&hk, data, len, out);
+}
+
+/**
+ * @brief 用 PBKDF2-HMAC-SHA256 从口令派生密钥
+ *
+ * 密钥的内外层状态只计算一次，每次迭代是两次压缩，耗时与 iterations 成正比。
+ *
+ * @param password 口令
+ * @param password_len 口令字节数
+ * @param salt 盐
+ * @param salt_len 盐字节数，不超过 PBKDF2_MAX_SALT_LEN
+ * @param iterations 迭代次数，至少为1
+ * @param out 输出缓冲区
+ * @param out_len 派生的字节数
+ * @return int 成功返回0，参数无效返回-1
+ */
+int pbkdf2_sha256(const char *password, size_t password_len, const unsigned char *salt, size_t salt_len,
+				  uint32_t iterations, unsigned char *out, size_t out_len)
+{
+	unsigned char first[PBKDF2_MAX_SALT_LEN + 4];
+	unsigned char u[SHA256_DIGEST_LEN];
+	unsigned char t[SHA256_DIGEST_LEN];
+	HmacKey hk;
+
+	if (!password || (!salt && salt_len > 0) || salt_len > PBKDF2_MAX_SALT_LEN || iterations == 0 || !out)
+		return -1;
+
+	hmac_prepare(&hk, password, password_len);
+	if (salt_len > 0)
+		memcpy(first, salt, salt_len);
+
+	for (uint32_t block = 1; out_len > 0; block++)
+	{
+		first[salt_len] = (unsigned char)(block >> 24);
+		first[salt_len + 1] = (unsigned char)(block >> 16);
+		first[salt_len + 2] = (unsigned char)(block >> 8);
+		first[salt_len + 3] = (unsigned char)block;
+		hmac_finish(&hk, first, salt_len + 4, u);
+		memcpy(t, u, sizeof(t));
+
+		for (uint32_t i = 1; i < iterations; i++)
+		{
+			hmac_finish(&hk, u, sizeof(u), u);
+			for (int j = 0; j < SHA256_DIGEST_LEN; j++)
+				t[j] ^= u[j];
+		}
+
+		size_t take = out_len < SHA256_DIGEST_LEN ? out_len : SHA256_DIGEST_LEN;
+		memcpy(out, t, take);
+		out += take;
+		out_len -= take;
+	}
+	return 0;
+}
+
+/**
+ * @brief 比较两段摘要，耗时与内容无关
+ *
+ * @return int 相同返回1，否则返回0
+ */
+int digest_equal(const unsigned char *a, const unsigned char *b, size_t len)
+{
+	unsigned char diff = 0;
+
+	for (size_t i = 0; i < len; i++)
+		diff |= (unsigned char)(a[i] ^ b[i]);
+	return diff == 0;
+}
@@ -0,0 +1,237 @@
+/**
+ * @file utils/epoch.c
+ * @brief 基于纪元的延迟回收实现
+ *
+ * 读者进入临界区时把当前全局纪元公布在自己线程的记录上，离开时清零，全程不加锁。
+ * 写者摘下节点后调用 epoch_retire：全局纪元加一，节点记下加一前的纪元挂到待回收链表。
+ * 所有活跃读者公布的纪元都大于节点的纪元时，它们都是在节点摘下之后进入的，
+ * 不可能再持有该节点，回收函数才会被调用。
+ *
+ * 读者“公布纪元、再读指针”与写者“摘下节点、再检查公布”之间各有一道全序屏障，
+ * 二者至少有一方看到另一方：要么写者看到读者的公布而推迟回收，要么读者看不到被摘下的节点。
+ *
+ * 每个线程第一次进入时领取一条记录，线程退出前调用 epoch_thread_release 交还，
+ * 记录本身不释放，由之后的线程复用。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include <stdlib.h>
+#include "utils.h"
+
+/**
+ * @brief 一个线程的纪元记录
+ */
+typedef struct EpochRecord
+{
+	atomic_uint_fast64_t active; /**< 临界区内公布的纪元，0 表示不在临界区 */
+	atomic_int in_use;			 /**< 已被某个线程领取 */
+	struct EpochRecord *next;	 /**< 全部记录组成的链表，只在头部追加 */
+} EpochRecord;
+
+/* 全局纪元从1开始，0 留给“不在临界区” */
+static atomic_uint_fast64_t global_epoch = 1;
+static _Atomic(EpochRecord *) records = NULL;
+
+/* 待回收链表按纪元递增排列，由 retired_lock 保护 */
+static platform_mutex_t retired_lock = PLATFORM_MUTEX_INITIALIZER;
+static EpochNode *retired_head = NULL;
+static EpochNode *retired_tail = NULL;
+static size_t retired_count = 0;
+
+/* 调用线程的记录和临界区嵌套层数 */
+static PLATFORM_THREAD_LOCAL EpochRecord *self = NULL;
+static PLATFORM_THREAD_LOCAL int depth = 0;
+
+/**
+ * @brief 领取一条空闲记录，没有时新建一条挂到链表头部
+ */
+static EpochRecord *claim_record(void)
+{
+	for (EpochRecord *r = atomic_load_explicit(&records, memory_order_acquire); r; r = r->next)
+	{
+		int expected = 0;
+		if (atomic_compare_exchange_strong(&r->in_use, &expected, 1))
+			return r;
+	}
+
+	EpochRecord *r = (EpochRecord *)calloc(1, sizeof(EpochRecord));
+	if (!r)
+		return NULL;
+	atomic_init(&r->active, 0);
+	atomic_init(&r->in_use, 1);
+	r->next = atomic_load_explicit(&records, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(&records, &r->next, r, memory_order_release, memory_order_relaxed))
+	{
+	}
+	return r;
+}
+
+/**
+ * @brief 进入读临界区
+ *
+ * 可以嵌套，只有最外层公布纪元。临界区内读到的共享节点在离开前不会被回收；
+ * 临界区内不能阻塞等待其他线程，也不能调用 epoch_synchronize。
+ * 记录分配失败时（内存耗尽）返回-1，调用者不能进入临界区读取共享结构。
+ *
+ * @return int 成功返回0，失败返回-1
+ */
+int epoch_enter(void)
+{
+	if (depth++ > 0)
+		return 0;
+	if (!self)
+		self = claim_record();
+	if (!self)
+	{
+		depth = 0;
+		return -1;
+	}
+
+	atomic_store_explicit(&self->active, atomic_load_explicit(&global_epoch, memory_order_relaxed),
+						  memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	return 0;
+}
+
+/**
+ * @brief 离开读临界区
+ */
+void epoch_exit(void)
+{
+	if (depth <= 0 || --depth > 0)
+		return;
+	atomic_store_explicit(&self->active, 0, memory_order_release);
+}
+
+/**
+ * @brief 计算可以回收的纪元上界：纪元小于它的节点没有读者持有
+ */
+static uint64_t safe_epoch(void)
+{
+	uint64_t bound = atomic_load_explicit(&global_epoch, memory_order_relaxed);
+
+	atomic_thread_fence(memory_order_seq_cst);
+	for (EpochRecord *r = atomic_load_explicit(&records, memory_order_acquire); r; r = r->next)
+	{
+		uint64_t active = atomic_load_explicit(&r->active, memory_order_acquire);
+		if (active != 0 && active < bound)
+			bound = active;
+	}
+	return bound;
+}
+
+/**
+ * @brief 回收已经没有读者持有的节点
+ *
+ * 在锁内摘下可回收的前缀，在锁外调用回收函数，回收函数中可以再调用 epoch_retire。
+ *
+ * @return size_t 本次回收的节点数
+ */
+size_t epoch_collect(void)
+{
+	EpochNode *ready = NULL;
+	EpochNode **link = &ready;
+	size_t count = 0;
+
+	platform_mutex_lock(&retired_lock);
+	uint64_t bound = safe_epoch();
+	while (retired_head && retired_head->epoch < bound)
+	{
+		*link = retired_head;
+		link = &retired_head->next;
+		retired_head = retired_head->next;
+		retired_count--;
+		count++;
+	}
+	*link = NULL;
+	if (!retired_head)
+		retired_tail = NULL;
+	platform_mutex_unlock(&retired_lock);
+
+	while (ready)
+	{
+		EpochNode *node = ready;
+		ready = node->next;
+		node->reclaim(node);
+	}
+	return count;
+}
+
+/**
+ * @brief 登记一个已从共享结构中摘下的节点，等当前所有读者离开后回收
+ *
+ * 调用前节点必须已经不可达（新进入的读者看不到它）。待回收的节点积累到
+ * EPOCH_COLLECT_THRESHOLD 个时顺带回收一次。不能在读临界区内调用，
+ * 否则本线程自己的公布会推迟回收。
+ *
+ * @param node 嵌入在被回收对象中的节点
+ * @param reclaim 回收函数，通常用 container_of 式的偏移找回对象后释放
+ */
+void epoch_retire(EpochNode *node, EpochReclaim reclaim)
+{
+	size_t pending;
+
+	if (!node || !reclaim)
+		return;
+
+	node->reclaim = reclaim;
+	node->next = NULL;
+	platform_mutex_lock(&retired_lock);
+	node->epoch = atomic_fetch_add(&global_epoch, 1);
+	if (retired_tail)
+		retired_tail->next = node;
+	else
+		retired_head = node;
+	retired_tail = node;
+	pending = ++retired_count;
+	platform_mutex_unlock(&retired_lock);
+
+	if (pending >= EPOCH_COLLECT_THRESHOLD)
+		epoch_collect();
+}
+
+/**
+ * @brief 等待当前所有读者离开，然后回收全部待回收的节点
+ *
+ * 用于停止时释放剩余的节点。调用线程不能在读临界区内。
+ */
+void epoch_synchronize(void)
+{
+	for (;;)
+	{
+		epoch_collect();
+		if (epoch_pending() == 0)
+			return;
+		platform_sleep_ms(1);
+	}
+}
+
+/**
+ * @brief 获取等待回收的节点数
+ *
+ * @return size_t 节点数
+ */
+size_t epoch_pending(void)
+{
+	size_t pending;
+
+	platform_mutex_lock(&retired_lock);
+	pending = retired_count;
+	platform_mutex_unlock(&retired_lock);
+	return pending;
+}
+
+/**
+ * @brief 交还调用线程的纪元记录，线程退出前调用
+ */
+void epoch_thread_release(void)
+{
+	if (!self)
+		return;
+	depth = 0;
+	atomic_store_explicit(&self->active, 0, memory_order_release);
+	atomic_store_explicit(&self->in_use, 0, memory_order_release);
+	self = NULL;
+}
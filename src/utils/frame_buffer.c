@@ -0,0 +1,250 @@
+/**
+ * @file utils/frame_buffer.c
+ * @brief 流式分帧缓冲区实现
+ *
+ * TCP 是字节流，一次 recv 可能包含多帧，也可能只包含半帧。本文件实现一个
+ * 随连接存活的可增长接收缓冲区：数据直接读入缓冲区尾部，完整的以 '\n'
+ * 结尾的帧在缓冲区内原地切出（换行替换为 '\0'），不完整的尾部保留到下一次读取。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include "utils.h"
+#include <string.h>
+#include <stdlib.h>
+
+/** 首次分配的缓冲区大小 */
+#define FRAME_BUFFER_INITIAL_CAP 4096
+
+/**
+ * @brief 初始化分帧缓冲区
+ *
+ * 只记录参数，不立即分配内存；首次读取时按需分配。
+ *
+ * @param fb 缓冲区指针
+ * @param max_frame 单帧最大长度（不含换行），0 表示使用 FRAME_BUFFER_DEFAULT_MAX
+ */
+void frame_buffer_init(FrameBuffer *fb, size_t max_frame)
+{
+	if (!fb)
+		return;
+
+	memset(fb, 0, sizeof(FrameBuffer));
+	fb->max_frame = max_frame > 0 ? max_frame : FRAME_BUFFER_DEFAULT_MAX;
+}
+
+/**
+ * @brief 释放分帧缓冲区
+ *
+ * @param fb 缓冲区指针
+ */
+void frame_buffer_free(FrameBuffer *fb)
+{
+	if (!fb)
+		return;
+
+	safe_free((void **)&fb->data);
+	fb->cap = 0;
+	fb->start = 0;
+	fb->len = 0;
+	fb->scan = 0;
+}
+
+/**
+ * @brief 为下一次读取预留空间
+ *
+ * 保证缓冲区尾部至少有 min_space 字节可写（额外保留1字节给终止符），
+ * 必要时先把未消费的数据移动到缓冲区头部，再按倍数扩容。
+ *
+ * @param fb 缓冲区指针
+ * @param min_space 期望的最小可写空间
+ * @param out_space 输出实际可写空间
+ * @return char* 成功返回写入位置，失败返回NULL
+ */
+char *frame_buffer_reserve(FrameBuffer *fb, size_t min_space, size_t *out_space)
+{
+	if (!fb || min_space == 0)
+		return NULL;
+
+	/* 已消费的前缀先回收，避免无谓扩容 */
+	if (fb->start > 0 && fb->cap - fb->len < min_space + 1)
+		frame_buffer_compact(fb);
+
+	if (fb->cap - fb->len < min_space + 1)
+	{
+		size_t new_cap = fb->cap > 0 ? fb->cap : FRAME_BUFFER_INITIAL_CAP;
+		while (new_cap - fb->len < min_space + 1)
+			new_cap *= 2;
+
+		char *grown = (char *)realloc(fb->data, new_cap);
+		if (!grown)
+			return NULL;
+		fb->data = grown;
+		fb->cap = new_cap;
+	}
+
+	if (out_space)
+		*out_space = fb->cap - fb->len - 1;
+	return fb->data + fb->len;
+}
+
+/**
+ * @brief 确认写入的字节数
+ *
+ * @param fb 缓冲区指针
+ * @param n 刚刚写入 frame_buffer_reserve 返回位置的字节数
+ */
+void frame_buffer_commit(FrameBuffer *fb, size_t n)
+{
+	if (!fb || !fb->data)
+		return;
+
+	if (n > fb->cap - fb->len - 1)
+		n = fb->cap - fb->len - 1;
+	fb->len += n;
+}
+
+/**
+ * @brief 取出下一帧
+ *
+ * 在未扫描过的区域查找换行符，找到后原地把换行（以及可选的 '\r'）替换为 '\0'。
+ * 返回的帧指针在下一次 frame_buffer_reserve/compact 之前有效。空行会被跳过。
+ * 已扫描位置会被记录下来，半帧不会在每次读取后被重复扫描。
+ *
+ * @param fb 缓冲区指针
+ * @param frame 输出帧起始地址
+ * @param frame_len 输出帧长度（不含终止符）
+ * @return int 取到一帧返回1，需要更多数据返回0，待处理数据超过单帧上限返回-1
+ */
+int frame_buffer_next(FrameBuffer *fb, char **frame, size_t *frame_len)
+{
+	if (!fb || !frame || !frame_len || !fb->data)
+		return 0;
+
+	while (fb->start < fb->len)
+	{
+		size_t from = fb->scan > fb->start ? fb->scan : fb->start;
+		char *newline = (char *)memchr(fb->data + from, '\n', fb->len - from);
+
+		if (!newline)
+		{
+			fb->scan = fb->len;
+			if (fb->len - fb->start > fb->max_frame)
+				return -1;
+			return 0;
+		}
+
+		size_t end = (size_t)(newline - fb->data);
+		size_t begin = fb->start;
+		size_t length = end - begin;
+
+		fb->start = end + 1;
+		fb->scan = fb->start;
+
+		if (length > fb->max_frame)
+			return -1;
+
+		if (length > 0 && fb->data[end - 1] == '\r')
+			length--;
+		fb->data[begin + length] = '\0';
+
+		if (length == 0)
+			continue;
+
+		*frame = fb->data + begin;
+		*frame_len = length;
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief 回收已消费的数据
+ *
+ * 把尚未成帧的尾部移动到缓冲区头部。缓冲区清空且曾扩容得较大时，
+ * 缩回初始大小，避免突发大消息后长期占用内存。
+ *
+ * @param fb 缓冲区指针
+ */
+void frame_buffer_compact(FrameBuffer *fb)
+{
+	if (!fb || !fb->data)
+		return;
+
+	if (fb->start >= fb->len)
+	{
+		fb->start = 0;
+		fb->len = 0;
+		fb->scan = 0;
+		if (fb->cap > FRAME_BUFFER_INITIAL_CAP * 16)
+		{
+			char *shrunk = (char *)realloc(fb->data, FRAME_BUFFER_INITIAL_CAP);
+			if (shrunk)
+			{
+				fb->data = shrunk;
+				fb->cap = FRAME_BUFFER_INITIAL_CAP;
+			}
+		}
+		return;
+	}
+
+	if (fb->start == 0)
+		return;
+
+	size_t remaining = fb->len - fb->start;
+	memmove(fb->data, fb->data + fb->start, remaining);
+	fb->scan -= fb->start;
+	fb->start = 0;
+	fb->len = remaining;
+}
+
+/**
+ * @brief 获取尚未成帧的字节数
+ *
+ * @param fb 缓冲区指针
+ * @return size_t 缓冲区中待处理的字节数
+ */
+size_t frame_buffer_pending(const FrameBuffer *fb)
+{
+	if (!fb)
+		return 0;
+	return fb->len - fb->start;
+}
+
+/**
+ * @brief 查看尚未消费的数据
+ *
+ * 长度前缀分帧的协议（如二进制协议 v2）不依赖换行，自行判断帧边界后
+ * 调用 frame_buffer_consume 消费。
+ *
+ * @param fb 缓冲区指针
+ * @param data 输出未消费数据的起始地址
+ * @return size_t 未消费的字节数
+ */
+size_t frame_buffer_peek(FrameBuffer *fb, char **data)
+{
+	if (!fb || !data || !fb->data)
+		return 0;
+	*data = fb->data + fb->start;
+	return fb->len - fb->start;
+}
+
+/**
+ * @brief 消费缓冲区开头的 n 字节
+ *
+ * @param fb 缓冲区指针
+ * @param n 字节数
+ */
+void frame_buffer_consume(FrameBuffer *fb, size_t n)
+{
+	if (!fb || !fb->data)
+		return;
+
+	if (n > fb->len - fb->start)
+		n = fb->len - fb->start;
+	fb->start += n;
+	if (fb->scan < fb->start)
+		fb->scan = fb->start;
+}
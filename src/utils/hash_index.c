@@ -0,0 +1,248 @@
+/**
+ * @file utils/hash_index.c
+ * @brief 开放寻址哈希索引实现
+ *
+ * 通用的指针索引：槽位只保存键的哈希值和值指针，键本身由调用方从值中取出比较，
+ * 因此同一实现可以按套接字、用户名、用户ID等任意键索引已有对象，而无需复制键。
+ * 冲突采用线性探测，删除时向后移位回填，不留墓碑，负载因子保持在 1/2 以下。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include "utils.h"
+#include <string.h>
+#include <stdlib.h>
+
+/** 首次插入时分配的槽位数（必须为2的幂） */
+#define HASH_INDEX_MIN_CAP 16
+
+/**
+ * @brief 把容量向上取整到2的幂
+ *
+ * @param n 期望容量
+ * @return size_t 不小于 n 的2的幂
+ */
+static size_t round_up_pow2(size_t n)
+{
+	size_t cap = HASH_INDEX_MIN_CAP;
+	while (cap < n)
+		cap <<= 1;
+	return cap;
+}
+
+/**
+ * @brief 比较槽位中的值与查找键
+ *
+ * match 为 NULL 时按指针本身比较，用于按对象删除。
+ */
+static int slot_matches(const HashIndexSlot *slot, size_t hash, const void *key, HashIndexMatch match)
+{
+	if (slot->hash != hash)
+		return 0;
+	return match ? match(slot->value, key) : slot->value == key;
+}
+
+/**
+ * @brief 调整槽位数组大小并重新插入所有条目
+ *
+ * @param idx 索引指针
+ * @param new_cap 新容量（2的幂）
+ * @return int 成功返回0，失败返回-1
+ */
+static int hash_index_resize(HashIndex *idx, size_t new_cap)
+{
+	HashIndexSlot *slots = (HashIndexSlot *)calloc(new_cap, sizeof(HashIndexSlot));
+	if (!slots)
+		return -1;
+
+	for (size_t i = 0; i < idx->cap; i++)
+	{
+		HashIndexSlot *old = &idx->slots[i];
+		if (!old->value)
+			continue;
+		size_t pos = old->hash & (new_cap - 1);
+		while (slots[pos].value)
+			pos = (pos + 1) & (new_cap - 1);
+		slots[pos] = *old;
+	}
+
+	free(idx->slots);
+	idx->slots = slots;
+	idx->cap = new_cap;
+	return 0;
+}
+
+/**
+ * @brief 初始化哈希索引
+ *
+ * 零初始化的 HashIndex 同样可用，首次插入时按最小容量分配。
+ *
+ * @param idx 索引指针
+ * @param expected 预计条目数，用于预分配，0 表示延迟分配
+ * @return int 成功返回0，失败返回-1
+ */
+int hash_index_init(HashIndex *idx, size_t expected)
+{
+	if (!idx)
+		return -1;
+
+	memset(idx, 0, sizeof(HashIndex));
+	if (expected == 0)
+		return 0;
+	return hash_index_resize(idx, round_up_pow2(expected * 2));
+}
+
+/**
+ * @brief 释放哈希索引（不释放值指向的对象）
+ *
+ * @param idx 索引指针
+ */
+void hash_index_free(HashIndex *idx)
+{
+	if (!idx)
+		return;
+
+	safe_free((void **)&idx->slots);
+	idx->cap = 0;
+	idx->count = 0;
+}
+
+/**
+ * @brief 查找条目
+ *
+ * @param idx 索引指针
+ * @param hash 键的哈希值
+ * @param key 查找键，传给 match 比较
+ * @param match 键比较函数，NULL 表示按指针比较
+ * @return void* 找到返回值指针，否则返回NULL
+ */
+void *hash_index_find(const HashIndex *idx, size_t hash, const void *key, HashIndexMatch match)
+{
+	if (!idx || idx->count == 0)
+		return NULL;
+
+	size_t mask = idx->cap - 1;
+	for (size_t pos = hash & mask;; pos = (pos + 1) & mask)
+	{
+		const HashIndexSlot *slot = &idx->slots[pos];
+		if (!slot->value)
+			return NULL;
+		if (slot_matches(slot, hash, key, match))
+			return slot->value;
+	}
+}
+
+/**
+ * @brief 插入条目
+ *
+ * 不检查重复键，调用方需先确认键不存在或已删除旧条目。
+ *
+ * @param idx 索引指针
+ * @param hash 键的哈希值
+ * @param value 值指针，不能为NULL
+ * @return int 成功返回0，失败返回-1
+ */
+int hash_index_insert(HashIndex *idx, size_t hash, void *value)
+{
+	if (!idx || !value)
+		return -1;
+
+	if ((idx->count + 1) * 2 > idx->cap)
+	{
+		if (hash_index_resize(idx, idx->cap ? idx->cap * 2 : HASH_INDEX_MIN_CAP) != 0)
+			return -1;
+	}
+
+	size_t mask = idx->cap - 1;
+	size_t pos = hash & mask;
+	while (idx->slots[pos].value)
+		pos = (pos + 1) & mask;
+
+	idx->slots[pos].hash = hash;
+	idx->slots[pos].value = value;
+	idx->count++;
+	return 0;
+}
+
+/**
+ * @brief 删除条目
+ *
+ * 删除后把同一探测链上的后续条目向前回填，保证查找无需墓碑。
+ *
+ * @param idx 索引指针
+ * @param hash 键的哈希值
+ * @param key 查找键
+ * @param match 键比较函数，NULL 表示按指针比较
+ * @return void* 返回被删除的值指针，未找到返回NULL
+ */
+void *hash_index_remove(HashIndex *idx, size_t hash, const void *key, HashIndexMatch match)
+{
+	if (!idx || idx->count == 0)
+		return NULL;
+
+	size_t mask = idx->cap - 1;
+	size_t pos = hash & mask;
+	while (idx->slots[pos].value && !slot_matches(&idx->slots[pos], hash, key, match))
+		pos = (pos + 1) & mask;
+
+	void *removed = idx->slots[pos].value;
+	if (!removed)
+		return NULL;
+
+	/* 向后移位删除：把不在自己理想位置之前的条目前移填补空洞 */
+	size_t hole = pos;
+	for (size_t next = (hole + 1) & mask; idx->slots[next].value; next = (next + 1) & mask)
+	{
+		size_t home = idx->slots[next].hash & mask;
+		if (((next - home) & mask) >= ((next - hole) & mask))
+		{
+			idx->slots[hole] = idx->slots[next];
+			hole = next;
+		}
+	}
+	idx->slots[hole].value = NULL;
+	idx->slots[hole].hash = 0;
+	idx->count--;
+	return removed;
+}
+
+/**
+ * @brief 计算字符串哈希（FNV-1a）
+ *
+ * @param str 字符串
+ * @param max_len 最多参与计算的字符数
+ * @return size_t 哈希值
+ */
+size_t hash_index_hash_string(const char *str, size_t max_len)
+{
+	uint64_t h = 1469598103934665603ULL;
+
+	if (!str)
+		return 0;
+
+	for (size_t i = 0; i < max_len && str[i]; i++)
+	{
+		h ^= (unsigned char)str[i];
+		h *= 1099511628211ULL;
+	}
+	return (size_t)(h ^ (h >> 32));
+}
+
+/**
+ * @brief 计算整数哈希
+ *
+ * 套接字和用户ID都是连续的小整数，需要打散后再取低位。
+ *
+ * @param value 整数键
+ * @return size_t 哈希值
+ */
+size_t hash_index_hash_int(uint64_t value)
+{
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ULL;
+	value ^= value >> 33;
+	return (size_t)value;
+}
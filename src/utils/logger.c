@@ -5,6 +5,11 @@
  * 本文件实现了日志记录功能，支持多种日志级别、颜色输出和文件记录。
  * 日志系统可以输出到控制台或文件，并提供了客户端和消息相关的专用日志函数。
  *
+ * 默认同步写入：每条日志持锁格式化并立即刷新。异步模式下调用方只抢占
+ * 有界无锁环形缓冲区中的一个槽位，把正文格式化进去即返回；后台线程按序
+ * 取出槽位，补上时间戳和级别前缀后批量写入，每批只刷新一次。缓冲区满时
+ * 丢弃新日志并累计丢弃计数，绝不阻塞调用方。
+ *
  * @author 开发团队
  * @date 2025
  */
@@ -17,8 +22,8 @@
 #include "utils.h"
 #include "../models/models.h"
 
-/** 当前日志级别，低于此级别的日志将被忽略 */
-static LogLevel current_log_level = LOG_INFO;
+/** 当前日志级别，低于此级别的日志将被忽略；日志宏在调用处直接读取 */
+atomic_int log_current_level = LOG_INFO;
 /** 日志输出文件指针，默认为NULL表示输出到标准输出 */
 /* 默认输出到标准输出，避免未初始化导致的崩溃 */
 static FILE *log_file = NULL;
@@ -42,6 +47,49 @@ static const char *log_level_colors[] = {
 /* 级别数组长度，用于边界检查 */
 static const int LOG_LEVEL_COUNT = sizeof(log_level_strings) / sizeof(log_level_strings[0]);
 
+/**
+ * @brief 异步日志槽位
+ *
+ * seq 等于槽位位置时可写，等于位置+1时可读，读完后加上容量进入下一轮。
+ */
+typedef struct
+{
+	atomic_size_t seq;			/**< 槽位序号 */
+	LogLevel level;				/**< 日志级别 */
+	time_t when;				/**< 记录时间 */
+	char text[LOG_RECORD_MAX];	/**< 已格式化的正文 */
+} LogRecord;
+
+/* 异步日志的环形缓冲区与后台线程 */
+static LogRecord *ring = NULL;
+static size_t ring_mask = 0;
+static atomic_size_t ring_head = 0;	 /* 下一个可抢占的位置（生产者） */
+static size_t ring_tail = 0;		 /* 下一个待写出的位置（后台线程） */
+static atomic_int async_enabled = 0;
+static atomic_int async_writers = 0; /* 正在写槽位的生产者数，停止时等待归零 */
+static atomic_size_t async_dropped = 0;
+static size_t reported_dropped = 0;
+static int flush_interval = 100;
+static platform_thread_t flush_thread;
+
+/**
+ * @brief 格式化日志前缀
+ *
+ * 控制台输出带颜色，文件输出不带颜色。
+ */
+static void format_prefix(char *prefix, size_t size, FILE *target, LogLevel level, const char *time_buf)
+{
+	if (target == stdout || target == stderr)
+	{
+		snprintf(prefix, size, "%s[%s]%s %s: ",
+				 log_level_colors[level], time_buf, "\x1b[0m", log_level_strings[level]);
+	}
+	else
+	{
+		snprintf(prefix, size, "[%s] %s: ", time_buf, log_level_strings[level]);
+	}
+}
+
 /**
  * @brief 设置日志级别
  *
@@ -51,7 +99,7 @@ static const int LOG_LEVEL_COUNT = sizeof(log_level_strings) / sizeof(log_level_
  */
 void set_log_level(LogLevel level)
 {
-	current_log_level = level;
+	atomic_store_explicit(&log_current_level, (int)level, memory_order_relaxed);
 }
 
 /**
@@ -90,6 +138,191 @@ void set_log_file(const char *filename)
 	platform_mutex_unlock(&log_mutex);
 }
 
+/**
+ * @brief 抢占一个槽位并写入一条日志
+ *
+ * 多个生产者通过对 ring_head 的 CAS 抢占位置，槽位序号表明其是否空闲；
+ * 缓冲区已满时只增加丢弃计数。
+ */
+static void enqueue_record(LogLevel level, const char *format, va_list args)
+{
+	size_t pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+	LogRecord *rec;
+
+	for (;;)
+	{
+		rec = &ring[pos & ring_mask];
+		size_t seq = atomic_load_explicit(&rec->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)(seq - pos);
+		if (diff == 0)
+		{
+			if (atomic_compare_exchange_weak_explicit(&ring_head, &pos, pos + 1,
+													  memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			atomic_fetch_add_explicit(&async_dropped, 1, memory_order_relaxed);
+			return;
+		}
+		else
+		{
+			pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+		}
+	}
+
+	rec->level = level;
+	rec->when = time(NULL);
+	vsnprintf(rec->text, sizeof(rec->text), format, args);
+	atomic_store_explicit(&rec->seq, pos + 1, memory_order_release);
+}
+
+/**
+ * @brief 写出环形缓冲区中所有已就绪的日志
+ *
+ * 只由后台线程调用。整批写完后刷新一次，并报告新增的丢弃条数。
+ *
+ * @return int 写出的条数
+ */
+static int drain_records(void)
+{
+	char time_buf[32];
+	char prefix[256];
+	int written = 0;
+
+	platform_mutex_lock(&log_mutex);
+	if (!log_file)
+	{
+		log_file = stdout;
+	}
+
+	for (;;)
+	{
+		LogRecord *rec = &ring[ring_tail & ring_mask];
+		if (atomic_load_explicit(&rec->seq, memory_order_acquire) != ring_tail + 1)
+			break;
+
+		/* 同一秒内的日志由 format_timestamp 的线程缓存复用时间戳 */
+		format_timestamp(rec->when, time_buf, sizeof(time_buf));
+		if (time_buf[0] == '\0')
+			safe_strcpy(time_buf, "unknown", sizeof(time_buf));
+		format_prefix(prefix, sizeof(prefix), log_file, rec->level, time_buf);
+		fputs(prefix, log_file);
+		fputs(rec->text, log_file);
+		fputc('\n', log_file);
+
+		atomic_store_explicit(&rec->seq, ring_tail + ring_mask + 1, memory_order_release);
+		ring_tail++;
+		written++;
+	}
+
+	size_t dropped = atomic_load_explicit(&async_dropped, memory_order_relaxed);
+	if (dropped != reported_dropped)
+	{
+		get_current_time(time_buf, sizeof(time_buf));
+		format_prefix(prefix, sizeof(prefix), log_file, LOG_WARNING, time_buf);
+		fprintf(log_file, "%s%zu log records dropped, ring buffer full\n", prefix, dropped - reported_dropped);
+		reported_dropped = dropped;
+		written++;
+	}
+
+	if (written > 0)
+		fflush(log_file);
+	platform_mutex_unlock(&log_mutex);
+	return written;
+}
+
+/**
+ * @brief 后台刷新线程：有日志时连续写出，缓冲区为空时等待一个刷新间隔
+ *
+ * 停止时等所有正在写槽位的生产者完成后再做最后一次写出。
+ */
+static platform_thread_return_t PLATFORM_THREAD_CALL flush_main(void *arg)
+{
+	(void)arg;
+
+	for (;;)
+	{
+		int written = drain_records();
+		if (!atomic_load(&async_enabled))
+		{
+			while (atomic_load(&async_writers) > 0)
+				platform_sleep_ms(1);
+			drain_records();
+			break;
+		}
+		if (written == 0)
+			platform_sleep_ms((unsigned int)flush_interval);
+	}
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/**
+ * @brief 启动异步日志
+ *
+ * @param capacity 槽位数，向上取整到2的幂，0 表示使用 LOG_ASYNC_DEFAULT_CAPACITY
+ * @param flush_interval_ms 缓冲区为空时后台线程的等待间隔（毫秒）
+ * @return int 成功返回0，已启动或失败返回-1
+ */
+int log_start_async(size_t capacity, int flush_interval_ms)
+{
+	size_t cap = 2;
+
+	if (ring)
+		return -1;
+
+	if (capacity == 0)
+		capacity = LOG_ASYNC_DEFAULT_CAPACITY;
+	while (cap < capacity)
+		cap <<= 1;
+
+	ring = (LogRecord *)malloc(cap * sizeof(LogRecord));
+	if (!ring)
+		return -1;
+	for (size_t i = 0; i < cap; i++)
+		atomic_init(&ring[i].seq, i);
+	ring_mask = cap - 1;
+	atomic_store(&ring_head, 0);
+	ring_tail = 0;
+	atomic_store(&async_dropped, 0);
+	reported_dropped = 0;
+	flush_interval = flush_interval_ms > 0 ? flush_interval_ms : 1;
+
+	atomic_store(&async_enabled, 1);
+	if (platform_thread_create(&flush_thread, flush_main, NULL) != 0)
+	{
+		atomic_store(&async_enabled, 0);
+		safe_free((void **)&ring);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief 停止异步日志
+ *
+ * 写出缓冲区中剩余的日志后回到同步模式。未启动时不做任何事。
+ */
+void log_stop_async(void)
+{
+	if (!ring)
+		return;
+
+	atomic_store(&async_enabled, 0);
+	platform_thread_join(flush_thread);
+	safe_free((void **)&ring);
+}
+
+/**
+ * @brief 获取异步模式下因缓冲区已满丢弃的日志条数
+ *
+ * @return size_t 累计丢弃条数
+ */
+size_t log_dropped_count(void)
+{
+	return atomic_load(&async_dropped);
+}
+
 /**
  * @brief 记录日志消息
  *
@@ -103,7 +336,7 @@ void set_log_file(const char *filename)
 void log_message(LogLevel level, const char *format, ...)
 {
 	/* 如果日志级别低于当前设置的最低级别，则忽略此日志 */
-	if (level < current_log_level)
+	if ((int)level < atomic_load_explicit(&log_current_level, memory_order_relaxed))
 	{
 		return;
 	}
@@ -114,6 +347,19 @@ void log_message(LogLevel level, const char *format, ...)
 		level = LOG_INFO;
 	}
 
+	/* 异步模式：格式化进环形缓冲区的槽位后立即返回 */
+	atomic_fetch_add(&async_writers, 1);
+	if (atomic_load(&async_enabled))
+	{
+		va_list args;
+		va_start(args, format);
+		enqueue_record(level, format, args);
+		va_end(args);
+		atomic_fetch_sub(&async_writers, 1);
+		return;
+	}
+	atomic_fetch_sub(&async_writers, 1);
+
 	/* 获取当前时间字符串 */
 	char time_buf[32];
 	get_current_time(time_buf, sizeof(time_buf));
@@ -127,21 +373,7 @@ void log_message(LogLevel level, const char *format, ...)
 
 	/* 格式化日志前缀（基于当前输出目标决定是否需要颜色） */
 	char prefix[256];
-	if (log_file == stdout || log_file == stderr)
-	{
-		/* 控制台输出：带颜色 */
-		snprintf(prefix, sizeof(prefix), "%s[%s]%s %s: ",
-				 log_level_colors[level],
-				 time_buf,
-				 "\x1b[0m",
-				 log_level_strings[level]);
-	}
-	else
-	{
-		/* 文件输出：无颜色 */
-		snprintf(prefix, sizeof(prefix), "[%s] %s: ",
-				 time_buf, log_level_strings[level]);
-	}
+	format_prefix(prefix, sizeof(prefix), log_file, level, time_buf);
 
 	/* 获取可变参数并在持锁期间写入，避免在写入过程中被 set_log_file 干扰 */
 	va_list args;
@@ -161,7 +393,7 @@ void log_message(LogLevel level, const char *format, ...)
 /**
  * @brief 记录客户端相关事件
  *
- * 记录与客户端相关的事件日志，包括客户端ID、用户ID、用户名和IP地址等信息。
+ * 记录与客户端相关的事件日志，包括客户端ID、用户ID、用户名和套接字。
  *
  * @param event 事件描述字符串
  * @param client 客户端结构指针，可以为NULL
@@ -171,9 +403,9 @@ void log_client_event(const char *event, Client *client)
 	if (client)
 	{
 		/* 记录客户端详细信息 */
-		LOG_INFO("%s: client_id=%d, user_id=%d, username=%s, ip=%s:%d",
+		LOG_INFO("%s: client_id=%d, user_id=%d, username=%s, fd=%lld",
 				 event, client->client_id, client->user_id,
-				 client->username, client->remote_ip, client->remote_port);
+				 client->username, SOCKET_ID(client->sockfd));
 	}
 	else
 	{
@@ -0,0 +1,325 @@
+/**
+ * @file utils/metrics.c
+ * @brief 指标登记实现
+ *
+ * 每个线程第一次记录时分配一个自己的指标块，挂到全局链表上，之后只有该线程写它：
+ * 计数器和直方图的更新只是对本线程数据的一次读和一次写（宽松原子序），
+ * 不加锁也不做跨核的原子读改写，满负载下可以一直开启。
+ * 读取时遍历所有线程的指标块求和，结果是近似的瞬时值。
+ *
+ * 直方图按 HDR 的对数-线性方式分桶：每个2的幂区间再等分为 4 个子桶，
+ * 相对误差不超过 25%，124 个桶覆盖 0 到 2^32-1（以微秒计约 71 分钟）。
+ * 指标块在进程退出前不释放，线程退出后其计数仍计入总数。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** 每个 2 的幂区间的子桶数的位数 */
+#define METRICS_SUB_BITS 2
+#define METRICS_SUB_COUNT (1 << METRICS_SUB_BITS)
+
+/** 直方图能区分的最大值，更大的值计入最后一个桶 */
+#define METRICS_VALUE_MAX 0xFFFFFFFFull
+
+/**
+ * @brief 一个线程的直方图
+ */
+typedef struct
+{
+	atomic_uint_fast64_t buckets[METRICS_HISTOGRAM_BUCKETS]; /**< 各桶的计数 */
+	atomic_uint_fast64_t count;								 /**< 记录次数 */
+	atomic_uint_fast64_t sum;								 /**< 记录值之和 */
+	atomic_uint_fast64_t max;								 /**< 最大记录值 */
+} ThreadHistogram;
+
+/**
+ * @brief 一个线程的全部指标，只由所属线程写入
+ */
+typedef struct MetricsBlock
+{
+	struct MetricsBlock *next;							/**< 全局链表的下一个块 */
+	atomic_uint_fast64_t counters[METRICS_MAX_COUNTERS]; /**< 计数器 */
+	ThreadHistogram histograms[METRICS_MAX_HISTOGRAMS];	/**< 直方图 */
+} MetricsBlock;
+
+static _Atomic(MetricsBlock *) blocks_head = NULL;
+static PLATFORM_THREAD_LOCAL MetricsBlock *thread_block = NULL;
+
+/** 指标名称，在启动时定义，之后只读 */
+static const char *counter_names[METRICS_MAX_COUNTERS];
+static const char *histogram_names[METRICS_MAX_HISTOGRAMS];
+static const char *histogram_labels[METRICS_MAX_HISTOGRAMS];
+
+/**
+ * @brief 获取当前线程的指标块，第一次调用时分配
+ *
+ * @return MetricsBlock* 指标块，内存不足返回NULL（之后的记录被忽略）
+ */
+static MetricsBlock *current_block(void)
+{
+	MetricsBlock *block = thread_block;
+	if (block)
+		return block;
+
+	block = (MetricsBlock *)calloc(1, sizeof(MetricsBlock));
+	if (!block)
+		return NULL;
+
+	MetricsBlock *head = atomic_load_explicit(&blocks_head, memory_order_relaxed);
+	do
+	{
+		block->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(&blocks_head, &head, block,
+													memory_order_release, memory_order_relaxed));
+	thread_block = block;
+	return block;
+}
+
+/**
+ * @brief 单写者累加：只有所属线程写入，不需要原子读改写
+ */
+static void bump(atomic_uint_fast64_t *slot, uint64_t n)
+{
+	atomic_store_explicit(slot, atomic_load_explicit(slot, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/**
+ * @brief 计算值所在的桶
+ */
+static int bucket_of(uint64_t value)
+{
+	if (value > METRICS_VALUE_MAX)
+		value = METRICS_VALUE_MAX;
+	if (value < METRICS_SUB_COUNT)
+		return (int)value;
+
+	int msb = 63;
+	while (!(value >> msb))
+		msb--;
+	int sub = (int)(value >> (msb - METRICS_SUB_BITS)) & (METRICS_SUB_COUNT - 1);
+	return (msb - METRICS_SUB_BITS + 1) * METRICS_SUB_COUNT + sub;
+}
+
+/**
+ * @brief 获取桶能表示的最大值
+ */
+static uint64_t bucket_upper(int bucket)
+{
+	if (bucket < METRICS_SUB_COUNT)
+		return (uint64_t)bucket;
+
+	int msb = bucket / METRICS_SUB_COUNT + METRICS_SUB_BITS - 1;
+	uint64_t sub = (uint64_t)(bucket % METRICS_SUB_COUNT);
+	uint64_t width = (uint64_t)1 << (msb - METRICS_SUB_BITS);
+	return ((METRICS_SUB_COUNT + sub) << (msb - METRICS_SUB_BITS)) + width - 1;
+}
+
+/**
+ * @brief 定义计数器的名称，未定义名称的计数器不出现在导出结果中
+ *
+ * @param id 计数器编号
+ * @param name 名称，必须是静态字符串
+ */
+void metrics_define_counter(int id, const char *name)
+{
+	if (id >= 0 && id < METRICS_MAX_COUNTERS)
+		counter_names[id] = name;
+}
+
+/**
+ * @brief 定义直方图的名称和标签
+ *
+ * 多个直方图可以共用一个名称，以标签区分（如每种命令一个直方图）。
+ *
+ * @param id 直方图编号
+ * @param name 名称，必须是静态字符串
+ * @param label 标签（如 command="LOGIN"），可为NULL，必须是静态字符串
+ */
+void metrics_define_histogram(int id, const char *name, const char *label)
+{
+	if (id >= 0 && id < METRICS_MAX_HISTOGRAMS)
+	{
+		histogram_names[id] = name;
+		histogram_labels[id] = label;
+	}
+}
+
+/**
+ * @brief 累加计数器
+ *
+ * @param id 计数器编号
+ * @param n 增量
+ */
+void metrics_add(int id, uint64_t n)
+{
+	if (id < 0 || id >= METRICS_MAX_COUNTERS)
+		return;
+
+	MetricsBlock *block = current_block();
+	if (block)
+		bump(&block->counters[id], n);
+}
+
+/**
+ * @brief 在直方图中记录一个值
+ *
+ * @param id 直方图编号
+ * @param value 值（如微秒数）
+ */
+void metrics_record(int id, uint64_t value)
+{
+	if (id < 0 || id >= METRICS_MAX_HISTOGRAMS)
+		return;
+
+	MetricsBlock *block = current_block();
+	if (!block)
+		return;
+
+	ThreadHistogram *h = &block->histograms[id];
+	bump(&h->buckets[bucket_of(value)], 1);
+	bump(&h->count, 1);
+	bump(&h->sum, value);
+	if (value > atomic_load_explicit(&h->max, memory_order_relaxed))
+		atomic_store_explicit(&h->max, value, memory_order_relaxed);
+}
+
+/**
+ * @brief 获取计数器在所有线程上的合计
+ *
+ * @param id 计数器编号
+ * @return uint64_t 合计值
+ */
+uint64_t metrics_counter(int id)
+{
+	uint64_t total = 0;
+
+	if (id < 0 || id >= METRICS_MAX_COUNTERS)
+		return 0;
+
+	for (MetricsBlock *block = atomic_load_explicit(&blocks_head, memory_order_acquire); block; block = block->next)
+		total += atomic_load_explicit(&block->counters[id], memory_order_relaxed);
+	return total;
+}
+
+/**
+ * @brief 合并所有线程的直方图并计算分位数
+ *
+ * 分位数取所在桶的上界，不超过最大记录值。
+ *
+ * @param id 直方图编号
+ * @param out 输出统计
+ * @return int 成功返回0，编号无效返回-1
+ */
+int metrics_histogram(int id, MetricsSummary *out)
+{
+	uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+
+	if (id < 0 || id >= METRICS_MAX_HISTOGRAMS || !out)
+		return -1;
+
+	memset(out, 0, sizeof(MetricsSummary));
+	memset(buckets, 0, sizeof(buckets));
+	for (MetricsBlock *block = atomic_load_explicit(&blocks_head, memory_order_acquire); block; block = block->next)
+	{
+		ThreadHistogram *h = &block->histograms[id];
+		uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+		out->sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+		if (max > out->max)
+			out->max = max;
+		for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+		{
+			uint64_t n = atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+			buckets[i] += n;
+			out->count += n;
+		}
+	}
+	if (out->count == 0)
+		return 0;
+
+	/* 按桶累计找到各分位数所在的桶，count 取自桶的合计，读取期间的并发写入不会让分位数越界 */
+	const double quantiles[4] = {0.5, 0.9, 0.99, 0.999};
+	uint64_t *targets[4] = {&out->p50, &out->p90, &out->p99, &out->p999};
+	uint64_t seen = 0;
+	int q = 0;
+	for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS && q < 4; i++)
+	{
+		seen += buckets[i];
+		while (q < 4 && (double)seen >= quantiles[q] * (double)out->count)
+		{
+			uint64_t upper = bucket_upper(i);
+			*targets[q++] = upper < out->max ? upper : out->max;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief 以 Prometheus 文本格式导出所有已定义名称的计数器和直方图
+ *
+ * 计数器导出为 <prefix>_<name>_total，直方图导出为带 quantile 标签的 summary。
+ *
+ * @param buf 输出缓冲区
+ * @param cap 缓冲区大小
+ * @param prefix 指标名前缀
+ * @return size_t 写入的字节数（不含结尾的空字符），空间不足时截断在完整的行
+ */
+size_t metrics_format(char *buf, size_t cap, const char *prefix)
+{
+	size_t used = 0;
+	char line[256];
+
+	if (!buf || cap == 0)
+		return 0;
+	buf[0] = '\0';
+	if (!prefix)
+		prefix = "";
+
+#define METRICS_APPEND(...)                                         \
+	do                                                              \
+	{                                                               \
+		int n = snprintf(line, sizeof(line), __VA_ARGS__);          \
+		if (n < 0 || (size_t)n >= sizeof(line) || used + n >= cap)  \
+			return used;                                            \
+		memcpy(buf + used, line, (size_t)n + 1);                    \
+		used += (size_t)n;                                          \
+	} while (0)
+
+	for (int id = 0; id < METRICS_MAX_COUNTERS; id++)
+	{
+		if (!counter_names[id])
+			continue;
+		METRICS_APPEND("# TYPE %s_%s_total counter\n", prefix, counter_names[id]);
+		METRICS_APPEND("%s_%s_total %llu\n", prefix, counter_names[id], (unsigned long long)metrics_counter(id));
+	}
+
+	const char *last_family = NULL;
+	for (int id = 0; id < METRICS_MAX_HISTOGRAMS; id++)
+	{
+		MetricsSummary s;
+		if (!histogram_names[id] || metrics_histogram(id, &s) != 0)
+			continue;
+
+		const char *label = histogram_labels[id] ? histogram_labels[id] : "";
+		const char *sep = label[0] ? "," : "";
+		if (!last_family || strcmp(last_family, histogram_names[id]) != 0)
+		{
+			METRICS_APPEND("# TYPE %s_%s summary\n", prefix, histogram_names[id]);
+			last_family = histogram_names[id];
+		}
+		METRICS_APPEND("%s_%s{%s%squantile=\"0.5\"} %llu\n", prefix, histogram_names[id], label, sep, (unsigned long long)s.p50);
+		METRICS_APPEND("%s_%s{%s%squantile=\"0.9\"} %llu\n", prefix, histogram_names[id], label, sep, (unsigned long long)s.p90);
+		METRICS_APPEND("%s_%s{%s%squantile=\"0.99\"} %llu\n", prefix, histogram_names[id], label, sep, (unsigned long long)s.p99);
+		METRICS_APPEND("%s_%s{%s%squantile=\"0.999\"} %llu\n", prefix, histogram_names[id], label, sep, (unsigned long long)s.p999);
+		METRICS_APPEND("%s_%s_sum{%s} %llu\n", prefix, histogram_names[id], label, (unsigned long long)s.sum);
+		METRICS_APPEND("%s_%s_count{%s} %llu\n", prefix, histogram_names[id], label, (unsigned long long)s.count);
+	}
+
+#undef METRICS_APPEND
+	return used;
+}
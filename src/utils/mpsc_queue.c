@@ -0,0 +1,102 @@
+/**
+ * @file utils/mpsc_queue.c
+ * @brief 多生产者单消费者无锁队列实现
+ *
+ * 侵入式链表队列：生产者只用一次原子交换把节点挂到队尾，不需要加锁；
+ * 唯一的消费者线程从另一端取出。哨兵节点保证队列永不为空链表，
+ * 生产者交换完成但尚未链接时消费者会暂时看到空队列，稍后重试即可。
+ * 用于多 reactor 模式下向其他线程的连接分片投递消息。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include "utils.h"
+
+/**
+ * @brief 初始化队列
+ *
+ * @param q 队列指针
+ */
+void mpsc_queue_init(MpscQueue *q)
+{
+	if (!q)
+		return;
+
+	atomic_init(&q->stub.next, NULL);
+	atomic_init(&q->head, &q->stub);
+	q->tail = &q->stub;
+}
+
+/**
+ * @brief 追加节点
+ *
+ * 任意线程可并发调用。
+ *
+ * @param q 队列指针
+ * @param node 节点
+ */
+void mpsc_queue_push(MpscQueue *q, MpscNode *node)
+{
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+	MpscNode *prev = atomic_exchange_explicit(&q->head, node, memory_order_acq_rel);
+	atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+/**
+ * @brief 取出队首节点
+ *
+ * 只能由唯一的消费者线程调用。
+ *
+ * @param q 队列指针
+ * @return MpscNode* 队首节点，暂时没有可取的节点返回NULL
+ */
+MpscNode *mpsc_queue_pop(MpscQueue *q)
+{
+	MpscNode *tail = q->tail;
+	MpscNode *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+	/* 跳过哨兵 */
+	if (tail == &q->stub)
+	{
+		if (!next)
+			return NULL;
+		q->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&next->next, memory_order_acquire);
+	}
+
+	if (next)
+	{
+		q->tail = next;
+		return tail;
+	}
+
+	/* tail 不是最后追加的节点，说明有生产者正在链接，稍后再取 */
+	if (tail != atomic_load_explicit(&q->head, memory_order_acquire))
+		return NULL;
+
+	/* tail 是最后一个节点：重新挂上哨兵，才能把 tail 取出 */
+	mpsc_queue_push(q, &q->stub);
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if (next)
+	{
+		q->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/**
+ * @brief 判断队列是否确实为空
+ *
+ * 只能由唯一的消费者线程调用。mpsc_queue_pop 返回 NULL 时可能只是生产者还没链接好，
+ * 此时本函数返回 0，调用方需要稍后再取，不能当作队列已空。
+ *
+ * @param q 队列指针
+ * @return int 没有已追加或正在追加的节点返回1，否则返回0
+ */
+int mpsc_queue_empty(MpscQueue *q)
+{
+	return q->tail == &q->stub && atomic_load_explicit(&q->head, memory_order_acquire) == &q->stub;
+}
@@ -0,0 +1,395 @@
+/**
+ * @file utils/object_pool.c
+ * @brief 定长对象池实现
+ *
+ * 每个池只分配一种大小的对象，按块（slab）向系统申请内存，块内对象连续，
+ * 块一经分配直到池销毁才释放，对象地址在整个生命周期内稳定。
+ * 空闲对象用对象本身的前几个字节串成链表，不需要额外的元数据。
+ *
+ * 每个线程为每个池保留一个本地空闲链表：分配和释放先走本地链表，不加锁；
+ * 本地链表为空时从全局链表一次取 OBJECT_POOL_BATCH 个，本地链表过长时
+ * 一次归还 OBJECT_POOL_BATCH 个，全局链表由池的互斥锁保护。
+ * 在一个线程分配、在另一个线程释放的对象会留在释放方的本地链表中，
+ * 经批量归还回到全局链表。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** 对象和块头的对齐字节数 */
+#define OBJECT_POOL_ALIGN 16
+
+/** 未指定每块对象数时，每块的目标字节数 */
+#define OBJECT_POOL_SLAB_BYTES (64 * 1024)
+
+/** 向上取整到对齐边界 */
+#define POOL_ROUND_UP(n) (((n) + OBJECT_POOL_ALIGN - 1) & ~(size_t)(OBJECT_POOL_ALIGN - 1))
+
+/**
+ * @brief 一块连续分配的对象，头部之后紧跟 count 个对象
+ */
+struct ObjectPoolSlab
+{
+	struct ObjectPoolSlab *next; /**< 同一池的下一块 */
+	size_t count;				 /**< 本块的对象数 */
+};
+
+/**
+ * @brief 线程为一个池保留的本地空闲链表
+ */
+typedef struct
+{
+	ObjectPool *pool;		 /**< 所属池，NULL 表示未使用 */
+	unsigned int generation; /**< 建立链表时池的代数，池被销毁后链表作废 */
+	void *head;				 /**< 空闲对象链表 */
+	size_t count;			 /**< 链表中的对象数 */
+} PoolCache;
+
+static PLATFORM_THREAD_LOCAL PoolCache pool_caches[OBJECT_POOL_MAX_POOLS];
+static atomic_int pool_id_counter = 0;
+
+/** 空闲对象的链接字段保存在对象开头 */
+static void *next_of(void *obj)
+{
+	return *(void **)obj;
+}
+
+static void set_next(void *obj, void *next)
+{
+	*(void **)obj = next;
+}
+
+/**
+ * @brief 对象在块中的步长
+ */
+static size_t object_stride(const ObjectPool *pool)
+{
+	size_t size = pool->object_size < sizeof(void *) ? sizeof(void *) : pool->object_size;
+	return POOL_ROUND_UP(size);
+}
+
+/**
+ * @brief 为池分配一个编号，用于定位线程本地链表
+ *
+ * 编号用完时返回-1，该池之后只使用全局链表。
+ */
+static int pool_id(ObjectPool *pool)
+{
+	int id = atomic_load_explicit(&pool->id, memory_order_acquire);
+	if (id != 0)
+		return id;
+
+	platform_mutex_lock(&pool->lock);
+	id = atomic_load_explicit(&pool->id, memory_order_relaxed);
+	if (id == 0)
+	{
+		id = atomic_fetch_add(&pool_id_counter, 1) + 1;
+		if (id > OBJECT_POOL_MAX_POOLS)
+		{
+			LOG_WARN("Object pool %s has no thread cache (limit %d)", pool->name, OBJECT_POOL_MAX_POOLS);
+			id = -1;
+		}
+		atomic_store_explicit(&pool->id, id, memory_order_release);
+	}
+	platform_mutex_unlock(&pool->lock);
+	return id;
+}
+
+/**
+ * @brief 获取当前线程对该池的本地链表
+ *
+ * @return PoolCache* 本地链表，池没有线程缓存时返回NULL
+ */
+static PoolCache *thread_cache(ObjectPool *pool)
+{
+	int id = pool_id(pool);
+	if (id < 0)
+		return NULL;
+
+	PoolCache *cache = &pool_caches[id - 1];
+	unsigned int generation = atomic_load_explicit(&pool->generation, memory_order_acquire);
+	if (cache->pool != pool || cache->generation != generation)
+	{
+		/* 池已被销毁重建，旧链表中的对象所在的块已经释放 */
+		cache->pool = pool;
+		cache->generation = generation;
+		cache->head = NULL;
+		cache->count = 0;
+	}
+	return cache;
+}
+
+/**
+ * @brief 新分配一块对象并挂到全局空闲链表（在锁内调用）
+ *
+ * @return int 成功返回0，内存不足返回-1
+ */
+static int add_slab(ObjectPool *pool)
+{
+	size_t stride = object_stride(pool);
+	size_t count = pool->slab_objects;
+	if (count == 0)
+	{
+		count = OBJECT_POOL_SLAB_BYTES / stride;
+		if (count < OBJECT_POOL_BATCH)
+			count = OBJECT_POOL_BATCH;
+	}
+
+	struct ObjectPoolSlab *slab = (struct ObjectPoolSlab *)malloc(POOL_ROUND_UP(sizeof(*slab)) + count * stride);
+	if (!slab)
+		return -1;
+	slab->count = count;
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	/* 倒序挂入，分配时按地址递增取出 */
+	char *base = (char *)slab + POOL_ROUND_UP(sizeof(*slab));
+	for (size_t i = count; i > 0; i--)
+	{
+		void *obj = base + (i - 1) * stride;
+		set_next(obj, pool->free_list);
+		pool->free_list = obj;
+	}
+	pool->free_count += count;
+	pool->capacity += count;
+	return 0;
+}
+
+/**
+ * @brief 把本地链表的前 n 个对象归还全局链表（在锁内调用）
+ */
+static void return_to_global(ObjectPool *pool, PoolCache *cache, size_t n)
+{
+	while (n-- > 0 && cache->head)
+	{
+		void *obj = cache->head;
+		cache->head = next_of(obj);
+		cache->count--;
+		set_next(obj, pool->free_list);
+		pool->free_list = obj;
+		pool->free_count++;
+	}
+}
+
+/**
+ * @brief 记录一次分配并更新峰值
+ */
+static void count_alloc(ObjectPool *pool)
+{
+	size_t now = atomic_fetch_add_explicit(&pool->in_use, 1, memory_order_relaxed) + 1;
+	size_t peak = atomic_load_explicit(&pool->high_water, memory_order_relaxed);
+	while (now > peak && !atomic_compare_exchange_weak_explicit(&pool->high_water, &peak, now,
+																memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+/**
+ * @brief 从池中分配一个已清零的对象
+ *
+ * @param pool 对象池
+ * @return void* 成功返回对象，内存不足返回NULL
+ */
+void *object_pool_alloc(ObjectPool *pool)
+{
+	void *obj = NULL;
+
+	if (!pool)
+		return NULL;
+
+	PoolCache *cache = thread_cache(pool);
+	if (cache && cache->head)
+	{
+		obj = cache->head;
+		cache->head = next_of(obj);
+		cache->count--;
+	}
+	else
+	{
+		platform_mutex_lock(&pool->lock);
+		if (!pool->free_list && add_slab(pool) != 0)
+		{
+			platform_mutex_unlock(&pool->lock);
+			LOG_ERROR("Object pool %s out of memory", pool->name);
+			return NULL;
+		}
+		obj = pool->free_list;
+		pool->free_list = next_of(obj);
+		pool->free_count--;
+
+		/* 顺带取一批到本地链表，接下来的分配不再加锁 */
+		for (int i = 1; cache && i < OBJECT_POOL_BATCH && pool->free_list; i++)
+		{
+			void *extra = pool->free_list;
+			pool->free_list = next_of(extra);
+			pool->free_count--;
+			set_next(extra, cache->head);
+			cache->head = extra;
+			cache->count++;
+		}
+		platform_mutex_unlock(&pool->lock);
+	}
+
+	memset(obj, 0, pool->object_size);
+	count_alloc(pool);
+	return obj;
+}
+
+/**
+ * @brief 把对象归还对象池
+ *
+ * @param pool 对象池
+ * @param obj 由同一池分配的对象，NULL 时不做任何事
+ */
+void object_pool_free(ObjectPool *pool, void *obj)
+{
+	if (!pool || !obj)
+		return;
+
+	PoolCache *cache = thread_cache(pool);
+	if (cache)
+	{
+		set_next(obj, cache->head);
+		cache->head = obj;
+		cache->count++;
+		if (cache->count >= 2 * OBJECT_POOL_BATCH)
+		{
+			platform_mutex_lock(&pool->lock);
+			return_to_global(pool, cache, OBJECT_POOL_BATCH);
+			platform_mutex_unlock(&pool->lock);
+		}
+	}
+	else
+	{
+		platform_mutex_lock(&pool->lock);
+		set_next(obj, pool->free_list);
+		pool->free_list = obj;
+		pool->free_count++;
+		platform_mutex_unlock(&pool->lock);
+	}
+	atomic_fetch_sub_explicit(&pool->in_use, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief 预先分配对象，使池的总容量至少为 count
+ *
+ * @param pool 对象池
+ * @param count 期望容量
+ * @return int 成功返回0，内存不足返回-1
+ */
+int object_pool_reserve(ObjectPool *pool, size_t count)
+{
+	int result = 0;
+
+	if (!pool)
+		return -1;
+
+	platform_mutex_lock(&pool->lock);
+	while (pool->capacity < count)
+	{
+		if (add_slab(pool) != 0)
+		{
+			result = -1;
+			break;
+		}
+	}
+	platform_mutex_unlock(&pool->lock);
+	return result;
+}
+
+/**
+ * @brief 获取正在使用的对象数
+ *
+ * @param pool 对象池
+ * @return size_t 对象数
+ */
+size_t object_pool_in_use(ObjectPool *pool)
+{
+	return pool ? atomic_load_explicit(&pool->in_use, memory_order_relaxed) : 0;
+}
+
+/**
+ * @brief 获取同时使用的对象数的峰值
+ *
+ * @param pool 对象池
+ * @return size_t 对象数
+ */
+size_t object_pool_high_water(ObjectPool *pool)
+{
+	return pool ? atomic_load_explicit(&pool->high_water, memory_order_relaxed) : 0;
+}
+
+/**
+ * @brief 获取池已分配的对象总数（使用中和空闲）
+ *
+ * @param pool 对象池
+ * @return size_t 对象数
+ */
+size_t object_pool_capacity(ObjectPool *pool)
+{
+	if (!pool)
+		return 0;
+
+	platform_mutex_lock(&pool->lock);
+	size_t capacity = pool->capacity;
+	platform_mutex_unlock(&pool->lock);
+	return capacity;
+}
+
+/**
+ * @brief 把当前线程所有本地链表中的对象归还全局链表
+ *
+ * 线程退出前调用，否则本地链表中的对象要到池销毁时才能再被使用。
+ */
+void object_pool_thread_release(void)
+{
+	for (int i = 0; i < OBJECT_POOL_MAX_POOLS; i++)
+	{
+		PoolCache *cache = &pool_caches[i];
+		ObjectPool *pool = cache->pool;
+		if (!pool)
+			continue;
+
+		platform_mutex_lock(&pool->lock);
+		if (cache->generation == atomic_load_explicit(&pool->generation, memory_order_relaxed))
+			return_to_global(pool, cache, cache->count);
+		platform_mutex_unlock(&pool->lock);
+		cache->pool = NULL;
+		cache->head = NULL;
+		cache->count = 0;
+	}
+}
+
+/**
+ * @brief 释放池的全部内存
+ *
+ * 之后由该池分配的所有对象失效，各线程的本地链表在下次使用时作废。
+ * 池可以继续使用，计数从零开始。
+ *
+ * @param pool 对象池
+ */
+void object_pool_destroy(ObjectPool *pool)
+{
+	if (!pool)
+		return;
+
+	platform_mutex_lock(&pool->lock);
+	struct ObjectPoolSlab *slab = pool->slabs;
+	while (slab)
+	{
+		struct ObjectPoolSlab *next = slab->next;
+		free(slab);
+		slab = next;
+	}
+	pool->slabs = NULL;
+	pool->free_list = NULL;
+	pool->free_count = 0;
+	pool->capacity = 0;
+	atomic_store(&pool->in_use, 0);
+	atomic_store(&pool->high_water, 0);
+	atomic_fetch_add(&pool->generation, 1);
+	platform_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,430 @@
+/**
+ * @file utils/send_queue.c
+ * @brief 非阻塞套接字的发送队列实现
+ *
+ * 非阻塞套接字的内核发送缓冲区写满时，send 只会写出部分数据或直接返回 EAGAIN。
+ * 本文件为每个连接维护一个帧队列：未写出的字节保留在队列中，等套接字可写时
+ * 再用一次分散写（writev/WSASend）批量发出多帧，同时用高水位限制单个连接
+ * 可积压的字节数，防止慢速读取方耗尽内存。
+ *
+ * 广播等一对多发送使用引用计数的共享帧：消息只序列化一次，
+ * 各接收者的队列节点只持有引用，不再逐个复制。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include "utils.h"
+#include <string.h>
+#include <stdlib.h>
+
+/**
+ * @brief 队列节点：一帧待发送数据
+ */
+struct SendQueueNode
+{
+	struct SendQueueNode *next; /**< 下一帧 */
+	SharedFrame *shared;		/**< 引用的共享帧，复制入队时为NULL */
+	const char *data;			/**< 帧数据起始地址 */
+	size_t len;					/**< 帧长度 */
+	size_t offset;				/**< 已发送的字节数 */
+	char inline_data[];			/**< 复制入队时的帧数据 */
+};
+
+/**
+ * @brief 创建共享帧
+ *
+ * 数据被复制一次，初始引用计数为1，归调用方所有。
+ *
+ * @param data 帧数据
+ * @param len 帧长度
+ * @return SharedFrame* 成功返回共享帧，失败返回NULL
+ */
+SharedFrame *shared_frame_create(const char *data, size_t len)
+{
+	if (!data || len == 0)
+		return NULL;
+
+	SharedFrame *frame = (SharedFrame *)malloc(sizeof(SharedFrame) + len);
+	if (!frame)
+		return NULL;
+
+	atomic_init(&frame->refs, 1);
+	atomic_init(&frame->variant, NULL);
+	frame->len = len;
+	memcpy(frame->data, data, len);
+	return frame;
+}
+
+/**
+ * @brief 增加共享帧的引用
+ *
+ * @param frame 共享帧
+ * @return SharedFrame* 返回 frame 本身
+ */
+SharedFrame *shared_frame_retain(SharedFrame *frame)
+{
+	if (frame)
+		atomic_fetch_add_explicit(&frame->refs, 1, memory_order_relaxed);
+	return frame;
+}
+
+/**
+ * @brief 释放一次共享帧的引用，最后一个引用释放时回收内存
+ *
+ * @param frame 共享帧
+ */
+void shared_frame_release(SharedFrame *frame)
+{
+	if (frame && atomic_fetch_sub_explicit(&frame->refs, 1, memory_order_acq_rel) == 1)
+	{
+		shared_frame_release(atomic_load_explicit(&frame->variant, memory_order_acquire));
+		free(frame);
+	}
+}
+
+/**
+ * @brief 获取共享帧已生成的另一种编码
+ *
+ * @param frame 共享帧
+ * @return SharedFrame* 另一种编码，尚未生成返回NULL
+ */
+SharedFrame *shared_frame_variant(SharedFrame *frame)
+{
+	return frame ? atomic_load_explicit(&frame->variant, memory_order_acquire) : NULL;
+}
+
+/**
+ * @brief 为共享帧挂上另一种编码
+ *
+ * 同一帧可能同时在多个 reactor 线程上发往需要另一种编码的连接，
+ * 用比较交换只保留最先挂上的那个，后来者释放自己生成的副本。
+ *
+ * @param frame 共享帧
+ * @param variant 新生成的编码，所有权转交给 frame
+ * @return SharedFrame* 挂在 frame 上的编码
+ */
+SharedFrame *shared_frame_set_variant(SharedFrame *frame, SharedFrame *variant)
+{
+	SharedFrame *expected = NULL;
+
+	if (!frame || !variant)
+		return NULL;
+	if (atomic_compare_exchange_strong_explicit(&frame->variant, &expected, variant,
+												memory_order_acq_rel, memory_order_acquire))
+		return variant;
+	shared_frame_release(variant);
+	return expected;
+}
+
+/**
+ * @brief 释放队列节点及其持有的共享帧引用
+ */
+static void free_node(SendQueueNode *node)
+{
+	shared_frame_release(node->shared);
+	free(node);
+}
+
+/**
+ * @brief 检查追加 len 字节后是否超过高水位
+ *
+ * 队列为空时总是接受，超过时累计丢弃计数。
+ *
+ * @return int 可以追加返回1，否则返回0
+ */
+static int accepts(SendQueue *q, size_t len)
+{
+	if (q->head && q->bytes + len > q->high_water)
+	{
+		q->dropped++;
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief 把节点挂到队尾并累计未发送字节数
+ */
+static void append_node(SendQueue *q, SendQueueNode *node)
+{
+	node->next = NULL;
+	if (q->tail)
+		q->tail->next = node;
+	else
+		q->head = node;
+	q->tail = node;
+	q->bytes += node->len - node->offset;
+	q->frames++;
+}
+
+/**
+ * @brief 初始化发送队列
+ *
+ * @param q 队列指针
+ * @param high_water 允许积压的最大字节数，0 表示使用 SEND_QUEUE_DEFAULT_HIGH_WATER
+ */
+void send_queue_init(SendQueue *q, size_t high_water)
+{
+	if (!q)
+		return;
+
+	memset(q, 0, sizeof(SendQueue));
+	q->high_water = high_water > 0 ? high_water : SEND_QUEUE_DEFAULT_HIGH_WATER;
+}
+
+/**
+ * @brief 释放队列中所有未发送的帧
+ *
+ * @param q 队列指针
+ */
+void send_queue_free(SendQueue *q)
+{
+	if (!q)
+		return;
+
+	SendQueueNode *node = q->head;
+	while (node)
+	{
+		SendQueueNode *next = node->next;
+		free_node(node);
+		node = next;
+	}
+	q->head = NULL;
+	q->tail = NULL;
+	q->bytes = 0;
+	q->frames = 0;
+	q->dropped = 0;
+}
+
+/**
+ * @brief 追加一帧到队列尾部
+ *
+ * 数据会被复制。队列为空时总是接受（保证已部分写出的帧能完整补发），
+ * 否则追加后超过高水位的帧会被拒绝。
+ *
+ * @param q 队列指针
+ * @param data 帧数据
+ * @param len 帧长度
+ * @return int 成功返回0，超过高水位或内存不足返回-1
+ */
+int send_queue_push(SendQueue *q, const char *data, size_t len)
+{
+	if (!q || !data || len == 0)
+		return -1;
+
+	if (!accepts(q, len))
+		return -1;
+
+	SendQueueNode *node = (SendQueueNode *)malloc(sizeof(SendQueueNode) + len);
+	if (!node)
+		return -1;
+
+	memcpy(node->inline_data, data, len);
+	node->shared = NULL;
+	node->data = node->inline_data;
+	node->len = len;
+	node->offset = 0;
+	append_node(q, node);
+	return 0;
+}
+
+/**
+ * @brief 以引用方式追加一个共享帧
+ *
+ * 不复制帧数据，成功时队列持有一个新的引用，发送完成后释放。
+ *
+ * @param q 队列指针
+ * @param frame 共享帧
+ * @param offset 已直接发出的字节数，从该偏移开始排队
+ * @return int 成功返回0，超过高水位或内存不足返回-1
+ */
+int send_queue_push_shared(SendQueue *q, SharedFrame *frame, size_t offset)
+{
+	if (!q || !frame || offset >= frame->len)
+		return -1;
+
+	if (!accepts(q, frame->len - offset))
+		return -1;
+
+	SendQueueNode *node = (SendQueueNode *)malloc(sizeof(SendQueueNode));
+	if (!node)
+		return -1;
+
+	node->shared = shared_frame_retain(frame);
+	node->data = frame->data;
+	node->len = frame->len;
+	node->offset = offset;
+	append_node(q, node);
+	return 0;
+}
+
+/**
+ * @brief 把队首最多 max 帧未发送的部分填入分散写描述
+ *
+ * 队列不被修改，描述指向的数据在对应的帧被 send_queue_consume 释放之前有效，
+ * 供调用者自行提交（如异步批量发送）。
+ *
+ * @param q 队列指针
+ * @param iov 输出的分散写描述
+ * @param max 最多填入的帧数
+ * @return int 填入的帧数
+ */
+int send_queue_gather(const SendQueue *q, platform_iovec_t *iov, int max)
+{
+	int count = 0;
+
+	if (!q || !iov)
+		return 0;
+	for (const SendQueueNode *node = q->head; node && count < max; node = node->next)
+	{
+		platform_iovec_set(&iov[count++], node->data + node->offset, node->len - node->offset);
+	}
+	return count;
+}
+
+/**
+ * @brief 从队首移除已经写出的 bytes 字节
+ *
+ * 写完的帧立即释放，部分写出的帧记录偏移。
+ *
+ * @param q 队列指针
+ * @param bytes 已写出的字节数
+ * @return int 队列已清空返回1，仍有积压返回0
+ */
+int send_queue_consume(SendQueue *q, size_t bytes)
+{
+	if (!q)
+		return 1;
+
+	q->bytes -= bytes < q->bytes ? bytes : q->bytes;
+	while (bytes > 0 && q->head)
+	{
+		SendQueueNode *node = q->head;
+		size_t left = node->len - node->offset;
+		if (bytes < left)
+		{
+			node->offset += bytes;
+			break;
+		}
+
+		bytes -= left;
+		q->head = node->next;
+		if (!q->head)
+			q->tail = NULL;
+		q->frames--;
+		free_node(node);
+	}
+	return q->head == NULL;
+}
+
+/**
+ * @brief 尽可能多地把队列写入套接字
+ *
+ * 每轮把最多 PLATFORM_IOV_MAX 帧拼成一次分散写，写完的帧立即释放，
+ * 部分写出的帧记录偏移，直到队列清空或套接字暂时不可写。
+ *
+ * @param q 队列指针
+ * @param sockfd 目标套接字
+ * @return int 队列已清空返回1，仍有积压返回0，发送出错返回-1
+ */
+int send_queue_flush(SendQueue *q, socket_t sockfd)
+{
+	platform_iovec_t iov[PLATFORM_IOV_MAX];
+
+	if (!q)
+		return -1;
+
+	while (q->head)
+	{
+		int count = send_queue_gather(q, iov, PLATFORM_IOV_MAX);
+		socket_io_result_t sent = platform_socket_sendv(sockfd, iov, count);
+		if (sent < 0)
+		{
+			if (platform_socket_would_block())
+				return 0;
+			if (platform_socket_interrupted())
+				continue;
+			return -1;
+		}
+
+		send_queue_consume(q, (size_t)sent);
+
+		/* 内核一个字节都没有接受，等待下次可写 */
+		if (q->head && (size_t)sent == 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief 把 src 中的全部帧移到空队列 dst，src 变为空队列
+ *
+ * 帧数据不移动，已交给异步发送的分散写描述仍然有效；用于连接关闭时
+ * 保留仍在发送中的帧，直到发送完成再释放。
+ *
+ * @param dst 目标队列，必须为空
+ * @param src 源队列
+ */
+void send_queue_move(SendQueue *dst, SendQueue *src)
+{
+	if (!dst || !src)
+		return;
+
+	*dst = *src;
+	src->head = NULL;
+	src->tail = NULL;
+	src->bytes = 0;
+	src->frames = 0;
+	src->dropped = 0;
+}
+
+/**
+ * @brief 获取队列中尚未发送的字节数
+ *
+ * @param q 队列指针
+ * @return size_t 积压字节数
+ */
+size_t send_queue_bytes(const SendQueue *q)
+{
+	return q ? q->bytes : 0;
+}
+
+/**
+ * @brief 按发送顺序复制队列中尚未发送的字节，不修改队列
+ *
+ * 进程交接时用于把积压的输出交给新进程补发。
+ *
+ * @param q 队列指针
+ * @param out 输出缓冲区
+ * @param cap 缓冲区大小
+ * @return size_t 复制的字节数，缓冲区不足时只复制前 cap 字节
+ */
+size_t send_queue_copy(const SendQueue *q, char *out, size_t cap)
+{
+	size_t copied = 0;
+
+	if (!q || !out)
+		return 0;
+	for (const SendQueueNode *node = q->head; node && copied < cap; node = node->next)
+	{
+		size_t left = node->len - node->offset;
+		if (left > cap - copied)
+			left = cap - copied;
+		memcpy(out + copied, node->data + node->offset, left);
+		copied += left;
+	}
+	return copied;
+}
+
+/**
+ * @brief 判断队列是否为空
+ *
+ * @param q 队列指针
+ * @return int 为空返回1，否则返回0
+ */
+int send_queue_empty(const SendQueue *q)
+{
+	return !q || q->head == NULL;
+}
@@ -15,42 +15,93 @@
 #include <string.h>
 #include <stdlib.h>
 
+/** 默认时间戳格式 YYYY-MM-DD HH:MM:SS 的长度（不含结尾的空字符） */
+#define TIMESTAMP_LEN 19
+
 /**
- * @brief 获取当前时间字符串
+ * @brief 线程最近一次格式化的秒及其字符串
  *
- * 获取当前系统时间并按照指定格式(YYYY-MM-DD HH:MM:SS)格式化为字符串。
- * 该函数考虑了线程安全性，在不同平台上使用适当的线程安全函数。
+ * 构建消息、序列化和写日志在同一秒内反复取时间，按秒缓存后只有跨秒时才
+ * 调用 localtime 和 strftime，其余情况只是一次比较和 memcpy。
+ * 缓存是线程本地的，读写都不需要加锁。
+ */
+typedef struct
+{
+	time_t second;					/**< 缓存对应的秒，-1 表示空 */
+	char text[TIMESTAMP_LEN + 1];	/**< 格式化结果 */
+} TimestampCache;
+
+static PLATFORM_THREAD_LOCAL TimestampCache timestamp_cache = {-1, ""};
+
+/**
+ * @brief 按默认格式(YYYY-MM-DD HH:MM:SS)格式化时间
  *
+ * 与线程上一次格式化的是同一秒时直接复制缓存的字符串。
+ *
+ * @param t 要格式化的时间
  * @param buffer 存储时间字符串的缓冲区
- * @param buf_size 缓冲区大小
+ * @param buf_size 缓冲区大小，小于20字节时结果为空字符串
  */
-void get_current_time(char *buffer, size_t buf_size)
+void format_timestamp(time_t t, char *buffer, size_t buf_size)
 {
 	/* 检查参数有效性 */
 	if (!buffer || buf_size == 0)
 		return;
+	if (buf_size <= TIMESTAMP_LEN)
+	{
+		buffer[0] = '\0';
+		return;
+	}
 
-	/* 获取当前时间 */
-	time_t now = time(NULL);
-	struct tm tm_info;
+	TimestampCache *cache = &timestamp_cache;
+	if (cache->second != t)
+	{
+		struct tm tm_info;
 
-	/* 根据平台使用线程安全的本地时间转换函数 */
+		/* 根据平台使用线程安全的本地时间转换函数 */
 #if defined(_POSIX_THREAD_SAFE_FUNCTIONS) || defined(__linux__)
-	/* Linux/Unix系统使用线程安全的localtime_r函数 */
-	platform_localtime(&now, &tm_info);
+		/* Linux/Unix系统使用线程安全的localtime_r函数 */
+		if (!platform_localtime(&t, &tm_info))
+		{
+			buffer[0] = '\0';
+			return;
+		}
 #else
-	/* 其他系统使用标准localtime函数并复制结果 */
-	struct tm *tmp = localtime(&now);
-	if (tmp)
+		/* 其他系统使用标准localtime函数并复制结果 */
+		struct tm *tmp = localtime(&t);
+		if (!tmp)
+		{
+			buffer[0] = '\0';
+			return;
+		}
 		tm_info = *tmp;
 #endif
 
-	/* 将时间格式化为字符串 */
-	if (strftime(buffer, buf_size, "%Y-%m-%d %H:%M:%S", &tm_info) == 0)
-	{
-		/* 如果缓冲区太小，确保至少为空字符串 */
-		buffer[0] = '\0';
+		if (strftime(cache->text, sizeof(cache->text), "%Y-%m-%d %H:%M:%S", &tm_info) == 0)
+		{
+			/* 年份超出四位等情况放不下，不缓存 */
+			cache->second = -1;
+			buffer[0] = '\0';
+			return;
+		}
+		cache->second = t;
 	}
+
+	memcpy(buffer, cache->text, TIMESTAMP_LEN + 1);
+}
+
+/**
+ * @brief 获取当前时间字符串
+ *
+ * 获取当前系统时间并按照指定格式(YYYY-MM-DD HH:MM:SS)格式化为字符串，
+ * 同一秒内的调用复用线程缓存的结果。
+ *
+ * @param buffer 存储时间字符串的缓冲区
+ * @param buf_size 缓冲区大小
+ */
+void get_current_time(char *buffer, size_t buf_size)
+{
+	format_timestamp(time(NULL), buffer, buf_size);
 }
 
 /**
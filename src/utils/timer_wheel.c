@@ -0,0 +1,313 @@
+/**
+ * @file utils/timer_wheel.c
+ * @brief 分层时间轮实现
+ *
+ * 时间按固定的刻度（tick）推进，共 TIMER_WHEEL_LEVELS 层，每层 TIMER_WHEEL_SLOTS 个槽，
+ * 第 n 层的一个槽覆盖 64^n 个刻度。定时器按到期刻度与当前刻度的距离放入能容纳它的
+ * 最低一层，挂在对应槽的双向链表上，设置、重设和取消都是常数时间。
+ * 第0层转完一圈时把上一层当前槽中的定时器重新放入（级联），它们随之落到更低的层。
+ * 推进时只处理到期的槽，不扫描所有定时器。
+ *
+ * 超出最高层范围的定时器先放在最高层，到期时间保存在定时器中，
+ * 落到第0层时还没到期就重新放入。时间轮不加锁，只能由所属线程使用。
+ *
+ * @author 开发团队
+ * @date 2025
+ */
+
+#include "utils.h"
+#include <string.h>
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+/** 时间轮能直接表示的最大刻度距离 */
+#define TIMER_WHEEL_SPAN ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+/**
+ * @brief 把定时器从所在链表中摘下
+ */
+static void unlink_timer(TimerNode *timer)
+{
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->next = NULL;
+	timer->prev = NULL;
+}
+
+/**
+ * @brief 把定时器挂到链表尾部
+ */
+static void append_timer(TimerNode *head, TimerNode *timer)
+{
+	timer->prev = head->prev;
+	timer->next = head;
+	head->prev->next = timer;
+	head->prev = timer;
+}
+
+/**
+ * @brief 按到期刻度把定时器放入对应的层和槽
+ */
+static void place_timer(TimerWheel *wheel, TimerNode *timer)
+{
+	uint64_t expires = timer->expires;
+	if (expires < wheel->tick)
+		expires = wheel->tick;
+
+	uint64_t delta = expires - wheel->tick;
+	if (delta >= TIMER_WHEEL_SPAN)
+	{
+		/* 先放在最高层能表示的最远位置，落到第0层时再按真实到期时间重新放入 */
+		expires = wheel->tick + TIMER_WHEEL_SPAN - 1;
+		delta = TIMER_WHEEL_SPAN - 1;
+	}
+
+	int level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1))))
+		level++;
+
+	size_t slot = (size_t)(expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+	append_timer(&wheel->slots[level][slot], timer);
+}
+
+/**
+ * @brief 把某层一个槽中的定时器重新放入时间轮
+ *
+ * @return size_t 该槽的编号，为0时需要继续级联上一层
+ */
+static size_t cascade(TimerWheel *wheel, int level)
+{
+	size_t slot = (size_t)(wheel->tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+	TimerNode *head = &wheel->slots[level][slot];
+	TimerNode list;
+
+	if (head->next == head)
+		return slot;
+
+	/* 先整体移到临时链表，重新放入时可能落回同一层 */
+	list.next = head->next;
+	list.prev = head->prev;
+	list.next->prev = &list;
+	list.prev->next = &list;
+	head->next = head;
+	head->prev = head;
+
+	while (list.next != &list)
+	{
+		TimerNode *timer = list.next;
+		unlink_timer(timer);
+		place_timer(wheel, timer);
+	}
+	return slot;
+}
+
+/**
+ * @brief 初始化时间轮
+ *
+ * @param wheel 时间轮
+ * @param tick_ms 每个刻度的毫秒数，为0时使用1毫秒
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ */
+void timer_wheel_init(TimerWheel *wheel, unsigned int tick_ms, uint64_t now_ms)
+{
+	if (!wheel)
+		return;
+
+	memset(wheel, 0, sizeof(TimerWheel));
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+		{
+			wheel->slots[level][slot].next = &wheel->slots[level][slot];
+			wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+		}
+	}
+	wheel->tick_ms = tick_ms > 0 ? tick_ms : 1;
+	wheel->origin_ms = now_ms;
+}
+
+/**
+ * @brief 初始化定时器，之后可以反复设置和取消
+ *
+ * @param timer 定时器
+ * @param callback 到期回调
+ * @param ctx 回调参数
+ */
+void timer_init(TimerNode *timer, TimerCallback callback, void *ctx)
+{
+	if (!timer)
+		return;
+
+	memset(timer, 0, sizeof(TimerNode));
+	timer->callback = callback;
+	timer->ctx = ctx;
+}
+
+/**
+ * @brief 判断定时器是否已设置且尚未到期
+ *
+ * @param timer 定时器
+ * @return int 已设置返回1，否则返回0
+ */
+int timer_pending(const TimerNode *timer)
+{
+	return timer && timer->next != NULL;
+}
+
+/**
+ * @brief 设置或重设定时器
+ *
+ * 已设置的定时器先取消再按新的时间放入，常数时间。
+ *
+ * @param wheel 时间轮
+ * @param timer 已初始化的定时器
+ * @param delay_ms 距离到期的毫秒数，按刻度向上取整
+ * @param interval_ms 到期后自动重设的周期，0 表示只触发一次
+ */
+void timer_wheel_schedule(TimerWheel *wheel, TimerNode *timer, uint64_t delay_ms, uint64_t interval_ms)
+{
+	if (!wheel || !timer)
+		return;
+
+	if (timer->next)
+		unlink_timer(timer);
+	else
+		wheel->count++;
+
+	timer->expires = wheel->tick + (delay_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+	timer->interval = (interval_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+	place_timer(wheel, timer);
+}
+
+/**
+ * @brief 取消定时器，未设置时不做任何事
+ *
+ * @param wheel 时间轮
+ * @param timer 定时器
+ */
+void timer_wheel_cancel(TimerWheel *wheel, TimerNode *timer)
+{
+	if (!wheel || !timer || !timer->next)
+		return;
+
+	unlink_timer(timer);
+	wheel->count--;
+}
+
+/**
+ * @brief 推进时间轮到当前时间并执行到期的定时器
+ *
+ * 回调中可以设置、重设和取消任何定时器（包括正在执行的这一个）。
+ * 周期定时器在回调之前已经重设。
+ *
+ * @param wheel 时间轮
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ * @return int 执行的回调数
+ */
+int timer_wheel_advance(TimerWheel *wheel, uint64_t now_ms)
+{
+	int fired = 0;
+
+	if (!wheel || now_ms < wheel->origin_ms)
+		return 0;
+
+	uint64_t target = (now_ms - wheel->origin_ms) / wheel->tick_ms;
+	while (wheel->tick <= target)
+	{
+		if (wheel->count == 0)
+		{
+			/* 没有定时器时不必逐个刻度推进 */
+			wheel->tick = target + 1;
+			break;
+		}
+
+		size_t slot = (size_t)wheel->tick & TIMER_WHEEL_MASK;
+		if (slot == 0)
+		{
+			for (int level = 1; level < TIMER_WHEEL_LEVELS && cascade(wheel, level) == 0; level++)
+				;
+		}
+
+		uint64_t current = wheel->tick++;
+		TimerNode *head = &wheel->slots[0][slot];
+		TimerNode list;
+		if (head->next == head)
+			continue;
+
+		list.next = head->next;
+		list.prev = head->prev;
+		list.next->prev = &list;
+		list.prev->next = &list;
+		head->next = head;
+		head->prev = head;
+
+		while (list.next != &list)
+		{
+			TimerNode *timer = list.next;
+			unlink_timer(timer);
+			if (timer->expires > current)
+			{
+				/* 超出范围暂放的定时器，还没到期 */
+				place_timer(wheel, timer);
+				continue;
+			}
+
+			if (timer->interval > 0)
+			{
+				timer->expires = current + timer->interval;
+				place_timer(wheel, timer);
+			}
+			else
+				wheel->count--;
+
+			fired++;
+			if (timer->callback)
+				timer->callback(timer, timer->ctx);
+		}
+	}
+	return fired;
+}
+
+/**
+ * @brief 计算到下一个可能到期的刻度还有多少毫秒
+ *
+ * 只查看第0层从当前位置起的各槽，找不到时返回到下一次级联的时间，
+ * 用作事件等待的超时时间。
+ *
+ * @param wheel 时间轮
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ * @param max_ms 上限，没有定时器时返回该值
+ * @return int 毫秒数
+ */
+int timer_wheel_timeout(const TimerWheel *wheel, uint64_t now_ms, int max_ms)
+{
+	if (!wheel || wheel->count == 0)
+		return max_ms;
+
+	uint64_t ticks = 0;
+	size_t start = (size_t)wheel->tick & TIMER_WHEEL_MASK;
+	while (ticks < TIMER_WHEEL_SLOTS - start)
+	{
+		const TimerNode *head = &wheel->slots[0][start + ticks];
+		if (head->next != head)
+			break;
+		ticks++;
+	}
+
+	uint64_t due_ms = wheel->origin_ms + (wheel->tick + ticks) * wheel->tick_ms;
+	if (due_ms <= now_ms)
+		return 0;
+	uint64_t wait = due_ms - now_ms;
+	return wait < (uint64_t)max_ms ? (int)wait : max_ms;
+}
+
+/**
+ * @brief 获取已设置的定时器数
+ *
+ * @param wheel 时间轮
+ * @return size_t 定时器数
+ */
+size_t timer_wheel_count(const TimerWheel *wheel)
+{
+	return wheel ? wheel->count : 0;
+}
@@ -15,6 +15,7 @@
 
 #include <stdio.h>
 #include <time.h>
+#include <stdatomic.h>
 #include "../platform/platform.h"
 
 /**
@@ -72,14 +73,71 @@ void set_log_level(LogLevel level);
  */
 void set_log_file(const char *filename);
 
+/** 异步日志环形缓冲区的默认槽位数（必须为2的幂） */
+#define LOG_ASYNC_DEFAULT_CAPACITY 4096
+/** 异步模式下单条日志正文的最大长度，超出部分截断 */
+#define LOG_RECORD_MAX 512
+
+/**
+ * @brief 启动异步日志
+ *
+ * 之后的日志只格式化进无锁环形缓冲区的槽位，由后台线程批量写入
+ * set_log_file 指定的目标；缓冲区满时丢弃并计数，不阻塞调用方。
+ *
+ * @param capacity 槽位数，向上取整到2的幂，0 表示使用 LOG_ASYNC_DEFAULT_CAPACITY
+ * @param flush_interval_ms 缓冲区为空时后台线程的等待间隔（毫秒）
+ * @return int 成功返回0，已启动或失败返回-1
+ */
+int log_start_async(size_t capacity, int flush_interval_ms);
+
+/**
+ * @brief 停止异步日志
+ *
+ * 写出缓冲区中剩余的日志后回到同步模式。未启动时不做任何事。
+ */
+void log_stop_async(void);
+
+/**
+ * @brief 获取异步模式下因缓冲区已满丢弃的日志条数
+ *
+ * @return size_t 累计丢弃条数
+ */
+size_t log_dropped_count(void);
+
 /* @} */
 
+/**
+ * @brief 编译期最低日志级别
+ *
+ * 低于此级别的日志宏的条件是编译期常量假，整条语句被消除，参数不会求值。
+ * 构建时用 -DITIT_LOG_MIN_LEVEL=1（make LOG_MIN_LEVEL=1）去掉所有调试日志。
+ */
+#ifndef ITIT_LOG_MIN_LEVEL
+#define ITIT_LOG_MIN_LEVEL 0
+#endif
+
+/** 运行期最低日志级别（LogLevel 的值），由 set_log_level 设置；任意线程都可能同时读取 */
+extern atomic_int log_current_level;
+
+/* 判断级别是否会被记录：先比较编译期常量，再读运行期级别（只需读到某个有效值，用宽松序） */
+#define LOG_ENABLED(level)                 \
+	((int)(level) >= ITIT_LOG_MIN_LEVEL && \
+	 (int)(level) >= atomic_load_explicit(&log_current_level, memory_order_relaxed))
+
+/* 先在调用处检查级别，被过滤的日志既不调用 log_message 也不求值参数 */
+#define LOG_AT(level, ...)                   \
+	do                                       \
+	{                                        \
+		if (LOG_ENABLED(level))              \
+			log_message(level, __VA_ARGS__); \
+	} while (0)
+
 /* 简化版日志宏：方便在代码中直接使用不同级别的日志记录 */
-#define LOG_DEBUG(...) log_message(LOG_DEBUG, __VA_ARGS__)
-#define LOG_INFO(...) log_message(LOG_INFO, __VA_ARGS__)
-#define LOG_WARN(...) log_message(LOG_WARNING, __VA_ARGS__)
-#define LOG_ERROR(...) log_message(LOG_ERROR, __VA_ARGS__)
-#define LOG_FATAL(...) log_message(LOG_FATAL, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+#define LOG_FATAL(...) LOG_AT(LOG_FATAL, __VA_ARGS__)
 
 /*
  * @defgroup 安全字符串函数
@@ -141,6 +199,17 @@ int safe_strcmp(const char *s1, const char *s2, size_t max_len);
  */
 void get_current_time(char *buffer, size_t buf_size);
 
+/**
+ * @brief 按默认格式(YYYY-MM-DD HH:MM:SS)格式化时间
+ *
+ * 每个线程缓存最近一次格式化的秒，同一秒内只需复制字符串。
+ *
+ * @param t 要格式化的时间
+ * @param buffer 存储时间字符串的缓冲区，至少20字节
+ * @param buf_size 缓冲区大小
+ */
+void format_timestamp(time_t t, char *buffer, size_t buf_size);
+
 /**
  * @brief 解析时间戳字符串
  *
@@ -230,4 +299,988 @@ int is_valid_port(int port);
 
 /* @} */
 
+/*
+ * @defgroup 流式分帧缓冲区
+ * @brief 按换行符从字节流中切分完整帧，跨多次读取保留半帧
+ * @{
+ */
+
+/** 单帧默认最大长度（不含换行），超过视为协议错误 */
+#define FRAME_BUFFER_DEFAULT_MAX 8192
+
+/**
+ * @brief 分帧缓冲区
+ *
+ * data[start, len) 为尚未消费的数据，scan 记录已确认不含换行的位置，
+ * 避免半帧在每次读取后被重复扫描。
+ */
+typedef struct FrameBuffer
+{
+	char *data;		  /**< 缓冲区内存，按需分配 */
+	size_t cap;		  /**< 缓冲区容量 */
+	size_t start;	  /**< 下一帧起始偏移 */
+	size_t len;		  /**< 已写入数据的末尾偏移 */
+	size_t scan;	  /**< 换行查找的续扫偏移 */
+	size_t max_frame; /**< 单帧最大长度 */
+} FrameBuffer;
+
+/**
+ * @brief 初始化分帧缓冲区
+ *
+ * @param fb 缓冲区指针
+ * @param max_frame 单帧最大长度，0 表示使用 FRAME_BUFFER_DEFAULT_MAX
+ */
+void frame_buffer_init(FrameBuffer *fb, size_t max_frame);
+
+/**
+ * @brief 释放分帧缓冲区占用的内存
+ *
+ * @param fb 缓冲区指针
+ */
+void frame_buffer_free(FrameBuffer *fb);
+
+/**
+ * @brief 为下一次读取预留空间
+ *
+ * @param fb 缓冲区指针
+ * @param min_space 期望的最小可写空间
+ * @param out_space 输出实际可写空间
+ * @return 成功返回写入位置，失败返回NULL
+ */
+char *frame_buffer_reserve(FrameBuffer *fb, size_t min_space, size_t *out_space);
+
+/**
+ * @brief 确认写入 frame_buffer_reserve 返回位置的字节数
+ *
+ * @param fb 缓冲区指针
+ * @param n 写入的字节数
+ */
+void frame_buffer_commit(FrameBuffer *fb, size_t n);
+
+/**
+ * @brief 取出下一完整帧
+ *
+ * 帧在缓冲区内原地以'\0'结尾，指针在下一次 reserve/compact 前有效。
+ *
+ * @param fb 缓冲区指针
+ * @param frame 输出帧起始地址
+ * @param frame_len 输出帧长度
+ * @return 取到一帧返回1，需要更多数据返回0，超过单帧上限返回-1
+ */
+int frame_buffer_next(FrameBuffer *fb, char **frame, size_t *frame_len);
+
+/**
+ * @brief 把未消费的尾部移到缓冲区头部
+ *
+ * @param fb 缓冲区指针
+ */
+void frame_buffer_compact(FrameBuffer *fb);
+
+/**
+ * @brief 获取尚未成帧的字节数
+ *
+ * @param fb 缓冲区指针
+ * @return 待处理的字节数
+ */
+size_t frame_buffer_pending(const FrameBuffer *fb);
+
+/**
+ * @brief 查看尚未消费的数据，供长度前缀分帧的协议自行切帧
+ *
+ * @param fb 缓冲区指针
+ * @param data 输出未消费数据的起始地址
+ * @return 未消费的字节数
+ */
+size_t frame_buffer_peek(FrameBuffer *fb, char **data);
+
+/**
+ * @brief 消费缓冲区开头的 n 字节
+ *
+ * @param fb 缓冲区指针
+ * @param n 字节数，超过未消费数据时按全部计
+ */
+void frame_buffer_consume(FrameBuffer *fb, size_t n);
+
+/* @} */
+
+/*
+ * @defgroup 哈希索引
+ * @brief 开放寻址的指针索引，键由调用方从值中取出比较
+ * @{
+ */
+
+/**
+ * @brief 键比较函数
+ *
+ * @param value 索引中保存的值
+ * @param key 查找键
+ * @return 匹配返回非0，否则返回0
+ */
+typedef int (*HashIndexMatch)(const void *value, const void *key);
+
+/** 哈希索引槽位，value 为 NULL 表示空槽 */
+typedef struct
+{
+	size_t hash; /**< 键的哈希值 */
+	void *value; /**< 值指针 */
+} HashIndexSlot;
+
+/** 哈希索引，零初始化即可使用 */
+typedef struct HashIndex
+{
+	HashIndexSlot *slots; /**< 槽位数组，容量为2的幂 */
+	size_t cap;			  /**< 槽位数 */
+	size_t count;		  /**< 已用槽位数 */
+} HashIndex;
+
+/**
+ * @brief 初始化哈希索引
+ *
+ * @param idx 索引指针
+ * @param expected 预计条目数，0 表示延迟分配
+ * @return 成功返回0，失败返回-1
+ */
+int hash_index_init(HashIndex *idx, size_t expected);
+
+/**
+ * @brief 释放哈希索引（不释放值指向的对象）
+ *
+ * @param idx 索引指针
+ */
+void hash_index_free(HashIndex *idx);
+
+/**
+ * @brief 查找条目
+ *
+ * @param idx 索引指针
+ * @param hash 键的哈希值
+ * @param key 查找键
+ * @param match 键比较函数，NULL 表示按指针比较
+ * @return 找到返回值指针，否则返回NULL
+ */
+void *hash_index_find(const HashIndex *idx, size_t hash, const void *key, HashIndexMatch match);
+
+/**
+ * @brief 插入条目（不检查重复键）
+ *
+ * @param idx 索引指针
+ * @param hash 键的哈希值
+ * @param value 值指针，不能为NULL
+ * @return 成功返回0，失败返回-1
+ */
+int hash_index_insert(HashIndex *idx, size_t hash, void *value);
+
+/**
+ * @brief 删除条目
+ *
+ * @param idx 索引指针
+ * @param hash 键的哈希值
+ * @param key 查找键
+ * @param match 键比较函数，NULL 表示按指针比较
+ * @return 返回被删除的值指针，未找到返回NULL
+ */
+void *hash_index_remove(HashIndex *idx, size_t hash, const void *key, HashIndexMatch match);
+
+/**
+ * @brief 计算字符串哈希
+ *
+ * @param str 字符串
+ * @param max_len 最多参与计算的字符数
+ * @return 哈希值
+ */
+size_t hash_index_hash_string(const char *str, size_t max_len);
+
+/**
+ * @brief 计算整数哈希
+ *
+ * @param value 整数键
+ * @return 哈希值
+ */
+size_t hash_index_hash_int(uint64_t value);
+
+/* @} */
+
+/*
+ * @defgroup 发送队列
+ * @brief 非阻塞套接字的待发送帧队列，支持部分写出和分散写批量发送
+ * @{
+ */
+
+/** 单个连接默认允许积压的最大字节数 */
+#define SEND_QUEUE_DEFAULT_HIGH_WATER (1024 * 1024)
+
+typedef struct SendQueueNode SendQueueNode;
+
+/**
+ * @brief 引用计数的共享帧
+ *
+ * 一对多发送时只序列化一次，各接收者的发送队列共享同一份数据。
+ * 引用计数为原子变量，同一帧可以投递到不同 reactor 线程的邮箱。
+ */
+typedef struct SharedFrame
+{
+	atomic_size_t refs;						 /**< 引用计数 */
+	_Atomic(struct SharedFrame *) variant; /**< 同一内容的另一种编码（如二进制协议帧），首次需要时生成 */
+	size_t len;								 /**< 帧长度 */
+	char data[];							 /**< 帧数据 */
+} SharedFrame;
+
+/** 发送队列，帧按入队顺序发出 */
+typedef struct SendQueue
+{
+	SendQueueNode *head; /**< 队首帧 */
+	SendQueueNode *tail; /**< 队尾帧 */
+	size_t bytes;		 /**< 尚未发送的字节数 */
+	size_t frames;		 /**< 帧数 */
+	size_t high_water;	 /**< 积压上限 */
+	size_t dropped;		 /**< 自上次清空以来因超过高水位被拒绝的帧数 */
+} SendQueue;
+
+/**
+ * @brief 初始化发送队列
+ *
+ * @param q 队列指针
+ * @param high_water 积压上限，0 表示使用 SEND_QUEUE_DEFAULT_HIGH_WATER
+ */
+void send_queue_init(SendQueue *q, size_t high_water);
+
+/**
+ * @brief 释放队列中所有未发送的帧
+ *
+ * @param q 队列指针
+ */
+void send_queue_free(SendQueue *q);
+
+/**
+ * @brief 复制一帧追加到队列尾部
+ *
+ * @param q 队列指针
+ * @param data 帧数据
+ * @param len 帧长度
+ * @return 成功返回0，超过高水位或内存不足返回-1
+ */
+int send_queue_push(SendQueue *q, const char *data, size_t len);
+
+/**
+ * @brief 以引用方式追加一个共享帧（不复制数据）
+ *
+ * @param q 队列指针
+ * @param frame 共享帧，成功时队列持有一个引用
+ * @param offset 已直接发出的字节数
+ * @return 成功返回0，超过高水位或内存不足返回-1
+ */
+int send_queue_push_shared(SendQueue *q, SharedFrame *frame, size_t offset);
+
+/**
+ * @brief 创建共享帧，复制数据，初始引用计数为1
+ *
+ * @param data 帧数据
+ * @param len 帧长度
+ * @return 成功返回共享帧，失败返回NULL
+ */
+SharedFrame *shared_frame_create(const char *data, size_t len);
+
+/**
+ * @brief 增加共享帧引用
+ *
+ * @param frame 共享帧
+ * @return 返回 frame 本身
+ */
+SharedFrame *shared_frame_retain(SharedFrame *frame);
+
+/**
+ * @brief 释放一次共享帧引用，计数归零时回收
+ *
+ * @param frame 共享帧
+ */
+void shared_frame_release(SharedFrame *frame);
+
+/**
+ * @brief 获取共享帧已生成的另一种编码
+ *
+ * @param frame 共享帧
+ * @return 另一种编码，随 frame 一起释放，尚未生成返回NULL
+ */
+SharedFrame *shared_frame_variant(SharedFrame *frame);
+
+/**
+ * @brief 为共享帧挂上另一种编码，多个线程同时生成时只保留第一个
+ *
+ * @param frame 共享帧
+ * @param variant 新生成的编码，所有权转交给 frame
+ * @return 挂在 frame 上的编码（可能是其他线程先挂上的）
+ */
+SharedFrame *shared_frame_set_variant(SharedFrame *frame, SharedFrame *variant);
+
+/* @} */
+
+/*
+ * @defgroup 无锁队列
+ * @brief 多生产者单消费者的侵入式无锁队列，用于跨线程投递
+ * @{
+ */
+
+/** 队列节点，嵌入到被投递的结构体中 */
+typedef struct MpscNode
+{
+	_Atomic(struct MpscNode *) next; /**< 下一个节点 */
+} MpscNode;
+
+/** 多生产者单消费者队列 */
+typedef struct MpscQueue
+{
+	_Atomic(MpscNode *) head; /**< 生产者追加的位置 */
+	MpscNode *tail;			  /**< 消费者取出的位置，只由消费者访问 */
+	MpscNode stub;			  /**< 哨兵节点 */
+} MpscQueue;
+
+/**
+ * @brief 初始化队列
+ *
+ * @param q 队列指针
+ */
+void mpsc_queue_init(MpscQueue *q);
+
+/**
+ * @brief 追加节点（任意线程可调用，无锁）
+ *
+ * @param q 队列指针
+ * @param node 节点
+ */
+void mpsc_queue_push(MpscQueue *q, MpscNode *node);
+
+/**
+ * @brief 取出队首节点（只能由唯一的消费者线程调用）
+ *
+ * @param q 队列指针
+ * @return 队首节点，队列为空或生产者尚未完成追加时返回NULL
+ */
+MpscNode *mpsc_queue_pop(MpscQueue *q);
+
+/**
+ * @brief 判断队列是否确实为空（只能由唯一的消费者线程调用）
+ *
+ * @param q 队列指针
+ * @return 没有已追加或正在追加的节点返回1；pop 返回 NULL 但生产者尚未完成追加时返回0
+ */
+int mpsc_queue_empty(MpscQueue *q);
+
+/**
+ * @brief 把队首最多 max 帧未发送的部分填入分散写描述，不修改队列
+ *
+ * @param q 队列指针
+ * @param iov 输出的分散写描述
+ * @param max 最多填入的帧数
+ * @return 填入的帧数
+ */
+int send_queue_gather(const SendQueue *q, platform_iovec_t *iov, int max);
+
+/**
+ * @brief 从队首移除已经写出的字节，写完的帧立即释放
+ *
+ * @param q 队列指针
+ * @param bytes 已写出的字节数
+ * @return 队列已清空返回1，仍有积压返回0
+ */
+int send_queue_consume(SendQueue *q, size_t bytes);
+
+/**
+ * @brief 把 src 中的全部帧移到空队列 dst，帧数据不移动
+ *
+ * @param dst 目标队列
+ * @param src 源队列，移动后为空
+ */
+void send_queue_move(SendQueue *dst, SendQueue *src);
+
+/**
+ * @brief 尽可能多地把队列写入套接字
+ *
+ * @param q 队列指针
+ * @param sockfd 目标套接字
+ * @return 队列已清空返回1，仍有积压返回0，发送出错返回-1
+ */
+int send_queue_flush(SendQueue *q, socket_t sockfd);
+
+/**
+ * @brief 获取队列中尚未发送的字节数
+ *
+ * @param q 队列指针
+ * @return 积压字节数
+ */
+size_t send_queue_bytes(const SendQueue *q);
+
+/**
+ * @brief 按发送顺序复制尚未发送的字节，不修改队列
+ *
+ * @param q 队列指针
+ * @param out 输出缓冲区
+ * @param cap 缓冲区大小
+ * @return 复制的字节数
+ */
+size_t send_queue_copy(const SendQueue *q, char *out, size_t cap);
+
+/**
+ * @brief 判断队列是否为空
+ *
+ * @param q 队列指针
+ * @return 为空返回1，否则返回0
+ */
+int send_queue_empty(const SendQueue *q);
+
+/* @} */
+
+/*
+ * @defgroup 纪元回收
+ * @brief 读者不加锁的共享结构延迟回收：摘下的节点等所有可能读到它的读者离开临界区后才释放
+ * @{
+ */
+
+/** 待回收的节点积累到这么多个时，epoch_retire 顺带回收一次 */
+#define EPOCH_COLLECT_THRESHOLD 64
+
+struct EpochNode;
+typedef void (*EpochReclaim)(struct EpochNode *node);
+
+/** 待回收节点，嵌入到被回收的结构体中 */
+typedef struct EpochNode
+{
+	struct EpochNode *next; /**< 待回收链表 */
+	uint64_t epoch;			/**< 摘下时的全局纪元 */
+	EpochReclaim reclaim;	/**< 回收函数 */
+} EpochNode;
+
+/**
+ * @brief 进入读临界区，可嵌套；临界区内读到的共享节点在离开前不会被回收
+ *
+ * @return 成功返回0，无法分配线程记录时返回-1（此时不能读取共享结构）
+ */
+int epoch_enter(void);
+
+/**
+ * @brief 离开读临界区
+ */
+void epoch_exit(void);
+
+/**
+ * @brief 登记一个已摘下（新读者不可达）的节点，当前所有读者离开后调用其回收函数
+ *
+ * 不能在读临界区内调用。
+ *
+ * @param node 嵌入的待回收节点
+ * @param reclaim 回收函数
+ */
+void epoch_retire(EpochNode *node, EpochReclaim reclaim);
+
+/**
+ * @brief 回收已经没有读者持有的节点
+ *
+ * @return 本次回收的节点数
+ */
+size_t epoch_collect(void);
+
+/**
+ * @brief 等待当前所有读者离开并回收全部待回收节点，不能在读临界区内调用
+ */
+void epoch_synchronize(void);
+
+/**
+ * @brief 获取等待回收的节点数
+ *
+ * @return 节点数
+ */
+size_t epoch_pending(void);
+
+/**
+ * @brief 交还调用线程的纪元记录，线程退出前调用
+ */
+void epoch_thread_release(void);
+
+/* @} */
+
+/*
+ * @defgroup 对象池
+ * @brief 定长对象的分块池，每线程本地空闲链表，带使用数和峰值计数
+ * @{
+ */
+
+/** 同时存在的对象池个数上限，每个线程为每个池保留一个本地空闲链表 */
+#define OBJECT_POOL_MAX_POOLS 8
+/** 本地空闲链表与全局空闲链表之间一次搬运的对象数 */
+#define OBJECT_POOL_BATCH 32
+
+struct ObjectPoolSlab;
+
+/**
+ * @brief 定长对象池
+ *
+ * 用 OBJECT_POOL_INITIALIZER 静态初始化后即可使用，首次分配时才申请内存。
+ */
+typedef struct ObjectPool
+{
+	const char *name;			  /**< 池名称，用于日志 */
+	size_t object_size;			  /**< 对象大小 */
+	size_t slab_objects;		  /**< 每块对象数，0 表示按块大小自动计算 */
+	platform_mutex_t lock;		  /**< 保护全局空闲链表和块链表 */
+	void *free_list;			  /**< 全局空闲链表 */
+	size_t free_count;			  /**< 全局空闲链表中的对象数 */
+	struct ObjectPoolSlab *slabs; /**< 已分配的块 */
+	size_t capacity;			  /**< 已分配的对象总数 */
+	atomic_size_t in_use;		  /**< 使用中的对象数 */
+	atomic_size_t high_water;	  /**< 使用中对象数的峰值 */
+	atomic_int id;				  /**< 线程本地链表编号，0 表示尚未分配，-1 表示没有本地链表 */
+	atomic_uint generation;		  /**< 每次销毁加一，使各线程的旧本地链表作废 */
+} ObjectPool;
+
+/** 对象池静态初始化器 */
+#define OBJECT_POOL_INITIALIZER(pool_name, size, per_slab) \
+	{(pool_name), (size), (per_slab), PLATFORM_MUTEX_INITIALIZER, NULL, 0, NULL, 0, 0, 0, 0, 0}
+
+/**
+ * @brief 分配一个已清零的对象
+ *
+ * @param pool 对象池
+ * @return 成功返回对象，内存不足返回NULL
+ */
+void *object_pool_alloc(ObjectPool *pool);
+
+/**
+ * @brief 把对象归还对象池，可以在任意线程调用
+ *
+ * @param pool 对象池
+ * @param obj 由同一池分配的对象
+ */
+void object_pool_free(ObjectPool *pool, void *obj);
+
+/**
+ * @brief 预先分配对象，使池的总容量至少为 count
+ *
+ * @param pool 对象池
+ * @param count 期望容量
+ * @return 成功返回0，内存不足返回-1
+ */
+int object_pool_reserve(ObjectPool *pool, size_t count);
+
+/**
+ * @brief 获取使用中的对象数
+ *
+ * @param pool 对象池
+ * @return 对象数
+ */
+size_t object_pool_in_use(ObjectPool *pool);
+
+/**
+ * @brief 获取使用中对象数的峰值
+ *
+ * @param pool 对象池
+ * @return 对象数
+ */
+size_t object_pool_high_water(ObjectPool *pool);
+
+/**
+ * @brief 获取已分配的对象总数
+ *
+ * @param pool 对象池
+ * @return 对象数
+ */
+size_t object_pool_capacity(ObjectPool *pool);
+
+/**
+ * @brief 把当前线程本地链表中的对象全部归还，线程退出前调用
+ */
+void object_pool_thread_release(void);
+
+/**
+ * @brief 释放池的全部内存，池由它分配的对象全部失效，之后池可继续使用
+ *
+ * @param pool 对象池
+ */
+void object_pool_destroy(ObjectPool *pool);
+
+/* @} */
+
+/*
+ * @defgroup 线性分配区
+ * @brief 移动偏移量分配、整体重置回收的临时内存，底层内存由调用方提供
+ * @{
+ */
+
+struct ArenaBlock;
+
+/** 线性分配区，放不下的分配挂在溢出链表上 */
+typedef struct Arena
+{
+	char *base;					 /**< 底层内存 */
+	size_t cap;					 /**< 底层内存大小 */
+	size_t used;				 /**< 已分配的偏移 */
+	size_t last;				 /**< 最近一次分配的起始偏移 */
+	size_t peak;				 /**< used 的峰值 */
+	size_t overflow_count;		 /**< 累计溢出分配次数 */
+	struct ArenaBlock *overflow; /**< 本轮的溢出分配 */
+} Arena;
+
+/**
+ * @brief 用调用方提供的内存初始化分配区
+ *
+ * @param arena 分配区
+ * @param buffer 底层内存
+ * @param cap 底层内存大小
+ */
+void arena_init(Arena *arena, void *buffer, size_t cap);
+
+/**
+ * @brief 分配内存，底层内存不足时单独向系统申请
+ *
+ * @param arena 分配区
+ * @param size 字节数
+ * @return 成功返回内存，失败返回NULL
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief 缩小或撤销（size 为0）最近一次分配
+ *
+ * @param arena 分配区
+ * @param ptr 最近一次分配得到的指针，其他指针被忽略
+ * @param size 保留的字节数
+ */
+void arena_trim(Arena *arena, void *ptr, size_t size);
+
+/**
+ * @brief 判断指针是否由分配区分配
+ *
+ * @param arena 分配区
+ * @param ptr 指针
+ * @return 是返回1，否则返回0
+ */
+int arena_owns(const Arena *arena, const void *ptr);
+
+/**
+ * @brief 回收全部分配
+ *
+ * @param arena 分配区
+ */
+void arena_reset(Arena *arena);
+
+/* @} */
+
+/*
+ * @defgroup 时间轮
+ * @brief 分层时间轮，设置、重设和取消定时器都是常数时间，只能由所属线程使用
+ * @{
+ */
+
+#define TIMER_WHEEL_BITS 6							/* 每层槽数的位数 */
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)	/* 每层的槽数 */
+#define TIMER_WHEEL_LEVELS 4						/* 层数，可表示 64^4 个刻度 */
+
+struct TimerNode;
+typedef void (*TimerCallback)(struct TimerNode *timer, void *ctx);
+
+/** 定时器，嵌入在所属对象中，由时间轮串成链表，不需要额外分配 */
+typedef struct TimerNode
+{
+	struct TimerNode *next; /**< 槽链表的下一个，NULL 表示未设置 */
+	struct TimerNode *prev; /**< 槽链表的上一个 */
+	uint64_t expires;		/**< 到期刻度 */
+	uint64_t interval;		/**< 周期（刻度），0 表示只触发一次 */
+	TimerCallback callback; /**< 到期回调 */
+	void *ctx;				/**< 回调参数 */
+} TimerNode;
+
+/** 时间轮，每个槽是一个以哨兵节点开头的双向循环链表 */
+typedef struct
+{
+	TimerNode slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; /**< 各层的槽 */
+	uint64_t tick;											 /**< 下一个要处理的刻度 */
+	uint64_t origin_ms;										 /**< 刻度0对应的时间 */
+	unsigned int tick_ms;									 /**< 每个刻度的毫秒数 */
+	size_t count;											 /**< 已设置的定时器数 */
+} TimerWheel;
+
+/**
+ * @brief 初始化时间轮
+ *
+ * @param wheel 时间轮
+ * @param tick_ms 每个刻度的毫秒数
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ */
+void timer_wheel_init(TimerWheel *wheel, unsigned int tick_ms, uint64_t now_ms);
+
+/**
+ * @brief 初始化定时器
+ *
+ * @param timer 定时器
+ * @param callback 到期回调
+ * @param ctx 回调参数
+ */
+void timer_init(TimerNode *timer, TimerCallback callback, void *ctx);
+
+/**
+ * @brief 判断定时器是否已设置
+ *
+ * @param timer 定时器
+ * @return 已设置返回1，否则返回0
+ */
+int timer_pending(const TimerNode *timer);
+
+/**
+ * @brief 设置或重设定时器
+ *
+ * @param wheel 时间轮
+ * @param timer 定时器
+ * @param delay_ms 距离到期的毫秒数
+ * @param interval_ms 周期，0 表示只触发一次
+ */
+void timer_wheel_schedule(TimerWheel *wheel, TimerNode *timer, uint64_t delay_ms, uint64_t interval_ms);
+
+/**
+ * @brief 取消定时器
+ *
+ * @param wheel 时间轮
+ * @param timer 定时器
+ */
+void timer_wheel_cancel(TimerWheel *wheel, TimerNode *timer);
+
+/**
+ * @brief 推进时间轮并执行到期的定时器
+ *
+ * @param wheel 时间轮
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ * @return 执行的回调数
+ */
+int timer_wheel_advance(TimerWheel *wheel, uint64_t now_ms);
+
+/**
+ * @brief 计算事件等待的超时时间
+ *
+ * @param wheel 时间轮
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ * @param max_ms 上限
+ * @return 到下一个可能到期的刻度的毫秒数
+ */
+int timer_wheel_timeout(const TimerWheel *wheel, uint64_t now_ms, int max_ms);
+
+/**
+ * @brief 获取已设置的定时器数
+ *
+ * @param wheel 时间轮
+ * @return 定时器数
+ */
+size_t timer_wheel_count(const TimerWheel *wheel);
+
+/* @} */
+
+/*
+ * @defgroup 令牌桶
+ * @brief 按毫秒补充的令牌桶，令牌以千分之一为单位保存，只能由所属线程使用（或由调用者加锁）
+ * @{
+ */
+
+#define TOKEN_BUCKET_SCALE 1000 /* 每个令牌的内部单位数 */
+
+/** 令牌桶，零初始化后第一次使用时装满 */
+typedef struct
+{
+	int64_t level;	   /**< 当前令牌（内部单位），允许透支为负 */
+	uint64_t stamp_ms; /**< 上次补充的时间，0 表示尚未使用 */
+} TokenBucket;
+
+/**
+ * @brief 取走令牌，不足时不扣除
+ *
+ * @param bucket 令牌桶
+ * @param rate 每秒补充的令牌数，0 表示不限
+ * @param burst 桶容量
+ * @param cost 要取走的令牌数
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ * @return 取到返回1，令牌不足返回0
+ */
+int token_bucket_take(TokenBucket *bucket, uint32_t rate, uint32_t burst, uint32_t cost, uint64_t now_ms);
+
+/**
+ * @brief 扣除令牌，不足时透支
+ *
+ * 用于已经发生、无法拒绝的消耗（如已读入的字节），透支部分由之后的补充偿还。
+ *
+ * @param bucket 令牌桶
+ * @param rate 每秒补充的令牌数，0 表示不限
+ * @param burst 桶容量
+ * @param cost 要扣除的令牌数
+ * @param now_ms 当前时间（毫秒，单调时钟）
+ * @return 还清透支需要的毫秒数，没有透支返回0
+ */
+uint64_t token_bucket_charge(TokenBucket *bucket, uint32_t rate, uint32_t burst, uint64_t cost, uint64_t now_ms);
+
+/* @} */
+
+/*
+ * @defgroup 指标
+ * @brief 按线程分块的计数器和对数-线性直方图，记录时不加锁，读取时合并所有线程
+ * @{
+ */
+
+#define METRICS_MAX_COUNTERS 32		 /* 计数器数量上限 */
+#define METRICS_MAX_HISTOGRAMS 16	 /* 直方图数量上限 */
+#define METRICS_HISTOGRAM_BUCKETS 124 /* 直方图桶数，覆盖 0 到 2^32-1 */
+
+/** 直方图的合并统计 */
+typedef struct
+{
+	uint64_t count; /**< 记录次数 */
+	uint64_t sum;	/**< 记录值之和 */
+	uint64_t max;	/**< 最大记录值 */
+	uint64_t p50;	/**< 中位数 */
+	uint64_t p90;	/**< 90 分位数 */
+	uint64_t p99;	/**< 99 分位数 */
+	uint64_t p999;	/**< 99.9 分位数 */
+} MetricsSummary;
+
+/**
+ * @brief 定义计数器的名称
+ *
+ * @param id 计数器编号
+ * @param name 名称（静态字符串）
+ */
+void metrics_define_counter(int id, const char *name);
+
+/**
+ * @brief 定义直方图的名称和标签
+ *
+ * @param id 直方图编号
+ * @param name 名称（静态字符串）
+ * @param label 标签（静态字符串），可为NULL
+ */
+void metrics_define_histogram(int id, const char *name, const char *label);
+
+/**
+ * @brief 累加当前线程的计数器
+ *
+ * @param id 计数器编号
+ * @param n 增量
+ */
+void metrics_add(int id, uint64_t n);
+
+/**
+ * @brief 在当前线程的直方图中记录一个值
+ *
+ * @param id 直方图编号
+ * @param value 值
+ */
+void metrics_record(int id, uint64_t value);
+
+/**
+ * @brief 获取计数器在所有线程上的合计
+ *
+ * @param id 计数器编号
+ * @return 合计值
+ */
+uint64_t metrics_counter(int id);
+
+/**
+ * @brief 合并所有线程的直方图并计算分位数
+ *
+ * @param id 直方图编号
+ * @param out 输出统计
+ * @return 成功返回0，编号无效返回-1
+ */
+int metrics_histogram(int id, MetricsSummary *out);
+
+/**
+ * @brief 以 Prometheus 文本格式导出已定义名称的指标
+ *
+ * @param buf 输出缓冲区
+ * @param cap 缓冲区大小
+ * @param prefix 指标名前缀
+ * @return 写入的字节数
+ */
+size_t metrics_format(char *buf, size_t cap, const char *prefix);
+
+/* @} */
+
+/**
+ * @defgroup 摘要与口令派生
+ * @brief SHA-256、HMAC-SHA256 和 PBKDF2-HMAC-SHA256，用于口令摘要和凭证缓存的键
+ * @{
+ */
+
+#define SHA256_DIGEST_LEN 32	/* SHA-256 摘要的字节数 */
+#define PBKDF2_MAX_SALT_LEN 64 /* PBKDF2 接受的最长盐 */
+
+/** SHA-256 的增量计算上下文 */
+typedef struct
+{
+	uint32_t state[8];		  /**< 链接变量 */
+	uint64_t total;			  /**< 已输入的字节数 */
+	unsigned char buffer[64]; /**< 未满一块的输入 */
+	size_t buffered;		  /**< buffer 中的字节数 */
+} Sha256Context;
+
+/**
+ * @brief 开始一次 SHA-256 计算
+ *
+ * @param ctx 计算上下文
+ */
+void sha256_init(Sha256Context *ctx);
+
+/**
+ * @brief 追加输入数据
+ *
+ * @param ctx 计算上下文
+ * @param data 数据
+ * @param len 字节数
+ */
+void sha256_update(Sha256Context *ctx, const void *data, size_t len);
+
+/**
+ * @brief 结束计算并输出摘要
+ *
+ * @param ctx 计算上下文
+ * @param out 输出摘要
+ */
+void sha256_final(Sha256Context *ctx, unsigned char out[SHA256_DIGEST_LEN]);
+
+/**
+ * @brief 一次计算整段数据的 SHA-256
+ *
+ * @param data 数据
+ * @param len 字节数
+ * @param out 输出摘要
+ */
+void sha256(const void *data, size_t len, unsigned char out[SHA256_DIGEST_LEN]);
+
+/**
+ * @brief 计算 HMAC-SHA256
+ *
+ * @param key 密钥
+ * @param key_len 密钥字节数
+ * @param data 数据
+ * @param len 数据字节数
+ * @param out 输出摘要
+ */
+void hmac_sha256(const void *key, size_t key_len, const void *data, size_t len, unsigned char out[SHA256_DIGEST_LEN]);
+
+/**
+ * @brief 用 PBKDF2-HMAC-SHA256 从口令派生密钥
+ *
+ * @param password 口令
+ * @param password_len 口令字节数
+ * @param salt 盐
+ * @param salt_len 盐字节数
+ * @param iterations 迭代次数
+ * @param out 输出缓冲区
+ * @param out_len 派生的字节数
+ * @return 成功返回0，参数无效返回-1
+ */
+int pbkdf2_sha256(const char *password, size_t password_len, const unsigned char *salt, size_t salt_len,
+				  uint32_t iterations, unsigned char *out, size_t out_len);
+
+/**
+ * @brief 比较两段摘要，耗时与内容无关
+ *
+ * @return 相同返回1，否则返回0
+ */
+int digest_equal(const unsigned char *a, const unsigned char *b, size_t len);
+
+/* @} */
+
 #endif /* UTILS_H */
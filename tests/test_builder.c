@@ -105,6 +105,45 @@ void test_build_history_request()
 	free(msg);
 }
 
+void test_build_history_sync_request()
+{
+	printf("Testing build_history_sync_request...\n");
+
+	char *msg = build_history_sync_request("alice", "bob", 1234, 100);
+	assert(msg != NULL);
+
+	assert(strstr(msg, "HISTORY|alice|server") != NULL);
+	assert(strstr(msg, "|bob|||100|1234\n") != NULL);
+
+	printf("  ✓ Built history sync request: %s", msg);
+	free(msg);
+
+	assert(build_history_sync_request("alice", NULL, 0, 0) == NULL);
+}
+
+void test_build_history_search_request()
+{
+	printf("Testing build_history_search_request...\n");
+
+	char *msg = build_history_search_request("alice", "bob", "你好 a|b", 20);
+	assert(msg != NULL);
+
+	/* 整个内容经过转义，查询中的 '|' 不会被当作字段分隔 */
+	assert(strstr(msg, "HISTORY|alice|server") != NULL);
+	assert(strstr(msg, "|bob\\|\\|\\|20\\|\\|你好 a\\|b\n") != NULL);
+
+	Message *parsed = parse_message(msg);
+	assert(parsed != NULL);
+	assert(strcmp(parsed->content, "bob|||20||你好 a|b") == 0);
+	free_message(parsed);
+
+	printf("  ✓ Built history search request: %s", msg);
+	free(msg);
+
+	assert(build_history_search_request("alice", "bob", "", 0) == NULL);
+	assert(build_history_search_request("alice", "bob", NULL, 0) == NULL);
+}
+
 void test_build_status_request()
 {
 	printf("Testing build_status_request...\n");
@@ -156,6 +195,117 @@ void test_escape_in_builder()
 	free(msg);
 }
 
+void test_long_content()
+{
+	printf("Testing long content round trip...\n");
+
+	/* 全部需要转义的最长内容：构建后仍能被完整解析 */
+	char content[MAX_CONTENT_LEN];
+	memset(content, '|', sizeof(content) - 1);
+	content[sizeof(content) - 1] = '\0';
+
+	char *msg = build_text_msg("alice", "bob", content);
+	assert(msg != NULL);
+	assert(strlen(msg) <= MAX_RAW_MESSAGE_LEN);
+
+	Message parsed;
+	assert(parse_message_into(msg, strlen(msg), &parsed) == 0);
+	assert(strcmp(parsed.content, content) == 0);
+
+	printf("  ✓ %zu-byte escaped content survives build and parse\n", strlen(content));
+	free(msg);
+}
+
+void test_trace_round_trip()
+{
+	printf("Testing traffic trace capture and replay encoding...\n");
+
+	const char *path = "test_builder.trace";
+	char *login = build_login_msg("alice", "password123");
+	size_t login_len = strlen(login) - 1; /* 记录的文本帧不含换行 */
+	size_t v2_len = 0;
+	char *v2 = protocol_v2_from_text(login, login_len, &v2_len);
+	assert(v2 != NULL && v2_len > 2);
+
+	/* v2 帧经分帧后得到的正文即记录的内容 */
+	FrameBuffer fb;
+	char *frame;
+	size_t frame_len;
+	int binary;
+	size_t space = 0;
+	frame_buffer_init(&fb, 0);
+	char *dest = frame_buffer_reserve(&fb, v2_len, &space);
+	assert(dest != NULL && space >= v2_len);
+	memcpy(dest, v2, v2_len);
+	frame_buffer_commit(&fb, v2_len);
+	assert(protocol_next_frame(&fb, &frame, &frame_len, &binary) > 0 && binary == 1);
+	char *body = (char *)malloc(frame_len);
+	memcpy(body, frame, frame_len);
+	size_t body_len = frame_len;
+
+	uint32_t first = 0;
+	uint32_t second = 0;
+	assert(trace_capture_start(path) == 0);
+	assert(trace_capture_enabled());
+	trace_capture_frame(&first, 0, login, login_len);
+	trace_capture_frame(&second, 1, body, body_len);
+	trace_capture_frame(&first, 0, "STATUS|alice|server|now|", 24);
+	trace_capture_close(first);
+	trace_capture_stop();
+	assert(!trace_capture_enabled());
+	assert(first == 1 && second == 2);
+
+	/* 读回：每个连接第一帧前有打开记录，时间不减少 */
+	static const int types[] = {TRACE_OPEN, TRACE_TEXT, TRACE_OPEN, TRACE_V2, TRACE_TEXT, TRACE_CLOSE};
+	static const uint32_t ids[] = {1, 1, 2, 2, 1, 1};
+	TraceReader reader;
+	TraceRecord record;
+	uint64_t last_us = 0;
+	char wire[MAX_RAW_MESSAGE_LEN + TRACE_WIRE_OVERHEAD];
+	assert(trace_reader_open(&reader, path) == 0);
+	assert(reader.start_us > 0);
+	for (int i = 0; i < 6; i++)
+	{
+		assert(trace_reader_next(&reader, &record) == 1);
+		assert(record.type == types[i] && record.conn == ids[i] && record.time_us >= last_us);
+		last_us = record.time_us;
+
+		size_t n = trace_record_wire(&record, wire, sizeof(wire));
+		if (i == 1)
+			assert(n == login_len + 1 && memcmp(wire, login, n) == 0);
+		else if (i == 3)
+			assert(n == v2_len && memcmp(wire, v2, n) == 0);
+		else if (i != 4)
+			assert(n == 0 && record.data == NULL);
+	}
+	assert(trace_reader_next(&reader, &record) == 0);
+	trace_reader_close(&reader);
+
+	/* 截断的文件报告损坏 */
+	char data[4096];
+	FILE *fp = fopen(path, "rb");
+	assert(fp != NULL);
+	size_t size = fread(data, 1, sizeof(data), fp);
+	fclose(fp);
+	fp = fopen(path, "wb");
+	assert(fp != NULL && fwrite(data, 1, size - 12, fp) == size - 12); /* 去掉关闭记录和最后一帧的一部分 */
+	fclose(fp);
+	assert(trace_reader_open(&reader, path) == 0);
+	int status;
+	int records = 0;
+	while ((status = trace_reader_next(&reader, &record)) == 1)
+		records++;
+	assert(status == -1 && records == 4);
+	trace_reader_close(&reader);
+	remove(path);
+
+	printf("  ✓ Text and v2 frames re-encode to the original wire bytes\n");
+	frame_buffer_free(&fb);
+	free(body);
+	free(v2);
+	free(login);
+}
+
 int main()
 {
 	set_log_file(NULL);
@@ -169,9 +319,13 @@ int main()
 	test_build_group_msg();
 	test_build_responses();
 	test_build_history_request();
+	test_build_history_sync_request();
+	test_build_history_search_request();
 	test_build_status_request();
 	test_build_notifications();
 	test_escape_in_builder();
+	test_long_content();
+	test_trace_round_trip();
 
 	printf("\n=== All builder tests passed! ===\n");
 
@@ -1,8 +1,11 @@
 // tests/test_connection.c - 使用正确的函数名
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "../src/models/models.h"
+#include "../src/models/message.h"
 
 // 声明实际的连接管理器函数（根据你的头文件）
 void connection_manager_add_from_fd(socket_t sockfd, const char *ip, int port);
@@ -10,8 +13,94 @@ Client *connection_manager_find_by_fd(socket_t fd);
 void connection_manager_remove(socket_t fd);
 int connection_manager_count(void);
 void connection_manager_set_status(socket_t fd, int status);
+Client *connection_manager_find_by_username(const char *username);
+int connection_manager_set_auth(socket_t fd, int user_id, const char *username);
+void connection_manager_clear_auth(socket_t fd);
 void connection_manager_print_all(void);
 void connection_manager_cleanup(void);
+int connection_manager_total_count(void);
+typedef struct ConnectionShard ConnectionShard;
+ConnectionShard *connection_shard_create(void);
+void connection_shard_destroy_all(void);
+void connection_manager_bind_shard(ConnectionShard *shard);
+int connection_manager_is_remote_user(const char *username);
+int connection_manager_post_to_user(const char *username, SharedFrame *frame);
+int connection_manager_drain_mailbox(void);
+void connection_manager_update_active(socket_t fd);
+typedef void (*ConnectionIdleHook)(socket_t fd);
+void connection_manager_set_idle_timeout(TimerWheel *wheel, int seconds, ConnectionIdleHook hook);
+void presence_set_window(int ms);
+int presence_flush(uint64_t now_ms);
+int presence_watch(const char *subscriber, const char *spec);
+int presence_snapshot(const char *subscriber, char *out, size_t cap);
+void presence_cleanup(void);
+int cluster_configure(const char *spec, int self);
+int cluster_home(const char *username);
+int cluster_route_private(const char *receiver, const char *data, size_t len);
+void connection_manager_detach(socket_t fd);
+int connection_manager_restore(socket_t fd, const Client *saved, const ClientInfo *info, const char *unread,
+							   size_t unread_len, const char *unsent, size_t unsent_len);
+Client *connection_manager_find_by_id(int client_id);
+const ClientInfo *connection_manager_info(const Client *c);
+typedef int (*ConnectionVisitor)(Client *c, void *ctx);
+int connection_manager_foreach(ConnectionVisitor visit, void *ctx);
+int connection_manager_foreach_online(ConnectionVisitor visit, void *ctx);
+int connection_manager_is_online(const char *username);
+int connection_manager_user_count(void);
+int connection_manager_throttle(socket_t fd, uint64_t delay_ms);
+int connection_manager_is_throttled(socket_t fd);
+typedef struct CommandJob CommandJob;
+typedef void (*ConnectionResumeHook)(socket_t fd);
+void connection_manager_set_resume_hook(ConnectionResumeHook hook);
+CommandJob *connection_manager_prepare_job(socket_t fd, const Message *msg);
+void connection_manager_complete_job(CommandJob *job);
+
+/* 空闲超时回调：记录被回收的连接并移除 */
+static socket_t reaped_fd = SOCKET_INVALID;
+static void reap_idle(socket_t fd)
+{
+	reaped_fd = fd;
+	connection_manager_remove(fd);
+}
+
+/* 目录读者：不断查询一直在线的用户和正在上下线的用户，一直在线的用户查不到即为错误 */
+#define DIRECTORY_READERS 4
+static atomic_int directory_stop;
+static atomic_int directory_misses;
+static atomic_long directory_lookups;
+static platform_thread_return_t PLATFORM_THREAD_CALL directory_reader(void *arg)
+{
+	char name[MAX_USERNAME_LEN];
+	int i = 0;
+	(void)arg;
+	while (!atomic_load(&directory_stop))
+	{
+		if (!connection_manager_is_online("anchor"))
+			atomic_fetch_add(&directory_misses, 1);
+		snprintf(name, sizeof(name), "d%d", i++ % 100);
+		connection_manager_is_online(name);
+		atomic_fetch_add(&directory_lookups, 1);
+	}
+	epoch_thread_release();
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/* 恢复回调：与 client_handler_resume 一样，限流暂停中只分发不恢复读取 */
+static int resume_calls = 0;
+static int resumed_reading = 0;
+static void record_resume(socket_t fd)
+{
+	resume_calls++;
+	if (!connection_manager_is_throttled(fd))
+		resumed_reading++;
+}
+
+/* 遍历回调：累加访问到的套接字 */
+static int sum_fds(Client *c, void *ctx)
+{
+	*(long long *)ctx += SOCKET_ID(c->sockfd);
+	return 0;
+}
 
 int main()
 {
@@ -36,8 +125,9 @@ int main()
 	assert(client2 != NULL);
 	assert(client1->sockfd == 100);
 	assert(client2->sockfd == 101);
-	assert(strcmp(client1->remote_ip, "192.168.1.100") == 0);
-	assert(strcmp(client2->remote_ip, "192.168.1.101") == 0);
+	assert(strcmp(connection_manager_info(client1)->remote_ip, "192.168.1.100") == 0);
+	assert(strcmp(connection_manager_info(client2)->remote_ip, "192.168.1.101") == 0);
+	assert(connection_manager_info(client2)->remote_port == 12346);
 	printf("✓ Found clients by fd\n\n");
 
 	// 测试3：设置客户端状态
@@ -63,6 +153,347 @@ int main()
 	connection_manager_print_all();
 	printf("✓ Printed client list\n\n");
 
+	// 测试6：按用户名索引查找，认证/登出/断开后保持同步
+	printf("Test 6: Username index...\n");
+	assert(connection_manager_find_by_username("carol") == NULL);
+	connection_manager_set_auth(101, 1001, "carol");
+	assert(connection_manager_find_by_username("carol") == connection_manager_find_by_fd(101));
+	connection_manager_clear_auth(101);
+	assert(connection_manager_find_by_username("carol") == NULL);
+	connection_manager_set_auth(101, 1001, "carol");
+	for (int fd = 200; fd < 1200; fd++)
+		connection_manager_add_from_fd(fd, "10.0.0.1", fd);
+	assert(connection_manager_count() == 1001);
+	for (int fd = 200; fd < 1200; fd += 2)
+		connection_manager_remove(fd);
+	for (int fd = 200; fd < 1200; fd++)
+		assert((connection_manager_find_by_fd(fd) != NULL) == (fd % 2 == 1));
+	assert(connection_manager_find_by_username("carol") == connection_manager_find_by_fd(101));
+	connection_manager_remove(101);
+	assert(connection_manager_find_by_username("carol") == NULL);
+	for (int fd = 201; fd < 1200; fd += 2)
+		connection_manager_remove(fd);
+	printf("✓ Indexes stay in sync\n\n");
+
+#ifndef _WIN32
+	// 测试7：跨分片投递，A 分片发给 B 分片上的用户，经全局目录和 B 的邮箱送达
+	printf("Test 7: Cross-shard mailbox...\n");
+	int pair[2];
+	char buf[32];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+	ConnectionShard *shard_a = connection_shard_create();
+	ConnectionShard *shard_b = connection_shard_create();
+	assert(shard_a && shard_b);
+	connection_manager_bind_shard(shard_b);
+	connection_manager_add_from_fd(pair[0], "127.0.0.1", 1);
+	connection_manager_set_auth(pair[0], 1002, "dave");
+	connection_manager_bind_shard(shard_a);
+	assert(connection_manager_find_by_username("dave") == NULL);
+	assert(connection_manager_is_remote_user("dave") == 1);
+	assert(connection_manager_count() == 0 && connection_manager_total_count() == 1);
+	SharedFrame *frame = shared_frame_create("MSG|a|dave||hi\n", 15);
+	assert(connection_manager_post_to_user("dave", frame) == 0);
+	shared_frame_release(frame);
+	assert(connection_manager_drain_mailbox() == 0);
+	connection_manager_bind_shard(shard_b);
+	assert(connection_manager_drain_mailbox() == 1);
+	assert(recv(pair[1], buf, sizeof(buf), 0) == 15 && memcmp(buf, "MSG|a|dave||hi\n", 15) == 0);
+	connection_manager_cleanup();
+	connection_manager_bind_shard(NULL);
+	assert(connection_manager_is_remote_user("dave") == 0);
+	connection_shard_destroy_all();
+	close(pair[0]);
+	close(pair[1]);
+	printf("✓ Cross-shard delivery through the mailbox\n\n");
+
+	// 测试8：空闲超时，收到数据的连接重设定时器，另一个连接到期被回收
+	printf("Test 8: Idle timeout...\n");
+	int quiet[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0 && socketpair(AF_UNIX, SOCK_STREAM, 0, quiet) == 0);
+	TimerWheel wheel;
+	timer_wheel_init(&wheel, 100, 0);
+	connection_manager_set_idle_timeout(&wheel, 2, reap_idle);
+	connection_manager_add_from_fd(pair[0], "127.0.0.1", 2);
+	connection_manager_add_from_fd(quiet[0], "127.0.0.1", 3);
+	assert(timer_wheel_count(&wheel) == 2);
+	assert(timer_wheel_advance(&wheel, 1500) == 0);
+	connection_manager_update_active(pair[0]);
+	assert(timer_wheel_advance(&wheel, 2100) == 1 && reaped_fd == quiet[0]);
+	assert(connection_manager_find_by_fd(quiet[0]) == NULL && connection_manager_find_by_fd(pair[0]) != NULL);
+	assert(recv(quiet[1], buf, sizeof(buf), MSG_DONTWAIT) > 0 && memcmp(buf, "ERROR|", 6) == 0);
+	assert(timer_wheel_advance(&wheel, 3600) == 1 && reaped_fd == pair[0]);
+	assert(connection_manager_count() == 0 && timer_wheel_count(&wheel) == 0);
+	connection_manager_set_idle_timeout(NULL, 0, NULL);
+	close(pair[0]);
+	close(pair[1]);
+	close(quiet[0]);
+	close(quiet[1]);
+	printf("✓ Idle connection reaped, active connection kept\n\n");
+
+	// 测试9：在线状态合并，窗口内上线又下线的用户不通知，关注部分用户的订阅者只收到自己关注的条目
+	printf("Test 9: Presence coalescing...\n");
+	int watcher[2], peer[2], brief[2];
+	char frame_buf[256];
+	char snapshot[64];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, watcher) == 0 && socketpair(AF_UNIX, SOCK_STREAM, 0, peer) == 0 &&
+		   socketpair(AF_UNIX, SOCK_STREAM, 0, brief) == 0);
+	presence_set_window(100);
+	connection_manager_add_from_fd(watcher[0], "127.0.0.1", 4);
+	connection_manager_add_from_fd(peer[0], "127.0.0.1", 5);
+	connection_manager_add_from_fd(brief[0], "127.0.0.1", 6);
+	connection_manager_set_auth(watcher[0], 1003, "erin");
+	connection_manager_set_auth(peer[0], 1004, "frank");
+	connection_manager_set_auth(brief[0], 1005, "gina");
+	connection_manager_remove(brief[0]);
+	assert(presence_flush(0) == 0);
+	assert(presence_flush(platform_monotonic_ms() + 1000) == 2);
+	ssize_t got = recv(watcher[1], frame_buf, sizeof(frame_buf) - 1, MSG_DONTWAIT);
+	assert(got > 0);
+	frame_buf[got] = '\0';
+	assert(strncmp(frame_buf, "PRESENCE|server|*|", 18) == 0 && strstr(frame_buf, "|+erin,+frank\n") != NULL);
+	assert(recv(peer[1], frame_buf, sizeof(frame_buf), MSG_DONTWAIT) == got);
+	assert(presence_flush(platform_monotonic_ms() + 1000) == 0);
+
+	assert(presence_watch("erin", "gina, bad-name") == -1);
+	assert(presence_watch("erin", "gina") == 1);
+	close(brief[0]);
+	close(brief[1]);
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, brief) == 0);
+	connection_manager_add_from_fd(brief[0], "127.0.0.1", 7);
+	connection_manager_set_auth(brief[0], 1005, "gina");
+	connection_manager_clear_auth(peer[0]);
+	assert(presence_snapshot("erin", snapshot, sizeof(snapshot)) == 1 && strcmp(snapshot, "+gina") == 0);
+	assert(presence_flush(platform_monotonic_ms() + 1000) == 2);
+	got = recv(watcher[1], frame_buf, sizeof(frame_buf) - 1, MSG_DONTWAIT);
+	assert(got > 0);
+	frame_buf[got] = '\0';
+	assert(strstr(frame_buf, "|+gina\n") != NULL && strstr(frame_buf, "frank") == NULL);
+	assert(recv(brief[1], frame_buf, sizeof(frame_buf) - 1, MSG_DONTWAIT) > 0 && strstr(frame_buf, "|+gina,-frank\n") != NULL);
+	connection_manager_cleanup();
+	presence_cleanup();
+	presence_set_window(0);
+	close(watcher[0]);
+	close(watcher[1]);
+	close(peer[0]);
+	close(peer[1]);
+	close(brief[0]);
+	close(brief[1]);
+	printf("✓ Presence changes coalesced per window and filtered per subscriber\n\n");
+#endif
+
+	// 测试10：集群放置，用户均匀分到各节点，增加一个节点只移动约四分之一的用户
+	printf("Test 10: Cluster placement...\n");
+	assert(cluster_configure("10.0.0.1:7001,bad", 0) == -1);
+	assert(cluster_configure("10.0.0.1:7001,10.0.0.2:7001", 2) == -1);
+	assert(cluster_configure("10.0.0.1:7001,10.0.0.2:7001,10.0.0.3:7001", 1) == 3);
+	int homes[1000];
+	int per_node[4] = {0};
+	for (int i = 0; i < 1000; i++)
+	{
+		char name[MAX_USERNAME_LEN];
+		snprintf(name, sizeof(name), "user%d", i);
+		homes[i] = cluster_home(name);
+		assert(homes[i] >= 0 && homes[i] < 3 && cluster_home(name) == homes[i]);
+		per_node[homes[i]]++;
+	}
+	for (int n = 0; n < 3; n++)
+		assert(per_node[n] > 200);
+	assert(cluster_configure("10.0.0.1:7001,10.0.0.2:7001,10.0.0.3:7001,10.0.0.4:7001", 1) == 4);
+	int moved = 0;
+	for (int i = 0; i < 1000; i++)
+	{
+		char name[MAX_USERNAME_LEN];
+		snprintf(name, sizeof(name), "user%d", i);
+		int home = cluster_home(name);
+		if (home != homes[i])
+		{
+			assert(home == 3);
+			moved++;
+		}
+	}
+	assert(moved > 100 && moved < 400);
+	assert(cluster_route_private("user1", "x", 1) == 1);
+	printf("✓ Users spread across nodes, %d of 1000 moved to the new node\n\n", moved);
+
+#ifndef _WIN32
+	// 测试11：进程交接，摘下连接不关闭套接字也不通知下线，恢复后认证状态和未处理的数据都还在
+	printf("Test 11: Detach and restore for handoff...\n");
+	char *pending = NULL;
+	Client saved;
+	ClientInfo saved_info;
+	memset(&saved, 0, sizeof(saved));
+	memset(&saved_info, 0, sizeof(saved_info));
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+	presence_set_window(100);
+	connection_manager_add_from_fd(pair[0], "127.0.0.1", 8);
+	connection_manager_set_auth(pair[0], 1006, "hank");
+	presence_flush(platform_monotonic_ms() + 1000);
+	while (recv(pair[1], frame_buf, sizeof(frame_buf), MSG_DONTWAIT) > 0)
+		;
+	saved.user_id = 1006;
+	saved.status = CLIENT_STATUS_AUTHENTICATED;
+	saved.protocol_version = 2;
+	saved_info.remote_port = 8;
+	safe_strcpy(saved.username, "hank", sizeof(saved.username));
+	safe_strcpy(saved_info.remote_ip, "127.0.0.1", sizeof(saved_info.remote_ip));
+	connection_manager_detach(pair[0]);
+	assert(connection_manager_find_by_fd(pair[0]) == NULL && connection_manager_find_by_username("hank") == NULL);
+	assert(send(pair[1], "x", 1, 0) == 1 && recv(pair[0], buf, sizeof(buf), 0) == 1);
+	connection_manager_add_from_fd(pair[0], "0.0.0.0", 0);
+	assert(connection_manager_restore(pair[0], &saved, &saved_info, "MSG|hank", 8, "OK\n", 3) == 0);
+	Client *restored = connection_manager_find_by_username("hank");
+	assert(restored != NULL && restored == connection_manager_find_by_fd(pair[0]));
+	assert(restored->user_id == 1006 && restored->protocol_version == 2);
+	assert(connection_manager_info(restored)->remote_port == 8 &&
+		   strcmp(connection_manager_info(restored)->remote_ip, "127.0.0.1") == 0);
+	assert(frame_buffer_peek(&restored->recv_buffer, &pending) == 8 && memcmp(pending, "MSG|hank", 8) == 0);
+	assert(send_queue_bytes(&restored->send_queue) == 3);
+	assert(presence_flush(platform_monotonic_ms() + 1000) == 0);
+	connection_manager_remove(pair[0]);
+	presence_cleanup();
+	presence_set_window(0);
+	close(pair[0]);
+	close(pair[1]);
+	printf("✓ Session survives detach and restore without presence changes\n\n");
+#endif
+
+	// 测试12：紧凑连接表，移除后末尾连接补位，遍历不重不漏；槽位复用后旧的连接ID查不到新连接
+	printf("Test 12: Dense connection table and stable ids...\n");
+	long long sum = 0;
+	for (int fd = 300; fd < 310; fd++)
+	{
+		char name[MAX_USERNAME_LEN];
+		connection_manager_add_from_fd(fd, "10.0.0.2", fd);
+		snprintf(name, sizeof(name), "u%d", fd);
+		if (fd % 2 == 0)
+			connection_manager_set_auth(fd, fd, name);
+	}
+	assert(connection_manager_foreach(sum_fds, &sum) == 10 && sum == 3045);
+	sum = 0;
+	assert(connection_manager_foreach_online(sum_fds, &sum) == 5 && sum == 300 + 302 + 304 + 306 + 308);
+	int old_id = connection_manager_find_by_fd(302)->client_id;
+	assert(connection_manager_find_by_id(old_id) == connection_manager_find_by_fd(302));
+	connection_manager_remove(302);
+	assert(connection_manager_find_by_id(old_id) == NULL);
+	sum = 0;
+	assert(connection_manager_foreach(sum_fds, &sum) == 9 && sum == 3045 - 302);
+	connection_manager_add_from_fd(302, "10.0.0.2", 302);
+	Client *reused = connection_manager_find_by_fd(302);
+	assert(reused->client_id != old_id && connection_manager_find_by_id(old_id) == NULL);
+	assert(connection_manager_find_by_id(reused->client_id) == reused);
+	connection_manager_clear_auth(300);
+	connection_manager_set_status(301, CLIENT_STATUS_AUTHENTICATED);
+	sum = 0;
+	assert(connection_manager_foreach_online(sum_fds, &sum) == 4 && sum == 301 + 304 + 306 + 308);
+	for (int fd = 300; fd < 310; fd++)
+		connection_manager_remove(fd);
+	assert(connection_manager_count() == 0 && connection_manager_foreach(sum_fds, &sum) == 0);
+	printf("✓ Fan-out skips unauthenticated connections, stale ids stay dead\n\n");
+
+	// 测试13: 紧凑消息
+	printf("Test 13: Packed messages and interned names...\n");
+	uint32_t alice_id = name_intern("alice");
+	assert(alice_id != NAME_ID_NONE && alice_id != NAME_ID_INLINE);
+	assert(name_intern("alice") == alice_id && name_intern("bob") != alice_id);
+	assert(strcmp(name_lookup(alice_id), "alice") == 0 && name_intern("") == NAME_ID_NONE);
+	Message m, out;
+	memset(&m, 0, sizeof(m));
+	strcpy(m.type, MSG_TYPE_MSG);
+	strcpy(m.sender, "alice");
+	strcpy(m.receiver, "bob");
+	format_timestamp((time_t)1700000000, m.timestamp, sizeof(m.timestamp));
+	strcpy(m.content, "hi");
+	m.message_id = 42;
+	PackedMessage *pm = message_pack(&m);
+	assert(pm && pm->sender == alice_id && pm->type != PACKED_TYPE_INLINE);
+	assert(!(pm->flags & PACKED_FLAG_RAW_TIME) && pm->timestamp == 1700000000);
+	assert(message_packed_size(pm) == offsetof(PackedMessage, tail) + 3);
+	memset(&out, 0x7f, sizeof(out));
+	message_unpack(pm, &out);
+	assert(strcmp(out.type, m.type) == 0 && strcmp(out.sender, "alice") == 0 && strcmp(out.receiver, "bob") == 0);
+	assert(strcmp(out.timestamp, m.timestamp) == 0 && strcmp(out.content, "hi") == 0);
+	assert(out.message_id == 42 && out.is_delivered == 0);
+	free(pm);
+	/* 超过旧上限的长内容、非规范时间戳和未知类型按原文保存 */
+	memset(m.content, 'x', MAX_CONTENT_LEN - 1);
+	m.content[MAX_CONTENT_LEN - 1] = '\0';
+	strcpy(m.timestamp, "yesterday");
+	strcpy(m.type, "CUSTOM");
+	m.is_delivered = 1;
+	pm = message_pack(&m);
+	assert(pm && pm->type == PACKED_TYPE_INLINE && (pm->flags & PACKED_FLAG_RAW_TIME));
+	assert(pm->content_len == MAX_CONTENT_LEN - 1);
+	message_unpack(pm, &out);
+	assert(strcmp(out.type, "CUSTOM") == 0 && strcmp(out.timestamp, "yesterday") == 0);
+	assert(strcmp(out.content, m.content) == 0 && strcmp(out.receiver, "bob") == 0 && out.is_delivered == 1);
+	assert(message_packed_size(pm) == offsetof(PackedMessage, tail) + MAX_CONTENT_LEN + 7 + 10);
+	free(pm);
+	printf("✓ Names interned once, short messages packed to header plus content, long content kept\n\n");
+
+	// 测试14：限流暂停中有命令在工作线程上执行，命令完成不解除暂停，暂停到期才恢复读取
+	printf("Test 14: Throttle outlives a finished command...\n");
+	ConnectionShard *throttled_shard = connection_shard_create();
+	TimerWheel throttle_wheel;
+	Message job_msg;
+	memset(&job_msg, 0, sizeof(job_msg));
+	safe_strcpy(job_msg.type, "STATUS", sizeof(job_msg.type));
+	safe_strcpy(job_msg.sender, "flooder", sizeof(job_msg.sender));
+	safe_strcpy(job_msg.receiver, "server", sizeof(job_msg.receiver));
+	assert(throttled_shard);
+	connection_manager_bind_shard(throttled_shard);
+	timer_wheel_init(&throttle_wheel, 100, 0);
+	connection_manager_set_idle_timeout(&throttle_wheel, 0, NULL);
+	connection_manager_set_resume_hook(record_resume);
+	connection_manager_add_from_fd(600, "10.0.0.4", 600);
+	connection_manager_set_auth(600, 600, "flooder");
+	CommandJob *job = connection_manager_prepare_job(600, &job_msg);
+	assert(job);
+	connection_manager_find_by_fd(600)->in_flight = 1;
+	assert(connection_manager_throttle(600, 500) == 0 && connection_manager_is_throttled(600));
+	connection_manager_complete_job(job);
+	assert(connection_manager_drain_mailbox() == 1);
+	assert(resume_calls == 1 && resumed_reading == 0 && connection_manager_is_throttled(600));
+	assert(connection_manager_find_by_fd(600)->in_flight == 0);
+	assert(timer_wheel_advance(&throttle_wheel, 600) == 1);
+	assert(resume_calls == 2 && resumed_reading == 1 && !connection_manager_is_throttled(600));
+	connection_manager_remove(600);
+	connection_manager_set_idle_timeout(NULL, 0, NULL);
+	connection_manager_set_resume_hook(NULL);
+	connection_manager_bind_shard(NULL);
+	connection_shard_destroy_all();
+	printf("✓ Reading stays paused until the throttle expires\n\n");
+
+	// 测试15：其他线程不加锁查询全局目录，同时本线程反复登录注销并使目录扩容
+	printf("Test 15: Lock-free directory lookups during login churn...\n");
+	platform_thread_t readers[DIRECTORY_READERS];
+	connection_manager_add_from_fd(399, "10.0.0.3", 399);
+	connection_manager_set_auth(399, 399, "anchor");
+	for (int i = 0; i < DIRECTORY_READERS; i++)
+		platform_thread_create(&readers[i], directory_reader, NULL);
+	for (int round = 0; round < 50; round++)
+	{
+		for (int fd = 400; fd < 500; fd++)
+		{
+			char name[MAX_USERNAME_LEN];
+			snprintf(name, sizeof(name), "d%d", fd - 400);
+			connection_manager_add_from_fd(fd, "10.0.0.3", fd);
+			connection_manager_set_auth(fd, fd, name);
+		}
+		assert(connection_manager_user_count() == 101 && connection_manager_is_online("d99"));
+		for (int fd = 400; fd < 500; fd++)
+			connection_manager_remove(fd);
+		assert(connection_manager_user_count() == 1 && !connection_manager_is_online("d0"));
+	}
+	atomic_store(&directory_stop, 1);
+	for (int i = 0; i < DIRECTORY_READERS; i++)
+		platform_thread_join(readers[i]);
+	assert(atomic_load(&directory_misses) == 0 && atomic_load(&directory_lookups) > 0);
+	connection_manager_remove(399);
+	assert(connection_manager_user_count() == 0 && !connection_manager_is_online("anchor"));
+	epoch_synchronize();
+	assert(epoch_pending() == 0);
+	printf("✓ %ld lookups never missed a user that stayed online\n\n", (long)atomic_load(&directory_lookups));
+
 	// 清理
 	printf("Cleaning up...\n");
 	connection_manager_cleanup();
@@ -0,0 +1,460 @@
+// tests/test_history.c
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include "../src/storage/storage.h"
+#include "../src/utils/utils.h"
+#include "../src/client/message_cache.h"
+
+#define TEST_DIR "test_history_data"
+#define TEST_SEGMENT_BYTES 2048
+#define TEST_KEEP 50
+#define MAX_PROBE 4096
+#define CACHE_DIR "test_client_cache"
+#define CACHE_FILE CACHE_DIR "/alice.cache"
+
+/* 查询结果收集 */
+typedef struct
+{
+	int count;
+	char last_content[MAX_CONTENT_LEN];
+	char first_content[MAX_CONTENT_LEN];
+} Collected;
+
+static int collect(const Message *msg, void *ctx)
+{
+	Collected *c = (Collected *)ctx;
+	if (c->count == 0)
+		safe_strcpy(c->first_content, msg->content, sizeof(c->first_content));
+	safe_strcpy(c->last_content, msg->content, sizeof(c->last_content));
+	c->count++;
+	return 0;
+}
+
+static void make_message(Message *msg, const char *type, const char *sender, const char *receiver, const char *content, int id)
+{
+	memset(msg, 0, sizeof(Message));
+	safe_strcpy(msg->type, type, sizeof(msg->type));
+	safe_strcpy(msg->sender, sender, sizeof(msg->sender));
+	safe_strcpy(msg->receiver, receiver, sizeof(msg->receiver));
+	safe_strcpy(msg->content, content, sizeof(msg->content));
+	msg->message_id = id;
+}
+
+/* 删除测试目录中的段文件、HEAD 和目录本身 */
+static void remove_test_dir(void)
+{
+	char path[128];
+	for (int id = 0; id < MAX_PROBE; id++)
+	{
+		snprintf(path, sizeof(path), "%s/%08u.seg", TEST_DIR, id);
+		remove(path);
+	}
+	remove(TEST_DIR "/HEAD");
+	remove(TEST_DIR "/HEAD.tmp");
+	remove(TEST_DIR);
+}
+
+/* 找到编号最大的段文件 */
+static int last_segment(char *path, size_t size)
+{
+	int last = -1;
+	for (int id = 0; id < MAX_PROBE; id++)
+	{
+		char probe[128];
+		snprintf(probe, sizeof(probe), "%s/%08u.seg", TEST_DIR, id);
+		FILE *fp = fopen(probe, "rb");
+		if (fp)
+		{
+			fclose(fp);
+			last = id;
+			safe_strcpy(path, probe, size);
+		}
+	}
+	return last;
+}
+
+int main()
+{
+	Message msg;
+	Collected c;
+	char content[64];
+
+	set_log_level(LOG_WARNING);
+	printf("=== History Manager Test ===\n\n");
+	remove_test_dir();
+
+	// 测试1：追加后关闭，写线程写完队列中的全部记录
+	printf("Test 1: Append and group commit...\n");
+	assert(history_manager_append(&msg) == -1);
+	assert(history_manager_init(TEST_DIR, TEST_SEGMENT_BYTES, TEST_KEEP) == 0);
+	for (int i = 0; i < 300; i++)
+	{
+		snprintf(content, sizeof(content), "msg-%d", i);
+		make_message(&msg, MSG_TYPE_MSG, (i % 2) ? "bob" : "alice", (i % 2) ? "alice" : "bob", content, i);
+		assert(history_manager_append(&msg) == 0);
+	}
+	for (int i = 0; i < 20; i++)
+	{
+		snprintf(content, sizeof(content), "hello-%d", i);
+		make_message(&msg, MSG_TYPE_BROADCAST, "charlie", "*", content, 300 + i);
+		assert(history_manager_append(&msg) == 0);
+	}
+	make_message(&msg, MSG_TYPE_LOGIN, "alice", "server", "alice123", 999);
+	assert(history_manager_append(&msg) == -1);
+	history_manager_shutdown();
+	assert(history_manager_dropped_count() == 0);
+	printf("✓ 320 messages committed\n");
+
+	// 测试2：重新打开时恢复段，旧段按保留条数轮转掉
+	printf("\nTest 2: Recovery and rotation...\n");
+	assert(history_manager_init(TEST_DIR, TEST_SEGMENT_BYTES, TEST_KEEP) == 0);
+	int retained = history_manager_record_count();
+	printf("Retained %d records\n", retained);
+	assert(retained >= TEST_KEEP && retained < 320);
+	char first_segment[128];
+	snprintf(first_segment, sizeof(first_segment), "%s/%08u.seg", TEST_DIR, 0);
+	FILE *fp = fopen(first_segment, "rb");
+	assert(fp == NULL);
+	printf("✓ Oldest segments rotated out\n");
+
+	// 测试3：查询最近的私聊和广播，按时间顺序返回
+	printf("\nTest 3: Queries...\n");
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("bob", "alice", 0, 0, 10, collect, &c) == 10);
+	assert(strcmp(c.first_content, "msg-290") == 0 && strcmp(c.last_content, "msg-299") == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("alice", "all", 0, 0, 0, collect, &c) == 20);
+	assert(strcmp(c.last_content, "hello-19") == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("charlie", "alice", 0, 0, 0, collect, &c) == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("alice", "bob", 0, 1, 0, collect, &c) == 0);
+	printf("✓ Conversation, broadcast and time filters work\n");
+
+	// 测试4：段尾不完整（模拟崩溃时的半批写入）时忽略尾部并写入新段
+	printf("\nTest 4: Torn tail recovery...\n");
+	history_manager_shutdown();
+	char tail_path[128];
+	int tail_id = last_segment(tail_path, sizeof(tail_path));
+	assert(tail_id >= 0);
+	fp = fopen(tail_path, "ab");
+	assert(fp);
+	fwrite("\x40\x00\x00\x00garbage", 1, 11, fp);
+	fclose(fp);
+
+	assert(history_manager_init(TEST_DIR, TEST_SEGMENT_BYTES, TEST_KEEP) == 0);
+	assert(history_manager_record_count() == retained);
+	make_message(&msg, MSG_TYPE_MSG, "alice", "bob", "after-crash", 1000);
+	assert(history_manager_append(&msg) == 0);
+	history_manager_shutdown();
+
+	assert(history_manager_init(TEST_DIR, TEST_SEGMENT_BYTES, TEST_KEEP) == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("alice", "bob", 0, 0, 1, collect, &c) == 1);
+	assert(strcmp(c.last_content, "after-crash") == 0);
+	assert(last_segment(tail_path, sizeof(tail_path)) > tail_id);
+	history_manager_shutdown();
+	printf("✓ Torn tail ignored, new records survive restart\n");
+
+	// 测试5：会话索引和时间索引跨多个段定位，只返回目标会话最近的记录
+	printf("\nTest 5: Indexed conversation and time range queries...\n");
+	remove_test_dir();
+	const char *pairs[3][2] = {{"alice", "bob"}, {"charlie", "alice"}, {"bob", "charlie"}};
+	time_t before = time(NULL);
+	assert(history_manager_init(TEST_DIR, 4096, 0) == 0);
+	for (int i = 0; i < 1000; i++)
+	{
+		snprintf(content, sizeof(content), "m-%d", i);
+		if (i % 4 == 3)
+			make_message(&msg, MSG_TYPE_BROADCAST, "bob", "*", content, i);
+		else
+			make_message(&msg, MSG_TYPE_MSG, pairs[i % 4][0], pairs[i % 4][1], content, i);
+		assert(history_manager_append(&msg) == 0);
+	}
+	history_manager_shutdown();
+	assert(history_manager_init(TEST_DIR, 4096, 0) == 0);
+	time_t after = time(NULL);
+	assert(history_manager_record_count() == 1000);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("alice", "charlie", 0, 0, 50, collect, &c) == 50);
+	assert(strcmp(c.first_content, "m-801") == 0 && strcmp(c.last_content, "m-997") == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("bob", "all", before, after, 1000, collect, &c) == HISTORY_QUERY_MAX_LIMIT);
+	assert(strcmp(c.last_content, "m-999") == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("alice", "bob", after + 1, 0, 0, collect, &c) == 0);
+	assert(history_manager_query("alice", "bob", 0, before - 1, 0, collect, &c) == 0);
+	assert(history_manager_query("alice", "dave", 0, 0, 0, collect, &c) == 0);
+	history_manager_shutdown();
+	printf("✓ Last 50 of one conversation found across segments; time bounds honoured\n");
+
+	// 测试6：最近消息缓存直接回答尚未落盘的查询，超出上限时按 LRU 淘汰整个会话
+	printf("\nTest 6: Recent message cache...\n");
+	remove_test_dir();
+	assert(history_manager_init(TEST_DIR, 0, 0) == 0);
+	for (int i = 0; i < 10; i++)
+	{
+		snprintf(content, sizeof(content), "old-%d", i);
+		make_message(&msg, MSG_TYPE_MSG, "alice", "bob", content, i);
+		assert(history_manager_append(&msg) == 0);
+	}
+	history_manager_shutdown();
+	assert(history_manager_cache_bytes() == 0);
+
+	assert(history_manager_set_cache(4096, 8) == 0);
+	assert(history_manager_init(TEST_DIR, 0, 0) == 0);
+	assert(history_manager_set_cache(0, 0) == -1);
+	size_t hits = history_manager_cache_hits();
+	make_message(&msg, MSG_TYPE_MSG, "bob", "alice", "new-0", 10);
+	assert(history_manager_append(&msg) == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("alice", "bob", 0, 0, 1, collect, &c) == 1);
+	assert(strcmp(c.last_content, "new-0") == 0 && history_manager_cache_hits() == hits + 1);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("alice", "bob", 0, 0, 5, collect, &c) == 5);
+	assert(history_manager_cache_hits() == hits + 1);
+
+	for (int i = 0; i < 100; i++)
+	{
+		char peer[16];
+		snprintf(peer, sizeof(peer), "user%d", i / 10);
+		snprintf(content, sizeof(content), "c-%d", i);
+		make_message(&msg, MSG_TYPE_MSG, "charlie", peer, content, 100 + i);
+		assert(history_manager_append(&msg) == 0);
+	}
+	assert(history_manager_cache_bytes() <= 4096);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query("user9", "charlie", 0, 0, 3, collect, &c) == 3);
+	assert(strcmp(c.first_content, "c-97") == 0 && strcmp(c.last_content, "c-99") == 0);
+	assert(history_manager_cache_hits() == hits + 2);
+	history_manager_shutdown();
+	assert(history_manager_set_cache(HISTORY_CACHE_BYTES, HISTORY_CACHE_RING) == 0);
+	printf("✓ Hot reads served from cache, cache bounded by LRU eviction\n");
+
+	// 测试7：序号跨重启递增，按游标分页增量同步，不重复也不遗漏
+	printf("\nTest 7: Cursor-based incremental sync...\n");
+	remove_test_dir();
+	assert(history_manager_set_cache(0, 0) == 0);
+	assert(history_manager_init(TEST_DIR, 4096, 0) == 0);
+	int previous = 0;
+	for (int i = 0; i < 300; i++)
+	{
+		snprintf(content, sizeof(content), "p-%d", i);
+		make_message(&msg, MSG_TYPE_MSG, i % 2 ? "alice" : "bob", i % 2 ? "bob" : "alice", content, 0);
+		assert(history_manager_append(&msg) == 0);
+		assert(msg.message_id > previous);
+		previous = msg.message_id;
+		make_message(&msg, MSG_TYPE_BROADCAST, "carol", "all", "noise", 0);
+		assert(history_manager_append(&msg) == 0);
+		previous = msg.message_id;
+	}
+	history_manager_shutdown();
+	assert(history_manager_init(TEST_DIR, 4096, 0) == 0);
+	assert(history_manager_committed_sequence() == (uint32_t)previous);
+	make_message(&msg, MSG_TYPE_MSG, "alice", "bob", "p-300", 0);
+	assert(history_manager_append(&msg) == 0);
+	assert(msg.message_id == previous + 1);
+	while (history_manager_committed_sequence() < (uint32_t)msg.message_id)
+		platform_sleep_ms(1);
+
+	uint32_t cursor = 0;
+	int more = 1;
+	int pages = 0;
+	int synced = 0;
+	while (more)
+	{
+		memset(&c, 0, sizeof(c));
+		int got = history_manager_query_after("alice", "bob", cursor, 50, collect, &c, &cursor, &more);
+		assert(got == (more ? 50 : 1));
+		snprintf(content, sizeof(content), "p-%d", synced);
+		assert(strcmp(c.first_content, content) == 0);
+		synced += got;
+		pages++;
+	}
+	assert(synced == 301 && pages == 7 && cursor == (uint32_t)msg.message_id);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query_after("alice", "bob", cursor, 50, collect, &c, &cursor, &more) == 0);
+	assert(more == 0 && cursor == (uint32_t)msg.message_id);
+	history_manager_shutdown();
+
+	assert(history_manager_set_cache(HISTORY_CACHE_BYTES, 8) == 0);
+	assert(history_manager_init(TEST_DIR, 4096, 0) == 0);
+	hits = history_manager_cache_hits();
+	uint32_t resume = history_manager_committed_sequence();
+	for (int i = 0; i < 5; i++)
+	{
+		snprintf(content, sizeof(content), "q-%d", i);
+		make_message(&msg, MSG_TYPE_MSG, "bob", "alice", content, 0);
+		assert(history_manager_append(&msg) == 0);
+	}
+	while (history_manager_committed_sequence() < (uint32_t)msg.message_id)
+		platform_sleep_ms(1);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query_after("alice", "bob", cursor, 3, collect, &c, &cursor, &more) == 3);
+	assert(strcmp(c.first_content, "q-0") == 0 && more == 1 && history_manager_cache_hits() == hits + 1);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query_after("alice", "bob", cursor, 3, collect, &c, &cursor, &more) == 2);
+	assert(strcmp(c.last_content, "q-4") == 0 && more == 0 && cursor == (uint32_t)msg.message_id);
+	assert(history_manager_cache_hits() == hits + 2);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_query_after("alice", "bob", resume - 2, 1, collect, &c, &cursor, &more) == 1);
+	assert(strcmp(c.first_content, "p-300") == 0 && more == 1);
+	history_manager_shutdown();
+	assert(history_manager_set_cache(HISTORY_CACHE_BYTES, HISTORY_CACHE_RING) == 0);
+	printf("✓ Sequence survives restart, pages resume from the cursor\n");
+
+	// 测试8：客户端本地缓存按页写入，重新打开后重建索引，写了一半的页被截掉
+	printf("\nTest 8: Client-side message cache...\n");
+	MessageCache cache;
+	remove(CACHE_FILE);
+	remove(CACHE_DIR);
+	assert(message_cache_init(&cache) == 0);
+	assert(message_cache_open(&cache, CACHE_DIR, "alice") == 0);
+	assert(message_cache_cursor(&cache, "bob") == 0 && message_cache_count(&cache, "bob") == 0);
+	for (int page = 0; page < 3; page++)
+	{
+		for (int i = 0; i < 40; i++)
+		{
+			snprintf(content, sizeof(content), "m-%d", page * 40 + i);
+			make_message(&msg, MSG_TYPE_HISTORY, i % 2 ? "alice" : "bob", i % 2 ? "bob" : "alice", content, 0);
+			assert(message_cache_add(&cache, "bob", &msg) == 0);
+		}
+		assert(message_cache_commit(&cache, "bob", (uint32_t)(page + 1) * 100) == 0);
+	}
+	make_message(&msg, MSG_TYPE_HISTORY, "carol", "all", "hello all", 0);
+	assert(message_cache_add(&cache, NULL, &msg) == 0);
+	assert(message_cache_commit(&cache, "all", 7) == 0);
+	assert(message_cache_cursor(&cache, "bob") == 300 && message_cache_count(&cache, "bob") == 120);
+	assert(message_cache_cursor(&cache, "all") == 7 && message_cache_count(&cache, "all") == 1);
+	memset(&c, 0, sizeof(c));
+	assert(message_cache_recent(&cache, "bob", MESSAGE_CACHE_VIEW_LIMIT, collect, &c) == MESSAGE_CACHE_VIEW_LIMIT);
+	assert(strcmp(c.first_content, "m-70") == 0 && strcmp(c.last_content, "m-119") == 0);
+
+	/* 没有等到游标的一页不写入；空页只推进游标 */
+	make_message(&msg, MSG_TYPE_HISTORY, "bob", "alice", "lost", 0);
+	assert(message_cache_add(&cache, "bob", &msg) == 0);
+	message_cache_discard(&cache);
+	assert(message_cache_commit(&cache, "bob", 310) == 0);
+	assert(message_cache_count(&cache, "bob") == 120 && message_cache_cursor(&cache, "bob") == 310);
+	message_cache_close(&cache);
+
+	/* 重新打开从文件重建，再在尾部追加半页模拟崩溃 */
+	FILE *torn = fopen(CACHE_FILE, "ab");
+	assert(torn != NULL);
+	fwrite("\x40\x00\x00\x00garbage", 1, 11, torn);
+	fclose(torn);
+	assert(message_cache_open(&cache, CACHE_DIR, "alice") == 0);
+	assert(message_cache_cursor(&cache, "bob") == 310 && message_cache_count(&cache, "bob") == 120);
+	assert(message_cache_count(&cache, "all") == 1);
+	make_message(&msg, MSG_TYPE_HISTORY, "bob", "alice", "m-120", 0);
+	assert(message_cache_add(&cache, "bob", &msg) == 0);
+	assert(message_cache_commit(&cache, "bob", 320) == 0);
+	memset(&c, 0, sizeof(c));
+	assert(message_cache_recent(&cache, "bob", 2, collect, &c) == 2);
+	assert(strcmp(c.first_content, "m-119") == 0 && strcmp(c.last_content, "m-120") == 0);
+	message_cache_close(&cache);
+	assert(message_cache_open(&cache, CACHE_DIR, "alice") == 0);
+	assert(message_cache_cursor(&cache, "bob") == 320 && message_cache_count(&cache, "bob") == 121);
+	memset(&c, 0, sizeof(c));
+	assert(message_cache_recent(&cache, "all", MESSAGE_CACHE_VIEW_LIMIT, collect, &c) == 1);
+	assert(strcmp(c.first_content, "hello all") == 0);
+	message_cache_destroy(&cache);
+	remove(CACHE_FILE);
+	remove(CACHE_DIR);
+	printf("✓ Cached pages survive reopen, torn tail is truncated\n");
+
+	// 测试9：全文检索按会话隔离，英文不分大小写，中文按字和词组匹配，重启后重建，段删除后裁剪
+	printf("\nTest 9: Full-text search...\n");
+	remove_test_dir();
+	int total = 0;
+	assert(history_manager_set_cache(0, 0) == 0);
+	assert(history_manager_init(TEST_DIR, 4096, 0) == 0);
+	assert(history_manager_set_search(0) == -1);
+	for (int i = 0; i < 200; i++)
+	{
+		snprintf(content, sizeof(content), "%s report %d", i % 10 == 0 ? "Quarterly" : "daily", i);
+		make_message(&msg, MSG_TYPE_MSG, i % 2 ? "alice" : "bob", i % 2 ? "bob" : "alice", content, 0);
+		assert(history_manager_append(&msg) == 0);
+	}
+	make_message(&msg, MSG_TYPE_MSG, "alice", "bob", "明天下午开会讨论预算", 0);
+	assert(history_manager_append(&msg) == 0);
+	make_message(&msg, MSG_TYPE_MSG, "carol", "dave", "quarterly report for carol", 0);
+	assert(history_manager_append(&msg) == 0);
+	while (history_manager_committed_sequence() < (uint32_t)msg.message_id)
+		platform_sleep_ms(1);
+	assert(history_manager_search_bytes() > 0);
+
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_search("bob", "alice", "QUARTERLY", 0, collect, &c, &total) == 20 && total == 20);
+	assert(strcmp(c.first_content, "Quarterly report 0") == 0 && strcmp(c.last_content, "Quarterly report 190") == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_search("alice", "bob", "quarterly 190", 0, collect, &c, &total) == 1 && total == 1);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_search("alice", "bob", "report", 5, collect, &c, &total) == 5 && total == 200);
+	assert(strcmp(c.first_content, "daily report 195") == 0 && strcmp(c.last_content, "daily report 199") == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_search("alice", "bob", "预算", 0, collect, &c, &total) == 1);
+	assert(strcmp(c.last_content, "明天下午开会讨论预算") == 0);
+	assert(history_manager_search("alice", "bob", "下午 会", 0, collect, &c, &total) == 1);
+	assert(history_manager_search("alice", "bob", "后天", 0, collect, &c, &total) == 0 && total == 0);
+	assert(history_manager_search("alice", "bob", "carol", 0, collect, &c, &total) == 0);
+	assert(history_manager_search("alice", "dave", "quarterly", 0, collect, &c, &total) == 0);
+	assert(history_manager_search("dave", "carol", "quarterly", 0, collect, &c, &total) == 1);
+	assert(history_manager_search("alice", "bob", " ,. ", 0, collect, &c, &total) == 0);
+
+	history_manager_shutdown();
+	assert(history_manager_search_bytes() == 0);
+	assert(history_manager_init(TEST_DIR, 4096, 0) == 0);
+	memset(&c, 0, sizeof(c));
+	assert(history_manager_search("bob", "alice", "quarterly", 0, collect, &c, &total) == 20);
+	assert(history_manager_search("alice", "bob", "开会", 0, collect, &c, &total) == 1);
+	history_manager_shutdown();
+
+	/* 小段和保留上限：旧段被删除后不再命中，也不会访问已删除的段 */
+	remove_test_dir();
+	assert(history_manager_init(TEST_DIR, TEST_SEGMENT_BYTES, TEST_KEEP) == 0);
+	for (int i = 0; i < 400; i++)
+	{
+		snprintf(content, sizeof(content), "needle %d", i);
+		make_message(&msg, MSG_TYPE_MSG, "alice", "bob", content, 0);
+		assert(history_manager_append(&msg) == 0);
+	}
+	while (history_manager_committed_sequence() < (uint32_t)msg.message_id)
+		platform_sleep_ms(1);
+	memset(&c, 0, sizeof(c));
+	int kept = history_manager_search("alice", "bob", "needle", HISTORY_QUERY_MAX_LIMIT, collect, &c, &total);
+	assert(kept == total && total >= TEST_KEEP && total < 400);
+	assert(strcmp(c.last_content, "needle 399") == 0);
+	assert(history_manager_search("alice", "bob", "needle 0", 0, collect, &c, &total) == 0);
+	history_manager_shutdown();
+
+	/* 检索关闭时拒绝查询，也不建索引 */
+	assert(history_manager_set_search(0) == 0);
+	assert(history_manager_init(TEST_DIR, TEST_SEGMENT_BYTES, TEST_KEEP) == 0);
+	assert(history_manager_search_bytes() == 0);
+	assert(history_manager_search("alice", "bob", "needle", 0, collect, &c, &total) == -1);
+	history_manager_shutdown();
+	assert(history_manager_set_search(1) == 0);
+	assert(history_manager_set_cache(HISTORY_CACHE_BYTES, HISTORY_CACHE_RING) == 0);
+
+	char snippet[HISTORY_SNIPPET_LEN + 8];
+	char longtext[256];
+	assert(history_search_snippet("short note", "note", snippet, sizeof(snippet)) == 10);
+	assert(strcmp(snippet, "short note") == 0);
+	memset(longtext, 'x', 200);
+	memcpy(longtext + 150, "Needle here", 11);
+	longtext[200] = '\0';
+	history_search_snippet(longtext, "needle", snippet, sizeof(snippet));
+	assert(strncmp(snippet, "...", 3) == 0 && strstr(snippet, "Needle here") != NULL);
+	assert(strlen(snippet) <= HISTORY_SNIPPET_LEN + 3);
+	history_search_snippet("明天下午开会讨论预算", "预算", snippet, 14);
+	assert(strcmp(snippet, "明天...") == 0);
+	printf("✓ Per-conversation AND search, CJK bigrams, rebuild on restart, trimmed with retention\n");
+
+	remove_test_dir();
+	printf("\n=== All history tests passed ===\n");
+	return 0;
+}
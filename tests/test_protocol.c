@@ -21,7 +21,7 @@ void test_parse_basic()
 	assert(strcmp(msg->content, "password123") == 0);
 
 	printf("  ✓ Login message parsed\n");
-	safe_free((void **)&msg);
+	free_message(msg);
 }
 
 void test_parse_with_escape()
@@ -36,7 +36,26 @@ void test_parse_with_escape()
 	assert(strcmp(msg->content, "Hello|World\nNew line") == 0);
 
 	printf("  ✓ Message with escape characters parsed\n");
-	safe_free((void **)&msg);
+	free_message(msg);
+}
+
+void test_parse_into()
+{
+	printf("Testing in-place parse...\n");
+
+	// 在可写缓冲区上原地解析，content 中未转义的多余分隔符保留在 content 内
+	char buffer[] = "MSG|bob|alice||a\\\\|b\\|c|d";
+	Message msg;
+	assert(parse_message_into(buffer, strlen(buffer), &msg) == 0);
+	assert(strcmp(msg.sender, "bob") == 0);
+	assert(strcmp(msg.receiver, "alice") == 0);
+	assert(strlen(msg.timestamp) > 0);
+	assert(strcmp(msg.content, "a\\|b|c|d") == 0);
+
+	char bad[] = "NOPE|a|b|c|d";
+	assert(parse_message_into(bad, strlen(bad), &msg) != 0);
+
+	printf("  ✓ Message parsed in place\n");
 }
 
 void test_serialize()
@@ -89,6 +108,31 @@ void test_escape_unescape()
 	}
 }
 
+void test_escape_heavy()
+{
+	printf("Testing escape-heavy round trip...\n");
+
+	// 大量分隔符和反斜杠混合的内容，转义后再解析应完全还原
+	char content[200];
+	for (int i = 0; i < 199; i++)
+		content[i] = (i % 3 == 0) ? '|' : ((i % 3 == 1) ? '\\' : 'x');
+	content[199] = '\0';
+
+	char *escaped = escape_field(content);
+	assert(escaped != NULL);
+
+	char raw[1024];
+	snprintf(raw, sizeof(raw), "MSG|a|b|2024-01-15 10:30:00|%s\n", escaped);
+	assert(validate_message(raw));
+	Message *msg = parse_message(raw);
+	assert(msg != NULL);
+	assert(strcmp(msg->content, content) == 0);
+
+	printf("  ✓ %zu-byte escaped content restored\n", strlen(escaped));
+	free(escaped);
+	free_message(msg);
+}
+
 void test_command_type()
 {
 	printf("Testing command type recognition...\n");
@@ -153,6 +197,67 @@ void test_validation()
 	}
 }
 
+void test_binary_v2()
+{
+	printf("Testing binary protocol v2...\n");
+
+	// 编码后原样解码，特殊字符不转义
+	Message msg, out;
+	char frame[PROTOCOL_V2_MAX_FRAME];
+	memset(&msg, 0, sizeof(Message));
+	strcpy(msg.type, "GROUP");
+	strcpy(msg.sender, "alice");
+	strcpy(msg.receiver, "group:dev");
+	strcpy(msg.timestamp, "2024-01-15 10:30:00");
+	strcpy(msg.content, "a|b\\c\nd");
+	size_t len = protocol_v2_encode(&msg, frame, sizeof(frame));
+	assert(len > 0 && (unsigned char)frame[0] == PROTOCOL_V2_MAGIC);
+	assert(frame[2] == CMD_JOIN_GROUP);
+	size_t header_len, body_len;
+	assert(protocol_v2_frame(frame, len - 1, &header_len, &body_len) == 0);
+	assert(protocol_v2_frame(frame, len, &header_len, &body_len) == 1 && header_len + body_len == len);
+	assert(protocol_v2_decode(frame + header_len, body_len, &out) == 0);
+	assert(strcmp(out.type, "GROUP") == 0 && strcmp(out.receiver, "group:dev") == 0);
+	assert(strcmp(out.content, msg.content) == 0);
+
+	// 字段长度越界和未知标签被拒绝
+	assert(protocol_v2_decode(frame + header_len, body_len - 1, &out) != 0);
+	frame[header_len] = 99;
+	assert(protocol_v2_decode(frame + header_len, body_len, &out) != 0);
+
+	// 文本响应转换成 v2 后与原帧内容一致
+	char *text = build_error_msg(ERROR_USER_NOT_FOUND, "User not found");
+	size_t binary_len;
+	char *binary = protocol_v2_from_text(text, strlen(text), &binary_len);
+	assert(binary && protocol_v2_frame(binary, binary_len, &header_len, &body_len) == 1);
+	assert(protocol_v2_decode(binary + header_len, body_len, &out) == 0);
+	assert(strcmp(out.type, MSG_TYPE_ERROR) == 0 && strcmp(out.content, "1002|User not found") == 0);
+
+	// 同一缓冲区中文本帧和 v2 帧按首字节区分，v2 半帧等待后续数据
+	FrameBuffer fb;
+	size_t space;
+	char *got;
+	size_t got_len;
+	int is_binary;
+	frame_buffer_init(&fb, 0);
+	char *dst = frame_buffer_reserve(&fb, 256, &space);
+	memcpy(dst, text, strlen(text));
+	memcpy(dst + strlen(text), binary, binary_len - 3);
+	frame_buffer_commit(&fb, strlen(text) + binary_len - 3);
+	assert(protocol_next_frame(&fb, &got, &got_len, &is_binary) == 1 && !is_binary);
+	assert(protocol_next_frame(&fb, &got, &got_len, &is_binary) == 0);
+	dst = frame_buffer_reserve(&fb, 16, &space);
+	memcpy(dst, binary + binary_len - 3, 3);
+	frame_buffer_commit(&fb, 3);
+	assert(protocol_next_frame(&fb, &got, &got_len, &is_binary) == 1 && is_binary && got_len == body_len);
+	assert(frame_buffer_pending(&fb) == 0);
+	frame_buffer_free(&fb);
+	free(text);
+	free(binary);
+
+	printf("  ✓ v2 frames round-trip, reject malformed input and mix with text frames\n");
+}
+
 int main()
 {
 	set_log_file(NULL);
@@ -162,9 +267,12 @@ int main()
 
 	test_parse_basic();
 	test_parse_with_escape();
+	test_parse_into();
 	test_serialize();
 	test_escape_unescape();
+	test_escape_heavy();
 	test_command_type();
+	test_binary_v2();
 	test_validation();
 
 	printf("\n=== All tests passed! ===\n");
@@ -1,6 +1,7 @@
 // tests/test_session.c
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "../src/core/core.h"
 #include "../src/storage/storage.h"
@@ -54,6 +55,32 @@ int main()
 	assert(session_manager_is_user_online("bob") == 0);
 	printf("✓ Online status checked\n");
 
+	// 测试5b：在线名单快照在名单变化前复用，同一用户的多个连接只列一次
+	printf("\nTest 5b: Online roster...\n");
+	const OnlineRoster *roster = connection_manager_roster_acquire();
+	assert(roster != NULL && roster->count == 1 && strcmp(roster->names, "alice") == 0);
+	assert(connection_manager_roster_acquire() == roster);
+	connection_manager_roster_release(roster);
+	assert(session_manager_authenticate(101, "alice", "alice123") == 1);
+	assert(connection_manager_roster_acquire() == roster && connection_manager_user_count() == 1);
+	connection_manager_roster_release(roster);
+	session_manager_logout(101);
+	assert(session_manager_authenticate(101, "bob", "bob123") == 1);
+	const OnlineRoster *changed = connection_manager_roster_acquire();
+	assert(changed != roster && changed->version == connection_manager_roster_version());
+	assert(changed->count == 2 && strcmp(changed->names, "alice,bob") == 0);
+	connection_manager_roster_release(changed);
+	connection_manager_roster_release(roster);
+	char **online = NULL;
+	int online_count = 0;
+	assert(session_manager_get_online_users(&online, &online_count) == 1 && online_count == 2);
+	assert(strcmp(online[0], "alice") == 0 && strcmp(online[1], "bob") == 0);
+	for (int i = 0; i < online_count; i++)
+		free(online[i]);
+	free(online);
+	session_manager_logout(101);
+	printf("✓ Roster rebuilt only after it changed\n");
+
 	// 测试6：登出
 	printf("\nTest 6: Logout...\n");
 	session_manager_logout(100);
@@ -69,11 +96,554 @@ int main()
 	assert(strcmp(session_manager_get_username(100), "bob") == 0);
 	printf("✓ Login after logout successful\n");
 
+	// 测试8：大量注册后按用户名和ID查找
+	printf("\nTest 8: Indexed user store lookups...\n");
+	set_log_level(LOG_WARNING);
+	char name[MAX_USERNAME_LEN];
+	int base_count = user_store_count();
+	user_store_set_hash_iterations(1); // 这里只检查索引，用最低代价派生口令摘要
+	for (int i = 0; i < 5000; i++)
+	{
+		snprintf(name, sizeof(name), "user%d", i);
+		assert(user_store_add(name, "pw") == 1);
+	}
+	assert(user_store_count() == base_count + 5000);
+	assert(user_store_add("user42", "pw") == 0);
+	User *u = user_store_find_by_username("user4321");
+	assert(u != NULL);
+	assert(user_store_find_by_id(u->user_id) == u);
+	assert(user_store_find_by_id(999) == NULL);
+	assert(user_store_authenticate("user4999", "pw") == 1);
+	user_store_set_hash_iterations(0);
+	set_log_level(LOG_INFO);
+	printf("✓ %d users indexed\n", user_store_count());
+
+	// 测试8b：验证通过的凭证进入缓存，同一口令再次认证不再派生摘要，错误口令仍被拒绝
+	printf("\nTest 8b: Verified credential cache...\n");
+	size_t hits = user_store_credential_cache_hits();
+	assert(user_store_authenticate("user4999", "pw") == 1);
+	assert(user_store_credential_cache_hits() == hits + 1);
+	assert(user_store_authenticate("user4999", "pw2") == 0);
+	assert(user_store_authenticate("user4998", "pw") == 1);
+	assert(user_store_credential_cache_hits() == hits + 1);
+	printf("✓ Cached credential reused, wrong password still rejected\n");
+
+#ifndef _WIN32
+	// 测试9：命令在工作线程上执行，认证状态和响应随完成邮件回到所属分片
+	printf("\nTest 9: Login on a worker thread...\n");
+	int pair[2];
+	char buf[256];
+	Message login;
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+	ConnectionShard *shard = connection_shard_create();
+	assert(shard != NULL);
+	connection_manager_bind_shard(shard);
+	connection_manager_add_from_fd(pair[0], "127.0.0.1", 1);
+	char *frame = build_login_msg("charlie", "charlie123");
+	assert(frame != NULL);
+	frame[strcspn(frame, "\n")] = '\0';
+	assert(parse_message_into(frame, strlen(frame), &login) == 0);
+	free(frame);
+	CommandJob *job = connection_manager_prepare_job(pair[0], &login);
+	assert(job != NULL);
+	assert(worker_pool_start(2) == 2);
+	assert(worker_pool_submit(job) == 0);
+	while (connection_manager_drain_mailbox() == 0)
+		platform_sleep_ms(1);
+	assert(session_manager_is_authenticated(pair[0]) == 1);
+	assert(strcmp(session_manager_get_username(pair[0]), "charlie") == 0);
+	ssize_t n = recv(pair[1], buf, sizeof(buf) - 1, 0);
+	assert(n > 0);
+	buf[n] = '\0';
+	assert(strstr(buf, "Login successful") != NULL);
+	worker_pool_stop();
+
+	// 登录交给认证线程池，走同一条完成邮件的路径
+	connection_manager_remove(pair[0]);
+	connection_manager_add_from_fd(pair[0], "127.0.0.1", 1);
+	frame = build_login_msg("admin", "admin123");
+	assert(frame != NULL);
+	frame[strcspn(frame, "\n")] = '\0';
+	assert(parse_message_into(frame, strlen(frame), &login) == 0);
+	free(frame);
+	job = connection_manager_prepare_job(pair[0], &login);
+	assert(job != NULL);
+	assert(auth_pool_start(1) == 1);
+	assert(auth_pool_submit(job) == 0);
+	while (connection_manager_drain_mailbox() == 0)
+		platform_sleep_ms(1);
+	auth_pool_stop();
+	assert(auth_pool_size() == 0);
+	assert(strcmp(session_manager_get_username(pair[0]), "admin") == 0);
+	n = recv(pair[1], buf, sizeof(buf) - 1, 0);
+	assert(n > 0);
+	buf[n] = '\0';
+	assert(strstr(buf, "Login successful") != NULL);
+	connection_manager_cleanup();
+	connection_manager_bind_shard(NULL);
+	connection_shard_destroy_all();
+	close(pair[0]);
+	close(pair[1]);
+	printf("✓ Worker result applied on the owning shard\n");
+#endif
+
+	// 测试10：群组成员索引，成员数超过旧的50上限，加入/退出/判断都是哈希查找
+	printf("\nTest 10: Group membership index...\n");
+	set_log_level(LOG_WARNING);
+	for (int i = 0; i < 5000; i++)
+	{
+		snprintf(name, sizeof(name), "user%d", i);
+		assert(group_manager_join("big", name) == 0);
+	}
+	assert(group_manager_join("big", "user7") == 1);
+	assert(group_manager_join("small", "user7") == 0);
+	assert(group_manager_member_count("big") == 5000);
+	assert(group_manager_user_group_count("user7") == 2);
+	assert(group_manager_is_member("big", "user4999") == 1);
+	assert(group_manager_is_member("big", "alice") == 0);
+	assert(group_manager_leave("big", "user7") == 0);
+	assert(group_manager_leave("big", "user7") == -1);
+	assert(group_manager_is_member("big", "user7") == 0);
+	assert(group_manager_user_group_count("user7") == 1);
+	assert(group_manager_leave("small", "user7") == 0);
+	assert(group_manager_member_count("small") == 0);
+	assert(group_manager_join("all", "alice") == -1);
+	group_manager_cleanup();
+	assert(group_manager_member_count("big") == 0);
+	set_log_level(LOG_INFO);
+	printf("✓ 5000-member group indexed both ways\n");
+
+#ifndef _WIN32
+	// 测试11：加入群组后发送群组消息，经共享帧发给在线的其他成员
+	printf("\nTest 11: Group join and fan-out...\n");
+	int alice_pair[2], bob_pair[2];
+	Message gmsg;
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, alice_pair) == 0);
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, bob_pair) == 0);
+	connection_manager_add_from_fd(alice_pair[0], "127.0.0.1", 2);
+	connection_manager_add_from_fd(bob_pair[0], "127.0.0.1", 3);
+	assert(session_manager_authenticate(alice_pair[0], "alice", "alice123") == 1);
+	assert(session_manager_authenticate(bob_pair[0], "bob", "bob123") == 1);
+	const char *steps[3][3] = {{"alice", GROUP_CONTROL_JOIN, "Joined group dev"},
+							   {"bob", GROUP_CONTROL_JOIN, "Joined group dev (2 members)"},
+							   {"alice", "standup now", "Group message sent"}};
+	for (int i = 0; i < 3; i++)
+	{
+		int fd = strcmp(steps[i][0], "alice") == 0 ? alice_pair[0] : bob_pair[0];
+		int peer = strcmp(steps[i][0], "alice") == 0 ? alice_pair[1] : bob_pair[1];
+		char *gframe = build_group_msg(steps[i][0], "dev", steps[i][1]);
+		assert(gframe != NULL);
+		gframe[strcspn(gframe, "\n")] = '\0';
+		assert(parse_message_into(gframe, strlen(gframe), &gmsg) == 0);
+		free(gframe);
+		assert(handle_command(fd, &gmsg) == 0);
+		n = recv(peer, buf, sizeof(buf) - 1, 0);
+		assert(n > 0);
+		buf[n] = '\0';
+		assert(strstr(buf, steps[i][2]) != NULL);
+	}
+	n = recv(bob_pair[1], buf, sizeof(buf) - 1, 0);
+	assert(n > 0);
+	buf[n] = '\0';
+	assert(strstr(buf, "GROUP|alice|group:dev|") != NULL && strstr(buf, "standup now") != NULL);
+	assert(recv(alice_pair[1], buf, sizeof(buf), MSG_DONTWAIT) < 0);
+	connection_manager_remove(alice_pair[0]);
+	connection_manager_remove(bob_pair[0]);
+	group_manager_cleanup();
+	for (int i = 0; i < 2; i++)
+	{
+		close(alice_pair[i]);
+		close(bob_pair[i]);
+	}
+	printf("✓ Group message delivered once to the other member\n");
+
+	// 测试12：发给离线用户的消息排队，登录时随登录响应一次写出；超出上限的计入溢出
+	printf("\nTest 12: Offline queue flushed on login...\n");
+	int sender_pair[2], receiver_pair[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sender_pair) == 0);
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, receiver_pair) == 0);
+	connection_manager_add_from_fd(sender_pair[0], "127.0.0.1", 4);
+	assert(session_manager_authenticate(sender_pair[0], "alice", "alice123") == 1);
+	for (int i = 0; i < 3; i++)
+	{
+		char text[32];
+		snprintf(text, sizeof(text), "while away %d", i);
+		char *pframe = build_text_msg("alice", "charlie", text);
+		assert(pframe != NULL);
+		pframe[strcspn(pframe, "\n")] = '\0';
+		assert(parse_message_into(pframe, strlen(pframe), &gmsg) == 0);
+		free(pframe);
+		assert(handle_command(sender_pair[0], &gmsg) == 0);
+		n = recv(sender_pair[1], buf, sizeof(buf) - 1, 0);
+		assert(n > 0);
+		buf[n] = '\0';
+		assert(strstr(buf, "message queued") != NULL);
+	}
+	assert(offline_queue_pending("charlie") == 3);
+
+	connection_manager_add_from_fd(receiver_pair[0], "127.0.0.1", 5);
+	char *lframe = build_login_msg("charlie", "charlie123");
+	assert(lframe != NULL);
+	lframe[strcspn(lframe, "\n")] = '\0';
+	assert(parse_message_into(lframe, strlen(lframe), &gmsg) == 0);
+	free(lframe);
+	assert(handle_command(receiver_pair[0], &gmsg) == 0);
+	char burst[2048];
+	n = recv(receiver_pair[1], burst, sizeof(burst) - 1, 0);
+	assert(n > 0);
+	burst[n] = '\0';
+	assert(strstr(burst, "Login successful, 3 offline messages") != NULL);
+	assert(strstr(burst, "while away 0") != NULL && strstr(burst, "while away 2") != NULL);
+	assert(strstr(burst, "while away 0") < strstr(burst, "while away 2"));
+	assert(offline_queue_pending("charlie") == 0 && offline_queue_bytes() == 0);
+
+	for (int i = 0; i < OFFLINE_QUEUE_MAX_PER_USER + 10; i++)
+		assert(offline_queue_push("ghost", "MSG|a|ghost|t|x\n", 16) == 0);
+	assert(offline_queue_pending("ghost") == OFFLINE_QUEUE_MAX_PER_USER);
+	size_t backlog_len;
+	int spilled;
+	char *backlog = offline_queue_take("ghost", &backlog_len, &spilled);
+	assert(backlog != NULL && backlog_len == (size_t)OFFLINE_QUEUE_MAX_PER_USER * 16 && spilled == 10);
+	free(backlog);
+	offline_queue_cleanup();
+	connection_manager_remove(sender_pair[0]);
+	connection_manager_remove(receiver_pair[0]);
+	for (int i = 0; i < 2; i++)
+	{
+		close(sender_pair[i]);
+		close(receiver_pair[i]);
+	}
+	printf("✓ Backlog delivered in one burst after the login response\n");
+
+	// 测试12b：接受 ack 的用户收到编号的消息，投递后保留到累计确认；重新登录时重发未确认的
+	printf("\nTest 12b: Cumulative delivery acks...\n");
+	char stamp[32] = "2025-01-01 10:00:00;42";
+	assert(protocol_take_delivery_id(stamp) == 42 && strcmp(stamp, "2025-01-01 10:00:00") == 0);
+	assert(protocol_take_delivery_id(stamp) == 0 && strcmp(stamp, "2025-01-01 10:00:00") == 0);
+	assert(protocol_find_option("server;v2;ack", PROTOCOL_OPTION_ACK) != NULL);
+	assert(strncmp(protocol_find_option("client;v2;ack=77", PROTOCOL_OPTION_ACK), "77", 2) == 0);
+	assert(protocol_find_option("server;v2", PROTOCOL_OPTION_ACK) == NULL);
+	assert(protocol_find_option(PROTOCOL_V2_ACCEPT, PROTOCOL_OPTION_V2) != NULL);
+	assert(protocol_find_option("server;acks", PROTOCOL_OPTION_ACK) == NULL);
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sender_pair) == 0);
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, receiver_pair) == 0);
+	connection_manager_add_from_fd(sender_pair[0], "127.0.0.1", 4);
+	assert(session_manager_authenticate(sender_pair[0], "alice", "alice123") == 1);
+	connection_manager_add_from_fd(receiver_pair[0], "127.0.0.1", 5);
+	lframe = build_login_to("charlie", "charlie123", "server;" PROTOCOL_OPTION_ACK);
+	assert(lframe != NULL);
+	lframe[strcspn(lframe, "\n")] = '\0';
+	assert(parse_message_into(lframe, strlen(lframe), &gmsg) == 0);
+	free(lframe);
+	assert(handle_command(receiver_pair[0], &gmsg) == 0);
+	n = recv(receiver_pair[1], burst, sizeof(burst) - 1, 0);
+	assert(n > 0);
+	burst[n] = '\0';
+	assert(strstr(burst, "|client;ack=") != NULL);
+
+	for (int i = 0; i < 3; i++)
+	{
+		char text[32];
+		snprintf(text, sizeof(text), "tracked %d", i);
+		char *pframe = build_text_msg("alice", "charlie", text);
+		assert(pframe != NULL);
+		pframe[strcspn(pframe, "\n")] = '\0';
+		assert(parse_message_into(pframe, strlen(pframe), &gmsg) == 0);
+		free(pframe);
+		assert(handle_command(sender_pair[0], &gmsg) == 0);
+		n = recv(sender_pair[1], buf, sizeof(buf) - 1, 0);
+		assert(n > 0);
+		buf[n] = '\0';
+		assert(strstr(buf, "Message sent successfully") != NULL);
+	}
+	n = recv(receiver_pair[1], burst, sizeof(burst) - 1, 0);
+	assert(n > 0);
+	burst[n] = '\0';
+	assert(strstr(burst, ";1|tracked 0") != NULL && strstr(burst, ";3|tracked 2") != NULL);
+	assert(offline_queue_pending("charlie") == 3);
+
+	// 累计确认成批删除，不回复；超过已分配序号的确认按已分配的处理
+	char *aframe = build_ack_request("charlie", 2);
+	assert(aframe != NULL);
+	aframe[strcspn(aframe, "\n")] = '\0';
+	assert(parse_message_into(aframe, strlen(aframe), &gmsg) == 0 && is_ack_msg(&gmsg));
+	free(aframe);
+	assert(handle_command(receiver_pair[0], &gmsg) == 0);
+	assert(offline_queue_pending("charlie") == 1);
+	assert(recv(receiver_pair[1], buf, sizeof(buf), MSG_DONTWAIT) < 0);
+
+	// 断线后发来的消息和未确认的消息在重新登录时一起重发，序号继续递增
+	session_manager_logout(receiver_pair[0]);
+	connection_manager_remove(receiver_pair[0]);
+	char *pframe = build_text_msg("alice", "charlie", "tracked later");
+	assert(pframe != NULL);
+	pframe[strcspn(pframe, "\n")] = '\0';
+	assert(parse_message_into(pframe, strlen(pframe), &gmsg) == 0);
+	free(pframe);
+	assert(handle_command(sender_pair[0], &gmsg) == 0);
+	n = recv(sender_pair[1], buf, sizeof(buf) - 1, 0);
+	assert(n > 0);
+	buf[n] = '\0';
+	assert(strstr(buf, "message queued") != NULL);
+	assert(offline_queue_pending("charlie") == 2);
+
+	connection_manager_add_from_fd(receiver_pair[0], "127.0.0.1", 5);
+	lframe = build_login_to("charlie", "charlie123", "server;" PROTOCOL_OPTION_ACK);
+	assert(lframe != NULL);
+	lframe[strcspn(lframe, "\n")] = '\0';
+	assert(parse_message_into(lframe, strlen(lframe), &gmsg) == 0);
+	free(lframe);
+	assert(handle_command(receiver_pair[0], &gmsg) == 0);
+	n = recv(receiver_pair[1], burst, sizeof(burst) - 1, 0);
+	assert(n > 0);
+	burst[n] = '\0';
+	assert(strstr(burst, "|client;ack=") != NULL && strstr(burst, "2 offline messages") != NULL);
+	assert(strstr(burst, ";3|tracked 2") != NULL && strstr(burst, ";4|tracked later") != NULL);
+	assert(offline_queue_pending("charlie") == 2);
+	assert(offline_queue_ack("charlie", 1000) == 2);
+	assert(offline_queue_pending("charlie") == 0);
+
+	offline_queue_cleanup();
+	connection_manager_remove(sender_pair[0]);
+	connection_manager_remove(receiver_pair[0]);
+	for (int i = 0; i < 2; i++)
+	{
+		close(sender_pair[i]);
+		close(receiver_pair[i]);
+	}
+	printf("✓ Unacked messages retained, trimmed in bulk and resent after reconnect\n");
+
+	// 测试12c：登录时签发恢复令牌；断线后保留期内凭令牌恢复，不验证口令，只补发错过的消息
+	printf("\nTest 12c: Session resume tokens...\n");
+	assert(session_resume_grace() == SESSION_RESUME_DEFAULT_GRACE);
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sender_pair) == 0);
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, receiver_pair) == 0);
+	connection_manager_add_from_fd(sender_pair[0], "127.0.0.1", 4);
+	assert(session_manager_authenticate(sender_pair[0], "alice", "alice123") == 1);
+	connection_manager_add_from_fd(receiver_pair[0], "127.0.0.1", 5);
+	lframe = build_login_to("charlie", "charlie123", "server;" PROTOCOL_OPTION_ACK ";" PROTOCOL_OPTION_RESUME);
+	assert(lframe != NULL);
+	lframe[strcspn(lframe, "\n")] = '\0';
+	assert(parse_message_into(lframe, strlen(lframe), &gmsg) == 0);
+	free(lframe);
+	assert(handle_command(receiver_pair[0], &gmsg) == 0);
+	n = recv(receiver_pair[1], burst, sizeof(burst) - 1, 0);
+	assert(n > 0);
+	burst[n] = '\0';
+	char *token_line = strstr(burst, "RESUME|server|charlie|");
+	assert(strstr(burst, "Login successful") != NULL && token_line != NULL && token_line > strstr(burst, "OK|"));
+	char token[SESSION_RESUME_TOKEN_LEN];
+	token_line[strcspn(token_line, "\n")] = '\0';
+	safe_strcpy(token, strrchr(token_line, '|') + 1, sizeof(token));
+	assert(strlen(token) == SESSION_RESUME_TOKEN_BYTES * 2);
+
+	uint32_t first_id = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		char text[32];
+		snprintf(text, sizeof(text), "before drop %d", i);
+		pframe = build_text_msg("alice", "charlie", text);
+		assert(pframe != NULL);
+		pframe[strcspn(pframe, "\n")] = '\0';
+		assert(parse_message_into(pframe, strlen(pframe), &gmsg) == 0);
+		free(pframe);
+		assert(handle_command(sender_pair[0], &gmsg) == 0);
+		n = recv(sender_pair[1], buf, sizeof(buf) - 1, 0);
+		assert(n > 0);
+		n = recv(receiver_pair[1], burst, sizeof(burst) - 1, 0);
+		assert(n > 0);
+		burst[n] = '\0';
+		burst[strcspn(burst, "\n")] = '\0';
+		assert(parse_message_into(burst, strlen(burst), &gmsg) == 0);
+		if (i == 0)
+			first_id = protocol_take_delivery_id(gmsg.timestamp);
+	}
+	assert(first_id > 0 && offline_queue_pending("charlie") == 2);
+
+	// 连接意外断开：有令牌的用户进入保留期，期间发来的消息照常排队
+	connection_manager_remove(receiver_pair[0]);
+	close(receiver_pair[0]);
+	close(receiver_pair[1]);
+	assert(session_resume_parked() == 1);
+	pframe = build_text_msg("alice", "charlie", "while dropped");
+	assert(pframe != NULL);
+	pframe[strcspn(pframe, "\n")] = '\0';
+	assert(parse_message_into(pframe, strlen(pframe), &gmsg) == 0);
+	free(pframe);
+	assert(handle_command(sender_pair[0], &gmsg) == 0);
+	n = recv(sender_pair[1], buf, sizeof(buf) - 1, 0);
+	assert(n > 0);
+
+	// 伪造的令牌和别人的用户名都被拒绝
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, receiver_pair) == 0);
+	connection_manager_add_from_fd(receiver_pair[0], "127.0.0.1", 5);
+	char *rframe = build_resume_request("charlie", "server;" PROTOCOL_OPTION_ACK, "00112233445566778899aabbccddeeff", 0);
+	assert(rframe != NULL);
+	rframe[strcspn(rframe, "\n")] = '\0';
+	assert(parse_message_into(rframe, strlen(rframe), &gmsg) == 0 && is_resume_msg(&gmsg));
+	free(rframe);
+	assert(handle_command(receiver_pair[0], &gmsg) == ERROR_AUTH_FAILED);
+	n = recv(receiver_pair[1], buf, sizeof(buf) - 1, 0);
+	assert(n > 0);
+	buf[n] = '\0';
+	assert(strstr(buf, "Session expired") != NULL);
+	assert(session_resume_claim("alice", token, NULL) != 0);
+	assert(session_manager_is_authenticated(receiver_pair[0]) == 0);
+
+	// 凭令牌恢复：确认断线前已收到的第一条，只补发之后的两条，并签发新令牌
+	rframe = build_resume_request("charlie", "server;" PROTOCOL_OPTION_ACK ";" PROTOCOL_OPTION_RESUME, token, first_id);
+	assert(rframe != NULL);
+	rframe[strcspn(rframe, "\n")] = '\0';
+	assert(parse_message_into(rframe, strlen(rframe), &gmsg) == 0);
+	free(rframe);
+	assert(handle_command(receiver_pair[0], &gmsg) == 0);
+	n = recv(receiver_pair[1], burst, sizeof(burst) - 1, 0);
+	assert(n > 0);
+	burst[n] = '\0';
+	assert(strstr(burst, "Session resumed, 2 offline messages") != NULL && strstr(burst, "|client;ack=") != NULL);
+	assert(strstr(burst, "before drop 0") == NULL);
+	assert(strstr(burst, "before drop 1") != NULL && strstr(burst, "while dropped") != NULL);
+	token_line = strstr(burst, "RESUME|server|charlie|");
+	assert(token_line != NULL && token_line < strstr(burst, "before drop 1"));
+	token_line[strcspn(token_line, "\n")] = '\0';
+	char next_token[SESSION_RESUME_TOKEN_LEN];
+	safe_strcpy(next_token, strrchr(token_line, '|') + 1, sizeof(next_token));
+	assert(strlen(next_token) == SESSION_RESUME_TOKEN_BYTES * 2 && strcmp(next_token, token) != 0);
+	assert(session_manager_is_authenticated(receiver_pair[0]) == 1);
+	assert(strcmp(session_manager_get_username(receiver_pair[0]), "charlie") == 0);
+	assert(session_resume_parked() == 0);
+
+	// 令牌只能使用一次
+	assert(session_resume_claim("charlie", token, NULL) != 0);
+
+	// 保留期结束仍未恢复：令牌作废
+	connection_manager_remove(receiver_pair[0]);
+	assert(session_resume_parked() == 1);
+	assert(session_resume_expire(platform_monotonic_ms()) == 0);
+	assert(session_resume_expire(platform_monotonic_ms() + SESSION_RESUME_DEFAULT_GRACE * 1000 + 1) == 1);
+	assert(session_resume_parked() == 0);
+	assert(session_resume_claim("charlie", next_token, NULL) != 0);
+
+	// 显式登出作废令牌，断开时不进入保留期
+	connection_manager_add_from_fd(receiver_pair[0], "127.0.0.1", 5);
+	lframe = build_login_to("charlie", "charlie123", "server;" PROTOCOL_OPTION_RESUME);
+	assert(lframe != NULL);
+	lframe[strcspn(lframe, "\n")] = '\0';
+	assert(parse_message_into(lframe, strlen(lframe), &gmsg) == 0);
+	free(lframe);
+	assert(handle_command(receiver_pair[0], &gmsg) == 0);
+	n = recv(receiver_pair[1], burst, sizeof(burst) - 1, 0);
+	assert(n > 0);
+	burst[n] = '\0';
+	assert(strstr(burst, "RESUME|server|charlie|") != NULL);
+	session_manager_logout(receiver_pair[0]);
+	connection_manager_remove(receiver_pair[0]);
+	assert(session_resume_parked() == 0);
+
+	session_resume_cleanup();
+	offline_queue_cleanup();
+	connection_manager_remove(sender_pair[0]);
+	for (int i = 0; i < 2; i++)
+	{
+		close(sender_pair[i]);
+		close(receiver_pair[i]);
+	}
+	printf("✓ Dropped session resumed by token, missed messages flushed, tokens single-use\n");
+#endif
+
 	// 清理
 	printf("\nCleaning up...\n");
 	connection_manager_remove(100);
 	connection_manager_remove(101);
 	connection_manager_cleanup();
+	user_store_cleanup();
+
+	// 测试13：用户库文件。新增用户先进日志，重启时重放；合并后直接在映射上查找
+	printf("\nTest 13: Persistent user database...\n");
+	const char *db = "test_users.db";
+	remove(db);
+	remove("test_users.db.journal");
+	set_log_level(LOG_WARNING);
+	user_store_set_hash_iterations(1);
+	assert(user_store_open(db) == 0);
+	assert(user_store_count() == 0);
+	assert(user_store_add("dave", "dave123") == 1);
+	assert(user_store_init_synthetic("p", 100) == 100);
+	int dave_id = user_store_find_by_username("dave")->user_id;
+	user_store_cleanup();
+
+	assert(user_store_open(db) == 0);
+	assert(user_store_mapped_count() == 0);
+	assert(user_store_count() == 101);
+	assert(user_store_authenticate("dave", "dave123") == 1);
+	assert(user_store_compact() == 0);
+	assert(user_store_mapped_count() == 101);
+	assert(user_store_find_by_id(dave_id) != NULL);
+	assert(strcmp(user_store_find_by_id(dave_id)->username, "dave") == 0);
+	assert(user_store_add("erin", "erin123") == 1);
+	user_store_cleanup();
+
+	assert(user_store_open(db) == 0);
+	assert(user_store_mapped_count() == 101);
+	assert(user_store_count() == 102);
+	assert(user_store_init_synthetic("p", 100) == 0);
+	assert(user_store_authenticate("p42", "p42123") == 1);
+	assert(user_store_authenticate("erin", "erin123") == 1);
+	assert(user_store_authenticate("dave", "wrong") == 0);
+	assert(user_store_find_by_username("p99")->user_id == user_store_find_by_id(user_store_find_by_username("p99")->user_id)->user_id);
+	assert(user_store_find_by_username("erin")->user_id > dave_id);
+	user_store_cleanup();
+
+	FILE *corrupt = fopen(db, "r+b");
+	assert(corrupt != NULL);
+	fputc('X', corrupt);
+	fclose(corrupt);
+	assert(user_store_open(db) == -1);
+	user_store_cleanup();
+	remove(db);
+	remove("test_users.db.journal");
+	user_store_set_hash_iterations(0);
+	set_log_level(LOG_INFO);
+	printf("✓ Journaled users replayed, compacted file mapped, corrupt header rejected\n");
+
+	// 测试14：按连接和按用户限流
+	printf("\nTest 14: Per-connection and per-user rate limits...\n");
+	RateLimitConfig limits = {{5, 1, 1000}, 2};
+	rate_limit_configure(&limits);
+	assert(rate_limit_enabled());
+	connection_manager_add_from_fd(700, "10.0.0.70", 700);
+	connection_manager_add_from_fd(701, "10.0.0.71", 701);
+	connection_manager_add_from_fd(702, "10.0.0.72", 702);
+	Client *c1 = connection_manager_find_by_fd(700);
+	Client *c2 = connection_manager_find_by_fd(701);
+	Client *c3 = connection_manager_find_by_fd(702);
+	uint64_t now = 1000000;
+	int admitted = 0;
+	while (rate_limit_admit(c1, CMD_SEND_MSG, now) == 0)
+		admitted++;
+	assert(admitted == 10);
+	assert(rate_limit_admit(c1, CMD_BROADCAST, now) == 0 && rate_limit_admit(c1, CMD_BROADCAST, now) == 0);
+	assert(rate_limit_admit(c1, CMD_BROADCAST, now) == -1);
+	assert(rate_limit_admit(c1, CMD_SEND_MSG, now + 200) == 0 && rate_limit_admit(c1, CMD_SEND_MSG, now + 200) == -1);
+	assert(rate_limit_admit(c2, CMD_SEND_MSG, now) == 0);
+	/* 同一用户的两个连接合计不超过单连接的 2 倍 */
+	connection_manager_set_auth(701, 1, "ratey");
+	connection_manager_set_auth(702, 1, "ratey");
+	admitted = 0;
+	while (rate_limit_admit(c2, CMD_SEND_MSG, now) == 0)
+		admitted++;
+	while (rate_limit_admit(c3, CMD_SEND_MSG, now) == 0)
+		admitted++;
+	assert(admitted == 19);
+	assert(rate_limit_charge_bytes(c1, 2000, now) == 0 && rate_limit_charge_bytes(c1, 500, now) == 500);
+	assert(rate_limit_charge_bytes(c3, 4500, now) == 2500);
+	for (int fd = 700; fd < 703; fd++)
+		connection_manager_remove(fd);
+	rate_limit_configure(NULL);
+	rate_limit_cleanup();
+	assert(!rate_limit_enabled());
+	printf("✓ Buckets per kind, refill over time, users share a multiplied budget, bytes report the pause\n");
 
 	printf("\n=== All session tests passed! ===\n");
 	return 0;
@@ -1,8 +1,149 @@
 // tests/test_utils.c - 创建这个文件
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "../src/utils/utils.h"
 
+#define ASYNC_LOG_THREADS 4
+#define ASYNC_LOG_LINES 2000
+#define POOL_THREADS 4
+#define POOL_ROUNDS 2000
+#define EPOCH_READERS 4
+#define EPOCH_ROUNDS 20000
+
+/* 对象池测试的对象，大小不是对齐的整数倍 */
+typedef struct
+{
+	int id;
+	char payload[37];
+} PoolItem;
+
+/* 把摘要转成十六进制字符串，便于与公开的测试向量比较 */
+static const char *hex_digest(const unsigned char *digest, size_t len)
+{
+	static char hex[SHA256_DIGEST_LEN * 2 + 1];
+	for (size_t i = 0; i < len && i < SHA256_DIGEST_LEN; i++)
+		snprintf(hex + i * 2, 3, "%02x", digest[i]);
+	return hex;
+}
+
+static ObjectPool test_pool = OBJECT_POOL_INITIALIZER("test", sizeof(PoolItem), 16);
+
+/* 时间轮测试：记录每个定时器的触发次数和最后一次触发的刻度，ctx 为要顺带取消的定时器 */
+static TimerWheel test_wheel;
+static int timer_fired[4];
+static uint64_t timer_fired_at[4];
+static TimerNode test_timers[4];
+
+static void count_timer(TimerNode *timer, void *ctx)
+{
+	int index = (int)(timer - test_timers);
+	timer_fired[index]++;
+	timer_fired_at[index] = test_wheel.tick - 1;
+	if (ctx)
+		timer_wheel_cancel(&test_wheel, (TimerNode *)ctx);
+}
+
+/* 异步日志测试的写入线程 */
+static platform_thread_return_t PLATFORM_THREAD_CALL async_log_writer(void *arg)
+{
+	int id = *(int *)arg;
+	for (int i = 0; i < ASYNC_LOG_LINES; i++)
+		LOG_INFO("async-%d-%d", id, i);
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/* 指标测试的记录线程：各自计数并记录 1..1000 */
+static platform_thread_return_t PLATFORM_THREAD_CALL metrics_writer(void *arg)
+{
+	(void)arg;
+	for (uint64_t v = 1; v <= 1000; v++)
+	{
+		metrics_add(0, 1);
+		metrics_record(0, v);
+	}
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/* 对象池测试的工作线程：分配一批对象，写入后校验再全部释放 */
+static platform_thread_return_t PLATFORM_THREAD_CALL pool_worker(void *arg)
+{
+	int id = *(int *)arg;
+	PoolItem *items[64];
+	for (int round = 0; round < POOL_ROUNDS; round++)
+	{
+		int n = 1 + (round * 7 + id) % 64;
+		for (int i = 0; i < n; i++)
+		{
+			items[i] = (PoolItem *)object_pool_alloc(&test_pool);
+			if (!items[i] || items[i]->id != 0)
+			{
+				*(int *)arg = -1;
+				return PLATFORM_THREAD_RETURN_VALUE;
+			}
+			items[i]->id = id * 1000 + i;
+		}
+		for (int i = 0; i < n; i++)
+		{
+			if (items[i]->id != id * 1000 + i)
+				*(int *)arg = -1;
+			object_pool_free(&test_pool, items[i]);
+		}
+	}
+	object_pool_thread_release();
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/* 纪元回收测试：回收函数只做标记不释放，读者在临界区内看到已回收的对象即为错误 */
+typedef struct
+{
+	EpochNode node;
+	atomic_int dead;
+} EpochItem;
+
+static EpochItem epoch_items[EPOCH_ROUNDS + 1];
+static _Atomic(EpochItem *) epoch_current;
+static atomic_int epoch_stop;
+static atomic_int epoch_held;
+static atomic_int epoch_violations;
+
+static void reclaim_epoch_item(EpochNode *node)
+{
+	atomic_store(&((EpochItem *)node)->dead, 1);
+}
+
+/* 进入临界区后一直停留，直到主线程清除 epoch_held */
+static platform_thread_return_t PLATFORM_THREAD_CALL epoch_holder(void *arg)
+{
+	(void)arg;
+	epoch_enter();
+	atomic_store(&epoch_held, 1);
+	while (atomic_load(&epoch_held))
+		platform_sleep_ms(1);
+	epoch_exit();
+	epoch_thread_release();
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
+/* 不断读取当前对象，检查临界区内它一直没有被回收 */
+static platform_thread_return_t PLATFORM_THREAD_CALL epoch_reader(void *arg)
+{
+	(void)arg;
+	while (!atomic_load(&epoch_stop))
+	{
+		epoch_enter();
+		EpochItem *item = atomic_load(&epoch_current);
+		for (int i = 0; i < 32; i++)
+		{
+			if (atomic_load(&item->dead))
+				atomic_fetch_add(&epoch_violations, 1);
+		}
+		epoch_exit();
+	}
+	epoch_thread_release();
+	return PLATFORM_THREAD_RETURN_VALUE;
+}
+
 int main()
 {
 	set_log_file(NULL);
@@ -21,6 +162,25 @@ int main()
 	get_current_time(time_buf, sizeof(time_buf));
 	printf("Current time: %s\n", time_buf);
 
+	// 测试按秒缓存的时间戳：同一秒结果一致，换秒后重新格式化，缓冲区过小时为空
+	char cached_a[32], cached_b[32], tiny[8];
+	time_t fixed = 1700000000;
+	format_timestamp(fixed, cached_a, sizeof(cached_a));
+	format_timestamp(fixed + 60, cached_b, sizeof(cached_b));
+	format_timestamp(fixed, tiny, sizeof(tiny));
+	if (strlen(cached_a) != 19 || strcmp(cached_a, cached_b) == 0 || tiny[0] != '\0' ||
+		strcmp(cached_b + 17, cached_a + 17) != 0)
+	{
+		printf("FAIL: cached timestamp %s / %s\n", cached_a, cached_b);
+		return 1;
+	}
+	format_timestamp(fixed, cached_b, sizeof(cached_b));
+	if (strcmp(cached_a, cached_b) != 0 || parse_timestamp(cached_a) != fixed)
+	{
+		printf("FAIL: cached timestamp did not round-trip: %s\n", cached_b);
+		return 1;
+	}
+
 	// 测试安全字符串函数
 	char dest[10];
 	size_t copied = safe_strcpy(dest, "Hello", sizeof(dest));
@@ -37,6 +197,501 @@ int main()
 	safe_free((void **)&ptr);
 	printf("Freed memory, pointer is now: %p\n", (void *)ptr);
 
+	// 测试分帧缓冲区：一次读取包含多帧，以及半帧跨读取拼接
+	FrameBuffer fb;
+	char *frame;
+	size_t frame_len;
+	size_t space;
+	const char *chunk1 = "MSG|a|b||one\nMSG|a|b||two\r\nMSG|a|b||th";
+	const char *chunk2 = "ree\n";
+	frame_buffer_init(&fb, 64);
+	char *dst = frame_buffer_reserve(&fb, 128, &space);
+	memcpy(dst, chunk1, strlen(chunk1));
+	frame_buffer_commit(&fb, strlen(chunk1));
+	if (frame_buffer_next(&fb, &frame, &frame_len) != 1 || strcmp(frame, "MSG|a|b||one") != 0 ||
+		frame_buffer_next(&fb, &frame, &frame_len) != 1 || strcmp(frame, "MSG|a|b||two") != 0 ||
+		frame_buffer_next(&fb, &frame, &frame_len) != 0)
+	{
+		printf("FAIL: frame buffer did not split coalesced frames\n");
+		return 1;
+	}
+	frame_buffer_compact(&fb);
+	dst = frame_buffer_reserve(&fb, 128, &space);
+	memcpy(dst, chunk2, strlen(chunk2));
+	frame_buffer_commit(&fb, strlen(chunk2));
+	if (frame_buffer_next(&fb, &frame, &frame_len) != 1 || strcmp(frame, "MSG|a|b||three") != 0 ||
+		frame_len != strlen("MSG|a|b||three") || frame_buffer_pending(&fb) != 0)
+	{
+		printf("FAIL: frame buffer did not join split frame\n");
+		return 1;
+	}
+	frame_buffer_compact(&fb);
+	dst = frame_buffer_reserve(&fb, 128, &space);
+	memset(dst, 'x', 100);
+	frame_buffer_commit(&fb, 100);
+	if (frame_buffer_next(&fb, &frame, &frame_len) != -1)
+	{
+		printf("FAIL: frame buffer accepted oversized frame\n");
+		return 1;
+	}
+	frame_buffer_free(&fb);
+	printf("Frame buffer split/join/overflow checks passed\n");
+
+#ifndef _WIN32
+	// 测试发送队列：对端不读时积压，读走后继续刷新，顺序不变
+	int pair[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+	{
+		printf("FAIL: socketpair\n");
+		return 1;
+	}
+	platform_socket_set_nonblocking(pair[0]);
+	SendQueue sq;
+	send_queue_init(&sq, 64 * 1024 * 1024);
+	const int frames = 100000;
+	size_t total = (size_t)frames * 14;
+	char *expected = (char *)malloc(total + 1);
+	char *actual = (char *)malloc(total);
+	for (int i = 0; i < frames; i++)
+	{
+		snprintf(expected + i * 14, 15, "frame-%06d\n", i);
+		send_queue_push(&sq, expected + i * 14, 14);
+	}
+	int flushed = send_queue_flush(&sq, pair[0]);
+	size_t pending_after_first = send_queue_bytes(&sq);
+	size_t received = 0;
+	while (received < total)
+	{
+		ssize_t n = recv(pair[1], actual + received, total - received, MSG_DONTWAIT);
+		if (n > 0)
+			received += (size_t)n;
+		if (flushed == 0)
+			flushed = send_queue_flush(&sq, pair[0]);
+		if (flushed < 0 || (n <= 0 && flushed == 1 && received < total))
+		{
+			printf("FAIL: send queue lost data\n");
+			return 1;
+		}
+	}
+	if (flushed != 1 || pending_after_first == 0 || memcmp(expected, actual, total) != 0)
+	{
+		printf("FAIL: send queue reordered or never queued frames\n");
+		return 1;
+	}
+	free(expected);
+	free(actual);
+	send_queue_free(&sq);
+	platform_socket_close(pair[0]);
+	platform_socket_close(pair[1]);
+	printf("Send queue flushed %d frames in order (%zu bytes were pending)\n", frames, pending_after_first);
+
+	// 测试共享帧：多个队列引用同一帧，全部发出后才释放
+	SendQueue a, b;
+	char shared_buf[32];
+	send_queue_init(&a, 0);
+	send_queue_init(&b, 0);
+	SharedFrame *shared = shared_frame_create("BROADCAST|x|*||hi\n", 18);
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0 ||
+		send_queue_push_shared(&a, shared, 0) != 0 || send_queue_push_shared(&b, shared, 10) != 0 ||
+		atomic_load(&shared->refs) != 3 || send_queue_bytes(&b) != 8)
+	{
+		printf("FAIL: shared frame was not referenced by both queues\n");
+		return 1;
+	}
+	send_queue_push(&b, "OK\n", 3);
+	if (send_queue_copy(&b, shared_buf, sizeof(shared_buf)) != 11 || memcmp(shared_buf, "x|*||hi\nOK\n", 11) != 0 ||
+		send_queue_copy(&b, shared_buf, 4) != 4 || send_queue_bytes(&b) != 11)
+	{
+		printf("FAIL: send queue copy skipped the sent prefix or modified the queue\n");
+		return 1;
+	}
+	send_queue_flush(&a, pair[0]);
+	send_queue_flush(&b, pair[0]);
+	if (atomic_load(&shared->refs) != 1 || recv(pair[1], shared_buf, sizeof(shared_buf), 0) != 29 ||
+		memcmp(shared_buf, "BROADCAST|x|*||hi\nx|*||hi\nOK\n", 29) != 0)
+	{
+		printf("FAIL: shared frame refs or data wrong after flush\n");
+		return 1;
+	}
+	shared_frame_release(shared);
+	send_queue_free(&a);
+	send_queue_free(&b);
+	platform_socket_close(pair[0]);
+	platform_socket_close(pair[1]);
+	printf("Shared frame fan-out checks passed\n");
+
+	// 测试无锁队列：生产者交换了队尾但尚未链接时 pop 取不到，empty 也不能报告为空
+	MpscQueue queue;
+	MpscNode nodes[2];
+	mpsc_queue_init(&queue);
+	if (!mpsc_queue_empty(&queue) || mpsc_queue_pop(&queue))
+	{
+		printf("FAIL: new mpsc queue is not empty\n");
+		return 1;
+	}
+	mpsc_queue_push(&queue, &nodes[0]);
+	if (mpsc_queue_empty(&queue) || mpsc_queue_pop(&queue) != &nodes[0] || !mpsc_queue_empty(&queue))
+	{
+		printf("FAIL: mpsc queue push/pop\n");
+		return 1;
+	}
+	/* 模拟 mpsc_queue_push 的前半步：只交换队尾，不链接 */
+	atomic_store(&nodes[1].next, NULL);
+	MpscNode *prev = atomic_exchange(&queue.head, &nodes[1]);
+	if (mpsc_queue_pop(&queue) || mpsc_queue_empty(&queue))
+	{
+		printf("FAIL: mpsc queue reported empty while a push was in progress\n");
+		return 1;
+	}
+	atomic_store(&prev->next, &nodes[1]);
+	if (mpsc_queue_pop(&queue) != &nodes[1] || !mpsc_queue_empty(&queue))
+	{
+		printf("FAIL: mpsc queue lost the completed push\n");
+		return 1;
+	}
+	printf("MPSC queue checks passed\n");
+
+	// 测试异步发送用的取出与确认：取出不修改队列，确认后按字节移除，移走后原队列为空
+	SendQueue pending, moved;
+	platform_iovec_t gathered[4];
+	send_queue_init(&pending, 0);
+	send_queue_push(&pending, "abc", 3);
+	send_queue_push(&pending, "defg", 4);
+	send_queue_push(&pending, "hi", 2);
+	if (send_queue_gather(&pending, gathered, 2) != 2 || gathered[1].iov_len != 4 ||
+		send_queue_bytes(&pending) != 9 || send_queue_consume(&pending, 5) != 0 ||
+		send_queue_gather(&pending, gathered, 4) != 2 || gathered[0].iov_len != 2 ||
+		memcmp(gathered[0].iov_base, "fg", 2) != 0 || send_queue_bytes(&pending) != 4)
+	{
+		printf("FAIL: send queue gather/consume\n");
+		return 1;
+	}
+	send_queue_init(&moved, 0);
+	send_queue_move(&moved, &pending);
+	if (!send_queue_empty(&pending) || send_queue_bytes(&moved) != 4 || send_queue_consume(&moved, 4) != 1 ||
+		!send_queue_empty(&moved))
+	{
+		printf("FAIL: send queue move\n");
+		return 1;
+	}
+	send_queue_free(&pending);
+	send_queue_free(&moved);
+	printf("Send queue gather/consume/move checks passed\n");
+#endif
+
+	// 测试对象池：复用已释放的对象，计数和峰值正确，多线程并发分配互不重叠
+	if (object_pool_reserve(&test_pool, 40) != 0 || object_pool_capacity(&test_pool) != 48)
+	{
+		printf("FAIL: object pool reserve\n");
+		return 1;
+	}
+	PoolItem *first = (PoolItem *)object_pool_alloc(&test_pool);
+	PoolItem *second = (PoolItem *)object_pool_alloc(&test_pool);
+	if (!first || !second || first == second || ((size_t)first % 16) != 0 ||
+		object_pool_in_use(&test_pool) != 2)
+	{
+		printf("FAIL: object pool alloc\n");
+		return 1;
+	}
+	first->id = 42;
+	object_pool_free(&test_pool, first);
+	PoolItem *again = (PoolItem *)object_pool_alloc(&test_pool);
+	if (again != first || again->id != 0)
+	{
+		printf("FAIL: object pool did not reuse a zeroed object\n");
+		return 1;
+	}
+	object_pool_free(&test_pool, again);
+	object_pool_free(&test_pool, second);
+
+	platform_thread_t pool_threads[POOL_THREADS];
+	int pool_ids[POOL_THREADS];
+	for (int i = 0; i < POOL_THREADS; i++)
+	{
+		pool_ids[i] = i + 1;
+		platform_thread_create(&pool_threads[i], pool_worker, &pool_ids[i]);
+	}
+	for (int i = 0; i < POOL_THREADS; i++)
+		platform_thread_join(pool_threads[i]);
+	for (int i = 0; i < POOL_THREADS; i++)
+	{
+		if (pool_ids[i] < 0)
+		{
+			printf("FAIL: object pool handed out an object twice\n");
+			return 1;
+		}
+	}
+	object_pool_thread_release();
+	size_t pool_peak = object_pool_high_water(&test_pool);
+	if (object_pool_in_use(&test_pool) != 0 || pool_peak < 64 || pool_peak > POOL_THREADS * 64 ||
+		object_pool_capacity(&test_pool) > POOL_THREADS * (64 + 2 * OBJECT_POOL_BATCH) + 48)
+	{
+		printf("FAIL: object pool counters in_use=%zu peak=%zu capacity=%zu\n",
+			   object_pool_in_use(&test_pool), pool_peak, object_pool_capacity(&test_pool));
+		return 1;
+	}
+	object_pool_destroy(&test_pool);
+	if (object_pool_capacity(&test_pool) != 0 || !object_pool_alloc(&test_pool))
+	{
+		printf("FAIL: object pool not reusable after destroy\n");
+		return 1;
+	}
+	object_pool_destroy(&test_pool);
+	printf("Object pool checks passed (peak %zu objects)\n", pool_peak);
+
+	// 测试纪元回收：有读者停留在临界区时不回收，离开后回收
+	platform_thread_t holder;
+	atomic_store(&epoch_current, &epoch_items[0]);
+	platform_thread_create(&holder, epoch_holder, NULL);
+	while (!atomic_load(&epoch_held))
+		platform_sleep_ms(1);
+	atomic_store(&epoch_current, &epoch_items[1]);
+	epoch_retire(&epoch_items[0].node, reclaim_epoch_item);
+	if (epoch_collect() != 0 || atomic_load(&epoch_items[0].dead) || epoch_pending() != 1)
+	{
+		printf("FAIL: epoch reclaimed a node an active reader may hold\n");
+		return 1;
+	}
+	atomic_store(&epoch_held, 0);
+	platform_thread_join(holder);
+	if (epoch_collect() != 1 || !atomic_load(&epoch_items[0].dead) || epoch_pending() != 0)
+	{
+		printf("FAIL: epoch did not reclaim after the reader left\n");
+		return 1;
+	}
+
+	// 读者不断读取当前对象，写者每轮换一个新对象并登记旧对象
+	platform_thread_t epoch_threads[EPOCH_READERS];
+	for (int i = 0; i < EPOCH_READERS; i++)
+		platform_thread_create(&epoch_threads[i], epoch_reader, NULL);
+	for (int i = 2; i <= EPOCH_ROUNDS; i++)
+	{
+		atomic_store(&epoch_current, &epoch_items[i]);
+		epoch_retire(&epoch_items[i - 1].node, reclaim_epoch_item);
+	}
+	size_t epoch_backlog = epoch_pending();
+	atomic_store(&epoch_stop, 1);
+	for (int i = 0; i < EPOCH_READERS; i++)
+		platform_thread_join(epoch_threads[i]);
+	epoch_synchronize();
+	for (int i = 0; i < EPOCH_ROUNDS; i++)
+	{
+		if (!atomic_load(&epoch_items[i].dead))
+		{
+			printf("FAIL: epoch item %d was never reclaimed\n", i);
+			return 1;
+		}
+	}
+	if (atomic_load(&epoch_violations) != 0 || atomic_load(&epoch_items[EPOCH_ROUNDS].dead) || epoch_pending() != 0)
+	{
+		printf("FAIL: epoch readers saw %d reclaimed nodes\n", atomic_load(&epoch_violations));
+		return 1;
+	}
+	printf("Epoch reclamation: %d retirements, %zu pending when the readers stopped\n", EPOCH_ROUNDS - 1,
+		   epoch_backlog);
+
+	// 测试线性分配区：对齐、撤销最近一次分配、溢出到堆、重置
+	char arena_buffer[256];
+	Arena arena;
+	arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+	char *a1 = (char *)arena_alloc(&arena, 10);
+	char *a2 = (char *)arena_alloc(&arena, 100);
+	if (!a1 || !a2 || ((size_t)(a2 - a1) % 8) != 0 || !arena_owns(&arena, a2))
+	{
+		printf("FAIL: arena alloc\n");
+		return 1;
+	}
+	arena_trim(&arena, a2, 0);
+	char *a3 = (char *)arena_alloc(&arena, 250);
+	if (a3 == a2 || !arena_owns(&arena, a3) || arena.overflow_count != 1)
+	{
+		printf("FAIL: arena trim or overflow\n");
+		return 1;
+	}
+	arena_trim(&arena, a1, 0); /* 不是最近一次分配，忽略 */
+	if (arena_alloc(&arena, 8) != a2)
+	{
+		printf("FAIL: arena did not reuse trimmed space\n");
+		return 1;
+	}
+	arena_reset(&arena);
+	if (arena.used != 0 || arena.overflow || arena_alloc(&arena, 16) != a1)
+	{
+		printf("FAIL: arena reset\n");
+		return 1;
+	}
+	arena_reset(&arena);
+	printf("Arena checks passed (peak %zu bytes)\n", arena.peak);
+
+	// 测试时间轮：跨层级联后准时触发、周期定时器、回调中取消、超出范围的延迟
+	timer_wheel_init(&test_wheel, 10, 1000);
+	timer_init(&test_timers[0], count_timer, NULL);
+	timer_init(&test_timers[1], count_timer, NULL);
+	timer_init(&test_timers[2], count_timer, &test_timers[3]);
+	timer_init(&test_timers[3], count_timer, NULL);
+	timer_wheel_schedule(&test_wheel, &test_timers[0], 50000, 0);  /* 5000 刻度，第2层 */
+	timer_wheel_schedule(&test_wheel, &test_timers[1], 300, 300);  /* 每30刻度 */
+	timer_wheel_schedule(&test_wheel, &test_timers[2], 640, 0);	   /* 刚好进入第1层，触发时取消 3 */
+	timer_wheel_schedule(&test_wheel, &test_timers[3], 700, 0);
+	if (timer_wheel_count(&test_wheel) != 4 || timer_wheel_timeout(&test_wheel, 1000, 5000) != 300)
+	{
+		printf("FAIL: timer wheel schedule\n");
+		return 1;
+	}
+	for (uint64_t now = 1000; now <= 1000 + 60000; now += 8)
+		timer_wheel_advance(&test_wheel, now);
+	if (timer_fired[0] != 1 || timer_fired_at[0] != 5000 || timer_fired[2] != 1 || timer_fired_at[2] != 64 ||
+		timer_fired[3] != 0 || timer_fired[1] != 200 || timer_fired_at[1] != 6000 ||
+		timer_wheel_count(&test_wheel) != 1)
+	{
+		printf("FAIL: timer wheel fired %d@%llu %d@%llu %d@%llu %d\n", timer_fired[0],
+			   (unsigned long long)timer_fired_at[0], timer_fired[1], (unsigned long long)timer_fired_at[1],
+			   timer_fired[2], (unsigned long long)timer_fired_at[2], timer_fired[3]);
+		return 1;
+	}
+	timer_wheel_cancel(&test_wheel, &test_timers[1]);
+	timer_wheel_schedule(&test_wheel, &test_timers[0], (uint64_t)20000000 * 10, 0); /* 超出 64^4 刻度 */
+	timer_wheel_advance(&test_wheel, 1000 + (uint64_t)16777216 * 10);
+	if (timer_fired[0] != 1 || !timer_pending(&test_timers[0]))
+	{
+		printf("FAIL: timer wheel fired a clamped timer early\n");
+		return 1;
+	}
+	timer_wheel_advance(&test_wheel, 1000 + (uint64_t)20006001 * 10);
+	if (timer_fired[0] != 2 || timer_pending(&test_timers[0]) || timer_wheel_count(&test_wheel) != 0)
+	{
+		printf("FAIL: timer wheel lost a clamped timer\n");
+		return 1;
+	}
+	printf("Timer wheel checks passed\n");
+
+	// 测试令牌桶：首次使用装满、按时间补充、不超过容量、透支后按速率还清
+	TokenBucket bucket = {0};
+	int taken = 0;
+	while (token_bucket_take(&bucket, 10, 20, 1, 5000))
+		taken++;
+	if (taken != 20 || token_bucket_take(&bucket, 10, 20, 1, 5099) || !token_bucket_take(&bucket, 10, 20, 1, 5100) ||
+		!token_bucket_take(&bucket, 0, 0, 1000, 5100))
+	{
+		printf("FAIL: token bucket take (%d taken)\n", taken);
+		return 1;
+	}
+	taken = 0;
+	while (token_bucket_take(&bucket, 10, 20, 1, 3600000))
+		taken++;
+	uint64_t wait_ms = token_bucket_charge(&bucket, 1000, 2000, 2500, 3600000);
+	if (taken != 20 || wait_ms != 2500 || token_bucket_charge(&bucket, 1000, 2000, 0, 3601000) != 1500 ||
+		token_bucket_charge(&bucket, 1000, 2000, 0, 3602500) != 0)
+	{
+		printf("FAIL: token bucket charge (%d taken, wait %llu)\n", taken, (unsigned long long)wait_ms);
+		return 1;
+	}
+	printf("Token bucket checks passed\n");
+
+	// 测试指标：多线程记录后合并，分位数误差不超过一个子桶（25%）
+	platform_thread_t metric_threads[2];
+	MetricsSummary summary;
+	char scrape[2048];
+	metrics_define_counter(0, "requests");
+	metrics_define_histogram(0, "latency_us", "command=\"TEST\"");
+	for (int i = 0; i < 2; i++)
+		platform_thread_create(&metric_threads[i], metrics_writer, NULL);
+	for (int i = 0; i < 2; i++)
+		platform_thread_join(metric_threads[i]);
+	if (metrics_counter(0) != 2000 || metrics_histogram(0, &summary) != 0 || summary.count != 2000 ||
+		summary.sum != 1001000 || summary.max != 1000 || summary.p50 < 500 || summary.p50 > 625 ||
+		summary.p99 < 990 || summary.p99 > 1000)
+	{
+		printf("FAIL: metrics count=%llu p50=%llu p99=%llu max=%llu\n", (unsigned long long)summary.count,
+			   (unsigned long long)summary.p50, (unsigned long long)summary.p99, (unsigned long long)summary.max);
+		return 1;
+	}
+	metrics_format(scrape, sizeof(scrape), "t");
+	if (!strstr(scrape, "t_requests_total 2000\n") ||
+		!strstr(scrape, "t_latency_us{command=\"TEST\",quantile=\"0.99\"}") ||
+		!strstr(scrape, "t_latency_us_count{command=\"TEST\"} 2000\n"))
+	{
+		printf("FAIL: metrics format:\n%s", scrape);
+		return 1;
+	}
+	printf("Metrics checks passed (p50 %llu, p99 %llu)\n", (unsigned long long)summary.p50,
+		   (unsigned long long)summary.p99);
+
+	// 测试摘要：FIPS 180-4、RFC 4231 和 RFC 7914 的测试向量，增量输入与一次输入结果相同
+	unsigned char digest[SHA256_DIGEST_LEN];
+	const char *two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	Sha256Context sha;
+	sha256("abc", 3, digest);
+	if (strcmp(hex_digest(digest, sizeof(digest)), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") != 0)
+	{
+		printf("FAIL: sha256(abc) = %s\n", hex_digest(digest, sizeof(digest)));
+		return 1;
+	}
+	sha256_init(&sha);
+	for (size_t i = 0; i < strlen(two_blocks); i += 5)
+		sha256_update(&sha, two_blocks + i, strlen(two_blocks) - i < 5 ? strlen(two_blocks) - i : 5);
+	sha256_final(&sha, digest);
+	if (strcmp(hex_digest(digest, sizeof(digest)), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") != 0)
+	{
+		printf("FAIL: incremental sha256 = %s\n", hex_digest(digest, sizeof(digest)));
+		return 1;
+	}
+	hmac_sha256("Jefe", 4, "what do ya want for nothing?", 28, digest);
+	if (strcmp(hex_digest(digest, sizeof(digest)), "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843") != 0)
+	{
+		printf("FAIL: hmac_sha256 = %s\n", hex_digest(digest, sizeof(digest)));
+		return 1;
+	}
+	if (pbkdf2_sha256("password", 8, (const unsigned char *)"salt", 4, 1, digest, sizeof(digest)) != 0 ||
+		strcmp(hex_digest(digest, sizeof(digest)), "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b") != 0 ||
+		pbkdf2_sha256("password", 8, (const unsigned char *)"salt", 4, 4096, digest, sizeof(digest)) != 0 ||
+		strcmp(hex_digest(digest, sizeof(digest)), "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a") != 0 ||
+		pbkdf2_sha256("password", 8, (const unsigned char *)"salt", 4, 0, digest, sizeof(digest)) != -1)
+	{
+		printf("FAIL: pbkdf2_sha256 = %s\n", hex_digest(digest, sizeof(digest)));
+		return 1;
+	}
+	printf("Digest checks passed\n");
+
+	// 测试异步日志：多线程并发写入，停止后每条要么写出要么计入丢弃数
+	const char *async_path = "test_async.log";
+	platform_thread_t writers[ASYNC_LOG_THREADS];
+	int writer_ids[ASYNC_LOG_THREADS];
+	remove(async_path);
+	set_log_file(async_path);
+	if (log_start_async(1024, 10) != 0)
+	{
+		printf("FAIL: async logger did not start\n");
+		return 1;
+	}
+	for (int i = 0; i < ASYNC_LOG_THREADS; i++)
+	{
+		writer_ids[i] = i;
+		platform_thread_create(&writers[i], async_log_writer, &writer_ids[i]);
+	}
+	for (int i = 0; i < ASYNC_LOG_THREADS; i++)
+		platform_thread_join(writers[i]);
+	log_stop_async();
+	set_log_file(NULL);
+
+	FILE *lf = fopen(async_path, "r");
+	char line[256];
+	size_t logged = 0;
+	while (lf && fgets(line, sizeof(line), lf))
+	{
+		if (strstr(line, "INFO: async-"))
+			logged++;
+	}
+	if (lf)
+		fclose(lf);
+	remove(async_path);
+	if (logged + log_dropped_count() != (size_t)ASYNC_LOG_THREADS * ASYNC_LOG_LINES || logged == 0)
+	{
+		printf("FAIL: async logger wrote %zu lines, dropped %zu\n", logged, log_dropped_count());
+		return 1;
+	}
+	printf("Async logger wrote %zu lines, dropped %zu\n", logged, log_dropped_count());
+
 	printf("\n=== All utils tests completed ===\n");
 	return 0;
 }